@@ -0,0 +1,899 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+extern "C" {
+#include "fstapi.h"
+}
+
+// Reader benchmark: compares read paths on one trace.  Without a file
+// argument a synthetic multi-block trace is generated first.
+//
+//   bench_fst_reader [trace.fst [iterations]]
+
+struct BenchCounters {
+    uint64_t changes = 0;
+    uint64_t bytes = 0;
+};
+
+static void count_callback(void* user_data, uint64_t, fstHandle, const unsigned char* value) {
+    BenchCounters* c = static_cast<BenchCounters*>(user_data);
+    c->changes++;
+    c->bytes += value[0];
+}
+
+static void count_callback_varlen(void* user_data, uint64_t, fstHandle, const unsigned char*, uint32_t len) {
+    BenchCounters* c = static_cast<BenchCounters*>(user_data);
+    c->changes++;
+    c->bytes += len;
+}
+
+// Read syscalls issued by this process so far (Linux only, -1 elsewhere).
+static long long read_syscalls() {
+    FILE* f = fopen("/proc/self/io", "r");
+    long long syscr = -1;
+    if (f) {
+        char line[128];
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, "syscr:", 6)) {
+                syscr = atoll(line + 6);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return syscr;
+}
+
+// Resident memory of this process in kB (Linux only, -1 elsewhere).
+static long long resident_kb() {
+    FILE* f = fopen("/proc/self/status", "r");
+    long long kb = -1;
+    if (f) {
+        char line[128];
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, "VmRSS:", 6)) {
+                kb = atoll(line + 6);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kb;
+}
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool write_bench_trace(const char* filename, int num_signals, int num_steps,
+                              enum fstWriterPackType pack = FST_WR_PT_LZ4, int flush_threads = 0,
+                              int parallel_depth = 0, double* max_stall_ms = nullptr) {
+    void* wctx = fstWriterCreate(filename, 1);
+    if (!wctx) return false;
+
+    fstWriterSetPackType(wctx, pack);
+    fstWriterSetFlushThreads(wctx, flush_threads);
+    if (parallel_depth) {
+        fstWriterSetParallelDepth(wctx, parallel_depth);
+        fstWriterSetParallelMode(wctx, 1);
+    }
+    fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+    std::vector<fstHandle> handles;
+    for (int i = 0; i < num_signals; i++) {
+        std::string name = "sig" + std::to_string(i);
+        handles.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, (i & 3) ? 16 : 1, name.c_str(), 0));
+    }
+    fstWriterSetUpscope(wctx);
+
+    char bits[17] = {0};
+    uint32_t lfsr = 0xACE1u;
+    for (int t = 0; t < num_steps; t++) {
+        double t0 = max_stall_ms ? now_ms() : 0;
+        fstWriterEmitTimeChange(wctx, (uint64_t)t);    // flushes what was queued before
+        if (max_stall_ms) *max_stall_ms = std::max(*max_stall_ms, now_ms() - t0);
+        for (int i = 0; i < num_signals; i++) {
+            lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+            if (lfsr & 7) continue;
+            if (i & 3) {
+                for (int b = 0; b < 16; b++) bits[b] = (char)('0' + ((lfsr >> b) & 1));
+                fstWriterEmitValueChange(wctx, handles[i], bits);
+            } else {
+                fstWriterEmitValueChange(wctx, handles[i], (lfsr & 8) ? "1" : "0");
+            }
+        }
+        if (t && (t % 2000) == 0) fstWriterFlushContext(wctx);
+    }
+    fstWriterClose(wctx);
+    return true;
+}
+
+static void bench_iter_blocks(const char* filename, int iterations, bool use_mmap) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstReaderSetMmapIo(ctx, use_mmap ? 1 : 0);
+    fstReaderSetFacProcessMaskAll(ctx);
+
+    BenchCounters counters;
+    long long syscr_before = read_syscalls();
+    double t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &counters, nullptr);
+    }
+    double iter_ms = (now_ms() - t0) / iterations;
+    long long syscr_iter = read_syscalls() - syscr_before;
+
+    // value-at-time sweep over a handful of signals, the cursor readout pattern
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    uint64_t step = end_time / 1000 + 1;
+    char buf[4096];
+    syscr_before = read_syscalls();
+    t0 = now_ms();
+    for (uint64_t t = 0; t <= end_time; t += step) {
+        for (fstHandle h = 1; h <= maxhandle && h <= 8; h++) {
+            fstReaderGetValueFromHandleAtTime(ctx, t, h, buf);
+        }
+    }
+    double rvat_ms = now_ms() - t0;
+    long long syscr_rvat = read_syscalls() - syscr_before;
+
+    printf("  %-6s  iter: %9.2f ms  %8lld read syscalls  | rvat sweep: %9.2f ms  %8lld read syscalls  (%llu changes)\n",
+           fstReaderGetMmapIo(ctx) ? "mmap" : "stdio", iter_ms, syscr_iter / iterations, rvat_ms, syscr_rvat,
+           (unsigned long long)(counters.changes / iterations));
+    fstReaderClose(ctx);
+}
+
+static void bench_open(const char* filename, int iterations, unsigned int flags, const char* label) {
+    long long syscr_before = read_syscalls();
+    double open_ms = 0, lookup_ms = 0;
+    char buf[4096];
+    for (int i = 0; i < iterations; i++) {
+        double t0 = now_ms();
+        void* ctx = fstReaderOpen2(filename, flags);
+        if (!ctx) {
+            fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+            exit(1);
+        }
+        double t1 = now_ms();
+        fstReaderGetValueFromHandleAtTime(ctx, fstReaderGetEndTime(ctx), 1, buf);
+        lookup_ms += now_ms() - t1;
+        open_ms += t1 - t0;
+        fstReaderClose(ctx);
+    }
+    long long syscr = read_syscalls() - syscr_before;
+
+    printf("  %-14s open: %9.3f ms  last-block lookup: %9.3f ms  %8lld read syscalls\n", label, open_ms / iterations,
+           lookup_ms / iterations, syscr / iterations);
+}
+
+static double bench_parallel(const char* filename, int iterations, int threads, double serial_ms) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocksSetParallelMode(ctx, threads);
+
+    BenchCounters counters;
+    double t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &counters, nullptr);
+    }
+    double iter_ms = (now_ms() - t0) / iterations;
+    printf("  %3d threads: %9.2f ms", threads, iter_ms);
+    if (serial_ms > 0) printf("  (%.2fx)", serial_ms / iter_ms);
+    printf("\n");
+    fstReaderClose(ctx);
+    return iter_ms;
+}
+
+static void count_column(void* user_data, const struct fstColumn* col) {
+    BenchCounters* c = static_cast<BenchCounters*>(user_data);
+    c->changes += col->count;
+    c->bytes += col->value_stride ? (uint64_t)col->count * col->value_stride : col->value_offs[col->count];
+}
+
+// Per-change string callbacks versus one packed column per signal and block.
+static void bench_columns(const char* filename, int iterations) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstReaderSetFacProcessMaskAll(ctx);
+
+    BenchCounters per_change, columns;
+    double t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &per_change, nullptr);
+    }
+    double per_change_ms = (now_ms() - t0) / iterations;
+    t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        fstReaderIterBlocksColumns(ctx, count_column, &columns);
+    }
+    double columns_ms = (now_ms() - t0) / iterations;
+
+    printf("  per-change: %9.2f ms  (%llu changes)\n", per_change_ms, (unsigned long long)(per_change.changes / iterations));
+    printf("  columns:    %9.2f ms  (%llu changes, %.2fx)\n", columns_ms, (unsigned long long)(columns.changes / iterations),
+           per_change_ms / columns_ms);
+    fstReaderClose(ctx);
+}
+
+// Viewport-style load: only the last 1% of the trace.
+static void bench_limit_range(const char* filename, int iterations) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstReaderSetFacProcessMaskAll(ctx);
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    fstReaderSetLimitTimeRange(ctx, end_time - end_time / 100, end_time);
+
+    BenchCounters counters;
+    double t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &counters, nullptr);
+    }
+    printf("  last 1%%: %9.2f ms  (%llu changes)\n", (now_ms() - t0) / iterations,
+           (unsigned long long)(counters.changes / iterations));
+    fstReaderClose(ctx);
+}
+
+// Value-at-time lookups alternating between two cursors far apart in the trace.
+static void bench_rvat_jumps(const char* filename, int iterations) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    const int jumps = 200;
+    char buf[4096];
+
+    long long syscr_before = read_syscalls();
+    double t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < jumps; j++) {
+            uint64_t t = (j & 1) ? end_time - end_time / 10 - j : end_time / 10 + j;
+            for (fstHandle h = 1; h <= maxhandle && h <= 8; h++) {
+                fstReaderGetValueFromHandleAtTime(ctx, t, h, buf);
+            }
+        }
+    }
+    printf("  %d jumps: %9.2f ms  %8lld read syscalls\n", jumps, (now_ms() - t0) / iterations,
+           (read_syscalls() - syscr_before) / iterations);
+    fstReaderClose(ctx);
+}
+
+// Every signal at a handful of timestamps, one lookup per signal versus one batch.
+static void bench_values_at_time(const char* filename, int iterations, bool batch, int threads) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstReaderIterBlocksSetParallelMode(ctx, threads);
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    const int stops = 16;
+    std::vector<fstHandle> handles;
+    for (fstHandle h = 1; h <= maxhandle; h++) {
+        handles.push_back(h);
+    }
+    std::vector<const char*> values(handles.size());
+    std::vector<char> buf((size_t)maxhandle * 64 + 4096);
+
+    double t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        for (int s = 0; s < stops; s++) {
+            uint64_t t = end_time / stops * s + end_time / (2 * stops);
+            if (batch) {
+                size_t need = fstReaderGetValuesAtTime(ctx, t, handles.data(), (uint32_t)handles.size(), buf.data(),
+                                                       buf.size(), values.data());
+                if (need > buf.size()) {
+                    buf.resize(need);
+                    fstReaderGetValuesAtTime(ctx, t, handles.data(), (uint32_t)handles.size(), buf.data(), buf.size(),
+                                             values.data());
+                }
+            } else {
+                for (fstHandle h = 1; h <= maxhandle; h++) {
+                    fstReaderGetValueFromHandleAtTime(ctx, t, h, buf.data());
+                }
+            }
+        }
+    }
+    printf("  %-8s threads=%d %d stops: %9.2f ms\n", batch ? "batch" : "single", threads, stops,
+           (now_ms() - t0) / iterations);
+    fstReaderClose(ctx);
+}
+
+// Repeat single-signal loads, the waveform viewer pattern, with and without the block cache.
+static void bench_block_cache(const char* filename, int iterations, uint64_t cache_bytes, const char* label) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        exit(1);
+    }
+    fstReaderSetBlockCacheSize(ctx, cache_bytes);
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    int loads = std::min<int>(maxhandle, 8);
+
+    BenchCounters counters;
+    double first_ms = 0, t0 = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        for (int h = 1; h <= loads; h++) {
+            fstReaderClrFacProcessMaskAll(ctx);
+            fstReaderSetFacProcessMask(ctx, (fstHandle)(h * (maxhandle / loads)));
+            fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &counters, nullptr);
+            if (!i && h == 1) first_ms = now_ms() - t0;
+        }
+    }
+    double per_load_ms = (now_ms() - t0 - first_ms) / (iterations * loads - 1 ? iterations * loads - 1 : 1);
+
+    printf("  %-10s first load: %9.2f ms  later loads: %9.2f ms  (%llu bytes cached)\n", label, first_ms, per_load_ms,
+           (unsigned long long)fstReaderGetBlockCacheUsage(ctx));
+    fstReaderClose(ctx);
+}
+
+// Open plus one full hierarchy walk, the browser's start-up path.
+static void bench_hier(const char* filename, int iterations) {
+    double open_ms = 0, walk_ms = 0;
+    uint64_t items = 0;
+    for (int i = 0; i < iterations; i++) {
+        double t0 = now_ms();
+        void* ctx = fstReaderOpen(filename);
+        if (!ctx) {
+            fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+            exit(1);
+        }
+        double t1 = now_ms();
+        items = 0;
+        while (fstReaderIterateHier(ctx)) items++;
+        walk_ms += now_ms() - t1;
+        open_ms += t1 - t0;
+        fstReaderClose(ctx);
+    }
+
+    printf("  open: %9.3f ms  hierarchy walk: %9.3f ms  (%llu items)\n", open_ms / iterations, walk_ms / iterations,
+           (unsigned long long)items);
+}
+
+// The synthetic trace written with each pack type: file size against zlib,
+// write time, full iteration and a value-at-time sweep.
+static void bench_pack_types(int iterations) {
+    struct PackType {
+        enum fstWriterPackType pack;
+        const char* label;
+    };
+    const PackType packs[] = {
+        { FST_WR_PT_ZLIB, "zlib" },
+        { FST_WR_PT_FASTLZ, "fastlz" },
+        { FST_WR_PT_LZ4, "lz4" },
+        { FST_WR_PT_ZSTD, "zstd" },
+        { FST_WR_PT_ZSTD_DICT, "zstd+dict" },
+    };
+    const char* filename = "bench_pack.fst";
+    double zlib_bytes = 0;
+
+    for (const PackType& p : packs) {
+        double t0 = now_ms();
+        if (!write_bench_trace(filename, 2000, 20000, p.pack)) {
+            fprintf(stderr, "ERROR: Failed to write %s\n", filename);
+            exit(1);
+        }
+        double write_ms = now_ms() - t0;
+
+        FILE* f = fopen(filename, "rb");
+        double bytes = 0;
+        if (f) {
+            fseek(f, 0, SEEK_END);
+            bytes = (double)ftell(f);
+            fclose(f);
+        }
+        if (p.pack == FST_WR_PT_ZLIB) zlib_bytes = bytes;
+
+        void* ctx = fstReaderOpen(filename);
+        if (!ctx) {
+            fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+            exit(1);
+        }
+        fstReaderSetFacProcessMaskAll(ctx);
+        BenchCounters counters;
+        t0 = now_ms();
+        for (int i = 0; i < iterations; i++) {
+            fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &counters, nullptr);
+        }
+        double iter_ms = (now_ms() - t0) / iterations;
+
+        uint64_t end_time = fstReaderGetEndTime(ctx);
+        uint64_t step = end_time / 1000 + 1;
+        char buf[4096];
+        t0 = now_ms();
+        for (uint64_t t = 0; t <= end_time; t += step) {
+            for (fstHandle h = 1; h <= 8; h++) {
+                fstReaderGetValueFromHandleAtTime(ctx, t, h, buf);
+            }
+        }
+        double rvat_ms = now_ms() - t0;
+        fstReaderClose(ctx);
+
+        printf("  %-10s %10.0f bytes (%5.1f%% of zlib)  write: %8.2f ms  iter: %8.2f ms  rvat sweep: %8.2f ms\n", p.label, bytes,
+               zlib_bytes ? 100.0 * bytes / zlib_bytes : 0.0, write_ms, iter_ms, rvat_ms);
+    }
+    remove(filename);
+#ifndef HAVE_LIBZSTD
+    printf("  (built without HAVE_LIBZSTD, the zstd rows were written with zlib)\n");
+#endif
+}
+
+// The per-varint loop the reader used before bulk decode (fstGetVarint64():
+// find the last byte, then assemble backwards), kept here as the baseline.
+static uint64_t bench_get_varint64(const unsigned char* mem, int* skiplen) {
+    const unsigned char* mem_orig = mem;
+    uint64_t rc = 0;
+    while (*mem & 0x80) mem++;
+    *skiplen = (int)(mem - mem_orig + 1);
+    for (;;) {
+        rc <<= 7;
+        rc |= (uint64_t)(*mem & 0x7f);
+        if (mem == mem_orig) break;
+        mem--;
+    }
+    return rc;
+}
+
+static volatile uint64_t bench_sink;   // keeps the decode loops from being optimized out
+
+// Bulk varint decode of time table like data against the per-varint loop,
+// then a full iteration of the trace with each decoder.
+static void bench_varint_decoders(const char* filename, int iterations) {
+    struct Mix {
+        const char* label;
+        uint64_t mask;          // deltas are masked pseudo random values
+    };
+    const Mix mixes[] = {
+        { "1 byte", 0x7f },
+        { "2 byte", 0x3fff },
+        { "mixed", 0 },
+    };
+    const size_t count = 1 << 22;
+    std::vector<uint64_t> out(count);
+
+    for (const Mix& mix : mixes) {
+        std::vector<unsigned char> encoded;
+        uint64_t x = 88172645463325252ULL;
+        for (size_t i = 0; i < count; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            uint64_t v = mix.mask ? (x & mix.mask) : (x >> (57 - (x & 31)));    // 1 to 5 bytes
+            while (v >> 7) {
+                encoded.push_back((unsigned char)(v | 0x80));
+                v >>= 7;
+            }
+            encoded.push_back((unsigned char)v);
+        }
+        encoded.resize(encoded.size() + 16, 0);    // the per-varint loop does not bound its reads
+
+        double t0 = now_ms();
+        uint64_t sum = 0;
+        for (int it = 0; it < iterations; it++) {
+            const unsigned char* pnt = encoded.data();
+            for (size_t i = 0; i < count; i++) {
+                int skiplen;
+                out[i] = bench_get_varint64(pnt, &skiplen);
+                pnt += skiplen;
+            }
+            sum += out[count - 1];
+        }
+        double base_ms = (now_ms() - t0) / iterations;
+        printf("  %-7s per varint: %8.2f ms", mix.label, base_ms);
+
+        const int decoders[] = { FST_VARINT_SCALAR, FST_VARINT_SSE2, FST_VARINT_AVX2 };
+        const char* names[] = { "scalar", "sse2", "avx2" };
+        for (int d = 0; d < 3; d++) {
+            if (fstUtilitySetVarintDecoder(decoders[d]) != decoders[d]) continue;
+            t0 = now_ms();
+            for (int it = 0; it < iterations; it++) {
+                size_t nout = 0;
+                fstUtilityDecodeVarints(encoded.data(), encoded.size() - 16, out.data(), count, &nout);
+                sum += out[count - 1];
+            }
+            double run_ms = (now_ms() - t0) / iterations;
+            printf("  %s: %8.2f ms (%4.2fx)", names[d], run_ms, run_ms > 0 ? base_ms / run_ms : 0.0);
+        }
+        bench_sink = sum;
+        printf("\n");
+    }
+
+    const int decoders[] = { FST_VARINT_SCALAR, FST_VARINT_AUTO };
+    const char* names[] = { "scalar", "auto" };
+    for (int d = 0; d < 2; d++) {
+        int used = fstUtilitySetVarintDecoder(decoders[d]);
+        void* ctx = fstReaderOpen(filename);
+        fstReaderSetFacProcessMaskAll(ctx);
+        BenchCounters counters;
+        double t0 = now_ms();
+        for (int i = 0; i < iterations; i++) {
+            fstReaderIterBlocks2(ctx, count_callback, count_callback_varlen, &counters, nullptr);
+        }
+        printf("  iterate with %-6s (%d): %8.2f ms\n", names[d], used, (now_ms() - t0) / iterations);
+        fstReaderClose(ctx);
+    }
+    fstUtilitySetVarintDecoder(FST_VARINT_AUTO);
+}
+
+// Writing the synthetic trace with the chains of each flush compressed on
+// a pool of threads, against the serial flush.
+static void bench_flush_threads(int iterations) {
+    const enum fstWriterPackType packs[] = { FST_WR_PT_ZLIB, FST_WR_PT_LZ4, FST_WR_PT_ZSTD };
+    const char* labels[] = { "zlib", "lz4", "zstd" };
+    const char* filename = "bench_flush.fst";
+    int max_threads = std::max(4, (int)std::thread::hardware_concurrency());
+
+    for (int p = 0; p < 3; p++) {
+        double serial_ms = 0;
+        printf("  %-5s", labels[p]);
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            double t0 = now_ms();
+            for (int i = 0; i < iterations; i++) {
+                if (!write_bench_trace(filename, 20000, 4000, packs[p], threads)) {
+                    fprintf(stderr, "ERROR: Failed to write %s\n", filename);
+                    exit(1);
+                }
+            }
+            double write_ms = (now_ms() - t0) / iterations;
+            if (threads == 1) serial_ms = write_ms;
+            printf("  %d: %8.2f ms (%4.2fx)", threads, write_ms, write_ms > 0 ? serial_ms / write_ms : 0.0);
+        }
+        printf("\n");
+    }
+    remove(filename);
+}
+
+// Writing with flushes handed to the parallel mode pipeline, against the
+// serial flush.  The stall is the longest the simulation waited on a flush.
+static void bench_flush_pipeline(int iterations) {
+    const char* filename = "bench_flush.fst";
+    const int depths[] = { 0, 1, 2, 4 };
+    double serial_ms = 0;
+
+    for (int depth : depths) {
+        double stall_ms = 0;
+        double t0 = now_ms();
+        for (int i = 0; i < iterations; i++) {
+            if (!write_bench_trace(filename, 20000, 8000, FST_WR_PT_ZLIB, 0, depth, &stall_ms)) {
+                fprintf(stderr, "ERROR: Failed to write %s\n", filename);
+                exit(1);
+            }
+        }
+        double write_ms = (now_ms() - t0) / iterations;
+        if (!depth) serial_ms = write_ms;
+        printf("  %s %d: %8.2f ms (%4.2fx)  longest flush stall: %8.2f ms\n", depth ? "in flight" : "serial   ", depth,
+               write_ms, write_ms > 0 ? serial_ms / write_ms : 0.0, stall_ms);
+    }
+    remove(filename);
+}
+
+// Emit throughput with many changes per time step, as a Verilator-style
+// dump produces: one call per change, against the batched calls.  Only the
+// emit calls are timed, not the flushes done on time changes.
+static void bench_emit_batch(int iterations) {
+    const char* filename = "bench_emit.fst";
+    const int num_signals = 100000;
+    const int num_steps = 40;
+    const char* labels[] = { "single chars", "single 32 bit", "batch chars", "batch packed" };
+
+    for (int mode = 0; mode < 4; mode++) {
+        double emit_ms = 0;
+        uint64_t changes = 0;
+        for (int it = 0; it < iterations; it++) {
+            void* wctx = fstWriterCreate(filename, 1);
+            if (!wctx) {
+                fprintf(stderr, "ERROR: Failed to create %s\n", filename);
+                exit(1);
+            }
+            fstWriterSetPackType(wctx, FST_WR_PT_LZ4);
+            fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+            std::vector<fstHandle> handles;
+            std::vector<uint32_t> widths;
+            for (int i = 0; i < num_signals; i++) {
+                std::string name = "sig" + std::to_string(i);
+                widths.push_back((i & 3) ? 32 : 1);
+                handles.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, widths.back(), name.c_str(), 0));
+            }
+            fstWriterSetUpscope(wctx);
+            for (int i = num_signals - 1; i > 0; i--) {    // changes come in no particular handle order
+                int j = (int)((i * 2654435761u) % (uint32_t)(i + 1));
+                std::swap(handles[i], handles[j]);
+                std::swap(widths[i], widths[j]);
+            }
+
+            std::vector<uint64_t> words(num_signals);
+            std::vector<char> chars(num_signals * 33);
+            std::vector<const void*> vals(num_signals);
+            uint32_t lfsr = 0xACE1u;
+            for (int t = 0; t < num_steps; t++) {
+                fstWriterEmitTimeChange(wctx, (uint64_t)t);
+                for (int i = 0; i < num_signals; i++) {
+                    lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+                    words[i] = (lfsr * 2654435761u) & ((widths[i] == 32) ? 0xffffffffu : 1u);
+                    char* c = &chars[i * 33];
+                    for (uint32_t b = 0; b < widths[i]; b++) c[b] = (char)('0' + ((words[i] >> (widths[i] - 1 - b)) & 1));
+                    vals[i] = c;
+                }
+
+                double t0 = now_ms();
+                switch (mode) {
+                    case 0:
+                        for (int i = 0; i < num_signals; i++) fstWriterEmitValueChange(wctx, handles[i], vals[i]);
+                        break;
+                    case 1:
+                        for (int i = 0; i < num_signals; i++) {
+                            fstWriterEmitValueChange32(wctx, handles[i], widths[i], (uint32_t)words[i]);
+                        }
+                        break;
+                    case 2:
+                        fstWriterEmitValueChangeBatch(wctx, num_signals, handles.data(), vals.data());
+                        break;
+                    default:
+                        fstWriterEmitValueChangeBatchPacked(wctx, num_signals, handles.data(), words.data());
+                        break;
+                }
+                emit_ms += now_ms() - t0;
+                changes += num_signals;
+            }
+            fstWriterClose(wctx);
+        }
+        printf("  %-14s %8.2f ms  %7.2f M changes/s\n", labels[mode], emit_ms / iterations,
+               emit_ms > 0 ? changes / (emit_ms * 1000.0) : 0.0);
+    }
+    remove(filename);
+}
+
+// Writing wide buses given as characters and as integers, two-state and with
+// x/z bits, timing the emits and the flushes.  The change buffer is flushed
+// every 128 MB, so the block count shows how much of it the changes take.
+static void bench_packed_values(int iterations) {
+    const char* filename = "bench_packed.fst";
+    const int num_signals = 1000;
+    const uint32_t width = 256;
+    const int num_steps = 4000;
+    const char* labels[] = { "chars, 2-state", "Vec64, 2-state", "chars, 4-state" };
+
+    for (int mode = 0; mode < 3; mode++) {
+        double write_ms = 0;
+        uint64_t blocks = 0;
+        for (int it = 0; it < iterations; it++) {
+            void* wctx = fstWriterCreate(filename, 1);
+            if (!wctx) {
+                fprintf(stderr, "ERROR: Failed to create %s\n", filename);
+                exit(1);
+            }
+            fstWriterSetPackType(wctx, FST_WR_PT_LZ4);
+            fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+            std::vector<fstHandle> handles;
+            for (int i = 0; i < num_signals; i++) {
+                std::string name = "bus" + std::to_string(i);
+                handles.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, width, name.c_str(), 0));
+            }
+            fstWriterSetUpscope(wctx);
+
+            std::vector<uint64_t> words(width / 64);
+            std::string chars(width, '0');
+            uint64_t seed = 0x9e3779b97f4a7c15ULL;
+            double t0 = now_ms();
+            for (int t = 0; t < num_steps; t++) {
+                fstWriterEmitTimeChange(wctx, (uint64_t)t);
+                for (int i = (t & 3); i < num_signals; i += 4) {
+                    for (uint64_t& w : words) {
+                        seed ^= seed << 13;
+                        seed ^= seed >> 7;
+                        seed ^= seed << 17;
+                        w = seed;
+                    }
+                    if (mode == 1) {
+                        fstWriterEmitValueChangeVec64(wctx, handles[i], width, words.data());
+                        continue;
+                    }
+                    for (uint32_t b = 0; b < width; b++) {
+                        chars[width - 1 - b] = (char)('0' + ((words[b / 64] >> (b & 63)) & 1));
+                    }
+                    if (mode == 2) chars[seed & (width - 1)] = (seed & 256) ? 'x' : 'z';
+                    fstWriterEmitValueChange(wctx, handles[i], chars.c_str());
+                }
+            }
+            fstWriterClose(wctx);
+            write_ms += now_ms() - t0;
+
+            void* rctx = fstReaderOpen(filename);
+            if (rctx) {
+                blocks = fstReaderGetValueChangeSectionCount(rctx);
+                fstReaderClose(rctx);
+            }
+        }
+        printf("  %-15s %8.2f ms  %llu blocks\n", labels[mode], write_ms / iterations, (unsigned long long)blocks);
+    }
+    remove(filename);
+}
+
+// Buffering the changes of a large design as chains linked backwards through
+// the change buffer, against per signal segments.  Each signal changes on a
+// quarter of the steps, in no particular handle order, and everything goes
+// into one block: the emits, the flush of that block and the memory the
+// buffered changes take are measured separately.
+static void bench_buffer_layout(int iterations) {
+    const char* filename = "bench_layout.fst";
+    const int num_signals = 100000;
+    const int num_steps = 200;
+    const enum fstWriterBufferLayout layouts[] = { FST_WR_BL_CHAINED, FST_WR_BL_SEGMENTED };
+    const char* labels[] = { "chained", "segmented" };
+
+    for (int l = 0; l < 2; l++) {
+        double emit_ms = 0, flush_ms = 0;
+        long long buffered_kb = 0;
+        for (int it = 0; it < iterations; it++) {
+            void* wctx = fstWriterCreate(filename, 1);
+            if (!wctx) {
+                fprintf(stderr, "ERROR: Failed to create %s\n", filename);
+                exit(1);
+            }
+            fstWriterSetBufferLayout(wctx, layouts[l]);
+            fstWriterSetPackType(wctx, FST_WR_PT_LZ4);
+            fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+            std::vector<fstHandle> handles;
+            std::vector<uint32_t> widths;
+            for (int i = 0; i < num_signals; i++) {
+                std::string name = "sig" + std::to_string(i);
+                widths.push_back((i & 3) ? 1 : 32);
+                handles.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, widths.back(), name.c_str(), 0));
+            }
+            fstWriterSetUpscope(wctx);
+            for (int i = num_signals - 1; i > 0; i--) {
+                int j = (int)((i * 2654435761u) % (uint32_t)(i + 1));
+                std::swap(handles[i], handles[j]);
+                std::swap(widths[i], widths[j]);
+            }
+
+            long long rss0 = resident_kb();
+            uint32_t lfsr = 0xACE1u;
+            double t0 = now_ms();
+            for (int t = 0; t < num_steps; t++) {
+                fstWriterEmitTimeChange(wctx, (uint64_t)t);
+                for (int i = 0; i < num_signals; i++) {
+                    lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+                    if (lfsr & 3) continue;
+                    fstWriterEmitValueChange32(wctx, handles[i], widths[i], (lfsr * 2654435761u) >> (32 - widths[i]));
+                }
+            }
+            emit_ms += now_ms() - t0;
+            buffered_kb = resident_kb() - rss0;
+
+            fstWriterFlushContext(wctx);
+            t0 = now_ms();
+            fstWriterEmitTimeChange(wctx, (uint64_t)num_steps);    // flushes the block
+            flush_ms += now_ms() - t0;
+            fstWriterClose(wctx);
+        }
+        printf("  %-10s emit %8.2f ms  flush %8.2f ms  buffered %7.1f MB\n", labels[l], emit_ms / iterations,
+               flush_ms / iterations, buffered_kb / 1024.0);
+    }
+    remove(filename);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filename = "bench_synthetic.fst";
+    int iterations = 3;
+
+    if (argc > 1) {
+        filename = argv[1];
+    } else {
+        printf("Generating %s...\n", filename);
+        if (!write_bench_trace(filename, 2000, 20000)) {
+            fprintf(stderr, "ERROR: Failed to write %s\n", filename);
+            return 1;
+        }
+    }
+    if (argc > 2) iterations = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: Failed to open %s\n", filename);
+        return 1;
+    }
+    printf("FST reader benchmark: %s (%u signals, %llu blocks)\n", filename, fstReaderGetMaxHandle(ctx),
+           (unsigned long long)fstReaderGetValueChangeSectionCount(ctx));
+    fstReaderClose(ctx);
+
+    printf("\nI/O path (all signals, %d iterations):\n", iterations);
+    bench_iter_blocks(filename, iterations, false);
+    bench_iter_blocks(filename, iterations, true);
+
+    printf("\nParallel block decode (all signals, %d iterations):\n", iterations);
+    {
+        void* probe = fstReaderOpen(filename);
+        fstReaderIterBlocksSetParallelMode(probe, 2);
+        bool available = fstReaderIterBlocksGetParallelMode(probe) > 1;
+        fstReaderClose(probe);
+        if (available) {
+            int max_threads = std::max(4, (int)std::thread::hardware_concurrency());
+            double serial_ms = bench_parallel(filename, iterations, 1, 0);
+            for (int threads = 2; threads <= max_threads; threads *= 2) {
+                bench_parallel(filename, iterations, threads, serial_ms);
+            }
+        } else {
+            printf("  not available (built without FST_READER_PARALLEL)\n");
+        }
+    }
+
+    printf("\nColumnar iteration (all signals, %d iterations):\n", iterations);
+    bench_columns(filename, iterations);
+
+    printf("\nTime range limited iteration (%d iterations):\n", iterations);
+    bench_limit_range(filename, iterations);
+
+    printf("\nValue-at-time cursor jumps (%d iterations):\n", iterations);
+    bench_rvat_jumps(filename, iterations);
+
+    printf("\nAll signals at one time (%d iterations):\n", iterations);
+    bench_values_at_time(filename, iterations, false, 0);
+    bench_values_at_time(filename, iterations, true, 0);
+    bench_values_at_time(filename, iterations, true, 4);
+
+    printf("\nRepeat single-signal loads (%d iterations):\n", iterations);
+    bench_block_cache(filename, iterations, 0, "uncached");
+    bench_block_cache(filename, iterations, 64 << 20, "cached");
+
+    printf("\nOpen and walk hierarchy (%d iterations):\n", iterations * 10);
+    bench_hier(filename, iterations * 10);
+
+    std::string sidecar = std::string(filename) + ".fstidx";
+    remove(sidecar.c_str());
+    printf("\nOpen (%d iterations):\n", iterations * 10);
+    bench_open(filename, iterations * 10, FST_RD_OPEN_NO_MMAP, "stdio scan");
+    bench_open(filename, iterations * 10, FST_RD_OPEN_DEFAULT, "mmap scan");
+    fstReaderClose(fstReaderOpen2(filename, FST_RD_OPEN_BLOCK_INDEX));
+    bench_open(filename, iterations * 10, FST_RD_OPEN_NO_MMAP | FST_RD_OPEN_BLOCK_INDEX, "stdio sidecar");
+    bench_open(filename, iterations * 10, FST_RD_OPEN_BLOCK_INDEX, "mmap sidecar");
+    remove(sidecar.c_str());
+
+    printf("\nVarint decode (4M varints, %d iterations):\n", iterations);
+    bench_varint_decoders(filename, iterations);
+
+    printf("\nWriter flush threads (20000 signals, 4000 steps, %d iterations, %u cores):\n", iterations,
+           std::thread::hardware_concurrency());
+    bench_flush_threads(iterations);
+
+    printf("\nWriter flush pipeline (20000 signals, 8000 steps, %d iterations, %u cores):\n", iterations,
+           std::thread::hardware_concurrency());
+    bench_flush_pipeline(iterations);
+
+    printf("\nEmit throughput (100000 signals changing on 40 steps, %d iterations):\n", iterations);
+    bench_emit_batch(iterations);
+
+    printf("\nWide bus buffering (1000 x 256 bit signals, 4000 steps, %d iterations):\n", iterations);
+    bench_packed_values(iterations);
+
+    printf("\nChange buffer layout (100000 signals changing on a quarter of 200 steps, %d iterations):\n", iterations);
+    bench_buffer_layout(iterations);
+
+    printf("\nPack types (synthetic trace, %d iterations):\n", iterations);
+    bench_pack_types(iterations);
+
+    return 0;
+}
@@ -28,12 +28,16 @@
  * FST_DYNAMIC_ALIAS_DISABLE : dynamic aliases are not processed
  * FST_DYNAMIC_ALIAS2_DISABLE : new encoding for dynamic aliases is not generated
  * FST_WRITEX_DISABLE : fast write I/O routines are disabled
+ * FST_READER_MMAP_DISABLE : reader uses stdio instead of mapping the file
+ * FST_VARINT_SIMD_DISABLE : bulk varint decode always uses the scalar loop
  *
  * possible enables:
  *
  * FST_DEBUG : not for production use, only enable for development
  * FST_REMOVE_DUPLICATE_VC : glitch removal (has writer performance impact)
  * HAVE_LIBPTHREAD -> FST_WRITER_PARALLEL : enables inclusion of parallel writer code
+ * HAVE_LIBPTHREAD -> FST_READER_PARALLEL : enables inclusion of parallel block decode for fstReaderIterBlocks2()
+ * HAVE_LIBZSTD : enables the zstd pack type (FST_WR_PT_ZSTD) and reading traces written with it
  * _WAVE_HAVE_JUDY : use Judy arrays instead of Jenkins (undefine if LGPL is not acceptable)
  *
  */
@@ -48,11 +52,17 @@
 #include "lz4.h"
 #include <errno.h>
 
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
 #ifndef HAVE_LIBPTHREAD
 #undef FST_WRITER_PARALLEL
+#undef FST_READER_PARALLEL
 #endif
 
-#ifdef FST_WRITER_PARALLEL
+#if defined(FST_WRITER_PARALLEL) || defined(FST_READER_PARALLEL)
 #include <pthread.h>
 #endif
 
@@ -139,6 +149,17 @@ void **JenkinsIns(void *base_i, const unsigned char *mem, uint32_t length, uint3
 #define FST_GZIO_LEN                    (32768)
 #define FST_HDR_FOURPACK_DUO_SIZE       (4*1024*1024)
 #define FST_ZWRAPPER_HDR_SIZE           (1+8+8)
+#define FST_GZ_WINSIZE                  (32768)
+#define FST_GZ_SPAN                     (1024*1024)
+#define FST_GZ_OBUF_LEN                 (256*1024)
+#define FST_GZ_HISTORY                  (64*1024)
+#define FST_ZSTD_CHAIN_LEVEL            (3)
+#define FST_ZSTD_LEVEL                  (9)     /* time tables and hierarchy */
+#define FST_ZSTD_DICT_SIZE              (16*1024)
+#define FST_ZSTD_DICT_SAMPLES           (1024*1024)
+
+/* zstd frames start 28 b5 2f fd, which is never a valid zlib header (fails the FCHECK test) */
+#define FST_ZSTD_FRAME(p, len)          (((len) >= 4) && ((p)[0] == 0x28) && ((p)[1] == 0xb5) && ((p)[2] == 0x2f) && ((p)[3] == 0xfd))
 
 #if defined(__APPLE__) && defined(__MACH__)
 #define FST_MACOSX
@@ -154,9 +175,18 @@ void **JenkinsIns(void *base_i, const unsigned char *mem, uint32_t length, uint3
 #define FST_LIKELY(x) __builtin_expect(!!(x), 1)
 /* Boolean expression more often false than true */
 #define FST_UNLIKELY(x) __builtin_expect(!!(x), 0)
+/* Memory at p is about to be written */
+#define FST_PREFETCH_W(p) __builtin_prefetch((p), 1)
 #else
 #define FST_LIKELY(x) (!!(x))
 #define FST_UNLIKELY(x) (!!(x))
+#define FST_PREFETCH_W(p) ((void)(p))
+#endif
+
+#if !defined(FST_VARINT_SIMD_DISABLE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* SSE2/AVX2 bulk varint decode, picked at runtime by fstVarintDecoderResolve() */
+#define FST_VARINT_SIMD
+#include <immintrin.h>
 #endif
 
 #define FST_APIMESS "FSTAPI  | "
@@ -419,6 +449,8 @@ return ptr;
 #define fstMmap(__addr,__len,__prot,__flags,__fd,__off) (void*)mmap(FST_CADDR_T_CAST (__addr),(__len),(__prot),(__flags),(__fd),(__off))
 #define fstMunmap(__addr,__len)                         { if(__addr) munmap(FST_CADDR_T_CAST (__addr),(__len)); }
 #endif
+#include <sys/types.h>
+#include <sys/stat.h>
 
 
 /*
@@ -558,6 +590,21 @@ return(pnt);
 }
 
 
+static unsigned char *fstCopyVarint32ToRight(unsigned char *pnt, uint32_t v)
+{
+uint32_t nxt;
+
+while((nxt = v>>7))
+        {
+        *(pnt++) = ((unsigned char)v) | 0x80;
+        v = nxt;
+        }
+*(pnt++) = (unsigned char)v;
+
+return(pnt);
+}
+
+
 static unsigned char *fstCopyVarint64ToRight(unsigned char *pnt, uint64_t v)
 {
 uint64_t nxt;
@@ -598,6 +645,227 @@ return(rc);
 }
 
 
+/*
+ * bulk varint decode for time tables and chain indexes: up to max_out
+ * varints from mem[0..len) go to out[], each one's byte count to lens[]
+ * when lens is non-NULL.  *nout is set to how many were decoded and the
+ * bytes used are returned.  a varint truncated by len ends the run.
+ */
+static size_t fstGetVarintRunScalar(const unsigned char *mem, size_t len, uint64_t *out, unsigned char *lens, size_t max_out, size_t *nout)
+{
+size_t pos = 0, n = 0;
+
+while((n < max_out) && (pos < len))
+        {
+        size_t vstart = pos;
+        uint64_t rc = 0;
+        int shift = 0;
+        unsigned char byt;
+
+        do      {
+                byt = mem[pos++];
+                if(shift < 64) rc |= ((uint64_t)(byt & 0x7f)) << shift;
+                shift += 7;
+                } while((byt & 0x80) && (pos < len));
+
+        if(lens) lens[n] = (pos - vstart < 255) ? (unsigned char)(pos - vstart) : 255;
+        out[n++] = rc;
+        }
+
+*nout = n;
+return(pos);
+}
+
+
+#ifdef FST_VARINT_SIMD
+/*
+ * the SIMD versions load a vector of bytes at a time and take a mask of
+ * the bytes without a continuation bit, which are where varints end.  a
+ * vector of all single byte varints is widened without any branching, else
+ * each varint ending in the vector is decoded by its length.
+ */
+static inline __attribute__((always_inline)) size_t fstGetVarintEnds(const unsigned char *mem, uint32_t ends, uint64_t *out, unsigned char *lens, size_t n)
+{
+uint32_t vstart = 0;
+
+while(ends)
+        {
+        uint32_t vend = __builtin_ctz(ends);
+        uint32_t vlen = vend - vstart + 1;
+        const unsigned char *pnt = mem + vstart;
+        uint64_t rc;
+
+        if(vlen == 1)
+                {
+                rc = pnt[0];
+                }
+        else if(FST_LIKELY(vlen <= 8))
+                {
+                /* little endian load of the varint, then its 7 bit groups are packed together */
+                memcpy(&rc, pnt, sizeof(uint64_t));
+                rc &= (~(uint64_t)0) >> (64 - 8 * vlen);
+                rc &= UINT64_C(0x7f7f7f7f7f7f7f7f);
+                rc = ((rc & UINT64_C(0x7f007f007f007f00)) >> 1) | (rc & UINT64_C(0x007f007f007f007f));
+                rc = ((rc & UINT64_C(0x3fff00003fff0000)) >> 2) | (rc & UINT64_C(0x00003fff00003fff));
+                rc = ((rc & UINT64_C(0x0fffffff00000000)) >> 4) | (rc & UINT64_C(0x000000000fffffff));
+                }
+        else
+                {
+                uint32_t i;
+                int shift = 0;
+
+                rc = 0;
+                for(i=0;i<vlen;i++)
+                        {
+                        if(shift < 64) rc |= ((uint64_t)(pnt[i] & 0x7f)) << shift;
+                        shift += 7;
+                        }
+                }
+
+        if(lens) lens[n] = (vlen < 255) ? (unsigned char)vlen : 255;
+        out[n++] = rc;
+        vstart = vend + 1;
+        ends &= ends - 1;
+        }
+
+return(n);
+}
+
+
+__attribute__((target("sse2")))
+static size_t fstGetVarintRunSSE2(const unsigned char *mem, size_t len, uint64_t *out, unsigned char *lens, size_t max_out, size_t *nout)
+{
+size_t pos = 0, n = 0, got;
+
+while((pos + 16 + 8 <= len) && (n + 16 <= max_out))   /* + 8 for the loads in fstGetVarintEnds() */
+        {
+        uint32_t ends = (~(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(mem + pos)))) & 0xffff;
+
+        if(ends == 0xffff)
+                {
+                int i;
+
+                for(i=0;i<16;i++) out[n+i] = mem[pos+i];
+                if(lens) memset(lens + n, 1, 16);
+                n += 16;
+                pos += 16;
+                }
+        else if(ends == 0xaaaa) /* eight two byte varints, as 16 bit lanes */
+                {
+                __m128i v = _mm_loadu_si128((const __m128i *)(mem + pos));
+                __m128i zero = _mm_setzero_si128();
+                __m128i w = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x7f)), _mm_slli_epi16(_mm_srli_epi16(v, 8), 7));
+                __m128i lo = _mm_unpacklo_epi16(w, zero);
+                __m128i hi = _mm_unpackhi_epi16(w, zero);
+
+                _mm_storeu_si128((__m128i *)(out + n + 0), _mm_unpacklo_epi32(lo, zero));
+                _mm_storeu_si128((__m128i *)(out + n + 2), _mm_unpackhi_epi32(lo, zero));
+                _mm_storeu_si128((__m128i *)(out + n + 4), _mm_unpacklo_epi32(hi, zero));
+                _mm_storeu_si128((__m128i *)(out + n + 6), _mm_unpackhi_epi32(hi, zero));
+                if(lens) memset(lens + n, 2, 8);
+                n += 8;
+                pos += 16;
+                }
+        else if(ends)
+                {
+                n = fstGetVarintEnds(mem + pos, ends, out, lens, n);
+                pos += 32 - __builtin_clz(ends);
+                }
+        else    /* longer than the vector */
+                {
+                pos += fstGetVarintRunScalar(mem + pos, len - pos, out + n, lens ? lens + n : NULL, 1, &got);
+                n += got;
+                }
+        }
+
+pos += fstGetVarintRunScalar(mem + pos, len - pos, out + n, lens ? lens + n : NULL, max_out - n, &got);
+*nout = n + got;
+return(pos);
+}
+
+
+__attribute__((target("avx2")))
+static size_t fstGetVarintRunAVX2(const unsigned char *mem, size_t len, uint64_t *out, unsigned char *lens, size_t max_out, size_t *nout)
+{
+size_t pos = 0, n = 0, got;
+
+while((pos + 32 + 8 <= len) && (n + 32 <= max_out))
+        {
+        uint32_t ends = ~(uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(mem + pos)));
+
+        if(ends == 0xffffffff)
+                {
+                int i;
+
+                for(i=0;i<32;i++) out[n+i] = mem[pos+i];
+                if(lens) memset(lens + n, 1, 32);
+                n += 32;
+                pos += 32;
+                }
+        else if(ends == 0xaaaaaaaa) /* sixteen two byte varints, as 16 bit lanes */
+                {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(mem + pos));
+                __m256i w = _mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi16(0x7f)), _mm256_slli_epi16(_mm256_srli_epi16(v, 8), 7));
+                __m128i lo = _mm256_castsi256_si128(w);
+                __m128i hi = _mm256_extracti128_si256(w, 1);
+
+                _mm256_storeu_si256((__m256i *)(out + n + 0), _mm256_cvtepu16_epi64(lo));
+                _mm256_storeu_si256((__m256i *)(out + n + 4), _mm256_cvtepu16_epi64(_mm_srli_si128(lo, 8)));
+                _mm256_storeu_si256((__m256i *)(out + n + 8), _mm256_cvtepu16_epi64(hi));
+                _mm256_storeu_si256((__m256i *)(out + n + 12), _mm256_cvtepu16_epi64(_mm_srli_si128(hi, 8)));
+                if(lens) memset(lens + n, 2, 16);
+                n += 16;
+                pos += 32;
+                }
+        else if(ends)
+                {
+                n = fstGetVarintEnds(mem + pos, ends, out, lens, n);
+                pos += 32 - __builtin_clz(ends);
+                }
+        else    /* longer than the vector */
+                {
+                pos += fstGetVarintRunScalar(mem + pos, len - pos, out + n, lens ? lens + n : NULL, 1, &got);
+                n += got;
+                }
+        }
+
+pos += fstGetVarintRunScalar(mem + pos, len - pos, out + n, lens ? lens + n : NULL, max_out - n, &got);
+*nout = n + got;
+return(pos);
+}
+#endif
+
+
+static int fst_varint_decoder = FST_VARINT_AUTO;       /* fstUtilitySetVarintDecoder() */
+
+/* the decoder to use for a request, the widest the CPU has when it cannot do the one asked for */
+static int fstVarintDecoderResolve(int decoder)
+{
+#ifdef FST_VARINT_SIMD
+if(((decoder == FST_VARINT_AUTO) || (decoder == FST_VARINT_AVX2)) && __builtin_cpu_supports("avx2")) return(FST_VARINT_AVX2);
+if((decoder != FST_VARINT_SCALAR) && __builtin_cpu_supports("sse2")) return(FST_VARINT_SSE2);
+#else
+(void)decoder;
+#endif
+return(FST_VARINT_SCALAR);
+}
+
+
+static size_t fstGetVarintRun(const unsigned char *mem, size_t len, uint64_t *out, unsigned char *lens, size_t max_out, size_t *nout)
+{
+#ifdef FST_VARINT_SIMD
+switch(fstVarintDecoderResolve(fst_varint_decoder))
+        {
+        case FST_VARINT_AVX2:   return(fstGetVarintRunAVX2(mem, len, out, lens, max_out, nout));
+        case FST_VARINT_SSE2:   return(fstGetVarintRunSSE2(mem, len, out, lens, max_out, nout));
+        default:                break;
+        }
+#endif
+
+return(fstGetVarintRunScalar(mem, len, out, lens, max_out, nout));
+}
+
+
 static uint32_t fstReaderVarint32(FILE *f)
 {
 #define CHK_LEN_MAX 5 /* TALOS-2023-1783 */
@@ -719,34 +987,6 @@ return(len);
 }
 
 
-/* signed integer read/write routines are currently unused */
-static int64_t fstGetSVarint64(unsigned char *mem, int *skiplen)
-{
-unsigned char *mem_orig = mem;
-int64_t rc = 0;
-const int64_t one = 1;
-const int siz = sizeof(int64_t) * 8;
-int shift = 0;
-unsigned char byt;
-
-do      {
-        byt = *(mem++);
-        rc |= ((int64_t)(byt & 0x7f)) << shift;
-        shift += 7;
-
-        } while(byt & 0x80);
-
-if((shift<siz) && (byt & 0x40))
-        {
-        rc |= -(one << shift); /* sign extend */
-        }
-
-*skiplen = mem - mem_orig;
-
-return(rc);
-}
-
-
 #ifndef FST_DYNAMIC_ALIAS2_DISABLE
 static int fstWriterSVarint(FILE *handle, int64_t v)
 {
@@ -817,11 +1057,19 @@ char *filename;
 fstHandle maxhandle;
 fstHandle numsigs;
 uint32_t maxvalpos;
+uint32_t max_value_len;                 /* widest fixed length value, bounds what a batched emit appends */
 
 unsigned vc_emitted : 1;
 unsigned is_initial_time : 1;
 unsigned fourpack : 1;
 unsigned fastpack : 1;
+unsigned zstdpack : 1;
+unsigned zstd_dict_wanted : 1;          /* FST_WR_PT_ZSTD_DICT */
+
+#ifdef HAVE_LIBZSTD
+ZSTD_CDict *zstd_cdict;                 /* see fstWriterEmitZstdDict(), kept in the parent context */
+int zstd_dict_tried;
+#endif
 
 int64_t timezero;
 fst_off_t section_header_truncpos;
@@ -830,6 +1078,10 @@ uint64_t curtime;
 uint64_t firsttime;
 uint32_t vchg_siz;
 uint32_t vchg_alloc_siz;
+uint64_t vchg_grow; /* what the buffered changes can grow by as value change chains */
+uint32_t *vseg_mem; /* FST_WR_BL_SEGMENTED: where the segments of each handle are */
+fstHandle vseg_handles;
+int buffer_layout;
 
 uint32_t secnum;
 fst_off_t section_start;
@@ -859,12 +1111,12 @@ unsigned char already_in_flush; /* in case control-c handlers interrupt */
 unsigned char already_in_close; /* in case control-c handlers interrupt */
 
 #ifdef FST_WRITER_PARALLEL
-pthread_mutex_t mutex;
-pthread_t thread;
-pthread_attr_t thread_attr;
 struct fstWriterContext *xc_parent;
+struct fstWriterFlushPipe *pipe;        /* fstWriterSetParallelMode(), created on the first flush */
+struct fstWriterFlushSet *flush_set;    /* set only in the copy a pipeline worker flushes */
 #endif
-unsigned in_pthread : 1;
+int parallel_depth;                     /* fstWriterSetParallelDepth(), 0 is FST_WRITER_PARALLEL_DEPTH */
+int flush_threads;                      /* fstWriterSetFlushThreads(), 0 is serial */
 
 size_t fst_orig_break_size;
 size_t fst_orig_break_add_size;
@@ -907,145 +1159,508 @@ return(rc);
 }
 
 
-static uint32_t fstWriterUint32WithVarint32(struct fstWriterContext *xc, uint32_t *u, uint32_t v, const void *dbuf, uint32_t siz)
-{
-unsigned char *buf = xc->vchg_mem + xc->vchg_siz;
-unsigned char *pnt = buf;
-uint32_t nxt;
-uint32_t len;
+/*
+ * FST_WR_BL_CHAINED buffers each change behind the vchg_mem offset of the
+ * one before it for the same handle, so a flush walks every chain backwards
+ * across the whole buffer.  FST_WR_BL_SEGMENTED appends the changes of a
+ * handle, without that offset, to segments it gets from the end of vchg_mem,
+ * each twice the size of the one before up to FST_VSEG_MAX, and a flush reads
+ * the segments front to back.  a segment starts with the offset of the next
+ * segment of the handle and, once it is full, of its first unused byte.
+ * vseg_mem has FST_VSEG_ENTRY words for each handle: its first and last
+ * segment, and the first unused byte and the end of the last one.  either
+ * way vm4ip[2] is the offset of the latest change less 4, as in the chains.
+ */
+#define FST_VSEG_ENTRY                  (4)
+#define FST_VSEG_HDR                    (2 * sizeof(uint32_t))
+#define FST_VSEG_MIN                    (16)
+#define FST_VSEG_MAX                    (16384)
+#define FST_VSEG_OF(xc, vm4ip)          ((xc)->vseg_mem + FST_VSEG_ENTRY * ((size_t)((vm4ip) - (xc)->valpos_mem) / 4))
 
-memcpy(pnt, u, sizeof(uint32_t));
-pnt += 4;
+/* starts a new last segment with room for at least maxlen bytes for the handle vseg is the entry of */
+static unsigned char *fstWriterSegmentRoom(struct fstWriterContext *xc, uint32_t *vseg, uint32_t maxlen)
+{
+uint32_t hdr[2] = { 0, 0 };
+uint32_t room = FST_VSEG_MIN;
+uint32_t seg = xc->vchg_siz;
 
-while((nxt = v>>7))
+if(vseg[1])
         {
-        *(pnt++) = ((unsigned char)v) | 0x80;
-        v = nxt;
+        room = (vseg[3] - vseg[1] - FST_VSEG_HDR) * 2;
+        if(room > FST_VSEG_MAX) room = FST_VSEG_MAX;
         }
-*(pnt++) = (unsigned char)v;
-memcpy(pnt, dbuf, siz);
-
-len = pnt-buf + siz;
-return(len);
-}
-
-
-static uint32_t fstWriterUint32WithVarint32AndLength(struct fstWriterContext *xc, uint32_t *u, uint32_t v, const void *dbuf, uint32_t siz)
-{
-unsigned char *buf = xc->vchg_mem + xc->vchg_siz;
-unsigned char *pnt = buf;
-uint32_t nxt;
-uint32_t len;
+if(room < maxlen) room = maxlen;
 
-memcpy(pnt, u, sizeof(uint32_t));
-pnt += 4;
-
-while((nxt = v>>7))
+if(FST_UNLIKELY((seg + FST_VSEG_HDR + room) > xc->vchg_alloc_siz))
         {
-        *(pnt++) = ((unsigned char)v) | 0x80;
-        v = nxt;
+        xc->vchg_alloc_siz += (xc->fst_break_add_size + FST_VSEG_HDR + room);
+        xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+        if(FST_UNLIKELY(!xc->vchg_mem))
+                {
+                fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterSegmentRoom, exiting.\n");
+                exit(255);
+                }
         }
-*(pnt++) = (unsigned char)v;
 
-v = siz;
-while((nxt = v>>7))
+memcpy(xc->vchg_mem + seg, hdr, sizeof(hdr));
+if(vseg[1])
         {
-        *(pnt++) = ((unsigned char)v) | 0x80;
-        v = nxt;
+        hdr[0] = seg;
+        hdr[1] = vseg[2];
+        memcpy(xc->vchg_mem + vseg[1], hdr, sizeof(hdr)); /* link from the full one */
         }
-*(pnt++) = (unsigned char)v;
-
-memcpy(pnt, dbuf, siz);
+        else
+        {
+        vseg[0] = seg;
+        }
+vseg[1] = seg;
+vseg[2] = seg + FST_VSEG_HDR;
+vseg[3] = seg + FST_VSEG_HDR + room;
+xc->vchg_siz = vseg[3];
 
-len = pnt-buf + siz;
-return(len);
+return(xc->vchg_mem + vseg[2]);
 }
 
 
 /*
- * header bytes, write here so defines are set up before anything else
- * that needs to use them
+ * returns where a change of the handle at vm4ip that takes at most maxlen
+ * bytes goes.  for FST_WR_BL_CHAINED the caller has made room for it and
+ * next_offs, which is written here.
  */
-static void fstWriterEmitHdrBytes(struct fstWriterContext *xc)
+static unsigned char *fstWriterChangeStart(struct fstWriterContext *xc, const uint32_t *vm4ip, uint32_t maxlen)
 {
-char vbuf[FST_HDR_SIM_VERSION_SIZE];
-char dbuf[FST_HDR_DATE_SIZE];
-double endtest = FST_DOUBLE_ENDTEST;
-time_t walltime;
+unsigned char *pnt;
 
-#define FST_HDR_OFFS_TAG                        (0)
-fputc(FST_BL_HDR, xc->handle);                  /* +0 tag */
+if(xc->buffer_layout == FST_WR_BL_SEGMENTED)
+        {
+        uint32_t *vseg = FST_VSEG_OF(xc, vm4ip);
 
-#define FST_HDR_OFFS_SECLEN                     (FST_HDR_OFFS_TAG + 1)
-fstWriterUint64(xc->handle, 329);               /* +1 section length */
+        if(FST_LIKELY((vseg[2] + maxlen) <= vseg[3]))
+                {
+                return(xc->vchg_mem + vseg[2]);
+                }
+        return(fstWriterSegmentRoom(xc, vseg, maxlen));
+        }
 
-#define FST_HDR_OFFS_START_TIME                 (FST_HDR_OFFS_SECLEN + 8)
-fstWriterUint64(xc->handle, 0);                 /* +9 start time */
+pnt = xc->vchg_mem + xc->vchg_siz;
+memcpy(pnt, &vm4ip[2], sizeof(uint32_t));
+return(pnt + 4);
+}
 
-#define FST_HDR_OFFS_END_TIME                   (FST_HDR_OFFS_START_TIME + 8)
-fstWriterUint64(xc->handle, 0);                 /* +17 end time */
 
-#define FST_HDR_OFFS_ENDIAN_TEST                (FST_HDR_OFFS_END_TIME + 8)
-fstFwrite(&endtest, 8, 1, xc->handle);          /* +25 endian test for reals */
+/* makes the change from start to end, both from fstWriterChangeStart(), the latest of the handle at vm4ip */
+static void fstWriterChangeEnd(struct fstWriterContext *xc, uint32_t *vm4ip, unsigned char *start, unsigned char *end)
+{
+uint32_t used = end - xc->vchg_mem;
 
-#define FST_HDR_OFFS_MEM_USED                   (FST_HDR_OFFS_ENDIAN_TEST + 8)
-fstWriterUint64(xc->handle, xc->fst_break_size);/* +33 memory used by writer */
+vm4ip[2] = start - xc->vchg_mem - 4;
+vm4ip[3] = xc->tchn_idx;
 
-#define FST_HDR_OFFS_NUM_SCOPES                 (FST_HDR_OFFS_MEM_USED + 8)
-fstWriterUint64(xc->handle, 0);                 /* +41 scope creation count */
+if(xc->buffer_layout == FST_WR_BL_SEGMENTED)
+        {
+        FST_VSEG_OF(xc, vm4ip)[2] = used;
+        }
+        else
+        {
+        xc->vchg_siz = used;
+        }
+}
 
-#define FST_HDR_OFFS_NUM_VARS                   (FST_HDR_OFFS_NUM_SCOPES + 8)
-fstWriterUint64(xc->handle, 0);                 /* +49 var creation count */
 
-#define FST_HDR_OFFS_MAXHANDLE                  (FST_HDR_OFFS_NUM_VARS + 8)
-fstWriterUint64(xc->handle, 0);                 /* +57 max var idcode */
+/*
+ * changes of variables wider than one bit are buffered in one of three forms,
+ * told apart by the low bits of the time delta varint that leads them.  only
+ * '0'/'1' characters go in as the msb first bytes a value change chain stores
+ * them as, only '0'/'1'/'x'/'z' as a value plane followed by an xz plane that
+ * are packed the same way (0 is 0/0, 1 is 1/0, z is 0/1 and x is 1/1), and
+ * anything else as the characters themselves.  curval_mem keeps characters:
+ * the frame of each section is written straight from it.
+ */
+#define FST_VCHG_CHARS                  (0)
+#define FST_VCHG_PACKED                 (1)
+#define FST_VCHG_PLANES                 (2)
+#define FST_VCHG_KIND_BITS              (2)
+#define FST_VCHG_KIND_MASK              ((1 << FST_VCHG_KIND_BITS) - 1)
+#define FST_VCHG_TIME_DELTA_MAX         (0xffffffffUL >> 4) /* widest shift of a delta is fstWriterBitRcv()'s */
+#define FST_VCHG_SCRATCH_SIZ(xc)        ((size_t)(xc)->vchg_siz + (xc)->vchg_grow) /* bounds any chain */
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define FST_BIN_CHARS_MASK              (0x8040201008040201ULL)
+#define FST_BIN_GATHER_MUL              (0x0102040810204080ULL)
+#else
+#define FST_BIN_CHARS_MASK              (0x0102040810204080ULL) /* msb to the lowest address */
+#define FST_BIN_GATHER_MUL              (0x8040201008040201ULL) /* lowest address to the msb */
+#endif
 
-#define FST_HDR_OFFS_SECTION_CNT                (FST_HDR_OFFS_MAXHANDLE + 8)
-fstWriterUint64(xc->handle, 0);                 /* +65 vc section count */
+/* the bits of b as one 0 or 1 byte each, msb to the lowest address */
+static inline uint64_t fstWriterSpreadBits(unsigned int b)
+{
+uint64_t t = ((uint64_t)(b & 0xff) * 0x0101010101010101ULL) & FST_BIN_CHARS_MASK;
 
-#define FST_HDR_OFFS_TIMESCALE                  (FST_HDR_OFFS_SECTION_CNT + 8)
-fputc((-9)&255, xc->handle);                    /* +73 timescale 1ns */
+return(((t + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL);
+}
 
-#define FST_HDR_OFFS_SIM_VERSION                (FST_HDR_OFFS_TIMESCALE + 1)
-memset(vbuf, 0, FST_HDR_SIM_VERSION_SIZE);
-strcpy(vbuf, FST_WRITER_STR);
-fstFwrite(vbuf, FST_HDR_SIM_VERSION_SIZE, 1, xc->handle); /* +74 version */
 
-#define FST_HDR_OFFS_DATE                       (FST_HDR_OFFS_SIM_VERSION + FST_HDR_SIM_VERSION_SIZE)
-memset(dbuf, 0, FST_HDR_DATE_SIZE);
-time(&walltime);
-strcpy(dbuf, asctime(localtime(&walltime)));
-fstFwrite(dbuf, FST_HDR_DATE_SIZE, 1, xc->handle);      /* +202 date */
+/*
+ * writes the low len bits of words, least significant word first, as len
+ * '0'/'1' characters msb first.  whole bytes go eight characters at once.
+ */
+static void fstWriterExpandPacked(unsigned char *dst, uint32_t len, const uint64_t *words)
+{
+uint32_t w = (len - 1) / 64;
+uint32_t top = len - (w * 64); /* bits in words[w] */
 
-/* date size is deliberately overspecified at 119 bytes (originally 128) in order to provide backfill for new args */
+for(;;)
+        {
+        uint64_t v = words[w];
 
-#define FST_HDR_OFFS_FILETYPE                   (FST_HDR_OFFS_DATE + FST_HDR_DATE_SIZE)
-fputc(xc->filetype, xc->handle);                /* +321 filetype */
+        while(top & 7)
+                {
+                top--;
+                *(dst++) = '0' + ((v >> top) & 1);
+                }
+        while(top)
+                {
+                uint64_t t;
 
-#define FST_HDR_OFFS_TIMEZERO                   (FST_HDR_OFFS_FILETYPE + FST_HDR_FILETYPE_SIZE)
-fstWriterUint64(xc->handle, xc->timezero);      /* +322 timezero */
+                top -= 8;
+                t = fstWriterSpreadBits((unsigned int)(v >> top)) | 0x3030303030303030ULL;
+                memcpy(dst, &t, 8);
+                dst += 8;
+                }
 
-#define FST_HDR_LENGTH                          (FST_HDR_OFFS_TIMEZERO + FST_HDR_TIMEZERO_SIZE)
-                                                /* +330 next section starts here */
-fflush(xc->handle);
+        if(!w) break;
+        w--;
+        top = 64;
+        }
 }
 
 
 /*
- * mmap functions
+ * writes the low len bits of words, least significant word first, as the
+ * (len+7)/8 bytes of an FST_VCHG_PACKED change
  */
-static void fstWriterMmapSanity(void *pnt, const char *file, int line, const char *usage)
+static void fstWriterPackWords(unsigned char *dst, uint32_t len, const uint64_t *words)
 {
-if(pnt == NULL
-#ifdef MAP_FAILED
-   || pnt == MAP_FAILED
-#endif
-  )
-	{
-	fprintf(stderr, "fstMmap() assigned to %s failed: errno: %d, file %s, line %d.\n", usage, errno, file, line);
-#if !defined(__MINGW32__)
-	perror("Why");
-#else
+uint32_t w = (len - 1) / 64;
+uint32_t have = len - (w * 64); /* bits in words[w] */
+uint64_t acc = words[w] << (64 - have); /* bits not written yet, left aligned */
+int k;
+
+for(;;)
+        {
+        for(;have >= 8;have -= 8)
+                {
+                *(dst++) = (unsigned char)(acc >> 56);
+                acc <<= 8;
+                }
+        if(!w) break;
+
+        w--;
+        acc |= words[w] >> have;
+        for(k=56;k>=0;k-=8)
+                {
+                *(dst++) = (unsigned char)(acc >> k);
+                }
+        acc = have ? (words[w] << (64 - have)) : 0;
+        }
+
+if(have)
+        {
+        *dst = (unsigned char)(acc >> 56); /* the last byte is padded at the bottom */
+        }
+}
+
+
+/*
+ * packs the len characters at src into dst and returns the form they took.
+ * dst needs room for both planes; for FST_VCHG_CHARS nothing usable is left
+ * there, eight characters of only '0'/'1' are packed at once.
+ */
+static uint32_t fstWriterPackChars(unsigned char *dst, const unsigned char *src, uint32_t len)
+{
+uint32_t nbytes = (len + 7) / 8;
+unsigned char *xzp = dst + nbytes;
+unsigned char any_xz = 0;
+uint32_t i, k;
+
+for(i=0;i<nbytes;i++)
+        {
+        const unsigned char *pnt = src + i*8;
+        uint32_t n = (i == (nbytes - 1)) ? (len - i*8) : 8;
+        unsigned char v = 0, xz = 0;
+
+        if(n == 8)
+                {
+                uint64_t t;
+
+                memcpy(&t, pnt, 8);
+                if((t & 0xfefefefefefefefeULL) == 0x3030303030303030ULL)
+                        {
+                        dst[i] = (unsigned char)(((t & 0x0101010101010101ULL) * FST_BIN_GATHER_MUL) >> 56);
+                        xzp[i] = 0;
+                        continue;
+                        }
+                }
+
+        for(k=0;k<n;k++)
+                {
+                switch(pnt[k])
+                        {
+                        case '0':       break;
+                        case '1':       v |= 0x80 >> k; break;
+                        case 'x':       v |= 0x80 >> k; xz |= 0x80 >> k; break;
+                        case 'z':       xz |= 0x80 >> k; break;
+                        default:        return(FST_VCHG_CHARS);
+                        }
+                }
+
+        dst[i] = v;
+        xzp[i] = xz;
+        any_xz |= xz;
+        }
+
+return(any_xz ? FST_VCHG_PLANES : FST_VCHG_PACKED);
+}
+
+
+/*
+ * writes the len characters that a buffered change of the given form at src
+ * stands for
+ */
+static void fstWriterUnpackValue(unsigned char *dst, const unsigned char *src, uint32_t len, uint32_t kind)
+{
+uint32_t nbytes = (len + 7) / 8;
+uint32_t i;
+
+if(kind == FST_VCHG_CHARS)
+        {
+        memcpy(dst, src, len);
+        return;
+        }
+
+for(i=0;i<nbytes;i++)
+        {
+        uint64_t t = fstWriterSpreadBits(src[i]);
+
+        if(kind == FST_VCHG_PLANES)
+                {
+                uint64_t m = fstWriterSpreadBits(src[nbytes + i]);
+
+                /* bytewise '0' + v, plus 'z' - '0' - 3v where xz is set */
+                t = 0x3030303030303030ULL + t + (m * 0x4a) - (3 * (m & t));
+                }
+                else
+                {
+                t |= 0x3030303030303030ULL;
+                }
+
+        if(FST_LIKELY(i != (nbytes - 1)))
+                {
+                memcpy(dst, &t, 8);
+                dst += 8;
+                }
+                else
+                {
+                memcpy(dst, &t, len - i*8);
+                }
+        }
+}
+
+
+/*
+ * buffers a change of the variable at vm4ip, given as its characters
+ */
+static void fstWriterAppendChars(struct fstWriterContext *xc, uint32_t *vm4ip, const unsigned char *buf)
+{
+uint32_t len = vm4ip[1];
+uint32_t nbytes = (len + 7) / 8;
+unsigned char *start = fstWriterChangeStart(xc, vm4ip, 5 + len);
+unsigned char *pnt;
+uint32_t kind;
+
+if(len == 1)
+        {
+        pnt = fstCopyVarint32ToRight(start, xc->tchn_idx - vm4ip[3]);
+        *(pnt++) = *buf;
+        fstWriterChangeEnd(xc, vm4ip, start, pnt);
+        return;
+        }
+
+pnt = fstCopyVarint32ToRight(start, (xc->tchn_idx - vm4ip[3]) << FST_VCHG_KIND_BITS);
+#ifdef FST_REMOVE_DUPLICATE_VC
+kind = FST_VCHG_CHARS; /* glitch removal overlays the characters of a change */
+#else
+kind = fstWriterPackChars(pnt, buf, len);
+#endif
+*start |= kind; /* the low bits of the time delta are in the first varint byte */
+
+switch(kind)
+        {
+        case FST_VCHG_PACKED:   pnt += nbytes;
+                                break;
+        case FST_VCHG_PLANES:   xc->vchg_grow += len - 2*nbytes;
+                                pnt += 2*nbytes;
+                                break;
+        default:                memcpy(pnt, buf, len);
+                                pnt += len;
+                                break;
+        }
+
+fstWriterChangeEnd(xc, vm4ip, start, pnt);
+}
+
+
+/*
+ * buffers a two-state change of the variable at vm4ip, given as the packed
+ * bits fstWriterEmitValueChangeVec64() takes
+ */
+static void fstWriterAppendPacked(struct fstWriterContext *xc, uint32_t *vm4ip, const uint64_t *words)
+{
+uint32_t len = vm4ip[1];
+unsigned char *start = fstWriterChangeStart(xc, vm4ip, 5 + (len + 7) / 8);
+unsigned char *pnt;
+
+if(len == 1)
+        {
+        pnt = fstCopyVarint32ToRight(start, xc->tchn_idx - vm4ip[3]);
+        *(pnt++) = '0' + (words[0] & 1);
+        }
+        else
+        {
+        pnt = fstCopyVarint32ToRight(start, ((xc->tchn_idx - vm4ip[3]) << FST_VCHG_KIND_BITS) | FST_VCHG_PACKED);
+        fstWriterPackWords(pnt, len, words);
+        pnt += (len + 7) / 8;
+        }
+
+fstWriterChangeEnd(xc, vm4ip, start, pnt);
+}
+
+
+#ifndef FST_REMOVE_DUPLICATE_VC
+/*
+ * copies the latest change buffered for the variable at vm4ip into curval_mem
+ */
+static void fstWriterCheckpointValue(struct fstWriterContext *xc, const uint32_t *vm4ip)
+{
+unsigned char *pnt = xc->vchg_mem + vm4ip[2] + 4;
+uint32_t kind;
+int wrlen;
+
+if(vm4ip[1] == 1)
+        {
+        xc->curval_mem[vm4ip[0]] = pnt[fstGetVarint32Length(pnt)];
+        return;
+        }
+
+kind = fstGetVarint32(pnt, &wrlen) & FST_VCHG_KIND_MASK;
+fstWriterUnpackValue(xc->curval_mem + vm4ip[0], pnt + wrlen, vm4ip[1], kind);
+}
+#endif
+
+
+/*
+ * buffers a change of the variable length variable at vm4ip.  the chain
+ * stores its time delta a bit further up, which can take another byte.
+ */
+static void fstWriterAppendVariableLength(struct fstWriterContext *xc, uint32_t *vm4ip, const unsigned char *buf, uint32_t len)
+{
+unsigned char *start = fstWriterChangeStart(xc, vm4ip, 5 + 5 + len);
+unsigned char *pnt;
+
+pnt = fstCopyVarint32ToRight(start, xc->tchn_idx - vm4ip[3]);
+pnt = fstCopyVarint32ToRight(pnt, len);
+memcpy(pnt, buf, len);
+xc->vchg_grow++;
+
+fstWriterChangeEnd(xc, vm4ip, start, pnt + len);
+}
+
+
+/*
+ * header bytes, write here so defines are set up before anything else
+ * that needs to use them
+ */
+static void fstWriterEmitHdrBytes(struct fstWriterContext *xc)
+{
+char vbuf[FST_HDR_SIM_VERSION_SIZE];
+char dbuf[FST_HDR_DATE_SIZE];
+double endtest = FST_DOUBLE_ENDTEST;
+time_t walltime;
+
+#define FST_HDR_OFFS_TAG                        (0)
+fputc(FST_BL_HDR, xc->handle);                  /* +0 tag */
+
+#define FST_HDR_OFFS_SECLEN                     (FST_HDR_OFFS_TAG + 1)
+fstWriterUint64(xc->handle, 329);               /* +1 section length */
+
+#define FST_HDR_OFFS_START_TIME                 (FST_HDR_OFFS_SECLEN + 8)
+fstWriterUint64(xc->handle, 0);                 /* +9 start time */
+
+#define FST_HDR_OFFS_END_TIME                   (FST_HDR_OFFS_START_TIME + 8)
+fstWriterUint64(xc->handle, 0);                 /* +17 end time */
+
+#define FST_HDR_OFFS_ENDIAN_TEST                (FST_HDR_OFFS_END_TIME + 8)
+fstFwrite(&endtest, 8, 1, xc->handle);          /* +25 endian test for reals */
+
+#define FST_HDR_OFFS_MEM_USED                   (FST_HDR_OFFS_ENDIAN_TEST + 8)
+fstWriterUint64(xc->handle, xc->fst_break_size);/* +33 memory used by writer */
+
+#define FST_HDR_OFFS_NUM_SCOPES                 (FST_HDR_OFFS_MEM_USED + 8)
+fstWriterUint64(xc->handle, 0);                 /* +41 scope creation count */
+
+#define FST_HDR_OFFS_NUM_VARS                   (FST_HDR_OFFS_NUM_SCOPES + 8)
+fstWriterUint64(xc->handle, 0);                 /* +49 var creation count */
+
+#define FST_HDR_OFFS_MAXHANDLE                  (FST_HDR_OFFS_NUM_VARS + 8)
+fstWriterUint64(xc->handle, 0);                 /* +57 max var idcode */
+
+#define FST_HDR_OFFS_SECTION_CNT                (FST_HDR_OFFS_MAXHANDLE + 8)
+fstWriterUint64(xc->handle, 0);                 /* +65 vc section count */
+
+#define FST_HDR_OFFS_TIMESCALE                  (FST_HDR_OFFS_SECTION_CNT + 8)
+fputc((-9)&255, xc->handle);                    /* +73 timescale 1ns */
+
+#define FST_HDR_OFFS_SIM_VERSION                (FST_HDR_OFFS_TIMESCALE + 1)
+memset(vbuf, 0, FST_HDR_SIM_VERSION_SIZE);
+strcpy(vbuf, FST_WRITER_STR);
+fstFwrite(vbuf, FST_HDR_SIM_VERSION_SIZE, 1, xc->handle); /* +74 version */
+
+#define FST_HDR_OFFS_DATE                       (FST_HDR_OFFS_SIM_VERSION + FST_HDR_SIM_VERSION_SIZE)
+memset(dbuf, 0, FST_HDR_DATE_SIZE);
+time(&walltime);
+strcpy(dbuf, asctime(localtime(&walltime)));
+fstFwrite(dbuf, FST_HDR_DATE_SIZE, 1, xc->handle);      /* +202 date */
+
+/* date size is deliberately overspecified at 119 bytes (originally 128) in order to provide backfill for new args */
+
+#define FST_HDR_OFFS_FILETYPE                   (FST_HDR_OFFS_DATE + FST_HDR_DATE_SIZE)
+fputc(xc->filetype, xc->handle);                /* +321 filetype */
+
+#define FST_HDR_OFFS_TIMEZERO                   (FST_HDR_OFFS_FILETYPE + FST_HDR_FILETYPE_SIZE)
+fstWriterUint64(xc->handle, xc->timezero);      /* +322 timezero */
+
+#define FST_HDR_LENGTH                          (FST_HDR_OFFS_TIMEZERO + FST_HDR_TIMEZERO_SIZE)
+                                                /* +330 next section starts here */
+fflush(xc->handle);
+}
+
+
+/*
+ * mmap functions
+ */
+static void fstWriterMmapSanity(void *pnt, const char *file, int line, const char *usage)
+{
+if(pnt == NULL
+#ifdef MAP_FAILED
+   || pnt == MAP_FAILED
+#endif
+  )
+	{
+	fprintf(stderr, "fstMmap() assigned to %s failed: errno: %d, file %s, line %d.\n", usage, errno, file, line);
+#if !defined(__MINGW32__)
+	perror("Why");
+#else
 	LPSTR mbuf = NULL;
 	FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM
 		      | FORMAT_MESSAGE_IGNORE_INSERTS, NULL, GetLastError(),
@@ -1059,6 +1674,32 @@ if(pnt == NULL
 }
 
 
+/* makes FST_WR_BL_SEGMENTED room for handles created since, which have no segments yet */
+static void fstWriterCreateSegments(struct fstWriterContext *xc)
+{
+if((xc->buffer_layout != FST_WR_BL_SEGMENTED) || (xc->vseg_handles >= xc->maxhandle)) return;
+
+xc->vseg_mem = (uint32_t *)realloc(xc->vseg_mem, xc->maxhandle * FST_VSEG_ENTRY * sizeof(uint32_t));
+if(!xc->vseg_mem)
+        {
+        fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterCreateSegments, exiting.\n");
+        exit(255);
+        }
+memset(xc->vseg_mem + FST_VSEG_ENTRY * xc->vseg_handles, 0, (xc->maxhandle - xc->vseg_handles) * FST_VSEG_ENTRY * sizeof(uint32_t));
+xc->vseg_handles = xc->maxhandle;
+}
+
+
+/* forgets the segments of all handles, as vchg_mem is about to be reused */
+static void fstWriterResetSegments(struct fstWriterContext *xc)
+{
+if(xc->vseg_mem)
+        {
+        memset(xc->vseg_mem, 0, xc->vseg_handles * FST_VSEG_ENTRY * sizeof(uint32_t));
+        }
+}
+
+
 static void fstWriterCreateMmaps(struct fstWriterContext *xc)
 {
 fst_off_t curpos = ftello(xc->handle);
@@ -1096,6 +1737,8 @@ if(!xc->curval_mem)
 	        fstWriterMmapSanity(xc->curval_mem = (unsigned char *)fstMmap(NULL, xc->maxvalpos, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->curval_handle), 0), __FILE__, __LINE__, "xc->curval_handle");
 		}
         }
+
+fstWriterCreateSegments(xc);
 }
 
 
@@ -1238,11 +1881,6 @@ if((!nam)||
 
                 fstWriterEmitHdrBytes(xc);
                 xc->nan = strtod("NaN", NULL);
-#ifdef FST_WRITER_PARALLEL
-                pthread_mutex_init(&xc->mutex, NULL);
-                pthread_attr_init(&xc->thread_attr);
-                pthread_attr_setdetachstate(&xc->thread_attr, PTHREAD_CREATE_DETACHED);
-#endif
                 }
                 else
                 {
@@ -1283,9 +1921,6 @@ if(xc)
 
         fputc(FST_BL_SKIP, xc->handle);                 /* temporarily tag the section, use FST_BL_VCDATA on finalize */
         xc->section_start = ftello(xc->handle);
-#ifdef FST_WRITER_PARALLEL
-        if(xc->xc_parent) xc->xc_parent->section_start = xc->section_start;
-#endif
         xc->section_header_only = 1;                    /* indicates truncate might be needed */
         fstWriterUint64(xc->handle, 0);                 /* placeholder = section length */
         fstWriterUint64(xc->handle, xc->is_initial_time ? xc->firsttime : xc->curtime);         /* begin time of section */
@@ -1307,9 +1942,9 @@ if(xc)
                 {
                 fstFwrite(dmem, destlen, 1, xc->handle);
                 }
-                else /* comparison between compressed / decompressed len tells if compressed */
+                else if(xc->maxvalpos) /* comparison between compressed / decompressed len tells if compressed */
                 {
-                fstFwrite(xc->curval_mem, xc->maxvalpos, 1, xc->handle);
+                fstFwrite(xc->curval_mem, xc->maxvalpos, 1, xc->handle); /* curval_mem is NULL with no signals */
                 }
 
         free(dmem);
@@ -1318,5055 +1953,9851 @@ if(xc)
 
 
 /*
- * only to be called directly by fst code...otherwise must
- * be synced up with time changes
+ * fills in the placeholders of the section header at section_start once
+ * the block ending at endpos is written, and leaves the file at endpos
  */
-#ifdef FST_WRITER_PARALLEL
-static void fstWriterFlushContextPrivate2(void *ctx)
-#else
-static void fstWriterFlushContextPrivate(void *ctx)
-#endif
+static void fstWriterPatchSectionHeader(struct fstWriterContext *xc, FILE *f, fst_off_t section_start, fst_off_t endpos, fst_off_t unc_memreq)
 {
-#ifdef FST_DEBUG
-int cnt = 0;
+fstWriterFseeko(xc, f, section_start, SEEK_SET);
+fstWriterUint64(f, endpos - section_start);                     /* write block length */
+fstWriterFseeko(xc, f, 8, SEEK_CUR);                            /* skip begin time */
+fstWriterUint64(f, xc->curtime);                                /* write end time for section */
+fstWriterUint64(f, unc_memreq);                                 /* amount of buffer memory required in reader for full traversal */
+fflush(f);
+
+fstWriterFseeko(xc, f, section_start-1, SEEK_SET);              /* write out FST_BL_VCDATA over FST_BL_SKIP */
+
+#ifndef FST_DYNAMIC_ALIAS_DISABLE
+#ifndef FST_DYNAMIC_ALIAS2_DISABLE
+fputc(FST_BL_VCDATA_DYN_ALIAS2, f);
+#else
+fputc(FST_BL_VCDATA_DYN_ALIAS, f);
 #endif
-unsigned int i;
-unsigned char *vchg_mem;
-FILE *f;
-fst_off_t fpos, indxpos, endpos;
-uint32_t prevpos;
-int zerocnt;
-unsigned char *scratchpad;
-unsigned char *scratchpnt;
-unsigned char *tmem;
-fst_off_t tlen;
-fst_off_t unc_memreq = 0; /* for reader */
-unsigned char *packmem;
-unsigned int packmemlen;
-uint32_t *vm4ip;
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-#ifdef FST_WRITER_PARALLEL
-struct fstWriterContext *xc2 = xc->xc_parent;
 #else
-struct fstWriterContext *xc2 = xc;
+fputc(FST_BL_VCDATA, f);
 #endif
 
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-Pvoid_t PJHSArray = (Pvoid_t) NULL;
-#ifndef _WAVE_HAVE_JUDY
-uint32_t hashmask =  xc->maxhandle;
-hashmask |= hashmask >> 1;
-hashmask |= hashmask >> 2;
-hashmask |= hashmask >> 4;
-hashmask |= hashmask >> 8;
-hashmask |= hashmask >> 16;
-#endif
-#endif
+fflush(f);
 
-if((xc->vchg_siz <= 1)||(xc->already_in_flush)) return;
-xc->already_in_flush = 1; /* should really do this with a semaphore */
+fstWriterFseeko(xc, f, endpos, SEEK_SET);                       /* seek to end of file */
+}
 
-xc->section_header_only = 0;
-scratchpad = (unsigned char *)malloc(xc->vchg_siz);
 
-vchg_mem = xc->vchg_mem;
+#ifdef HAVE_LIBZSTD
+/*
+ * FST_WR_PT_ZSTD_DICT: trains a dictionary on the chains of the first block
+ * with enough of them and appends it as a FST_BL_ZSTD_DICT section.  chains
+ * of the blocks after it are compressed against the dictionary, which pays
+ * off as most chains are too short for zstd to find repeats on its own.
+ */
+static void fstWriterEmitZstdDict(struct fstWriterContext *xc, struct fstWriterContext *xc2,
+        const unsigned char *samples, const size_t *sample_sizes, unsigned sample_cnt, size_t samples_len)
+{
+unsigned char *dict;
+size_t dlen;
 
-f = xc->handle;
-fstWriterVarint(f, xc->maxhandle);      /* emit current number of handles */
-fputc(xc->fourpack ? '4' : (xc->fastpack ? 'F' : 'Z'), f);
-fpos = 1;
+if((sample_cnt < 16) || (samples_len < (FST_ZSTD_DICT_SIZE * 4))) return; /* retry on the next block */
+
+xc2->zstd_dict_tried = 1;
+dict = (unsigned char *)malloc(FST_ZSTD_DICT_SIZE);
+dlen = ZDICT_trainFromBuffer(dict, FST_ZSTD_DICT_SIZE, samples, sample_sizes, sample_cnt);
+if((!ZDICT_isError(dlen)) && (xc2->zstd_cdict = ZSTD_createCDict(dict, dlen, FST_ZSTD_CHAIN_LEVEL)))
+        {
+        fputc(FST_BL_ZSTD_DICT, xc->handle);
+        fstWriterUint64(xc->handle, dlen + 8);          /* section length */
+        fstFwrite(dict, dlen, 1, xc->handle);
+        }
+free(dict);
+}
+#endif
 
-packmemlen = 1024;                      /* maintain a running "longest" allocation to */
-packmem = (unsigned char *)malloc(packmemlen);           /* prevent continual malloc...free every loop iter */
 
-for(i=0;i<xc->maxhandle;i++)
+/* what a value change chain stores for a change of a one bit variable */
+static inline uint32_t fstWriterBitRcv(unsigned char val, uint32_t time_delta)
+{
+switch(val)
         {
-        vm4ip = &(xc->valpos_mem[4*i]);
+        case '0':
+        case '1':               return(((val&1)<<1) | (time_delta<<2)); /* pack more delta bits in for 0/1 vchs */
 
-        if(vm4ip[2])
-                {
-                uint32_t offs = vm4ip[2];
-                uint32_t next_offs;
-                unsigned int wrlen;
+        case 'x': case 'X':     return(FST_RCV_X | (time_delta<<4));
+        case 'z': case 'Z':     return(FST_RCV_Z | (time_delta<<4));
+        case 'h': case 'H':     return(FST_RCV_H | (time_delta<<4));
+        case 'u': case 'U':     return(FST_RCV_U | (time_delta<<4));
+        case 'w': case 'W':     return(FST_RCV_W | (time_delta<<4));
+        case 'l': case 'L':     return(FST_RCV_L | (time_delta<<4));
+        default:                return(FST_RCV_D | (time_delta<<4));
+        }
+}
 
-                vm4ip[2] = fpos;
 
-                scratchpnt = scratchpad + xc->vchg_siz;         /* build this buffer backwards */
-                if(vm4ip[1] <= 1)
-                        {
-                        if(vm4ip[1] == 1)
-                                {
-                                wrlen = fstGetVarint32Length(vchg_mem + offs + 4); /* used to advance and determine wrlen */
+/*
+ * rebuilds the changes buffered in vchg_mem for one handle, starting from
+ * its latest at offs, into a value change chain.  the chain is built
+ * backwards so that it ends at scratchpnt, and its start is returned.  the
+ * latest value is checkpointed into curval_mem on the way.
+ */
+static unsigned char *fstWriterEncodeChain(struct fstWriterContext *xc, const uint32_t *vm4ip, uint32_t offs, unsigned char *scratchpnt)
+{
+unsigned char *vchg_mem = xc->vchg_mem;
+uint32_t next_offs;
+unsigned int wrlen;
+
+if(vm4ip[1] <= 1)
+        {
+        if(vm4ip[1] == 1)
+                {
+                wrlen = fstGetVarint32Length(vchg_mem + offs + 4); /* used to advance and determine wrlen */
 #ifndef FST_REMOVE_DUPLICATE_VC
-                                xc->curval_mem[vm4ip[0]] = vchg_mem[offs + 4 + wrlen]; /* checkpoint variable */
+                xc->curval_mem[vm4ip[0]] = vchg_mem[offs + 4 + wrlen]; /* checkpoint variable */
 #endif
-                                while(offs)
-                                        {
-                                        unsigned char val;
-                                        uint32_t time_delta, rcv;
-                                        next_offs = fstGetUint32(vchg_mem + offs);
-                                        offs += 4;
-
-                                        time_delta = fstGetVarint32(vchg_mem + offs, (int *)&wrlen);
-                                        val = vchg_mem[offs+wrlen];
-                                        offs = next_offs;
-
-                                        switch(val)
-                                                {
-                                                case '0':
-                                                case '1':               rcv = ((val&1)<<1) | (time_delta<<2);
-                                                                        break; /* pack more delta bits in for 0/1 vchs */
-
-                                                case 'x': case 'X':     rcv = FST_RCV_X | (time_delta<<4); break;
-                                                case 'z': case 'Z':     rcv = FST_RCV_Z | (time_delta<<4); break;
-                                                case 'h': case 'H':     rcv = FST_RCV_H | (time_delta<<4); break;
-                                                case 'u': case 'U':     rcv = FST_RCV_U | (time_delta<<4); break;
-                                                case 'w': case 'W':     rcv = FST_RCV_W | (time_delta<<4); break;
-                                                case 'l': case 'L':     rcv = FST_RCV_L | (time_delta<<4); break;
-                                                default:                rcv = FST_RCV_D | (time_delta<<4); break;
-                                                }
+                while(offs)
+                        {
+                        unsigned char val;
+                        uint32_t time_delta;
+                        next_offs = fstGetUint32(vchg_mem + offs);
+                        offs += 4;
 
-                                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, rcv);
-                                        }
-                                }
-                                else
-                                {
-                                /* variable length */
-                                /* fstGetUint32 (next_offs) + fstGetVarint32 (time_delta) + fstGetVarint32 (len) + payload */
-                                unsigned char *pnt;
-                                uint32_t record_len;
-                                uint32_t time_delta;
+                        time_delta = fstGetVarint32(vchg_mem + offs, (int *)&wrlen);
+                        val = vchg_mem[offs+wrlen];
+                        offs = next_offs;
 
-                                while(offs)
-                                        {
-                                        next_offs = fstGetUint32(vchg_mem + offs);
-                                        offs += 4;
-                                        pnt = vchg_mem + offs;
-                                        offs = next_offs;
-                                        time_delta = fstGetVarint32(pnt, (int *)&wrlen);
-                                        pnt += wrlen;
-                                        record_len = fstGetVarint32(pnt, (int *)&wrlen);
-                                        pnt += wrlen;
-
-                                        scratchpnt -= record_len;
-                                        memcpy(scratchpnt, pnt, record_len);
-
-                                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, record_len);
-                                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1)); /* reserve | 1 case for future expansion */
-                                        }
-                                }
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, fstWriterBitRcv(val, time_delta));
                         }
-                        else
+                }
+                else
+                {
+                /* variable length */
+                /* fstGetUint32 (next_offs) + fstGetVarint32 (time_delta) + fstGetVarint32 (len) + payload */
+                unsigned char *pnt;
+                uint32_t record_len;
+                uint32_t time_delta;
+
+                while(offs)
                         {
-                        wrlen = fstGetVarint32Length(vchg_mem + offs + 4); /* used to advance and determine wrlen */
+                        next_offs = fstGetUint32(vchg_mem + offs);
+                        offs += 4;
+                        pnt = vchg_mem + offs;
+                        offs = next_offs;
+                        time_delta = fstGetVarint32(pnt, (int *)&wrlen);
+                        pnt += wrlen;
+                        record_len = fstGetVarint32(pnt, (int *)&wrlen);
+                        pnt += wrlen;
+
+                        scratchpnt -= record_len;
+                        memcpy(scratchpnt, pnt, record_len);
+
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, record_len);
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1)); /* reserve | 1 case for future expansion */
+                        }
+                }
+        }
+        else
+        {
 #ifndef FST_REMOVE_DUPLICATE_VC
-                        memcpy(xc->curval_mem + vm4ip[0], vchg_mem + offs + 4 + wrlen, vm4ip[1]); /* checkpoint variable */
+        fstWriterCheckpointValue(xc, vm4ip); /* checkpoint variable */
 #endif
-                        while(offs)
-                                {
-                                unsigned int idx;
-                                char is_binary = 1;
-                                unsigned char *pnt;
-                                uint32_t time_delta;
-
-                                next_offs = fstGetUint32(vchg_mem + offs);
-                                offs += 4;
+        while(offs)
+                {
+                unsigned int idx;
+                char is_binary = 1;
+                unsigned char *pnt;
+                uint32_t time_delta, kind;
 
-                                time_delta = fstGetVarint32(vchg_mem + offs, (int *)&wrlen);
+                next_offs = fstGetUint32(vchg_mem + offs);
+                offs += 4;
 
-                                pnt = vchg_mem+offs+wrlen;
-                                offs = next_offs;
+                time_delta = fstGetVarint32(vchg_mem + offs, (int *)&wrlen);
+                kind = time_delta & FST_VCHG_KIND_MASK;
+                time_delta >>= FST_VCHG_KIND_BITS;
 
-                                for(idx=0;idx<vm4ip[1];idx++)
-                                        {
-                                        if((pnt[idx] == '0') || (pnt[idx] == '1'))
-                                                {
-                                                continue;
-                                                }
-                                                else
-                                                {
-                                                is_binary = 0;
-                                                break;
-                                                }
-                                        }
+                pnt = vchg_mem+offs+wrlen;
+                offs = next_offs;
 
-                                if(is_binary)
-                                        {
-                                        unsigned char acc = 0;
-                                        /* new algorithm */
-                                        idx = ((vm4ip[1]+7) & ~7);
-                                        switch(vm4ip[1] & 7)
-                                                {
-                                                case 0: do {    acc  = (pnt[idx+7-8] & 1) << 0; /* fallthrough */
-                                                case 7:         acc |= (pnt[idx+6-8] & 1) << 1; /* fallthrough */
-                                                case 6:         acc |= (pnt[idx+5-8] & 1) << 2; /* fallthrough */
-                                                case 5:         acc |= (pnt[idx+4-8] & 1) << 3; /* fallthrough */
-                                                case 4:         acc |= (pnt[idx+3-8] & 1) << 4; /* fallthrough */
-                                                case 3:         acc |= (pnt[idx+2-8] & 1) << 5; /* fallthrough */
-                                                case 2:         acc |= (pnt[idx+1-8] & 1) << 6; /* fallthrough */
-                                                case 1:         acc |= (pnt[idx+0-8] & 1) << 7;
-                                                                *(--scratchpnt) = acc;
-                                                                idx -= 8;
-                                                        } while(idx);
-                                                }
+                if(kind == FST_VCHG_PACKED) /* already as the chain stores it */
+                        {
+                        scratchpnt -= (vm4ip[1] + 7) / 8;
+                        memcpy(scratchpnt, pnt, (vm4ip[1] + 7) / 8);
 
-                                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1));
-                                        }
-                                        else
-                                        {
-                                        scratchpnt -= vm4ip[1];
-                                        memcpy(scratchpnt, pnt, vm4ip[1]);
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1));
+                        continue;
+                        }
+                if(kind == FST_VCHG_PLANES)
+                        {
+                        scratchpnt -= vm4ip[1];
+                        fstWriterUnpackValue(scratchpnt, pnt, vm4ip[1], kind);
 
-                                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1) | 1);
-                                        }
-                                }
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1) | 1);
+                        continue;
                         }
 
-                wrlen = scratchpad + xc->vchg_siz - scratchpnt;
-                unc_memreq += wrlen;
-                if(wrlen > 32)
+                for(idx=0;idx<vm4ip[1];idx++)
                         {
-                        unsigned long destlen = wrlen;
-                        unsigned char *dmem;
-                        unsigned int rc;
-
-                        if(!xc->fastpack)
+                        if((pnt[idx] == '0') || (pnt[idx] == '1'))
                                 {
-                                if(wrlen <= packmemlen)
-                                        {
-                                        dmem = packmem;
-                                        }
-                                        else
-                                        {
-                                        free(packmem);
-                                        dmem = packmem = (unsigned char *)malloc(compressBound(packmemlen = wrlen));
-                                        }
-
-                                rc = compress2(dmem, &destlen, scratchpnt, wrlen, 4);
-                                if(rc == Z_OK)
-                                        {
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                        PPvoid_t pv = JudyHSIns(&PJHSArray, dmem, destlen, NULL);
-                                        if(*pv)
-                                                {
-                                                uint32_t pvi = (intptr_t)(*pv);
-                                                vm4ip[2] = -pvi;
-                                                }
-                                                else
-                                                {
-                                                *pv = (void *)(intptr_t)(i+1);
-#endif
-                                                fpos += fstWriterVarint(f, wrlen);
-                                                fpos += destlen;
-                                                fstFwrite(dmem, destlen, 1, f);
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                                }
-#endif
-                                        }
-                                        else
-                                        {
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                        PPvoid_t pv = JudyHSIns(&PJHSArray, scratchpnt, wrlen, NULL);
-                                        if(*pv)
-                                                {
-                                                uint32_t pvi = (intptr_t)(*pv);
-                                                vm4ip[2] = -pvi;
-                                                }
-                                                else
-                                                {
-                                                *pv = (void *)(intptr_t)(i+1);
-#endif
-                                                fpos += fstWriterVarint(f, 0);
-                                                fpos += wrlen;
-                                                fstFwrite(scratchpnt, wrlen, 1, f);
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                                }
-#endif
-                                        }
+                                continue;
                                 }
                                 else
                                 {
-                                /* this is extremely conservative: fastlz needs +5% for worst case, lz4 needs siz+(siz/255)+16 */
-                                if(((wrlen * 2) + 2) <= packmemlen)
-                                        {
-                                        dmem = packmem;
-                                        }
-                                        else
-                                        {
-                                        free(packmem);
-                                        dmem = packmem = (unsigned char *)malloc(packmemlen = (wrlen * 2) + 2);
-                                        }
-
-                                rc = (xc->fourpack) ? LZ4_compress_default((char *)scratchpnt, (char *)dmem, wrlen, packmemlen) : fastlz_compress(scratchpnt, wrlen, dmem);
-                                if(rc < destlen)
-                                        {
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                        PPvoid_t pv = JudyHSIns(&PJHSArray, dmem, rc, NULL);
-                                        if(*pv)
-                                                {
-                                                uint32_t pvi = (intptr_t)(*pv);
-                                                vm4ip[2] = -pvi;
-                                                }
-                                                else
-                                                {
-                                                *pv = (void *)(intptr_t)(i+1);
-#endif
-                                                fpos += fstWriterVarint(f, wrlen);
-                                                fpos += rc;
-                                                fstFwrite(dmem, rc, 1, f);
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                                }
-#endif
-                                        }
-                                        else
-                                        {
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                        PPvoid_t pv = JudyHSIns(&PJHSArray, scratchpnt, wrlen, NULL);
-                                        if(*pv)
-                                                {
-                                                uint32_t pvi = (intptr_t)(*pv);
-                                                vm4ip[2] = -pvi;
-                                                }
-                                                else
-                                                {
-                                                *pv = (void *)(intptr_t)(i+1);
-#endif
-                                                fpos += fstWriterVarint(f, 0);
-                                                fpos += wrlen;
-                                                fstFwrite(scratchpnt, wrlen, 1, f);
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                                                }
-#endif
-                                        }
+                                is_binary = 0;
+                                break;
                                 }
                         }
-                        else
+
+                if(is_binary)
                         {
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-                        PPvoid_t pv = JudyHSIns(&PJHSArray, scratchpnt, wrlen, NULL);
-                        if(*pv)
-                                {
-                                uint32_t pvi = (intptr_t)(*pv);
-                                vm4ip[2] = -pvi;
-                                }
-                                else
+                        unsigned char acc = 0;
+                        /* new algorithm */
+                        idx = ((vm4ip[1]+7) & ~7);
+                        switch(vm4ip[1] & 7)
                                 {
-                                *pv = (void *)(intptr_t)(i+1);
-#endif
-                                fpos += fstWriterVarint(f, 0);
-                                fpos += wrlen;
-                                fstFwrite(scratchpnt, wrlen, 1, f);
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
+                                case 0: do {    acc  = (pnt[idx+7-8] & 1) << 0; /* fallthrough */
+                                case 7:         acc |= (pnt[idx+6-8] & 1) << 1; /* fallthrough */
+                                case 6:         acc |= (pnt[idx+5-8] & 1) << 2; /* fallthrough */
+                                case 5:         acc |= (pnt[idx+4-8] & 1) << 3; /* fallthrough */
+                                case 4:         acc |= (pnt[idx+3-8] & 1) << 4; /* fallthrough */
+                                case 3:         acc |= (pnt[idx+2-8] & 1) << 5; /* fallthrough */
+                                case 2:         acc |= (pnt[idx+1-8] & 1) << 6; /* fallthrough */
+                                case 1:         acc |= (pnt[idx+0-8] & 1) << 7;
+                                                *(--scratchpnt) = acc;
+                                                idx -= 8;
+                                        } while(idx);
                                 }
-#endif
+
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1));
                         }
+                        else
+                        {
+                        scratchpnt -= vm4ip[1];
+                        memcpy(scratchpnt, pnt, vm4ip[1]);
 
-                /* vm4ip[3] = 0; ...redundant with clearing below */
-#ifdef FST_DEBUG
-                cnt++;
-#endif
+                        scratchpnt = fstCopyVarint32ToLeft(scratchpnt, (time_delta << 1) | 1);
+                        }
                 }
         }
 
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-JudyHSFreeArray(&PJHSArray, NULL);
-#endif
+return(scratchpnt);
+}
 
-free(packmem); packmem = NULL; /* packmemlen = 0; */ /* scan-build */
 
-prevpos = 0; zerocnt = 0;
-free(scratchpad); scratchpad = NULL;
+/*
+ * fstWriterEncodeChain() for FST_WR_BL_SEGMENTED: the changes are read
+ * front to back from the segments of the handle vseg is the entry of, and
+ * the chain is built forwards from dst.  returns its end.
+ */
+static unsigned char *fstWriterEncodeSegments(struct fstWriterContext *xc, const uint32_t *vm4ip, const uint32_t *vseg, unsigned char *dst)
+{
+unsigned char *vchg_mem = xc->vchg_mem;
+uint32_t seg = vseg[0];
+uint32_t len = vm4ip[1];
+uint32_t nbytes = (len + 7) / 8;
+int wrlen;
 
-indxpos = ftello(f);
-xc->secnum++;
+#ifndef FST_REMOVE_DUPLICATE_VC
+if(len)
+        {
+        fstWriterCheckpointValue(xc, vm4ip); /* checkpoint variable */
+        }
+#endif
 
-#ifndef FST_DYNAMIC_ALIAS2_DISABLE
-if(1)
+while(seg)
         {
-        uint32_t prev_alias = 0;
+        uint32_t hdr[2];
+        const unsigned char *pnt = vchg_mem + seg + FST_VSEG_HDR;
+        const unsigned char *end;
 
-        for(i=0;i<xc->maxhandle;i++)
+        memcpy(hdr, vchg_mem + seg, sizeof(hdr));
+        end = vchg_mem + ((seg == vseg[1]) ? vseg[2] : hdr[1]);
+        seg = hdr[0];
+
+        while(pnt != end)
                 {
-                vm4ip = &(xc->valpos_mem[4*i]);
+                uint32_t time_delta = fstGetVarint32((unsigned char *)pnt, &wrlen);
+                pnt += wrlen;
 
-                if(vm4ip[2])
+                if(len == 1)
                         {
-                        if(zerocnt)
-                                {
-                                fpos += fstWriterVarint(f, (zerocnt << 1));
-                                zerocnt = 0;
-                                }
-
-                        if(vm4ip[2] & 0x80000000)
-                                {
-                                if(vm4ip[2] != prev_alias)
-                                        {
-					int32_t  t_i32 = ((int32_t)(prev_alias = vm4ip[2])); /* vm4ip is generic unsigned data */
-					int64_t  t_i64 = (int64_t)t_i32; /* convert to signed */
-					uint64_t t_u64 = (uint64_t)t_i64; /* sign extend through 64b */
-
-					fpos += fstWriterSVarint(f, (int64_t)((t_u64 << 1) | 1)); /* all in this block was: fpos += fstWriterSVarint(f, (((int64_t)((int32_t)(prev_alias = vm4ip[2]))) << 1) | 1); */
-                                        }
-                                        else
-                                        {
-                                        fpos += fstWriterSVarint(f, (0 << 1) | 1);
-                                        }
-                                }
-                                else
-                                {
-                                fpos += fstWriterSVarint(f, ((vm4ip[2] - prevpos) << 1) | 1);
-                                prevpos = vm4ip[2];
-                                }
-                        vm4ip[2] = 0;
-                        vm4ip[3] = 0; /* clear out tchn idx */
+                        dst = fstCopyVarint32ToRight(dst, fstWriterBitRcv(*(pnt++), time_delta));
                         }
-                        else
+                else if(!len)
                         {
-                        zerocnt++;
+                        uint32_t record_len = fstGetVarint32((unsigned char *)pnt, &wrlen);
+                        pnt += wrlen;
+
+                        dst = fstCopyVarint32ToRight(dst, (time_delta << 1)); /* reserve | 1 case for future expansion */
+                        dst = fstCopyVarint32ToRight(dst, record_len);
+                        memcpy(dst, pnt, record_len);
+                        dst += record_len;
+                        pnt += record_len;
                         }
-                }
-        }
-        else
-#endif
-        {
-        for(i=0;i<xc->maxhandle;i++)
-                {
-                vm4ip = &(xc->valpos_mem[4*i]);
-
-                if(vm4ip[2])
+                else
                         {
-                        if(zerocnt)
-                                {
-                                fpos += fstWriterVarint(f, (zerocnt << 1));
-                                zerocnt = 0;
-                                }
+                        uint32_t kind = time_delta & FST_VCHG_KIND_MASK;
+                        unsigned char *vpnt = dst;
 
-                        if(vm4ip[2] & 0x80000000)
-                                {
-                                fpos += fstWriterVarint(f, 0); /* signal, note that using a *signed* varint would be more efficient than this byte escape! */
-                                fpos += fstWriterVarint(f, (-(int32_t)vm4ip[2]));
-                                }
-                                else
+                        dst = fstCopyVarint32ToRight(dst, (time_delta >> FST_VCHG_KIND_BITS) << 1);
+                        switch(kind)
                                 {
-                                fpos += fstWriterVarint(f, ((vm4ip[2] - prevpos) << 1) | 1);
-                                prevpos = vm4ip[2];
+                                case FST_VCHG_PACKED:   memcpy(dst, pnt, nbytes); /* already as the chain stores it */
+                                                        dst += nbytes;
+                                                        pnt += nbytes;
+                                                        break;
+
+                                case FST_VCHG_PLANES:   *vpnt |= 1;
+                                                        fstWriterUnpackValue(dst, pnt, len, kind);
+                                                        dst += len;
+                                                        pnt += 2*nbytes;
+                                                        break;
+
+                                default:                if(fstWriterPackChars(dst, pnt, len) == FST_VCHG_PACKED)
+                                                                {
+                                                                dst += nbytes;
+                                                                }
+                                                                else
+                                                                {
+                                                                *vpnt |= 1;
+                                                                memcpy(dst, pnt, len);
+                                                                dst += len;
+                                                                }
+                                                        pnt += len;
+                                                        break;
                                 }
-                        vm4ip[2] = 0;
-                        vm4ip[3] = 0; /* clear out tchn idx */
-                        }
-                        else
-                        {
-                        zerocnt++;
                         }
                 }
         }
 
-if(zerocnt)
-        {
-        /* fpos += */ fstWriterVarint(f, (zerocnt << 1)); /* scan-build */
-        }
-#ifdef FST_DEBUG
-fprintf(stderr, FST_APIMESS "value chains: %d\n", cnt);
-#endif
+return(dst);
+}
 
-xc->vchg_mem[0] = '!';
-xc->vchg_siz = 1;
 
-endpos = ftello(xc->handle);
-fstWriterUint64(xc->handle, endpos-indxpos);            /* write delta index position at very end of block */
-
-/*emit time changes for block */
-fflush(xc->tchn_handle);
-tlen = ftello(xc->tchn_handle);
-fstWriterFseeko(xc, xc->tchn_handle, 0, SEEK_SET);
+/*
+ * encodes the changes buffered for handle idx, the latest at offs, into a
+ * value change chain in scratchpad, which is FST_VCHG_SCRATCH_SIZ() long.
+ * returns where it starts and its length in wrlen.
+ */
+static unsigned char *fstWriterBuildChain(struct fstWriterContext *xc, fstHandle idx, uint32_t offs, unsigned char *scratchpad, uint32_t *wrlen)
+{
+const uint32_t *vm4ip = &(xc->valpos_mem[4*idx]);
+unsigned char *scratchend = scratchpad + FST_VCHG_SCRATCH_SIZ(xc);
+unsigned char *scratchpnt;
 
-errno = 0;
-fstWriterMmapSanity(tmem = (unsigned char *)fstMmap(NULL, tlen, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->tchn_handle), 0), __FILE__, __LINE__, "tmem");
-if(tmem)
+if(xc->buffer_layout == FST_WR_BL_SEGMENTED)
         {
-        unsigned long destlen = tlen;
-        unsigned char *dmem = (unsigned char *)malloc(compressBound(destlen));
-        int rc = compress2(dmem, &destlen, tmem, tlen, 9);
+        *wrlen = fstWriterEncodeSegments(xc, vm4ip, FST_VSEG_OF(xc, vm4ip), scratchpad) - scratchpad;
+        return(scratchpad);
+        }
 
-        if((rc == Z_OK) && (((fst_off_t)destlen) < tlen))
+scratchpnt = fstWriterEncodeChain(xc, vm4ip, offs, scratchend); /* build this buffer backwards */
+*wrlen = scratchend - scratchpnt;
+return(scratchpnt);
+}
+
+
+/* what packing a chain needs, one per flushing thread */
+struct fstWriterChainPack
+{
+unsigned char *packmem;                 /* maintain a running "longest" allocation to */
+unsigned int packmemlen;                /* prevent continual malloc...free every chain */
+#ifdef HAVE_LIBZSTD
+ZSTD_CCtx *zcctx;
+const ZSTD_CDict *zcdict;
+unsigned char *zsamples;                /* dictionary training input, FST_WR_PT_ZSTD_DICT */
+size_t *zsample_sizes;
+unsigned zsample_cnt;
+size_t zsamples_len;
+#endif
+};
+
+
+/*
+ * compresses a chain of wrlen bytes with the writer's pack type.  *dpnt is
+ * set to the bytes to store and their length is returned: packed (with
+ * *compressed set) or the chain itself when packing does not pay off.
+ */
+static uint32_t fstWriterPackChain(struct fstWriterContext *xc, struct fstWriterChainPack *pk, unsigned char *scratchpnt, uint32_t wrlen, unsigned char **dpnt, int *compressed)
+{
+unsigned long destlen = wrlen;
+unsigned char *dmem;
+unsigned int rc;
+
+*dpnt = scratchpnt;
+*compressed = 0;
+if(wrlen <= 32) return(wrlen);
+
+if(!xc->fastpack)
+        {
+        if(wrlen <= pk->packmemlen)
                 {
-                fstFwrite(dmem, destlen, 1, xc->handle);
+                dmem = pk->packmem;
                 }
-                else /* comparison between compressed / decompressed len tells if compressed */
+                else
                 {
-                fstFwrite(tmem, tlen, 1, xc->handle);
-                destlen = tlen;
+                free(pk->packmem);
+                dmem = pk->packmem = (unsigned char *)malloc(compressBound(pk->packmemlen = wrlen));
                 }
-        free(dmem);
-        fstMunmap(tmem, tlen);
-        fstWriterUint64(xc->handle, tlen);              /* uncompressed */
-        fstWriterUint64(xc->handle, destlen);           /* compressed */
-        fstWriterUint64(xc->handle, xc->tchn_cnt);      /* number of time items */
-        }
 
-xc->tchn_cnt = xc->tchn_idx = 0;
-fstWriterFseeko(xc, xc->tchn_handle, 0, SEEK_SET);
-fstFtruncate(fileno(xc->tchn_handle), 0);
+        rc = compress2(dmem, &destlen, scratchpnt, wrlen, 4);
+        if(rc == Z_OK)
+                {
+                *dpnt = dmem;
+                *compressed = 1;
+                return(destlen);
+                }
 
-/* write block trailer */
-endpos = ftello(xc->handle);
-fstWriterFseeko(xc, xc->handle, xc->section_start, SEEK_SET);
-fstWriterUint64(xc->handle, endpos - xc->section_start);        /* write block length */
-fstWriterFseeko(xc, xc->handle, 8, SEEK_CUR);                           /* skip begin time */
-fstWriterUint64(xc->handle, xc->curtime);                       /* write end time for section */
-fstWriterUint64(xc->handle, unc_memreq);                        /* amount of buffer memory required in reader for full traversal */
-fflush(xc->handle);
+        return(wrlen);
+        }
 
-fstWriterFseeko(xc, xc->handle, xc->section_start-1, SEEK_SET);         /* write out FST_BL_VCDATA over FST_BL_SKIP */
+/* this is extremely conservative: fastlz needs +5% for worst case, lz4 needs siz+(siz/255)+16 */
+if(((wrlen * 2) + 2) <= pk->packmemlen)
+        {
+        dmem = pk->packmem;
+        }
+        else
+        {
+        free(pk->packmem);
+        dmem = pk->packmem = (unsigned char *)malloc(pk->packmemlen = (wrlen * 2) + 2);
+        }
 
-#ifndef FST_DYNAMIC_ALIAS_DISABLE
-#ifndef FST_DYNAMIC_ALIAS2_DISABLE
-fputc(FST_BL_VCDATA_DYN_ALIAS2, xc->handle);
-#else
-fputc(FST_BL_VCDATA_DYN_ALIAS, xc->handle);
-#endif
-#else
-fputc(FST_BL_VCDATA, xc->handle);
+#ifdef HAVE_LIBZSTD
+if(xc->zstdpack)
+        {
+        rc = destlen;   /* stored uncompressed unless zstd shrinks it */
+        if(pk->zcctx)
+                {
+                size_t zrc = pk->zcdict ?
+                        ZSTD_compress_usingCDict(pk->zcctx, dmem, pk->packmemlen, scratchpnt, wrlen, pk->zcdict) :
+                        ZSTD_compressCCtx(pk->zcctx, dmem, pk->packmemlen, scratchpnt, wrlen, FST_ZSTD_CHAIN_LEVEL);
+                if(!ZSTD_isError(zrc)) rc = zrc;
+                }
+        if((pk->zsamples) && (pk->zsamples_len + wrlen <= FST_ZSTD_DICT_SAMPLES))
+                {
+                memcpy(pk->zsamples + pk->zsamples_len, scratchpnt, wrlen);
+                pk->zsample_sizes[pk->zsample_cnt++] = wrlen;
+                pk->zsamples_len += wrlen;
+                }
+        }
+        else
 #endif
+rc = (xc->fourpack) ? LZ4_compress_default((char *)scratchpnt, (char *)dmem, wrlen, pk->packmemlen) : fastlz_compress(scratchpnt, wrlen, dmem);
+if(rc < destlen)
+        {
+        *dpnt = dmem;
+        *compressed = 1;
+        return(rc);
+        }
 
-fflush(xc->handle);
+return(wrlen);
+}
 
-fstWriterFseeko(xc, xc->handle, endpos, SEEK_SET);                              /* seek to end of file */
 
-xc2->section_header_truncpos = endpos;                          /* cache in case of need to truncate */
-if(xc->dump_size_limit)
+/*
+ * writes out the packed chain of handle idx at block offset fpos.  pv is
+ * its slot in the dynamic alias table: when an identical chain was written
+ * earlier in the block the handle points at that one instead.  returns the
+ * bytes written.
+ */
+static uint32_t fstWriterEmitChain(struct fstWriterContext *xc, PPvoid_t pv, fstHandle idx, uint32_t *vm4ip, fst_off_t fpos,
+        uint32_t wrlen, const unsigned char *dmem, uint32_t dlen, int compressed)
+{
+uint32_t len;
+
+vm4ip[2] = fpos;
+if(pv)
         {
-        if(endpos >= ((fst_off_t)xc->dump_size_limit))
+        if(*pv)
                 {
-                xc2->skip_writing_section_hdr = 1;
-                xc2->size_limit_locked = 1;
-                xc2->is_initial_time = 1; /* to trick emit value and emit time change */
-#ifdef FST_DEBUG
-                fprintf(stderr, FST_APIMESS "<< dump file size limit reached, stopping dumping >>\n");
-#endif
+                uint32_t pvi = (intptr_t)(*pv);
+                vm4ip[2] = -pvi;
+                return(0);
                 }
-        }
 
-if(!xc2->skip_writing_section_hdr)
-        {
-        fstWriterEmitSectionHeader(xc);                         /* emit next section header */
+        *pv = (void *)(intptr_t)(idx+1);
         }
-fflush(xc->handle);
 
-xc->already_in_flush = 0;
+len = fstWriterVarint(xc->handle, compressed ? wrlen : 0);
+fstFwrite(dmem, dlen, 1, xc->handle);
+
+return(len + dlen);
 }
 
 
 #ifdef FST_WRITER_PARALLEL
-static void *fstWriterFlushContextPrivate1(void *ctx)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-struct fstWriterContext *xc_parent;
-
-pthread_mutex_lock(&(xc->xc_parent->mutex));
-fstWriterFlushContextPrivate2(xc);
+/*
+ * chain pool for fstWriterSetFlushThreads(): workers claim the handles with
+ * buffered changes in handle order, encode and pack their chains into a
+ * ring of slots, and the flushing thread writes the slots out in the same
+ * order.  the file is byte for byte what a serial flush writes.
+ */
+#define FST_WRITER_CHAIN_RING           (1024)  /* slots, bounds how far workers run ahead of the writing */
+#define FST_WRITER_CHAIN_CLAIM          (16)    /* handles a worker claims at once */
+#ifndef FST_WRITER_CHAIN_PARALLEL_MIN_BYTES
+#define FST_WRITER_CHAIN_PARALLEL_MIN_BYTES (64 * 1024) /* smaller flushes are not worth the threads */
+#endif
+
+struct fstWriterChainSlot
+{
+fstHandle idx;                          /* handle - 1 */
+uint32_t offs;                          /* its latest change in vchg_mem */
+uint32_t wrlen;                         /* encoded chain length */
+uint32_t dlen;                          /* stored length, packed or not */
+int compressed;
+unsigned char *mem;                     /* stored bytes, kept across the chains the slot holds */
+uint32_t memlen;
+int done;
+};
 
-#ifdef FST_REMOVE_DUPLICATE_VC
-free(xc->curval_mem);
-#endif
-free(xc->valpos_mem);
-free(xc->vchg_mem);
-tmpfile_close(&xc->tchn_handle, &xc->tchn_handle_nam);
-xc_parent = xc->xc_parent;
-free(xc);
+struct fstWriterChainWorker
+{
+struct fstWriterChainPool *pool;
+pthread_t thread;
+unsigned char *scratchpad;              /* FST_VCHG_SCRATCH_SIZ(), as the serial flush uses */
+};
 
-xc_parent->in_pthread = 0;
-pthread_mutex_unlock(&(xc_parent->mutex));
+struct fstWriterChainPool
+{
+struct fstWriterContext *xc;
+const void *zcdict;                     /* ZSTD_CDict shared by the workers */
 
-return(NULL);
-}
+pthread_mutex_t mutex;
+pthread_cond_t done_cond;               /* a claim finished, or the last handle was claimed */
+pthread_cond_t free_cond;               /* slots were written out */
+struct fstWriterChainWorker *workers;
+int num_threads;
+
+struct fstWriterChainSlot *slots;
+fstHandle scan;                         /* next handle to look at */
+int scan_done;
+uint32_t claimed;                       /* chains handed to workers */
+uint32_t written;                       /* chains written out, their slots are free */
+
+/* only touched by the flushing thread */
+uint32_t ready, emitted;
+};
 
 
-static void fstWriterFlushContextPrivate(void *ctx)
+static void *fstWriterChainWorkerMain(void *arg)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+struct fstWriterChainWorker *w = (struct fstWriterChainWorker *)arg;
+struct fstWriterChainPool *pool = w->pool;
+struct fstWriterContext *xc = pool->xc;
+unsigned char *scratchpad = w->scratchpad;
+struct fstWriterChainPack pk;
 
-if(xc->parallel_enabled)
+memset(&pk, 0, sizeof(pk));
+pk.packmem = (unsigned char *)malloc(pk.packmemlen = 1024);
+#ifdef HAVE_LIBZSTD
+if(xc->zstdpack)
         {
-        struct fstWriterContext *xc2 = (struct fstWriterContext *)malloc(sizeof(struct fstWriterContext));
-        unsigned int i;
+        pk.zcctx = ZSTD_createCCtx();
+        pk.zcdict = (const ZSTD_CDict *)pool->zcdict;
+        }
+#endif
 
-        pthread_mutex_lock(&xc->mutex);
-        pthread_mutex_unlock(&xc->mutex);
+for(;;)
+        {
+        uint32_t first, cnt = 0, j;
 
-        xc->xc_parent = xc;
-        memcpy(xc2, xc, sizeof(struct fstWriterContext));
+        pthread_mutex_lock(&pool->mutex);
+        while((!pool->scan_done) && ((pool->claimed + FST_WRITER_CHAIN_CLAIM) > (pool->written + FST_WRITER_CHAIN_RING)))
+                {
+                pthread_cond_wait(&pool->free_cond, &pool->mutex);
+                }
 
-	if(sizeof(size_t) < sizeof(uint64_t))
-		{
-		/* TALOS-2023-1777 for 32b overflow */
-		uint64_t chk_64 = xc->maxhandle * 4 * sizeof(uint32_t);
-		size_t   chk_32 = xc->maxhandle * 4 * sizeof(uint32_t);
-		if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1777");
-		}
+        first = pool->claimed;
+        while((cnt < FST_WRITER_CHAIN_CLAIM) && (pool->scan < xc->maxhandle))
+                {
+                uint32_t *vm4ip = &(xc->valpos_mem[4*pool->scan]);
 
-        xc2->valpos_mem = (uint32_t *)malloc(xc->maxhandle * 4 * sizeof(uint32_t));
-        memcpy(xc2->valpos_mem, xc->valpos_mem, xc->maxhandle * 4 * sizeof(uint32_t));
+                if(vm4ip[2])
+                        {
+                        struct fstWriterChainSlot *slot = pool->slots + ((first + cnt) % FST_WRITER_CHAIN_RING);
 
-        /* curval mem is updated in the thread */
-#ifdef FST_REMOVE_DUPLICATE_VC
-        xc2->curval_mem = (unsigned char *)malloc(xc->maxvalpos);
-        memcpy(xc2->curval_mem, xc->curval_mem, xc->maxvalpos);
-#endif
+                        slot->idx = pool->scan;
+                        slot->offs = vm4ip[2];
+                        slot->done = 0;
+                        cnt++;
+                        }
+                pool->scan++;
+                }
+        pool->claimed += cnt;
+        if((pool->scan == xc->maxhandle) && (!pool->scan_done))
+                {
+                pool->scan_done = 1;
+                pthread_cond_broadcast(&pool->done_cond);
+                pthread_cond_broadcast(&pool->free_cond);
+                }
+        pthread_mutex_unlock(&pool->mutex);
 
-        xc->vchg_mem = (unsigned char *)malloc(xc->vchg_alloc_siz);
-        xc->vchg_mem[0] = '!';
-        xc->vchg_siz = 1;
+        if(!cnt) break;
 
-        for(i=0;i<xc->maxhandle;i++)
+        for(j=0;j<cnt;j++)
+                {
+                struct fstWriterChainSlot *slot = pool->slots + ((first + j) % FST_WRITER_CHAIN_RING);
+                unsigned char *scratchpnt = fstWriterBuildChain(xc, slot->idx, slot->offs, scratchpad, &slot->wrlen);
+                unsigned char *dpnt;
+
+                slot->dlen = fstWriterPackChain(xc, &pk, scratchpnt, slot->wrlen, &dpnt, &slot->compressed);
+                if(slot->dlen > slot->memlen)
+                        {
+                        free(slot->mem);
+                        slot->mem = (unsigned char *)malloc(slot->memlen = slot->dlen);
+                        }
+                memcpy(slot->mem, dpnt, slot->dlen);
+                }
+
+        pthread_mutex_lock(&pool->mutex);
+        for(j=0;j<cnt;j++)
                 {
-                uint32_t *vm4ip = &(xc->valpos_mem[4*i]);
-                vm4ip[2] = 0; /* zero out offset val */
-                vm4ip[3] = 0; /* zero out last time change val */
+                pool->slots[(first + j) % FST_WRITER_CHAIN_RING].done = 1;
                 }
+        pthread_cond_signal(&pool->done_cond);
+        pthread_mutex_unlock(&pool->mutex);
+        }
+
+#ifdef HAVE_LIBZSTD
+ZSTD_freeCCtx(pk.zcctx);
+#endif
+free(pk.packmem);
+
+return(NULL);
+}
+
+
+static void fstWriterChainPoolFree(struct fstWriterChainPool *pool)
+{
+int i;
 
-        xc->tchn_cnt = xc->tchn_idx = 0;
-        xc->tchn_handle = tmpfile_open(&xc->tchn_handle_nam); /* child thread will deallocate file/name */
-        fstWriterFseeko(xc, xc->tchn_handle, 0, SEEK_SET);
-        fstFtruncate(fileno(xc->tchn_handle), 0);
+for(i=0;i<pool->xc->flush_threads;i++)
+        {
+        free(pool->workers[i].scratchpad);
+        }
+for(i=0;i<FST_WRITER_CHAIN_RING;i++)
+        {
+        free(pool->slots[i].mem);
+        }
+free(pool->workers);
+free(pool->slots);
+free(pool);
+}
 
-        xc->section_header_only = 0;
-        xc->secnum++;
 
-	while (xc->in_pthread) 
-		{ 
-		pthread_mutex_lock(&xc->mutex); 
-		pthread_mutex_unlock(&xc->mutex); 
-		};
+/* starts the workers, NULL when the flush is better done serially or they cannot be had */
+static struct fstWriterChainPool *fstWriterChainPoolCreate(struct fstWriterContext *xc, const void *zcdict)
+{
+struct fstWriterChainPool *pool;
+int i;
 
-        pthread_mutex_lock(&xc->mutex);
-	xc->in_pthread = 1;
-        pthread_mutex_unlock(&xc->mutex);
+if((xc->flush_threads <= 1) || (xc->vchg_siz < FST_WRITER_CHAIN_PARALLEL_MIN_BYTES)) return(NULL);
 
-        pthread_create(&xc->thread, &xc->thread_attr, fstWriterFlushContextPrivate1, xc2);
+pool = (struct fstWriterChainPool *)calloc(1, sizeof(struct fstWriterChainPool));
+if(!pool) return(NULL);
+pool->xc = xc;
+pool->zcdict = zcdict;
+pool->workers = (struct fstWriterChainWorker *)calloc(xc->flush_threads, sizeof(struct fstWriterChainWorker));
+pool->slots = (struct fstWriterChainSlot *)calloc(FST_WRITER_CHAIN_RING, sizeof(struct fstWriterChainSlot));
+if((!pool->workers) || (!pool->slots))
+        {
+        free(pool->workers);
+        free(pool->slots);
+        free(pool);
+        return(NULL);
         }
-        else
+
+for(i=0;i<xc->flush_threads;i++)
         {
-        if(xc->parallel_was_enabled) /* conservatively block */
+        /* chains are built at one end, so only the pages of the longest chain get touched */
+        pool->workers[i].pool = pool;
+        if(!(pool->workers[i].scratchpad = (unsigned char *)malloc(FST_VCHG_SCRATCH_SIZ(xc))))
                 {
-                pthread_mutex_lock(&xc->mutex);
-                pthread_mutex_unlock(&xc->mutex);
+                fstWriterChainPoolFree(pool);
+                return(NULL);
                 }
+        }
 
-        xc->xc_parent = xc;
-        fstWriterFlushContextPrivate2(xc);
+pthread_mutex_init(&pool->mutex, NULL);
+pthread_cond_init(&pool->done_cond, NULL);
+pthread_cond_init(&pool->free_cond, NULL);
+
+for(i=0;i<xc->flush_threads;i++)
+        {
+        if(pthread_create(&pool->workers[i].thread, NULL, fstWriterChainWorkerMain, pool->workers + i)) break;
+        pool->num_threads++;
+        }
+
+if(!pool->num_threads)
+        {
+        pthread_cond_destroy(&pool->free_cond);
+        pthread_cond_destroy(&pool->done_cond);
+        pthread_mutex_destroy(&pool->mutex);
+        fstWriterChainPoolFree(pool);
+        return(NULL);
         }
+
+return(pool);
 }
-#endif
 
 
 /*
- * queues up a flush context operation
+ * the next chain to write out in handle order, waiting for the workers as
+ * needed, or NULL after the last.  the slot stays valid until the next call.
  */
-void fstWriterFlushContext(void *ctx)
+static struct fstWriterChainSlot *fstWriterChainPoolNext(struct fstWriterChainPool *pool)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+if(pool->emitted == pool->ready)
         {
-        if(xc->tchn_idx > 1)
+        pthread_mutex_lock(&pool->mutex);
+        pool->written = pool->emitted;          /* every slot handed out so far has been written */
+        pthread_cond_broadcast(&pool->free_cond);
+        for(;;)
                 {
-                xc->flush_context_pending = 1;
+                while((pool->ready < pool->claimed) && (pool->slots[pool->ready % FST_WRITER_CHAIN_RING].done))
+                        {
+                        pool->ready++;
+                        }
+                if((pool->ready > pool->emitted) || ((pool->scan_done) && (pool->ready == pool->claimed))) break;
+                pthread_cond_wait(&pool->done_cond, &pool->mutex);
                 }
+        pthread_mutex_unlock(&pool->mutex);
+
+        if(pool->emitted == pool->ready) return(NULL);
         }
+
+return(pool->slots + (pool->emitted++ % FST_WRITER_CHAIN_RING));
 }
 
 
-/*
- * close out FST file
- */
-void fstWriterClose(void *ctx)
+static void fstWriterChainPoolDestroy(struct fstWriterChainPool *pool)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+int i;
 
-#ifdef FST_WRITER_PARALLEL
-if(xc)
+for(i=0;i<pool->num_threads;i++)
         {
-        pthread_mutex_lock(&xc->mutex);
-        pthread_mutex_unlock(&xc->mutex);
+        pthread_join(pool->workers[i].thread, NULL);
         }
-#endif
 
-if(xc && !xc->already_in_close && !xc->already_in_flush)
-        {
-        unsigned char *tmem = NULL;
-        fst_off_t fixup_offs, tlen, hlen;
-
-        xc->already_in_close = 1; /* never need to zero this out as it is freed at bottom */
+pthread_cond_destroy(&pool->free_cond);
+pthread_cond_destroy(&pool->done_cond);
+pthread_mutex_destroy(&pool->mutex);
+fstWriterChainPoolFree(pool);
+}
+#endif
 
-        if(xc->section_header_only && xc->section_header_truncpos && (xc->vchg_siz <= 1) && (!xc->is_initial_time))
-                {
-                fstFtruncate(fileno(xc->handle), xc->section_header_truncpos);
-                fstWriterFseeko(xc, xc->handle, xc->section_header_truncpos, SEEK_SET);
-                xc->section_header_only = 0;
-                }
-                else
-                {
-                xc->skip_writing_section_hdr = 1;
-                if(!xc->size_limit_locked)
-                        {
-                        if(FST_UNLIKELY(xc->is_initial_time)) /* simulation time never advanced so mock up the changes as time zero ones */
-                                {
-                                fstHandle dupe_idx;
 
-                                fstWriterEmitTimeChange(xc, 0); /* emit some time change just to have one */
-                                for(dupe_idx = 0; dupe_idx < xc->maxhandle; dupe_idx++) /* now clone the values */
-                                        {
-                                        fstWriterEmitValueChange(xc, dupe_idx+1, xc->curval_mem + xc->valpos_mem[4*dupe_idx]);
-                                        }
-                                }
-                        fstWriterFlushContextPrivate(xc);
 #ifdef FST_WRITER_PARALLEL
-                        pthread_mutex_lock(&xc->mutex);
-                        pthread_mutex_unlock(&xc->mutex);
-
-			while (xc->in_pthread) 
-				{ 
-				pthread_mutex_lock(&xc->mutex); 
-				pthread_mutex_unlock(&xc->mutex); 
-				};
+/*
+ * flush pipeline for fstWriterSetParallelMode(): a flush swaps the buffered
+ * changes into one of parallel_depth recycled buffer sets and returns to the
+ * simulation.  a worker flushes the copied context into the set's own file,
+ * and the sets are committed to the trace in submission order, where the
+ * section header written by the block before is patched up.
+ */
+#ifndef FST_WRITER_PARALLEL_DEPTH
+#define FST_WRITER_PARALLEL_DEPTH       (2)     /* blocks in flight by default */
 #endif
-                        }
-                }
-        fstDestroyMmaps(xc, 1);
-	if(xc->outval_mem)
-		{
-		free(xc->outval_mem); xc->outval_mem = NULL;
-		xc->outval_alloc_siz = 0;
-		}
 
-        /* write out geom section */
-        fflush(xc->geom_handle);
-        tlen = ftello(xc->geom_handle);
-	errno = 0;
-	if(tlen)
-		{
-	        fstWriterMmapSanity(tmem = (unsigned char *)fstMmap(NULL, tlen, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->geom_handle), 0), __FILE__, __LINE__, "tmem");
-		}
+struct fstWriterFlushSet
+{
+struct fstWriterFlushSet *next;         /* free list or queue */
+uint64_t seq;                           /* commit order */
+struct fstWriterContext *xc;            /* copy of the writer that gets flushed */
 
-        if(tmem)
-                {
-                unsigned long destlen = tlen;
-                unsigned char *dmem = (unsigned char *)malloc(compressBound(destlen));
-                int rc = compress2(dmem, &destlen, tmem, tlen, 9);
+FILE *body;                             /* the block, then the next section header */
+char *body_nam;
+fst_off_t body_len;                     /* block only */
+fst_off_t next_section_start;           /* in body, 0 when no header follows */
+fst_off_t unc_memreq;
 
-                if((rc != Z_OK) || (((fst_off_t)destlen) > tlen))
-                        {
-                        destlen = tlen;
-                        }
+unsigned char *vchg_mem;                /* swapped with the writer's on submit */
+uint32_t vchg_alloc_siz;
+FILE *tchn_handle;                      /* likewise */
+char *tchn_handle_nam;
+uint32_t *valpos_mem;                   /* copied */
+size_t valpos_len;
+uint32_t *vseg_mem;                     /* copied, FST_WR_BL_SEGMENTED */
+size_t vseg_len;
+unsigned char *curval_mem;              /* copied, read by the next section header */
+uint32_t curval_len;
+};
 
-                fixup_offs = ftello(xc->handle);
-                fputc(FST_BL_SKIP, xc->handle);                 /* temporary tag */
-                fstWriterUint64(xc->handle, destlen + 24);      /* section length */
-                fstWriterUint64(xc->handle, tlen);              /* uncompressed */
-                                                                /* compressed len is section length - 24 */
-                fstWriterUint64(xc->handle, xc->maxhandle);     /* maxhandle */
-                fstFwrite((((fst_off_t)destlen) != tlen) ? dmem : tmem, destlen, 1, xc->handle);
-                fflush(xc->handle);
+struct fstWriterFlushPipe
+{
+pthread_mutex_t mutex;
+pthread_cond_t work_cond;               /* queue has a set or quit */
+pthread_cond_t commit_cond;             /* commit_seq moved */
+pthread_cond_t free_cond;               /* a set was recycled */
+
+struct fstWriterFlushSet *sets;
+int num_sets;
+pthread_t *threads;
+int num_threads;
+
+struct fstWriterFlushSet *free_head;
+struct fstWriterFlushSet *queue_head;
+struct fstWriterFlushSet *queue_tail;
+uint64_t next_seq;
+uint64_t commit_seq;
+int inflight;
+int quit;
+
+FILE *handle;                           /* the trace */
+
+/* writer state the commits own while active, handed back by fstWriterFlushPipeDrain() */
+int active;                             /* not bitfields, the producer and a committer write them */
+int limit_reached;
+int section_header_only;
+int fseek_failed;
+fst_off_t section_start;
+fst_off_t section_header_truncpos;
+};
+#endif
 
-                fstWriterFseeko(xc, xc->handle, fixup_offs, SEEK_SET);
-                fputc(FST_BL_GEOM, xc->handle);                 /* actual tag */
 
-                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);           /* move file pointer to end for any section adds */
-                fflush(xc->handle);
+/*
+ * only to be called directly by fst code...otherwise must
+ * be synced up with time changes
+ */
+#ifdef FST_WRITER_PARALLEL
+static void fstWriterFlushContextPrivate2(void *ctx)
+#else
+static void fstWriterFlushContextPrivate(void *ctx)
+#endif
+{
+#ifdef FST_DEBUG
+int cnt = 0;
+#endif
+unsigned int i;
+FILE *f;
+fst_off_t fpos, indxpos, endpos;
+uint32_t prevpos;
+int zerocnt;
+unsigned char *scratchpad;
+unsigned char *tmem;
+fst_off_t tlen;
+fst_off_t unc_memreq = 0; /* for reader */
+struct fstWriterChainPack pk;
+uint32_t *vm4ip;
+PPvoid_t pv = NULL;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+#ifdef FST_WRITER_PARALLEL
+struct fstWriterContext *xc2 = xc->xc_parent;
+struct fstWriterChainPool *pool = NULL;
+#else
+struct fstWriterContext *xc2 = xc;
+#endif
 
-                free(dmem);
-                fstMunmap(tmem, tlen);
+#ifndef FST_DYNAMIC_ALIAS_DISABLE
+Pvoid_t PJHSArray = (Pvoid_t) NULL;
+#ifndef _WAVE_HAVE_JUDY
+uint32_t hashmask =  xc->maxhandle;
+hashmask |= hashmask >> 1;
+hashmask |= hashmask >> 2;
+hashmask |= hashmask >> 4;
+hashmask |= hashmask >> 8;
+hashmask |= hashmask >> 16;
+#endif
+#endif
+
+if((xc->vchg_siz <= 1)||(xc->already_in_flush)) return;
+xc->already_in_flush = 1; /* should really do this with a semaphore */
+
+xc->section_header_only = 0;
+
+f = xc->handle;
+fstWriterVarint(f, xc->maxhandle);      /* emit current number of handles */
+fputc(xc->zstdpack ? 'S' : (xc->fourpack ? '4' : (xc->fastpack ? 'F' : 'Z')), f);
+fpos = 1;
+
+memset(&pk, 0, sizeof(pk));
+#ifdef HAVE_LIBZSTD
+if(xc->zstdpack)
+        {
+        pk.zcdict = xc2->zstd_cdict;
+        if((xc->zstd_dict_wanted) && (!xc2->zstd_dict_tried))
+                {
+                pk.zsamples = (unsigned char *)malloc(FST_ZSTD_DICT_SAMPLES);
+                pk.zsample_sizes = (size_t *)malloc((FST_ZSTD_DICT_SAMPLES / 32) * sizeof(size_t)); /* only chains over 32 bytes are sampled */
                 }
+        }
+#endif
 
-        if(xc->num_blackouts)
+#ifdef FST_WRITER_PARALLEL
+#ifdef HAVE_LIBZSTD
+if(!pk.zsamples) /* dictionary training samples the chains in order */
+        {
+        pool = fstWriterChainPoolCreate(xc, pk.zcdict);
+        }
+#else
+pool = fstWriterChainPoolCreate(xc, NULL);
+#endif
+
+if(pool)
+        {
+        struct fstWriterChainSlot *slot;
+
+        while((slot = fstWriterChainPoolNext(pool)))
                 {
-                uint64_t cur_bl = 0;
-                fst_off_t bpos, eos;
-                uint32_t i;
+                vm4ip = &(xc->valpos_mem[4*slot->idx]);
+                unc_memreq += slot->wrlen;
+#ifndef FST_DYNAMIC_ALIAS_DISABLE
+                pv = JudyHSIns(&PJHSArray, slot->mem, slot->dlen, NULL);
+#endif
+                fpos += fstWriterEmitChain(xc, pv, slot->idx, vm4ip, fpos, slot->wrlen, slot->mem, slot->dlen, slot->compressed);
+                }
 
-                fixup_offs = ftello(xc->handle);
-                fputc(FST_BL_SKIP, xc->handle);                 /* temporary tag */
-                bpos = fixup_offs + 1;
-                fstWriterUint64(xc->handle, 0);                 /* section length */
-                fstWriterVarint(xc->handle, xc->num_blackouts);
+        fstWriterChainPoolDestroy(pool);
+        }
+        else
+#endif
+        {
+        scratchpad = (unsigned char *)malloc(FST_VCHG_SCRATCH_SIZ(xc));
+        pk.packmem = (unsigned char *)malloc(pk.packmemlen = 1024);
+#ifdef HAVE_LIBZSTD
+        if(xc->zstdpack) pk.zcctx = ZSTD_createCCtx();
+#endif
 
-                for(i=0;i<xc->num_blackouts;i++)
+        for(i=0;i<xc->maxhandle;i++)
+                {
+                vm4ip = &(xc->valpos_mem[4*i]);
+
+                if(vm4ip[2])
                         {
-                        fputc(xc->blackout_head->active, xc->handle);
-                        fstWriterVarint(xc->handle, xc->blackout_head->tim - cur_bl);
-                        cur_bl = xc->blackout_head->tim;
-                        xc->blackout_curr = xc->blackout_head->next;
-                        free(xc->blackout_head);
-                        xc->blackout_head = xc->blackout_curr;
+                        uint32_t wrlen;
+                        unsigned char *scratchpnt = fstWriterBuildChain(xc, i, vm4ip[2], scratchpad, &wrlen);
+                        unsigned char *dpnt;
+                        uint32_t dlen;
+                        int compressed;
+
+                        unc_memreq += wrlen;
+                        dlen = fstWriterPackChain(xc, &pk, scratchpnt, wrlen, &dpnt, &compressed);
+#ifndef FST_DYNAMIC_ALIAS_DISABLE
+                        pv = JudyHSIns(&PJHSArray, dpnt, dlen, NULL);
+#endif
+                        fpos += fstWriterEmitChain(xc, pv, i, vm4ip, fpos, wrlen, dpnt, dlen, compressed);
+#ifdef FST_DEBUG
+                        cnt++;
+#endif
                         }
+                }
 
-                eos = ftello(xc->handle);
-                fstWriterFseeko(xc, xc->handle, bpos, SEEK_SET);
-                fstWriterUint64(xc->handle, eos - bpos);
-                fflush(xc->handle);
+        free(pk.packmem); pk.packmem = NULL; /* scan-build */
+#ifdef HAVE_LIBZSTD
+        ZSTD_freeCCtx(pk.zcctx);
+#endif
+        free(scratchpad); scratchpad = NULL;
+        }
 
-                fstWriterFseeko(xc, xc->handle, fixup_offs, SEEK_SET);
-                fputc(FST_BL_BLACKOUT, xc->handle);     /* actual tag */
+#ifndef FST_DYNAMIC_ALIAS_DISABLE
+JudyHSFreeArray(&PJHSArray, NULL);
+#endif
 
-                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);   /* move file pointer to end for any section adds */
-                fflush(xc->handle);
-                }
+prevpos = 0; zerocnt = 0;
 
-        if(xc->compress_hier)
-                {
-                fst_off_t hl, eos;
-                gzFile zhandle;
-                int zfd;
-                int fourpack_duo = 0;
-#ifndef __MINGW32__
-		int fnam_len = strlen(xc->filename) + 5 + 1;
-                char *fnam = (char *)malloc(fnam_len);
-#endif
+indxpos = ftello(f);
+xc->secnum++;
 
-                fixup_offs = ftello(xc->handle);
-                fputc(FST_BL_SKIP, xc->handle);                 /* temporary tag */
-                hlen = ftello(xc->handle);
-                fstWriterUint64(xc->handle, 0);                 /* section length */
-                fstWriterUint64(xc->handle, xc->hier_file_len); /* uncompressed length */
+#ifndef FST_DYNAMIC_ALIAS2_DISABLE
+if(1)
+        {
+        uint32_t prev_alias = 0;
 
-                if(!xc->fourpack)
+        for(i=0;i<xc->maxhandle;i++)
+                {
+                vm4ip = &(xc->valpos_mem[4*i]);
+
+                if(vm4ip[2])
                         {
-                        unsigned char *mem = (unsigned char *)malloc(FST_GZIO_LEN);
-                        zfd = dup(fileno(xc->handle));
-                        fflush(xc->handle);
-                        zhandle = gzdopen(zfd, "wb4");
-                        if(zhandle)
+                        if(zerocnt)
                                 {
-                                fstWriterFseeko(xc, xc->hier_handle, 0, SEEK_SET);
-                                for(hl = 0; hl < xc->hier_file_len; hl += FST_GZIO_LEN)
+                                fpos += fstWriterVarint(f, (zerocnt << 1));
+                                zerocnt = 0;
+                                }
+
+                        if(vm4ip[2] & 0x80000000)
+                                {
+                                if(vm4ip[2] != prev_alias)
                                         {
-                                        unsigned len = ((xc->hier_file_len - hl) > FST_GZIO_LEN) ? FST_GZIO_LEN : (xc->hier_file_len - hl);
-                                        fstFread(mem, len, 1, xc->hier_handle);
-                                        gzwrite(zhandle, mem, len);
+					int32_t  t_i32 = ((int32_t)(prev_alias = vm4ip[2])); /* vm4ip is generic unsigned data */
+					int64_t  t_i64 = (int64_t)t_i32; /* convert to signed */
+					uint64_t t_u64 = (uint64_t)t_i64; /* sign extend through 64b */
+
+					fpos += fstWriterSVarint(f, (int64_t)((t_u64 << 1) | 1)); /* all in this block was: fpos += fstWriterSVarint(f, (((int64_t)((int32_t)(prev_alias = vm4ip[2]))) << 1) | 1); */
+                                        }
+                                        else
+                                        {
+                                        fpos += fstWriterSVarint(f, (0 << 1) | 1);
                                         }
-                                gzclose(zhandle);
                                 }
                                 else
                                 {
-                                close(zfd);
+                                fpos += fstWriterSVarint(f, ((vm4ip[2] - prevpos) << 1) | 1);
+                                prevpos = vm4ip[2];
                                 }
-                        free(mem);
+                        vm4ip[2] = 0;
+                        vm4ip[3] = 0; /* clear out tchn idx */
                         }
                         else
                         {
-                        int lz4_maxlen;
-                        unsigned char *mem;
-                        unsigned char *hmem = NULL;
-                        int packed_len;
-
-                        fflush(xc->handle);
-
-                        lz4_maxlen = LZ4_compressBound(xc->hier_file_len);
-                        mem = (unsigned char *)malloc(lz4_maxlen);
-			errno = 0;
-			if(xc->hier_file_len)
-				{
-	                        fstWriterMmapSanity(hmem = (unsigned char *)fstMmap(NULL, xc->hier_file_len, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->hier_handle), 0), __FILE__, __LINE__, "hmem");
-				}
-                        packed_len = LZ4_compress_default((char *)hmem, (char *)mem, xc->hier_file_len, lz4_maxlen);
-                        fstMunmap(hmem, xc->hier_file_len);
-
-                        fourpack_duo = (!xc->repack_on_close) && (xc->hier_file_len > FST_HDR_FOURPACK_DUO_SIZE); /* double pack when hierarchy is large */
+                        zerocnt++;
+                        }
+                }
+        }
+        else
+#endif
+        {
+        for(i=0;i<xc->maxhandle;i++)
+                {
+                vm4ip = &(xc->valpos_mem[4*i]);
 
-                        if(fourpack_duo)        /* double packing with LZ4 is faster than gzip */
+                if(vm4ip[2])
+                        {
+                        if(zerocnt)
                                 {
-                                unsigned char *mem_duo;
-                                int lz4_maxlen_duo;
-                                int packed_len_duo;
-
-                                lz4_maxlen_duo = LZ4_compressBound(packed_len);
-                                mem_duo = (unsigned char *)malloc(lz4_maxlen_duo);
-                                packed_len_duo = LZ4_compress_default((char *)mem, (char *)mem_duo, packed_len, lz4_maxlen_duo);
+                                fpos += fstWriterVarint(f, (zerocnt << 1));
+                                zerocnt = 0;
+                                }
 
-                                fstWriterVarint(xc->handle, packed_len); /* 1st round compressed length */
-                                fstFwrite(mem_duo, packed_len_duo, 1, xc->handle);
-                                free(mem_duo);
+                        if(vm4ip[2] & 0x80000000)
+                                {
+                                fpos += fstWriterVarint(f, 0); /* signal, note that using a *signed* varint would be more efficient than this byte escape! */
+                                fpos += fstWriterVarint(f, (-(int32_t)vm4ip[2]));
                                 }
                                 else
                                 {
-                                fstFwrite(mem, packed_len, 1, xc->handle);
+                                fpos += fstWriterVarint(f, ((vm4ip[2] - prevpos) << 1) | 1);
+                                prevpos = vm4ip[2];
                                 }
-
-                        free(mem);
+                        vm4ip[2] = 0;
+                        vm4ip[3] = 0; /* clear out tchn idx */
+                        }
+                        else
+                        {
+                        zerocnt++;
                         }
+                }
+        }
 
-                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);
-                eos = ftello(xc->handle);
-                fstWriterFseeko(xc, xc->handle, hlen, SEEK_SET);
-                fstWriterUint64(xc->handle, eos - hlen);
-                fflush(xc->handle);
-
-                fstWriterFseeko(xc, xc->handle, fixup_offs, SEEK_SET);
-                fputc(xc->fourpack ?
-                        ( fourpack_duo ? FST_BL_HIER_LZ4DUO : FST_BL_HIER_LZ4) :
-                        FST_BL_HIER, xc->handle); /* actual tag now also == compression type */
-
-                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);   /* move file pointer to end for any section adds */
-                fflush(xc->handle);
-
-#ifndef __MINGW32__
-                snprintf(fnam, fnam_len, "%s.hier", xc->filename);
-                unlink(fnam);
-                free(fnam);
+if(zerocnt)
+        {
+        /* fpos += */ fstWriterVarint(f, (zerocnt << 1)); /* scan-build */
+        }
+#ifdef FST_DEBUG
+fprintf(stderr, FST_APIMESS "value chains: %d\n", cnt);
 #endif
-                }
-
-        /* finalize out header */
-        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_START_TIME, SEEK_SET);
-        fstWriterUint64(xc->handle, xc->firsttime);
-        fstWriterUint64(xc->handle, xc->curtime);
-        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_NUM_SCOPES, SEEK_SET);
-        fstWriterUint64(xc->handle, xc->numscopes);
-        fstWriterUint64(xc->handle, xc->numsigs);
-        fstWriterUint64(xc->handle, xc->maxhandle);
-        fstWriterUint64(xc->handle, xc->secnum);
-        fflush(xc->handle);
-
-        tmpfile_close(&xc->tchn_handle, &xc->tchn_handle_nam);
-        free(xc->vchg_mem); xc->vchg_mem = NULL;
-        tmpfile_close(&xc->curval_handle, &xc->curval_handle_nam);
-        tmpfile_close(&xc->valpos_handle, &xc->valpos_handle_nam);
-        tmpfile_close(&xc->geom_handle, &xc->geom_handle_nam);
-        if(xc->hier_handle) { fclose(xc->hier_handle); xc->hier_handle = NULL; }
-        if(xc->handle)
-                {
-                if(xc->repack_on_close)
-                        {
-                        FILE *fp;
-                        fst_off_t offpnt, uclen;
-                        int flen = strlen(xc->filename);
-                        char *hf = (char *)calloc(1, flen + 5);
 
-                        strcpy(hf, xc->filename);
-                        strcpy(hf+flen, ".pak");
-                        fp = fopen(hf, "wb");
+xc->vchg_mem[0] = '!';
+xc->vchg_siz = 1;
+xc->vchg_grow = 0;
+fstWriterResetSegments(xc);
 
-                        if(fp)
-                                {
-                                gzFile dsth;
-                                int zfd;
-                                char gz_membuf[FST_GZIO_LEN];
+endpos = ftello(xc->handle);
+fstWriterUint64(xc->handle, endpos-indxpos);            /* write delta index position at very end of block */
 
-                                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);
-                                uclen = ftello(xc->handle);
+/*emit time changes for block */
+fflush(xc->tchn_handle);
+tlen = ftello(xc->tchn_handle);
+fstWriterFseeko(xc, xc->tchn_handle, 0, SEEK_SET);
 
-                                fputc(FST_BL_ZWRAPPER, fp);
-                                fstWriterUint64(fp, 0);
-                                fstWriterUint64(fp, uclen);
-                                fflush(fp);
+errno = 0;
+fstWriterMmapSanity(tmem = (unsigned char *)fstMmap(NULL, tlen, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->tchn_handle), 0), __FILE__, __LINE__, "tmem");
+if(tmem)
+        {
+        unsigned long destlen = tlen;
+        unsigned char *dmem;
+        int rc;
 
-                                fstWriterFseeko(xc, xc->handle, 0, SEEK_SET);
-                                zfd = dup(fileno(fp));
-                                dsth = gzdopen(zfd, "wb4");
-                                if(dsth)
-                                        {
-                                        for(offpnt = 0; offpnt < uclen; offpnt += FST_GZIO_LEN)
-                                                {
-                                                size_t this_len = ((uclen - offpnt) > FST_GZIO_LEN) ? FST_GZIO_LEN : (uclen - offpnt);
-                                                fstFread(gz_membuf, this_len, 1, xc->handle);
-                                                gzwrite(dsth, gz_membuf, this_len);
-                                                }
-                                        gzclose(dsth);
-                                        }
-                                        else
-                                        {
-                                        close(zfd);
-                                        }
-                                fstWriterFseeko(xc, fp, 0, SEEK_END);
-                                offpnt = ftello(fp);
-                                fstWriterFseeko(xc, fp, 1, SEEK_SET);
-                                fstWriterUint64(fp, offpnt - 1);
-                                fclose(fp);
-                                fclose(xc->handle); xc->handle = NULL;
+#ifdef HAVE_LIBZSTD
+        if(xc->zstdpack)
+                {
+                size_t zrc;
 
-                                unlink(xc->filename);
-                                rename(hf, xc->filename);
-                                }
-                                else
-                                {
-                                xc->repack_on_close = 0;
-                                fclose(xc->handle); xc->handle = NULL;
-                                }
+                dmem = (unsigned char *)malloc(ZSTD_compressBound(tlen));
+                zrc = ZSTD_compress(dmem, ZSTD_compressBound(tlen), tmem, tlen, FST_ZSTD_LEVEL);
+                rc = ZSTD_isError(zrc) ? Z_DATA_ERROR : Z_OK;
+                destlen = zrc;
+                }
+                else
+#endif
+                {
+                dmem = (unsigned char *)malloc(compressBound(destlen));
+                rc = compress2(dmem, &destlen, tmem, tlen, 9);
+                }
 
-                        free(hf);
-                        }
-                        else
-                        {
-                        fclose(xc->handle); xc->handle = NULL;
-                        }
+        if((rc == Z_OK) && (((fst_off_t)destlen) < tlen))
+                {
+                fstFwrite(dmem, destlen, 1, xc->handle);
+                }
+                else /* comparison between compressed / decompressed len tells if compressed */
+                {
+                fstFwrite(tmem, tlen, 1, xc->handle);
+                destlen = tlen;
                 }
+        free(dmem);
+        fstMunmap(tmem, tlen);
+        fstWriterUint64(xc->handle, tlen);              /* uncompressed */
+        fstWriterUint64(xc->handle, destlen);           /* compressed */
+        fstWriterUint64(xc->handle, xc->tchn_cnt);      /* number of time items */
+        }
 
-#ifdef __MINGW32__
-        {
-        int flen = strlen(xc->filename);
-        char *hf = (char *)calloc(1, flen + 6);
-        strcpy(hf, xc->filename);
+xc->tchn_cnt = xc->tchn_idx = 0;
+fstWriterFseeko(xc, xc->tchn_handle, 0, SEEK_SET);
+fstFtruncate(fileno(xc->tchn_handle), 0);
 
-        if(xc->compress_hier)
+/* write block trailer */
+endpos = ftello(xc->handle);
+#ifdef FST_WRITER_PARALLEL
+if(xc->flush_set) /* pipeline copy: the block went to its own file, fstWriterFlushPipeCommit() places it */
+        {
+        xc->flush_set->body_len = endpos;
+        xc->flush_set->unc_memreq = unc_memreq;
+        xc->flush_set->next_section_start = 0;
+        if(!xc->skip_writing_section_hdr)
                 {
-                strcpy(hf + flen, ".hier");
-                unlink(hf); /* no longer needed as a section now exists for this */
+                fstWriterEmitSectionHeader(xc);
+                xc->flush_set->next_section_start = xc->section_start;
                 }
+        fflush(xc->handle);
 
-        free(hf);
+        xc->already_in_flush = 0;
+        return;
         }
 #endif
+fstWriterPatchSectionHeader(xc, xc->handle, xc->section_start, endpos, unc_memreq);
 
-#ifdef FST_WRITER_PARALLEL
-        pthread_mutex_destroy(&xc->mutex);
-        pthread_attr_destroy(&xc->thread_attr);
+#ifdef HAVE_LIBZSTD
+if(pk.zsamples)
+        {
+        fstWriterEmitZstdDict(xc, xc2, pk.zsamples, pk.zsample_sizes, pk.zsample_cnt, pk.zsamples_len);
+        endpos = ftello(xc->handle);
+        free(pk.zsamples);
+        free(pk.zsample_sizes);
+        }
 #endif
 
-        if(xc->path_array)
+xc2->section_header_truncpos = endpos;                          /* cache in case of need to truncate */
+if(xc->dump_size_limit)
+        {
+        if(endpos >= ((fst_off_t)xc->dump_size_limit))
                 {
-#ifndef _WAVE_HAVE_JUDY
-                const uint32_t hashmask = FST_PATH_HASHMASK;
+                xc2->skip_writing_section_hdr = 1;
+                xc2->size_limit_locked = 1;
+                xc2->is_initial_time = 1; /* to trick emit value and emit time change */
+#ifdef FST_DEBUG
+                fprintf(stderr, FST_APIMESS "<< dump file size limit reached, stopping dumping >>\n");
 #endif
-                JudyHSFreeArray(&(xc->path_array), NULL);
                 }
+        }
 
-        free(xc->filename); xc->filename = NULL;
-        free(xc);
+if(!xc2->skip_writing_section_hdr)
+        {
+        fstWriterEmitSectionHeader(xc);                         /* emit next section header */
         }
+fflush(xc->handle);
+
+xc->already_in_flush = 0;
 }
 
 
+#ifdef FST_WRITER_PARALLEL
 /*
- * functions to set miscellaneous header/block information
+ * appends a flushed set to the trace and patches the header of the section
+ * it belongs to.  runs on the worker whose set is next in commit order, so
+ * only one thread touches the trace at a time.  returns 1 when the block
+ * crossed the dump size limit; later blocks are then dropped as a serial
+ * flush never would have made them.
  */
-void fstWriterSetDate(void *ctx, const char *dat)
+static int fstWriterFlushPipeCommit(struct fstWriterFlushPipe *pipe, struct fstWriterFlushSet *set)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
-        {
-        char s[FST_HDR_DATE_SIZE];
-        fst_off_t fpos = ftello(xc->handle);
-        int len = strlen(dat);
+struct fstWriterContext *xc = set->xc;
+FILE *f = pipe->handle;
+fst_off_t base, endpos, tlen;
+unsigned char *tmem;
+int limit = 0;
 
-        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_DATE, SEEK_SET);
-        memset(s, 0, FST_HDR_DATE_SIZE);
-        memcpy(s, dat, (len < FST_HDR_DATE_SIZE) ? len : FST_HDR_DATE_SIZE);
-        fstFwrite(s, FST_HDR_DATE_SIZE, 1, xc->handle);
-        fflush(xc->handle);
-        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
-        }
-}
+if(pipe->limit_reached) return(0);
+
+tlen = ftello(set->body);
+errno = 0;
+fstWriterMmapSanity(tmem = (unsigned char *)fstMmap(NULL, tlen, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(set->body), 0), __FILE__, __LINE__, "tmem");
 
+base = ftello(f);
+fstFwrite(tmem, set->body_len, 1, f);
+endpos = base + set->body_len;
+fstWriterPatchSectionHeader(xc, f, pipe->section_start, endpos, set->unc_memreq);
 
-void fstWriterSetVersion(void *ctx, const char *vers)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc && vers)
+pipe->section_header_truncpos = endpos;
+pipe->section_header_only = 0;
+if(xc->dump_size_limit && (endpos >= ((fst_off_t)xc->dump_size_limit)))
         {
-        char s[FST_HDR_SIM_VERSION_SIZE];
-        fst_off_t fpos = ftello(xc->handle);
-        int len = strlen(vers);
-
-        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_SIM_VERSION, SEEK_SET);
-        memset(s, 0, FST_HDR_SIM_VERSION_SIZE);
-        memcpy(s, vers, (len < FST_HDR_SIM_VERSION_SIZE) ? len : FST_HDR_SIM_VERSION_SIZE);
-        fstFwrite(s, FST_HDR_SIM_VERSION_SIZE, 1, xc->handle);
-        fflush(xc->handle);
-        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
+        limit = 1;
+#ifdef FST_DEBUG
+        fprintf(stderr, FST_APIMESS "<< dump file size limit reached, stopping dumping >>\n");
+#endif
+        }
+else if(set->next_section_start)
+        {
+        fstFwrite(tmem + set->body_len, tlen - set->body_len, 1, f);
+        pipe->section_start = base + set->next_section_start;
+        pipe->section_header_only = 1;
         }
+fflush(f);
+fstMunmap(tmem, tlen);
+
+if(xc->fseek_failed) pipe->fseek_failed = 1;
+return(limit);
 }
 
 
-void fstWriterSetFileType(void *ctx, enum fstFileType filetype)
+static void *fstWriterFlushPipeWorker(void *arg)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+struct fstWriterFlushPipe *pipe = (struct fstWriterFlushPipe *)arg;
+
+for(;;)
         {
-        if(/*(filetype >= FST_FT_MIN) &&*/ (filetype <= FST_FT_MAX))
+        struct fstWriterFlushSet *set;
+        int limit;
+
+        pthread_mutex_lock(&pipe->mutex);
+        while(!pipe->queue_head && !pipe->quit)
                 {
-                fst_off_t fpos = ftello(xc->handle);
+                pthread_cond_wait(&pipe->work_cond, &pipe->mutex);
+                }
+        set = pipe->queue_head;
+        if(!set)
+                {
+                pthread_mutex_unlock(&pipe->mutex);
+                break;
+                }
+        pipe->queue_head = set->next;
+        if(!pipe->queue_head) pipe->queue_tail = NULL;
+        pthread_mutex_unlock(&pipe->mutex);
 
-                xc->filetype = filetype;
+        fstWriterFlushContextPrivate2(set->xc);
 
-                fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_FILETYPE, SEEK_SET);
-                fputc(xc->filetype, xc->handle);
-                fflush(xc->handle);
-                fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
+        pthread_mutex_lock(&pipe->mutex);
+        while(pipe->commit_seq != set->seq)
+                {
+                pthread_cond_wait(&pipe->commit_cond, &pipe->mutex);
                 }
+        pthread_mutex_unlock(&pipe->mutex);
+
+        limit = fstWriterFlushPipeCommit(pipe, set);
+
+        pthread_mutex_lock(&pipe->mutex);
+        if(limit) pipe->limit_reached = 1;
+        pipe->commit_seq++;
+        pipe->inflight--;
+        set->next = pipe->free_head;
+        pipe->free_head = set;
+        pthread_cond_broadcast(&pipe->commit_cond);
+        pthread_cond_broadcast(&pipe->free_cond);
+        pthread_mutex_unlock(&pipe->mutex);
         }
+
+return(NULL);
 }
 
 
-static void fstWriterSetAttrDoubleArgGeneric(void *ctx, int typ, uint64_t arg1, uint64_t arg2)
+static void fstWriterFlushPipeFree(struct fstWriterFlushPipe *pipe)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+int i;
+
+for(i=0;i<pipe->num_sets;i++)
         {
-        unsigned char buf[11]; /* ceil(64/7) = 10 + null term */
-        unsigned char *pnt = fstCopyVarint64ToRight(buf, arg1);
-        if(arg1)
-                {
-                *pnt = 0; /* this converts any *nonzero* arg1 when made a varint into a null-term string */
-                }
+        struct fstWriterFlushSet *set = &pipe->sets[i];
 
-        fstWriterSetAttrBegin(xc, FST_AT_MISC, typ, (char *)buf, arg2);
+        free(set->xc);
+        tmpfile_close(&set->body, &set->body_nam);
+        free(set->vchg_mem);
+        tmpfile_close(&set->tchn_handle, &set->tchn_handle_nam);
+        free(set->valpos_mem);
+        free(set->vseg_mem);
+        free(set->curval_mem);
         }
+
+free(pipe->sets);
+free(pipe->threads);
+free(pipe);
 }
 
 
-static void fstWriterSetAttrGeneric(void *ctx, const char *comm, int typ, uint64_t arg)
+/*
+ * NULL when no worker could be started, the writer then flushes serially
+ */
+static struct fstWriterFlushPipe *fstWriterFlushPipeCreate(struct fstWriterContext *xc)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc && comm)
+struct fstWriterFlushPipe *pipe = (struct fstWriterFlushPipe *)calloc(1, sizeof(struct fstWriterFlushPipe));
+int depth = (xc->parallel_depth > 0) ? xc->parallel_depth : FST_WRITER_PARALLEL_DEPTH;
+int i;
+
+pipe->handle = xc->handle;
+pipe->sets = (struct fstWriterFlushSet *)calloc(depth, sizeof(struct fstWriterFlushSet));
+pipe->threads = (pthread_t *)calloc(depth, sizeof(pthread_t));
+for(i=0;i<depth;i++)
         {
-        char *s = strdup(comm);
-        char *sf = s;
+        struct fstWriterFlushSet *set = &pipe->sets[pipe->num_sets];
 
-        while(*s)
+        set->xc = (struct fstWriterContext *)malloc(sizeof(struct fstWriterContext));
+        set->body = tmpfile_open(&set->body_nam);
+        set->tchn_handle = tmpfile_open(&set->tchn_handle_nam);
+        pipe->num_sets++;
+        if(!set->body || !set->tchn_handle) break;
+
+        set->next = pipe->free_head;
+        pipe->free_head = set;
+        }
+
+pthread_mutex_init(&pipe->mutex, NULL);
+pthread_cond_init(&pipe->work_cond, NULL);
+pthread_cond_init(&pipe->commit_cond, NULL);
+pthread_cond_init(&pipe->free_cond, NULL);
+
+if(pipe->free_head)
+        {
+        for(i=0;i<depth;i++) /* each worker holds at most one set */
                 {
-                if((*s == '\n') || (*s == '\r')) *s = ' ';
-                s++;
+                if(pthread_create(&pipe->threads[pipe->num_threads], NULL, fstWriterFlushPipeWorker, pipe)) break;
+                pipe->num_threads++;
                 }
+        }
 
-        fstWriterSetAttrBegin(xc, FST_AT_MISC, typ, sf, arg);
-        free(sf);
+if(!pipe->num_threads)
+        {
+        pthread_cond_destroy(&pipe->free_cond);
+        pthread_cond_destroy(&pipe->commit_cond);
+        pthread_cond_destroy(&pipe->work_cond);
+        pthread_mutex_destroy(&pipe->mutex);
+        fstWriterFlushPipeFree(pipe);
+        pipe = NULL;
         }
+
+return(pipe);
 }
 
 
-static void fstWriterSetSourceStem_2(void *ctx, const char *path, unsigned int line, unsigned int use_realpath, int typ)
+/*
+ * waits until every submitted block is in the trace and hands the section
+ * state the commits kept back to the writer, which may then write the
+ * trace itself again
+ */
+static void fstWriterFlushPipeDrain(struct fstWriterContext *xc)
 {
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+struct fstWriterFlushPipe *pipe = xc->pipe;
 
-if(xc && path && path[0])
+if(!pipe) return;
+
+pthread_mutex_lock(&pipe->mutex);
+while(pipe->inflight)
         {
-        uint64_t sidx = 0;
-        int slen = strlen(path);
-#ifndef _WAVE_HAVE_JUDY
-        const uint32_t hashmask = FST_PATH_HASHMASK;
-        const unsigned char *path2 = (const unsigned char *)path;
-	PPvoid_t pv;
-#else
-        char *path2 = (char *)alloca(slen + 1); /* judy lacks const qualifier in its JudyHSIns definition */
-	PPvoid_t pv;
-        strcpy(path2, path);
-#endif
+        pthread_cond_wait(&pipe->free_cond, &pipe->mutex);
+        }
 
-        pv = JudyHSIns(&(xc->path_array), path2, slen, NULL);
-        if(*pv)
-                {
-                sidx = (intptr_t)(*pv);
-                }
-                else
+if(pipe->active)
+        {
+        xc->section_start = pipe->section_start;
+        xc->section_header_truncpos = pipe->section_header_truncpos;
+        xc->section_header_only = pipe->section_header_only;
+        if(pipe->fseek_failed) xc->fseek_failed = 1;
+        if(pipe->limit_reached)
                 {
-                char *rp = NULL;
-
-                sidx = ++xc->path_array_count;
-                *pv = (void *)(intptr_t)(xc->path_array_count);
-
-                if(use_realpath)
-                        {
-                        rp = fstRealpath(
-#ifndef _WAVE_HAVE_JUDY
-                                (const char *)
-#endif
-                                path2, NULL);
-                        }
-
-                fstWriterSetAttrGeneric(xc, rp ? rp :
-#ifndef _WAVE_HAVE_JUDY
-                        (const char *)
-#endif
-                        path2, FST_MT_PATHNAME, sidx);
-
-                if(rp)
-                        {
-                        free(rp);
-                        }
+                xc->skip_writing_section_hdr = 1;
+                xc->size_limit_locked = 1;
+                xc->is_initial_time = 1; /* to trick emit value and emit time change */
                 }
-
-        fstWriterSetAttrDoubleArgGeneric(xc, typ, sidx, line);
+        pipe->active = 0;
         }
+pthread_mutex_unlock(&pipe->mutex);
 }
 
 
-void fstWriterSetSourceStem(void *ctx, const char *path, unsigned int line, unsigned int use_realpath)
+static void fstWriterFlushPipeDestroy(struct fstWriterContext *xc)
 {
-fstWriterSetSourceStem_2(ctx, path, line, use_realpath, FST_MT_SOURCESTEM);
-}
-
+struct fstWriterFlushPipe *pipe = xc->pipe;
+int i;
 
-void fstWriterSetSourceInstantiationStem(void *ctx, const char *path, unsigned int line, unsigned int use_realpath)
-{
-fstWriterSetSourceStem_2(ctx, path, line, use_realpath, FST_MT_SOURCEISTEM);
-}
+if(!pipe) return;
 
+fstWriterFlushPipeDrain(xc);
 
-void fstWriterSetComment(void *ctx, const char *comm)
-{
-fstWriterSetAttrGeneric(ctx, comm, FST_MT_COMMENT, 0);
-}
+pthread_mutex_lock(&pipe->mutex);
+pipe->quit = 1;
+pthread_cond_broadcast(&pipe->work_cond);
+pthread_mutex_unlock(&pipe->mutex);
 
+for(i=0;i<pipe->num_threads;i++)
+        {
+        pthread_join(pipe->threads[i], NULL);
+        }
 
-void fstWriterSetValueList(void *ctx, const char *vl)
-{
-fstWriterSetAttrGeneric(ctx, vl, FST_MT_VALUELIST, 0);
+pthread_cond_destroy(&pipe->free_cond);
+pthread_cond_destroy(&pipe->commit_cond);
+pthread_cond_destroy(&pipe->work_cond);
+pthread_mutex_destroy(&pipe->mutex);
+fstWriterFlushPipeFree(pipe);
+xc->pipe = NULL;
 }
 
 
-void fstWriterSetEnvVar(void *ctx, const char *envvar)
-{
-fstWriterSetAttrGeneric(ctx, envvar, FST_MT_ENVVAR, 0);
-}
+/*
+ * hands the changes buffered since the last flush to the pipeline.  blocks
+ * only when all parallel_depth sets are still in flight.
+ */
+static void fstWriterFlushPipeSubmit(struct fstWriterContext *xc)
+{
+struct fstWriterFlushPipe *pipe = xc->pipe;
+struct fstWriterFlushSet *set;
+struct fstWriterContext *xc2;
+unsigned char *swap_mem;
+uint32_t swap_siz;
+FILE *swap_f;
+char *swap_nam;
+size_t valpos_len;
+unsigned int i;
 
+if((xc->vchg_siz <= 1)||(xc->already_in_flush)) return;
 
-void fstWriterSetTimescale(void *ctx, int ts)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+pthread_mutex_lock(&pipe->mutex);
+while(!pipe->free_head)
         {
-        fst_off_t fpos = ftello(xc->handle);
-        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_TIMESCALE, SEEK_SET);
-        fputc(ts & 255, xc->handle);
-        fflush(xc->handle);
-        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
+        pthread_cond_wait(&pipe->free_cond, &pipe->mutex);
         }
-}
 
+if(pipe->limit_reached) /* an older block crossed the dump size limit */
+        {
+        pthread_mutex_unlock(&pipe->mutex);
+        fstWriterFlushPipeDrain(xc);
+        return;
+        }
 
-void fstWriterSetTimescaleFromString(void *ctx, const char *s)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc && s)
+set = pipe->free_head;
+pipe->free_head = set->next;
+pipe->inflight++;
+if(!pipe->active) /* the writer wrote the trace last */
         {
-        int mat = 0;
-        int seconds_exp = -9;
-        int tv = atoi(s);
-        const char *pnt = s;
+        pipe->section_start = xc->section_start;
+        pipe->section_header_truncpos = xc->section_header_truncpos;
+        pipe->section_header_only = xc->section_header_only;
+        pipe->active = 1;
+        }
+pthread_mutex_unlock(&pipe->mutex);
 
-        while(*pnt)
-                {
-                switch(*pnt)
-                        {
-                        case 'm': seconds_exp =  -3; mat = 1; break;
-                        case 'u': seconds_exp =  -6; mat = 1; break;
-                        case 'n': seconds_exp =  -9; mat = 1; break;
-                        case 'p': seconds_exp = -12; mat = 1; break;
-                        case 'f': seconds_exp = -15; mat = 1; break;
-                        case 'a': seconds_exp = -18; mat = 1; break;
-                        case 'z': seconds_exp = -21; mat = 1; break;
-                        case 's': seconds_exp =   0; mat = 1; break;
-                        default: break;
-                        }
+if(sizeof(size_t) < sizeof(uint64_t))
+	{
+	/* TALOS-2023-1777 for 32b overflow */
+	uint64_t chk_64 = xc->maxhandle * 4 * sizeof(uint32_t);
+	size_t   chk_32 = xc->maxhandle * 4 * sizeof(uint32_t);
+	if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1777");
+	}
 
-                if(mat) break;
-                pnt++;
-                }
+valpos_len = xc->maxhandle * 4 * sizeof(uint32_t);
+if(set->valpos_len < valpos_len)
+        {
+        free(set->valpos_mem);
+        set->valpos_mem = (uint32_t *)malloc(set->valpos_len = valpos_len);
+        }
+memcpy(set->valpos_mem, xc->valpos_mem, valpos_len);
 
-        if(tv == 10)
+for(i=0;i<xc->maxhandle;i++)
+        {
+        uint32_t *vm4ip = &(xc->valpos_mem[4*i]);
+
+#ifndef FST_REMOVE_DUPLICATE_VC
+        if(vm4ip[2] && vm4ip[1]) /* checkpoint the latest values as fstWriterEncodeChain() will in the copy */
                 {
-                seconds_exp++;
+                fstWriterCheckpointValue(xc, vm4ip);
                 }
-        else
-        if(tv == 100)
+#endif
+        vm4ip[2] = 0; /* zero out offset val */
+        vm4ip[3] = 0; /* zero out last time change val */
+        }
+
+if(xc->vseg_mem)
+        {
+        size_t vseg_len = xc->vseg_handles * FST_VSEG_ENTRY * sizeof(uint32_t);
+
+        if(set->vseg_len < vseg_len)
                 {
-                seconds_exp+=2;
+                free(set->vseg_mem);
+                set->vseg_mem = (uint32_t *)malloc(set->vseg_len = vseg_len);
                 }
-
-        fstWriterSetTimescale(ctx, seconds_exp);
+        memcpy(set->vseg_mem, xc->vseg_mem, vseg_len);
+        fstWriterResetSegments(xc);
         }
-}
 
-
-void fstWriterSetTimezero(void *ctx, int64_t tim)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+if(set->curval_len < xc->maxvalpos)
         {
-        fst_off_t fpos = ftello(xc->handle);
-        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_TIMEZERO, SEEK_SET);
-        fstWriterUint64(xc->handle, (xc->timezero = tim));
-        fflush(xc->handle);
-        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
+        free(set->curval_mem);
+        set->curval_mem = (unsigned char *)malloc(set->curval_len = xc->maxvalpos);
         }
-}
-
+memcpy(set->curval_mem, xc->curval_mem, xc->maxvalpos);
 
-void fstWriterSetPackType(void *ctx, enum fstWriterPackType typ)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+if(!set->vchg_mem)
         {
-        xc->fastpack     = (typ != FST_WR_PT_ZLIB);
-        xc->fourpack     = (typ == FST_WR_PT_LZ4);
+        set->vchg_alloc_siz = xc->fst_break_size + xc->fst_break_add_size;
+        set->vchg_mem = (unsigned char *)malloc(set->vchg_alloc_siz);
         }
-}
+swap_mem = xc->vchg_mem; xc->vchg_mem = set->vchg_mem; set->vchg_mem = swap_mem;
+swap_siz = xc->vchg_alloc_siz; xc->vchg_alloc_siz = set->vchg_alloc_siz; set->vchg_alloc_siz = swap_siz;
+swap_f = xc->tchn_handle; xc->tchn_handle = set->tchn_handle; set->tchn_handle = swap_f;
+swap_nam = xc->tchn_handle_nam; xc->tchn_handle_nam = set->tchn_handle_nam; set->tchn_handle_nam = swap_nam;
 
+fstWriterFseeko(xc, set->body, 0, SEEK_SET);
+fstFtruncate(fileno(set->body), 0);
 
-void fstWriterSetRepackOnClose(void *ctx, int enable)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
-        {
-        xc->repack_on_close = (enable != 0);
-        }
-}
+xc2 = set->xc;
+memcpy(xc2, xc, sizeof(struct fstWriterContext));
+xc2->xc_parent = xc;
+xc2->pipe = NULL;
+xc2->flush_set = set;
+xc2->handle = set->body;
+xc2->vchg_mem = set->vchg_mem;
+xc2->vchg_alloc_siz = set->vchg_alloc_siz;
+xc2->tchn_handle = set->tchn_handle;
+xc2->tchn_handle_nam = set->tchn_handle_nam;
+xc2->valpos_mem = set->valpos_mem;
+xc2->vseg_mem = set->vseg_mem;
+xc2->curval_mem = set->curval_mem;
+xc2->fseek_failed = 0;
 
+xc->vchg_mem[0] = '!';
+xc->vchg_siz = 1;
+xc->vchg_grow = 0;
 
-void fstWriterSetParallelMode(void *ctx, int enable)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
-        {
-        xc->parallel_was_enabled |= xc->parallel_enabled; /* make sticky */
-        xc->parallel_enabled = (enable != 0);
-#ifndef FST_WRITER_PARALLEL
-        if(xc->parallel_enabled)
-                {
-                fprintf(stderr, FST_APIMESS "fstWriterSetParallelMode(), FST_WRITER_PARALLEL not enabled during compile, exiting.\n");
-                exit(255);
-                }
-#endif
-        }
-}
+xc->tchn_cnt = xc->tchn_idx = 0;
+fstWriterFseeko(xc, xc->tchn_handle, 0, SEEK_SET);
+fstFtruncate(fileno(xc->tchn_handle), 0);
 
+xc->section_header_only = 0;
+xc->secnum++;
 
-void fstWriterSetDumpSizeLimit(void *ctx, uint64_t numbytes)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
-        {
-        xc->dump_size_limit = numbytes;
-        }
+pthread_mutex_lock(&pipe->mutex);
+set->seq = pipe->next_seq++;
+set->next = NULL;
+if(pipe->queue_tail) pipe->queue_tail->next = set; else pipe->queue_head = set;
+pipe->queue_tail = set;
+pthread_cond_signal(&pipe->work_cond);
+pthread_mutex_unlock(&pipe->mutex);
 }
 
 
-int fstWriterGetDumpSizeLimitReached(void *ctx)
+static void fstWriterFlushContextPrivate(void *ctx)
 {
 struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc)
+int dict_pending = 0;
+
+#ifdef HAVE_LIBZSTD
+dict_pending = xc->zstdpack && xc->zstd_dict_wanted && !xc->zstd_dict_tried; /* training flushes see the chains in order */
+#endif
+
+if(xc->parallel_enabled && !dict_pending && (xc->pipe || (xc->pipe = fstWriterFlushPipeCreate(xc))))
         {
-        return(xc->size_limit_locked != 0);
+        fstWriterFlushPipeSubmit(xc);
         }
+        else
+        {
+        fstWriterFlushPipeDrain(xc);
 
-return(0);
+        xc->xc_parent = xc;
+        fstWriterFlushContextPrivate2(xc);
+        }
 }
+#endif
 
 
-int fstWriterGetFseekFailed(void *ctx)
+/*
+ * queues up a flush context operation
+ */
+void fstWriterFlushContext(void *ctx)
 {
 struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 if(xc)
         {
-        return(xc->fseek_failed != 0);
+        if(xc->tchn_idx > 1)
+                {
+                xc->flush_context_pending = 1;
+                }
         }
-
-return(0);
 }
 
 
 /*
- * writer attr/scope/var creation:
- * fstWriterCreateVar2() is used to dump VHDL or other languages, but the
- * underlying variable needs to map to Verilog/SV via the proper fstVarType vt
+ * close out FST file
  */
-fstHandle fstWriterCreateVar2(void *ctx, enum fstVarType vt, enum fstVarDir vd,
-        uint32_t len, const char *nam, fstHandle aliasHandle,
-        const char *type, enum fstSupplementalVarType svt, enum fstSupplementalDataType sdt)
-{
-fstWriterSetAttrGeneric(ctx, type ? type : "", FST_MT_SUPVAR, (svt<<FST_SDT_SVT_SHIFT_COUNT) | (sdt & FST_SDT_ABS_MAX));
-return(fstWriterCreateVar(ctx, vt, vd, len, nam, aliasHandle));
-}
-
-
-fstHandle fstWriterCreateVar(void *ctx, enum fstVarType vt, enum fstVarDir vd,
-        uint32_t len, const char *nam, fstHandle aliasHandle)
+void fstWriterClose(void *ctx)
 {
 struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-unsigned int i;
-int nlen, is_real;
 
-if(xc && nam)
+#ifdef FST_WRITER_PARALLEL
+if(xc)
         {
-        if(xc->valpos_mem)
-                {
-                fstDestroyMmaps(xc, 0);
-                }
+        fstWriterFlushPipeDrain(xc);
+        }
+#endif
 
-        fputc(vt, xc->hier_handle);
-        fputc(vd, xc->hier_handle);
-        nlen = strlen(nam);
-        fstFwrite(nam, nlen, 1, xc->hier_handle);
-        fputc(0, xc->hier_handle);
-        xc->hier_file_len += (nlen+3);
+if(xc && !xc->already_in_close && !xc->already_in_flush)
+        {
+        unsigned char *tmem = NULL;
+        fst_off_t fixup_offs, tlen, hlen;
 
-        if((vt == FST_VT_VCD_REAL) || (vt == FST_VT_VCD_REAL_PARAMETER) || (vt == FST_VT_VCD_REALTIME) || (vt == FST_VT_SV_SHORTREAL))
+        xc->already_in_close = 1; /* never need to zero this out as it is freed at bottom */
+
+        if(xc->section_header_only && xc->section_header_truncpos && (xc->vchg_siz <= 1) && (!xc->is_initial_time))
                 {
-                is_real = 1;
-                len = 8; /* recast number of bytes to that of what a double is */
+                fstFtruncate(fileno(xc->handle), xc->section_header_truncpos);
+                fstWriterFseeko(xc, xc->handle, xc->section_header_truncpos, SEEK_SET);
+                xc->section_header_only = 0;
                 }
                 else
                 {
-                is_real = 0;
-                if(vt == FST_VT_GEN_STRING)
-                        {
-                        len = 0;
-                        }
-                }
-
-        xc->hier_file_len += fstWriterVarint(xc->hier_handle, len);
-
-        if(aliasHandle > xc->maxhandle) aliasHandle = 0;
-        xc->hier_file_len += fstWriterVarint(xc->hier_handle, aliasHandle);
-        xc->numsigs++;
-        if(xc->numsigs == xc->next_huge_break)
-                {
-                if(xc->fst_break_size < xc->fst_huge_break_size)
+                xc->skip_writing_section_hdr = 1;
+                if(!xc->size_limit_locked)
                         {
-                        xc->next_huge_break += FST_ACTIVATE_HUGE_INC;
-                        xc->fst_break_size += xc->fst_orig_break_size;
-                        xc->fst_break_add_size += xc->fst_orig_break_add_size;
-
-                        xc->vchg_alloc_siz = xc->fst_break_size + xc->fst_break_add_size;
-                        if(xc->vchg_mem)
+                        if(FST_UNLIKELY(xc->is_initial_time)) /* simulation time never advanced so mock up the changes as time zero ones */
                                 {
-                                xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+                                fstHandle dupe_idx;
+
+                                fstWriterEmitTimeChange(xc, 0); /* emit some time change just to have one */
+                                for(dupe_idx = 0; dupe_idx < xc->maxhandle; dupe_idx++) /* now clone the values */
+                                        {
+                                        fstWriterEmitValueChange(xc, dupe_idx+1, xc->curval_mem + xc->valpos_mem[4*dupe_idx]);
+                                        }
                                 }
+                        fstWriterFlushContextPrivate(xc);
                         }
                 }
+#ifdef FST_WRITER_PARALLEL
+        fstWriterFlushPipeDestroy(xc);
+#endif
+        fstDestroyMmaps(xc, 1);
+	if(xc->outval_mem)
+		{
+		free(xc->outval_mem); xc->outval_mem = NULL;
+		xc->outval_alloc_siz = 0;
+		}
 
-        if(!aliasHandle)
-                {
-                uint32_t zero = 0;
-
-                if(len)
-                        {
-                        fstWriterVarint(xc->geom_handle, !is_real ? len : 0); /* geom section encodes reals as zero byte */
-                        }
-                        else
-                        {
-                        fstWriterVarint(xc->geom_handle, 0xFFFFFFFF);         /* geom section encodes zero len as 32b -1 */
-                        }
+        /* write out geom section */
+        fflush(xc->geom_handle);
+        tlen = ftello(xc->geom_handle);
+	errno = 0;
+	if(tlen)
+		{
+	        fstWriterMmapSanity(tmem = (unsigned char *)fstMmap(NULL, tlen, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->geom_handle), 0), __FILE__, __LINE__, "tmem");
+		}
 
-                fstFwrite(&xc->maxvalpos, sizeof(uint32_t), 1, xc->valpos_handle);
-                fstFwrite(&len, sizeof(uint32_t), 1, xc->valpos_handle);
-                fstFwrite(&zero, sizeof(uint32_t), 1, xc->valpos_handle);
-                fstFwrite(&zero, sizeof(uint32_t), 1, xc->valpos_handle);
+        if(tmem)
+                {
+                unsigned long destlen = tlen;
+                unsigned char *dmem = (unsigned char *)malloc(compressBound(destlen));
+                int rc = compress2(dmem, &destlen, tmem, tlen, 9);
 
-                if(!is_real)
-                        {
-                        for(i=0;i<len;i++)
-                                {
-                                fputc('x', xc->curval_handle);
-                                }
-                        }
-                        else
+                if((rc != Z_OK) || (((fst_off_t)destlen) > tlen))
                         {
-                        fstFwrite(&xc->nan, 8, 1, xc->curval_handle); /* initialize doubles to NaN rather than x */
+                        destlen = tlen;
                         }
 
-                xc->maxvalpos+=len;
-                xc->maxhandle++;
-                return(xc->maxhandle);
-                }
-                else
-                {
-                return(aliasHandle);
-                }
-        }
-
-return(0);
-}
-
+                fixup_offs = ftello(xc->handle);
+                fputc(FST_BL_SKIP, xc->handle);                 /* temporary tag */
+                fstWriterUint64(xc->handle, destlen + 24);      /* section length */
+                fstWriterUint64(xc->handle, tlen);              /* uncompressed */
+                                                                /* compressed len is section length - 24 */
+                fstWriterUint64(xc->handle, xc->maxhandle);     /* maxhandle */
+                fstFwrite((((fst_off_t)destlen) != tlen) ? dmem : tmem, destlen, 1, xc->handle);
+                fflush(xc->handle);
 
-void fstWriterSetScope(void *ctx, enum fstScopeType scopetype,
-                const char *scopename, const char *scopecomp)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+                fstWriterFseeko(xc, xc->handle, fixup_offs, SEEK_SET);
+                fputc(FST_BL_GEOM, xc->handle);                 /* actual tag */
 
-if(xc)
-        {
-        fputc(FST_ST_VCD_SCOPE, xc->hier_handle);
-        if(/*(scopetype < FST_ST_VCD_MODULE) ||*/ (scopetype > FST_ST_MAX)) { scopetype = FST_ST_VCD_MODULE; }
-        fputc(scopetype, xc->hier_handle);
-        fprintf(xc->hier_handle, "%s%c%s%c",
-                scopename ? scopename : "", 0,
-                scopecomp ? scopecomp : "", 0);
+                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);           /* move file pointer to end for any section adds */
+                fflush(xc->handle);
 
-        if(scopename)
-                {
-                xc->hier_file_len += strlen(scopename);
-                }
-        if(scopecomp)
-                {
-                xc->hier_file_len += strlen(scopecomp);
+                free(dmem);
+                fstMunmap(tmem, tlen);
                 }
 
-        xc->hier_file_len += 4; /* FST_ST_VCD_SCOPE + scopetype + two string terminating zeros */
-        xc->numscopes++;
-        }
-}
-
-
-void fstWriterSetUpscope(void *ctx)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-
-if(xc)
-        {
-        fputc(FST_ST_VCD_UPSCOPE, xc->hier_handle);
-        xc->hier_file_len++;
-        }
-}
+        if(xc->num_blackouts)
+                {
+                uint64_t cur_bl = 0;
+                fst_off_t bpos, eos;
+                uint32_t i;
 
+                fixup_offs = ftello(xc->handle);
+                fputc(FST_BL_SKIP, xc->handle);                 /* temporary tag */
+                bpos = fixup_offs + 1;
+                fstWriterUint64(xc->handle, 0);                 /* section length */
+                fstWriterVarint(xc->handle, xc->num_blackouts);
 
-void fstWriterSetAttrBegin(void *ctx, enum fstAttrType attrtype, int subtype,
-                const char *attrname, uint64_t arg)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+                for(i=0;i<xc->num_blackouts;i++)
+                        {
+                        fputc(xc->blackout_head->active, xc->handle);
+                        fstWriterVarint(xc->handle, xc->blackout_head->tim - cur_bl);
+                        cur_bl = xc->blackout_head->tim;
+                        xc->blackout_curr = xc->blackout_head->next;
+                        free(xc->blackout_head);
+                        xc->blackout_head = xc->blackout_curr;
+                        }
 
-if(xc)
-        {
-        fputc(FST_ST_GEN_ATTRBEGIN, xc->hier_handle);
-        if(/*(attrtype < FST_AT_MISC) ||*/ (attrtype > FST_AT_MAX)) { attrtype = FST_AT_MISC; subtype = FST_MT_UNKNOWN; }
-        fputc(attrtype, xc->hier_handle);
+                eos = ftello(xc->handle);
+                fstWriterFseeko(xc, xc->handle, bpos, SEEK_SET);
+                fstWriterUint64(xc->handle, eos - bpos);
+                fflush(xc->handle);
 
-        switch(attrtype)
-                {
-                case FST_AT_ARRAY:      if((subtype < FST_AR_NONE) || (subtype > FST_AR_MAX)) subtype = FST_AR_NONE; break;
-                case FST_AT_ENUM:       if((subtype < FST_EV_SV_INTEGER) || (subtype > FST_EV_MAX)) subtype = FST_EV_SV_INTEGER; break;
-                case FST_AT_PACK:       if((subtype < FST_PT_NONE) || (subtype > FST_PT_MAX)) subtype = FST_PT_NONE; break;
+                fstWriterFseeko(xc, xc->handle, fixup_offs, SEEK_SET);
+                fputc(FST_BL_BLACKOUT, xc->handle);     /* actual tag */
 
-                case FST_AT_MISC:
-                default:                break;
+                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);   /* move file pointer to end for any section adds */
+                fflush(xc->handle);
                 }
 
-        fputc(subtype, xc->hier_handle);
-        fprintf(xc->hier_handle, "%s%c",
-                attrname ? attrname : "", 0);
-
-        if(attrname)
+        if(xc->compress_hier)
                 {
-                xc->hier_file_len += strlen(attrname);
-                }
+                fst_off_t hl, eos;
+                gzFile zhandle;
+                int zfd;
+                int fourpack_duo = 0;
+#ifndef __MINGW32__
+		int fnam_len = strlen(xc->filename) + 5 + 1;
+                char *fnam = (char *)malloc(fnam_len);
+#endif
 
-        xc->hier_file_len += 4; /* FST_ST_GEN_ATTRBEGIN + type + subtype + string terminating zero */
-        xc->hier_file_len += fstWriterVarint(xc->hier_handle, arg);
-        }
-}
+                fixup_offs = ftello(xc->handle);
+                fputc(FST_BL_SKIP, xc->handle);                 /* temporary tag */
+                hlen = ftello(xc->handle);
+                fstWriterUint64(xc->handle, 0);                 /* section length */
+                fstWriterUint64(xc->handle, xc->hier_file_len); /* uncompressed length */
 
+#ifdef HAVE_LIBZSTD
+                if(xc->zstdpack)
+                        {
+                        size_t zstd_maxlen = ZSTD_compressBound(xc->hier_file_len);
+                        unsigned char *mem = (unsigned char *)malloc(zstd_maxlen);
+                        unsigned char *hmem = NULL;
+                        size_t packed_len;
 
-void fstWriterSetAttrEnd(void *ctx)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+                        fflush(xc->handle);
 
-if(xc)
-        {
-        fputc(FST_ST_GEN_ATTREND, xc->hier_handle);
-        xc->hier_file_len++;
-        }
-}
+                        errno = 0;
+                        if(xc->hier_file_len)
+                                {
+                                fstWriterMmapSanity(hmem = (unsigned char *)fstMmap(NULL, xc->hier_file_len, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->hier_handle), 0), __FILE__, __LINE__, "hmem");
+                                }
+                        packed_len = ZSTD_compress(mem, zstd_maxlen, hmem, xc->hier_file_len, FST_ZSTD_LEVEL);
+                        fstMunmap(hmem, xc->hier_file_len);
 
+                        if(!ZSTD_isError(packed_len))
+                                {
+                                fstFwrite(mem, packed_len, 1, xc->handle);
+                                }
 
-fstEnumHandle fstWriterCreateEnumTable(void *ctx, const char *name, uint32_t elem_count, unsigned int min_valbits, const char **literal_arr, const char **val_arr)
-{
-fstEnumHandle handle = 0;
-unsigned int *literal_lens = NULL;
-unsigned int *val_lens = NULL;
-int lit_len_tot = 0;
-int val_len_tot = 0;
-int name_len;
-char elem_count_buf[16];
-int elem_count_len;
-int total_len;
-int pos = 0;
-char *attr_str = NULL;
-
-if(ctx && name && literal_arr && val_arr && (elem_count != 0))
-	{
-	struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-
-	uint32_t i;
-
-	name_len = strlen(name);
-	elem_count_len = snprintf(elem_count_buf, 16, "%" PRIu32, elem_count);
-
-	literal_lens = (unsigned int *)calloc(elem_count, sizeof(unsigned int));
-	val_lens = (unsigned int *)calloc(elem_count, sizeof(unsigned int));
-
-	for(i=0;i<elem_count;i++)
-		{
-		literal_lens[i] = strlen(literal_arr[i]);
-		lit_len_tot += fstUtilityBinToEscConvertedLen((unsigned char*)literal_arr[i], literal_lens[i]);
+                        free(mem);
+                        }
+                        else
+#endif
+                if(!xc->fourpack)
+                        {
+                        unsigned char *mem = (unsigned char *)malloc(FST_GZIO_LEN);
+                        zfd = dup(fileno(xc->handle));
+                        fflush(xc->handle);
+                        zhandle = gzdopen(zfd, "wb4");
+                        if(zhandle)
+                                {
+                                fstWriterFseeko(xc, xc->hier_handle, 0, SEEK_SET);
+                                for(hl = 0; hl < xc->hier_file_len; hl += FST_GZIO_LEN)
+                                        {
+                                        unsigned len = ((xc->hier_file_len - hl) > FST_GZIO_LEN) ? FST_GZIO_LEN : (xc->hier_file_len - hl);
+                                        fstFread(mem, len, 1, xc->hier_handle);
+                                        gzwrite(zhandle, mem, len);
+                                        }
+                                gzclose(zhandle);
+                                }
+                                else
+                                {
+                                close(zfd);
+                                }
+                        free(mem);
+                        }
+                        else
+                        {
+                        int lz4_maxlen;
+                        unsigned char *mem;
+                        unsigned char *hmem = NULL;
+                        int packed_len;
 
-		val_lens[i] =  strlen(val_arr[i]);
-		val_len_tot += fstUtilityBinToEscConvertedLen((unsigned char*)val_arr[i], val_lens[i]);
+                        fflush(xc->handle);
 
-		if(min_valbits > 0)
-			{
-			if(val_lens[i] < min_valbits)
+                        lz4_maxlen = LZ4_compressBound(xc->hier_file_len);
+                        mem = (unsigned char *)malloc(lz4_maxlen);
+			errno = 0;
+			if(xc->hier_file_len)
 				{
-				val_len_tot += (min_valbits - val_lens[i]); /* additional converted len is same for '0' character */
+	                        fstWriterMmapSanity(hmem = (unsigned char *)fstMmap(NULL, xc->hier_file_len, PROT_READ|PROT_WRITE, MAP_SHARED, fileno(xc->hier_handle), 0), __FILE__, __LINE__, "hmem");
 				}
-			}
-		}
+                        packed_len = LZ4_compress_default((char *)hmem, (char *)mem, xc->hier_file_len, lz4_maxlen);
+                        fstMunmap(hmem, xc->hier_file_len);
 
-	total_len = name_len + 1 + elem_count_len + 1 + lit_len_tot + elem_count + val_len_tot + elem_count;
+                        fourpack_duo = (!xc->repack_on_close) && (xc->hier_file_len > FST_HDR_FOURPACK_DUO_SIZE); /* double pack when hierarchy is large */
 
-	attr_str = (char*)malloc(total_len);
-	pos = 0;
+                        if(fourpack_duo)        /* double packing with LZ4 is faster than gzip */
+                                {
+                                unsigned char *mem_duo;
+                                int lz4_maxlen_duo;
+                                int packed_len_duo;
 
-	memcpy(attr_str+pos, name, name_len);
-	pos += name_len;
-	attr_str[pos++] = ' ';
+                                lz4_maxlen_duo = LZ4_compressBound(packed_len);
+                                mem_duo = (unsigned char *)malloc(lz4_maxlen_duo);
+                                packed_len_duo = LZ4_compress_default((char *)mem, (char *)mem_duo, packed_len, lz4_maxlen_duo);
 
-	memcpy(attr_str+pos, elem_count_buf, elem_count_len);
-	pos += elem_count_len;
-	attr_str[pos++] = ' ';
+                                fstWriterVarint(xc->handle, packed_len); /* 1st round compressed length */
+                                fstFwrite(mem_duo, packed_len_duo, 1, xc->handle);
+                                free(mem_duo);
+                                }
+                                else
+                                {
+                                fstFwrite(mem, packed_len, 1, xc->handle);
+                                }
 
-	for(i=0;i<elem_count;i++)
-		{
-		pos += fstUtilityBinToEsc((unsigned char*)attr_str+pos, (unsigned char*)literal_arr[i], literal_lens[i]);
-		attr_str[pos++] = ' ';
-		}
+                        free(mem);
+                        }
 
-	for(i=0;i<elem_count;i++)
-		{
-		if(min_valbits > 0)
-			{
-			if(val_lens[i] < min_valbits)
-				{
-				memset(attr_str+pos, '0', min_valbits - val_lens[i]);
-				pos += (min_valbits - val_lens[i]);
-				}
-			}
+                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);
+                eos = ftello(xc->handle);
+                fstWriterFseeko(xc, xc->handle, hlen, SEEK_SET);
+                fstWriterUint64(xc->handle, eos - hlen);
+                fflush(xc->handle);
 
-		pos += fstUtilityBinToEsc((unsigned char*)attr_str+pos, (unsigned char*)val_arr[i], val_lens[i]);
-		attr_str[pos++] = ' ';
-		}
+                fstWriterFseeko(xc, xc->handle, fixup_offs, SEEK_SET);
+                fputc(xc->zstdpack ? FST_BL_HIER_ZSTD : (xc->fourpack ?
+                        ( fourpack_duo ? FST_BL_HIER_LZ4DUO : FST_BL_HIER_LZ4) :
+                        FST_BL_HIER), xc->handle); /* actual tag now also == compression type */
 
-	attr_str[pos-1] = 0;
+                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);   /* move file pointer to end for any section adds */
+                fflush(xc->handle);
 
-#ifdef FST_DEBUG
-	fprintf(stderr, FST_APIMESS "fstWriterCreateEnumTable() total_len: %d, pos: %d\n", total_len, pos);
-	fprintf(stderr, FST_APIMESS "*%s*\n", attr_str);
+#ifndef __MINGW32__
+                snprintf(fnam, fnam_len, "%s.hier", xc->filename);
+                unlink(fnam);
+                free(fnam);
 #endif
+                }
 
-	fstWriterSetAttrBegin(xc, FST_AT_MISC, FST_MT_ENUMTABLE, attr_str, handle = ++xc->max_enumhandle);
+        /* finalize out header */
+        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_START_TIME, SEEK_SET);
+        fstWriterUint64(xc->handle, xc->firsttime);
+        fstWriterUint64(xc->handle, xc->curtime);
+        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_NUM_SCOPES, SEEK_SET);
+        fstWriterUint64(xc->handle, xc->numscopes);
+        fstWriterUint64(xc->handle, xc->numsigs);
+        fstWriterUint64(xc->handle, xc->maxhandle);
+        fstWriterUint64(xc->handle, xc->secnum);
+        fflush(xc->handle);
 
-	free(attr_str);
-	free(val_lens);
-	free(literal_lens);
-	}
+        tmpfile_close(&xc->tchn_handle, &xc->tchn_handle_nam);
+        free(xc->vchg_mem); xc->vchg_mem = NULL;
+        free(xc->vseg_mem); xc->vseg_mem = NULL;
+        tmpfile_close(&xc->curval_handle, &xc->curval_handle_nam);
+        tmpfile_close(&xc->valpos_handle, &xc->valpos_handle_nam);
+        tmpfile_close(&xc->geom_handle, &xc->geom_handle_nam);
+        if(xc->hier_handle) { fclose(xc->hier_handle); xc->hier_handle = NULL; }
+        if(xc->handle)
+                {
+                if(xc->repack_on_close)
+                        {
+                        FILE *fp;
+                        fst_off_t offpnt, uclen;
+                        int flen = strlen(xc->filename);
+                        char *hf = (char *)calloc(1, flen + 5);
 
-return(handle);
-}
+                        strcpy(hf, xc->filename);
+                        strcpy(hf+flen, ".pak");
+                        fp = fopen(hf, "wb");
 
+                        if(fp)
+                                {
+                                gzFile dsth;
+                                int zfd;
+                                char gz_membuf[FST_GZIO_LEN];
 
-void fstWriterEmitEnumTableRef(void *ctx, fstEnumHandle handle)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-if(xc && handle)
-	{
-	fstWriterSetAttrBegin(xc, FST_AT_MISC, FST_MT_ENUMTABLE, NULL, handle);
-        }
-}
+                                fstWriterFseeko(xc, xc->handle, 0, SEEK_END);
+                                uclen = ftello(xc->handle);
 
+                                fputc(FST_BL_ZWRAPPER, fp);
+                                fstWriterUint64(fp, 0);
+                                fstWriterUint64(fp, uclen);
+                                fflush(fp);
 
-/*
- * value and time change emission
- */
-void fstWriterEmitValueChange(void *ctx, fstHandle handle, const void *val)
-{
-struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-const unsigned char *buf = (const unsigned char *)val;
-uint32_t offs;
-int len;
+                                fstWriterFseeko(xc, xc->handle, 0, SEEK_SET);
+                                zfd = dup(fileno(fp));
+                                dsth = gzdopen(zfd, "wb4");
+                                if(dsth)
+                                        {
+                                        for(offpnt = 0; offpnt < uclen; offpnt += FST_GZIO_LEN)
+                                                {
+                                                size_t this_len = ((uclen - offpnt) > FST_GZIO_LEN) ? FST_GZIO_LEN : (uclen - offpnt);
+                                                fstFread(gz_membuf, this_len, 1, xc->handle);
+                                                gzwrite(dsth, gz_membuf, this_len);
+                                                }
+                                        gzclose(dsth);
+                                        }
+                                        else
+                                        {
+                                        close(zfd);
+                                        }
+                                fstWriterFseeko(xc, fp, 0, SEEK_END);
+                                offpnt = ftello(fp);
+                                fstWriterFseeko(xc, fp, 1, SEEK_SET);
+                                fstWriterUint64(fp, offpnt - 1);
+                                fclose(fp);
+                                fclose(xc->handle); xc->handle = NULL;
 
-if(FST_LIKELY((xc) && (handle <= xc->maxhandle)))
-        {
-        uint32_t fpos;
-        uint32_t *vm4ip;
+                                unlink(xc->filename);
+                                rename(hf, xc->filename);
+                                }
+                                else
+                                {
+                                xc->repack_on_close = 0;
+                                fclose(xc->handle); xc->handle = NULL;
+                                }
 
-        if(FST_UNLIKELY(!xc->valpos_mem))
-                {
-                xc->vc_emitted = 1;
-                fstWriterCreateMmaps(xc);
+                        free(hf);
+                        }
+                        else
+                        {
+                        fclose(xc->handle); xc->handle = NULL;
+                        }
                 }
 
-        handle--; /* move starting at 1 index to starting at 0 */
-        vm4ip = &(xc->valpos_mem[4*handle]);
+#ifdef __MINGW32__
+        {
+        int flen = strlen(xc->filename);
+        char *hf = (char *)calloc(1, flen + 6);
+        strcpy(hf, xc->filename);
 
-        len  = vm4ip[1];
-        if(FST_LIKELY(len)) /* len of zero = variable length, use fstWriterEmitVariableLengthValueChange */
+        if(xc->compress_hier)
                 {
-                if(FST_LIKELY(!xc->is_initial_time))
-                        {
-                        fpos = xc->vchg_siz;
-
-                        if(FST_UNLIKELY((fpos + len + 10) > xc->vchg_alloc_siz))
-                                {
-                                xc->vchg_alloc_siz += (xc->fst_break_add_size + len); /* +len added in the case of extremely long vectors and small break add sizes */
-                                xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
-                                if(FST_UNLIKELY(!xc->vchg_mem))
-                                        {
-                                        fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitValueChange, exiting.\n");
-                                        exit(255);
-                                        }
-                                }
-#ifdef FST_REMOVE_DUPLICATE_VC
-                        offs = vm4ip[0];
-
-                        if(len != 1)
-                                {
-                                if((vm4ip[3]==xc->tchn_idx)&&(vm4ip[2]))
-                                        {
-                                        unsigned char *old_value = xc->vchg_mem + vm4ip[2] + 4; /* the +4 skips old vm4ip[2] value */
-                                        while(*(old_value++) & 0x80) { /* skips over varint encoded "xc->tchn_idx - vm4ip[3]" */ }
-                                        memcpy(old_value, buf, len); /* overlay new value */
-
-                                        memcpy(xc->curval_mem + offs, buf, len);
-                                        return;
-                                        }
-                                else
-                                        {
-                                        if(!memcmp(xc->curval_mem + offs, buf, len))
-                                                {
-                                                if(!xc->curtime)
-                                                        {
-                                                        int i;
-                                                        for(i=0;i<len;i++)
-                                                                {
-                                                                if(buf[i]!='x') break;
-                                                                }
-
-                                                        if(i<len) return;
-                                                        }
-                                                        else
-                                                        {
-                                                        return;
-                                                        }
-                                                }
-                                        }
-
-                                memcpy(xc->curval_mem + offs, buf, len);
-                                }
-                                else
-                                {
-                                if((vm4ip[3]==xc->tchn_idx)&&(vm4ip[2]))
-                                        {
-                                        unsigned char *old_value = xc->vchg_mem + vm4ip[2] + 4; /* the +4 skips old vm4ip[2] value */
-                                        while(*(old_value++) & 0x80) { /* skips over varint encoded "xc->tchn_idx - vm4ip[3]" */ }
-                                        *old_value = *buf; /* overlay new value */
+                strcpy(hf + flen, ".hier");
+                unlink(hf); /* no longer needed as a section now exists for this */
+                }
 
-                                        *(xc->curval_mem + offs) = *buf;
-                                        return;
-                                        }
-                                else
-                                        {
-                                        if((*(xc->curval_mem + offs)) == (*buf))
-                                                {
-                                                if(!xc->curtime)
-                                                        {
-                                                        if(*buf != 'x') return;
-                                                        }
-                                                        else
-                                                        {
-                                                        return;
-                                                        }
-                                                }
-                                        }
+        free(hf);
+        }
+#endif
 
-                                *(xc->curval_mem + offs) = *buf;
-                                }
+        if(xc->path_array)
+                {
+#ifndef _WAVE_HAVE_JUDY
+                const uint32_t hashmask = FST_PATH_HASHMASK;
 #endif
-                        xc->vchg_siz += fstWriterUint32WithVarint32(xc, &vm4ip[2], xc->tchn_idx - vm4ip[3], buf, len); /* do one fwrite op only */
-                        vm4ip[3] = xc->tchn_idx;
-                        vm4ip[2] = fpos;
-                        }
-                        else
-                        {
-                        offs = vm4ip[0];
-                        memcpy(xc->curval_mem + offs, buf, len);
-                        }
+                JudyHSFreeArray(&(xc->path_array), NULL);
                 }
+
+#ifdef HAVE_LIBZSTD
+        ZSTD_freeCDict(xc->zstd_cdict); xc->zstd_cdict = NULL;
+#endif
+        free(xc->filename); xc->filename = NULL;
+        free(xc);
         }
 }
 
-void fstWriterEmitValueChange32(void *ctx, fstHandle handle,
-                                uint32_t bits, uint32_t val) {
-        char buf[32];
-        char *s = buf;
-        uint32_t i;
-        for (i = 0; i < bits; ++i)
+
+/*
+ * functions to set miscellaneous header/block information
+ */
+void fstWriterSetDate(void *ctx, const char *dat)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-                *s++ = '0' + ((val >> (bits - i - 1)) & 1);
+        char s[FST_HDR_DATE_SIZE];
+        fst_off_t fpos = ftello(xc->handle);
+        int len = strlen(dat);
+
+        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_DATE, SEEK_SET);
+        memset(s, 0, FST_HDR_DATE_SIZE);
+        memcpy(s, dat, (len < FST_HDR_DATE_SIZE) ? len : FST_HDR_DATE_SIZE);
+        fstFwrite(s, FST_HDR_DATE_SIZE, 1, xc->handle);
+        fflush(xc->handle);
+        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
         }
-        fstWriterEmitValueChange(ctx, handle, buf);
 }
-void fstWriterEmitValueChange64(void *ctx, fstHandle handle,
-                                uint32_t bits, uint64_t val) {
-        char buf[64];
-        char *s = buf;
-        uint32_t i;
-        for (i = 0; i < bits; ++i)
+
+
+void fstWriterSetVersion(void *ctx, const char *vers)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc && vers)
         {
-                *s++ = '0' + ((val >> (bits - i - 1)) & 1);
+        char s[FST_HDR_SIM_VERSION_SIZE];
+        fst_off_t fpos = ftello(xc->handle);
+        int len = strlen(vers);
+
+        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_SIM_VERSION, SEEK_SET);
+        memset(s, 0, FST_HDR_SIM_VERSION_SIZE);
+        memcpy(s, vers, (len < FST_HDR_SIM_VERSION_SIZE) ? len : FST_HDR_SIM_VERSION_SIZE);
+        fstFwrite(s, FST_HDR_SIM_VERSION_SIZE, 1, xc->handle);
+        fflush(xc->handle);
+        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
         }
-        fstWriterEmitValueChange(ctx, handle, buf);
 }
-void fstWriterEmitValueChangeVec32(void *ctx, fstHandle handle,
-                                   uint32_t bits, const uint32_t *val) {
-        struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-        if (FST_UNLIKELY(bits <= 32))
-        {
-                fstWriterEmitValueChange32(ctx, handle, bits, val[0]);
-        }
-        else if(FST_LIKELY(xc))
+
+
+void fstWriterSetFileType(void *ctx, enum fstFileType filetype)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-                int bq = bits / 32;
-                int br = bits & 31;
-                int i;
-                int w;
-                uint32_t v;
-                unsigned char* s;
-                if (FST_UNLIKELY(bits > xc->outval_alloc_siz))
-                {
-                        xc->outval_alloc_siz = bits*2 + 1;
-                        xc->outval_mem = (unsigned char*)realloc(xc->outval_mem, xc->outval_alloc_siz);
-                        if (FST_UNLIKELY(!xc->outval_mem))
-                        {
-                                fprintf(stderr,
-                                        FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeVec32, exiting.\n");
-                                exit(255);
-                        }
-                }
-                s = xc->outval_mem;
-                {
-                        w = bq;
-                        v = val[w];
-                        for (i = 0; i < br; ++i)
-                        {
-                                *s++ = '0' + ((v >> (br - i - 1)) & 1);
-                        }
-                }
-                for (w = bq - 1; w >= 0; --w)
+        if(/*(filetype >= FST_FT_MIN) &&*/ (filetype <= FST_FT_MAX))
                 {
-                        v = val[w];
-                        for (i = (32 - 4); i >= 0; i -= 4) {
-                                s[0] = '0' + ((v >> (i + 3)) & 1);
-                                s[1] = '0' + ((v >> (i + 2)) & 1);
-                                s[2] = '0' + ((v >> (i + 1)) & 1);
-                                s[3] = '0' + ((v >> (i + 0)) & 1);
-                                s += 4;
-                        }
+                fst_off_t fpos = ftello(xc->handle);
+
+                xc->filetype = filetype;
+
+                fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_FILETYPE, SEEK_SET);
+                fputc(xc->filetype, xc->handle);
+                fflush(xc->handle);
+                fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
                 }
-                fstWriterEmitValueChange(ctx, handle, xc->outval_mem);
         }
 }
-void fstWriterEmitValueChangeVec64(void *ctx, fstHandle handle,
-                                   uint32_t bits, const uint64_t *val) {
-        struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-        if (FST_UNLIKELY(bits <= 64))
+
+
+static void fstWriterSetAttrDoubleArgGeneric(void *ctx, int typ, uint64_t arg1, uint64_t arg2)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-                fstWriterEmitValueChange64(ctx, handle, bits, val[0]);
+        unsigned char buf[11]; /* ceil(64/7) = 10 + null term */
+        unsigned char *pnt = fstCopyVarint64ToRight(buf, arg1);
+        if(arg1)
+                {
+                *pnt = 0; /* this converts any *nonzero* arg1 when made a varint into a null-term string */
+                }
+
+        fstWriterSetAttrBegin(xc, FST_AT_MISC, typ, (char *)buf, arg2);
         }
-        else if(FST_LIKELY(xc))
+}
+
+
+static void fstWriterSetAttrGeneric(void *ctx, const char *comm, int typ, uint64_t arg)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc && comm)
         {
-                int bq = bits / 64;
-                int br = bits & 63;
-                int i;
-                int w;
-                uint32_t v;
-                unsigned char* s;
-                if (FST_UNLIKELY(bits > xc->outval_alloc_siz))
+        char *s = strdup(comm);
+        char *sf = s;
+
+        while(*s)
                 {
-                        xc->outval_alloc_siz = bits*2 + 1;
-                        xc->outval_mem = (unsigned char*)realloc(xc->outval_mem, xc->outval_alloc_siz);
-                        if (FST_UNLIKELY(!xc->outval_mem))
-                        {
-                                fprintf(stderr,
-                                        FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeVec64, exiting.\n");
-                                exit(255);
-                        }
+                if((*s == '\n') || (*s == '\r')) *s = ' ';
+                s++;
                 }
-                s = xc->outval_mem;
-                {
-                        w = bq;
-                        v = val[w];
-                        for (i = 0; i < br; ++i)
-                        {
-                                *s++ = '0' + ((v >> (br - i - 1)) & 1);
-                        }
-                }
-                for (w = bq - 1; w >= 0; --w) {
-                        v = val[w];
-                        for (i = (64 - 4); i >= 0; i -= 4)
-                        {
-                                s[0] = '0' + ((v >> (i + 3)) & 1);
-                                s[1] = '0' + ((v >> (i + 2)) & 1);
-                                s[2] = '0' + ((v >> (i + 1)) & 1);
-                                s[3] = '0' + ((v >> (i + 0)) & 1);
-                                s += 4;
-                        }
-                }
-                fstWriterEmitValueChange(ctx, handle, xc->outval_mem);
+
+        fstWriterSetAttrBegin(xc, FST_AT_MISC, typ, sf, arg);
+        free(sf);
         }
 }
 
 
-void fstWriterEmitVariableLengthValueChange(void *ctx, fstHandle handle, const void *val, uint32_t len)
+static void fstWriterSetSourceStem_2(void *ctx, const char *path, unsigned int line, unsigned int use_realpath, int typ)
 {
 struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-const unsigned char *buf = (const unsigned char *)val;
 
-if(FST_LIKELY((xc) && (handle <= xc->maxhandle)))
+if(xc && path && path[0])
         {
-        uint32_t fpos;
-        uint32_t *vm4ip;
+        uint64_t sidx = 0;
+        int slen = strlen(path);
+#ifndef _WAVE_HAVE_JUDY
+        const uint32_t hashmask = FST_PATH_HASHMASK;
+        const unsigned char *path2 = (const unsigned char *)path;
+	PPvoid_t pv;
+#else
+        char *path2 = (char *)alloca(slen + 1); /* judy lacks const qualifier in its JudyHSIns definition */
+	PPvoid_t pv;
+        strcpy(path2, path);
+#endif
 
-        if(FST_UNLIKELY(!xc->valpos_mem))
+        pv = JudyHSIns(&(xc->path_array), path2, slen, NULL);
+        if(*pv)
                 {
-                xc->vc_emitted = 1;
-                fstWriterCreateMmaps(xc);
+                sidx = (intptr_t)(*pv);
                 }
-
-        handle--; /* move starting at 1 index to starting at 0 */
-        vm4ip = &(xc->valpos_mem[4*handle]);
-
-        /* there is no initial time dump for variable length value changes */
-        if(FST_LIKELY(!vm4ip[1])) /* len of zero = variable length */
+                else
                 {
-                fpos = xc->vchg_siz;
+                char *rp = NULL;
 
-                if(FST_UNLIKELY((fpos + len + 10 + 5) > xc->vchg_alloc_siz))
+                sidx = ++xc->path_array_count;
+                *pv = (void *)(intptr_t)(xc->path_array_count);
+
+                if(use_realpath)
                         {
-                        xc->vchg_alloc_siz += (xc->fst_break_add_size + len + 5); /* +len added in the case of extremely long vectors and small break add sizes */
-                        xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
-                        if(FST_UNLIKELY(!xc->vchg_mem))
-                                {
-                                fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitVariableLengthValueChange, exiting.\n");
-                                exit(255);
-                                }
+                        rp = fstRealpath(
+#ifndef _WAVE_HAVE_JUDY
+                                (const char *)
+#endif
+                                path2, NULL);
                         }
 
-                xc->vchg_siz += fstWriterUint32WithVarint32AndLength(xc, &vm4ip[2], xc->tchn_idx - vm4ip[3], buf, len); /* do one fwrite op only */
-                vm4ip[3] = xc->tchn_idx;
-                vm4ip[2] = fpos;
+                fstWriterSetAttrGeneric(xc, rp ? rp :
+#ifndef _WAVE_HAVE_JUDY
+                        (const char *)
+#endif
+                        path2, FST_MT_PATHNAME, sidx);
+
+                if(rp)
+                        {
+                        free(rp);
+                        }
                 }
+
+        fstWriterSetAttrDoubleArgGeneric(xc, typ, sidx, line);
         }
 }
 
 
-void fstWriterEmitTimeChange(void *ctx, uint64_t tim)
+void fstWriterSetSourceStem(void *ctx, const char *path, unsigned int line, unsigned int use_realpath)
+{
+fstWriterSetSourceStem_2(ctx, path, line, use_realpath, FST_MT_SOURCESTEM);
+}
+
+
+void fstWriterSetSourceInstantiationStem(void *ctx, const char *path, unsigned int line, unsigned int use_realpath)
+{
+fstWriterSetSourceStem_2(ctx, path, line, use_realpath, FST_MT_SOURCEISTEM);
+}
+
+
+void fstWriterSetComment(void *ctx, const char *comm)
+{
+fstWriterSetAttrGeneric(ctx, comm, FST_MT_COMMENT, 0);
+}
+
+
+void fstWriterSetValueList(void *ctx, const char *vl)
+{
+fstWriterSetAttrGeneric(ctx, vl, FST_MT_VALUELIST, 0);
+}
+
+
+void fstWriterSetEnvVar(void *ctx, const char *envvar)
+{
+fstWriterSetAttrGeneric(ctx, envvar, FST_MT_ENVVAR, 0);
+}
+
+
+void fstWriterSetTimescale(void *ctx, int ts)
 {
 struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
-unsigned int i;
-int skip = 0;
 if(xc)
         {
-        if(FST_UNLIKELY(xc->is_initial_time))
-                {
-                if(xc->size_limit_locked)       /* this resets xc->is_initial_time to one */
-                        {
-                        return;
-                        }
+        fst_off_t fpos = ftello(xc->handle);
+        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_TIMESCALE, SEEK_SET);
+        fputc(ts & 255, xc->handle);
+        fflush(xc->handle);
+        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
+        }
+}
 
-                if(!xc->valpos_mem)
-                        {
-                        fstWriterCreateMmaps(xc);
-                        }
 
-                skip = 1;
+void fstWriterSetTimescaleFromString(void *ctx, const char *s)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc && s)
+        {
+        int mat = 0;
+        int seconds_exp = -9;
+        int tv = atoi(s);
+        const char *pnt = s;
 
-                xc->firsttime = (xc->vc_emitted) ? 0: tim;
-                xc->curtime = 0;
-                xc->vchg_mem[0] = '!';
-                xc->vchg_siz = 1;
-                fstWriterEmitSectionHeader(xc);
-                for(i=0;i<xc->maxhandle;i++)
-                        {
-                        xc->valpos_mem[4*i+2] = 0; /* zero out offset val */
-                        xc->valpos_mem[4*i+3] = 0; /* zero out last time change val */
-                        }
-                xc->is_initial_time = 0;
-                }
-                else
+        while(*pnt)
                 {
-                if((xc->vchg_siz >= xc->fst_break_size) || (xc->flush_context_pending))
+                switch(*pnt)
                         {
-                        xc->flush_context_pending = 0;
-                        fstWriterFlushContextPrivate(xc);
-                        xc->tchn_cnt++;
-                        fstWriterVarint(xc->tchn_handle, xc->curtime);
+                        case 'm': seconds_exp =  -3; mat = 1; break;
+                        case 'u': seconds_exp =  -6; mat = 1; break;
+                        case 'n': seconds_exp =  -9; mat = 1; break;
+                        case 'p': seconds_exp = -12; mat = 1; break;
+                        case 'f': seconds_exp = -15; mat = 1; break;
+                        case 'a': seconds_exp = -18; mat = 1; break;
+                        case 'z': seconds_exp = -21; mat = 1; break;
+                        case 's': seconds_exp =   0; mat = 1; break;
+                        default: break;
                         }
+
+                if(mat) break;
+                pnt++;
                 }
 
-        if(!skip)
+        if(tv == 10)
                 {
-                xc->tchn_idx++;
+                seconds_exp++;
                 }
-        fstWriterVarint(xc->tchn_handle, tim - xc->curtime);
-        xc->tchn_cnt++;
-        xc->curtime = tim;
+        else
+        if(tv == 100)
+                {
+                seconds_exp+=2;
+                }
+
+        fstWriterSetTimescale(ctx, seconds_exp);
         }
 }
 
 
-void fstWriterEmitDumpActive(void *ctx, int enable)
+void fstWriterSetTimezero(void *ctx, int64_t tim)
 {
 struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
+        {
+        fst_off_t fpos = ftello(xc->handle);
+        fstWriterFseeko(xc, xc->handle, FST_HDR_OFFS_TIMEZERO, SEEK_SET);
+        fstWriterUint64(xc->handle, (xc->timezero = tim));
+        fflush(xc->handle);
+        fstWriterFseeko(xc, xc->handle, fpos, SEEK_SET);
+        }
+}
 
+
+void fstWriterSetPackType(void *ctx, enum fstWriterPackType typ)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 if(xc)
         {
-        struct fstBlackoutChain *b = (struct fstBlackoutChain *)calloc(1, sizeof(struct fstBlackoutChain));
+        xc->fastpack     = (typ != FST_WR_PT_ZLIB);
+        xc->fourpack     = (typ == FST_WR_PT_LZ4);
+#ifdef HAVE_LIBZSTD
+        xc->zstdpack     = (typ == FST_WR_PT_ZSTD) || (typ == FST_WR_PT_ZSTD_DICT);
+        xc->zstd_dict_wanted = (typ == FST_WR_PT_ZSTD_DICT);
+#else
+        if((typ == FST_WR_PT_ZSTD) || (typ == FST_WR_PT_ZSTD_DICT)) xc->fastpack = 0; /* not compiled in, zlib instead */
+#endif
+        }
+}
 
-        b->tim = xc->curtime;
-        b->active = (enable != 0);
 
-        xc->num_blackouts++;
-        if(xc->blackout_curr)
-                {
-                xc->blackout_curr->next = b;
-                xc->blackout_curr = b;
-                }
-                else
+void fstWriterSetRepackOnClose(void *ctx, int enable)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
+        {
+        xc->repack_on_close = (enable != 0);
+        }
+}
+
+
+/*
+ * how value changes are buffered until a flush, see fstWriterSegmentRoom().
+ * segments pay off when signals change many times per block, as the flush
+ * then reads the changes of each in one go; chains take less memory when
+ * most change only a few times.  the trace is the same either way.  takes
+ * effect when set before the first time change, later calls are ignored.
+ */
+void fstWriterSetBufferLayout(void *ctx, enum fstWriterBufferLayout layout)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc && xc->is_initial_time && (!xc->size_limit_locked))
+        {
+        xc->buffer_layout = (layout == FST_WR_BL_SEGMENTED) ? FST_WR_BL_SEGMENTED : FST_WR_BL_CHAINED;
+        if(xc->valpos_mem)
                 {
-                xc->blackout_head = b;
-                xc->blackout_curr = b;
+                fstWriterCreateSegments(xc);
                 }
         }
 }
 
 
-/***********************/
-/***                 ***/
-/*** reader function ***/
-/***                 ***/
-/***********************/
+enum fstWriterBufferLayout fstWriterGetBufferLayout(void *ctx)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+return((xc && (xc->buffer_layout == FST_WR_BL_SEGMENTED)) ? FST_WR_BL_SEGMENTED : FST_WR_BL_CHAINED);
+}
+
 
 /*
- * private structs
+ * blocks a parallel mode writer keeps in flight before a flush waits for
+ * the oldest one to reach the trace, each holding a copy of the change
+ * buffer.  takes effect on the first parallel flush.
  */
-static const char *vartypes[] = {
-        "event", "integer", "parameter", "real", "real_parameter",
-        "reg", "supply0", "supply1", "time", "tri",
-        "triand", "trior", "trireg", "tri0", "tri1",
-        "wand", "wire", "wor", "port", "sparray", "realtime",
-        "string",
-        "bit", "logic", "int", "shortint", "longint", "byte", "enum", "shortreal"
-        };
-
-static const char *modtypes[] = {
-        "module", "task", "function", "begin", "fork", "generate", "struct", "union", "class", "interface", "package", "program",
-        "vhdl_architecture", "vhdl_procedure", "vhdl_function", "vhdl_record", "vhdl_process", "vhdl_block", "vhdl_for_generate", "vhdl_if_generate", "vhdl_generate", "vhdl_package"
-        };
-
-static const char *attrtypes[] = {
-        "misc", "array", "enum", "class"
-        };
-
-static const char *arraytypes[] = {
-        "none", "unpacked", "packed", "sparse"
-        };
-
-static const char *enumvaluetypes[] = {
-        "integer", "bit", "logic", "int", "shortint", "longint", "byte",
-        "unsigned_integer", "unsigned_bit", "unsigned_logic", "unsigned_int", "unsigned_shortint", "unsigned_longint", "unsigned_byte"
-        };
-
-static const char *packtypes[] = {
-        "none", "unpacked", "packed", "tagged_packed"
-        };
-
-
-struct fstCurrHier
-{
-struct fstCurrHier *prev;
-void *user_info;
-int len;
-};
-
-
-struct fstReaderContext
+void fstWriterSetParallelDepth(void *ctx, int depth)
 {
-/* common entries */
-
-FILE *f, *fh;
-
-uint64_t start_time, end_time;
-uint64_t mem_used_by_writer;
-uint64_t scope_count;
-uint64_t var_count;
-fstHandle maxhandle;
-uint64_t num_alias;
-uint64_t vc_section_count;
-
-uint32_t *signal_lens;                  /* maxhandle sized */
-unsigned char *signal_typs;             /* maxhandle sized */
-unsigned char *process_mask;            /* maxhandle-based, bitwise sized */
-uint32_t longest_signal_value_len;      /* longest len value encountered */
-unsigned char *temp_signal_value_buf;   /* malloced for len in longest_signal_value_len */
-
-signed char timescale;
-unsigned char filetype;
-
-unsigned use_vcd_extensions : 1;
-unsigned double_endian_match : 1;
-unsigned native_doubles_for_cb : 1;
-unsigned contains_geom_section : 1;
-unsigned contains_hier_section : 1;        /* valid for hier_pos */
-unsigned contains_hier_section_lz4duo : 1; /* valid for hier_pos (contains_hier_section_lz4 always also set) */
-unsigned contains_hier_section_lz4 : 1;    /* valid for hier_pos */
-unsigned limit_range_valid : 1;            /* valid for limit_range_start, limit_range_end */
-
-char version[FST_HDR_SIM_VERSION_SIZE + 1];
-char date[FST_HDR_DATE_SIZE + 1];
-int64_t timezero;
-
-char *filename, *filename_unpacked;
-fst_off_t hier_pos;
-
-uint32_t num_blackouts;
-uint64_t *blackout_times;
-unsigned char *blackout_activity;
-
-uint64_t limit_range_start, limit_range_end;
-
-/* entries specific to read value at time functions */
-
-unsigned rvat_data_valid : 1;
-uint64_t *rvat_time_table;
-uint64_t rvat_beg_tim, rvat_end_tim;
-unsigned char *rvat_frame_data;
-uint64_t rvat_frame_maxhandle;
-fst_off_t *rvat_chain_table;
-uint32_t *rvat_chain_table_lengths;
-uint64_t rvat_vc_maxhandle;
-fst_off_t rvat_vc_start;
-uint32_t *rvat_sig_offs;
-int rvat_packtype;
-
-uint32_t rvat_chain_len;
-unsigned char *rvat_chain_mem;
-fstHandle rvat_chain_facidx;
-
-uint32_t rvat_chain_pos_tidx;
-uint32_t rvat_chain_pos_idx;
-uint64_t rvat_chain_pos_time;
-unsigned rvat_chain_pos_valid : 1;
-
-/* entries specific to hierarchy traversal */
-
-struct fstHier hier;
-struct fstCurrHier *curr_hier;
-fstHandle current_handle;
-char *curr_flat_hier_nam;
-int flat_hier_alloc_len;
-unsigned do_rewind : 1;
-char str_scope_nam[FST_ID_NAM_SIZ+1];
-char str_scope_comp[FST_ID_NAM_SIZ+1];
-char *str_scope_attr;
-
-unsigned fseek_failed : 1;
-
-/* self-buffered I/O for writes */
-
-#ifndef FST_WRITEX_DISABLE
-int writex_pos;
-int writex_fd;
-unsigned char writex_buf[FST_WRITEX_MAX];
-#endif
-
-char *f_nam;
-char *fh_nam;
-};
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
+        {
+        xc->parallel_depth = (depth > 0) ? depth : 0;
+        }
+}
 
 
-int fstReaderFseeko(struct fstReaderContext *xc, FILE *stream, fst_off_t offset, int whence)
+int fstWriterGetParallelDepth(void *ctx)
 {
-int rc = fseeko(stream, offset, whence);
-
-if(rc<0)
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-        xc->fseek_failed = 1;
-#ifdef FST_DEBUG
-        fprintf(stderr, FST_APIMESS "Seek to #%" PRId64 " (whence = %d) failed!\n", offset, whence);
-        perror("Why");
+#ifdef FST_WRITER_PARALLEL
+        if(xc->pipe) return(xc->pipe->num_threads);
+        return((xc->parallel_depth > 0) ? xc->parallel_depth : FST_WRITER_PARALLEL_DEPTH);
 #endif
         }
 
-return(rc);
+return(0);
 }
 
 
-#ifndef FST_WRITEX_DISABLE
-static void fstWritex(struct fstReaderContext *xc, void *v, uint32_t len) /* TALOS-2023-1793: change len to unsigned */
+void fstWriterSetParallelMode(void *ctx, int enable)
 {
-unsigned char *s = (unsigned char *)v;
-
-if(len)
-        {
-        if(len < FST_WRITEX_MAX)
-                {
-                if(xc->writex_pos + len >= FST_WRITEX_MAX)
-                        {
-                        fstWritex(xc, NULL, 0);
-                        }
-
-                memcpy(xc->writex_buf + xc->writex_pos, s, len);
-                xc->writex_pos += len;
-                }
-                else
-                {
-                fstWritex(xc, NULL, 0);
-                if (write(xc->writex_fd, s, len)) { };
-                }
-        }
-        else
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-        if(xc->writex_pos)
+        xc->parallel_was_enabled |= xc->parallel_enabled; /* make sticky */
+        xc->parallel_enabled = (enable != 0);
+#ifndef FST_WRITER_PARALLEL
+        if(xc->parallel_enabled)
                 {
-                if(write(xc->writex_fd, xc->writex_buf, xc->writex_pos)) { };
-                xc->writex_pos = 0;
+                fprintf(stderr, FST_APIMESS "fstWriterSetParallelMode(), FST_WRITER_PARALLEL not enabled during compile, exiting.\n");
+                exit(255);
                 }
+#endif
         }
 }
-#endif
 
 
 /*
- * scope -> flat name handling
+ * encode and compress the value change chains of each flush on a pool of
+ * num_threads workers, written out in handle order so the file does not
+ * change.  0 or 1 flushes serially, as do builds without FST_WRITER_PARALLEL.
  */
-static void fstReaderDeallocateScopeData(struct fstReaderContext *xc)
+void fstWriterSetFlushThreads(void *ctx, int num_threads)
 {
-struct fstCurrHier *chp;
-
-free(xc->curr_flat_hier_nam); xc->curr_flat_hier_nam = NULL;
-while(xc->curr_hier)
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-        chp = xc->curr_hier->prev;
-        free(xc->curr_hier);
-        xc->curr_hier = chp;
+#ifdef FST_WRITER_PARALLEL
+        xc->flush_threads = (num_threads > 1) ? num_threads : 0;
+#else
+        (void)num_threads;
+#endif
         }
 }
 
 
-const char *fstReaderGetCurrentFlatScope(void *ctx)
+int fstWriterGetFlushThreads(void *ctx)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-if(xc)
-        {
-        return(xc->curr_flat_hier_nam ? xc->curr_flat_hier_nam : "");
-        }
-        else
-        {
-        return(NULL);
-        }
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+return(xc ? xc->flush_threads : 0);
 }
 
 
-void *fstReaderGetCurrentScopeUserInfo(void *ctx)
+void fstWriterSetDumpSizeLimit(void *ctx, uint64_t numbytes)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 if(xc)
         {
-        return(xc->curr_hier ? xc->curr_hier->user_info : NULL);
-        }
-        else
-        {
-        return(NULL);
+        xc->dump_size_limit = numbytes;
         }
 }
 
 
-const char *fstReaderPopScope(void *ctx)
+int fstWriterGetDumpSizeLimitReached(void *ctx)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-if(xc && xc->curr_hier)
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc)
         {
-        struct fstCurrHier *ch = xc->curr_hier;
-        if(xc->curr_hier->prev)
-                {
-                xc->curr_flat_hier_nam[xc->curr_hier->prev->len] = 0;
-                }
-                else
+#ifdef FST_WRITER_PARALLEL
+        if(xc->pipe)
                 {
-                *xc->curr_flat_hier_nam = 0;
+                int limit_reached;
+
+                pthread_mutex_lock(&xc->pipe->mutex);
+                limit_reached = xc->pipe->limit_reached;
+                pthread_mutex_unlock(&xc->pipe->mutex);
+                if(limit_reached) return(1);
                 }
-        xc->curr_hier = xc->curr_hier->prev;
-        free(ch);
-        return(xc->curr_flat_hier_nam ? xc->curr_flat_hier_nam : "");
+#endif
+        return(xc->size_limit_locked != 0);
         }
 
-return(NULL);
+return(0);
 }
 
 
-void fstReaderResetScope(void *ctx)
+int fstWriterGetFseekFailed(void *ctx)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 if(xc)
         {
-        while(fstReaderPopScope(xc)); /* remove any already-built scoping info */
+        return(xc->fseek_failed != 0);
         }
+
+return(0);
 }
 
 
-const char *fstReaderPushScope(void *ctx, const char *nam, void *user_info)
+/*
+ * writer attr/scope/var creation:
+ * fstWriterCreateVar2() is used to dump VHDL or other languages, but the
+ * underlying variable needs to map to Verilog/SV via the proper fstVarType vt
+ */
+fstHandle fstWriterCreateVar2(void *ctx, enum fstVarType vt, enum fstVarDir vd,
+        uint32_t len, const char *nam, fstHandle aliasHandle,
+        const char *type, enum fstSupplementalVarType svt, enum fstSupplementalDataType sdt)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-if(xc)
-        {
-        struct fstCurrHier *ch = (struct fstCurrHier *)malloc(sizeof(struct fstCurrHier));
-        int chl = xc->curr_hier ? xc->curr_hier->len : 0;
-        int len = chl + 1 + strlen(nam);
-        if(len >= xc->flat_hier_alloc_len)
-                {
-                xc->curr_flat_hier_nam = xc->curr_flat_hier_nam ? (char *)realloc(xc->curr_flat_hier_nam, len+1) : (char *)malloc(len+1);
-                }
+fstWriterSetAttrGeneric(ctx, type ? type : "", FST_MT_SUPVAR, (svt<<FST_SDT_SVT_SHIFT_COUNT) | (sdt & FST_SDT_ABS_MAX));
+return(fstWriterCreateVar(ctx, vt, vd, len, nam, aliasHandle));
+}
 
-        if(chl)
-                {
-                xc->curr_flat_hier_nam[chl] = '.';
-                strcpy(xc->curr_flat_hier_nam + chl + 1, nam);
-                }
-                else
+
+fstHandle fstWriterCreateVar(void *ctx, enum fstVarType vt, enum fstVarDir vd,
+        uint32_t len, const char *nam, fstHandle aliasHandle)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+unsigned int i;
+int nlen, is_real;
+
+if(xc && nam)
+        {
+        if(xc->valpos_mem)
                 {
-                strcpy(xc->curr_flat_hier_nam, nam);
-                len--;
+                fstDestroyMmaps(xc, 0);
                 }
 
-        ch->len = len;
-        ch->prev = xc->curr_hier;
-        ch->user_info = user_info;
-        xc->curr_hier = ch;
-        return(xc->curr_flat_hier_nam);
-        }
+        fputc(vt, xc->hier_handle);
+        fputc(vd, xc->hier_handle);
+        nlen = strlen(nam);
+        fstFwrite(nam, nlen, 1, xc->hier_handle);
+        fputc(0, xc->hier_handle);
+        xc->hier_file_len += (nlen+3);
 
-return(NULL);
-}
+        if((vt == FST_VT_VCD_REAL) || (vt == FST_VT_VCD_REAL_PARAMETER) || (vt == FST_VT_VCD_REALTIME) || (vt == FST_VT_SV_SHORTREAL))
+                {
+                is_real = 1;
+                len = 8; /* recast number of bytes to that of what a double is */
+                }
+                else
+                {
+                is_real = 0;
+                if(vt == FST_VT_GEN_STRING)
+                        {
+                        len = 0;
+                        }
+                }
 
+        xc->hier_file_len += fstWriterVarint(xc->hier_handle, len);
 
-int fstReaderGetCurrentScopeLen(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+        if(aliasHandle > xc->maxhandle) aliasHandle = 0;
+        xc->hier_file_len += fstWriterVarint(xc->hier_handle, aliasHandle);
+        xc->numsigs++;
+        if(xc->numsigs == xc->next_huge_break)
+                {
+                if(xc->fst_break_size < xc->fst_huge_break_size)
+                        {
+                        xc->next_huge_break += FST_ACTIVATE_HUGE_INC;
+                        xc->fst_break_size += xc->fst_orig_break_size;
+                        xc->fst_break_add_size += xc->fst_orig_break_add_size;
 
-if(xc && xc->curr_hier)
-        {
-        return(xc->curr_hier->len);
-        }
+                        xc->vchg_alloc_siz = xc->fst_break_size + xc->fst_break_add_size;
+                        if(xc->vchg_mem)
+                                {
+                                xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+                                }
+                        }
+                }
 
-return(0);
-}
+        if(!aliasHandle)
+                {
+                uint32_t zero = 0;
 
+                if(len)
+                        {
+                        fstWriterVarint(xc->geom_handle, !is_real ? len : 0); /* geom section encodes reals as zero byte */
+                        }
+                        else
+                        {
+                        fstWriterVarint(xc->geom_handle, 0xFFFFFFFF);         /* geom section encodes zero len as 32b -1 */
+                        }
 
-int fstReaderGetFseekFailed(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-if(xc)
-        {
-        return(xc->fseek_failed != 0);
+                fstFwrite(&xc->maxvalpos, sizeof(uint32_t), 1, xc->valpos_handle);
+                fstFwrite(&len, sizeof(uint32_t), 1, xc->valpos_handle);
+                fstFwrite(&zero, sizeof(uint32_t), 1, xc->valpos_handle);
+                fstFwrite(&zero, sizeof(uint32_t), 1, xc->valpos_handle);
+
+                if(!is_real)
+                        {
+                        for(i=0;i<len;i++)
+                                {
+                                fputc('x', xc->curval_handle);
+                                }
+                        }
+                        else
+                        {
+                        fstFwrite(&xc->nan, 8, 1, xc->curval_handle); /* initialize doubles to NaN rather than x */
+                        }
+
+                xc->maxvalpos+=len;
+                if(len > xc->max_value_len) xc->max_value_len = len;
+                xc->maxhandle++;
+                return(xc->maxhandle);
+                }
+                else
+                {
+                return(aliasHandle);
+                }
         }
 
 return(0);
 }
 
 
-/*
- * iter mask manipulation util functions
- */
-int fstReaderGetFacProcessMask(void *ctx, fstHandle facidx)
+void fstWriterSetScope(void *ctx, enum fstScopeType scopetype,
+                const char *scopename, const char *scopecomp)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 
 if(xc)
         {
-        facidx--;
-        if(facidx<xc->maxhandle)
-                {
-                int process_idx = facidx/8;
-                int process_bit = facidx&7;
+        fputc(FST_ST_VCD_SCOPE, xc->hier_handle);
+        if(/*(scopetype < FST_ST_VCD_MODULE) ||*/ (scopetype > FST_ST_MAX)) { scopetype = FST_ST_VCD_MODULE; }
+        fputc(scopetype, xc->hier_handle);
+        fprintf(xc->hier_handle, "%s%c%s%c",
+                scopename ? scopename : "", 0,
+                scopecomp ? scopecomp : "", 0);
 
-                return( (xc->process_mask[process_idx]&(1<<process_bit)) != 0 );
+        if(scopename)
+                {
+                xc->hier_file_len += strlen(scopename);
+                }
+        if(scopecomp)
+                {
+                xc->hier_file_len += strlen(scopecomp);
                 }
+
+        xc->hier_file_len += 4; /* FST_ST_VCD_SCOPE + scopetype + two string terminating zeros */
+        xc->numscopes++;
         }
-return(0);
 }
 
 
-void fstReaderSetFacProcessMask(void *ctx, fstHandle facidx)
+void fstWriterSetUpscope(void *ctx)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 
 if(xc)
         {
-        facidx--;
-        if(facidx<xc->maxhandle)
-                {
-                int idx = facidx/8;
-                int bitpos = facidx&7;
-
-                xc->process_mask[idx] |= (1<<bitpos);
-                }
+        fputc(FST_ST_VCD_UPSCOPE, xc->hier_handle);
+        xc->hier_file_len++;
         }
 }
 
 
-void fstReaderClrFacProcessMask(void *ctx, fstHandle facidx)
+void fstWriterSetAttrBegin(void *ctx, enum fstAttrType attrtype, int subtype,
+                const char *attrname, uint64_t arg)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 
 if(xc)
         {
-        facidx--;
-        if(facidx<xc->maxhandle)
+        fputc(FST_ST_GEN_ATTRBEGIN, xc->hier_handle);
+        if(/*(attrtype < FST_AT_MISC) ||*/ (attrtype > FST_AT_MAX)) { attrtype = FST_AT_MISC; subtype = FST_MT_UNKNOWN; }
+        fputc(attrtype, xc->hier_handle);
+
+        switch(attrtype)
                 {
-                int idx = facidx/8;
-                int bitpos = facidx&7;
+                case FST_AT_ARRAY:      if((subtype < FST_AR_NONE) || (subtype > FST_AR_MAX)) subtype = FST_AR_NONE; break;
+                case FST_AT_ENUM:       if((subtype < FST_EV_SV_INTEGER) || (subtype > FST_EV_MAX)) subtype = FST_EV_SV_INTEGER; break;
+                case FST_AT_PACK:       if((subtype < FST_PT_NONE) || (subtype > FST_PT_MAX)) subtype = FST_PT_NONE; break;
 
-                xc->process_mask[idx] &= (~(1<<bitpos));
+                case FST_AT_MISC:
+                default:                break;
                 }
-        }
-}
 
+        fputc(subtype, xc->hier_handle);
+        fprintf(xc->hier_handle, "%s%c",
+                attrname ? attrname : "", 0);
 
-void fstReaderSetFacProcessMaskAll(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+        if(attrname)
+                {
+                xc->hier_file_len += strlen(attrname);
+                }
 
-if(xc)
-        {
-        memset(xc->process_mask, 0xff, (xc->maxhandle+7)/8);
+        xc->hier_file_len += 4; /* FST_ST_GEN_ATTRBEGIN + type + subtype + string terminating zero */
+        xc->hier_file_len += fstWriterVarint(xc->hier_handle, arg);
         }
 }
 
 
-void fstReaderClrFacProcessMaskAll(void *ctx)
+void fstWriterSetAttrEnd(void *ctx)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 
 if(xc)
         {
-        memset(xc->process_mask, 0x00, (xc->maxhandle+7)/8);
+        fputc(FST_ST_GEN_ATTREND, xc->hier_handle);
+        xc->hier_file_len++;
         }
 }
 
 
-/*
- * various utility read/write functions
- */
-signed char fstReaderGetTimescale(void *ctx)
+fstEnumHandle fstWriterCreateEnumTable(void *ctx, const char *name, uint32_t elem_count, unsigned int min_valbits, const char **literal_arr, const char **val_arr)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->timescale : 0);
-}
+fstEnumHandle handle = 0;
+unsigned int *literal_lens = NULL;
+unsigned int *val_lens = NULL;
+int lit_len_tot = 0;
+int val_len_tot = 0;
+int name_len;
+char elem_count_buf[16];
+int elem_count_len;
+int total_len;
+int pos = 0;
+char *attr_str = NULL;
 
+if(ctx && name && literal_arr && val_arr && (elem_count != 0))
+	{
+	struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 
-uint64_t fstReaderGetStartTime(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->start_time : 0);
-}
+	uint32_t i;
 
+	name_len = strlen(name);
+	elem_count_len = snprintf(elem_count_buf, 16, "%" PRIu32, elem_count);
 
-uint64_t fstReaderGetEndTime(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->end_time : 0);
-}
+	literal_lens = (unsigned int *)calloc(elem_count, sizeof(unsigned int));
+	val_lens = (unsigned int *)calloc(elem_count, sizeof(unsigned int));
 
+	for(i=0;i<elem_count;i++)
+		{
+		literal_lens[i] = strlen(literal_arr[i]);
+		lit_len_tot += fstUtilityBinToEscConvertedLen((unsigned char*)literal_arr[i], literal_lens[i]);
 
-uint64_t fstReaderGetMemoryUsedByWriter(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->mem_used_by_writer : 0);
-}
+		val_lens[i] =  strlen(val_arr[i]);
+		val_len_tot += fstUtilityBinToEscConvertedLen((unsigned char*)val_arr[i], val_lens[i]);
 
+		if(min_valbits > 0)
+			{
+			if(val_lens[i] < min_valbits)
+				{
+				val_len_tot += (min_valbits - val_lens[i]); /* additional converted len is same for '0' character */
+				}
+			}
+		}
 
-uint64_t fstReaderGetScopeCount(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->scope_count : 0);
-}
-
+	total_len = name_len + 1 + elem_count_len + 1 + lit_len_tot + elem_count + val_len_tot + elem_count;
 
-uint64_t fstReaderGetVarCount(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->var_count : 0);
-}
+	attr_str = (char*)malloc(total_len);
+	pos = 0;
 
+	memcpy(attr_str+pos, name, name_len);
+	pos += name_len;
+	attr_str[pos++] = ' ';
 
-fstHandle fstReaderGetMaxHandle(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->maxhandle : 0);
-}
+	memcpy(attr_str+pos, elem_count_buf, elem_count_len);
+	pos += elem_count_len;
+	attr_str[pos++] = ' ';
 
+	for(i=0;i<elem_count;i++)
+		{
+		pos += fstUtilityBinToEsc((unsigned char*)attr_str+pos, (unsigned char*)literal_arr[i], literal_lens[i]);
+		attr_str[pos++] = ' ';
+		}
 
-uint64_t fstReaderGetAliasCount(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->num_alias : 0);
-}
+	for(i=0;i<elem_count;i++)
+		{
+		if(min_valbits > 0)
+			{
+			if(val_lens[i] < min_valbits)
+				{
+				memset(attr_str+pos, '0', min_valbits - val_lens[i]);
+				pos += (min_valbits - val_lens[i]);
+				}
+			}
 
+		pos += fstUtilityBinToEsc((unsigned char*)attr_str+pos, (unsigned char*)val_arr[i], val_lens[i]);
+		attr_str[pos++] = ' ';
+		}
 
-uint64_t fstReaderGetValueChangeSectionCount(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->vc_section_count : 0);
-}
+	attr_str[pos-1] = 0;
 
+#ifdef FST_DEBUG
+	fprintf(stderr, FST_APIMESS "fstWriterCreateEnumTable() total_len: %d, pos: %d\n", total_len, pos);
+	fprintf(stderr, FST_APIMESS "*%s*\n", attr_str);
+#endif
 
-int fstReaderGetDoubleEndianMatchState(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->double_endian_match : 0);
-}
+	fstWriterSetAttrBegin(xc, FST_AT_MISC, FST_MT_ENUMTABLE, attr_str, handle = ++xc->max_enumhandle);
 
+	free(attr_str);
+	free(val_lens);
+	free(literal_lens);
+	}
 
-const char *fstReaderGetVersionString(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->version : NULL);
+return(handle);
 }
 
 
-const char *fstReaderGetDateString(void *ctx)
+void fstWriterEmitEnumTableRef(void *ctx, fstEnumHandle handle)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->date : NULL);
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+if(xc && handle)
+	{
+	fstWriterSetAttrBegin(xc, FST_AT_MISC, FST_MT_ENUMTABLE, NULL, handle);
+        }
 }
 
 
-int fstReaderGetFileType(void *ctx)
+/*
+ * value and time change emission
+ */
+void fstWriterEmitValueChange(void *ctx, fstHandle handle, const void *val)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? (int)xc->filetype : (int)FST_FT_VERILOG);
-}
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+const unsigned char *buf = (const unsigned char *)val;
+uint32_t offs;
+int len;
+
+if(FST_LIKELY((xc) && (handle <= xc->maxhandle)))
+        {
+        uint32_t fpos;
+        uint32_t *vm4ip;
 
+        if(FST_UNLIKELY(!xc->valpos_mem))
+                {
+                xc->vc_emitted = 1;
+                fstWriterCreateMmaps(xc);
+                }
 
-int64_t fstReaderGetTimezero(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->timezero : 0);
-}
+        handle--; /* move starting at 1 index to starting at 0 */
+        vm4ip = &(xc->valpos_mem[4*handle]);
 
+        len  = vm4ip[1];
+        if(FST_LIKELY(len)) /* len of zero = variable length, use fstWriterEmitVariableLengthValueChange */
+                {
+                if(FST_LIKELY(!xc->is_initial_time))
+                        {
+                        fpos = xc->vchg_siz;
 
-uint32_t fstReaderGetNumberDumpActivityChanges(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-return(xc ? xc->num_blackouts : 0);
-}
+                        if(FST_UNLIKELY((fpos + len + 10) > xc->vchg_alloc_siz))
+                                {
+                                xc->vchg_alloc_siz += (xc->fst_break_add_size + len); /* +len added in the case of extremely long vectors and small break add sizes */
+                                xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+                                if(FST_UNLIKELY(!xc->vchg_mem))
+                                        {
+                                        fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitValueChange, exiting.\n");
+                                        exit(255);
+                                        }
+                                }
+#ifdef FST_REMOVE_DUPLICATE_VC
+                        offs = vm4ip[0];
 
+                        if(len != 1)
+                                {
+                                if((vm4ip[3]==xc->tchn_idx)&&(vm4ip[2]))
+                                        {
+                                        unsigned char *old_value = xc->vchg_mem + vm4ip[2] + 4; /* the +4 skips old vm4ip[2] value */
+                                        while(*(old_value++) & 0x80) { /* skips over varint encoded "xc->tchn_idx - vm4ip[3]" */ }
+                                        memcpy(old_value, buf, len); /* overlay new value */
 
-uint64_t fstReaderGetDumpActivityChangeTime(void *ctx, uint32_t idx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+                                        memcpy(xc->curval_mem + offs, buf, len);
+                                        return;
+                                        }
+                                else
+                                        {
+                                        if(!memcmp(xc->curval_mem + offs, buf, len))
+                                                {
+                                                if(!xc->curtime)
+                                                        {
+                                                        int i;
+                                                        for(i=0;i<len;i++)
+                                                                {
+                                                                if(buf[i]!='x') break;
+                                                                }
 
-if(xc && (idx < xc->num_blackouts) && (xc->blackout_times))
-        {
-        return(xc->blackout_times[idx]);
-        }
-        else
-        {
-        return(0);
-        }
-}
+                                                        if(i<len) return;
+                                                        }
+                                                        else
+                                                        {
+                                                        return;
+                                                        }
+                                                }
+                                        }
 
+                                memcpy(xc->curval_mem + offs, buf, len);
+                                }
+                                else
+                                {
+                                if((vm4ip[3]==xc->tchn_idx)&&(vm4ip[2]))
+                                        {
+                                        unsigned char *old_value = xc->vchg_mem + vm4ip[2] + 4; /* the +4 skips old vm4ip[2] value */
+                                        while(*(old_value++) & 0x80) { /* skips over varint encoded "xc->tchn_idx - vm4ip[3]" */ }
+                                        *old_value = *buf; /* overlay new value */
 
-unsigned char fstReaderGetDumpActivityChangeValue(void *ctx, uint32_t idx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+                                        *(xc->curval_mem + offs) = *buf;
+                                        return;
+                                        }
+                                else
+                                        {
+                                        if((*(xc->curval_mem + offs)) == (*buf))
+                                                {
+                                                if(!xc->curtime)
+                                                        {
+                                                        if(*buf != 'x') return;
+                                                        }
+                                                        else
+                                                        {
+                                                        return;
+                                                        }
+                                                }
+                                        }
 
-if(xc && (idx < xc->num_blackouts) && (xc->blackout_activity))
-        {
-        return(xc->blackout_activity[idx]);
-        }
-        else
-        {
-        return(0);
+                                *(xc->curval_mem + offs) = *buf;
+                                }
+#endif
+                        fstWriterAppendChars(xc, vm4ip, buf);
+                        }
+                        else
+                        {
+                        offs = vm4ip[0];
+                        memcpy(xc->curval_mem + offs, buf, len);
+                        }
+                }
         }
 }
 
 
-void fstReaderSetLimitTimeRange(void *ctx, uint64_t start_time, uint64_t end_time)
+/*
+ * emits a two-state value change given as packed bits, least significant
+ * word first, without going through characters.  returns 0 when it has to be
+ * emitted as characters instead: for glitch removal, which compares them, or
+ * when bits is not the width of the variable.
+ */
+static int fstWriterEmitPackedChange(struct fstWriterContext *xc, fstHandle handle, uint32_t bits, const uint64_t *words)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-
-if(xc)
-        {
-        xc->limit_range_valid = 1;
-        xc->limit_range_start = start_time;
-        xc->limit_range_end = end_time;
-        }
-}
+#ifdef FST_REMOVE_DUPLICATE_VC
+(void)xc;
+(void)handle;
+(void)bits;
+(void)words;
 
+return(0);
+#else
+uint32_t *vm4ip;
+uint32_t len;
+uint32_t fpos;
 
-void fstReaderSetUnlimitedTimeRange(void *ctx)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(FST_UNLIKELY((!xc) || ((handle - 1) >= xc->maxhandle))) return(1); /* ignored, as fstWriterEmitValueChange() does */
 
-if(xc)
+if(FST_UNLIKELY(!xc->valpos_mem))
         {
-        xc->limit_range_valid = 0;
+        xc->vc_emitted = 1;
+        fstWriterCreateMmaps(xc);
         }
-}
 
+vm4ip = &(xc->valpos_mem[4*(handle-1)]);
+len = vm4ip[1];
+if(FST_UNLIKELY((len != bits) || (!len))) return(0);
 
-void fstReaderSetVcdExtensions(void *ctx, int enable)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(FST_UNLIKELY(xc->is_initial_time))
+        {
+        fstWriterExpandPacked(xc->curval_mem + vm4ip[0], len, words);
+        return(1);
+        }
 
-if(xc)
+fpos = xc->vchg_siz;
+if(FST_UNLIKELY((fpos + (len + 7) / 8 + 10) > xc->vchg_alloc_siz))
         {
-        xc->use_vcd_extensions = (enable != 0);
+        xc->vchg_alloc_siz += (xc->fst_break_add_size + len);
+        xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+        if(FST_UNLIKELY(!xc->vchg_mem))
+                {
+                fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeVec64, exiting.\n");
+                exit(255);
+                }
         }
+
+fstWriterAppendPacked(xc, vm4ip, words);
+return(1);
+#endif
 }
 
-
-void fstReaderIterBlocksSetNativeDoublesOnCallback(void *ctx, int enable)
-{
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-if(xc)
+void fstWriterEmitValueChange32(void *ctx, fstHandle handle,
+                                uint32_t bits, uint32_t val) {
+        char buf[32];
+        char *s = buf;
+        uint32_t i;
+        uint64_t word = val;
+        if (FST_LIKELY(bits <= 32) &&
+            fstWriterEmitPackedChange((struct fstWriterContext *)ctx, handle, bits, &word))
         {
-        xc->native_doubles_for_cb = (enable != 0);
+                return;
         }
-}
-
-/*
- * hierarchy processing
- */
-static void fstVcdID(char *buf, unsigned int value)
-{
-char *pnt = buf;
-
-/* zero is illegal for a value...it is assumed they start at one */
-while (value)
+        for (i = 0; i < bits; ++i)
         {
-        value--;
-        *(pnt++) = (char)('!' + value % 94);
-        value = value / 94;
+                *s++ = '0' + ((val >> (bits - i - 1)) & 1);
         }
-
-*pnt = 0;
+        fstWriterEmitValueChange(ctx, handle, buf);
 }
-
-static int fstVcdIDForFwrite(char *buf, unsigned int value)
-{
-char *pnt = buf;
- int len = 0;
-
-/* zero is illegal for a value...it is assumed they start at one */
-while (value && len < 14)
+void fstWriterEmitValueChange64(void *ctx, fstHandle handle,
+                                uint32_t bits, uint64_t val) {
+        char buf[64];
+        char *s = buf;
+        uint32_t i;
+        if (FST_LIKELY(bits <= 64) &&
+            fstWriterEmitPackedChange((struct fstWriterContext *)ctx, handle, bits, &val))
         {
-        value--;
-	++len;
-        *(pnt++) = (char)('!' + value % 94);
-        value = value / 94;
+                return;
         }
-
-return len;
-}
-
-
-static int fstReaderRecreateHierFile(struct fstReaderContext *xc)
-{
-int pass_status = 1;
-
-#ifdef DEBUG_HIERARCHY
-fprintf(stderr, "DEBUG: fstReaderRecreateHierFile called\n");
-if(xc) {
-    fprintf(stderr, "DEBUG: xc->fh = %p\n", xc->fh);
-    fprintf(stderr, "DEBUG: xc->contains_hier_section = %d\n", xc->contains_hier_section);
-    fprintf(stderr, "DEBUG: xc->contains_hier_section_lz4 = %d\n", xc->contains_hier_section_lz4);
+        for (i = 0; i < bits; ++i)
+        {
+                *s++ = '0' + ((val >> (bits - i - 1)) & 1);
+        }
+        fstWriterEmitValueChange(ctx, handle, buf);
 }
-#endif
-
-if(!xc->fh)
+void fstWriterEmitValueChangeVec32(void *ctx, fstHandle handle,
+                                   uint32_t bits, const uint32_t *val) {
+        struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+        if (FST_UNLIKELY(bits <= 32))
         {
-        fst_off_t offs_cache = ftello(xc->f);
-	int fnam_len = strlen(xc->filename) + 6 + 16 + 32 + 1;
-        char *fnam = (char *)malloc(fnam_len);
-        unsigned char *mem = (unsigned char *)malloc(FST_GZIO_LEN);
-        fst_off_t hl, uclen;
-        fst_off_t clen = 0;
-        gzFile zhandle = NULL;
-        int zfd;
-        int htyp = FST_BL_SKIP;
-
-        /* can't handle both set at once should never happen in a real file */
-        if(!xc->contains_hier_section_lz4 && xc->contains_hier_section)
+                fstWriterEmitValueChange32(ctx, handle, bits, val[0]);
+        }
+        else if(FST_LIKELY(xc))
+        {
+                int bq = bits / 32;
+                int br = bits & 31;
+                int i;
+                int w;
+                uint32_t v;
+                unsigned char* s;
+                if (FST_UNLIKELY(bits > xc->outval_alloc_siz))
                 {
-                htyp = FST_BL_HIER;
+                        xc->outval_alloc_siz = bits*2 + 1;
+                        xc->outval_mem = (unsigned char*)realloc(xc->outval_mem, xc->outval_alloc_siz);
+                        if (FST_UNLIKELY(!xc->outval_mem))
+                        {
+                                fprintf(stderr,
+                                        FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeVec32, exiting.\n");
+                                exit(255);
+                        }
                 }
-        else
-        if(xc->contains_hier_section_lz4 && !xc->contains_hier_section)
                 {
-                htyp = xc->contains_hier_section_lz4duo ? FST_BL_HIER_LZ4DUO : FST_BL_HIER_LZ4;
+                        uint64_t *words = (uint64_t *)xc->outval_mem; /* fits as bits > 32 */
+                        int nw = (bits + 31) / 32;
+                        for (w = 0; w < nw; w += 2)
+                        {
+                                words[w / 2] = val[w] | ((w + 1 < nw) ? ((uint64_t)val[w + 1] << 32) : 0);
+                        }
+                        if (fstWriterEmitPackedChange(xc, handle, bits, words))
+                        {
+                                return;
+                        }
                 }
-        
-#ifdef DEBUG_HIERARCHY
-        fprintf(stderr, "DEBUG: htyp = %d (FST_BL_HIER=%d, FST_BL_SKIP=%d)\n", htyp, FST_BL_HIER, FST_BL_SKIP);
-        if(htyp == FST_BL_SKIP) {
-            fprintf(stderr, "ERROR: No hierarchy section found in FST file!\n");
-        }
-#endif
-
-        snprintf(fnam, fnam_len, "%s.hier_%d_%p", xc->filename, getpid(), (void *)xc);
-        fstReaderFseeko(xc, xc->f, xc->hier_pos, SEEK_SET);
-        uclen = fstReaderUint64(xc->f);
-#ifndef __MINGW32__
-        fflush(xc->f);
-#endif
-        if(htyp == FST_BL_HIER)
+                s = xc->outval_mem;
+                if (br) /* val has no word bq when bits is a multiple of the word size */
                 {
-#ifdef DEBUG_HIERARCHY
-                fprintf(stderr, "DEBUG: Processing FST_BL_HIER section at pos %lld\n", (long long)xc->hier_pos);
-#endif
-                fstReaderFseeko(xc, xc->f, xc->hier_pos, SEEK_SET);
-                uclen = fstReaderUint64(xc->f);
-                /* Position is now after the 8-byte length field */
-#ifndef __MINGW32__
-                fflush(xc->f);
-#endif
-                /* Get current position after reading uclen */
-                fst_off_t current_pos = ftello(xc->f);
-                
-#ifdef _MSC_VER
-                /* MSVC: Create a new file descriptor by reopening the file */
-                /* This avoids issues with shared file position */
-                int orig_fd = _fileno(xc->f);
-                zfd = _open(xc->filename, _O_RDONLY | _O_BINARY);
-#ifdef DEBUG_HIERARCHY
-                fprintf(stderr, "DEBUG: _open(%s) returned fd=%d\n", xc->filename, zfd);
-#endif
-                if (zfd >= 0) {
-                    __int64 seek_res = _lseeki64(zfd, current_pos, SEEK_SET);
-#ifdef DEBUG_HIERARCHY
-                    fprintf(stderr, "DEBUG: _lseeki64 to %lld returned %lld\n", (long long)current_pos, (long long)seek_res);
-#endif
-                }
-#else
-                /* Non-Windows: duplicate normally */
-                fflush(xc->f);
-                zfd = dup(fileno(xc->f));
-#endif
-                zhandle = gzdopen(zfd, "rb");
-#ifdef DEBUG_HIERARCHY
-                fprintf(stderr, "DEBUG: gzdopen returned %p for fd %d, filename=%s\n", zhandle, zfd, xc->filename);
-#endif
-                if(!zhandle)
+                        w = bq;
+                        v = val[w];
+                        for (i = 0; i < br; ++i)
                         {
-#ifdef _MSC_VER
-                        if (zfd >= 0) _close(zfd);
-#else
-                        close(zfd);
-#endif
-                        free(mem);
-                        free(fnam);
-                        return(0);
+                                *s++ = '0' + ((v >> (br - i - 1)) & 1);
                         }
                 }
-        else
-        if((htyp == FST_BL_HIER_LZ4) || (htyp == FST_BL_HIER_LZ4DUO))
+                for (w = bq - 1; w >= 0; --w)
                 {
-                fstReaderFseeko(xc, xc->f, xc->hier_pos - 8, SEEK_SET); /* get section len */
-                clen =  fstReaderUint64(xc->f) - 16;
-                uclen = fstReaderUint64(xc->f);
-#ifndef __MINGW32__
-                fflush(xc->f);
-#endif
+                        v = val[w];
+                        for (i = (32 - 4); i >= 0; i -= 4) {
+                                s[0] = '0' + ((v >> (i + 3)) & 1);
+                                s[1] = '0' + ((v >> (i + 2)) & 1);
+                                s[2] = '0' + ((v >> (i + 1)) & 1);
+                                s[3] = '0' + ((v >> (i + 0)) & 1);
+                                s += 4;
+                        }
                 }
-
-#if !defined(__MINGW32__) && !defined(_MSC_VER)
-        xc->fh = fopen(fnam, "w+b");
-        if(!xc->fh)
-#endif
+                fstWriterEmitValueChange(ctx, handle, xc->outval_mem);
+        }
+}
+void fstWriterEmitValueChangeVec64(void *ctx, fstHandle handle,
+                                   uint32_t bits, const uint64_t *val) {
+        struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+        if (FST_UNLIKELY(bits <= 64))
+        {
+                fstWriterEmitValueChange64(ctx, handle, bits, val[0]);
+        }
+        else if(FST_LIKELY(xc))
+        {
+                int bq = bits / 64;
+                int br = bits & 63;
+                int i;
+                int w;
+                uint64_t v;
+                unsigned char* s;
+                if (fstWriterEmitPackedChange(xc, handle, bits, val))
                 {
-                xc->fh = tmpfile_open(&xc->fh_nam);
-                free(fnam); fnam = NULL;
-#ifdef DEBUG_HIERARCHY
-                fprintf(stderr, "DEBUG: tmpfile_open returned %p\n", xc->fh);
-#endif
-                if(!xc->fh)
+                        return;
+                }
+                if (FST_UNLIKELY(bits > xc->outval_alloc_siz))
+                {
+                        xc->outval_alloc_siz = bits*2 + 1;
+                        xc->outval_mem = (unsigned char*)realloc(xc->outval_mem, xc->outval_alloc_siz);
+                        if (FST_UNLIKELY(!xc->outval_mem))
                         {
-#ifdef DEBUG_HIERARCHY
-                        fprintf(stderr, "ERROR: Failed to create temp file!\n");
-#endif
-                        tmpfile_close(&xc->fh, &xc->fh_nam);
-                        free(mem);
-                        return(0);
+                                fprintf(stderr,
+                                        FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeVec64, exiting.\n");
+                                exit(255);
                         }
                 }
-
-#ifndef __MINGW32__
-        if(fnam) unlink(fnam);
-#endif
-
-        if(htyp == FST_BL_HIER)
+                s = xc->outval_mem;
+                if (br) /* val has no word bq when bits is a multiple of the word size */
                 {
-#ifdef _MSC_VER
-                /* On Windows, gzdopen seems unreliable. Read compressed data and decompress */
-                if(zhandle) {
-                    /* Close the gzhandle and fd, we'll do this differently */
-                    gzclose(zhandle);
-                    zhandle = NULL;
-                }
-                
-                /* Read the compressed data size (we need to figure this out) */
-                /* For now, allocate a large buffer */
-                size_t max_compressed_size = uclen; /* Worst case: no compression */
-                unsigned char *compressed_buf = (unsigned char *)malloc(max_compressed_size);
-                size_t compressed_size = fstFread(compressed_buf, 1, max_compressed_size, xc->f);
-                
-#ifdef DEBUG_HIERARCHY
-                fprintf(stderr, "DEBUG: Read %zu bytes of compressed data\n", compressed_size);
-#endif
-                
-                /* Decompress gzip data (has gzip headers, not raw deflate) */
-                unsigned char *uncompressed_buf = (unsigned char *)malloc(uclen);
-                
-                /* Use gzopen_w on a memory buffer would be ideal, but not available */
-                /* Instead, write to a temp file and use gzopen */
-                char temp_gz_name[256];
-                snprintf(temp_gz_name, sizeof(temp_gz_name), "fst_temp_gz_%d.gz", getpid());
-                FILE *temp_gz = fopen(temp_gz_name, "wb");
-                if(temp_gz) {
-                    fwrite(compressed_buf, 1, compressed_size, temp_gz);
-                    fclose(temp_gz);
-                    
-                    /* Now decompress using gzopen */
-                    gzFile gz = gzopen(temp_gz_name, "rb");
-                    if(gz) {
-                        int bytes_read = gzread(gz, uncompressed_buf, uclen);
-                        gzclose(gz);
-                        unlink(temp_gz_name);
-                        
-                        if(bytes_read == uclen) {
-                            /* Write to temp file */
-                            size_t fwlen = fstFwrite(uncompressed_buf, uclen, 1, xc->fh);
-                            if(fwlen != 1) {
-                                pass_status = 0;
-#ifdef DEBUG_HIERARCHY
-                                fprintf(stderr, "ERROR: Failed to write decompressed data\n");
-#endif
-                            }
-                        } else {
-                            pass_status = 0;
-#ifdef DEBUG_HIERARCHY
-                            fprintf(stderr, "ERROR: gzread returned %d, expected %d\n", bytes_read, (int)uclen);
-#endif
+                        w = bq;
+                        v = val[w];
+                        for (i = 0; i < br; ++i)
+                        {
+                                *s++ = '0' + ((v >> (br - i - 1)) & 1);
                         }
-                    } else {
-                        pass_status = 0;
-#ifdef DEBUG_HIERARCHY
-                        fprintf(stderr, "ERROR: Failed to open temp gz file for decompression\n");
-#endif
-                    }
-                } else {
-                    pass_status = 0;
-#ifdef DEBUG_HIERARCHY
-                    fprintf(stderr, "ERROR: Failed to create temp gz file\n");
-#endif
                 }
-                
-                free(compressed_buf);
-                free(uncompressed_buf);
-#else
-                /* Non-Windows: use the original gzread approach */
-                for(hl = 0; hl < uclen; hl += FST_GZIO_LEN)
+                for (w = bq - 1; w >= 0; --w) {
+                        v = val[w];
+                        for (i = (64 - 4); i >= 0; i -= 4)
                         {
-                        size_t len = ((uclen - hl) > FST_GZIO_LEN) ? FST_GZIO_LEN : (uclen - hl);
-                        size_t gzreadlen = gzread(zhandle, mem, len); /* rc should equal len... */
-                        size_t fwlen;
-#ifdef DEBUG_HIERARCHY
-                        if(hl == 0) {
-                            fprintf(stderr, "DEBUG: Starting decompression, uclen=%lld\n", (long long)uclen);
-                        }
-#endif
-                        if(gzreadlen != len)
-                                {
-#ifdef DEBUG_HIERARCHY
-                                fprintf(stderr, "ERROR: gzread failed! Expected %zu, got %zu\n", len, gzreadlen);
-                                const char *err_str = gzerror(zhandle, NULL);
-                                fprintf(stderr, "ERROR: gzip error: %s\n", err_str ? err_str : "unknown");
-#endif
-                                pass_status = 0;
-                                break;
-                                }
-
-                        fwlen = fstFwrite(mem, len, 1, xc->fh);
-                        if(fwlen != 1)
-                                {
-#ifdef DEBUG_HIERARCHY
-                                fprintf(stderr, "ERROR: fwrite failed! Expected 1, got %zu\n", fwlen);
-#endif
-                                pass_status = 0;
-                                break;
-                                }
+                                s[0] = '0' + ((v >> (i + 3)) & 1);
+                                s[1] = '0' + ((v >> (i + 2)) & 1);
+                                s[2] = '0' + ((v >> (i + 1)) & 1);
+                                s[3] = '0' + ((v >> (i + 0)) & 1);
+                                s += 4;
                         }
-                gzclose(zhandle);
-#endif /* _MSC_VER */
-#ifdef DEBUG_HIERARCHY
-                fprintf(stderr, "DEBUG: Decompression complete, pass_status=%d\n", pass_status);
-#endif
                 }
-        else
-        if(htyp == FST_BL_HIER_LZ4DUO)
-                {
-                unsigned char *lz4_cmem  = (unsigned char *)malloc(clen);
-                unsigned char *lz4_ucmem = (unsigned char *)malloc(uclen);
-                unsigned char *lz4_ucmem2;
-                uint64_t uclen2;
-                int skiplen2 = 0;
+                fstWriterEmitValueChange(ctx, handle, xc->outval_mem);
+        }
+}
 
-                fstFread(lz4_cmem, clen, 1, xc->f);
 
-                uclen2 = fstGetVarint64(lz4_cmem, &skiplen2);
-                lz4_ucmem2 = (unsigned char *)malloc(uclen2);
-                pass_status = (uclen2 == (uint64_t)LZ4_decompress_safe_partial ((char *)lz4_cmem + skiplen2, (char *)lz4_ucmem2, clen - skiplen2, uclen2, uclen2));
-                if(pass_status)
-                        {
-                        pass_status = (uclen == LZ4_decompress_safe_partial ((char *)lz4_ucmem2, (char *)lz4_ucmem, uclen2, uclen, uclen));
+/*
+ * batched emits make room in the change buffer once per batch: when count
+ * values as wide as the widest variable might not fit, a pass over the
+ * handles sums their real widths and the buffer grows by that.  the emit
+ * loops then skip the per change room check and prefetch the valpos_mem
+ * entries a few handles ahead, as those are spread over the whole table
+ * for a large design.  returns 0 when the changes have to go through
+ * fstWriterEmitValueChange() one at a time instead.
+ */
+#define FST_WRITER_BATCH_PREFETCH       (8)     /* handles looked ahead */
 
-                        if(fstFwrite(lz4_ucmem, uclen, 1, xc->fh) != 1)
-                                {
-                                pass_status = 0;
-                                }
-                        }
+static int fstWriterBatchReserve(struct fstWriterContext *xc, uint32_t count, const fstHandle *handles)
+{
+uint64_t need;
+uint32_t i;
 
-                free(lz4_ucmem2);
-                free(lz4_ucmem);
-                free(lz4_cmem);
-                }
-        else
-        if(htyp == FST_BL_HIER_LZ4)
-                {
-                unsigned char *lz4_cmem  = (unsigned char *)malloc(clen);
-                unsigned char *lz4_ucmem = (unsigned char *)malloc(uclen);
+if(FST_UNLIKELY(!xc->valpos_mem))
+        {
+        xc->vc_emitted = 1;
+        fstWriterCreateMmaps(xc);
+        }
 
-                fstFread(lz4_cmem, clen, 1, xc->f);
-                pass_status = (uclen == LZ4_decompress_safe_partial ((char *)lz4_cmem, (char *)lz4_ucmem, clen, uclen, uclen));
+#ifdef FST_REMOVE_DUPLICATE_VC
+return(0); /* glitch removal compares against curval_mem change by change */
+#endif
+if(FST_UNLIKELY(xc->is_initial_time)) return(0);
+if(xc->buffer_layout == FST_WR_BL_SEGMENTED) return(1); /* segments make their own room */
 
-                if(fstFwrite(lz4_ucmem, uclen, 1, xc->fh) != 1)
-                        {
-                        pass_status = 0;
-                        }
+need = (uint64_t)count * (4 + 5 + xc->max_value_len) + 10; /* next_offs, time delta varint, value */
+if(FST_LIKELY((xc->vchg_siz + need) <= xc->vchg_alloc_siz)) return(1);
 
-                free(lz4_ucmem);
-                free(lz4_cmem);
-                }
-        else /* FST_BL_SKIP */
+need = 10;
+for(i=0;i<count;i++)
+        {
+        fstHandle h = handles[i] - 1; /* handle 0 wraps around and fails the bounds check */
+
+        if(FST_LIKELY(h < xc->maxhandle))
                 {
-                pass_status = 0;
-                if(xc->fh)
-                        {
-                        fclose(xc->fh); xc->fh = NULL; /* needed in case .hier file is missing and there are no hier sections */
-                        }
+                need += 4 + 5 + xc->valpos_mem[4*h+1];
                 }
+        }
+
+if((xc->vchg_siz + need) > xc->vchg_alloc_siz)
+        {
+        uint64_t alloc = (uint64_t)xc->vchg_alloc_siz + xc->fst_break_add_size + need;
 
-        free(mem);
-        free(fnam);
+        if(alloc > 0xffffffffUL) return(0); /* the grown buffer would not fit vchg_alloc_siz */
 
-        fstReaderFseeko(xc, xc->f, offs_cache, SEEK_SET);
-        
-        /* MSVC fix: Ensure recreated hier file is ready for reading */
-        if(pass_status && xc->fh)
+        xc->vchg_alloc_siz = alloc;
+        xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+        if(FST_UNLIKELY(!xc->vchg_mem))
                 {
-                fflush(xc->fh);
-                fstReaderFseeko(xc, xc->fh, 0, SEEK_SET);
-                clearerr(xc->fh);
+                fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeBatch, exiting.\n");
+                exit(255);
                 }
         }
 
-#ifdef DEBUG_HIERARCHY
-fprintf(stderr, "DEBUG: fstReaderRecreateHierFile returning %d, xc->fh=%p\n", pass_status, xc ? xc->fh : NULL);
-#endif
-return(pass_status);
+return(1);
 }
 
 
-int fstReaderIterateHierRewind(void *ctx)
+static inline void fstWriterBatchPrefetch(struct fstWriterContext *xc, uint32_t count, const fstHandle *handles, uint32_t i)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-int pass_status = 0;
-
-if(xc)
+if(i + FST_WRITER_BATCH_PREFETCH < count)
         {
-        pass_status = 1;
-        if(!xc->fh)
-                {
-                pass_status = fstReaderRecreateHierFile(xc);
-                }
-
-        xc->do_rewind = 1;
+        fstHandle h = handles[i + FST_WRITER_BATCH_PREFETCH] - 1;
+        if(h < xc->maxhandle) FST_PREFETCH_W(&xc->valpos_mem[4*h]);
         }
-
-return(pass_status);
 }
 
 
-struct fstHier *fstReaderIterateHier(void *ctx)
+/*
+ * count value changes at the current time, vals[i] being what
+ * fstWriterEmitValueChange() takes for handles[i]
+ */
+void fstWriterEmitValueChangeBatch(void *ctx, uint32_t count, const fstHandle *handles, const void *const *vals)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-int isfeof;
-fstHandle alias;
-char *pnt;
-int ch;
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+uint32_t i;
 
-if(!xc) return(NULL);
+if(FST_UNLIKELY((!xc) || (!count))) return;
 
-if(!xc->fh)
+if(FST_UNLIKELY(!fstWriterBatchReserve(xc, count, handles)))
         {
-        if(!fstReaderRecreateHierFile(xc))
+        for(i=0;i<count;i++)
                 {
-                return(NULL);
+                fstWriterEmitValueChange(xc, handles[i], vals[i]);
                 }
+        return;
         }
 
-if(xc->do_rewind)
+for(i=0;i<count;i++)
         {
-        xc->do_rewind = 0;
-        xc->current_handle = 0;
-        fstReaderFseeko(xc, xc->fh, 0, SEEK_SET);
-        clearerr(xc->fh);
-        }
+        fstHandle h = handles[i] - 1;
+        uint32_t *vm4ip;
 
-if(!(isfeof=feof(xc->fh)))
-        {
-        int tag = fgetc(xc->fh);
-	int cl;
-        switch(tag)
-                {
-                case FST_ST_VCD_SCOPE:
-                        xc->hier.htyp = FST_HT_SCOPE;
-                        xc->hier.u.scope.typ = fgetc(xc->fh);
-                        xc->hier.u.scope.name = pnt = xc->str_scope_nam;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* scopename */
-                        pnt[cl] = 0;
-                        xc->hier.u.scope.name_length = cl;
+        fstWriterBatchPrefetch(xc, count, handles, i);
+        if(FST_UNLIKELY(h >= xc->maxhandle)) continue;
 
-                        xc->hier.u.scope.component = pnt = xc->str_scope_comp;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* scopecomp */
-                        pnt[cl] = 0;
-                        xc->hier.u.scope.component_length = cl;
-                        break;
+        vm4ip = &(xc->valpos_mem[4*h]);
+        if(FST_LIKELY(vm4ip[1])) /* len of zero = variable length, use fstWriterEmitVariableLengthValueChange */
+                {
+                fstWriterAppendChars(xc, vm4ip, (const unsigned char *)vals[i]);
+                }
+        }
+}
 
-                case FST_ST_VCD_UPSCOPE:
-                        xc->hier.htyp = FST_HT_UPSCOPE;
-                        break;
 
-                case FST_ST_GEN_ATTRBEGIN:
-                        xc->hier.htyp = FST_HT_ATTRBEGIN;
-                        xc->hier.u.attr.typ = fgetc(xc->fh);
-                        xc->hier.u.attr.subtype = fgetc(xc->fh);
-			if(!xc->str_scope_attr)
-				{
-				xc->str_scope_attr = (char *)calloc(1, FST_ID_NAM_ATTR_SIZ+1);
-				}
-                        xc->hier.u.attr.name = pnt = xc->str_scope_attr;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_ATTR_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* attrname */
-			pnt[cl] = 0;
-                        xc->hier.u.attr.name_length = cl;
+/*
+ * count two-state value changes at the current time given as packed bits,
+ * which go into the change buffer packed as they are.  each handle takes one
+ * word per started 64 bits of its width from vals, least significant word
+ * first as for fstWriterEmitValueChangeVec64().  the handles have to be valid
+ * as their widths place the values: emitting stops at one that is not.
+ */
+void fstWriterEmitValueChangeBatchPacked(void *ctx, uint32_t count, const fstHandle *handles, const uint64_t *vals)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+uint32_t i;
+int batched;
 
-                        xc->hier.u.attr.arg = fstReaderVarint64(xc->fh);
+if(FST_UNLIKELY((!xc) || (!count))) return;
 
-                        if(xc->hier.u.attr.typ == FST_AT_MISC)
-                                {
-                                if((xc->hier.u.attr.subtype == FST_MT_SOURCESTEM)||(xc->hier.u.attr.subtype == FST_MT_SOURCEISTEM))
-                                        {
-                                        int sidx_skiplen_dummy = 0;
-                                        xc->hier.u.attr.arg_from_name = fstGetVarint64((unsigned char *)xc->str_scope_attr, &sidx_skiplen_dummy);
-                                        }
-                                }
-                        break;
+batched = fstWriterBatchReserve(xc, count, handles);
 
-                case FST_ST_GEN_ATTREND:
-                        xc->hier.htyp = FST_HT_ATTREND;
-                        break;
+for(i=0;i<count;i++)
+        {
+        fstHandle h = handles[i] - 1;
+        uint32_t *vm4ip;
+        uint32_t len;
 
-                case FST_VT_VCD_EVENT:
-                case FST_VT_VCD_INTEGER:
-                case FST_VT_VCD_PARAMETER:
-                case FST_VT_VCD_REAL:
-                case FST_VT_VCD_REAL_PARAMETER:
-                case FST_VT_VCD_REG:
-                case FST_VT_VCD_SUPPLY0:
-                case FST_VT_VCD_SUPPLY1:
-                case FST_VT_VCD_TIME:
-                case FST_VT_VCD_TRI:
-                case FST_VT_VCD_TRIAND:
-                case FST_VT_VCD_TRIOR:
-                case FST_VT_VCD_TRIREG:
-                case FST_VT_VCD_TRI0:
-                case FST_VT_VCD_TRI1:
-                case FST_VT_VCD_WAND:
-                case FST_VT_VCD_WIRE:
-                case FST_VT_VCD_WOR:
-                case FST_VT_VCD_PORT:
-                case FST_VT_VCD_SPARRAY:
-                case FST_VT_VCD_REALTIME:
-                case FST_VT_GEN_STRING:
-                case FST_VT_SV_BIT:
-                case FST_VT_SV_LOGIC:
-                case FST_VT_SV_INT:
-                case FST_VT_SV_SHORTINT:
-                case FST_VT_SV_LONGINT:
-                case FST_VT_SV_BYTE:
-                case FST_VT_SV_ENUM:
-                case FST_VT_SV_SHORTREAL:
-                        xc->hier.htyp = FST_HT_VAR;
-                        xc->hier.u.var.svt_workspace = FST_SVT_NONE;
-                        xc->hier.u.var.sdt_workspace = FST_SDT_NONE;
-                        xc->hier.u.var.sxt_workspace = 0;
-                        xc->hier.u.var.typ = tag;
-                        xc->hier.u.var.direction = fgetc(xc->fh);
-                        xc->hier.u.var.name = pnt = xc->str_scope_nam;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* varname */
-                        pnt[cl] = 0;
-                        xc->hier.u.var.name_length = cl;
-                        xc->hier.u.var.length = fstReaderVarint32(xc->fh);
-                        if(tag == FST_VT_VCD_PORT)
-                                {
-                                xc->hier.u.var.length -= 2; /* removal of delimiting spaces */
-                                xc->hier.u.var.length /= 3; /* port -> signal size adjust */
-                                }
+        if(batched) fstWriterBatchPrefetch(xc, count, handles, i);
+        if(FST_UNLIKELY(h >= xc->maxhandle)) break;
 
-                        alias = fstReaderVarint32(xc->fh);
+        vm4ip = &(xc->valpos_mem[4*h]);
+        len = vm4ip[1];
+        if(FST_UNLIKELY(!len)) continue;
 
-                        if(!alias)
-                                {
-                                xc->current_handle++;
-                                xc->hier.u.var.handle = xc->current_handle;
-                                xc->hier.u.var.is_alias = 0;
-                                }
-                                else
+        if(FST_LIKELY(batched))
+                {
+                fstWriterAppendPacked(xc, vm4ip, vals);
+                }
+                else
+                {
+                if(FST_UNLIKELY(len > xc->outval_alloc_siz))
+                        {
+                        xc->outval_alloc_siz = len*2 + 1;
+                        xc->outval_mem = (unsigned char *)realloc(xc->outval_mem, xc->outval_alloc_siz);
+                        if(FST_UNLIKELY(!xc->outval_mem))
                                 {
-                                xc->hier.u.var.handle = alias;
-                                xc->hier.u.var.is_alias = 1;
+                                fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitValueChangeBatchPacked, exiting.\n");
+                                exit(255);
                                 }
-
-                        break;
-
-                default:
-                        isfeof = 1;
-                        break;
+                        }
+                fstWriterExpandPacked(xc->outval_mem, len, vals);
+                fstWriterEmitValueChange(xc, h + 1, xc->outval_mem);
                 }
-        }
 
-return(!isfeof ? &xc->hier : NULL);
+        vals += (len + 63) / 64;
+        }
 }
 
 
-int fstReaderProcessHier(void *ctx, FILE *fv)
+void fstWriterEmitVariableLengthValueChange(void *ctx, fstHandle handle, const void *val, uint32_t len)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-char *str;
-char *pnt;
-int ch, scopetype;
-int vartype;
-uint32_t len, alias;
-/* uint32_t maxvalpos=0; */
-unsigned int num_signal_dyn = 65536;
-int attrtype, subtype;
-uint64_t attrarg;
-fstHandle maxhandle_scanbuild;
-int cl;
-
-if(!xc) return(0);
-
-xc->longest_signal_value_len = 32; /* arbitrarily set at 32...this is much longer than an expanded double */
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+const unsigned char *buf = (const unsigned char *)val;
 
-if(!xc->fh)
+if(FST_LIKELY((xc) && (handle <= xc->maxhandle)))
         {
-        if(!fstReaderRecreateHierFile(xc))
+        uint32_t fpos;
+        uint32_t *vm4ip;
+
+        if(FST_UNLIKELY(!xc->valpos_mem))
                 {
-                return(0);
+                xc->vc_emitted = 1;
+                fstWriterCreateMmaps(xc);
                 }
-        }
-
-str = (char *)malloc(FST_ID_NAM_ATTR_SIZ+1);
-
-if(fv)
-        {
-        char time_dimension[2] = {0, 0};
-        int time_scale = 1;
 
-        fprintf(fv, "$date\n\t%s\n$end\n", xc->date);
-        fprintf(fv, "$version\n\t%s\n$end\n", xc->version);
-        if(xc->timezero) fprintf(fv, "$timezero\n\t%" PRId64 "\n$end\n", xc->timezero);
+        handle--; /* move starting at 1 index to starting at 0 */
+        vm4ip = &(xc->valpos_mem[4*handle]);
 
-        switch(xc->timescale)
+        /* there is no initial time dump for variable length value changes */
+        if(FST_LIKELY(!vm4ip[1])) /* len of zero = variable length */
                 {
-                case  2:        time_scale = 100;               time_dimension[0] = 0;   break;
-                case  1:        time_scale = 10; /* fallthrough */
-                case  0:                                        time_dimension[0] = 0;   break;
-
-                case -1:        time_scale = 100;               time_dimension[0] = 'm'; break;
-                case -2:        time_scale = 10; /* fallthrough */
-                case -3:                                        time_dimension[0] = 'm'; break;
-
-                case -4:        time_scale = 100;               time_dimension[0] = 'u'; break;
-                case -5:        time_scale = 10; /* fallthrough */
-                case -6:                                        time_dimension[0] = 'u'; break;
-
-                case -10:       time_scale = 100;               time_dimension[0] = 'p'; break;
-                case -11:       time_scale = 10; /* fallthrough */
-                case -12:                                       time_dimension[0] = 'p'; break;
-
-                case -13:       time_scale = 100;               time_dimension[0] = 'f'; break;
-                case -14:       time_scale = 10; /* fallthrough */
-                case -15:                                       time_dimension[0] = 'f'; break;
-
-                case -16:       time_scale = 100;               time_dimension[0] = 'a'; break;
-                case -17:       time_scale = 10; /* fallthrough */
-                case -18:                                       time_dimension[0] = 'a'; break;
+                fpos = xc->vchg_siz;
 
-                case -19:       time_scale = 100;               time_dimension[0] = 'z'; break;
-                case -20:       time_scale = 10; /* fallthrough */
-                case -21:                                       time_dimension[0] = 'z'; break;
+                if(FST_UNLIKELY((fpos + len + 10 + 5) > xc->vchg_alloc_siz))
+                        {
+                        xc->vchg_alloc_siz += (xc->fst_break_add_size + len + 5); /* +len added in the case of extremely long vectors and small break add sizes */
+                        xc->vchg_mem = (unsigned char *)realloc(xc->vchg_mem, xc->vchg_alloc_siz);
+                        if(FST_UNLIKELY(!xc->vchg_mem))
+                                {
+                                fprintf(stderr, FST_APIMESS "Could not realloc() in fstWriterEmitVariableLengthValueChange, exiting.\n");
+                                exit(255);
+                                }
+                        }
 
-                case -7:        time_scale = 100;               time_dimension[0] = 'n'; break;
-                case -8:        time_scale = 10; /* fallthrough */
-                case -9:
-                default:                                        time_dimension[0] = 'n'; break;
+                fstWriterAppendVariableLength(xc, vm4ip, buf, len);
                 }
-
-        if(fv) fprintf(fv, "$timescale\n\t%d%ss\n$end\n", time_scale, time_dimension);
         }
+}
 
-xc->maxhandle = 0;
-xc->num_alias = 0;
-
-free(xc->signal_lens);
-xc->signal_lens = (uint32_t *)malloc(num_signal_dyn*sizeof(uint32_t));
-
-free(xc->signal_typs);
-xc->signal_typs = (unsigned char *)malloc(num_signal_dyn*sizeof(unsigned char));
 
-fstReaderFseeko(xc, xc->fh, 0, SEEK_SET);
-while(!feof(xc->fh))
+void fstWriterEmitTimeChange(void *ctx, uint64_t tim)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
+unsigned int i;
+int skip = 0;
+if(xc)
         {
-        int tag = fgetc(xc->fh);
-        switch(tag)
+        if(FST_UNLIKELY(xc->is_initial_time))
                 {
-                case FST_ST_VCD_SCOPE:
-                        scopetype = fgetc(xc->fh);
-                        if((scopetype < FST_ST_MIN) || (scopetype > FST_ST_MAX)) scopetype = FST_ST_VCD_MODULE;
-                        pnt = str;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_ATTR_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* scopename */
-                        pnt[cl] = 0;
-                        while(fgetc(xc->fh)) { }; /* scopecomp */
+                if(xc->size_limit_locked)       /* this resets xc->is_initial_time to one */
+                        {
+                        return;
+                        }
 
-                        if(fv) fprintf(fv, "$scope %s %s $end\n", modtypes[scopetype], str);
-                        break;
-
-                case FST_ST_VCD_UPSCOPE:
-                        if(fv) fprintf(fv, "$upscope $end\n");
-                        break;
+                if(!xc->valpos_mem)
+                        {
+                        fstWriterCreateMmaps(xc);
+                        }
 
-                case FST_ST_GEN_ATTRBEGIN:
-                        attrtype = fgetc(xc->fh);
-                        subtype = fgetc(xc->fh);
-                        pnt = str;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_ATTR_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* attrname */
-                        pnt[cl] = 0;
+                skip = 1;
 
-                        if(!str[0]) { strcpy(str, "\"\""); }
+                xc->firsttime = (xc->vc_emitted) ? 0: tim;
+                xc->curtime = 0;
+                xc->vchg_mem[0] = '!';
+                xc->vchg_siz = 1;
+                xc->vchg_grow = 0;
+                fstWriterResetSegments(xc);
+                fstWriterEmitSectionHeader(xc);
+                for(i=0;i<xc->maxhandle;i++)
+                        {
+                        xc->valpos_mem[4*i+2] = 0; /* zero out offset val */
+                        xc->valpos_mem[4*i+3] = 0; /* zero out last time change val */
+                        }
+                xc->is_initial_time = 0;
+                }
+                else
+                {
+                /* time deltas are taken from tchn_idx, so a section ends before they overflow 32 bits once shifted */
+                if((xc->vchg_siz >= xc->fst_break_size) || (xc->flush_context_pending) || (xc->tchn_idx >= FST_VCHG_TIME_DELTA_MAX))
+                        {
+                        xc->flush_context_pending = 0;
+                        fstWriterFlushContextPrivate(xc);
+                        xc->tchn_cnt++;
+                        fstWriterVarint(xc->tchn_handle, xc->curtime);
+                        }
+                }
 
-                        attrarg = fstReaderVarint64(xc->fh);
+        if(!skip)
+                {
+                xc->tchn_idx++;
+                }
+        fstWriterVarint(xc->tchn_handle, tim - xc->curtime);
+        xc->tchn_cnt++;
+        xc->curtime = tim;
+        }
+}
 
-                        if(fv && xc->use_vcd_extensions)
-                                {
-                                switch(attrtype)
-                                        {
-                                        case FST_AT_ARRAY:      if((subtype < FST_AR_NONE) || (subtype > FST_AR_MAX)) subtype = FST_AR_NONE;
-                                                                fprintf(fv, "$attrbegin %s %s %s %" PRId64 " $end\n", attrtypes[attrtype], arraytypes[subtype], str, attrarg);
-                                                                break;
-                                        case FST_AT_ENUM:       if((subtype < FST_EV_SV_INTEGER) || (subtype > FST_EV_MAX)) subtype = FST_EV_SV_INTEGER;
-                                                                fprintf(fv, "$attrbegin %s %s %s %" PRId64 " $end\n", attrtypes[attrtype], enumvaluetypes[subtype], str, attrarg);
-                                                                break;
-                                        case FST_AT_PACK:       if((subtype < FST_PT_NONE) || (subtype > FST_PT_MAX)) subtype = FST_PT_NONE;
-                                                                fprintf(fv, "$attrbegin %s %s %s %" PRId64 " $end\n", attrtypes[attrtype], packtypes[subtype], str, attrarg);
-                                                                break;
-                                        case FST_AT_MISC:
-                                        default:                attrtype = FST_AT_MISC;
-                                                                if(subtype == FST_MT_COMMENT)
-                                                                        {
-                                                                        fprintf(fv, "$comment\n\t%s\n$end\n", str);
-                                                                        }
-                                                                        else
-                                                                        {
-                                                                        if((subtype == FST_MT_SOURCESTEM)||(subtype == FST_MT_SOURCEISTEM))
-                                                                                {
-                                                                                int sidx_skiplen_dummy = 0;
-                                                                                uint64_t sidx = fstGetVarint64((unsigned char *)str, &sidx_skiplen_dummy);
 
-                                                                                fprintf(fv, "$attrbegin %s %02x %" PRId64 " %" PRId64 " $end\n", attrtypes[attrtype], subtype, sidx, attrarg);
-                                                                                }
-                                                                                else
-                                                                                {
-                                                                                fprintf(fv, "$attrbegin %s %02x %s %" PRId64 " $end\n", attrtypes[attrtype], subtype, str, attrarg);
-                                                                                }
-                                                                        }
-                                                                break;
-                                        }
-                                }
-                        break;
+void fstWriterEmitDumpActive(void *ctx, int enable)
+{
+struct fstWriterContext *xc = (struct fstWriterContext *)ctx;
 
-                case FST_ST_GEN_ATTREND:
-                        if(fv && xc->use_vcd_extensions) fprintf(fv, "$attrend $end\n");
-                        break;
+if(xc)
+        {
+        struct fstBlackoutChain *b = (struct fstBlackoutChain *)calloc(1, sizeof(struct fstBlackoutChain));
 
-                case FST_VT_VCD_EVENT:
-                case FST_VT_VCD_INTEGER:
-                case FST_VT_VCD_PARAMETER:
-                case FST_VT_VCD_REAL:
-                case FST_VT_VCD_REAL_PARAMETER:
-                case FST_VT_VCD_REG:
-                case FST_VT_VCD_SUPPLY0:
-                case FST_VT_VCD_SUPPLY1:
-                case FST_VT_VCD_TIME:
-                case FST_VT_VCD_TRI:
-                case FST_VT_VCD_TRIAND:
-                case FST_VT_VCD_TRIOR:
-                case FST_VT_VCD_TRIREG:
-                case FST_VT_VCD_TRI0:
-                case FST_VT_VCD_TRI1:
-                case FST_VT_VCD_WAND:
-                case FST_VT_VCD_WIRE:
-                case FST_VT_VCD_WOR:
-                case FST_VT_VCD_PORT:
-                case FST_VT_VCD_SPARRAY:
-                case FST_VT_VCD_REALTIME:
-                case FST_VT_GEN_STRING:
-                case FST_VT_SV_BIT:
-                case FST_VT_SV_LOGIC:
-                case FST_VT_SV_INT:
-                case FST_VT_SV_SHORTINT:
-                case FST_VT_SV_LONGINT:
-                case FST_VT_SV_BYTE:
-                case FST_VT_SV_ENUM:
-                case FST_VT_SV_SHORTREAL:
-                        vartype = tag;
-                        /* vardir = */ fgetc(xc->fh); /* unused in VCD reader, but need to advance read pointer */
-                        pnt = str;
-			cl = 0;
-                        while((ch = fgetc(xc->fh)))
-                                {
-				if(cl < FST_ID_NAM_ATTR_SIZ)
-					{
-					pnt[cl++] = ch;
-					}
-                                }; /* varname */
-                        pnt[cl] = 0;
-                        len = fstReaderVarint32(xc->fh);
-                        alias = fstReaderVarint32(xc->fh);
+        b->tim = xc->curtime;
+        b->active = (enable != 0);
 
-                        if(!alias)
-                                {
-                                if(xc->maxhandle == num_signal_dyn)
-                                        {
-                                        num_signal_dyn *= 2;
-                                        xc->signal_lens = (uint32_t *)realloc(xc->signal_lens, num_signal_dyn*sizeof(uint32_t));
-                                        xc->signal_typs = (unsigned char *)realloc(xc->signal_typs, num_signal_dyn*sizeof(unsigned char));
-                                        }
-                                xc->signal_lens[xc->maxhandle] = len;
-                                xc->signal_typs[xc->maxhandle] = vartype;
+        xc->num_blackouts++;
+        if(xc->blackout_curr)
+                {
+                xc->blackout_curr->next = b;
+                xc->blackout_curr = b;
+                }
+                else
+                {
+                xc->blackout_head = b;
+                xc->blackout_curr = b;
+                }
+        }
+}
 
-                                /* maxvalpos+=len; */
-                                if(len > xc->longest_signal_value_len)
-                                        {
-                                        xc->longest_signal_value_len = len;
-                                        }
 
-                                if((vartype == FST_VT_VCD_REAL) || (vartype == FST_VT_VCD_REAL_PARAMETER) || (vartype == FST_VT_VCD_REALTIME) || (vartype == FST_VT_SV_SHORTREAL))
-                                        {
-                                        len = (vartype != FST_VT_SV_SHORTREAL) ? 64 : 32;
-                                        xc->signal_typs[xc->maxhandle] = FST_VT_VCD_REAL;
-                                        }
-                                if(fv)
-                                        {
-                                        char vcdid_buf[16];
-                                        uint32_t modlen = (vartype != FST_VT_VCD_PORT) ? len : ((len - 2) / 3);
-                                        fstVcdID(vcdid_buf, xc->maxhandle+1);
-                                        fprintf(fv, "$var %s %" PRIu32 " %s %s $end\n", vartypes[vartype], modlen, vcdid_buf, str);
-                                        }
-                                xc->maxhandle++;
-                                }
-                                else
-                                {
-                                if((vartype == FST_VT_VCD_REAL) || (vartype == FST_VT_VCD_REAL_PARAMETER) || (vartype == FST_VT_VCD_REALTIME) || (vartype == FST_VT_SV_SHORTREAL))
-                                        {
-                                        len = (vartype != FST_VT_SV_SHORTREAL) ? 64 : 32;
-                                        xc->signal_typs[xc->maxhandle] = FST_VT_VCD_REAL;
-                                        }
-                                if(fv)
-                                        {
-                                        char vcdid_buf[16];
-                                        uint32_t modlen = (vartype != FST_VT_VCD_PORT) ? len : ((len - 2) / 3);
-                                        fstVcdID(vcdid_buf, alias);
-                                        fprintf(fv, "$var %s %" PRIu32 " %s %s $end\n", vartypes[vartype], modlen, vcdid_buf, str);
-                                        }
-                                xc->num_alias++;
-                                }
+/***********************/
+/***                 ***/
+/*** reader function ***/
+/***                 ***/
+/***********************/
 
-                        break;
+/*
+ * private structs
+ */
+static const char *vartypes[] = {
+        "event", "integer", "parameter", "real", "real_parameter",
+        "reg", "supply0", "supply1", "time", "tri",
+        "triand", "trior", "trireg", "tri0", "tri1",
+        "wand", "wire", "wor", "port", "sparray", "realtime",
+        "string",
+        "bit", "logic", "int", "shortint", "longint", "byte", "enum", "shortreal"
+        };
 
-                default:
-                        break;
-                }
-        }
-if(fv) fprintf(fv, "$enddefinitions $end\n");
+static const char *modtypes[] = {
+        "module", "task", "function", "begin", "fork", "generate", "struct", "union", "class", "interface", "package", "program",
+        "vhdl_architecture", "vhdl_procedure", "vhdl_function", "vhdl_record", "vhdl_process", "vhdl_block", "vhdl_for_generate", "vhdl_if_generate", "vhdl_generate", "vhdl_package"
+        };
 
-maxhandle_scanbuild = xc->maxhandle ? xc->maxhandle : 1; /*scan-build warning suppression, in reality we have at least one signal */
+static const char *attrtypes[] = {
+        "misc", "array", "enum", "class"
+        };
 
-xc->signal_lens = (uint32_t *)realloc(xc->signal_lens, maxhandle_scanbuild*sizeof(uint32_t));
-xc->signal_typs = (unsigned char *)realloc(xc->signal_typs, maxhandle_scanbuild*sizeof(unsigned char));
+static const char *arraytypes[] = {
+        "none", "unpacked", "packed", "sparse"
+        };
 
-free(xc->process_mask);
-xc->process_mask = (unsigned char *)calloc(1, (maxhandle_scanbuild+7)/8);
+static const char *enumvaluetypes[] = {
+        "integer", "bit", "logic", "int", "shortint", "longint", "byte",
+        "unsigned_integer", "unsigned_bit", "unsigned_logic", "unsigned_int", "unsigned_shortint", "unsigned_longint", "unsigned_byte"
+        };
 
-free(xc->temp_signal_value_buf);
-xc->temp_signal_value_buf = (unsigned char *)malloc(xc->longest_signal_value_len + 1);
+static const char *packtypes[] = {
+        "none", "unpacked", "packed", "tagged_packed"
+        };
 
-xc->var_count = xc->maxhandle + xc->num_alias;
 
-free(str);
-return(1);
-}
+struct fstCurrHier
+{
+struct fstCurrHier *prev;
+void *user_info;
+int len;
+};
 
 
-/*
- * reader file open/close functions
- */
-int fstReaderInit(struct fstReaderContext *xc)
+struct fstBlockIndexEntry
 {
-fst_off_t blkpos = 0;
-fst_off_t endfile;
+fst_off_t pos;                          /* offset of the section type byte */
 uint64_t seclen;
+uint64_t beg_tim, end_tim;
+uint64_t mem_required;
+uint64_t tsec_uclen, tsec_clen, tsec_nitems;
+uint64_t chain_clen;
 int sectype;
-uint64_t vc_section_count_actual = 0;
-int hdr_incomplete = 0;
-int hdr_seen = 0;
-int gzread_pass_status = 1;
+};
 
-sectype = fgetc(xc->f);
-if(sectype == FST_BL_ZWRAPPER)
-        {
-        FILE *fcomp;
-        fst_off_t offpnt, uclen;
-        char gz_membuf[FST_GZIO_LEN];
-        gzFile zhandle;
-        int zfd;
-        int flen = strlen(xc->filename);
-        char *hf;
-	int hf_len;
 
-        seclen = fstReaderUint64(xc->f);
-        uclen = fstReaderUint64(xc->f);
-
-        if(!seclen) return(0); /* not finished compressing, this is a failed read */
+/*
+ * one decoded value change block for fstReaderGetValueFromHandleAtTime().
+ * several are kept so a cursor moving between a few regions of a trace
+ * does not reload a block on every jump.
+ */
+#ifndef FST_RVAT_CACHE_BLOCKS
+#define FST_RVAT_CACHE_BLOCKS (8)
+#endif
 
-	hf_len = flen + 16 + 32 + 1;
-        hf = (char *)calloc(1, hf_len);
+struct fstRvatBlock
+{
+uint64_t blk_num;
+uint64_t last_used;                     /* 0 marks a free slot */
+uint64_t *time_table;
+uint64_t beg_tim, end_tim;
+unsigned char *frame_data;
+uint64_t frame_maxhandle;
+fst_off_t *chain_table;
+uint32_t *chain_table_lengths;
+uint64_t vc_maxhandle;
+fst_off_t vc_start;
+int packtype;
 
-        snprintf(hf, hf_len, "%s.upk_%d_%p", xc->filename, getpid(), (void *)xc);
-        fcomp = fopen(hf, "w+b");
-        if(!fcomp)
-                {
-                fcomp = tmpfile_open(&xc->f_nam);
-                free(hf); hf = NULL;
-                if(!fcomp) { tmpfile_close(&fcomp, &xc->f_nam); return(0); }
-                }
+uint32_t chain_len;                     /* inflated chain of chain_facidx */
+unsigned char *chain_mem;
+fstHandle chain_facidx;
 
-#if defined(FST_UNBUFFERED_IO)
-        setvbuf(fcomp, (char *)NULL, _IONBF, 0);   /* keeps gzip from acting weird in tandem with fopen */
-#endif
+uint32_t chain_pos_tidx;
+uint32_t chain_pos_idx;
+uint64_t chain_pos_time;
+unsigned chain_pos_valid : 1;
+};
 
-#ifdef __MINGW32__
-        xc->filename_unpacked = hf;
+/*
+ * metadata shared between a reader and its fstReaderClone() copies.  it is
+ * never written after the source context was opened; a context that needs
+ * its own copy (fstReaderProcessHier()) allocates a private one instead.
+ */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FST_ATOMIC_INC(p)               _InterlockedIncrement((volatile long *)(p))
+#define FST_ATOMIC_DEC(p)               _InterlockedDecrement((volatile long *)(p))
 #else
-        if(hf)
-                {
-                unlink(hf);
-                free(hf);
-                }
+#define FST_ATOMIC_INC(p)               __sync_add_and_fetch((p), 1)
+#define FST_ATOMIC_DEC(p)               __sync_sub_and_fetch((p), 1)
 #endif
 
-        fstReaderFseeko(xc, xc->f, FST_ZWRAPPER_HDR_SIZE, SEEK_SET);
-#ifndef __MINGW32__
-        fflush(xc->f);
-#else
-	/* Windows UCRT runtime library reads one byte ahead in the file
-	   even with buffering disabled and does not synchronise the
-	   file position after fseek. */
-	_lseek(fileno(xc->f), FST_ZWRAPPER_HDR_SIZE, SEEK_SET);
+struct fstReaderShared
+{
+long refcount;
+uint32_t *signal_lens;
+unsigned char *signal_typs;
+uint64_t *blackout_times;
+unsigned char *blackout_activity;
+struct fstBlockIndexEntry *blk_index;
+unsigned char *hier_mem;                /* only when the source had loaded it before the first clone */
+uint64_t hier_len;
+struct fstGzIndex *gz_index;
+#ifdef HAVE_LIBZSTD
+ZSTD_DDict *zstd_ddict;
 #endif
+};
 
-        zfd = dup(fileno(xc->f));
-        zhandle = gzdopen(zfd, "rb");
-        if(zhandle)
-                {
-                for(offpnt = 0; offpnt < uclen; offpnt += FST_GZIO_LEN)
-                        {
-                        size_t this_len = ((uclen - offpnt) > FST_GZIO_LEN) ? FST_GZIO_LEN : (uclen - offpnt);
-                        size_t gzreadlen = gzread(zhandle, gz_membuf, this_len);
-                        size_t fwlen;
-
-                        if(gzreadlen != this_len)
-                                {
-                                gzread_pass_status = 0;
-                                break;
-                                }
-                        fwlen = fstFwrite(gz_membuf, this_len, 1, fcomp);
-                        if(fwlen != 1)
-                                {
-                                gzread_pass_status = 0;
-                                break;
-                                }
-                        }
-                gzclose(zhandle);
-                }
-                else
-                {
-                close(zfd);
-                }
-        fflush(fcomp);
-        fclose(xc->f);
-        xc->f = fcomp;
-        }
 
-if(gzread_pass_status)
-        {
-        fstReaderFseeko(xc, xc->f, 0, SEEK_END);
-        endfile = ftello(xc->f);
+struct fstReaderContext
+{
+/* common entries */
 
-        while(blkpos < endfile)
-                {
-                fstReaderFseeko(xc, xc->f, blkpos, SEEK_SET);
+FILE *f;
 
-                sectype = fgetc(xc->f);
-                seclen = fstReaderUint64(xc->f);
+uint64_t start_time, end_time;
+uint64_t mem_used_by_writer;
+uint64_t scope_count;
+uint64_t var_count;
+fstHandle maxhandle;
+uint64_t num_alias;
+uint64_t vc_section_count;
 
-                if(sectype == EOF)
-                        {
-                        break;
-                        }
+uint32_t *signal_lens;                  /* maxhandle sized */
+unsigned char *signal_typs;             /* maxhandle sized */
+unsigned char *process_mask;            /* maxhandle-based, bitwise sized */
+uint32_t longest_signal_value_len;      /* longest len value encountered */
+unsigned char *temp_signal_value_buf;   /* malloced for len in longest_signal_value_len */
 
-                if((hdr_incomplete) && (!seclen))
-                        {
-                        break;
-                        }
+signed char timescale;
+unsigned char filetype;
 
-                if(!hdr_seen && (sectype != FST_BL_HDR))
-                        {
-                        break;
-                        }
+unsigned use_vcd_extensions : 1;
+unsigned double_endian_match : 1;
+unsigned native_doubles_for_cb : 1;
+unsigned contains_geom_section : 1;
+unsigned contains_hier_section : 1;        /* valid for hier_pos */
+unsigned contains_hier_section_lz4duo : 1; /* valid for hier_pos (contains_hier_section_lz4 always also set) */
+unsigned contains_hier_section_lz4 : 1;    /* valid for hier_pos */
+unsigned contains_hier_section_zstd : 1;   /* valid for hier_pos */
+unsigned limit_range_valid : 1;            /* valid for limit_range_start, limit_range_end */
 
-                blkpos++;
-                if(sectype == FST_BL_HDR)
-                        {
-                        if(!hdr_seen)
-                                {
-                                int ch;
-                                double dcheck;
+char version[FST_HDR_SIM_VERSION_SIZE + 1];
+char date[FST_HDR_DATE_SIZE + 1];
+int64_t timezero;
 
-                                xc->start_time = fstReaderUint64(xc->f);
-                                xc->end_time = fstReaderUint64(xc->f);
+char *filename, *filename_unpacked;
+fst_off_t hier_pos;
 
-                                hdr_incomplete = (xc->start_time == 0) && (xc->end_time == 0);
+uint32_t num_blackouts;
+uint64_t *blackout_times;
+unsigned char *blackout_activity;
 
-                                fstFread(&dcheck, 8, 1, xc->f);
-                                xc->double_endian_match = (dcheck == FST_DOUBLE_ENDTEST);
-                                if(!xc->double_endian_match)
-                                        {
-                                        union   {
-                                                unsigned char rvs_buf[8];
-                                                double d;
-                                                } vu;
+uint64_t limit_range_start, limit_range_end;
 
-                                        unsigned char *dcheck_alias = (unsigned char *)&dcheck;
-                                        int rvs_idx;
+/* entries specific to read value at time functions */
 
-                                        for(rvs_idx=0;rvs_idx<8;rvs_idx++)
-                                                {
-                                                vu.rvs_buf[rvs_idx] = dcheck_alias[7-rvs_idx];
-                                                }
-                                        if(vu.d != FST_DOUBLE_ENDTEST)
-                                                {
-                                                break; /* either corrupt file or wrong architecture (offset +33 also functions as matchword) */
-                                                }
-                                        }
+struct fstRvatBlock *rvat_blocks;       /* FST_RVAT_CACHE_BLOCKS slots, allocated on first lookup */
+uint64_t rvat_clock;
+uint32_t *rvat_sig_offs;
 
-                                hdr_seen = 1;
-
-                                xc->mem_used_by_writer = fstReaderUint64(xc->f);
-                                xc->scope_count = fstReaderUint64(xc->f);
-                                xc->var_count = fstReaderUint64(xc->f);
-                                xc->maxhandle = fstReaderUint64(xc->f);
-                                xc->num_alias = xc->var_count - xc->maxhandle;
-                                xc->vc_section_count = fstReaderUint64(xc->f);
-                                ch = fgetc(xc->f);
-                                xc->timescale = (signed char)ch;
-                                fstFread(xc->version, FST_HDR_SIM_VERSION_SIZE, 1, xc->f);
-                                xc->version[FST_HDR_SIM_VERSION_SIZE] = 0;
-                                fstFread(xc->date, FST_HDR_DATE_SIZE, 1, xc->f);
-                                xc->date[FST_HDR_DATE_SIZE] = 0;
-                                ch = fgetc(xc->f);
-                                xc->filetype = (unsigned char)ch;
-                                xc->timezero = fstReaderUint64(xc->f);
-                                }
-                        }
-                else if((sectype == FST_BL_VCDATA) || (sectype == FST_BL_VCDATA_DYN_ALIAS) || (sectype == FST_BL_VCDATA_DYN_ALIAS2))
-                        {
-                        if(hdr_incomplete)
-                                {
-                                uint64_t bt = fstReaderUint64(xc->f);
-                                xc->end_time = fstReaderUint64(xc->f);
+/* entries specific to hierarchy traversal */
 
-                                if(!vc_section_count_actual) { xc->start_time = bt; }
-                                }
+struct fstHier hier;
+struct fstCurrHier *curr_hier;
+fstHandle current_handle;
+char *curr_flat_hier_nam;
+int flat_hier_alloc_len;
+unsigned do_rewind : 1;
+unsigned char *hier_mem;                /* decompressed hierarchy section, see fstReaderLoadHier() */
+uint64_t hier_len, hier_ofs;
+char str_scope_nam[FST_ID_NAM_SIZ+1];
+char str_scope_comp[FST_ID_NAM_SIZ+1];
+char *str_scope_attr;
 
-                        vc_section_count_actual++;
-                        }
-                else if(sectype == FST_BL_GEOM)
-                        {
-                        if(!hdr_incomplete)
-                                {
-                                uint64_t clen = seclen - 24;
-                                uint64_t uclen = fstReaderUint64(xc->f);
-                                unsigned char *ucdata = (unsigned char *)malloc(uclen);
-                                unsigned char *pnt = ucdata;
-                                unsigned int i;
+unsigned fseek_failed : 1;
 
-                                xc->contains_geom_section = 1;
-                                xc->maxhandle = fstReaderUint64(xc->f);
-                                xc->longest_signal_value_len = 32; /* arbitrarily set at 32...this is much longer than an expanded double */
+/* read-only mapping of xc->f, used in place of stdio when present */
 
-                                free(xc->process_mask);
-                                xc->process_mask = (unsigned char *)calloc(1, (xc->maxhandle+7)/8);
+unsigned char *fmap;
+fst_off_t fmap_len;
+fst_off_t fmap_pos;
+unsigned is_zwrapped : 1;
+unsigned mmap_disabled : 1;             /* FST_RD_OPEN_NO_MMAP */
 
-                                if(clen != uclen)
-                                        {
-                                        unsigned char *cdata = (unsigned char *)malloc(clen);
-                                        unsigned long destlen = uclen;
-                                        unsigned long sourcelen = clen;
-                                        int rc;
+/* FST_BL_ZWRAPPER trace read in place through xc->f, see fstReaderGzFill() */
 
-                                        fstFread(cdata, clen, 1, xc->f);
-                                        rc = uncompress(ucdata, &destlen, cdata, sourcelen);
+struct fstGzIndex *gz_index;
+struct fstGzCursor *gz;
+unsigned gz_unpack : 1;                 /* FST_RD_OPEN_GZIP_UNPACK */
 
-                                        if(rc != Z_OK)
-                                                {
-                                                fprintf(stderr, FST_APIMESS "fstReaderInit(), geom uncompress rc = %d, exiting.\n", rc);
-                                                exit(255);
-                                                }
+/* value change section index built at open, see fstReaderIndexBlock() */
 
-                                        free(cdata);
-                                        }
-                                        else
-                                        {
-                                        fstFread(ucdata, uclen, 1, xc->f);
-                                        }
+struct fstBlockIndexEntry *blk_index;
+uint64_t blk_index_count, blk_index_alloc;
+fst_off_t geom_pos, blackout_pos;
+unsigned use_blk_index_sidecar : 1;     /* FST_RD_OPEN_BLOCK_INDEX */
 
-                                free(xc->signal_lens);
-                                xc->signal_lens = (uint32_t *)malloc(sizeof(uint32_t) * xc->maxhandle);
-                                free(xc->signal_typs);
-                                xc->signal_typs = (unsigned char *)malloc(sizeof(unsigned char) * xc->maxhandle);
+fst_off_t zstd_dict_pos;                /* FST_BL_ZSTD_DICT section, 0 when absent */
+#ifdef HAVE_LIBZSTD
+ZSTD_DDict *zstd_ddict;                 /* for 'S' chains written against the dictionary */
+#endif
+void *zstd_dctx;                        /* 'S' chains inflated on the caller's thread */
 
-                                for(i=0;i<xc->maxhandle;i++)
-                                        {
-                                        int skiplen;
-                                        uint64_t val = fstGetVarint32(pnt, &skiplen);
+int iterblocks_threads;                 /* fstReaderIterBlocksSetParallelMode(), 0 is serial */
 
-                                        pnt += skiplen;
+uint64_t *all_times;                    /* fstReaderGetTimeTable(), built on first use */
+uint64_t all_times_count;
 
-                                        if(val)
-                                                {
-                                                xc->signal_lens[i] = (val != 0xFFFFFFFF) ? val : 0;
-                                                xc->signal_typs[i] = FST_VT_VCD_WIRE;
-                                                if(xc->signal_lens[i] > xc->longest_signal_value_len)
-                                                        {
-                                                        xc->longest_signal_value_len = xc->signal_lens[i];
-                                                        }
-                                                }
-                                                else
-                                                {
-                                                xc->signal_lens[i] = 8; /* backpatch in real */
-                                                xc->signal_typs[i] = FST_VT_VCD_REAL;
-                                                /* xc->longest_signal_value_len handled above by overly large init size */
-                                                }
-                                        }
+struct fstBlockCacheEntry **blk_cache;  /* fstReaderSetBlockCacheSize(), indexed like blk_index */
+struct fstBlockCacheEntry *blk_cache_mru, *blk_cache_lru;
+uint64_t blk_cache_bytes, blk_cache_budget;
 
-                                free(xc->temp_signal_value_buf);
-                                xc->temp_signal_value_buf = (unsigned char *)malloc(xc->longest_signal_value_len + 1);
+struct fstReaderShared *shared;         /* set once fstReaderClone() was used on this context or its source */
 
-                                free(ucdata);
-                                }
-                        }
-                else if(sectype == FST_BL_HIER)
-                        {
-                        xc->contains_hier_section = 1;
-                        xc->hier_pos = ftello(xc->f);
-                        }
-                else if(sectype == FST_BL_HIER_LZ4DUO)
-                        {
-                        xc->contains_hier_section_lz4    = 1;
-                        xc->contains_hier_section_lz4duo = 1;
-                        xc->hier_pos = ftello(xc->f);
-                        }
-                else if(sectype == FST_BL_HIER_LZ4)
-                        {
-                        xc->contains_hier_section_lz4 = 1;
-                        xc->hier_pos = ftello(xc->f);
-                        }
-                else if(sectype == FST_BL_BLACKOUT)
-                        {
-                        uint32_t i;
-                        uint64_t cur_bl = 0;
-                        uint64_t delta;
+/* self-buffered I/O for writes */
 
-                        xc->num_blackouts = fstReaderVarint32(xc->f);
-                        free(xc->blackout_times);
-                        xc->blackout_times = (uint64_t *)calloc(xc->num_blackouts, sizeof(uint64_t));
-                        free(xc->blackout_activity);
-                        xc->blackout_activity = (unsigned char *)calloc(xc->num_blackouts, sizeof(unsigned char));
+#ifndef FST_WRITEX_DISABLE
+int writex_pos;
+int writex_fd;
+unsigned char writex_buf[FST_WRITEX_MAX];
+#endif
 
-                        for(i=0;i<xc->num_blackouts;i++)
-                                {
-                                xc->blackout_activity[i] = fgetc(xc->f) != 0;
-                                delta = fstReaderVarint64(xc->f);
-                                cur_bl += delta;
-                                xc->blackout_times[i] = cur_bl;
-                                }
-                        }
+char *f_nam;
+};
 
-                blkpos += seclen;
-                if(!hdr_seen) break;
-                }
 
-        if(hdr_seen)
-                {
-                if(xc->vc_section_count != vc_section_count_actual)
-                        {
-                        xc->vc_section_count = vc_section_count_actual;
-                        }
+/*
+ * frees one of the metadata arrays unless it is still the one held by
+ * xc->shared, which is released by fstReaderClose() instead.
+ */
+static void fstReaderFreeUnshared(struct fstReaderContext *xc, void *pnt)
+{
+struct fstReaderShared *sh = xc->shared;
 
-                if(!xc->contains_geom_section)
-                        {
-                        fstReaderProcessHier(xc, NULL); /* recreate signal_lens/signal_typs info */
-                        }
-                }
+if((sh) && (pnt) && ((pnt == sh->signal_lens) || (pnt == sh->signal_typs) || (pnt == sh->blackout_times) ||
+        (pnt == sh->blackout_activity) || (pnt == sh->blk_index) || (pnt == sh->hier_mem)))
+        {
+        return;
         }
 
-return(hdr_seen);
+free(pnt);
 }
 
 
-void *fstReaderOpenForUtilitiesOnly(void)
+int fstReaderFseeko(struct fstReaderContext *xc, FILE *stream, fst_off_t offset, int whence)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)calloc(1, sizeof(struct fstReaderContext));
+int rc = fseeko(stream, offset, whence);
 
-return(xc);
+if(rc<0)
+        {
+        xc->fseek_failed = 1;
+#ifdef FST_DEBUG
+        fprintf(stderr, FST_APIMESS "Seek to #%" PRId64 " (whence = %d) failed!\n", offset, whence);
+        perror("Why");
+#endif
+        }
+
+return(rc);
 }
 
 
-void *fstReaderOpen(const char *nam)
+/*
+ * FST_BL_ZWRAPPER traces are read in place instead of being unpacked to a
+ * temp file.  fstReaderGzBuildIndex() inflates the gzip stream once and
+ * records an access point about every FST_GZ_SPAN bytes of output: the
+ * position in the stream (down to the bit) and the 32KB of output before
+ * it, which primes a raw inflate there.  the index is never written after
+ * open, so clones share it and each inflates its own regions.
+ */
+struct fstGzPoint
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)calloc(1, sizeof(struct fstReaderContext));
-
-if((!nam)||(!(xc->f=fopen(nam, "rb"))))
-        {
-        free(xc);
-        xc=NULL;
-        }
-        else
-        {
-        int flen = strlen(nam);
-        char *hf = (char *)calloc(1, flen + 6);
-        int rc;
+uint64_t out;                           /* uncompressed offset */
+uint64_t in;                            /* offset of the first whole byte in the gzip stream */
+unsigned char *win;                     /* zlib-compressed output preceding out, NULL at out 0 */
+uint32_t win_clen;
+int bits;                               /* low bits of the byte before in still to be read, 0..7 */
+};
 
-#if defined(FST_UNBUFFERED_IO)
-        setvbuf(xc->f, (char *)NULL, _IONBF, 0);   /* keeps gzip from acting weird in tandem with fopen */
-#endif
 
-        memcpy(hf, nam, flen);
-        strcpy(hf + flen, ".hier");
-        xc->fh = fopen(hf, "rb");
+struct fstGzIndex
+{
+struct fstGzPoint *points;
+uint64_t count, alloc;
+uint64_t uclen;                         /* from the wrapper header */
+};
 
-        free(hf);
-        xc->filename = strdup(nam);
-        rc = fstReaderInit(xc);
 
-        if((rc) && (xc->vc_section_count) && (xc->maxhandle) && ((xc->fh)||(xc->contains_hier_section||(xc->contains_hier_section_lz4))))
+struct fstGzCursor
+{
+z_stream strm;                          /* raw inflate, positioned at next_out */
+unsigned strm_live : 1;
+uint64_t pos;                           /* fstReaderIoTell() */
+uint64_t next_out;
+uint64_t obuf_start;                    /* obuf holds [obuf_start, next_out), at least FST_GZ_HISTORY back when available */
+unsigned char obuf[FST_GZ_OBUF_LEN];
+unsigned char ibuf[FST_GZIO_LEN];
+unsigned char win[FST_GZ_WINSIZE];
+};
+
+
+static void fstGzIndexFree(struct fstGzIndex *idx)
+{
+if(idx)
+        {
+        uint64_t i;
+
+        for(i=0;i<idx->count;i++)
                 {
-                /* more init */
-                xc->do_rewind = 1;
+                free(idx->points[i].win);
+                }
+        free(idx->points);
+        free(idx);
+        }
+}
+
+
+static int fstReaderGzCursorInit(struct fstReaderContext *xc)
+{
+xc->gz = (struct fstGzCursor *)calloc(1, sizeof(struct fstGzCursor));
+if(!xc->gz) return(0);
+
+xc->gz->obuf_start = xc->gz->next_out = xc->gz_index->uclen; /* first access restarts at a point */
+return(1);
+}
+
+
+static void fstReaderGzClose(struct fstReaderContext *xc)
+{
+if(xc->gz)
+        {
+        if(xc->gz->strm_live)
+                {
+                inflateEnd(&xc->gz->strm);
+                }
+        free(xc->gz);
+        xc->gz = NULL;
+        }
+}
+
+
+/* restarts the inflate at the last access point at or before pos */
+static int fstReaderGzRestart(struct fstReaderContext *xc, uint64_t pos)
+{
+struct fstGzCursor *gz = xc->gz;
+struct fstGzIndex *idx = xc->gz_index;
+struct fstGzPoint *pt;
+uint64_t lo = 0, hi = idx->count;
+
+while(hi - lo > 1)
+        {
+        uint64_t mid = lo + ((hi - lo) >> 1);
+
+        if(idx->points[mid].out <= pos)
+                {
+                lo = mid;
                 }
                 else
                 {
-                fstReaderClose(xc);
-                xc = NULL;
+                hi = mid;
                 }
         }
+pt = idx->points + lo;
 
-return(xc);
+if(gz->strm_live)
+        {
+        inflateReset(&gz->strm);
+        }
+        else
+        {
+        memset(&gz->strm, 0, sizeof(z_stream));
+        if(inflateInit2(&gz->strm, -15) != Z_OK) return(0);
+        gz->strm_live = 1;
+        }
+
+gz->strm.avail_in = 0;
+gz->obuf_start = gz->next_out = idx->uclen; /* unusable until the restart completes */
+
+if(fstReaderFseeko(xc, xc->f, FST_ZWRAPPER_HDR_SIZE + pt->in - (pt->bits ? 1 : 0), SEEK_SET)) return(0);
+if(pt->bits)
+        {
+        int ch = fgetc(xc->f);
+
+        if(ch == EOF) return(0);
+        inflatePrime(&gz->strm, pt->bits, ch >> (8 - pt->bits));
+        }
+if(pt->win)
+        {
+        uLongf wlen = FST_GZ_WINSIZE;
+
+        if(uncompress(gz->win, &wlen, pt->win, pt->win_clen) != Z_OK) return(0);
+        inflateSetDictionary(&gz->strm, gz->win, wlen);
+        }
+
+gz->obuf_start = gz->next_out = pt->out;
+return(1);
 }
 
 
-static void fstReaderDeallocateRvatData(void *ctx)
+/* inflates up to len bytes at gz->next_out into dst, returns the count (0 at the end or on a bad stream) */
+static size_t fstReaderGzInflate(struct fstReaderContext *xc, unsigned char *dst, size_t len)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-if(xc)
+struct fstGzCursor *gz = xc->gz;
+int ret = Z_OK;
+
+if(len > (1UL << 30)) len = (1UL << 30);
+
+gz->strm.next_out = dst;
+gz->strm.avail_out = len;
+while((gz->strm.avail_out) && (ret == Z_OK))
         {
-        free(xc->rvat_chain_mem); xc->rvat_chain_mem = NULL;
-        free(xc->rvat_frame_data); xc->rvat_frame_data = NULL;
-        free(xc->rvat_time_table); xc->rvat_time_table = NULL;
-        free(xc->rvat_chain_table); xc->rvat_chain_table = NULL;
-        free(xc->rvat_chain_table_lengths); xc->rvat_chain_table_lengths = NULL;
+        if(!gz->strm.avail_in)
+                {
+                size_t rd = fread(gz->ibuf, 1, FST_GZIO_LEN, xc->f);
 
-        xc->rvat_data_valid = 0;
+                if(!rd) break;
+                gz->strm.next_in = gz->ibuf;
+                gz->strm.avail_in = rd;
+                }
+        ret = inflate(&gz->strm, Z_NO_FLUSH);
         }
+
+len -= gz->strm.avail_out;
+gz->next_out += len;
+return(len);
 }
 
 
-void fstReaderClose(void *ctx)
+/* makes obuf hold the byte at gz->pos, inflating forward or from an access point */
+static int fstReaderGzFill(struct fstReaderContext *xc)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstGzCursor *gz = xc->gz;
+uint64_t pos = gz->pos;
 
-if(xc)
+if(pos >= xc->gz_index->uclen) return(0);
+if((pos >= gz->obuf_start) && (pos < gz->next_out)) return(1);
+
+/* skipping ahead within a span is cheaper than priming at the next access point */
+if((!gz->strm_live) || (pos < gz->next_out) || (pos - gz->next_out >= FST_GZ_SPAN))
         {
-        fstReaderDeallocateScopeData(xc);
-        fstReaderDeallocateRvatData(xc);
-        free(xc->rvat_sig_offs); xc->rvat_sig_offs = NULL;
+        if(!fstReaderGzRestart(xc, pos)) return(0);
+        }
 
-        free(xc->process_mask); xc->process_mask = NULL;
-        free(xc->blackout_times); xc->blackout_times = NULL;
-        free(xc->blackout_activity); xc->blackout_activity = NULL;
-        free(xc->temp_signal_value_buf); xc->temp_signal_value_buf = NULL;
-        free(xc->signal_typs); xc->signal_typs = NULL;
-        free(xc->signal_lens); xc->signal_lens = NULL;
-        free(xc->filename); xc->filename = NULL;
-	free(xc->str_scope_attr); xc->str_scope_attr = NULL;
+do
+        {
+        size_t used = gz->next_out - gz->obuf_start;
+        size_t len;
 
-        if(xc->fh)
+        if(used > FST_GZ_OBUF_LEN - FST_GZ_HISTORY)
+                {
+                /* slide, keeping history for the short backward seeks block loads make */
+                memmove(gz->obuf, gz->obuf + used - FST_GZ_HISTORY, FST_GZ_HISTORY);
+                gz->obuf_start = gz->next_out - FST_GZ_HISTORY;
+                used = FST_GZ_HISTORY;
+                }
+        len = fstReaderGzInflate(xc, gz->obuf + used, FST_GZ_OBUF_LEN - used);
+        if(!len)
                 {
-                tmpfile_close(&xc->fh, &xc->fh_nam);
+                gz->obuf_start = gz->next_out = xc->gz_index->uclen;
+                return(0);
                 }
+        } while(gz->next_out <= pos);
 
-        if(xc->f)
+return(1);
+}
+
+
+static size_t fstReaderGzRead(struct fstReaderContext *xc, unsigned char *buf, uint64_t len)
+{
+struct fstGzCursor *gz = xc->gz;
+uint64_t done = 0;
+
+while(done < len)
+        {
+        uint64_t n;
+
+        if((gz->pos == gz->next_out) && (gz->pos < xc->gz_index->uclen) && (len - done >= FST_GZ_OBUF_LEN))
                 {
-                tmpfile_close(&xc->f, &xc->f_nam);
-                if(xc->filename_unpacked)
+                /* large sequential read, inflate straight into the caller's buffer */
+                n = fstReaderGzInflate(xc, buf + done, len - done);
+                if(!n)
                         {
-                        unlink(xc->filename_unpacked);
-                        free(xc->filename_unpacked);
+                        gz->obuf_start = gz->next_out = xc->gz_index->uclen;
+                        break;
+                        }
+                if(n >= FST_GZ_HISTORY)
+                        {
+                        memcpy(gz->obuf, buf + done + n - FST_GZ_HISTORY, FST_GZ_HISTORY);
+                        gz->obuf_start = gz->next_out - FST_GZ_HISTORY;
+                        }
+                        else
+                        {
+                        gz->obuf_start = gz->next_out; /* too short to stitch onto obuf */
                         }
                 }
+                else
+                {
+                if(!fstReaderGzFill(xc)) break;
+                n = gz->next_out - gz->pos;
+                if(n > len - done) n = len - done;
+                memcpy(buf + done, gz->obuf + (gz->pos - gz->obuf_start), n);
+                }
 
-        free(xc);
+        gz->pos += n;
+        done += n;
         }
+
+return(done);
 }
 
 
 /*
- * read processing
+ * reader I/O: when the trace is a regular file it is mapped read-only and
+ * block reads are served from memory (no read() per stdio buffer refill and
+ * compressed data is inflated in place).  FST_BL_ZWRAPPER traces are
+ * served by the gzip cursor above.  stdio remains the fallback for pipes,
+ * unpacked FST_BL_ZWRAPPER temp files and platforms without a read-only
+ * mapping primitive.
  */
+static void fstReaderUnmapFile(struct fstReaderContext *xc)
+{
+if(xc->fmap)
+        {
+        fstMunmap(xc->fmap, xc->fmap_len);
+        xc->fmap = NULL;
+        xc->fmap_len = 0;
+        xc->fmap_pos = 0;
+        }
+}
 
-/* normal read which re-interleaves the value change data */
-int fstReaderIterBlocks(void *ctx,
-        void (*value_change_callback)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value),
-        void *user_callback_data_pointer, FILE *fv)
+
+static int fstReaderMapFile(struct fstReaderContext *xc)
 {
-return(fstReaderIterBlocks2(ctx, value_change_callback, NULL, user_callback_data_pointer, fv));
+#if defined(FST_READER_MMAP_DISABLE) || defined(__MINGW32__) || defined(_MSC_VER)
+(void)xc; /* fstMmap2() maps read/write which fails on an "rb" handle */
+return(0);
+#else
+struct stat sb;
+void *pnt;
+
+if(xc->fmap) return(1);
+if((!xc->f) || (xc->is_zwrapped)) return(0);
+if(fstat(fileno(xc->f), &sb) || (!S_ISREG(sb.st_mode)) || (sb.st_size <= 0)) return(0);
+if((uint64_t)sb.st_size != (uint64_t)((size_t)sb.st_size)) return(0); /* too large for a 32b address space */
+
+pnt = fstMmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fileno(xc->f), 0);
+if((!pnt) || (pnt == MAP_FAILED)) return(0);
+
+xc->fmap = (unsigned char *)pnt;
+xc->fmap_len = sb.st_size;
+xc->fmap_pos = 0;
+return(1);
+#endif
 }
 
 
-int fstReaderIterBlocks2(void *ctx,
-        void (*value_change_callback)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value),
-        void (*value_change_callback_varlen)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value, uint32_t len),
-        void *user_callback_data_pointer, FILE *fv)
+static int fstReaderIoSeek(struct fstReaderContext *xc, fst_off_t offset, int whence)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc->fmap)
+        {
+        fst_off_t pos;
 
-uint64_t previous_time = UINT64_MAX;
-uint64_t *time_table = NULL;
-uint64_t tsec_nitems;
-unsigned int secnum = 0;
-int blocks_skipped = 0;
-fst_off_t blkpos = 0;
-uint64_t seclen, beg_tim;
-uint64_t end_tim;
-uint64_t frame_uclen, frame_clen, frame_maxhandle, vc_maxhandle;
-fst_off_t vc_start;
-fst_off_t indx_pntr, indx_pos;
-fst_off_t *chain_table = NULL;
-uint32_t *chain_table_lengths = NULL;
-unsigned char *chain_cmem;
-unsigned char *pnt;
-long chain_clen;
-fstHandle idx, pidx=0, i;
-uint64_t pval;
-uint64_t vc_maxhandle_largest = 0;
-uint64_t tsec_uclen = 0, tsec_clen = 0;
-int sectype;
-uint64_t mem_required_for_traversal;
-unsigned char *mem_for_traversal = NULL;
-uint32_t traversal_mem_offs;
-uint32_t *scatterptr, *headptr, *length_remaining;
-uint32_t cur_blackout = 0;
-int packtype;
-unsigned char *mc_mem = NULL;
-uint32_t mc_mem_len; /* corresponds to largest value encountered in chain_table_lengths[i] */
-int dumpvars_state = 0;
+        switch(whence)
+                {
+                case SEEK_CUR:  pos = xc->fmap_pos + offset; break;
+                case SEEK_END:  pos = xc->fmap_len + offset; break;
+                default:        pos = offset; break;
+                }
+
+        if(pos < 0)
+                {
+                xc->fseek_failed = 1;
+                return(-1);
+                }
+
+        xc->fmap_pos = pos;
+        return(0);
+        }
+
+if(xc->gz)
+        {
+        fst_off_t pos;
+
+        switch(whence)
+                {
+                case SEEK_CUR:  pos = xc->gz->pos + offset; break;
+                case SEEK_END:  pos = xc->gz_index->uclen + offset; break;
+                default:        pos = offset; break;
+                }
+
+        if(pos < 0)
+                {
+                xc->fseek_failed = 1;
+                return(-1);
+                }
+
+        xc->gz->pos = pos;
+        return(0);
+        }
+
+return(fstReaderFseeko(xc, xc->f, offset, whence));
+}
+
+
+static fst_off_t fstReaderIoTell(struct fstReaderContext *xc)
+{
+if(xc->gz) return(xc->gz->pos);
+
+return(xc->fmap ? xc->fmap_pos : ftello(xc->f));
+}
+
+
+static int fstReaderIoGetc(struct fstReaderContext *xc)
+{
+if(xc->fmap)
+        {
+        return((xc->fmap_pos < xc->fmap_len) ? xc->fmap[xc->fmap_pos++] : EOF);
+        }
+
+if(xc->gz)
+        {
+        struct fstGzCursor *gz = xc->gz;
+
+        if(((gz->pos >= gz->obuf_start) && (gz->pos < gz->next_out)) || (fstReaderGzFill(xc)))
+                {
+                return(gz->obuf[gz->pos++ - gz->obuf_start]);
+                }
+
+        return(EOF);
+        }
+
+return(fgetc(xc->f));
+}
+
+
+static size_t fstReaderIoRead(struct fstReaderContext *xc, void *buf, uint64_t len)
+{
+if(xc->fmap)
+        {
+        uint64_t avail = (xc->fmap_pos < xc->fmap_len) ? (uint64_t)(xc->fmap_len - xc->fmap_pos) : 0;
+
+        if(len > avail) len = avail;
+        memcpy(buf, xc->fmap + xc->fmap_pos, len);
+        xc->fmap_pos += len;
+        return(len);
+        }
+
+if(xc->gz) return(fstReaderGzRead(xc, (unsigned char *)buf, len));
+
+return(fread(buf, 1, len, xc->f));
+}
+
+
+/* zero-copy read: pointer into the mapping (and advance), NULL when unmapped or out of range */
+static unsigned char *fstReaderIoPeek(struct fstReaderContext *xc, uint64_t len)
+{
+if((xc->fmap) && (xc->fmap_pos <= xc->fmap_len) && (len <= (uint64_t)(xc->fmap_len - xc->fmap_pos)))
+        {
+        unsigned char *pnt = xc->fmap + xc->fmap_pos;
+
+        xc->fmap_pos += len;
+        return(pnt);
+        }
+
+return(NULL);
+}
+
+
+static uint64_t fstReaderIoUint64(struct fstReaderContext *xc)
+{
+uint64_t val = 0;
+unsigned char buf[sizeof(uint64_t)];
+unsigned int i;
+
+if((!xc->fmap) && (!xc->gz)) return(fstReaderUint64(xc->f));
+
+memset(buf, 0, sizeof(buf));
+fstReaderIoRead(xc, buf, sizeof(uint64_t));
+for(i=0;i<sizeof(uint64_t);i++)
+        {
+        val <<= 8;
+        val |= buf[i];
+        }
+
+return(val);
+}
+
+
+static uint32_t fstReaderIoVarint32WithSkip(struct fstReaderContext *xc, uint32_t *skiplen)
+{
+int chk_len = CHK_LEN_MAX2;
+unsigned char buf[CHK_LEN_MAX2];
+unsigned char *mem = buf;
+uint32_t rc = 0;
+int ch;
+
+if((!xc->fmap) && (!xc->gz)) return(fstReaderVarint32WithSkip(xc->f, skiplen));
+
+do
+        {
+        ch = fstReaderIoGetc(xc);
+        *(mem++) = ch;
+        } while((ch & 0x80) && (--chk_len));
+
+if(ch & 0x80) chk_report_abort("TALOS-2023-1783");
+*skiplen = mem - buf;
+mem--;
+
+for(;;)
+        {
+        rc <<= 7;
+        rc |= (uint32_t)(*mem & 0x7f);
+        if(mem == buf)
+                {
+                break;
+                }
+        mem--;
+        }
+
+return(rc);
+}
+
+
+static uint32_t fstReaderIoVarint32(struct fstReaderContext *xc)
+{
+uint32_t skiplen;
+
+return(((xc->fmap) || (xc->gz)) ? fstReaderIoVarint32WithSkip(xc, &skiplen) : fstReaderVarint32(xc->f));
+}
+
+
+static uint64_t fstReaderIoVarint64(struct fstReaderContext *xc)
+{
+int chk_len = CHK_LEN_MAX3;
+unsigned char buf[CHK_LEN_MAX3];
+unsigned char *mem = buf;
+uint64_t rc = 0;
+int ch;
+
+if((!xc->fmap) && (!xc->gz)) return(fstReaderVarint64(xc->f));
+
+do
+        {
+        ch = fstReaderIoGetc(xc);
+        *(mem++) = ch;
+        } while((ch & 0x80) && (--chk_len));
+
+if(ch & 0x80) chk_report_abort("TALOS-2023-1783");
+mem--;
+
+for(;;)
+        {
+        rc <<= 7;
+        rc |= (uint64_t)(*mem & 0x7f);
+        if(mem == buf)
+                {
+                break;
+                }
+        mem--;
+        }
+
+return(rc);
+}
+
+
+#ifndef FST_WRITEX_DISABLE
+static void fstWritex(struct fstReaderContext *xc, void *v, uint32_t len) /* TALOS-2023-1793: change len to unsigned */
+{
+unsigned char *s = (unsigned char *)v;
+
+if(len)
+        {
+        if(len < FST_WRITEX_MAX)
+                {
+                if(xc->writex_pos + len >= FST_WRITEX_MAX)
+                        {
+                        fstWritex(xc, NULL, 0);
+                        }
+
+                memcpy(xc->writex_buf + xc->writex_pos, s, len);
+                xc->writex_pos += len;
+                }
+                else
+                {
+                fstWritex(xc, NULL, 0);
+                if (write(xc->writex_fd, s, len)) { };
+                }
+        }
+        else
+        {
+        if(xc->writex_pos)
+                {
+                if(write(xc->writex_fd, xc->writex_buf, xc->writex_pos)) { };
+                xc->writex_pos = 0;
+                }
+        }
+}
+#endif
+
+
+/*
+ * scope -> flat name handling
+ */
+static void fstReaderDeallocateScopeData(struct fstReaderContext *xc)
+{
+struct fstCurrHier *chp;
+
+free(xc->curr_flat_hier_nam); xc->curr_flat_hier_nam = NULL;
+while(xc->curr_hier)
+        {
+        chp = xc->curr_hier->prev;
+        free(xc->curr_hier);
+        xc->curr_hier = chp;
+        }
+}
+
+
+const char *fstReaderGetCurrentFlatScope(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        return(xc->curr_flat_hier_nam ? xc->curr_flat_hier_nam : "");
+        }
+        else
+        {
+        return(NULL);
+        }
+}
+
+
+void *fstReaderGetCurrentScopeUserInfo(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        return(xc->curr_hier ? xc->curr_hier->user_info : NULL);
+        }
+        else
+        {
+        return(NULL);
+        }
+}
+
+
+const char *fstReaderPopScope(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc && xc->curr_hier)
+        {
+        struct fstCurrHier *ch = xc->curr_hier;
+        if(xc->curr_hier->prev)
+                {
+                xc->curr_flat_hier_nam[xc->curr_hier->prev->len] = 0;
+                }
+                else
+                {
+                *xc->curr_flat_hier_nam = 0;
+                }
+        xc->curr_hier = xc->curr_hier->prev;
+        free(ch);
+        return(xc->curr_flat_hier_nam ? xc->curr_flat_hier_nam : "");
+        }
+
+return(NULL);
+}
+
+
+void fstReaderResetScope(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        while(fstReaderPopScope(xc)); /* remove any already-built scoping info */
+        }
+}
+
+
+const char *fstReaderPushScope(void *ctx, const char *nam, void *user_info)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        struct fstCurrHier *ch = (struct fstCurrHier *)malloc(sizeof(struct fstCurrHier));
+        int chl = xc->curr_hier ? xc->curr_hier->len : 0;
+        int len = chl + 1 + strlen(nam);
+        if(len >= xc->flat_hier_alloc_len)
+                {
+                xc->curr_flat_hier_nam = xc->curr_flat_hier_nam ? (char *)realloc(xc->curr_flat_hier_nam, len+1) : (char *)malloc(len+1);
+                }
+
+        if(chl)
+                {
+                xc->curr_flat_hier_nam[chl] = '.';
+                strcpy(xc->curr_flat_hier_nam + chl + 1, nam);
+                }
+                else
+                {
+                strcpy(xc->curr_flat_hier_nam, nam);
+                len--;
+                }
+
+        ch->len = len;
+        ch->prev = xc->curr_hier;
+        ch->user_info = user_info;
+        xc->curr_hier = ch;
+        return(xc->curr_flat_hier_nam);
+        }
+
+return(NULL);
+}
+
+
+int fstReaderGetCurrentScopeLen(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc && xc->curr_hier)
+        {
+        return(xc->curr_hier->len);
+        }
+
+return(0);
+}
+
+
+int fstReaderGetFseekFailed(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        return(xc->fseek_failed != 0);
+        }
+
+return(0);
+}
+
+
+/*
+ * iter mask manipulation util functions
+ */
+int fstReaderGetFacProcessMask(void *ctx, fstHandle facidx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        facidx--;
+        if(facidx<xc->maxhandle)
+                {
+                int process_idx = facidx/8;
+                int process_bit = facidx&7;
+
+                return( (xc->process_mask[process_idx]&(1<<process_bit)) != 0 );
+                }
+        }
+return(0);
+}
+
+
+void fstReaderSetFacProcessMask(void *ctx, fstHandle facidx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        facidx--;
+        if(facidx<xc->maxhandle)
+                {
+                int idx = facidx/8;
+                int bitpos = facidx&7;
+
+                xc->process_mask[idx] |= (1<<bitpos);
+                }
+        }
+}
+
+
+void fstReaderClrFacProcessMask(void *ctx, fstHandle facidx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        facidx--;
+        if(facidx<xc->maxhandle)
+                {
+                int idx = facidx/8;
+                int bitpos = facidx&7;
+
+                xc->process_mask[idx] &= (~(1<<bitpos));
+                }
+        }
+}
+
+
+void fstReaderSetFacProcessMaskAll(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        memset(xc->process_mask, 0xff, (xc->maxhandle+7)/8);
+        }
+}
+
+
+void fstReaderClrFacProcessMaskAll(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        memset(xc->process_mask, 0x00, (xc->maxhandle+7)/8);
+        }
+}
+
+
+/*
+ * various utility read/write functions
+ */
+signed char fstReaderGetTimescale(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->timescale : 0);
+}
+
+
+uint64_t fstReaderGetStartTime(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->start_time : 0);
+}
+
+
+uint64_t fstReaderGetEndTime(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->end_time : 0);
+}
+
+
+uint64_t fstReaderGetMemoryUsedByWriter(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->mem_used_by_writer : 0);
+}
+
+
+uint64_t fstReaderGetScopeCount(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->scope_count : 0);
+}
+
+
+uint64_t fstReaderGetVarCount(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->var_count : 0);
+}
+
+
+fstHandle fstReaderGetMaxHandle(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->maxhandle : 0);
+}
+
+
+uint64_t fstReaderGetAliasCount(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->num_alias : 0);
+}
+
+
+uint64_t fstReaderGetValueChangeSectionCount(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->vc_section_count : 0);
+}
+
+
+int fstReaderGetDoubleEndianMatchState(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->double_endian_match : 0);
+}
+
+
+const char *fstReaderGetVersionString(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->version : NULL);
+}
+
+
+const char *fstReaderGetDateString(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->date : NULL);
+}
+
+
+int fstReaderGetFileType(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? (int)xc->filetype : (int)FST_FT_VERILOG);
+}
+
+
+int64_t fstReaderGetTimezero(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->timezero : 0);
+}
+
+
+uint32_t fstReaderGetNumberDumpActivityChanges(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->num_blackouts : 0);
+}
+
+
+uint64_t fstReaderGetDumpActivityChangeTime(void *ctx, uint32_t idx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc && (idx < xc->num_blackouts) && (xc->blackout_times))
+        {
+        return(xc->blackout_times[idx]);
+        }
+        else
+        {
+        return(0);
+        }
+}
+
+
+unsigned char fstReaderGetDumpActivityChangeValue(void *ctx, uint32_t idx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc && (idx < xc->num_blackouts) && (xc->blackout_activity))
+        {
+        return(xc->blackout_activity[idx]);
+        }
+        else
+        {
+        return(0);
+        }
+}
+
+
+void fstReaderSetLimitTimeRange(void *ctx, uint64_t start_time, uint64_t end_time)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        xc->limit_range_valid = 1;
+        xc->limit_range_start = start_time;
+        xc->limit_range_end = end_time;
+        }
+}
+
+
+void fstReaderSetUnlimitedTimeRange(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        xc->limit_range_valid = 0;
+        }
+}
+
+
+void fstReaderSetVcdExtensions(void *ctx, int enable)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        xc->use_vcd_extensions = (enable != 0);
+        }
+}
+
+
+void fstReaderIterBlocksSetNativeDoublesOnCallback(void *ctx, int enable)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        xc->native_doubles_for_cb = (enable != 0);
+        }
+}
+
+
+/*
+ * number of threads fstReaderIterBlocks2() uses to inflate value change
+ * blocks ahead of the callbacks, which are still made in time order from
+ * the calling thread.  0 or 1 decodes serially (the default), as does a
+ * build without FST_READER_PARALLEL.  the threads are started and joined
+ * within each iteration call and capped at 64, so this pays off for long
+ * reads, not for many short ones over a narrow time range.  if they cannot
+ * be set up the iteration falls back to decoding serially.
+ */
+void fstReaderIterBlocksSetParallelMode(void *ctx, int num_threads)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        xc->iterblocks_threads = (num_threads > 1) ? num_threads : 0;
+        }
+}
+
+
+int fstReaderIterBlocksGetParallelMode(void *ctx)
+{
+#ifdef FST_READER_PARALLEL
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->iterblocks_threads : 0);
+#else
+(void)ctx;
+return(0);
+#endif
+}
+
+
+/*
+ * enable (default where supported) or disable reading through a mapping of
+ * the trace.  stdio is used whenever the file cannot be mapped.
+ */
+void fstReaderSetMmapIo(void *ctx, int enable)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc)
+        {
+        if(enable)
+                {
+                fstReaderMapFile(xc);
+                }
+                else
+                {
+                fstReaderUnmapFile(xc);
+                }
+        }
+}
+
+
+int fstReaderGetMmapIo(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? (xc->fmap != NULL) : 0);
+}
+
+/*
+ * hierarchy processing
+ */
+static void fstVcdID(char *buf, unsigned int value)
+{
+char *pnt = buf;
+
+/* zero is illegal for a value...it is assumed they start at one */
+while (value)
+        {
+        value--;
+        *(pnt++) = (char)('!' + value % 94);
+        value = value / 94;
+        }
+
+*pnt = 0;
+}
+
+static int fstVcdIDForFwrite(char *buf, unsigned int value)
+{
+char *pnt = buf;
+ int len = 0;
+
+/* zero is illegal for a value...it is assumed they start at one */
+while (value && len < 14)
+        {
+        value--;
+	++len;
+        *(pnt++) = (char)('!' + value % 94);
+        value = value / 94;
+        }
+
+return len;
+}
+
+
+/* uncompress() for time tables, which FST_WR_PT_ZSTD writers emit as zstd frames */
+static int fstReaderUncompress(unsigned char *dest, unsigned long *destlen, const unsigned char *source, unsigned long sourcelen)
+{
+if(FST_ZSTD_FRAME(source, sourcelen))
+        {
+#ifdef HAVE_LIBZSTD
+        size_t rc = ZSTD_decompress(dest, *destlen, source, sourcelen);
+
+        if((ZSTD_isError(rc)) || (rc != *destlen)) return(Z_DATA_ERROR);
+        return(Z_OK);
+#else
+        return(Z_DATA_ERROR); /* built without HAVE_LIBZSTD */
+#endif
+        }
+
+return(uncompress(dest, destlen, source, sourcelen));
+}
+
+
+/* drops a zstd decode context cached by fstReaderUnpackChain() */
+static void fstReaderFreeZstdDCtx(void **dctx_cache)
+{
+#ifdef HAVE_LIBZSTD
+if(*dctx_cache) ZSTD_freeDCtx((ZSTD_DCtx *)*dctx_cache);
+#endif
+*dctx_cache = NULL;
+}
+
+
+#define FST_HIER_ZCHUNK (1U << 30)      /* keeps z_stream avail_in/avail_out within uInt */
+
+/* inflates the gzip stream the writer emits through gzdopen() for FST_BL_HIER */
+static int fstReaderInflateHier(const unsigned char *cmem, uint64_t clen, unsigned char *ucmem, uint64_t uclen)
+{
+z_stream strm;
+uint64_t out_done;
+int rc;
+
+memset(&strm, 0, sizeof(z_stream));
+if(inflateInit2(&strm, 15 + 16) != Z_OK) return(0);
+
+strm.next_in = (unsigned char *)cmem;
+strm.next_out = ucmem;
+do
+        {
+        uint64_t in_left = clen - (uint64_t)(strm.next_in - cmem);
+        uint64_t out_left = uclen - (uint64_t)(strm.next_out - ucmem);
+
+        strm.avail_in = (in_left > FST_HIER_ZCHUNK) ? FST_HIER_ZCHUNK : (uInt)in_left;
+        strm.avail_out = (out_left > FST_HIER_ZCHUNK) ? FST_HIER_ZCHUNK : (uInt)out_left;
+        rc = inflate(&strm, Z_NO_FLUSH);
+        } while(rc == Z_OK); /* Z_BUF_ERROR once no progress is possible, which includes a full buffer */
+
+out_done = (uint64_t)(strm.next_out - ucmem);
+inflateEnd(&strm);
+
+return((rc != Z_DATA_ERROR) && (rc != Z_MEM_ERROR) && (out_done == uclen));
+}
+
+
+/*
+ * decompresses the hierarchy section into xc->hier_mem, which is then
+ * walked in place by fstReaderIterateHier() and fstReaderProcessHier().
+ * nothing is written next to the trace, so read-only directories work.
+ */
+static int fstReaderLoadHier(struct fstReaderContext *xc)
+{
+fst_off_t offs_cache;
+uint64_t seclen, clen, uclen;
+unsigned char *cmem, *cmem_alloc = NULL;
+unsigned char *ucmem;
+int htyp = FST_BL_SKIP;
+int pass_status = 0;
+
+if(xc->hier_mem) return(1);
+
+/* can't handle both set at once should never happen in a real file */
+if(xc->contains_hier_section_zstd)
+        {
+        htyp = FST_BL_HIER_ZSTD;
+        }
+else
+if(!xc->contains_hier_section_lz4 && xc->contains_hier_section)
+        {
+        htyp = FST_BL_HIER;
+        }
+else
+if(xc->contains_hier_section_lz4 && !xc->contains_hier_section)
+        {
+        htyp = xc->contains_hier_section_lz4duo ? FST_BL_HIER_LZ4DUO : FST_BL_HIER_LZ4;
+        }
+
+if(htyp == FST_BL_SKIP) return(0);
+
+offs_cache = fstReaderIoTell(xc);
+fstReaderIoSeek(xc, xc->hier_pos - 8, SEEK_SET); /* get section len */
+seclen = fstReaderIoUint64(xc);
+uclen = fstReaderIoUint64(xc);
+clen = (seclen > 16) ? (seclen - 16) : 0;
+
+if(!(cmem = fstReaderIoPeek(xc, clen)))
+        {
+        cmem = cmem_alloc = (unsigned char *)malloc(clen ? clen : 1);
+        if(fstReaderIoRead(xc, cmem, clen) != clen)
+                {
+                clen = 0;
+                }
+        }
+
+ucmem = (unsigned char *)malloc(uclen ? uclen : 1);
+
+if(!clen)
+        {
+        pass_status = 0;
+        }
+else
+if(htyp == FST_BL_HIER)
+        {
+        pass_status = fstReaderInflateHier(cmem, clen, ucmem, uclen);
+        }
+else
+if(htyp == FST_BL_HIER_ZSTD)
+        {
+#ifdef HAVE_LIBZSTD
+        size_t rc = ZSTD_decompress(ucmem, uclen, cmem, clen);
+
+        pass_status = (!ZSTD_isError(rc)) && (rc == uclen);
+#endif
+        }
+else
+if(htyp == FST_BL_HIER_LZ4DUO)
+        {
+        unsigned char *lz4_ucmem2;
+        uint64_t uclen2;
+        int skiplen2 = 0;
+
+        uclen2 = fstGetVarint64(cmem, &skiplen2);
+        lz4_ucmem2 = (unsigned char *)malloc(uclen2 ? uclen2 : 1);
+        pass_status = ((uint64_t)skiplen2 < clen) &&
+                (uclen2 == (uint64_t)LZ4_decompress_safe_partial ((char *)cmem + skiplen2, (char *)lz4_ucmem2, clen - skiplen2, uclen2, uclen2));
+        if(pass_status)
+                {
+                pass_status = (uclen == (uint64_t)LZ4_decompress_safe_partial ((char *)lz4_ucmem2, (char *)ucmem, uclen2, uclen, uclen));
+                }
+
+        free(lz4_ucmem2);
+        }
+else /* FST_BL_HIER_LZ4 */
+        {
+        pass_status = (uclen == (uint64_t)LZ4_decompress_safe_partial ((char *)cmem, (char *)ucmem, clen, uclen, uclen));
+        }
+
+free(cmem_alloc);
+fstReaderIoSeek(xc, offs_cache, SEEK_SET);
+
+if(pass_status)
+        {
+        xc->hier_mem = ucmem;
+        xc->hier_len = uclen;
+        xc->hier_ofs = 0;
+        }
+        else
+        {
+        free(ucmem);
+        }
+
+return(pass_status);
+}
+
+
+/*
+ * pulls in the <trace>.hier file a writer keeps until fstWriterClose(), so
+ * traces that are still being written can be browsed.  returns 0 when absent.
+ */
+static int fstReaderLoadHierSidecar(struct fstReaderContext *xc, const char *nam)
+{
+int flen = strlen(nam);
+char *hf = (char *)calloc(1, flen + 6);
+FILE *fh;
+fst_off_t len;
+int pass_status = 0;
+
+memcpy(hf, nam, flen);
+strcpy(hf + flen, ".hier");
+fh = fopen(hf, "rb");
+free(hf);
+
+if(!fh) return(0);
+
+if((!fseeko(fh, 0, SEEK_END)) && ((len = ftello(fh)) >= 0) && (!fseeko(fh, 0, SEEK_SET)))
+        {
+        unsigned char *mem = (unsigned char *)malloc(len ? len : 1);
+
+        if((!len) || (fstFread(mem, len, 1, fh) == 1))
+                {
+                free(xc->hier_mem);
+                xc->hier_mem = mem;
+                xc->hier_len = len;
+                xc->hier_ofs = 0;
+                pass_status = 1;
+                }
+                else
+                {
+                free(mem);
+                }
+        }
+
+fclose(fh);
+return(pass_status);
+}
+
+
+/* hierarchy buffer accessors, reading past the end yields EOF / 0 / empty strings */
+static int fstReaderHierGetc(struct fstReaderContext *xc)
+{
+return((xc->hier_ofs < xc->hier_len) ? xc->hier_mem[xc->hier_ofs++] : EOF);
+}
+
+
+/* steps over a NUL terminated name, returning it in place along with its length */
+static const char *fstReaderHierSkipName(struct fstReaderContext *xc, uint64_t *len)
+{
+const unsigned char *pnt = xc->hier_mem + xc->hier_ofs;
+uint64_t avail = (xc->hier_ofs < xc->hier_len) ? (xc->hier_len - xc->hier_ofs) : 0;
+const unsigned char *nul = avail ? (const unsigned char *)memchr(pnt, 0, avail) : NULL;
+
+*len = nul ? (uint64_t)(nul - pnt) : avail;
+xc->hier_ofs += *len + (nul != NULL);
+return((const char *)pnt);
+}
+
+
+/* copies a NUL terminated name truncated to maxlen into dst (if not NULL) and returns the copied length */
+static int fstReaderHierName(struct fstReaderContext *xc, char *dst, int maxlen)
+{
+uint64_t len;
+const char *pnt = fstReaderHierSkipName(xc, &len);
+int cl = (len > (uint64_t)maxlen) ? maxlen : (int)len;
+
+if(dst)
+        {
+        memcpy(dst, pnt, cl);
+        dst[cl] = 0;
+        }
+
+return(cl);
+}
+
+
+static uint64_t fstReaderHierVarint64(struct fstReaderContext *xc)
+{
+uint64_t rc = 0;
+int shift = 0;
+
+while(xc->hier_ofs < xc->hier_len)
+        {
+        unsigned char ch = xc->hier_mem[xc->hier_ofs++];
+
+        if(shift < 64) rc |= ((uint64_t)(ch & 0x7f)) << shift;
+        shift += 7;
+        if(!(ch & 0x80)) break;
+        }
+
+return(rc);
+}
+
+
+int fstReaderIterateHierRewind(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+int pass_status = 0;
+
+if(xc)
+        {
+        pass_status = 1;
+        if(!xc->hier_mem)
+                {
+                pass_status = fstReaderLoadHier(xc);
+                }
+
+        xc->do_rewind = 1;
+        }
+
+return(pass_status);
+}
+
+
+struct fstHier *fstReaderIterateHier(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+int isfeof;
+fstHandle alias;
+char *pnt;
+
+if(!xc) return(NULL);
+
+if(!xc->hier_mem)
+        {
+        if(!fstReaderLoadHier(xc))
+                {
+                return(NULL);
+                }
+        }
+
+if(xc->do_rewind)
+        {
+        xc->do_rewind = 0;
+        xc->current_handle = 0;
+        xc->hier_ofs = 0;
+        }
+
+if(!(isfeof=(xc->hier_ofs >= xc->hier_len)))
+        {
+        int tag = fstReaderHierGetc(xc);
+        switch(tag)
+                {
+                case FST_ST_VCD_SCOPE:
+                        xc->hier.htyp = FST_HT_SCOPE;
+                        xc->hier.u.scope.typ = fstReaderHierGetc(xc);
+                        xc->hier.u.scope.name = pnt = xc->str_scope_nam;
+                        xc->hier.u.scope.name_length = fstReaderHierName(xc, pnt, FST_ID_NAM_SIZ); /* scopename */
+
+                        xc->hier.u.scope.component = pnt = xc->str_scope_comp;
+                        xc->hier.u.scope.component_length = fstReaderHierName(xc, pnt, FST_ID_NAM_SIZ); /* scopecomp */
+                        break;
+
+                case FST_ST_VCD_UPSCOPE:
+                        xc->hier.htyp = FST_HT_UPSCOPE;
+                        break;
+
+                case FST_ST_GEN_ATTRBEGIN:
+                        xc->hier.htyp = FST_HT_ATTRBEGIN;
+                        xc->hier.u.attr.typ = fstReaderHierGetc(xc);
+                        xc->hier.u.attr.subtype = fstReaderHierGetc(xc);
+			if(!xc->str_scope_attr)
+				{
+				xc->str_scope_attr = (char *)calloc(1, FST_ID_NAM_ATTR_SIZ+1);
+				}
+                        xc->hier.u.attr.name = pnt = xc->str_scope_attr;
+                        xc->hier.u.attr.name_length = fstReaderHierName(xc, pnt, FST_ID_NAM_ATTR_SIZ); /* attrname */
+
+                        xc->hier.u.attr.arg = fstReaderHierVarint64(xc);
+
+                        if(xc->hier.u.attr.typ == FST_AT_MISC)
+                                {
+                                if((xc->hier.u.attr.subtype == FST_MT_SOURCESTEM)||(xc->hier.u.attr.subtype == FST_MT_SOURCEISTEM))
+                                        {
+                                        int sidx_skiplen_dummy = 0;
+                                        xc->hier.u.attr.arg_from_name = fstGetVarint64((unsigned char *)xc->str_scope_attr, &sidx_skiplen_dummy);
+                                        }
+                                }
+                        break;
+
+                case FST_ST_GEN_ATTREND:
+                        xc->hier.htyp = FST_HT_ATTREND;
+                        break;
+
+                case FST_VT_VCD_EVENT:
+                case FST_VT_VCD_INTEGER:
+                case FST_VT_VCD_PARAMETER:
+                case FST_VT_VCD_REAL:
+                case FST_VT_VCD_REAL_PARAMETER:
+                case FST_VT_VCD_REG:
+                case FST_VT_VCD_SUPPLY0:
+                case FST_VT_VCD_SUPPLY1:
+                case FST_VT_VCD_TIME:
+                case FST_VT_VCD_TRI:
+                case FST_VT_VCD_TRIAND:
+                case FST_VT_VCD_TRIOR:
+                case FST_VT_VCD_TRIREG:
+                case FST_VT_VCD_TRI0:
+                case FST_VT_VCD_TRI1:
+                case FST_VT_VCD_WAND:
+                case FST_VT_VCD_WIRE:
+                case FST_VT_VCD_WOR:
+                case FST_VT_VCD_PORT:
+                case FST_VT_VCD_SPARRAY:
+                case FST_VT_VCD_REALTIME:
+                case FST_VT_GEN_STRING:
+                case FST_VT_SV_BIT:
+                case FST_VT_SV_LOGIC:
+                case FST_VT_SV_INT:
+                case FST_VT_SV_SHORTINT:
+                case FST_VT_SV_LONGINT:
+                case FST_VT_SV_BYTE:
+                case FST_VT_SV_ENUM:
+                case FST_VT_SV_SHORTREAL:
+                        xc->hier.htyp = FST_HT_VAR;
+                        xc->hier.u.var.svt_workspace = FST_SVT_NONE;
+                        xc->hier.u.var.sdt_workspace = FST_SDT_NONE;
+                        xc->hier.u.var.sxt_workspace = 0;
+                        xc->hier.u.var.typ = tag;
+                        xc->hier.u.var.direction = fstReaderHierGetc(xc);
+                        xc->hier.u.var.name = pnt = xc->str_scope_nam;
+                        xc->hier.u.var.name_length = fstReaderHierName(xc, pnt, FST_ID_NAM_SIZ); /* varname */
+                        xc->hier.u.var.length = (uint32_t)fstReaderHierVarint64(xc);
+                        if(tag == FST_VT_VCD_PORT)
+                                {
+                                xc->hier.u.var.length -= 2; /* removal of delimiting spaces */
+                                xc->hier.u.var.length /= 3; /* port -> signal size adjust */
+                                }
+
+                        alias = (uint32_t)fstReaderHierVarint64(xc);
+
+                        if(!alias)
+                                {
+                                xc->current_handle++;
+                                xc->hier.u.var.handle = xc->current_handle;
+                                xc->hier.u.var.is_alias = 0;
+                                }
+                                else
+                                {
+                                xc->hier.u.var.handle = alias;
+                                xc->hier.u.var.is_alias = 1;
+                                }
+
+                        break;
+
+                default:
+                        isfeof = 1;
+                        break;
+                }
+        }
+
+return(!isfeof ? &xc->hier : NULL);
+}
+
+
+/* hands out 8 byte aligned arrays from a single allocation */
+static void *fstFlatHierCarve(unsigned char **pnt, uint64_t bytes)
+{
+void *rc = *pnt;
+
+*pnt += (bytes + 7) & ~(uint64_t)7;
+return(rc);
+}
+
+
+static struct fstFlatHier *fstFlatHierAlloc(uint64_t si, uint64_t vi, uint64_t ni)
+{
+uint64_t total = sizeof(struct fstFlatHier) + 8 * (si + vi) + 4 * (2 * si + 3 * vi) +
+        sizeof(fstHandle) * vi + (si + 3 * vi) + ni + 14 * 8; /* 14 carves, each padded by < 8 */
+struct fstFlatHier *fh;
+unsigned char *pnt;
+
+if((si >= FST_FLAT_HIER_NO_SCOPE) || (vi >= FST_FLAT_HIER_NO_SCOPE) || (total != (size_t)total) ||
+        (!(fh = (struct fstFlatHier *)malloc((size_t)total))))
+        {
+        return(NULL);
+        }
+
+pnt = (unsigned char *)fh;
+fstFlatHierCarve(&pnt, sizeof(struct fstFlatHier));
+fh->num_scopes = (uint32_t)si;
+fh->num_vars = (uint32_t)vi;
+fh->names_len = ni;
+fh->scope_name_offs = (uint64_t *)fstFlatHierCarve(&pnt, 8 * si);
+fh->var_name_offs = (uint64_t *)fstFlatHierCarve(&pnt, 8 * vi);
+fh->scope_parent = (uint32_t *)fstFlatHierCarve(&pnt, 4 * si);
+fh->scope_name_len = (uint32_t *)fstFlatHierCarve(&pnt, 4 * si);
+fh->var_scope = (uint32_t *)fstFlatHierCarve(&pnt, 4 * vi);
+fh->var_name_len = (uint32_t *)fstFlatHierCarve(&pnt, 4 * vi);
+fh->var_length = (uint32_t *)fstFlatHierCarve(&pnt, 4 * vi);
+fh->var_handle = (fstHandle *)fstFlatHierCarve(&pnt, sizeof(fstHandle) * vi);
+fh->scope_typ = (unsigned char *)fstFlatHierCarve(&pnt, si);
+fh->var_typ = (unsigned char *)fstFlatHierCarve(&pnt, vi);
+fh->var_direction = (unsigned char *)fstFlatHierCarve(&pnt, vi);
+fh->var_is_alias = (unsigned char *)fstFlatHierCarve(&pnt, vi);
+fh->names = (char *)fstFlatHierCarve(&pnt, ni);
+
+return(fh);
+}
+
+
+/*
+ * steps over the var record whose tag was just read, storing it in slot vi of fh
+ * (when not NULL) with its name at ni.  returns the name length.
+ */
+static uint64_t fstFlatHierVar(struct fstReaderContext *xc, int tag, struct fstFlatHier *fh,
+        uint64_t vi, uint64_t ni, uint32_t scope, fstHandle *current_handle)
+{
+int direction = fstReaderHierGetc(xc);
+uint64_t len;
+const char *nam = fstReaderHierSkipName(xc, &len);
+uint32_t length = (uint32_t)fstReaderHierVarint64(xc);
+uint32_t alias = (uint32_t)fstReaderHierVarint64(xc);
+fstHandle handle = alias ? alias : ++(*current_handle);
+
+if(fh)
+        {
+        if(tag == FST_VT_VCD_PORT)
+                {
+                length -= 2; /* removal of delimiting spaces */
+                length /= 3; /* port -> signal size adjust */
+                }
+
+        fh->var_scope[vi] = scope;
+        fh->var_name_offs[vi] = ni;
+        fh->var_name_len[vi] = (uint32_t)len;
+        fh->var_typ[vi] = tag;
+        fh->var_direction[vi] = direction;
+        fh->var_length[vi] = length;
+        fh->var_handle[vi] = handle;
+        fh->var_is_alias[vi] = (alias != 0);
+        memcpy(fh->names + ni, nam, len);
+        fh->names[ni + len] = 0;
+        }
+
+return(len);
+}
+
+
+static void fstReaderHierSkipAttr(struct fstReaderContext *xc)
+{
+uint64_t len;
+
+fstReaderHierGetc(xc); /* attrtype */
+fstReaderHierGetc(xc); /* subtype */
+fstReaderHierSkipName(xc, &len);
+fstReaderHierVarint64(xc);
+}
+
+
+/*
+ * the whole hierarchy in one call: scopes and vars as parallel arrays with
+ * all names in one arena, in a single allocation released with
+ * fstReaderFreeFlatHier().  attributes are skipped and names are not
+ * truncated.  the position of fstReaderIterateHier() is left alone.
+ */
+struct fstFlatHier *fstReaderGetFlatHier(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstFlatHier *fh = NULL;
+uint64_t hier_ofs_cache;
+uint64_t si = 0, vi = 0, ni = 0;
+int pass;
+
+if((!xc) || ((!xc->hier_mem) && (!fstReaderLoadHier(xc)))) return(NULL);
+
+hier_ofs_cache = xc->hier_ofs;
+
+for(pass=0;pass<2;pass++)       /* counts first, then fills */
+        {
+        uint32_t cur_scope = FST_FLAT_HIER_NO_SCOPE;
+        fstHandle current_handle = 0;
+
+        if(pass)
+                {
+                if(!(fh = fstFlatHierAlloc(si, vi, ni))) break;
+                si = vi = ni = 0;
+                }
+
+        xc->hier_ofs = 0;
+        while(xc->hier_ofs < xc->hier_len)
+                {
+                int tag = fstReaderHierGetc(xc);
+
+                if((tag >= FST_VT_MIN) && (tag <= FST_VT_MAX))
+                        {
+                        ni += fstFlatHierVar(xc, tag, fh, vi, ni, cur_scope, &current_handle) + 1;
+                        vi++;
+                        }
+                else
+                if(tag == FST_ST_VCD_SCOPE)
+                        {
+                        int typ = fstReaderHierGetc(xc);
+                        uint64_t len, comp_len;
+                        const char *nam = fstReaderHierSkipName(xc, &len);
+
+                        fstReaderHierSkipName(xc, &comp_len); /* scopecomp */
+
+                        if(pass)
+                                {
+                                fh->scope_parent[si] = cur_scope;
+                                fh->scope_name_offs[si] = ni;
+                                fh->scope_name_len[si] = (uint32_t)len;
+                                fh->scope_typ[si] = typ;
+                                memcpy(fh->names + ni, nam, len);
+                                fh->names[ni + len] = 0;
+                                cur_scope = (uint32_t)si;
+                                }
+                        si++;
+                        ni += len + 1;
+                        }
+                else
+                if(tag == FST_ST_VCD_UPSCOPE)
+                        {
+                        if((pass) && (cur_scope != FST_FLAT_HIER_NO_SCOPE))
+                                {
+                                cur_scope = fh->scope_parent[cur_scope];
+                                }
+                        }
+                else
+                if(tag == FST_ST_GEN_ATTRBEGIN)
+                        {
+                        fstReaderHierSkipAttr(xc);
+                        }
+                else
+                if(tag != FST_ST_GEN_ATTREND)
+                        {
+                        break;          /* same end condition as fstReaderIterateHier() */
+                        }
+                }
+        }
+
+xc->hier_ofs = hier_ofs_cache;
+return(fh);
+}
+
+
+void fstReaderFreeFlatHier(struct fstFlatHier *fh)
+{
+free(fh);
+}
+
+
+/*
+ * one skim over the hierarchy that keeps only the scopes, plus where each
+ * one's records start and end and which handles its vars take, so that
+ * fstReaderGetFlatHierScope() can later decode a single scope without
+ * walking anything outside it.  released with fstReaderFreeHierScopeIndex().
+ */
+struct fstHierScopeIndex *fstReaderGetHierScopeIndex(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstHierScopeIndex *si = NULL;
+uint64_t hier_ofs_cache;
+uint64_t sc = 0, ni = 0;
+int pass;
+
+if((!xc) || ((!xc->hier_mem) && (!fstReaderLoadHier(xc)))) return(NULL);
+
+hier_ofs_cache = xc->hier_ofs;
+
+for(pass=0;pass<2;pass++)       /* counts first, then fills */
+        {
+        uint32_t cur_scope = FST_FLAT_HIER_NO_SCOPE;
+        fstHandle current_handle = 0;
+        uint64_t tag_ofs;
+
+        if(pass)
+                {
+                uint64_t total = sizeof(struct fstHierScopeIndex) + 8 * 3 * sc + 4 * 3 * sc +
+                        sizeof(fstHandle) * 2 * sc + sc + ni + 11 * 8; /* 11 carves, each padded by < 8 */
+                unsigned char *pnt;
+
+                if((sc >= FST_FLAT_HIER_NO_SCOPE) || (total != (size_t)total) ||
+                        (!(si = (struct fstHierScopeIndex *)malloc((size_t)total))))
+                        {
+                        si = NULL;
+                        break;
+                        }
+
+                pnt = (unsigned char *)si;
+                fstFlatHierCarve(&pnt, sizeof(struct fstHierScopeIndex));
+                si->num_scopes = (uint32_t)sc;
+                si->num_vars = 0;
+                si->root_num_vars = 0;
+                si->names_len = ni;
+                si->scope_name_offs = (uint64_t *)fstFlatHierCarve(&pnt, 8 * sc);
+                si->scope_body_ofs = (uint64_t *)fstFlatHierCarve(&pnt, 8 * sc);
+                si->scope_end_ofs = (uint64_t *)fstFlatHierCarve(&pnt, 8 * sc);
+                si->scope_parent = (uint32_t *)fstFlatHierCarve(&pnt, 4 * sc);
+                si->scope_name_len = (uint32_t *)fstFlatHierCarve(&pnt, 4 * sc);
+                si->scope_num_vars = (uint32_t *)fstFlatHierCarve(&pnt, 4 * sc);
+                si->scope_handle_base = (fstHandle *)fstFlatHierCarve(&pnt, sizeof(fstHandle) * sc);
+                si->scope_num_handles = (fstHandle *)fstFlatHierCarve(&pnt, sizeof(fstHandle) * sc);
+                si->scope_typ = (unsigned char *)fstFlatHierCarve(&pnt, sc);
+                si->names = (char *)fstFlatHierCarve(&pnt, ni);
+                sc = ni = 0;
+                }
+
+        tag_ofs = xc->hier_ofs = 0;
+        while(xc->hier_ofs < xc->hier_len)
+                {
+                int tag = fstReaderHierGetc(xc);
+
+                if((tag >= FST_VT_MIN) && (tag <= FST_VT_MAX))
+                        {
+                        fstFlatHierVar(xc, tag, NULL, 0, 0, cur_scope, &current_handle);
+
+                        if(pass)
+                                {
+                                si->num_vars++;
+                                if(cur_scope != FST_FLAT_HIER_NO_SCOPE)
+                                        {
+                                        si->scope_num_vars[cur_scope]++;
+                                        }
+                                        else
+                                        {
+                                        si->root_num_vars++;
+                                        }
+                                }
+                        }
+                else
+                if(tag == FST_ST_VCD_SCOPE)
+                        {
+                        int typ = fstReaderHierGetc(xc);
+                        uint64_t len, comp_len;
+                        const char *nam = fstReaderHierSkipName(xc, &len);
+
+                        fstReaderHierSkipName(xc, &comp_len); /* scopecomp */
+
+                        if(pass)
+                                {
+                                si->scope_parent[sc] = cur_scope;
+                                si->scope_name_offs[sc] = ni;
+                                si->scope_name_len[sc] = (uint32_t)len;
+                                si->scope_typ[sc] = typ;
+                                si->scope_num_vars[sc] = 0;
+                                si->scope_body_ofs[sc] = xc->hier_ofs;
+                                si->scope_handle_base[sc] = current_handle;
+                                memcpy(si->names + ni, nam, len);
+                                si->names[ni + len] = 0;
+                                cur_scope = (uint32_t)sc;
+                                }
+                        sc++;
+                        ni += len + 1;
+                        }
+                else
+                if(tag == FST_ST_VCD_UPSCOPE)
+                        {
+                        if((pass) && (cur_scope != FST_FLAT_HIER_NO_SCOPE))
+                                {
+                                si->scope_end_ofs[cur_scope] = tag_ofs;
+                                si->scope_num_handles[cur_scope] = current_handle - si->scope_handle_base[cur_scope];
+                                cur_scope = si->scope_parent[cur_scope];
+                                }
+                        }
+                else
+                if(tag == FST_ST_GEN_ATTRBEGIN)
+                        {
+                        fstReaderHierSkipAttr(xc);
+                        }
+                else
+                if(tag != FST_ST_GEN_ATTREND)
+                        {
+                        break;          /* same end condition as fstReaderIterateHier() */
+                        }
+
+                tag_ofs = xc->hier_ofs;
+                }
+
+        /* scopes left open end wherever the walk stopped */
+        while((pass) && (cur_scope != FST_FLAT_HIER_NO_SCOPE))
+                {
+                si->scope_end_ofs[cur_scope] = tag_ofs;
+                si->scope_num_handles[cur_scope] = current_handle - si->scope_handle_base[cur_scope];
+                cur_scope = si->scope_parent[cur_scope];
+                }
+        }
+
+xc->hier_ofs = hier_ofs_cache;
+return(si);
+}
+
+
+void fstReaderFreeHierScopeIndex(struct fstHierScopeIndex *si)
+{
+free(si);
+}
+
+
+/*
+ * the vars directly inside one scope of si (or outside any scope for
+ * FST_FLAT_HIER_NO_SCOPE), as an fstFlatHier without scopes.  child scopes
+ * are jumped over using si, so the cost is that of the scope's own records.
+ */
+struct fstFlatHier *fstReaderGetFlatHierScope(void *ctx, const struct fstHierScopeIndex *si, uint32_t scope)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstFlatHier *fh = NULL;
+uint64_t hier_ofs_cache, start, end;
+uint64_t vi = 0, ni = 0;
+fstHandle handle_base;
+int pass;
+
+if((!xc) || (!si) || ((!xc->hier_mem) && (!fstReaderLoadHier(xc)))) return(NULL);
+
+if(scope == FST_FLAT_HIER_NO_SCOPE)
+        {
+        start = 0;
+        end = xc->hier_len;
+        handle_base = 0;
+        }
+else
+if(scope < si->num_scopes)
+        {
+        start = si->scope_body_ofs[scope];
+        end = si->scope_end_ofs[scope];
+        handle_base = si->scope_handle_base[scope];
+        }
+else
+        {
+        return(NULL);
+        }
+
+if(end > xc->hier_len) end = xc->hier_len;
+
+hier_ofs_cache = xc->hier_ofs;
+
+for(pass=0;pass<2;pass++)       /* counts first, then fills */
+        {
+        uint32_t child = (scope == FST_FLAT_HIER_NO_SCOPE) ? 0 : (scope + 1);
+        fstHandle current_handle = handle_base;
+
+        if(pass)
+                {
+                if(!(fh = fstFlatHierAlloc(0, vi, ni))) break;
+                vi = ni = 0;
+                }
+
+        xc->hier_ofs = start;
+        while(xc->hier_ofs < end)
+                {
+                int tag = fstReaderHierGetc(xc);
+
+                if((tag >= FST_VT_MIN) && (tag <= FST_VT_MAX))
+                        {
+                        ni += fstFlatHierVar(xc, tag, fh, vi, ni, scope, &current_handle) + 1;
+                        vi++;
+                        }
+                else
+                if(tag == FST_ST_VCD_SCOPE)
+                        {
+                        /* scopes appear in index order, so this is child: jump past its upscope */
+                        uint32_t lo, hi;
+
+                        if((child >= si->num_scopes) || (si->scope_end_ofs[child] >= xc->hier_len) ||
+                                (xc->hier_mem[si->scope_end_ofs[child]] != FST_ST_VCD_UPSCOPE))
+                                {
+                                break;  /* the skim stopped inside it */
+                                }
+
+                        xc->hier_ofs = si->scope_end_ofs[child] + 1;
+                        current_handle += si->scope_num_handles[child];
+
+                        lo = child + 1;         /* next sibling is the first scope starting past it */
+                        hi = si->num_scopes;
+                        while(lo < hi)
+                                {
+                                uint32_t mid = lo + (hi - lo) / 2;
+
+                                if(si->scope_body_ofs[mid] < xc->hier_ofs) lo = mid + 1; else hi = mid;
+                                }
+                        child = lo;
+                        }
+                else
+                if(tag == FST_ST_GEN_ATTRBEGIN)
+                        {
+                        fstReaderHierSkipAttr(xc);
+                        }
+                else
+                if((tag != FST_ST_VCD_UPSCOPE) && (tag != FST_ST_GEN_ATTREND))
+                        {
+                        break;          /* same end condition as fstReaderIterateHier() */
+                        }
+                }
+        }
+
+xc->hier_ofs = hier_ofs_cache;
+return(fh);
+}
+
+
+int fstReaderProcessHier(void *ctx, FILE *fv)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+char *str;
+char *pnt;
+int scopetype;
+int vartype;
+uint32_t len, alias;
+/* uint32_t maxvalpos=0; */
+unsigned int num_signal_dyn = 65536;
+int attrtype, subtype;
+uint64_t attrarg;
+fstHandle maxhandle_scanbuild;
+
+if(!xc) return(0);
+
+xc->longest_signal_value_len = 32; /* arbitrarily set at 32...this is much longer than an expanded double */
+
+if(!xc->hier_mem)
+        {
+        if(!fstReaderLoadHier(xc))
+                {
+                return(0);
+                }
+        }
+
+str = (char *)malloc(FST_ID_NAM_ATTR_SIZ+1);
+
+if(fv)
+        {
+        char time_dimension[2] = {0, 0};
+        int time_scale = 1;
+
+        fprintf(fv, "$date\n\t%s\n$end\n", xc->date);
+        fprintf(fv, "$version\n\t%s\n$end\n", xc->version);
+        if(xc->timezero) fprintf(fv, "$timezero\n\t%" PRId64 "\n$end\n", xc->timezero);
+
+        switch(xc->timescale)
+                {
+                case  2:        time_scale = 100;               time_dimension[0] = 0;   break;
+                case  1:        time_scale = 10; /* fallthrough */
+                case  0:                                        time_dimension[0] = 0;   break;
+
+                case -1:        time_scale = 100;               time_dimension[0] = 'm'; break;
+                case -2:        time_scale = 10; /* fallthrough */
+                case -3:                                        time_dimension[0] = 'm'; break;
+
+                case -4:        time_scale = 100;               time_dimension[0] = 'u'; break;
+                case -5:        time_scale = 10; /* fallthrough */
+                case -6:                                        time_dimension[0] = 'u'; break;
+
+                case -10:       time_scale = 100;               time_dimension[0] = 'p'; break;
+                case -11:       time_scale = 10; /* fallthrough */
+                case -12:                                       time_dimension[0] = 'p'; break;
+
+                case -13:       time_scale = 100;               time_dimension[0] = 'f'; break;
+                case -14:       time_scale = 10; /* fallthrough */
+                case -15:                                       time_dimension[0] = 'f'; break;
+
+                case -16:       time_scale = 100;               time_dimension[0] = 'a'; break;
+                case -17:       time_scale = 10; /* fallthrough */
+                case -18:                                       time_dimension[0] = 'a'; break;
+
+                case -19:       time_scale = 100;               time_dimension[0] = 'z'; break;
+                case -20:       time_scale = 10; /* fallthrough */
+                case -21:                                       time_dimension[0] = 'z'; break;
+
+                case -7:        time_scale = 100;               time_dimension[0] = 'n'; break;
+                case -8:        time_scale = 10; /* fallthrough */
+                case -9:
+                default:                                        time_dimension[0] = 'n'; break;
+                }
+
+        if(fv) fprintf(fv, "$timescale\n\t%d%ss\n$end\n", time_scale, time_dimension);
+        }
+
+xc->maxhandle = 0;
+xc->num_alias = 0;
+
+fstReaderFreeUnshared(xc, xc->signal_lens);
+xc->signal_lens = (uint32_t *)malloc(num_signal_dyn*sizeof(uint32_t));
+
+fstReaderFreeUnshared(xc, xc->signal_typs);
+xc->signal_typs = (unsigned char *)malloc(num_signal_dyn*sizeof(unsigned char));
+
+xc->hier_ofs = 0;
+while(xc->hier_ofs < xc->hier_len)
+        {
+        int tag = fstReaderHierGetc(xc);
+        switch(tag)
+                {
+                case FST_ST_VCD_SCOPE:
+                        scopetype = fstReaderHierGetc(xc);
+                        if((scopetype < FST_ST_MIN) || (scopetype > FST_ST_MAX)) scopetype = FST_ST_VCD_MODULE;
+                        pnt = str;
+                        fstReaderHierName(xc, pnt, FST_ID_NAM_ATTR_SIZ); /* scopename */
+                        fstReaderHierName(xc, NULL, 0); /* scopecomp */
+
+                        if(fv) fprintf(fv, "$scope %s %s $end\n", modtypes[scopetype], str);
+                        break;
+
+                case FST_ST_VCD_UPSCOPE:
+                        if(fv) fprintf(fv, "$upscope $end\n");
+                        break;
+
+                case FST_ST_GEN_ATTRBEGIN:
+                        attrtype = fstReaderHierGetc(xc);
+                        subtype = fstReaderHierGetc(xc);
+                        pnt = str;
+                        fstReaderHierName(xc, pnt, FST_ID_NAM_ATTR_SIZ); /* attrname */
+
+                        if(!str[0]) { strcpy(str, "\"\""); }
+
+                        attrarg = fstReaderHierVarint64(xc);
+
+                        if(fv && xc->use_vcd_extensions)
+                                {
+                                switch(attrtype)
+                                        {
+                                        case FST_AT_ARRAY:      if((subtype < FST_AR_NONE) || (subtype > FST_AR_MAX)) subtype = FST_AR_NONE;
+                                                                fprintf(fv, "$attrbegin %s %s %s %" PRId64 " $end\n", attrtypes[attrtype], arraytypes[subtype], str, attrarg);
+                                                                break;
+                                        case FST_AT_ENUM:       if((subtype < FST_EV_SV_INTEGER) || (subtype > FST_EV_MAX)) subtype = FST_EV_SV_INTEGER;
+                                                                fprintf(fv, "$attrbegin %s %s %s %" PRId64 " $end\n", attrtypes[attrtype], enumvaluetypes[subtype], str, attrarg);
+                                                                break;
+                                        case FST_AT_PACK:       if((subtype < FST_PT_NONE) || (subtype > FST_PT_MAX)) subtype = FST_PT_NONE;
+                                                                fprintf(fv, "$attrbegin %s %s %s %" PRId64 " $end\n", attrtypes[attrtype], packtypes[subtype], str, attrarg);
+                                                                break;
+                                        case FST_AT_MISC:
+                                        default:                attrtype = FST_AT_MISC;
+                                                                if(subtype == FST_MT_COMMENT)
+                                                                        {
+                                                                        fprintf(fv, "$comment\n\t%s\n$end\n", str);
+                                                                        }
+                                                                        else
+                                                                        {
+                                                                        if((subtype == FST_MT_SOURCESTEM)||(subtype == FST_MT_SOURCEISTEM))
+                                                                                {
+                                                                                int sidx_skiplen_dummy = 0;
+                                                                                uint64_t sidx = fstGetVarint64((unsigned char *)str, &sidx_skiplen_dummy);
+
+                                                                                fprintf(fv, "$attrbegin %s %02x %" PRId64 " %" PRId64 " $end\n", attrtypes[attrtype], subtype, sidx, attrarg);
+                                                                                }
+                                                                                else
+                                                                                {
+                                                                                fprintf(fv, "$attrbegin %s %02x %s %" PRId64 " $end\n", attrtypes[attrtype], subtype, str, attrarg);
+                                                                                }
+                                                                        }
+                                                                break;
+                                        }
+                                }
+                        break;
+
+                case FST_ST_GEN_ATTREND:
+                        if(fv && xc->use_vcd_extensions) fprintf(fv, "$attrend $end\n");
+                        break;
+
+                case FST_VT_VCD_EVENT:
+                case FST_VT_VCD_INTEGER:
+                case FST_VT_VCD_PARAMETER:
+                case FST_VT_VCD_REAL:
+                case FST_VT_VCD_REAL_PARAMETER:
+                case FST_VT_VCD_REG:
+                case FST_VT_VCD_SUPPLY0:
+                case FST_VT_VCD_SUPPLY1:
+                case FST_VT_VCD_TIME:
+                case FST_VT_VCD_TRI:
+                case FST_VT_VCD_TRIAND:
+                case FST_VT_VCD_TRIOR:
+                case FST_VT_VCD_TRIREG:
+                case FST_VT_VCD_TRI0:
+                case FST_VT_VCD_TRI1:
+                case FST_VT_VCD_WAND:
+                case FST_VT_VCD_WIRE:
+                case FST_VT_VCD_WOR:
+                case FST_VT_VCD_PORT:
+                case FST_VT_VCD_SPARRAY:
+                case FST_VT_VCD_REALTIME:
+                case FST_VT_GEN_STRING:
+                case FST_VT_SV_BIT:
+                case FST_VT_SV_LOGIC:
+                case FST_VT_SV_INT:
+                case FST_VT_SV_SHORTINT:
+                case FST_VT_SV_LONGINT:
+                case FST_VT_SV_BYTE:
+                case FST_VT_SV_ENUM:
+                case FST_VT_SV_SHORTREAL:
+                        vartype = tag;
+                        /* vardir = */ fstReaderHierGetc(xc); /* unused in VCD reader, but need to advance read pointer */
+                        pnt = str;
+                        fstReaderHierName(xc, pnt, FST_ID_NAM_ATTR_SIZ); /* varname */
+                        len = (uint32_t)fstReaderHierVarint64(xc);
+                        alias = (uint32_t)fstReaderHierVarint64(xc);
+
+                        if(!alias)
+                                {
+                                if(xc->maxhandle == num_signal_dyn)
+                                        {
+                                        num_signal_dyn *= 2;
+                                        xc->signal_lens = (uint32_t *)realloc(xc->signal_lens, num_signal_dyn*sizeof(uint32_t));
+                                        xc->signal_typs = (unsigned char *)realloc(xc->signal_typs, num_signal_dyn*sizeof(unsigned char));
+                                        }
+                                xc->signal_lens[xc->maxhandle] = len;
+                                xc->signal_typs[xc->maxhandle] = vartype;
+
+                                /* maxvalpos+=len; */
+                                if(len > xc->longest_signal_value_len)
+                                        {
+                                        xc->longest_signal_value_len = len;
+                                        }
+
+                                if((vartype == FST_VT_VCD_REAL) || (vartype == FST_VT_VCD_REAL_PARAMETER) || (vartype == FST_VT_VCD_REALTIME) || (vartype == FST_VT_SV_SHORTREAL))
+                                        {
+                                        len = (vartype != FST_VT_SV_SHORTREAL) ? 64 : 32;
+                                        xc->signal_typs[xc->maxhandle] = FST_VT_VCD_REAL;
+                                        }
+                                if(fv)
+                                        {
+                                        char vcdid_buf[16];
+                                        uint32_t modlen = (vartype != FST_VT_VCD_PORT) ? len : ((len - 2) / 3);
+                                        fstVcdID(vcdid_buf, xc->maxhandle+1);
+                                        fprintf(fv, "$var %s %" PRIu32 " %s %s $end\n", vartypes[vartype], modlen, vcdid_buf, str);
+                                        }
+                                xc->maxhandle++;
+                                }
+                                else
+                                {
+                                if((vartype == FST_VT_VCD_REAL) || (vartype == FST_VT_VCD_REAL_PARAMETER) || (vartype == FST_VT_VCD_REALTIME) || (vartype == FST_VT_SV_SHORTREAL))
+                                        {
+                                        len = (vartype != FST_VT_SV_SHORTREAL) ? 64 : 32;
+                                        xc->signal_typs[xc->maxhandle] = FST_VT_VCD_REAL;
+                                        }
+                                if(fv)
+                                        {
+                                        char vcdid_buf[16];
+                                        uint32_t modlen = (vartype != FST_VT_VCD_PORT) ? len : ((len - 2) / 3);
+                                        fstVcdID(vcdid_buf, alias);
+                                        fprintf(fv, "$var %s %" PRIu32 " %s %s $end\n", vartypes[vartype], modlen, vcdid_buf, str);
+                                        }
+                                xc->num_alias++;
+                                }
+
+                        break;
+
+                default:
+                        break;
+                }
+        }
+if(fv) fprintf(fv, "$enddefinitions $end\n");
+
+maxhandle_scanbuild = xc->maxhandle ? xc->maxhandle : 1; /*scan-build warning suppression, in reality we have at least one signal */
+
+xc->signal_lens = (uint32_t *)realloc(xc->signal_lens, maxhandle_scanbuild*sizeof(uint32_t));
+xc->signal_typs = (unsigned char *)realloc(xc->signal_typs, maxhandle_scanbuild*sizeof(unsigned char));
+
+free(xc->process_mask);
+xc->process_mask = (unsigned char *)calloc(1, (maxhandle_scanbuild+7)/8);
+
+free(xc->temp_signal_value_buf);
+xc->temp_signal_value_buf = (unsigned char *)malloc(xc->longest_signal_value_len + 1);
+
+xc->var_count = xc->maxhandle + xc->num_alias;
+
+free(str);
+return(1);
+}
+
+
+/*
+ * section readers shared by the section scan in fstReaderInit() and by
+ * fstReaderLoadBlockIndex().  the I/O position is expected to be just past
+ * the section type and length.
+ */
+static int fstReaderReadHdrSection(struct fstReaderContext *xc)
+{
+int ch;
+double dcheck;
+
+xc->start_time = fstReaderIoUint64(xc);
+xc->end_time = fstReaderIoUint64(xc);
+
+fstReaderIoRead(xc, &dcheck, 8);
+xc->double_endian_match = (dcheck == FST_DOUBLE_ENDTEST);
+if(!xc->double_endian_match)
+        {
+        union   {
+                unsigned char rvs_buf[8];
+                double d;
+                } vu;
+
+        unsigned char *dcheck_alias = (unsigned char *)&dcheck;
+        int rvs_idx;
+
+        for(rvs_idx=0;rvs_idx<8;rvs_idx++)
+                {
+                vu.rvs_buf[rvs_idx] = dcheck_alias[7-rvs_idx];
+                }
+        if(vu.d != FST_DOUBLE_ENDTEST)
+                {
+                return(0);
+                }
+        }
+
+xc->mem_used_by_writer = fstReaderIoUint64(xc);
+xc->scope_count = fstReaderIoUint64(xc);
+xc->var_count = fstReaderIoUint64(xc);
+xc->maxhandle = fstReaderIoUint64(xc);
+xc->num_alias = xc->var_count - xc->maxhandle;
+xc->vc_section_count = fstReaderIoUint64(xc);
+ch = fstReaderIoGetc(xc);
+xc->timescale = (signed char)ch;
+fstReaderIoRead(xc, xc->version, FST_HDR_SIM_VERSION_SIZE);
+xc->version[FST_HDR_SIM_VERSION_SIZE] = 0;
+fstReaderIoRead(xc, xc->date, FST_HDR_DATE_SIZE);
+xc->date[FST_HDR_DATE_SIZE] = 0;
+ch = fstReaderIoGetc(xc);
+xc->filetype = (unsigned char)ch;
+xc->timezero = fstReaderIoUint64(xc);
+
+return(1);
+}
+
+
+static void fstReaderReadGeomSection(struct fstReaderContext *xc, uint64_t seclen)
+{
+uint64_t clen = seclen - 24;
+uint64_t uclen = fstReaderIoUint64(xc);
+unsigned char *ucdata = (unsigned char *)malloc(uclen);
+unsigned char *pnt = ucdata;
+unsigned int i;
+
+xc->contains_geom_section = 1;
+xc->maxhandle = fstReaderIoUint64(xc);
+xc->longest_signal_value_len = 32; /* arbitrarily set at 32...this is much longer than an expanded double */
+
+free(xc->process_mask);
+xc->process_mask = (unsigned char *)calloc(1, (xc->maxhandle+7)/8);
+
+if(clen != uclen)
+        {
+        unsigned char *cdata = (unsigned char *)malloc(clen);
+        unsigned long destlen = uclen;
+        unsigned long sourcelen = clen;
+        int rc;
+
+        fstReaderIoRead(xc, cdata, clen);
+        rc = uncompress(ucdata, &destlen, cdata, sourcelen);
+
+        if(rc != Z_OK)
+                {
+                fprintf(stderr, FST_APIMESS "fstReaderInit(), geom uncompress rc = %d, exiting.\n", rc);
+                exit(255);
+                }
+
+        free(cdata);
+        }
+        else
+        {
+        fstReaderIoRead(xc, ucdata, uclen);
+        }
+
+free(xc->signal_lens);
+xc->signal_lens = (uint32_t *)malloc(sizeof(uint32_t) * xc->maxhandle);
+free(xc->signal_typs);
+xc->signal_typs = (unsigned char *)malloc(sizeof(unsigned char) * xc->maxhandle);
+
+for(i=0;i<xc->maxhandle;i++)
+        {
+        int skiplen;
+        uint64_t val = fstGetVarint32(pnt, &skiplen);
+
+        pnt += skiplen;
+
+        if(val)
+                {
+                xc->signal_lens[i] = (val != 0xFFFFFFFF) ? val : 0;
+                xc->signal_typs[i] = FST_VT_VCD_WIRE;
+                if(xc->signal_lens[i] > xc->longest_signal_value_len)
+                        {
+                        xc->longest_signal_value_len = xc->signal_lens[i];
+                        }
+                }
+                else
+                {
+                xc->signal_lens[i] = 8; /* backpatch in real */
+                xc->signal_typs[i] = FST_VT_VCD_REAL;
+                /* xc->longest_signal_value_len handled above by overly large init size */
+                }
+        }
+
+free(xc->temp_signal_value_buf);
+xc->temp_signal_value_buf = (unsigned char *)malloc(xc->longest_signal_value_len + 1);
+
+free(ucdata);
+}
+
+
+static void fstReaderReadBlackoutSection(struct fstReaderContext *xc)
+{
+uint32_t i;
+uint64_t cur_bl = 0;
+uint64_t delta;
+
+xc->num_blackouts = fstReaderIoVarint32(xc);
+free(xc->blackout_times);
+xc->blackout_times = (uint64_t *)calloc(xc->num_blackouts, sizeof(uint64_t));
+free(xc->blackout_activity);
+xc->blackout_activity = (unsigned char *)calloc(xc->num_blackouts, sizeof(unsigned char));
+
+for(i=0;i<xc->num_blackouts;i++)
+        {
+        xc->blackout_activity[i] = fstReaderIoGetc(xc) != 0;
+        delta = fstReaderIoVarint64(xc);
+        cur_bl += delta;
+        xc->blackout_times[i] = cur_bl;
+        }
+}
+
+
+/* FST_BL_ZSTD_DICT, with the file positioned just past the section length */
+static void fstReaderReadZstdDictSection(struct fstReaderContext *xc, uint64_t seclen)
+{
+#ifdef HAVE_LIBZSTD
+uint64_t dlen = (seclen > 8) ? (seclen - 8) : 0;
+unsigned char *dict, *dict_alloc = NULL;
+
+if((!dlen) || (xc->zstd_ddict)) return;
+
+if(!(dict = fstReaderIoPeek(xc, dlen)))
+        {
+        dict = dict_alloc = (unsigned char *)malloc(dlen);
+        if(fstReaderIoRead(xc, dict, dlen) != dlen)
+                {
+                free(dict_alloc);
+                return;
+                }
+        }
+
+xc->zstd_ddict = ZSTD_createDDict(dict, dlen);
+free(dict_alloc);
+#else
+(void)xc; (void)seclen;
+#endif
+}
+
+
+/*
+ * block index: one entry per value change section, holding what
+ * fstReaderIterBlocks2() and the rvat functions would otherwise re-read
+ * from the section header and trailer on every call.
+ */
+static int fstReaderIndexBlock(struct fstReaderContext *xc, int sectype, fst_off_t pos, uint64_t seclen)
+{
+struct fstBlockIndexEntry *ent;
+
+if(!seclen) return(0);
+
+if(xc->blk_index_count == xc->blk_index_alloc)
+        {
+        xc->blk_index_alloc = xc->blk_index_alloc ? (xc->blk_index_alloc * 2) : 64;
+        xc->blk_index = (struct fstBlockIndexEntry *)realloc(xc->blk_index, xc->blk_index_alloc * sizeof(struct fstBlockIndexEntry));
+        }
+
+ent = xc->blk_index + xc->blk_index_count;
+ent->pos = pos;
+ent->seclen = seclen;
+ent->sectype = sectype;
+
+fstReaderIoSeek(xc, pos + 9, SEEK_SET);
+ent->beg_tim = fstReaderIoUint64(xc);
+ent->end_tim = fstReaderIoUint64(xc);
+ent->mem_required = fstReaderIoUint64(xc);
+
+if(fstReaderIoSeek(xc, pos + 1 + seclen - 24, SEEK_SET) != 0) return(0);
+ent->tsec_uclen = fstReaderIoUint64(xc);
+ent->tsec_clen = fstReaderIoUint64(xc);
+ent->tsec_nitems = fstReaderIoUint64(xc);
+if(ent->tsec_clen > seclen) return(0); /* corrupted tsec_clen: by definition it can't be larger than size of section */
+
+fstReaderIoSeek(xc, pos + 1 + seclen - 24 - ent->tsec_clen - 8, SEEK_SET);
+ent->chain_clen = fstReaderIoUint64(xc);
+
+xc->blk_index_count++;
+return(1);
+}
+
+
+/*
+ * first block index entry whose time range ends at or after tim, or
+ * blk_index_count if there is none.  blocks are written in time order so
+ * end_tim is monotonic across the index.
+ */
+static uint64_t fstReaderFindBlock(struct fstReaderContext *xc, uint64_t tim)
+{
+uint64_t lo = 0, hi = xc->blk_index_count;
+
+while(lo < hi)
+        {
+        uint64_t mid = lo + ((hi - lo) >> 1);
+
+        if(xc->blk_index[mid].end_tim < tim)
+                {
+                lo = mid + 1;
+                }
+                else
+                {
+                hi = mid;
+                }
+        }
+
+return(lo);
+}
+
+
+/*
+ * block index sidecar (<trace>.fstidx), only used when opened with
+ * FST_RD_OPEN_BLOCK_INDEX.  it is keyed to the trace by size, mtime, inode
+ * and a crc32 of the first and last FST_SIDECAR_PROBE_SIZE bytes (inode is
+ * always 0 and mtime only has one second resolution on windows) and ends in
+ * a struct fstSidecarFooter; any mismatch falls back to the full section
+ * scan, which then rewrites it.
+ */
+#define FST_BLKIDX_MAGIC        "FSTIDX"
+#define FST_BLKIDX_VERSION      (3)
+#define FST_BLKIDX_HDR_SIZE     (96)
+#define FST_BLKIDX_ENT_SIZE     (80)
+
+#define FST_SIDECAR_KEY_WORDS   (4)     /* stored from byte 8 of either sidecar */
+#define FST_SIDECAR_PROBE_SIZE  (4096)
+#define FST_SIDECAR_FOOTER_SIZE (16)
+
+struct fstSidecarFooter
+{
+uint64_t len;           /* whole sidecar, footer included */
+uint64_t crc;           /* crc32 of everything before the footer */
+};
+
+static void fstBlkIdxPut64(unsigned char *pnt, uint64_t v)
+{
+int i;
+
+for(i=7;i>=0;i--)
+        {
+        pnt[i] = v & 0xff;
+        v >>= 8;
+        }
+}
+
+
+static uint64_t fstBlkIdxGet64(const unsigned char *pnt)
+{
+uint64_t val = 0;
+int i;
+
+for(i=0;i<8;i++)
+        {
+        val <<= 8;
+        val |= pnt[i];
+        }
+
+return(val);
+}
+
+
+static char *fstReaderBlockIndexName(struct fstReaderContext *xc, const char *suffix)
+{
+int flen = strlen(xc->filename);
+char *nam = (char *)malloc(flen + strlen(suffix) + 1);
+
+memcpy(nam, xc->filename, flen);
+strcpy(nam + flen, suffix);
+
+return(nam);
+}
+
+
+static int fstReaderBlockIndexKey(struct fstReaderContext *xc, uint64_t *key)
+{
+#ifdef _MSC_VER
+struct _stat64 sb;
+#else
+struct stat sb;
+#endif
+unsigned char *probe;
+uint64_t plen;
+uLong crc = crc32(0, NULL, 0);
+FILE *f;
+int rc = 0;
+
+#ifdef _MSC_VER
+if(_stat64(xc->filename, &sb)) return(0);
+#else
+if(stat(xc->filename, &sb)) return(0);
+#endif
+
+key[0] = (uint64_t)sb.st_size;
+key[1] = (uint64_t)sb.st_mtime;
+key[2] = (uint64_t)sb.st_ino;
+
+/* header block at the front, geometry and hierarchy usually at the back */
+plen = (key[0] < FST_SIDECAR_PROBE_SIZE) ? key[0] : FST_SIDECAR_PROBE_SIZE;
+probe = (unsigned char *)malloc(FST_SIDECAR_PROBE_SIZE);
+f = fopen(xc->filename, "rb");
+if(probe && f)
+        {
+        rc = (plen == 0);
+        if((!rc) && (fstFread(probe, plen, 1, f) == 1))
+                {
+                crc = crc32(crc, probe, plen);
+                if((!fseeko(f, (fst_off_t)(key[0] - plen), SEEK_SET)) && (fstFread(probe, plen, 1, f) == 1))
+                        {
+                        crc = crc32(crc, probe, plen);
+                        rc = 1;
+                        }
+                }
+        }
+if(f) fclose(f);
+free(probe);
+
+key[3] = (uint64_t)crc;
+
+return(rc);
+}
+
+
+static void fstSidecarPutKey(unsigned char *buf, const uint64_t *key)
+{
+int i;
+
+for(i=0;i<FST_SIDECAR_KEY_WORDS;i++)
+        {
+        fstBlkIdxPut64(buf + 8 + i * 8, key[i]);
+        }
+}
+
+
+static int fstSidecarKeyMatches(const unsigned char *buf, const uint64_t *key)
+{
+int i;
+
+for(i=0;i<FST_SIDECAR_KEY_WORDS;i++)
+        {
+        if(fstBlkIdxGet64(buf + 8 + i * 8) != key[i]) return(0);
+        }
+
+return(1);
+}
+
+
+/* seals a sidecar buffer whose last FST_SIDECAR_FOOTER_SIZE bytes are reserved */
+static void fstSidecarPutFooter(unsigned char *buf, size_t blen)
+{
+struct fstSidecarFooter ft;
+
+ft.len = blen;
+ft.crc = crc32(0, buf, blen - FST_SIDECAR_FOOTER_SIZE);
+
+fstBlkIdxPut64(buf + blen - FST_SIDECAR_FOOTER_SIZE, ft.len);
+fstBlkIdxPut64(buf + blen - FST_SIDECAR_FOOTER_SIZE + 8, ft.crc);
+}
+
+
+static int fstSidecarFooterValid(const unsigned char *buf, size_t flen)
+{
+struct fstSidecarFooter ft;
+
+if(flen < FST_SIDECAR_FOOTER_SIZE) return(0);
+
+ft.len = fstBlkIdxGet64(buf + flen - FST_SIDECAR_FOOTER_SIZE);
+ft.crc = fstBlkIdxGet64(buf + flen - FST_SIDECAR_FOOTER_SIZE + 8);
+
+return((ft.len == flen) && (ft.crc == (uint64_t)crc32(0, buf, flen - FST_SIDECAR_FOOTER_SIZE)));
+}
+
+
+static int fstReaderLoadBlockIndex(struct fstReaderContext *xc)
+{
+char *nam;
+FILE *f;
+unsigned char *buf = NULL;
+long flen;
+uint64_t key[FST_SIDECAR_KEY_WORDS];
+uint64_t i, cnt;
+fst_off_t geom_pos, blackout_pos, zstd_dict_pos;
+int hier_type;
+int rc = 0;
+
+if((!xc->filename) || (!fstReaderBlockIndexKey(xc, key))) return(0);
+
+nam = fstReaderBlockIndexName(xc, ".fstidx");
+f = fopen(nam, "rb");
+free(nam);
+if(!f) return(0);
+
+if((!fseeko(f, 0, SEEK_END)) && ((flen = ftello(f)) >= (FST_BLKIDX_HDR_SIZE + FST_SIDECAR_FOOTER_SIZE)) && (!fseeko(f, 0, SEEK_SET)))
+        {
+        buf = (unsigned char *)malloc(flen);
+        if(fstFread(buf, flen, 1, f) != 1)
+                {
+                free(buf); buf = NULL;
+                }
+        }
+fclose(f);
+if(!buf) return(0);
+
+if(memcmp(buf, FST_BLKIDX_MAGIC, 6) || (buf[6] != 0) || (buf[7] != FST_BLKIDX_VERSION)) goto bail;
+if((!fstSidecarFooterValid(buf, flen)) || (!fstSidecarKeyMatches(buf, key))) goto bail;
+
+cnt = fstBlkIdxGet64(buf + 80);
+if((uint64_t)flen != (FST_BLKIDX_HDR_SIZE + cnt * FST_BLKIDX_ENT_SIZE + FST_SIDECAR_FOOTER_SIZE)) goto bail;
+
+/* header is re-read from the trace, everything else comes from the index */
+fstReaderIoSeek(xc, 0, SEEK_SET);
+if((fstReaderIoGetc(xc) != FST_BL_HDR) || (!fstReaderIoUint64(xc)) || (!fstReaderReadHdrSection(xc))) goto bail;
+if((xc->start_time == 0) && (xc->end_time == 0)) goto bail;
+
+xc->vc_section_count = fstBlkIdxGet64(buf + 40);
+geom_pos = fstBlkIdxGet64(buf + 48);
+xc->hier_pos = fstBlkIdxGet64(buf + 56);
+hier_type = fstBlkIdxGet64(buf + 64);
+blackout_pos = fstBlkIdxGet64(buf + 72);
+zstd_dict_pos = fstBlkIdxGet64(buf + 88);
+
+if(geom_pos)
+        {
+        uint64_t seclen;
+
+        fstReaderIoSeek(xc, geom_pos, SEEK_SET);
+        if(fstReaderIoGetc(xc) != FST_BL_GEOM) goto bail;
+        seclen = fstReaderIoUint64(xc);
+        fstReaderReadGeomSection(xc, seclen);
+        xc->geom_pos = geom_pos;
+        }
+
+switch(hier_type)
+        {
+        case FST_BL_HIER:               xc->contains_hier_section = 1; break;
+        case FST_BL_HIER_LZ4DUO:        xc->contains_hier_section_lz4duo = 1; /* fallthrough */
+        case FST_BL_HIER_LZ4:           xc->contains_hier_section_lz4 = 1; break;
+        case FST_BL_HIER_ZSTD:          xc->contains_hier_section_zstd = 1; break;
+        default:                        break;
+        }
+
+if(blackout_pos)
+        {
+        fstReaderIoSeek(xc, blackout_pos, SEEK_SET);
+        if(fstReaderIoGetc(xc) != FST_BL_BLACKOUT) goto bail;
+        fstReaderIoUint64(xc);
+        fstReaderReadBlackoutSection(xc);
+        xc->blackout_pos = blackout_pos;
+        }
+
+if(zstd_dict_pos)
+        {
+        uint64_t seclen;
+
+        fstReaderIoSeek(xc, zstd_dict_pos, SEEK_SET);
+        if(fstReaderIoGetc(xc) != FST_BL_ZSTD_DICT) goto bail;
+        seclen = fstReaderIoUint64(xc);
+        fstReaderReadZstdDictSection(xc, seclen);
+        xc->zstd_dict_pos = zstd_dict_pos;
+        }
+
+free(xc->blk_index);
+xc->blk_index = (struct fstBlockIndexEntry *)calloc(cnt ? cnt : 1, sizeof(struct fstBlockIndexEntry));
+xc->blk_index_alloc = cnt ? cnt : 1;
+xc->blk_index_count = cnt;
+for(i=0;i<cnt;i++)
+        {
+        const unsigned char *pnt = buf + FST_BLKIDX_HDR_SIZE + i * FST_BLKIDX_ENT_SIZE;
+        struct fstBlockIndexEntry *ent = xc->blk_index + i;
+
+        ent->pos = fstBlkIdxGet64(pnt);
+        ent->seclen = fstBlkIdxGet64(pnt + 8);
+        ent->beg_tim = fstBlkIdxGet64(pnt + 16);
+        ent->end_tim = fstBlkIdxGet64(pnt + 24);
+        ent->mem_required = fstBlkIdxGet64(pnt + 32);
+        ent->tsec_uclen = fstBlkIdxGet64(pnt + 40);
+        ent->tsec_clen = fstBlkIdxGet64(pnt + 48);
+        ent->tsec_nitems = fstBlkIdxGet64(pnt + 56);
+        ent->chain_clen = fstBlkIdxGet64(pnt + 64);
+        ent->sectype = pnt[72];
+        }
+
+rc = 1;
+
+bail:
+free(buf);
+return(rc);
+}
+
+
+/* write-then-rename so concurrent readers never see a partial index */
+static void fstReaderWriteSidecar(struct fstReaderContext *xc, const char *suffix, const unsigned char *buf, size_t blen)
+{
+char *nam = fstReaderBlockIndexName(xc, suffix);
+int nlen = strlen(nam) + 32;
+char *tmpnam = (char *)malloc(nlen);
+FILE *f;
+
+snprintf(tmpnam, nlen, "%s.%d", nam, (int)getpid());
+f = fopen(tmpnam, "wb");
+if(f)
+        {
+        int ok = (fstFwrite(buf, blen, 1, f) == 1);
+
+        ok = (fclose(f) == 0) && ok;
+        if((!ok) || rename(tmpnam, nam))
+                {
+                unlink(tmpnam);
+                }
+        }
+
+free(tmpnam);
+free(nam);
+}
+
+
+static void fstReaderSaveBlockIndex(struct fstReaderContext *xc)
+{
+uint64_t key[FST_SIDECAR_KEY_WORDS];
+uint64_t i;
+size_t blen = FST_BLKIDX_HDR_SIZE + xc->blk_index_count * FST_BLKIDX_ENT_SIZE + FST_SIDECAR_FOOTER_SIZE;
+unsigned char *buf;
+int hier_type = 0;
+
+if((!xc->filename) || (!fstReaderBlockIndexKey(xc, key))) return;
+
+if(xc->contains_hier_section_zstd) hier_type = FST_BL_HIER_ZSTD;
+else if(xc->contains_hier_section_lz4duo) hier_type = FST_BL_HIER_LZ4DUO;
+else if(xc->contains_hier_section_lz4) hier_type = FST_BL_HIER_LZ4;
+else if(xc->contains_hier_section) hier_type = FST_BL_HIER;
+
+buf = (unsigned char *)calloc(1, blen);
+memcpy(buf, FST_BLKIDX_MAGIC, 6);
+buf[7] = FST_BLKIDX_VERSION;
+fstSidecarPutKey(buf, key);
+fstBlkIdxPut64(buf + 40, xc->vc_section_count);
+fstBlkIdxPut64(buf + 48, xc->geom_pos);
+fstBlkIdxPut64(buf + 56, xc->hier_pos);
+fstBlkIdxPut64(buf + 64, hier_type);
+fstBlkIdxPut64(buf + 72, xc->blackout_pos);
+fstBlkIdxPut64(buf + 80, xc->blk_index_count);
+fstBlkIdxPut64(buf + 88, xc->zstd_dict_pos);
+
+for(i=0;i<xc->blk_index_count;i++)
+        {
+        unsigned char *pnt = buf + FST_BLKIDX_HDR_SIZE + i * FST_BLKIDX_ENT_SIZE;
+        struct fstBlockIndexEntry *ent = xc->blk_index + i;
+
+        fstBlkIdxPut64(pnt, ent->pos);
+        fstBlkIdxPut64(pnt + 8, ent->seclen);
+        fstBlkIdxPut64(pnt + 16, ent->beg_tim);
+        fstBlkIdxPut64(pnt + 24, ent->end_tim);
+        fstBlkIdxPut64(pnt + 32, ent->mem_required);
+        fstBlkIdxPut64(pnt + 40, ent->tsec_uclen);
+        fstBlkIdxPut64(pnt + 48, ent->tsec_clen);
+        fstBlkIdxPut64(pnt + 56, ent->tsec_nitems);
+        fstBlkIdxPut64(pnt + 64, ent->chain_clen);
+        pnt[72] = ent->sectype;
+        }
+
+fstSidecarPutFooter(buf, blen);
+
+fstReaderWriteSidecar(xc, ".fstidx", buf, blen);
+free(buf);
+}
+
+
+/*
+ * gzip access point index for FST_BL_ZWRAPPER traces, see fstReaderGzFill().
+ * with FST_RD_OPEN_BLOCK_INDEX it is kept in a <trace>.fstgzidx sidecar,
+ * keyed and checked like the block index, so only the first open inflates
+ * the whole stream.
+ */
+#define FST_GZIDX_MAGIC         "FSTGZX"
+#define FST_GZIDX_VERSION       (2)
+#define FST_GZIDX_HDR_SIZE      (56)
+#define FST_GZIDX_ENT_SIZE      (32)    /* followed by win_clen bytes of window */
+
+/* window is the circular inflate output, the oldest byte at window + FST_GZ_WINSIZE - left */
+static int fstGzIndexAddPoint(struct fstGzIndex *idx, uint64_t out, uint64_t in, int bits,
+        const unsigned char *window, unsigned int left, unsigned char *scratch)
+{
+struct fstGzPoint *pt;
+uLong wlen = (out < FST_GZ_WINSIZE) ? (uLong)out : FST_GZ_WINSIZE;
+
+if(idx->count == idx->alloc)
+        {
+        uint64_t nalloc = idx->alloc ? (idx->alloc * 2) : 64;
+        struct fstGzPoint *npoints = (struct fstGzPoint *)realloc(idx->points, nalloc * sizeof(struct fstGzPoint));
+
+        if(!npoints) return(0);
+        idx->points = npoints;
+        idx->alloc = nalloc;
+        }
+
+pt = idx->points + idx->count;
+memset(pt, 0, sizeof(struct fstGzPoint));
+pt->out = out;
+pt->in = in;
+pt->bits = bits;
+
+if(wlen)
+        {
+        uLongf clen = compressBound(wlen);
+        unsigned char *cmem = (unsigned char *)malloc(clen);
+
+        memcpy(scratch, window + FST_GZ_WINSIZE - left, left);
+        memcpy(scratch + left, window, FST_GZ_WINSIZE - left);
+        if((!cmem) || (compress2(cmem, &clen, scratch + FST_GZ_WINSIZE - wlen, wlen, 1) != Z_OK))
+                {
+                free(cmem);
+                return(0);
+                }
+        pt->win = (unsigned char *)realloc(cmem, clen);
+        pt->win_clen = clen;
+        }
+
+idx->count++;
+return(1);
+}
+
+
+/* one pass over the gzip stream at FST_ZWRAPPER_HDR_SIZE, nothing is written out */
+static struct fstGzIndex *fstReaderGzBuildIndex(struct fstReaderContext *xc, uint64_t uclen)
+{
+struct fstGzIndex *idx = (struct fstGzIndex *)calloc(1, sizeof(struct fstGzIndex));
+unsigned char *ibuf = (unsigned char *)malloc(FST_GZIO_LEN);
+unsigned char *window = (unsigned char *)malloc(FST_GZ_WINSIZE * 2);
+uint64_t totin = 0, totout = 0, last = 0;
+z_stream strm;
+int ret = Z_OK;
+int pass_status = 0;
+
+memset(&strm, 0, sizeof(z_stream));
+idx->uclen = uclen;
+
+if((!fstReaderFseeko(xc, xc->f, FST_ZWRAPPER_HDR_SIZE, SEEK_SET)) && (inflateInit2(&strm, 15 + 16) == Z_OK))
+        {
+        do
+                {
+                if(!strm.avail_in)
+                        {
+                        size_t rd = fread(ibuf, 1, FST_GZIO_LEN, xc->f);
+
+                        if(!rd) break;
+                        strm.next_in = ibuf;
+                        strm.avail_in = rd;
+                        }
+                if(!strm.avail_out)
+                        {
+                        strm.next_out = window;
+                        strm.avail_out = FST_GZ_WINSIZE;
+                        }
+
+                totin += strm.avail_in;
+                totout += strm.avail_out;
+                ret = inflate(&strm, Z_BLOCK);
+                totin -= strm.avail_in;
+                totout -= strm.avail_out;
+                if((ret != Z_OK) && (ret != Z_STREAM_END)) break;
+
+                /* at the end of the gzip header or of a deflate block, at most 7 bits of what follows were consumed */
+                if((strm.data_type & 128) && (!(strm.data_type & 64)) && ((!idx->count) || (totout - last >= FST_GZ_SPAN)))
+                        {
+                        if(!fstGzIndexAddPoint(idx, totout, totin, strm.data_type & 7, window, strm.avail_out, window + FST_GZ_WINSIZE)) break;
+                        last = totout;
+                        }
+                } while(ret != Z_STREAM_END);
+
+        inflateEnd(&strm);
+        pass_status = (ret == Z_STREAM_END) && (totout == uclen) && (idx->count) && (!idx->points[0].out);
+        }
+
+free(window);
+free(ibuf);
+
+if(!pass_status)
+        {
+        fstGzIndexFree(idx);
+        idx = NULL;
+        }
+
+return(idx);
+}
+
+
+static struct fstGzIndex *fstReaderLoadGzIndex(struct fstReaderContext *xc, uint64_t uclen)
+{
+struct fstGzIndex *idx = NULL;
+char *nam;
+FILE *f;
+unsigned char *buf = NULL;
+const unsigned char *pnt, *end;
+long flen;
+uint64_t key[FST_SIDECAR_KEY_WORDS];
+uint64_t i, cnt;
+
+if((!xc->filename) || (!fstReaderBlockIndexKey(xc, key))) return(NULL);
+
+nam = fstReaderBlockIndexName(xc, ".fstgzidx");
+f = fopen(nam, "rb");
+free(nam);
+if(!f) return(NULL);
+
+if((!fseeko(f, 0, SEEK_END)) && ((flen = ftello(f)) >= (FST_GZIDX_HDR_SIZE + FST_SIDECAR_FOOTER_SIZE)) && (!fseeko(f, 0, SEEK_SET)))
+        {
+        buf = (unsigned char *)malloc(flen);
+        if(fstFread(buf, flen, 1, f) != 1)
+                {
+                free(buf); buf = NULL;
+                }
+        }
+fclose(f);
+if(!buf) return(NULL);
+
+if(memcmp(buf, FST_GZIDX_MAGIC, 6) || (buf[6] != 0) || (buf[7] != FST_GZIDX_VERSION)) goto bail;
+if((!fstSidecarFooterValid(buf, flen)) || (!fstSidecarKeyMatches(buf, key))) goto bail;
+if(fstBlkIdxGet64(buf + 40) != uclen) goto bail;
+
+cnt = fstBlkIdxGet64(buf + 48);
+if((!cnt) || (cnt > (uint64_t)flen / FST_GZIDX_ENT_SIZE)) goto bail;
+
+idx = (struct fstGzIndex *)calloc(1, sizeof(struct fstGzIndex));
+idx->points = (struct fstGzPoint *)calloc(cnt, sizeof(struct fstGzPoint));
+idx->alloc = cnt;
+idx->uclen = uclen;
+
+pnt = buf + FST_GZIDX_HDR_SIZE;
+end = buf + flen - FST_SIDECAR_FOOTER_SIZE;
+for(i=0;i<cnt;i++)
+        {
+        struct fstGzPoint *pt = idx->points + i;
+
+        if((end - pnt) < FST_GZIDX_ENT_SIZE) goto bail;
+        pt->out = fstBlkIdxGet64(pnt);
+        pt->in = fstBlkIdxGet64(pnt + 8);
+        pt->bits = fstBlkIdxGet64(pnt + 16);
+        pt->win_clen = fstBlkIdxGet64(pnt + 24);
+        pnt += FST_GZIDX_ENT_SIZE;
+        idx->count = i + 1;
+
+        if((pt->bits > 7) || (pt->out > uclen) || ((uint64_t)(end - pnt) < pt->win_clen)) goto bail;
+        if(i ? (pt->out <= pt[-1].out) : (pt->out != 0)) goto bail;
+        if(pt->win_clen)
+                {
+                pt->win = (unsigned char *)malloc(pt->win_clen);
+                memcpy(pt->win, pnt, pt->win_clen);
+                pnt += pt->win_clen;
+                }
+        }
+if(pnt != end) goto bail;
+
+free(buf);
+return(idx);
+
+bail:
+free(buf);
+fstGzIndexFree(idx);
+return(NULL);
+}
+
+
+static void fstReaderSaveGzIndex(struct fstReaderContext *xc)
+{
+struct fstGzIndex *idx = xc->gz_index;
+uint64_t key[FST_SIDECAR_KEY_WORDS];
+uint64_t i;
+size_t blen = FST_GZIDX_HDR_SIZE + FST_SIDECAR_FOOTER_SIZE;
+unsigned char *buf, *pnt;
+
+if((!xc->filename) || (!fstReaderBlockIndexKey(xc, key))) return;
+
+for(i=0;i<idx->count;i++)
+        {
+        blen += FST_GZIDX_ENT_SIZE + idx->points[i].win_clen;
+        }
+
+buf = (unsigned char *)calloc(1, blen);
+memcpy(buf, FST_GZIDX_MAGIC, 6);
+buf[7] = FST_GZIDX_VERSION;
+fstSidecarPutKey(buf, key);
+fstBlkIdxPut64(buf + 40, idx->uclen);
+fstBlkIdxPut64(buf + 48, idx->count);
+
+pnt = buf + FST_GZIDX_HDR_SIZE;
+for(i=0;i<idx->count;i++)
+        {
+        struct fstGzPoint *pt = idx->points + i;
+
+        fstBlkIdxPut64(pnt, pt->out);
+        fstBlkIdxPut64(pnt + 8, pt->in);
+        fstBlkIdxPut64(pnt + 16, pt->bits);
+        fstBlkIdxPut64(pnt + 24, pt->win_clen);
+        pnt += FST_GZIDX_ENT_SIZE;
+        if(pt->win_clen)
+                {
+                memcpy(pnt, pt->win, pt->win_clen);
+                pnt += pt->win_clen;
+                }
+        }
+
+fstSidecarPutFooter(buf, blen);
+
+fstReaderWriteSidecar(xc, ".fstgzidx", buf, blen);
+free(buf);
+}
+
+
+/*
+ * sets up in-place reading of a FST_BL_ZWRAPPER trace, xc->f being just
+ * past the section type.  on failure xc->f is put back there so the caller
+ * can unpack it to a temp file instead.
+ */
+static int fstReaderGzOpen(struct fstReaderContext *xc)
+{
+struct fstGzIndex *idx = NULL;
+uint64_t seclen = fstReaderUint64(xc->f);
+uint64_t uclen = fstReaderUint64(xc->f);
+int built = 0;
+
+if(seclen)
+        {
+        if(xc->use_blk_index_sidecar)
+                {
+                idx = fstReaderLoadGzIndex(xc, uclen);
+                }
+        if(!idx)
+                {
+                idx = fstReaderGzBuildIndex(xc, uclen);
+                built = (idx != NULL);
+                }
+        }
+
+xc->gz_index = idx;
+if((!idx) || (!fstReaderGzCursorInit(xc)))
+        {
+        fstGzIndexFree(idx);
+        xc->gz_index = NULL;
+        fstReaderFseeko(xc, xc->f, 1, SEEK_SET);
+        return(0);
+        }
+
+xc->is_zwrapped = 1;
+if((built) && (xc->use_blk_index_sidecar))
+        {
+        fstReaderSaveGzIndex(xc);
+        }
+
+return(1);
+}
+
+
+/*
+ * reader file open/close functions
+ */
+int fstReaderInit(struct fstReaderContext *xc)
+{
+fst_off_t blkpos = 0;
+fst_off_t endfile;
+uint64_t seclen;
+int sectype;
+uint64_t vc_section_count_actual = 0;
+int hdr_incomplete = 0;
+int hdr_seen = 0;
+int gzread_pass_status = 1;
+
+sectype = fgetc(xc->f);
+if((sectype == FST_BL_ZWRAPPER) && (!xc->gz_unpack) && (fstReaderGzOpen(xc)))
+        {
+        /* read in place through the gzip access point index */
+        }
+else
+if(sectype == FST_BL_ZWRAPPER)
+        {
+        FILE *fcomp;
+        fst_off_t offpnt, uclen;
+        char gz_membuf[FST_GZIO_LEN];
+        gzFile zhandle;
+        int zfd;
+        int flen = strlen(xc->filename);
+        char *hf;
+	int hf_len;
+
+        seclen = fstReaderUint64(xc->f);
+        uclen = fstReaderUint64(xc->f);
+
+        if(!seclen) return(0); /* not finished compressing, this is a failed read */
+
+	hf_len = flen + 16 + 32 + 1;
+        hf = (char *)calloc(1, hf_len);
+
+        snprintf(hf, hf_len, "%s.upk_%d_%p", xc->filename, getpid(), (void *)xc);
+        fcomp = fopen(hf, "w+b");
+        if(!fcomp)
+                {
+                fcomp = tmpfile_open(&xc->f_nam);
+                free(hf); hf = NULL;
+                if(!fcomp) { tmpfile_close(&fcomp, &xc->f_nam); return(0); }
+                }
+
+#if defined(FST_UNBUFFERED_IO)
+        setvbuf(fcomp, (char *)NULL, _IONBF, 0);   /* keeps gzip from acting weird in tandem with fopen */
+#endif
+
+#ifdef __MINGW32__
+        xc->filename_unpacked = hf;
+#else
+        if(hf)
+                {
+                unlink(hf);
+                free(hf);
+                }
+#endif
+
+        fstReaderFseeko(xc, xc->f, FST_ZWRAPPER_HDR_SIZE, SEEK_SET);
+#ifndef __MINGW32__
+        fflush(xc->f);
+#else
+	/* Windows UCRT runtime library reads one byte ahead in the file
+	   even with buffering disabled and does not synchronise the
+	   file position after fseek. */
+	_lseek(fileno(xc->f), FST_ZWRAPPER_HDR_SIZE, SEEK_SET);
+#endif
+
+        zfd = dup(fileno(xc->f));
+        zhandle = gzdopen(zfd, "rb");
+        if(zhandle)
+                {
+                for(offpnt = 0; offpnt < uclen; offpnt += FST_GZIO_LEN)
+                        {
+                        size_t this_len = ((uclen - offpnt) > FST_GZIO_LEN) ? FST_GZIO_LEN : (uclen - offpnt);
+                        size_t gzreadlen = gzread(zhandle, gz_membuf, this_len);
+                        size_t fwlen;
+
+                        if(gzreadlen != this_len)
+                                {
+                                gzread_pass_status = 0;
+                                break;
+                                }
+                        fwlen = fstFwrite(gz_membuf, this_len, 1, fcomp);
+                        if(fwlen != 1)
+                                {
+                                gzread_pass_status = 0;
+                                break;
+                                }
+                        }
+                gzclose(zhandle);
+                }
+                else
+                {
+                close(zfd);
+                }
+        fflush(fcomp);
+        fclose(xc->f);
+        xc->f = fcomp;
+        xc->is_zwrapped = 1;
+        }
+
+if(gzread_pass_status)
+        {
+        if(!xc->mmap_disabled)
+                {
+                fstReaderMapFile(xc);
+                }
+
+        if((xc->use_blk_index_sidecar) && (fstReaderLoadBlockIndex(xc)))
+                {
+                hdr_seen = 1;
+                }
+                else
+                {
+                int blk_index_done = 0;
+
+                fstReaderIoSeek(xc, 0, SEEK_END);
+                endfile = fstReaderIoTell(xc);
+
+                while(blkpos < endfile)
+                        {
+                        fstReaderIoSeek(xc, blkpos, SEEK_SET);
+
+                        sectype = fstReaderIoGetc(xc);
+                        seclen = fstReaderIoUint64(xc);
+
+                        if(sectype == EOF)
+                                {
+                                break;
+                                }
+
+                        if((hdr_incomplete) && (!seclen))
+                                {
+                                break;
+                                }
+
+                        if(!hdr_seen && (sectype != FST_BL_HDR))
+                                {
+                                break;
+                                }
+
+                        blkpos++;
+                        if(sectype == FST_BL_HDR)
+                                {
+                                if(!hdr_seen)
+                                        {
+                                        if(!fstReaderReadHdrSection(xc))
+                                                {
+                                                break; /* either corrupt file or wrong architecture (offset +33 also functions as matchword) */
+                                                }
+
+                                        hdr_incomplete = (xc->start_time == 0) && (xc->end_time == 0);
+                                        hdr_seen = 1;
+                                        }
+                                }
+                        else if((sectype == FST_BL_VCDATA) || (sectype == FST_BL_VCDATA_DYN_ALIAS) || (sectype == FST_BL_VCDATA_DYN_ALIAS2))
+                                {
+                                if(hdr_incomplete)
+                                        {
+                                        uint64_t bt = fstReaderIoUint64(xc);
+                                        xc->end_time = fstReaderIoUint64(xc);
+
+                                        if(!vc_section_count_actual) { xc->start_time = bt; }
+                                        }
+
+                                if(!blk_index_done)
+                                        {
+                                        blk_index_done = !fstReaderIndexBlock(xc, sectype, blkpos - 1, seclen);
+                                        }
+
+                                vc_section_count_actual++;
+                                }
+                        else if(sectype == FST_BL_GEOM)
+                                {
+                                if(!hdr_incomplete)
+                                        {
+                                        fstReaderReadGeomSection(xc, seclen);
+                                        xc->geom_pos = blkpos - 1;
+                                        }
+                                }
+                        else if(sectype == FST_BL_HIER)
+                                {
+                                xc->contains_hier_section = 1;
+                                xc->hier_pos = fstReaderIoTell(xc);
+                                }
+                        else if(sectype == FST_BL_HIER_LZ4DUO)
+                                {
+                                xc->contains_hier_section_lz4    = 1;
+                                xc->contains_hier_section_lz4duo = 1;
+                                xc->hier_pos = fstReaderIoTell(xc);
+                                }
+                        else if(sectype == FST_BL_HIER_LZ4)
+                                {
+                                xc->contains_hier_section_lz4 = 1;
+                                xc->hier_pos = fstReaderIoTell(xc);
+                                }
+                        else if(sectype == FST_BL_HIER_ZSTD)
+                                {
+                                xc->contains_hier_section_zstd = 1;
+                                xc->hier_pos = fstReaderIoTell(xc);
+                                }
+                        else if(sectype == FST_BL_ZSTD_DICT)
+                                {
+                                fstReaderReadZstdDictSection(xc, seclen);
+                                xc->zstd_dict_pos = blkpos - 1;
+                                }
+                        else if(sectype == FST_BL_BLACKOUT)
+                                {
+                                fstReaderReadBlackoutSection(xc);
+                                xc->blackout_pos = blkpos - 1;
+                                }
+                        else if(sectype == FST_BL_SKIP)
+                                {
+                                blk_index_done = 1; /* block still being written: iteration stops here */
+                                }
+
+                        blkpos += seclen;
+                        if(!hdr_seen) break;
+                        }
+
+                if(hdr_seen)
+                        {
+                        if(xc->vc_section_count != vc_section_count_actual)
+                                {
+                                xc->vc_section_count = vc_section_count_actual;
+                                }
+
+                        if((xc->use_blk_index_sidecar) && (!hdr_incomplete))
+                                {
+                                fstReaderSaveBlockIndex(xc);
+                                }
+                        }
+                }
+
+        if(hdr_seen)
+                {
+                if(!xc->contains_geom_section)
+                        {
+                        fstReaderProcessHier(xc, NULL); /* recreate signal_lens/signal_typs info */
+                        }
+                }
+        }
+
+return(hdr_seen);
+}
+
+
+void *fstReaderOpenForUtilitiesOnly(void)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)calloc(1, sizeof(struct fstReaderContext));
+
+return(xc);
+}
+
+
+void *fstReaderOpen(const char *nam)
+{
+return(fstReaderOpen2(nam, FST_RD_OPEN_DEFAULT));
+}
+
+
+void *fstReaderOpen2(const char *nam, unsigned int flags)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)calloc(1, sizeof(struct fstReaderContext));
+
+if((!nam)||(!(xc->f=fopen(nam, "rb"))))
+        {
+        free(xc);
+        xc=NULL;
+        }
+        else
+        {
+        int rc;
+
+        xc->mmap_disabled = (flags & FST_RD_OPEN_NO_MMAP) != 0;
+        xc->use_blk_index_sidecar = (flags & FST_RD_OPEN_BLOCK_INDEX) != 0;
+        xc->gz_unpack = (flags & FST_RD_OPEN_GZIP_UNPACK) != 0;
+
+#if defined(FST_UNBUFFERED_IO)
+        setvbuf(xc->f, (char *)NULL, _IONBF, 0);   /* keeps gzip from acting weird in tandem with fopen */
+#endif
+
+        fstReaderLoadHierSidecar(xc, nam);
+
+        xc->filename = strdup(nam);
+        rc = fstReaderInit(xc);
+
+        if((rc) && (xc->vc_section_count) && (xc->maxhandle) && ((xc->hier_mem)||(xc->contains_hier_section||(xc->contains_hier_section_lz4)||(xc->contains_hier_section_zstd))))
+                {
+                /* more init */
+                xc->do_rewind = 1;
+                }
+                else
+                {
+                fstReaderClose(xc);
+                xc = NULL;
+                }
+        }
+
+return(xc);
+}
+
+
+/*
+ * returns a second reader on the same trace that can be used concurrently
+ * with ctx from another thread.  the header, signal lengths/types, blackouts,
+ * block index and decompressed hierarchy are shared read-only with ctx; the
+ * clone has its own file handle or mapping, process mask, scratch buffers,
+ * rvat state and hierarchy iteration position
+ * and starts with an empty process mask and no time range limit.  ctx must
+ * not be in use by another thread during the call.  contexts may be closed in
+ * any order.  FST_BL_ZWRAPPER traces read in place share the gzip index
+ * and each clone inflates on its own; returns NULL for ones unpacked to a
+ * private temp file (FST_RD_OPEN_GZIP_UNPACK).
+ */
+void *fstReaderClone(void *ctx)
+{
+struct fstReaderContext *src = (struct fstReaderContext *)ctx;
+struct fstReaderContext *xc;
+
+if((!src) || (!src->filename) || ((src->is_zwrapped) && (!src->gz)) || (src->filename_unpacked)) return(NULL);
+
+xc = (struct fstReaderContext *)calloc(1, sizeof(struct fstReaderContext));
+if(!(xc->f = fopen(src->filename, "rb")))
+        {
+        free(xc);
+        return(NULL);
+        }
+
+if(!src->shared)
+        {
+        struct fstReaderShared *sh = (struct fstReaderShared *)calloc(1, sizeof(struct fstReaderShared));
+
+        sh->refcount = 1;
+        sh->signal_lens = src->signal_lens;
+        sh->signal_typs = src->signal_typs;
+        sh->blackout_times = src->blackout_times;
+        sh->blackout_activity = src->blackout_activity;
+        sh->blk_index = src->blk_index;
+        sh->hier_mem = src->hier_mem;
+        sh->hier_len = src->hier_len;
+        sh->gz_index = src->gz_index;
+#ifdef HAVE_LIBZSTD
+        sh->zstd_ddict = src->zstd_ddict;
+#endif
+        src->shared = sh;
+        }
+
+FST_ATOMIC_INC(&src->shared->refcount);
+xc->shared = src->shared;
+
+#if defined(FST_UNBUFFERED_IO)
+setvbuf(xc->f, (char *)NULL, _IONBF, 0);
+#endif
+
+xc->start_time = src->start_time;
+xc->end_time = src->end_time;
+xc->mem_used_by_writer = src->mem_used_by_writer;
+xc->scope_count = src->scope_count;
+xc->var_count = src->var_count;
+xc->maxhandle = src->maxhandle;
+xc->num_alias = src->num_alias;
+xc->vc_section_count = src->vc_section_count;
+
+xc->signal_lens = src->signal_lens;
+xc->signal_typs = src->signal_typs;
+xc->process_mask = (unsigned char *)calloc(1, (xc->maxhandle+7)/8);
+xc->longest_signal_value_len = src->longest_signal_value_len;
+xc->temp_signal_value_buf = (unsigned char *)malloc(xc->longest_signal_value_len + 1);
+
+xc->timescale = src->timescale;
+xc->filetype = src->filetype;
+xc->use_vcd_extensions = src->use_vcd_extensions;
+xc->double_endian_match = src->double_endian_match;
+xc->native_doubles_for_cb = src->native_doubles_for_cb;
+xc->contains_geom_section = src->contains_geom_section;
+xc->contains_hier_section = src->contains_hier_section;
+xc->contains_hier_section_lz4duo = src->contains_hier_section_lz4duo;
+xc->contains_hier_section_lz4 = src->contains_hier_section_lz4;
+xc->contains_hier_section_zstd = src->contains_hier_section_zstd;
+
+memcpy(xc->version, src->version, sizeof(xc->version));
+memcpy(xc->date, src->date, sizeof(xc->date));
+xc->timezero = src->timezero;
+
+xc->filename = strdup(src->filename);
+xc->hier_pos = src->hier_pos;
+
+xc->num_blackouts = src->num_blackouts;
+xc->blackout_times = src->blackout_times;
+xc->blackout_activity = src->blackout_activity;
+
+xc->blk_index = src->blk_index;
+xc->blk_index_count = xc->blk_index_alloc = src->blk_index_count;
+xc->geom_pos = src->geom_pos;
+xc->blackout_pos = src->blackout_pos;
+xc->zstd_dict_pos = src->zstd_dict_pos;
+#ifdef HAVE_LIBZSTD
+xc->zstd_ddict = src->zstd_ddict;
+#endif
+xc->mmap_disabled = src->mmap_disabled;
+xc->is_zwrapped = src->is_zwrapped;
+xc->gz_index = src->gz_index;
+if((xc->gz_index) && (!fstReaderGzCursorInit(xc)))
+        {
+        fstReaderClose(xc);
+        return(NULL);
+        }
+xc->iterblocks_threads = src->iterblocks_threads;
+xc->blk_cache_budget = src->blk_cache_budget;            /* each clone caches for itself */
+
+if((src->hier_mem) && (src->hier_mem == src->shared->hier_mem))
+        {
+        xc->hier_mem = src->hier_mem;
+        xc->hier_len = src->hier_len;
+        }
+else
+if(src->hier_mem)               /* loaded after the shared block was set up: private copy */
+        {
+        xc->hier_mem = (unsigned char *)malloc(src->hier_len ? src->hier_len : 1);
+        memcpy(xc->hier_mem, src->hier_mem, src->hier_len);
+        xc->hier_len = src->hier_len;
+        }
+
+if((src->fmap) && (!xc->mmap_disabled))
+        {
+        fstReaderMapFile(xc);
+        }
+
+xc->do_rewind = 1;
+
+return(xc);
+}
+
+
+static void fstReaderFreeRvatBlock(struct fstRvatBlock *rb)
+{
+free(rb->chain_mem);
+free(rb->frame_data);
+free(rb->time_table);
+free(rb->chain_table);
+free(rb->chain_table_lengths);
+memset(rb, 0, sizeof(struct fstRvatBlock));
+}
+
+
+static void fstReaderDeallocateRvatData(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+if(xc && xc->rvat_blocks)
+        {
+        int slot;
+
+        for(slot=0;slot<FST_RVAT_CACHE_BLOCKS;slot++)
+                {
+                fstReaderFreeRvatBlock(xc->rvat_blocks + slot);
+                }
+
+        free(xc->rvat_blocks); xc->rvat_blocks = NULL;
+        }
+}
+
+
+void fstReaderClose(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        fstReaderDeallocateScopeData(xc);
+        fstReaderDeallocateRvatData(xc);
+        free(xc->rvat_sig_offs); xc->rvat_sig_offs = NULL;
+
+        if(xc->shared)
+                {
+                struct fstReaderShared *sh = xc->shared;
+
+                fstReaderFreeUnshared(xc, xc->signal_lens); xc->signal_lens = NULL;
+                fstReaderFreeUnshared(xc, xc->signal_typs); xc->signal_typs = NULL;
+                xc->blackout_times = NULL;
+                xc->blackout_activity = NULL;
+                xc->blk_index = NULL;
+                fstReaderFreeUnshared(xc, xc->hier_mem); xc->hier_mem = NULL;
+                if(xc->gz_index == sh->gz_index) xc->gz_index = NULL;
+#ifdef HAVE_LIBZSTD
+                if(xc->zstd_ddict == sh->zstd_ddict) xc->zstd_ddict = NULL;
+#endif
+                xc->shared = NULL;
+
+                if(!FST_ATOMIC_DEC(&sh->refcount))
+                        {
+                        free(sh->signal_lens);
+                        free(sh->signal_typs);
+                        free(sh->blackout_times);
+                        free(sh->blackout_activity);
+                        free(sh->blk_index);
+                        free(sh->hier_mem);
+                        fstGzIndexFree(sh->gz_index);
+#ifdef HAVE_LIBZSTD
+                        ZSTD_freeDDict(sh->zstd_ddict);
+#endif
+                        free(sh);
+                        }
+                }
+
+        free(xc->process_mask); xc->process_mask = NULL;
+        free(xc->blackout_times); xc->blackout_times = NULL;
+        free(xc->blackout_activity); xc->blackout_activity = NULL;
+        free(xc->temp_signal_value_buf); xc->temp_signal_value_buf = NULL;
+        free(xc->signal_typs); xc->signal_typs = NULL;
+        free(xc->signal_lens); xc->signal_lens = NULL;
+        free(xc->blk_index); xc->blk_index = NULL;
+        free(xc->all_times); xc->all_times = NULL;
+        fstReaderSetBlockCacheSize(xc, 0);
+        free(xc->filename); xc->filename = NULL;
+	free(xc->str_scope_attr); xc->str_scope_attr = NULL;
+
+        fstReaderUnmapFile(xc);
+        fstReaderGzClose(xc);
+        fstGzIndexFree(xc->gz_index); xc->gz_index = NULL;
+        fstReaderFreeZstdDCtx(&xc->zstd_dctx);
+#ifdef HAVE_LIBZSTD
+        ZSTD_freeDDict(xc->zstd_ddict); xc->zstd_ddict = NULL;
+#endif
+
+        free(xc->hier_mem); xc->hier_mem = NULL;
+
+        if(xc->f)
+                {
+                tmpfile_close(&xc->f, &xc->f_nam);
+                if(xc->filename_unpacked)
+                        {
+                        unlink(xc->filename_unpacked);
+                        free(xc->filename_unpacked);
+                        }
+                }
+
+        free(xc);
+        }
+}
+
+
+/*
+ * read processing
+ */
+
+/*
+ * decodes the chain index of a value change section into per-handle chain
+ * offsets (relative to vc_start) and lengths, resolving aliases.  chain_end
+ * is the offset of the chain index itself, which terminates the last chain.
+ * returns the number of handles described.
+ */
+#define FST_CHAIN_VARINT_RUN (256)      /* chain index varints decoded per fstGetVarintRun() */
+
+static fstHandle fstReaderParseChainTable(int sectype, unsigned char *chain_cmem, long chain_clen, uint64_t vc_maxhandle,
+        fst_off_t *chain_table, uint32_t *chain_table_lengths, fst_off_t chain_end)
+{
+unsigned char *pnt;
+fstHandle idx, pidx=0, i;
+uint64_t pval;
+
+pnt = chain_cmem;
+idx = 0;
+pval = 0;
+
+if(sectype == FST_BL_VCDATA_DYN_ALIAS2)
+        {
+        uint32_t prev_alias = 0;
+        uint64_t vals[FST_CHAIN_VARINT_RUN];
+        unsigned char lens[FST_CHAIN_VARINT_RUN];
+        size_t vpos = 0;
+
+        while(vpos < (size_t)chain_clen)
+                {
+                size_t vnum, vi;
+
+                vpos += fstGetVarintRun(chain_cmem + vpos, chain_clen - vpos, vals, lens, FST_CHAIN_VARINT_RUN, &vnum);
+                for(vi=0;vi<vnum;vi++)
+                        {
+                        uint64_t val = vals[vi];
+
+                        if(val & 1)
+                                {
+                                int shift = lens[vi] * 7;
+                                int64_t shval;
+
+                                if((shift < 64) && ((val >> (shift - 1)) & 1)) val |= (~(uint64_t)0) << shift; /* sign extend, written by fstWriterSVarint() */
+                                shval = ((int64_t)val) >> 1;
+                                if(shval > 0)
+                                        {
+                                        pval = chain_table[idx] = pval + shval;
+                                        if(idx) { chain_table_lengths[pidx] = pval - chain_table[pidx]; }
+                                        pidx = idx++;
+                                        }
+                                else if(shval < 0)
+                                        {
+                                        chain_table[idx] = 0;                                   /* need to explicitly zero as calloc above might not run */
+                                        chain_table_lengths[idx] = prev_alias = shval;          /* because during this loop iter would give stale data! */
+                                        idx++;
+                                        }
+                                else
+                                        {
+                                        chain_table[idx] = 0;                                   /* need to explicitly zero as calloc above might not run */
+                                        chain_table_lengths[idx] = prev_alias;                  /* because during this loop iter would give stale data! */
+                                        idx++;
+                                        }
+                                }
+                                else
+                                {
+                                fstHandle loopcnt = ((uint32_t)val) >> 1;
+
+                                if((idx+loopcnt-1) > vc_maxhandle) /* TALOS-2023-1789 */
+                                        {
+                                        chk_report_abort("TALOS-2023-1789");
+                                        }
+
+                                for(i=0;i<loopcnt;i++)
+                                        {
+                                        chain_table[idx++] = 0;
+                                        }
+                                }
+                        }
+                }
+        }
+        else
+        {
+        do      {
+                int skiplen;
+                uint64_t val = fstGetVarint32(pnt, &skiplen);
+
+                if(!val)
+                        {
+                        pnt += skiplen;
+                        val = fstGetVarint32(pnt, &skiplen);
+                        chain_table[idx] = 0;                   /* need to explicitly zero as calloc above might not run */
+                        chain_table_lengths[idx] = -val;        /* because during this loop iter would give stale data! */
+                        idx++;
+                        }
+                else
+                if(val&1)
+                        {
+                        pval = chain_table[idx] = pval + (val >> 1);
+                        if(idx) { chain_table_lengths[pidx] = pval - chain_table[pidx]; }
+                        pidx = idx++;
+                        }
+                else
+                        {
+                        fstHandle loopcnt = val >> 1;
+
+			if((idx+loopcnt-1) > vc_maxhandle) /* TALOS-2023-1789 */
+				{
+				chk_report_abort("TALOS-2023-1789");
+				}
+
+                        for(i=0;i<loopcnt;i++)
+                                {
+                                chain_table[idx++] = 0;
+                                }
+                        }
+
+                pnt += skiplen;
+                } while (pnt != (chain_cmem + chain_clen));
+        }
+
+chain_table[idx] = chain_end;
+chain_table_lengths[pidx] = chain_table[idx] - chain_table[pidx];
+
+for(i=0;i<idx;i++)
+        {
+        int32_t v32 = chain_table_lengths[i];
+        if((v32 < 0) && (!chain_table[i]))
+                {
+                v32 = -v32;
+                v32--;
+                if(((uint32_t)v32) < i) /* sanity check */
+                        {
+                        chain_table[i] = chain_table[v32];
+                        chain_table_lengths[i] = chain_table_lengths[v32];
+                        }
+                }
+        }
+
+return(idx);
+}
+
+
+/*
+ * expands the uncompressed time section of a value change block into
+ * absolute times, and allocates the per-time chain heads used to
+ * re-interleave the value changes
+ */
+static void fstReaderBuildTimeTable(unsigned char *ucdata, uint64_t tsec_uclen, uint64_t tsec_nitems, uint64_t **time_table, uint32_t **tc_head, uint32_t *tc_head_items)
+{
+uint64_t tpval;
+size_t ti, tnum;
+
+free(*time_table);
+
+if(sizeof(size_t) < sizeof(uint64_t))
+	{
+	/* TALOS-2023-1792 for 32b overflow */
+	uint64_t chk_64 = tsec_nitems * sizeof(uint64_t);
+	size_t   chk_32 = ((size_t)tsec_nitems) * sizeof(uint64_t);
+	if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1792");
+	}
+else
+	{
+	uint64_t chk_64 = tsec_nitems * sizeof(uint64_t);
+	if((chk_64/sizeof(uint64_t)) != tsec_nitems)
+		{
+		chk_report_abort("TALOS-2023-1792");
+		}
+	}
+*time_table = (uint64_t *)calloc(tsec_nitems, sizeof(uint64_t));
+fstGetVarintRun(ucdata, tsec_uclen, *time_table, NULL, tsec_nitems, &tnum); /* deltas, summed in place below */
+tpval = 0;
+for(ti=0;ti<tnum;ti++)
+        {
+        tpval = (*time_table)[ti] += tpval;
+        }
+
+*tc_head_items = tsec_nitems /* scan-build */ ? tsec_nitems : 1;
+if(sizeof(size_t) < sizeof(uint64_t))
+	{
+	/* TALOS-2023-1792 for 32b overflow */
+	uint64_t chk_64 = (*tc_head_items) * sizeof(uint32_t);
+	size_t   chk_32 = ((size_t)(*tc_head_items)) * sizeof(uint32_t);
+	if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1792");
+	}
+else
+	{
+	uint64_t chk_64 = (*tc_head_items) * sizeof(uint32_t);
+	if((chk_64/sizeof(uint32_t)) != (*tc_head_items))
+		{
+		chk_report_abort("TALOS-2023-1792");
+		}
+	}
+*tc_head = (uint32_t *)calloc(*tc_head_items, sizeof(uint32_t));
+}
+
+
+/*
+ * cache of the per-block metadata that every pass over a value change block
+ * rebuilds the same way: its time table (an inflate) and its parsed chain
+ * index.  with it a repeat load of other signals only inflates the chains it
+ * asks for.  entries are copied in and out, so nothing outside holds a
+ * pointer into the cache, and they are evicted least recently used first
+ * once fstReaderSetBlockCacheSize() is exceeded.  calling thread only.
+ */
+struct fstBlockCacheEntry
+{
+struct fstBlockCacheEntry *mru_next, *lru_next;
+uint64_t blk_num;
+uint64_t bytes;
+
+uint64_t *time_table;                   /* NULL until the time section was inflated */
+uint64_t tsec_nitems;
+fst_off_t *chain_table;                 /* NULL until the chain index was parsed */
+uint32_t *chain_table_lengths;          /* chain_idx+1 entries each */
+fstHandle chain_idx;
+uint64_t vc_maxhandle;
+};
+
+
+static void fstReaderBlockCacheUnlink(struct fstReaderContext *xc, struct fstBlockCacheEntry *ce)
+{
+if(ce->mru_next) ce->mru_next->lru_next = ce->lru_next; else xc->blk_cache_mru = ce->lru_next;
+if(ce->lru_next) ce->lru_next->mru_next = ce->mru_next; else xc->blk_cache_lru = ce->mru_next;
+ce->mru_next = ce->lru_next = NULL;
+}
+
+
+static void fstReaderBlockCacheLinkFront(struct fstReaderContext *xc, struct fstBlockCacheEntry *ce)
+{
+ce->mru_next = NULL;
+ce->lru_next = xc->blk_cache_mru;
+if(xc->blk_cache_mru) xc->blk_cache_mru->mru_next = ce; else xc->blk_cache_lru = ce;
+xc->blk_cache_mru = ce;
+}
+
+
+static void fstReaderBlockCacheDrop(struct fstReaderContext *xc, struct fstBlockCacheEntry *ce)
+{
+fstReaderBlockCacheUnlink(xc, ce);
+xc->blk_cache[ce->blk_num] = NULL;
+xc->blk_cache_bytes -= ce->bytes;
+free(ce->time_table);
+free(ce->chain_table);
+free(ce->chain_table_lengths);
+free(ce);
+}
+
+
+/* evicts until need more bytes fit in the budget, never evicting keep */
+static int fstReaderBlockCacheMakeRoom(struct fstReaderContext *xc, uint64_t need, struct fstBlockCacheEntry *keep)
+{
+while((xc->blk_cache_bytes + need > xc->blk_cache_budget) && (xc->blk_cache_lru) && (xc->blk_cache_lru != keep))
+        {
+        fstReaderBlockCacheDrop(xc, xc->blk_cache_lru);
+        }
+
+return(xc->blk_cache_bytes + need <= xc->blk_cache_budget);
+}
+
+
+/* the entry for blk_num, now the most recently used, or NULL */
+static struct fstBlockCacheEntry *fstReaderBlockCacheLookup(struct fstReaderContext *xc, uint64_t blk_num)
+{
+struct fstBlockCacheEntry *ce;
+
+if((!xc->blk_cache) || (blk_num >= xc->blk_index_count)) return(NULL);
+
+ce = xc->blk_cache[blk_num];
+if(ce && (ce != xc->blk_cache_mru))
+        {
+        fstReaderBlockCacheUnlink(xc, ce);
+        fstReaderBlockCacheLinkFront(xc, ce);
+        }
+
+return(ce);
+}
+
+
+/*
+ * offers a decoded time table and/or chain index of block blk_num to the
+ * cache, either may be NULL.  parts already cached are left alone, parts
+ * that do not fit the budget are not kept.
+ */
+static void fstReaderBlockCacheStore(struct fstReaderContext *xc, uint64_t blk_num,
+        const uint64_t *time_table, uint64_t tsec_nitems,
+        const fst_off_t *chain_table, const uint32_t *chain_table_lengths, fstHandle chain_idx, uint64_t vc_maxhandle)
+{
+struct fstBlockCacheEntry *ce;
+
+if((!xc->blk_cache_budget) || (blk_num >= xc->blk_index_count)) return;
+
+if(!xc->blk_cache)
+        {
+        xc->blk_cache = (struct fstBlockCacheEntry **)calloc(xc->blk_index_count, sizeof(struct fstBlockCacheEntry *));
+        if(!xc->blk_cache) return;
+        }
+
+ce = fstReaderBlockCacheLookup(xc, blk_num);
+if(!ce)
+        {
+        if(!fstReaderBlockCacheMakeRoom(xc, sizeof(struct fstBlockCacheEntry), NULL)) return;
+        ce = (struct fstBlockCacheEntry *)calloc(1, sizeof(struct fstBlockCacheEntry));
+        if(!ce) return;
+        ce->blk_num = blk_num;
+        ce->bytes = sizeof(struct fstBlockCacheEntry);
+        xc->blk_cache[blk_num] = ce;
+        xc->blk_cache_bytes += ce->bytes;
+        fstReaderBlockCacheLinkFront(xc, ce);
+        }
+
+if((time_table) && (!ce->time_table))
+        {
+        uint64_t len = tsec_nitems * sizeof(uint64_t);
+
+        if(fstReaderBlockCacheMakeRoom(xc, len, ce) && (ce->time_table = (uint64_t *)malloc(len ? len : 1)))
+                {
+                memcpy(ce->time_table, time_table, len);
+                ce->tsec_nitems = tsec_nitems;
+                ce->bytes += len;
+                xc->blk_cache_bytes += len;
+                }
+        }
+
+if((chain_table) && (!ce->chain_table) && (chain_idx <= vc_maxhandle))
+        {
+        uint64_t cnt = (uint64_t)chain_idx + 1;
+        uint64_t len = cnt * (sizeof(fst_off_t) + sizeof(uint32_t));
+
+        if(fstReaderBlockCacheMakeRoom(xc, len, ce))
+                {
+                ce->chain_table = (fst_off_t *)malloc(cnt * sizeof(fst_off_t));
+                ce->chain_table_lengths = (uint32_t *)malloc(cnt * sizeof(uint32_t));
+                if((ce->chain_table) && (ce->chain_table_lengths))
+                        {
+                        memcpy(ce->chain_table, chain_table, cnt * sizeof(fst_off_t));
+                        memcpy(ce->chain_table_lengths, chain_table_lengths, cnt * sizeof(uint32_t));
+                        ce->chain_idx = chain_idx;
+                        ce->vc_maxhandle = vc_maxhandle;
+                        ce->bytes += len;
+                        xc->blk_cache_bytes += len;
+                        }
+                        else
+                        {
+                        free(ce->chain_table); ce->chain_table = NULL;
+                        free(ce->chain_table_lengths); ce->chain_table_lengths = NULL;
+                        }
+                }
+        }
+
+if((!ce->time_table) && (!ce->chain_table))
+        {
+        fstReaderBlockCacheDrop(xc, ce);
+        }
+}
+
+
+/*
+ * fstReaderBuildTimeTable() from the cache: copies out the time table of
+ * block blk_num and allocates fresh chain heads.  returns 0 on a miss.
+ */
+static int fstReaderBlockCacheTimes(struct fstReaderContext *xc, uint64_t blk_num, uint64_t **time_table, uint32_t **tc_head, uint32_t *tc_head_items)
+{
+struct fstBlockCacheEntry *ce = fstReaderBlockCacheLookup(xc, blk_num);
+uint64_t len;
+
+if((!ce) || (!ce->time_table)) return(0);
+
+len = ce->tsec_nitems * sizeof(uint64_t);
+free(*time_table);
+*time_table = (uint64_t *)malloc(len ? len : 1);
+free(*tc_head);
+*tc_head_items = ce->tsec_nitems ? ce->tsec_nitems : 1;
+*tc_head = (uint32_t *)calloc(*tc_head_items, sizeof(uint32_t));
+if((!*time_table) || (!*tc_head))
+        {
+        free(*time_table); *time_table = NULL;
+        free(*tc_head); *tc_head = NULL;
+        return(0);
+        }
+
+memcpy(*time_table, ce->time_table, len);
+return(1);
+}
+
+
+/*
+ * bounds the memory this context keeps for decoded block time tables and
+ * chain indexes across iterations.  0, the default, disables the cache and
+ * frees what it holds; a smaller budget evicts right away.
+ */
+void fstReaderSetBlockCacheSize(void *ctx, uint64_t max_bytes)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        xc->blk_cache_budget = max_bytes;
+        fstReaderBlockCacheMakeRoom(xc, 0, NULL);
+        if(!max_bytes)
+                {
+                free(xc->blk_cache); xc->blk_cache = NULL;
+                }
+        }
+}
+
+
+uint64_t fstReaderGetBlockCacheSize(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->blk_cache_budget : 0);
+}
+
+
+uint64_t fstReaderGetBlockCacheUsage(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+return(xc ? xc->blk_cache_bytes : 0);
+}
+
+
+/*
+ * every distinct time in the trace, built on first use from the time
+ * sections of all value change blocks (plus each block's start time, where
+ * fstReaderIterBlocks2() reports initial values) and kept until close or
+ * fstReaderFreeTimeTable().
+ * blocks are written in time order, so appending them and dropping any time
+ * not past the last one kept yields a sorted, deduplicated table.
+ */
+const uint64_t *fstReaderGetTimeTable(void *ctx, uint64_t *num_times)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+uint64_t *time_table = NULL;
+uint32_t *tc_head = NULL;
+uint32_t tc_head_items = 0;
+uint64_t blk_num, cnt = 0, alloc = 0;
+uint64_t *times = NULL;
+
+if(num_times) *num_times = 0;
+if(!xc) return(NULL);
+
+if(xc->all_times)
+        {
+        if(num_times) *num_times = xc->all_times_count;
+        return(xc->all_times);
+        }
+
+for(blk_num=0;blk_num<xc->blk_index_count;blk_num++)
+        {
+        struct fstBlockIndexEntry *ent = xc->blk_index + blk_num;
+        unsigned char *ucdata, *cdata, *cdata_alloc = NULL;
+        uint64_t ti;
+
+        if((ent->seclen < 64) || (ent->tsec_clen > ent->seclen - 64)) break;
+
+        if(!fstReaderBlockCacheTimes(xc, blk_num, &time_table, &tc_head, &tc_head_items))
+                {
+                ucdata = (unsigned char *)malloc(ent->tsec_uclen);
+                if(!ucdata) break; /* malloc fail as tsec_uclen out of range from corrupted file */
+
+                fstReaderIoSeek(xc, ent->pos + 1 + ent->seclen - 24 - ((fst_off_t)ent->tsec_clen), SEEK_SET);
+
+                if(ent->tsec_uclen != ent->tsec_clen)
+                        {
+                        unsigned long destlen = ent->tsec_uclen;
+                        unsigned long sourcelen = ent->tsec_clen;
+                        int rc;
+
+                        cdata = fstReaderIoPeek(xc, ent->tsec_clen);
+                        if(!cdata)
+                                {
+                                cdata = cdata_alloc = (unsigned char *)malloc(ent->tsec_clen);
+                                fstReaderIoRead(xc, cdata, ent->tsec_clen);
+                                }
+
+                        rc = fstReaderUncompress(ucdata, &destlen, cdata, sourcelen);
+
+                        if(rc != Z_OK)
+                                {
+                                fprintf(stderr, FST_APIMESS "fstReaderGetTimeTable(), tsec uncompress rc = %d, exiting.\n", rc);
+                                exit(255);
+                                }
+
+                        free(cdata_alloc); cdata_alloc = NULL;
+                        }
+                        else
+                        {
+                        fstReaderIoRead(xc, ucdata, ent->tsec_uclen);
+                        }
+
+                fstReaderBuildTimeTable(ucdata, ent->tsec_uclen, ent->tsec_nitems, &time_table, &tc_head, &tc_head_items);
+                free(ucdata);
+                fstReaderBlockCacheStore(xc, blk_num, time_table, ent->tsec_nitems, NULL, NULL, 0, 0);
+                }
+        free(tc_head); tc_head = NULL;
+
+        if(cnt + ent->tsec_nitems + 1 > alloc)
+                {
+                uint64_t *t;
+
+                alloc = (cnt + ent->tsec_nitems + 1) * 2;
+                t = (uint64_t *)realloc(times, alloc * sizeof(uint64_t));
+                if(!t) break;
+                times = t;
+                }
+
+        if(!cnt || (ent->beg_tim > times[cnt-1])) times[cnt++] = ent->beg_tim;
+        for(ti=0;ti<ent->tsec_nitems;ti++)
+                {
+                if(time_table[ti] > times[cnt-1]) times[cnt++] = time_table[ti];
+                }
+        }
+
+free(time_table);
+
+if(!times) return(NULL);
+
+xc->all_times = times;
+xc->all_times_count = cnt;
+if(num_times) *num_times = cnt;
+return(times);
+}
+
+
+/*
+ * releases the table fstReaderGetTimeTable() returned, for callers that
+ * keep their own copy; the next fstReaderGetTimeTable() builds it again.
+ */
+void fstReaderFreeTimeTable(void *ctx)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+if(xc)
+        {
+        free(xc->all_times); xc->all_times = NULL;
+        xc->all_times_count = 0;
+        }
+}
+
+
+/*
+ * grows the chain offset/length tables to hold vc_maxhandle+1 entries
+ */
+static int fstReaderGrowChainTable(uint64_t vc_maxhandle, uint64_t *vc_maxhandle_largest, fst_off_t **chain_table, uint32_t **chain_table_lengths)
+{
+if(vc_maxhandle > *vc_maxhandle_largest)
+        {
+        free(*chain_table);
+        free(*chain_table_lengths);
+
+        *vc_maxhandle_largest = vc_maxhandle;
+
+	if(!(vc_maxhandle+1))
+		{
+		chk_report_abort("TALOS-2023-1798");
+		}
+
+	if(sizeof(size_t) < sizeof(uint64_t))
+		{
+		/* TALOS-2023-1798 for 32b overflow */
+		uint64_t chk_64 = (vc_maxhandle+1) * sizeof(fst_off_t);
+		size_t   chk_32 = ((size_t)(vc_maxhandle+1)) * sizeof(fst_off_t);
+		if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1798");
+		}
+	else
+		{
+		uint64_t chk_64 = (vc_maxhandle+1) * sizeof(fst_off_t);
+			if((chk_64/sizeof(fst_off_t)) != (vc_maxhandle+1))
+			{
+			chk_report_abort("TALOS-2023-1798");
+			}
+		}
+        *chain_table = (fst_off_t *)calloc((vc_maxhandle+1), sizeof(fst_off_t));
+
+	if(sizeof(size_t) < sizeof(uint64_t))
+		{
+		/* TALOS-2023-1798 for 32b overflow */
+		uint64_t chk_64 = (vc_maxhandle+1) * sizeof(uint32_t);
+		size_t   chk_32 = ((size_t)(vc_maxhandle+1)) * sizeof(uint32_t);
+		if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1798");
+		}
+	else
+		{
+		uint64_t chk_64 = (vc_maxhandle+1) * sizeof(uint32_t);
+			if((chk_64/sizeof(uint32_t)) != (vc_maxhandle+1))
+			{
+			chk_report_abort("TALOS-2023-1798");
+			}
+		}
+        *chain_table_lengths = (uint32_t *)calloc((vc_maxhandle+1), sizeof(uint32_t));
+        }
+
+return((*chain_table) && (*chain_table_lengths));
+}
+
+
+
+/*
+ * fstReaderParseChainTable() from the cache: copies the chain index of block
+ * blk_num out into the (grown) tables.  returns 0 on a miss.
+ */
+static int fstReaderBlockCacheChains(struct fstReaderContext *xc, uint64_t blk_num, uint64_t *vc_maxhandle_largest,
+        fst_off_t **chain_table, uint32_t **chain_table_lengths, fstHandle *chain_idx)
+{
+struct fstBlockCacheEntry *ce = fstReaderBlockCacheLookup(xc, blk_num);
+
+if((!ce) || (!ce->chain_table)) return(0);
+if(!fstReaderGrowChainTable(ce->vc_maxhandle, vc_maxhandle_largest, chain_table, chain_table_lengths)) return(0);
+
+memcpy(*chain_table, ce->chain_table, ((uint64_t)ce->chain_idx + 1) * sizeof(fst_off_t));
+memcpy(*chain_table_lengths, ce->chain_table_lengths, ((uint64_t)ce->chain_idx + 1) * sizeof(uint32_t));
+*chain_idx = ce->chain_idx;
+return(1);
+}
+
+/* 'S' chains, decoded against the FST_BL_ZSTD_DICT dictionary when the frame names one */
+static int fstReaderUnpackZstd(struct fstReaderContext *xc, void **dctx_cache, const unsigned char *mc, unsigned long sourcelen, unsigned char *mu, unsigned long destlen)
+{
+#ifdef HAVE_LIBZSTD
+ZSTD_DCtx *dctx = (ZSTD_DCtx *)*dctx_cache;
+size_t flen = ZSTD_findFrameCompressedSize(mc, sourcelen); /* chain lengths run past the frame, by the length varint */
+size_t rc = (size_t)-1;
+
+if(ZSTD_isError(flen)) return(Z_DATA_ERROR);
+sourcelen = flen;
+
+if((!dctx) && (!(*dctx_cache = dctx = ZSTD_createDCtx()))) return(Z_MEM_ERROR);
+if(!ZSTD_getDictID_fromFrame(mc, sourcelen))
+        {
+        rc = ZSTD_decompressDCtx(dctx, mu, destlen, mc, sourcelen);
+        }
+else if(xc->zstd_ddict)
+        {
+        rc = ZSTD_decompress_usingDDict(dctx, mu, destlen, mc, sourcelen, xc->zstd_ddict);
+        }
+
+return(((!ZSTD_isError(rc)) && (rc == destlen)) ? Z_OK : Z_DATA_ERROR);
+#else
+(void)xc; (void)dctx_cache; (void)mc; (void)sourcelen; (void)mu; (void)destlen;
+return(Z_DATA_ERROR); /* built without HAVE_LIBZSTD */
+#endif
+}
+
+
+/*
+ * inflates one value change chain according to the section pack type
+ */
+static int fstReaderUnpackChain(struct fstReaderContext *xc, void **zstd_dctx, int packtype, unsigned char *mc, unsigned long sourcelen, unsigned char *mu, unsigned long destlen)
+{
+int rc = Z_OK;
+
+switch(packtype)
+        {
+        case 'S': rc = fstReaderUnpackZstd(xc, zstd_dctx, mc, sourcelen, mu, destlen);
+                  break;
+        case '4': rc = (destlen == (unsigned long)LZ4_decompress_safe_partial((char *)mc, (char *)mu, sourcelen, destlen, destlen)) ? Z_OK : Z_DATA_ERROR;
+                  break;
+        case 'F': fastlz_decompress(mc, sourcelen, mu, destlen); /* rc appears unreliable */
+                  break;
+        default:  rc = uncompress(mu, &destlen, mc, sourcelen);
+                  break;
+        }
+
+return(rc);
+}
+
+
+/*
+ * block decode shared by fstReaderIterBlocks2() and fstReaderIterBlocksColumns():
+ * a value change block is taken into memory whole, then its time table and
+ * masked chains are inflated without touching the reader's file position.
+ */
+enum fstBlockDecodeState { FST_BD_FREE, FST_BD_QUEUED, FST_BD_DECODING, FST_BD_DONE };
+
+struct fstBlockDecode
+{
+struct fstBlockIndexEntry *ent;
+const unsigned char *blk;               /* section data, starting at the section length */
+unsigned char *blk_alloc;               /* non-NULL when blk was read rather than mapped */
+
+uint64_t *time_table;
+uint64_t tsec_nitems;
+uint32_t *tc_head;
+uint32_t tc_head_items;
+unsigned char *mem_for_traversal;
+
+/* kept across the blocks a slot decodes */
+uint32_t *scatterptr, *headptr, *length_remaining;      /* maxhandle sized */
+fst_off_t *chain_table;
+uint32_t *chain_table_lengths;
+uint64_t vc_maxhandle_largest;
+void *zstd_dctx;
+
+/* block cache: what fstReaderBlockCacheFetch() filled in, and what to offer back */
+int times_cached, chains_cached;
+fstHandle chain_idx;
+uint64_t vc_maxhandle;
+
+int state;
+int ok;
+};
+
+/* inflates one block entirely from memory, safe to run on any thread */
+static int fstReaderDecodeBlock(struct fstReaderContext *xc, struct fstBlockDecode *bd)
+{
+struct fstBlockIndexEntry *ent = bd->ent;
+const unsigned char *blk = bd->blk;
+uint64_t seclen = ent->seclen;
+uint64_t frame_clen, vc_maxhandle;
+uint64_t mem_required_for_traversal;
+uint32_t traversal_mem_offs = 0;
+fst_off_t vc_start, indx_pos;
+unsigned char *ucdata;
+const unsigned char *pnt;
+fstHandle idx, i;
+int skiplen;
+int packtype;
+
+if((seclen < 64) || (ent->tsec_clen > seclen - 64) || (ent->chain_clen > seclen - 64 - ent->tsec_clen)) return(0);
+
+/* time section */
+if(!bd->times_cached)
+        {
+        ucdata = (unsigned char *)malloc(ent->tsec_uclen);
+        if(!ucdata) return(0); /* malloc fail as tsec_uclen out of range from corrupted file */
+
+        if(ent->tsec_uclen != ent->tsec_clen)
+                {
+                unsigned long destlen = ent->tsec_uclen;
+                unsigned long sourcelen = ent->tsec_clen;
+                int rc = fstReaderUncompress(ucdata, &destlen, blk + seclen - 24 - ent->tsec_clen, sourcelen);
+
+                if(rc != Z_OK)
+                        {
+                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), tsec uncompress rc = %d, exiting.\n", rc);
+                        exit(255);
+                        }
+                }
+                else
+                {
+                memcpy(ucdata, blk + seclen - 24 - ent->tsec_clen, ent->tsec_uclen);
+                }
+
+        fstReaderBuildTimeTable(ucdata, ent->tsec_uclen, ent->tsec_nitems, &bd->time_table, &bd->tc_head, &bd->tc_head_items);
+        free(ucdata);
+        }
+bd->tsec_nitems = ent->tsec_nitems;
+
+/* skip the frame, the calling thread reads it when it is needed */
+pnt = blk + 32;
+fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;         /* frame_uclen */
+frame_clen = fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;
+fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;         /* frame_maxhandle */
+if(frame_clen > seclen) return(0);
+pnt += frame_clen;
+if(pnt >= blk + seclen) return(0);
+vc_maxhandle = fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;
+vc_start = pnt - blk;
+packtype = *pnt;
+
+indx_pos = seclen - 24 - ent->tsec_clen - 8 - ent->chain_clen;
+if((indx_pos <= vc_start) || (!ent->chain_clen)) return(0);
+
+if(!bd->chains_cached)
+        {
+        if(!fstReaderGrowChainTable(vc_maxhandle, &bd->vc_maxhandle_largest, &bd->chain_table, &bd->chain_table_lengths)) return(0);
+        bd->chain_idx = fstReaderParseChainTable(ent->sectype, (unsigned char *)blk + indx_pos, ent->chain_clen, vc_maxhandle,
+                bd->chain_table, bd->chain_table_lengths, indx_pos - vc_start);
+        bd->vc_maxhandle = vc_maxhandle;
+        }
+idx = bd->chain_idx;
+
+mem_required_for_traversal = ent->mem_required + 66; /* add in potential fastlz overhead */
+bd->mem_for_traversal = (unsigned char *)malloc(mem_required_for_traversal);
+if(!bd->mem_for_traversal) return(0);
+memset(bd->scatterptr, 0, xc->maxhandle * sizeof(uint32_t));
+memset(bd->length_remaining, 0, xc->maxhandle * sizeof(uint32_t)); /* zero marks a handle with no chain in this block */
+
+if(idx > xc->maxhandle) idx = xc->maxhandle;
+for(i=0;i<idx;i++)
+        {
+        if(bd->chain_table[i])
+                {
+                int process_idx = i/8;
+                int process_bit = i&7;
+
+                if(xc->process_mask[process_idx]&(1<<process_bit))
+                        {
+                        fst_off_t chain_pos = vc_start + bd->chain_table[i];
+                        uint32_t chain_len = bd->chain_table_lengths[i];
+                        unsigned char *mu = bd->mem_for_traversal + traversal_mem_offs;
+                        uint32_t val, vli, tdelta;
+
+                        if((chain_pos >= indx_pos) || (chain_len > (uint64_t)(indx_pos - chain_pos))) return(0);
+
+                        val = fstGetVarint32((unsigned char *)blk + chain_pos, &skiplen);
+                        if(val)
+                                {
+                                int rc;
+
+                                if((traversal_mem_offs >= mem_required_for_traversal) || (val > mem_required_for_traversal - traversal_mem_offs))
+                                        {
+                                        chk_report_abort("TALOS-2023-1785");
+                                        }
+
+                                rc = fstReaderUnpackChain(xc, &bd->zstd_dctx, packtype, (unsigned char *)blk + chain_pos + skiplen, chain_len, mu, val);
+                                if(rc != Z_OK)
+                                        {
+                                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), fac: %d clen: %d (rc=%d), exiting.\n", (int)i, (int)val, rc);
+                                        exit(255);
+                                        }
+                                }
+                                else
+                                {
+                                val = chain_len - skiplen;
+                                if((traversal_mem_offs >= mem_required_for_traversal) || (val > mem_required_for_traversal - traversal_mem_offs))
+                                        {
+                                        chk_report_abort("TALOS-2023-1785");
+                                        }
+
+                                memcpy(mu, blk + chain_pos + skiplen, val);
+                                }
+
+                        /* data to process is for(j=0;j<val;j++) in mu[j] */
+                        bd->headptr[i] = traversal_mem_offs;
+                        bd->length_remaining[i] = val;
+                        traversal_mem_offs += val;
+
+                        vli = fstGetVarint32NoSkip(mu);
+                        tdelta = (xc->signal_lens[i] == 1) ? (vli >> (2 << (vli & 1))) : (vli >> 1);
+
+                        if(tdelta >= bd->tc_head_items)
+                                {
+                                chk_report_abort("TALOS-2023-1791");
+                                }
+
+                        bd->scatterptr[i] = bd->tc_head[tdelta];
+                        bd->tc_head[tdelta] = i+1;
+                        }
+                }
+        }
+
+return(1);
+}
+
+
+static void fstReaderDecodeReset(struct fstBlockDecode *bd)
+{
+free(bd->time_table); bd->time_table = NULL;
+free(bd->tc_head); bd->tc_head = NULL;
+free(bd->mem_for_traversal); bd->mem_for_traversal = NULL;
+free(bd->blk_alloc); bd->blk_alloc = NULL;
+bd->blk = NULL;
+bd->ent = NULL;
+bd->times_cached = bd->chains_cached = 0;
+bd->state = FST_BD_FREE;
+}
+
+
+/* fills in what the block cache holds for bd->ent ahead of decoding; calling thread only */
+static void fstReaderBlockCacheFetch(struct fstReaderContext *xc, struct fstBlockDecode *bd)
+{
+uint64_t blk_num = bd->ent - xc->blk_index;
+
+bd->times_cached = fstReaderBlockCacheTimes(xc, blk_num, &bd->time_table, &bd->tc_head, &bd->tc_head_items);
+bd->chains_cached = fstReaderBlockCacheChains(xc, blk_num, &bd->vc_maxhandle_largest, &bd->chain_table, &bd->chain_table_lengths, &bd->chain_idx);
+}
+
+
+/* offers what decoding bd built to the block cache; calling thread only */
+static void fstReaderBlockCacheKeep(struct fstReaderContext *xc, struct fstBlockDecode *bd)
+{
+if(xc->blk_cache_budget)
+        {
+        fstReaderBlockCacheStore(xc, bd->ent - xc->blk_index,
+                bd->times_cached ? NULL : bd->time_table, bd->tsec_nitems,
+                bd->chains_cached ? NULL : bd->chain_table, bd->chain_table_lengths, bd->chain_idx, bd->vc_maxhandle);
+        }
+}
+
+
+/* points bd->blk at the section data of bd->ent, mapped or read; calling thread only */
+static int fstReaderLoadBlock(struct fstReaderContext *xc, struct fstBlockDecode *bd)
+{
+struct fstBlockIndexEntry *ent = bd->ent;
+
+fstReaderIoSeek(xc, ent->pos + 1, SEEK_SET);
+bd->blk = fstReaderIoPeek(xc, ent->seclen);
+if(!bd->blk)
+        {
+        bd->blk_alloc = (unsigned char *)malloc(ent->seclen);
+        if((bd->blk_alloc) && (fstReaderIoRead(xc, bd->blk_alloc, ent->seclen) == ent->seclen))
+                {
+                bd->blk = bd->blk_alloc;
+                }
+        }
+
+return(bd->blk != NULL);
+}
+
+
+#ifdef FST_READER_PARALLEL
+/*
+ * parallel block decode for fstReaderIterBlocks2(): worker threads inflate
+ * the time table and the masked chains of upcoming value change blocks,
+ * the calling thread consumes them strictly in block order and makes the
+ * callbacks.  file I/O stays on the calling thread: a block is handed to
+ * the workers as a pointer into the mapping, or else read into memory.
+ */
+#define FST_DECODE_POOL_MAX_THREADS     (64)
+
+struct fstBlockDecodePool
+{
+struct fstReaderContext *xc;
+
+pthread_mutex_t mutex;
+pthread_cond_t work_cond;               /* a block was queued, or shutdown */
+pthread_cond_t done_cond;               /* a block finished decoding */
+pthread_t *threads;
+int num_threads;
+
+struct fstBlockDecode *slots;           /* reorder window, block n lives in slot n % num_slots */
+int num_slots;
+
+uint64_t next_fill;                     /* next index entry to queue */
+uint64_t end;                           /* one past the last index entry in range */
+uint64_t queued, decoding, delivered;   /* running block counts */
+int shutdown;
+};
+
+
+static void *fstReaderDecodeWorker(void *arg)
+{
+struct fstBlockDecodePool *pool = (struct fstBlockDecodePool *)arg;
+
+for(;;)
+        {
+        struct fstBlockDecode *bd;
+        int ok;
+
+        pthread_mutex_lock(&pool->mutex);
+        while((!pool->shutdown) && (pool->decoding == pool->queued))
+                {
+                pthread_cond_wait(&pool->work_cond, &pool->mutex);
+                }
+        if(pool->shutdown)
+                {
+                pthread_mutex_unlock(&pool->mutex);
+                break;
+                }
+        bd = pool->slots + (pool->decoding++ % pool->num_slots);
+        bd->state = FST_BD_DECODING;
+        pthread_mutex_unlock(&pool->mutex);
+
+        ok = bd->blk ? fstReaderDecodeBlock(pool->xc, bd) : 0;
+
+        pthread_mutex_lock(&pool->mutex);
+        bd->ok = ok;
+        bd->state = FST_BD_DONE;
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->mutex);
+        }
+
+return(NULL);
+}
+
+
+/* queues blocks until the reorder window is full, calling thread only */
+static void fstReaderDecodePoolFill(struct fstBlockDecodePool *pool)
+{
+struct fstReaderContext *xc = pool->xc;
+
+while(((pool->queued - pool->delivered) < (uint64_t)pool->num_slots) && (pool->next_fill < pool->end))
+        {
+        struct fstBlockIndexEntry *ent = xc->blk_index + pool->next_fill++;
+        struct fstBlockDecode *bd;
+
+        if((xc->limit_range_valid) && (ent->end_tim < xc->limit_range_start)) continue;
+
+        bd = pool->slots + (pool->queued % pool->num_slots);
+        bd->ent = ent;
+        if(fstReaderLoadBlock(xc, bd)) fstReaderBlockCacheFetch(xc, bd);
+
+        pthread_mutex_lock(&pool->mutex);
+        bd->state = FST_BD_QUEUED;
+        pool->queued++;
+        pthread_cond_signal(&pool->work_cond);
+        pthread_mutex_unlock(&pool->mutex);
+        }
+}
+
+
+static void fstReaderDecodePoolDestroy(struct fstBlockDecodePool *pool)
+{
+int i;
+
+pthread_mutex_lock(&pool->mutex);
+pool->shutdown = 1;
+pthread_cond_broadcast(&pool->work_cond);
+pthread_mutex_unlock(&pool->mutex);
+
+for(i=0;i<pool->num_threads;i++)
+        {
+        pthread_join(pool->threads[i], NULL);
+        }
+
+for(i=0;i<pool->num_slots;i++)
+        {
+        struct fstBlockDecode *bd = pool->slots + i;
+
+        fstReaderDecodeReset(bd);
+        free(bd->scatterptr);
+        free(bd->headptr);
+        free(bd->length_remaining);
+        free(bd->chain_table);
+        free(bd->chain_table_lengths);
+        fstReaderFreeZstdDCtx(&bd->zstd_dctx);
+        }
+
+pthread_cond_destroy(&pool->done_cond);
+pthread_cond_destroy(&pool->work_cond);
+pthread_mutex_destroy(&pool->mutex);
+free(pool->slots);
+free(pool->threads);
+free(pool);
+}
+
+
+/*
+ * returns NULL when there is too little to decode for threads to pay off,
+ * or when the pool cannot be set up, and the caller then decodes serially.
+ * the pool lives for one iteration: each call starts and joins its threads
+ * and allocates num_threads + 2 slots of three maxhandle sized arrays.
+ */
+static struct fstBlockDecodePool *fstReaderDecodePoolCreate(struct fstReaderContext *xc, uint64_t first_blk, int num_threads)
+{
+struct fstBlockDecodePool *pool;
+uint64_t end = xc->blk_index_count;
+size_t hcnt = xc->maxhandle ? xc->maxhandle : 1;
+int i;
+
+if(xc->limit_range_valid)
+        {
+        for(end=first_blk;end<xc->blk_index_count;end++)
+                {
+                if(xc->blk_index[end].beg_tim > xc->limit_range_end) break;
+                }
+        }
+if((end - first_blk) < 2) return(NULL);
+if(num_threads > FST_DECODE_POOL_MAX_THREADS) num_threads = FST_DECODE_POOL_MAX_THREADS;
+if((uint64_t)num_threads > (end - first_blk)) num_threads = (int)(end - first_blk);
+
+pool = (struct fstBlockDecodePool *)calloc(1, sizeof(struct fstBlockDecodePool));
+if(!pool) return(NULL);
+pool->xc = xc;
+pool->next_fill = first_blk;
+pool->end = end;
+
+pthread_mutex_init(&pool->mutex, NULL);
+pthread_cond_init(&pool->work_cond, NULL);
+pthread_cond_init(&pool->done_cond, NULL);
+
+/* num_slots stays 0 until the slots exist, so a partial pool tears down cleanly */
+pool->slots = (struct fstBlockDecode *)calloc(num_threads + 2, sizeof(struct fstBlockDecode));
+pool->threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+if((!pool->slots) || (!pool->threads))
+        {
+        fstReaderDecodePoolDestroy(pool);
+        return(NULL);
+        }
+pool->num_slots = num_threads + 2; /* lets workers run ahead of a slow block without holding a block per thread twice over */
+for(i=0;i<pool->num_slots;i++)
+        {
+        struct fstBlockDecode *bd = pool->slots + i;
+
+        bd->scatterptr = (uint32_t *)calloc(hcnt, sizeof(uint32_t));
+        bd->headptr = (uint32_t *)calloc(hcnt, sizeof(uint32_t));
+        bd->length_remaining = (uint32_t *)calloc(hcnt, sizeof(uint32_t));
+        if((!bd->scatterptr) || (!bd->headptr) || (!bd->length_remaining))
+                {
+                fstReaderDecodePoolDestroy(pool);
+                return(NULL);
+                }
+        }
+
+for(i=0;i<num_threads;i++)
+        {
+        if(pthread_create(pool->threads + i, NULL, fstReaderDecodeWorker, pool)) break;
+        pool->num_threads++;
+        }
+
+if(!pool->num_threads)
+        {
+        fstReaderDecodePoolDestroy(pool);
+        return(NULL);
+        }
+
+fstReaderDecodePoolFill(pool);
+return(pool);
+}
+
+
+/* waits for the next block in order, which must be ent; NULL stops iteration */
+static struct fstBlockDecode *fstReaderDecodePoolNext(struct fstBlockDecodePool *pool, struct fstBlockIndexEntry *ent)
+{
+struct fstBlockDecode *bd;
+
+fstReaderDecodePoolFill(pool);
+if(pool->delivered == pool->queued) return(NULL);
+
+bd = pool->slots + (pool->delivered % pool->num_slots);
+pthread_mutex_lock(&pool->mutex);
+while(bd->state != FST_BD_DONE)
+        {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+        }
+pthread_mutex_unlock(&pool->mutex);
+
+if((bd->ent != ent) || (!bd->ok)) return(NULL);
+
+fstReaderBlockCacheKeep(pool->xc, bd);
+return(bd);
+}
+
+
+static void fstReaderDecodePoolRelease(struct fstBlockDecodePool *pool, struct fstBlockDecode *bd)
+{
+fstReaderDecodeReset(bd);
+pool->delivered++;
+fstReaderDecodePoolFill(pool);
+}
+#endif
+
+
+/* normal read which re-interleaves the value change data */
+int fstReaderIterBlocks(void *ctx,
+        void (*value_change_callback)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value),
+        void *user_callback_data_pointer, FILE *fv)
+{
+return(fstReaderIterBlocks2(ctx, value_change_callback, NULL, user_callback_data_pointer, fv));
+}
+
+
+int fstReaderIterBlocks2(void *ctx,
+        void (*value_change_callback)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value),
+        void (*value_change_callback_varlen)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value, uint32_t len),
+        void *user_callback_data_pointer, FILE *fv)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+
+uint64_t previous_time = UINT64_MAX;
+uint64_t *time_table = NULL;
+uint64_t tsec_nitems;
+unsigned int secnum = 0;
+int blocks_skipped = 0;
+uint64_t blk_num = 0;
+struct fstBlockIndexEntry *ent;
+fst_off_t blkpos;
+uint64_t seclen, beg_tim;
+uint64_t end_tim;
+uint64_t frame_uclen, frame_clen, frame_maxhandle, vc_maxhandle;
+fst_off_t vc_start;
+fst_off_t indx_pntr, indx_pos;
+fst_off_t *chain_table = NULL;
+uint32_t *chain_table_lengths = NULL;
+unsigned char *chain_cmem;
+long chain_clen;
+fstHandle idx, i;
+uint64_t vc_maxhandle_largest = 0;
+uint64_t tsec_uclen = 0, tsec_clen = 0;
+int times_cached = 0, chains_cached = 0;
+int sectype;
+uint64_t mem_required_for_traversal;
+unsigned char *mem_for_traversal = NULL;
+uint32_t traversal_mem_offs;
+uint32_t *scatterptr = NULL, *headptr = NULL, *length_remaining = NULL;
+uint32_t cur_blackout = 0;
+int packtype;
+unsigned char *mc_mem = NULL;
+uint32_t mc_mem_len; /* corresponds to largest value encountered in chain_table_lengths[i] */
+int dumpvars_state = 0;
+#ifdef FST_READER_PARALLEL
+struct fstBlockDecodePool *pool = NULL;
+#endif
+struct fstBlockDecode *bd;
+
+if(!xc) return(0);
+
+if(fv)
+        {
+#ifndef FST_WRITEX_DISABLE
+        fflush(fv);
+        setvbuf(fv, (char *) NULL, _IONBF, 0); /* even buffered IO is slow so disable it and use our own routines that don't need seeking */
+        xc->writex_fd = fileno(fv);
+#endif
+        }
+
+if(xc->limit_range_valid)
+        {
+        /* jump straight to the first block overlapping the range, the ones before it are skipped */
+        blk_num = fstReaderFindBlock(xc, xc->limit_range_start);
+        blocks_skipped = blk_num;
+        }
+
+#ifdef FST_READER_PARALLEL
+if(xc->iterblocks_threads > 1)
+        {
+        pool = fstReaderDecodePoolCreate(xc, blk_num, xc->iterblocks_threads);
+        }
+
+if(!pool)
+#endif
+        {
+        scatterptr = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
+        headptr = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
+        length_remaining = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
+        }
+
+for(;;)
+        {
+        uint32_t *tc_head = NULL;
+	uint32_t tc_head_items = 0;
+        unsigned char *chain_cmem_alloc = NULL;
+        traversal_mem_offs = 0;
+        bd = NULL;
+
+        if(blk_num == xc->blk_index_count) /* index stops at EOF, FST_BL_SKIP, or a truncated section */
+                {
+#ifdef FST_DEBUG
+                fprintf(stderr, FST_APIMESS "<< EOF >>\n");
+#endif
+                break;
+                }
+
+        ent = xc->blk_index + blk_num++;
+        blkpos = ent->pos + 1;
+        sectype = ent->sectype;
+        seclen = ent->seclen;
+        beg_tim = ent->beg_tim;
+        end_tim = ent->end_tim;
+
+        if(xc->limit_range_valid)
+                {
+                if(end_tim < xc->limit_range_start)
+                        {
+                        blocks_skipped++;
+                        continue;
+                        }
+
+                if(beg_tim > xc->limit_range_end) /* likely the compare in for(i=0;i<tsec_nitems;i++) below would do this earlier */
+                        {
+                        break;
+                        }
+                }
+
+#ifdef FST_READER_PARALLEL
+        if(pool)
+                {
+                bd = fstReaderDecodePoolNext(pool, ent);
+                if(!bd) break;
+
+                /* time table and masked chains were inflated by a worker */
+                time_table = bd->time_table;
+                tsec_nitems = bd->tsec_nitems;
+                tc_head = bd->tc_head;
+                tc_head_items = bd->tc_head_items;
+                mem_for_traversal = bd->mem_for_traversal;
+                mem_required_for_traversal = ent->mem_required + 66;
+                scatterptr = bd->scatterptr;
+                headptr = bd->headptr;
+                length_remaining = bd->length_remaining;
+                goto block_decoded;
+                }
+#endif
+
+
+        mem_required_for_traversal = ent->mem_required + 66; /* add in potential fastlz overhead */
+        mem_for_traversal = (unsigned char *)malloc(mem_required_for_traversal);
+#ifdef FST_DEBUG
+        fprintf(stderr, FST_APIMESS "sec: %u seclen: %d begtim: %d endtim: %d\n",
+                secnum, (int)seclen, (int)beg_tim, (int)end_tim);
+        fprintf(stderr, FST_APIMESS "mem_required_for_traversal: %d\n", (int)mem_required_for_traversal-66);
+#endif
+        tsec_uclen = ent->tsec_uclen;
+        tsec_clen = ent->tsec_clen;
+        tsec_nitems = ent->tsec_nitems;
+#ifdef FST_DEBUG
+        fprintf(stderr, FST_APIMESS "time section unc: %d, com: %d (%d items)\n",
+                (int)tsec_uclen, (int)tsec_clen, (int)tsec_nitems);
+#endif
+        times_cached = fstReaderBlockCacheTimes(xc, blk_num - 1, &time_table, &tc_head, &tc_head_items);
+
+        /* process time block */
+        if(!times_cached)
+                {
+                unsigned char *ucdata;
+                unsigned char *cdata;
+                unsigned char *cdata_alloc = NULL;
+                unsigned long destlen /* = tsec_uclen */; /* scan-build */
+                unsigned long sourcelen /*= tsec_clen */; /* scan-build */
+                int rc;
+
+                ucdata = (unsigned char *)malloc(tsec_uclen);
+                if(!ucdata) break; /* malloc fail as tsec_uclen out of range from corrupted file */
+                destlen = tsec_uclen;
+                sourcelen = tsec_clen;
+
+                fstReaderIoSeek(xc, blkpos + seclen - 24 - ((fst_off_t)tsec_clen), SEEK_SET);
+
+                if(tsec_uclen != tsec_clen)
+                        {
+                        cdata = fstReaderIoPeek(xc, tsec_clen);
+                        if(!cdata)
+                                {
+                                cdata = cdata_alloc = (unsigned char *)malloc(tsec_clen);
+                                fstReaderIoRead(xc, cdata, tsec_clen);
+                                }
+
+                        rc = fstReaderUncompress(ucdata, &destlen, cdata, sourcelen);
+
+                        if(rc != Z_OK)
+                                {
+                                fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), tsec uncompress rc = %d, exiting.\n", rc);
+                                exit(255);
+                                }
+
+                        free(cdata_alloc);
+                        }
+                        else
+                        {
+                        fstReaderIoRead(xc, ucdata, tsec_uclen);
+                        }
+
+                fstReaderBuildTimeTable(ucdata, tsec_uclen, tsec_nitems, &time_table, &tc_head, &tc_head_items);
+                free(ucdata);
+                }
+
+#ifdef FST_READER_PARALLEL
+block_decoded:
+#endif
+        fstReaderIoSeek(xc, blkpos+32, SEEK_SET);
+
+        frame_uclen = fstReaderIoVarint64(xc);
+        frame_clen = fstReaderIoVarint64(xc);
+        frame_maxhandle = fstReaderIoVarint64(xc);
+
+        if(secnum == 0)
+                {
+                if((beg_tim != time_table[0]) || (blocks_skipped))
+                        {
+                        unsigned char *mu = (unsigned char *)malloc(frame_uclen);
+                        uint32_t sig_offs = 0;
+
+                        if(fv)
+                                {
+                                char wx_buf[32];
+                                int wx_len;
+
+                                if(beg_tim)
+                                        {
+					if(dumpvars_state == 1) { wx_len = snprintf(wx_buf, 32, "$end\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 2; }
+                                        wx_len = snprintf(wx_buf, 32, "#%" PRIu64 "\n", beg_tim);
+                                        fstWritex(xc, wx_buf, wx_len);
+					if(!dumpvars_state) { wx_len = snprintf(wx_buf, 32, "$dumpvars\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 1; }
+                                        }
+                                if((xc->num_blackouts)&&(cur_blackout != xc->num_blackouts))
+                                        {
+                                        if(beg_tim == xc->blackout_times[cur_blackout])
+                                                {
+                                                wx_len = snprintf(wx_buf, 32, "$dump%s $end\n", (xc->blackout_activity[cur_blackout++]) ? "on" : "off");
+                                                fstWritex(xc, wx_buf, wx_len);
+                                                }
+                                        }
+                                }
+
+                        if(frame_uclen == frame_clen)
+                                {
+                                fstReaderIoRead(xc, mu, frame_uclen);
+                                }
+                                else
+                                {
+                                unsigned char *mc_alloc = NULL;
+                                unsigned char *mc = fstReaderIoPeek(xc, frame_clen);
+                                int rc;
+
+                                unsigned long destlen = frame_uclen;
+                                unsigned long sourcelen = frame_clen;
+
+                                if(!mc)
+                                        {
+                                        mc = mc_alloc = (unsigned char *)malloc(frame_clen);
+                                        fstReaderIoRead(xc, mc, sourcelen);
+                                        }
+                                rc = uncompress(mu, &destlen, mc, sourcelen);
+                                if(rc != Z_OK)
+                                        {
+                                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), frame uncompress rc: %d, exiting.\n", rc);
+                                        exit(255);
+                                        }
+                                free(mc_alloc);
+                                }
+
+
+                        for(idx=0;idx<frame_maxhandle;idx++)
+                                {
+                                int process_idx = idx/8;
+                                int process_bit = idx&7;
+
+                                if(xc->process_mask[process_idx]&(1<<process_bit))
+                                        {
+                                        if(xc->signal_lens[idx] <= 1)
+                                                {
+                                                if(xc->signal_lens[idx] == 1)
+                                                        {
+                                                        unsigned char val = mu[sig_offs];
+                                                        if(value_change_callback)
+                                                                {
+                                                                xc->temp_signal_value_buf[0] = val;
+                                                                xc->temp_signal_value_buf[1] = 0;
+                                                                value_change_callback(user_callback_data_pointer, beg_tim, idx+1, xc->temp_signal_value_buf);
+                                                                }
+                                                                else
+                                                                {
+                                                                if(fv)
+                                                                        {
+                                                                        char vcd_id[16];
+
+                                                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
+                                                                        vcd_id[0] = val; /* collapse 3 writes into one I/O call */
+                                                                        vcd_id[vcdid_len + 1] = '\n';
+                                                                        fstWritex(xc, vcd_id, vcdid_len + 2);
+                                                                        }
+                                                                }
+                                                        }
+                                                        else
+                                                        {
+                                                        /* variable-length ("0" length) records have no initial state */
+                                                        }
+                                                }
+                                                else
+                                                {
+                                                if(xc->signal_typs[idx] != FST_VT_VCD_REAL)
+                                                        {
+                                                        if(value_change_callback)
+                                                                {
+								if(xc->signal_lens[idx] > xc->longest_signal_value_len)
+									{
+									chk_report_abort("TALOS-2023-1797");
+									}
+                                                                memcpy(xc->temp_signal_value_buf, mu+sig_offs, xc->signal_lens[idx]);
+                                                                xc->temp_signal_value_buf[xc->signal_lens[idx]] = 0;
+                                                                value_change_callback(user_callback_data_pointer, beg_tim, idx+1, xc->temp_signal_value_buf);
+                                                                }
+                                                                else
+                                                                {
+                                                                if(fv)
+                                                                        {
+                                                                        char vcd_id[16];
+                                                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
+
+                                                                        vcd_id[0] = (xc->signal_typs[idx] != FST_VT_VCD_PORT) ? 'b' : 'p';
+                                                                        fstWritex(xc, vcd_id, 1);
+									if((sig_offs + xc->signal_lens[idx]) > frame_uclen)
+										{
+										chk_report_abort("TALOS-2023-1793");
+										}
+                                                                        fstWritex(xc,mu+sig_offs, xc->signal_lens[idx]);
+
+                                                                        vcd_id[0] = ' '; /* collapse 3 writes into one I/O call */
+                                                                        vcd_id[vcdid_len + 1] = '\n';
+                                                                        fstWritex(xc, vcd_id, vcdid_len + 2);
+                                                                        }
+                                                                }
+                                                        }
+                                                        else
+                                                        {
+                                                        double d;
+                                                        unsigned char *clone_d;
+                                                        unsigned char *srcdata = mu+sig_offs;
+
+                                                        if(value_change_callback)
+                                                                {
+                                                                if(xc->native_doubles_for_cb)
+                                                                        {
+                                                                        if(xc->double_endian_match)
+                                                                                {
+                                                                                clone_d = srcdata;
+                                                                                }
+                                                                                else
+                                                                                {
+                                                                                int j;
+
+                                                                                clone_d = (unsigned char *)&d;
+                                                                                for(j=0;j<8;j++)
+                                                                                        {
+                                                                                        clone_d[j] = srcdata[7-j];
+                                                                                        }
+                                                                                }
+                                                                        value_change_callback(user_callback_data_pointer, beg_tim, idx+1, clone_d);
+                                                                        }
+                                                                        else
+                                                                        {
+                                                                        clone_d = (unsigned char *)&d;
+                                                                        if(xc->double_endian_match)
+                                                                                {
+                                                                                memcpy(clone_d, srcdata, 8);
+                                                                                }
+                                                                                else
+                                                                                {
+                                                                                int j;
+
+                                                                                for(j=0;j<8;j++)
+                                                                                        {
+                                                                                        clone_d[j] = srcdata[7-j];
+                                                                                        }
+                                                                                }
+                                                                        snprintf((char *)xc->temp_signal_value_buf, xc->longest_signal_value_len + 1, "%.16g", d);
+                                                                        value_change_callback(user_callback_data_pointer, beg_tim, idx+1, xc->temp_signal_value_buf);
+                                                                        }
+                                                                }
+                                                                else
+                                                                {
+                                                                if(fv)
+                                                                        {
+                                                                        char vcdid_buf[16];
+                                                                        char wx_buf[64];
+                                                                        int wx_len;
+
+                                                                        clone_d = (unsigned char *)&d;
+                                                                        if(xc->double_endian_match)
+                                                                                {
+                                                                                memcpy(clone_d, srcdata, 8);
+                                                                                }
+                                                                                else
+                                                                                {
+                                                                                int j;
+
+                                                                                for(j=0;j<8;j++)
+                                                                                        {
+                                                                                        clone_d[j] = srcdata[7-j];
+                                                                                        }
+                                                                                }
+
+                                                                        fstVcdID(vcdid_buf, idx+1);
+                                                                        wx_len = snprintf(wx_buf, 64, "r%.16g %s\n", d, vcdid_buf);
+                                                                        fstWritex(xc, wx_buf, wx_len);
+                                                                        }
+                                                                }
+                                                        }
+                                                }
+                                        }
 
-if(!xc) return(0);
+                                sig_offs += xc->signal_lens[idx];
+                                }
 
-scatterptr = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
-headptr = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
-length_remaining = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
+                        free(mu);
+                        fstReaderIoSeek(xc, -((fst_off_t)frame_clen), SEEK_CUR);
+                        }
+                }
 
-if(fv)
-        {
-#ifndef FST_WRITEX_DISABLE
-        fflush(fv);
-        setvbuf(fv, (char *) NULL, _IONBF, 0); /* even buffered IO is slow so disable it and use our own routines that don't need seeking */
-        xc->writex_fd = fileno(fv);
-#endif
-        }
+        if(bd) goto block_deliver;
 
-for(;;)
-        {
-        uint32_t *tc_head = NULL;
-	uint32_t tc_head_items = 0;
-        traversal_mem_offs = 0;
+        fstReaderIoSeek(xc, (fst_off_t)frame_clen, SEEK_CUR); /* skip past compressed data */
 
-        fstReaderFseeko(xc, xc->f, blkpos, SEEK_SET);
+        vc_maxhandle = fstReaderIoVarint64(xc);
+        vc_start = fstReaderIoTell(xc);       /* points to '!' character */
+        packtype = fstReaderIoGetc(xc);
 
-        sectype = fgetc(xc->f);
-        seclen = fstReaderUint64(xc->f);
+#ifdef FST_DEBUG
+        fprintf(stderr, FST_APIMESS "frame_uclen: %d, frame_clen: %d, frame_maxhandle: %d\n",
+                (int)frame_uclen, (int)frame_clen, (int)frame_maxhandle);
+        fprintf(stderr, FST_APIMESS "vc_maxhandle: %d, packtype: %c\n", (int)vc_maxhandle, packtype);
+#endif
 
-        if((sectype == EOF) || (sectype == FST_BL_SKIP))
-                {
+        indx_pntr = blkpos + seclen - 24 -tsec_clen -8;
+        chain_clen = ent->chain_clen;
+        indx_pos = indx_pntr - chain_clen;
 #ifdef FST_DEBUG
-                fprintf(stderr, FST_APIMESS "<< EOF >>\n");
+        fprintf(stderr, FST_APIMESS "indx_pos: %d (%d bytes)\n", (int)indx_pos, (int)chain_clen);
 #endif
-                break;
+        chains_cached = fstReaderBlockCacheChains(xc, blk_num - 1, &vc_maxhandle_largest, &chain_table, &chain_table_lengths, &idx);
+        if(!chains_cached)
+                {
+                fstReaderIoSeek(xc, indx_pos, SEEK_SET);
+                chain_cmem = fstReaderIoPeek(xc, chain_clen);
+                if(!chain_cmem)
+                        {
+                        chain_cmem = chain_cmem_alloc = (unsigned char *)malloc(chain_clen);
+                        if(!chain_cmem) goto block_err;
+                        fstReaderIoRead(xc, chain_cmem, chain_clen);
+                        }
+
+                if(!fstReaderGrowChainTable(vc_maxhandle, &vc_maxhandle_largest, &chain_table, &chain_table_lengths)) goto block_err;
+
+                idx = fstReaderParseChainTable(sectype, chain_cmem, chain_clen, vc_maxhandle, chain_table, chain_table_lengths, indx_pos - vc_start);
                 }
 
-        blkpos++;
-        if((sectype != FST_BL_VCDATA) && (sectype != FST_BL_VCDATA_DYN_ALIAS) && (sectype != FST_BL_VCDATA_DYN_ALIAS2))
+        if(xc->blk_cache_budget)
                 {
-                blkpos += seclen;
-                continue;
+                fstReaderBlockCacheStore(xc, blk_num - 1, times_cached ? NULL : time_table, tsec_nitems,
+                        chains_cached ? NULL : chain_table, chain_table_lengths, idx, vc_maxhandle);
                 }
 
-        if(!seclen) break;
+#ifdef FST_DEBUG
+        fprintf(stderr, FST_APIMESS "decompressed chain idx len: %" PRIu32 "\n", idx);
+#endif
 
-        beg_tim = fstReaderUint64(xc->f);
-        end_tim = fstReaderUint64(xc->f);
+        mc_mem_len = 16384;
+        mc_mem = (unsigned char *)malloc(mc_mem_len); /* buffer for compressed reads */
 
-        if(xc->limit_range_valid)
+        /* check compressed VC data */
+        if(idx > xc->maxhandle) idx = xc->maxhandle;
+        for(i=0;i<idx;i++)
                 {
-                if(end_tim < xc->limit_range_start)
+                if(chain_table[i])
                         {
-                        blocks_skipped++;
-                        blkpos += seclen;
-                        continue;
-                        }
+                        int process_idx = i/8;
+                        int process_bit = i&7;
 
-                if(beg_tim > xc->limit_range_end) /* likely the compare in for(i=0;i<tsec_nitems;i++) below would do this earlier */
-                        {
-                        break;
+                        if(xc->process_mask[process_idx]&(1<<process_bit))
+                                {
+                                int rc = Z_OK;
+                                uint32_t val;
+                                uint32_t skiplen;
+                                uint32_t tdelta;
+
+                                fstReaderIoSeek(xc, vc_start + chain_table[i], SEEK_SET);
+                                val = fstReaderIoVarint32WithSkip(xc, &skiplen);
+                                if(val)
+                                        {
+                                        unsigned char *mu = mem_for_traversal + traversal_mem_offs; /* uncomp: dst */
+                                        unsigned char *mc;                                          /* comp:   src */
+                                        unsigned long destlen = val;
+                                        unsigned long sourcelen = chain_table_lengths[i];
+
+					if(traversal_mem_offs >= mem_required_for_traversal)
+						{
+						chk_report_abort("TALOS-2023-1785");
+						}
+
+                                        mc = fstReaderIoPeek(xc, chain_table_lengths[i]);
+                                        if(!mc)
+                                                {
+                                                if(mc_mem_len < chain_table_lengths[i])
+                                                        {
+                                                        free(mc_mem);
+                                                        mc_mem = (unsigned char *)malloc(mc_mem_len = chain_table_lengths[i]);
+                                                        }
+                                                mc = mc_mem;
+
+                                                fstReaderIoRead(xc, mc, chain_table_lengths[i]);
+                                                }
+
+                                        rc = fstReaderUnpackChain(xc, &xc->zstd_dctx, packtype, mc, sourcelen, mu, destlen);
+
+                                        /* data to process is for(j=0;j<destlen;j++) in mu[j] */
+                                        headptr[i] = traversal_mem_offs;
+                                        length_remaining[i] = val;
+                                        traversal_mem_offs += val;
+                                        }
+                                        else
+                                        {
+                                        int destlen = chain_table_lengths[i] - skiplen;
+                                        unsigned char *mu = mem_for_traversal + traversal_mem_offs;
+
+					if(traversal_mem_offs >= mem_required_for_traversal)
+						{
+						chk_report_abort("TALOS-2023-1785");
+						}
+
+                                        fstReaderIoRead(xc, mu, destlen);
+                                        /* data to process is for(j=0;j<destlen;j++) in mu[j] */
+                                        headptr[i] = traversal_mem_offs;
+                                        length_remaining[i] = destlen;
+                                        traversal_mem_offs += destlen;
+                                        }
+
+                                if(rc != Z_OK)
+                                        {
+                                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), fac: %d clen: %d (rc=%d), exiting.\n", (int)i, (int)val, rc);
+                                        exit(255);
+                                        }
+
+                                if(xc->signal_lens[i] == 1)
+                                        {
+                                        uint32_t vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[i]);
+                                        uint32_t shcnt = 2 << (vli & 1);
+                                        tdelta = vli >> shcnt;
+                                        }
+                                        else
+                                        {
+                                        uint32_t vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[i]);
+                                        tdelta = vli >> 1;
+                                        }
+
+				if(tdelta >= tc_head_items)
+					{
+					chk_report_abort("TALOS-2023-1791");
+					}
+
+                                scatterptr[i] = tc_head[tdelta];
+                                tc_head[tdelta] = i+1;
+                                }
                         }
                 }
 
+        free(mc_mem); /* there is no usage below for this, no real need to clear out mc_mem or mc_mem_len */
 
-        mem_required_for_traversal = fstReaderUint64(xc->f) + 66; /* add in potential fastlz overhead */
-        mem_for_traversal = (unsigned char *)malloc(mem_required_for_traversal);
-#ifdef FST_DEBUG
-        fprintf(stderr, FST_APIMESS "sec: %u seclen: %d begtim: %d endtim: %d\n",
-                secnum, (int)seclen, (int)beg_tim, (int)end_tim);
-        fprintf(stderr, FST_APIMESS "mem_required_for_traversal: %d\n", (int)mem_required_for_traversal-66);
-#endif
-        /* process time block */
-        {
-        unsigned char *ucdata;
-        unsigned char *cdata;
-        unsigned long destlen /* = tsec_uclen */; /* scan-build */
-        unsigned long sourcelen /*= tsec_clen */; /* scan-build */
-        int rc;
-        unsigned char *tpnt;
-        uint64_t tpval;
-        unsigned int ti;
-
-        if(fstReaderFseeko(xc, xc->f, blkpos + seclen - 24, SEEK_SET) != 0) break;
-        tsec_uclen = fstReaderUint64(xc->f);
-        tsec_clen = fstReaderUint64(xc->f);
-        tsec_nitems = fstReaderUint64(xc->f);
-#ifdef FST_DEBUG
-        fprintf(stderr, FST_APIMESS "time section unc: %d, com: %d (%d items)\n",
-                (int)tsec_uclen, (int)tsec_clen, (int)tsec_nitems);
-#endif
-        if(tsec_clen > seclen) break; /* corrupted tsec_clen: by definition it can't be larger than size of section */
-        ucdata = (unsigned char *)malloc(tsec_uclen);
-        if(!ucdata) break; /* malloc fail as tsec_uclen out of range from corrupted file */
-        destlen = tsec_uclen;
-        sourcelen = tsec_clen;
+block_deliver:
+        for(i=0;i<tsec_nitems;i++)
+                {
+                uint32_t tdelta;
+                int skiplen, skiplen2;
+                uint32_t vli;
 
-        fstReaderFseeko(xc, xc->f, -24 - ((fst_off_t)tsec_clen), SEEK_CUR);
+                if(fv)
+                        {
+                        char wx_buf[32];
+                        int wx_len;
 
-        if(tsec_uclen != tsec_clen)
-                {
-                cdata = (unsigned char *)malloc(tsec_clen);
-                fstFread(cdata, tsec_clen, 1, xc->f);
+                        if(time_table[i] != previous_time)
+                                {
+                                if(xc->limit_range_valid)
+                                        {
+                                        if(time_table[i] > xc->limit_range_end)
+                                                {
+                                                break;
+                                                }
+                                        }
 
-                rc = uncompress(ucdata, &destlen, cdata, sourcelen);
+				if(dumpvars_state == 1) { wx_len = snprintf(wx_buf, 32, "$end\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 2; }
+                                wx_len = snprintf(wx_buf, 32, "#%" PRIu64 "\n", time_table[i]);
+                                fstWritex(xc, wx_buf, wx_len);
+				if(!dumpvars_state) { wx_len = snprintf(wx_buf, 32, "$dumpvars\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 1; }
 
-                if(rc != Z_OK)
-                        {
-                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), tsec uncompress rc = %d, exiting.\n", rc);
-                        exit(255);
+                                if((xc->num_blackouts)&&(cur_blackout != xc->num_blackouts))
+                                        {
+                                        if(time_table[i] == xc->blackout_times[cur_blackout])
+                                                {
+                                                wx_len = snprintf(wx_buf, 32, "$dump%s $end\n", (xc->blackout_activity[cur_blackout++]) ? "on" : "off");
+                                                fstWritex(xc, wx_buf, wx_len);
+                                                }
+                                        }
+                                previous_time = time_table[i];
+                                }
                         }
 
-                free(cdata);
-                }
-                else
-                {
-                fstFread(ucdata, tsec_uclen, 1, xc->f);
-                }
+                while(tc_head[i])
+                        {
+                        idx = tc_head[i] - 1;
+                        vli = fstGetVarint32(mem_for_traversal + headptr[idx], &skiplen);
+
+                        if(xc->signal_lens[idx] <= 1)
+                                {
+                                if(xc->signal_lens[idx] == 1)
+                                        {
+                                        unsigned char val;
+                                        if(!(vli & 1))
+                                                {
+                                                /* tdelta = vli >> 2; */ /* scan-build */
+                                                val = ((vli >> 1) & 1) | '0';
+                                                }
+                                                else
+                                                {
+                                                /* tdelta = vli >> 4; */ /* scan-build */
+                                                val = FST_RCV_STR[((vli >> 1) & 7)];
+                                                }
+
+                                        if(value_change_callback)
+                                                {
+                                                xc->temp_signal_value_buf[0] = val;
+                                                xc->temp_signal_value_buf[1] = 0;
+                                                value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
+                                                }
+                                                else
+                                                {
+                                                if(fv)
+                                                        {
+                                                        char vcd_id[16];
+                                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
+
+                                                        vcd_id[0] = val;
+                                                        vcd_id[vcdid_len+1] = '\n';
+                                                        fstWritex(xc, vcd_id, vcdid_len+2);
+                                                        }
+                                                }
+                                        headptr[idx] += skiplen;
+                                        length_remaining[idx] -= skiplen;
+
+                                        tc_head[i] = scatterptr[idx];
+                                        scatterptr[idx] = 0;
+
+                                        if(length_remaining[idx])
+                                                {
+                                                int shamt;
+                                                vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[idx]);
+                                                shamt = 2 << (vli & 1);
+                                                tdelta = vli >> shamt;
+
+						if((tdelta+i) >= tc_head_items)
+							{
+							chk_report_abort("TALOS-2023-1791");
+							}
+
+                                                scatterptr[idx] = tc_head[i+tdelta];
+                                                tc_head[i+tdelta] = idx+1;
+                                                }
+                                        }
+                                        else
+                                        {
+                                        unsigned char *vdata;
+                                        uint32_t len;
 
-        free(time_table);
+                                        vli = fstGetVarint32(mem_for_traversal + headptr[idx], &skiplen);
+                                        len = fstGetVarint32(mem_for_traversal + headptr[idx] + skiplen, &skiplen2);
+                                        /* tdelta = vli >> 1; */ /* scan-build */
+                                        skiplen += skiplen2;
+                                        vdata = mem_for_traversal + headptr[idx] + skiplen;
 
-	if(sizeof(size_t) < sizeof(uint64_t))
-		{
-		/* TALOS-2023-1792 for 32b overflow */
-		uint64_t chk_64 = tsec_nitems * sizeof(uint64_t);
-		size_t   chk_32 = ((size_t)tsec_nitems) * sizeof(uint64_t);
-		if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1792");
-		}
-	else
-		{
-		uint64_t chk_64 = tsec_nitems * sizeof(uint64_t);
-		if((chk_64/sizeof(uint64_t)) != tsec_nitems)
-			{
-			chk_report_abort("TALOS-2023-1792");
-			}
-		}
-        time_table = (uint64_t *)calloc(tsec_nitems, sizeof(uint64_t));
-        tpnt = ucdata;
-        tpval = 0;
-        for(ti=0;ti<tsec_nitems;ti++)
-                {
-                int skiplen;
-                uint64_t val = fstGetVarint64(tpnt, &skiplen);
-                tpval = time_table[ti] = tpval + val;
-                tpnt += skiplen;
-                }
+                                        if(!(vli & 1))
+                                                {
+                                                if(value_change_callback_varlen)
+                                                        {
+                                                        value_change_callback_varlen(user_callback_data_pointer, time_table[i], idx+1, vdata, len);
+                                                        }
+                                                        else
+                                                        {
+                                                        if(fv)
+                                                                {
+                                                                char vcd_id[16];
+                                                                int vcdid_len;
 
-	tc_head_items = tsec_nitems /* scan-build */ ? tsec_nitems : 1;
-	if(sizeof(size_t) < sizeof(uint64_t))
-		{
-		/* TALOS-2023-1792 for 32b overflow */
-		uint64_t chk_64 = tc_head_items * sizeof(uint32_t);
-		size_t   chk_32 = ((size_t)tc_head_items) * sizeof(uint32_t);
-		if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1792");
-		}
-	else
-		{
-		uint64_t chk_64 = tc_head_items * sizeof(uint32_t);
-		if((chk_64/sizeof(uint32_t)) != tc_head_items)
-			{
-			chk_report_abort("TALOS-2023-1792");
-			}
-		}
-        tc_head = (uint32_t *)calloc(tc_head_items, sizeof(uint32_t));
-        free(ucdata);
-        }
+                                                                vcd_id[0] = 's';
+                                                                fstWritex(xc, vcd_id, 1);
 
-        fstReaderFseeko(xc, xc->f, blkpos+32, SEEK_SET);
+                                                                vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
+                                                                {
+								if(sizeof(size_t) < sizeof(uint64_t))
+                							{
+                							/* TALOS-2023-1790 for 32b overflow */
+                							uint64_t chk_64 = len*4 + 1;
+                							size_t   chk_32 = len*4 + 1;
+                							if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1790");
+                							}
 
-        frame_uclen = fstReaderVarint64(xc->f);
-        frame_clen = fstReaderVarint64(xc->f);
-        frame_maxhandle = fstReaderVarint64(xc->f);
+                                                                unsigned char *vesc = (unsigned char *)malloc(len*4 + 1);
+                                                                int vlen = fstUtilityBinToEsc(vesc, vdata, len);
+                                                                fstWritex(xc, vesc, vlen);
+                                                                free(vesc);
+                                                                }
 
-        if(secnum == 0)
-                {
-                if((beg_tim != time_table[0]) || (blocks_skipped))
-                        {
-                        unsigned char *mu = (unsigned char *)malloc(frame_uclen);
-                        uint32_t sig_offs = 0;
+                                                                vcd_id[0] = ' ';
+                                                                vcd_id[vcdid_len + 1] = '\n';
+                                                                fstWritex(xc, vcd_id, vcdid_len+2);
+                                                                }
+                                                        }
+                                                }
 
-                        if(fv)
-                                {
-                                char wx_buf[32];
-                                int wx_len;
+                                        skiplen += len;
+                                        headptr[idx] += skiplen;
+                                        length_remaining[idx] -= skiplen;
 
-                                if(beg_tim)
-                                        {
-					if(dumpvars_state == 1) { wx_len = snprintf(wx_buf, 32, "$end\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 2; }
-                                        wx_len = snprintf(wx_buf, 32, "#%" PRIu64 "\n", beg_tim);
-                                        fstWritex(xc, wx_buf, wx_len);
-					if(!dumpvars_state) { wx_len = snprintf(wx_buf, 32, "$dumpvars\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 1; }
-                                        }
-                                if((xc->num_blackouts)&&(cur_blackout != xc->num_blackouts))
-                                        {
-                                        if(beg_tim == xc->blackout_times[cur_blackout])
+                                        tc_head[i] = scatterptr[idx];
+                                        scatterptr[idx] = 0;
+
+                                        if(length_remaining[idx])
                                                 {
-                                                wx_len = snprintf(wx_buf, 32, "$dump%s $end\n", (xc->blackout_activity[cur_blackout++]) ? "on" : "off");
-                                                fstWritex(xc, wx_buf, wx_len);
+                                                vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[idx]);
+                                                tdelta = vli >> 1;
+
+						if((tdelta+i) >= tc_head_items)
+							{
+							chk_report_abort("TALOS-2023-1791");
+							}
+
+                                                scatterptr[idx] = tc_head[i+tdelta];
+                                                tc_head[i+tdelta] = idx+1;
                                                 }
                                         }
                                 }
-
-                        if(frame_uclen == frame_clen)
-                                {
-                                fstFread(mu, frame_uclen, 1, xc->f);
-                                }
                                 else
                                 {
-                                unsigned char *mc = (unsigned char *)malloc(frame_clen);
-                                int rc;
+                                uint32_t len = xc->signal_lens[idx];
+                                unsigned char *vdata;
 
-                                unsigned long destlen = frame_uclen;
-                                unsigned long sourcelen = frame_clen;
+                                vli = fstGetVarint32(mem_for_traversal + headptr[idx], &skiplen);
+                                /* tdelta = vli >> 1; */ /* scan-build */
+                                vdata = mem_for_traversal + headptr[idx] + skiplen;
 
-                                fstFread(mc, sourcelen, 1, xc->f);
-                                rc = uncompress(mu, &destlen, mc, sourcelen);
-                                if(rc != Z_OK)
+                                if(xc->signal_typs[idx] != FST_VT_VCD_REAL)
                                         {
-                                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), frame uncompress rc: %d, exiting.\n", rc);
-                                        exit(255);
-                                        }
-                                free(mc);
-                                }
+					if(len > xc->longest_signal_value_len)
+						{
+						chk_report_abort("TALOS-2023-1797");
+						}
+
+                                        if(!(vli & 1))
+                                                {
+                                                int byte = 0;
+                                                int bit;
+                                                unsigned int j;
 
+                                                for(j=0;j<len;j++)
+                                                        {
+                                                        unsigned char ch;
+                                                        byte = j/8;
+                                                        bit = 7 - (j & 7);
+                                                        ch = ((vdata[byte] >> bit) & 1) | '0';
+                                                        xc->temp_signal_value_buf[j] = ch;
+                                                        }
+                                                xc->temp_signal_value_buf[j] = 0;
 
-                        for(idx=0;idx<frame_maxhandle;idx++)
-                                {
-                                int process_idx = idx/8;
-                                int process_bit = idx&7;
+                                                if(value_change_callback)
+                                                        {
+                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
+                                                        }
+                                                        else
+                                                        {
+                                                        if(fv)  {
+                                                                unsigned char ch_bp = (xc->signal_typs[idx] != FST_VT_VCD_PORT) ? 'b' : 'p';
 
-                                if(xc->process_mask[process_idx]&(1<<process_bit))
-                                        {
-                                        if(xc->signal_lens[idx] <= 1)
+                                                                fstWritex(xc, &ch_bp, 1);
+                                                                fstWritex(xc, xc->temp_signal_value_buf, len);
+                                                                }
+                                                        }
+
+                                                len = byte+1;
+                                                }
+                                                else
                                                 {
-                                                if(xc->signal_lens[idx] == 1)
+                                                if(value_change_callback)
                                                         {
-                                                        unsigned char val = mu[sig_offs];
-                                                        if(value_change_callback)
-                                                                {
-                                                                xc->temp_signal_value_buf[0] = val;
-                                                                xc->temp_signal_value_buf[1] = 0;
-                                                                value_change_callback(user_callback_data_pointer, beg_tim, idx+1, xc->temp_signal_value_buf);
-                                                                }
-                                                                else
+                                                        memcpy(xc->temp_signal_value_buf, vdata, len);
+                                                        xc->temp_signal_value_buf[len] = 0;
+                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
+                                                        }
+                                                        else
+                                                        {
+                                                        if(fv)
                                                                 {
-                                                                if(fv)
-                                                                        {
-                                                                        char vcd_id[16];
+                                                                unsigned char ch_bp =  (xc->signal_typs[idx] != FST_VT_VCD_PORT) ? 'b' : 'p';
+								uint64_t mem_required_for_traversal_chk = vdata - mem_for_traversal + len;
 
-                                                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
-                                                                        vcd_id[0] = val; /* collapse 3 writes into one I/O call */
-                                                                        vcd_id[vcdid_len + 1] = '\n';
-                                                                        fstWritex(xc, vcd_id, vcdid_len + 2);
-                                                                        }
+                                                                fstWritex(xc, &ch_bp, 1);
+								if(mem_required_for_traversal_chk > mem_required_for_traversal)
+									{
+									chk_report_abort("TALOS-2023-1793");
+									}
+                                                                fstWritex(xc, vdata, len);
                                                                 }
                                                         }
-                                                        else
+                                                }
+                                        }
+                                        else
+                                        {
+                                        double d;
+                                        unsigned char *clone_d /*= (unsigned char *)&d */; /* scan-build */
+                                        unsigned char buf[8];
+                                        unsigned char *srcdata;
+
+                                        if(!(vli & 1))  /* very rare case, but possible */
+                                                {
+                                                int bit;
+                                                int j;
+
+                                                for(j=0;j<8;j++)
                                                         {
-                                                        /* variable-length ("0" length) records have no initial state */
+                                                        unsigned char ch;
+                                                        bit = 7 - (j & 7);
+                                                        ch = ((vdata[0] >> bit) & 1) | '0';
+                                                        buf[j] = ch;
                                                         }
+
+                                                len = 1;
+                                                srcdata = buf;
                                                 }
                                                 else
                                                 {
-                                                if(xc->signal_typs[idx] != FST_VT_VCD_REAL)
+                                                srcdata = vdata;
+                                                }
+
+                                        if(value_change_callback)
+                                                {
+                                                if(xc->native_doubles_for_cb)
                                                         {
-                                                        if(value_change_callback)
+                                                        if(xc->double_endian_match)
                                                                 {
-								if(xc->signal_lens[idx] > xc->longest_signal_value_len)
-									{
-									chk_report_abort("TALOS-2023-1797");
-									}
-                                                                memcpy(xc->temp_signal_value_buf, mu+sig_offs, xc->signal_lens[idx]);
-                                                                xc->temp_signal_value_buf[xc->signal_lens[idx]] = 0;
-                                                                value_change_callback(user_callback_data_pointer, beg_tim, idx+1, xc->temp_signal_value_buf);
+                                                                clone_d = srcdata;
                                                                 }
                                                                 else
                                                                 {
-                                                                if(fv)
-                                                                        {
-                                                                        char vcd_id[16];
-                                                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
-
-                                                                        vcd_id[0] = (xc->signal_typs[idx] != FST_VT_VCD_PORT) ? 'b' : 'p';
-                                                                        fstWritex(xc, vcd_id, 1);
-									if((sig_offs + xc->signal_lens[idx]) > frame_uclen)
-										{
-										chk_report_abort("TALOS-2023-1793");
-										}
-                                                                        fstWritex(xc,mu+sig_offs, xc->signal_lens[idx]);
+                                                                int j;
 
-                                                                        vcd_id[0] = ' '; /* collapse 3 writes into one I/O call */
-                                                                        vcd_id[vcdid_len + 1] = '\n';
-                                                                        fstWritex(xc, vcd_id, vcdid_len + 2);
+                                                                clone_d = (unsigned char *)&d;
+                                                                for(j=0;j<8;j++)
+                                                                        {
+                                                                        clone_d[j] = srcdata[7-j];
                                                                         }
                                                                 }
+                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, clone_d);
                                                         }
                                                         else
                                                         {
-                                                        double d;
-                                                        unsigned char *clone_d;
-                                                        unsigned char *srcdata = mu+sig_offs;
-
-                                                        if(value_change_callback)
+                                                        clone_d = (unsigned char *)&d;
+                                                        if(xc->double_endian_match)
                                                                 {
-                                                                if(xc->native_doubles_for_cb)
-                                                                        {
-                                                                        if(xc->double_endian_match)
-                                                                                {
-                                                                                clone_d = srcdata;
-                                                                                }
-                                                                                else
-                                                                                {
-                                                                                int j;
+                                                                memcpy(clone_d, srcdata, 8);
+                                                                }
+                                                                else
+                                                                {
+                                                                int j;
 
-                                                                                clone_d = (unsigned char *)&d;
-                                                                                for(j=0;j<8;j++)
-                                                                                        {
-                                                                                        clone_d[j] = srcdata[7-j];
-                                                                                        }
-                                                                                }
-                                                                        value_change_callback(user_callback_data_pointer, beg_tim, idx+1, clone_d);
-                                                                        }
-                                                                        else
+                                                                for(j=0;j<8;j++)
                                                                         {
-                                                                        clone_d = (unsigned char *)&d;
-                                                                        if(xc->double_endian_match)
-                                                                                {
-                                                                                memcpy(clone_d, srcdata, 8);
-                                                                                }
-                                                                                else
-                                                                                {
-                                                                                int j;
-
-                                                                                for(j=0;j<8;j++)
-                                                                                        {
-                                                                                        clone_d[j] = srcdata[7-j];
-                                                                                        }
-                                                                                }
-                                                                        snprintf((char *)xc->temp_signal_value_buf, xc->longest_signal_value_len + 1, "%.16g", d);
-                                                                        value_change_callback(user_callback_data_pointer, beg_tim, idx+1, xc->temp_signal_value_buf);
+                                                                        clone_d[j] = srcdata[7-j];
                                                                         }
                                                                 }
+                                                        snprintf((char *)xc->temp_signal_value_buf, xc->longest_signal_value_len + 1, "%.16g", d);
+                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
+                                                        }
+                                                }
+                                                else
+                                                {
+                                                if(fv)
+                                                        {
+                                                        char wx_buf[32];
+                                                        int wx_len;
+
+                                                        clone_d = (unsigned char *)&d;
+                                                        if(xc->double_endian_match)
+                                                                {
+                                                                memcpy(clone_d, srcdata, 8);
+                                                                }
                                                                 else
                                                                 {
-                                                                if(fv)
-                                                                        {
-                                                                        char vcdid_buf[16];
-                                                                        char wx_buf[64];
-                                                                        int wx_len;
-
-                                                                        clone_d = (unsigned char *)&d;
-                                                                        if(xc->double_endian_match)
-                                                                                {
-                                                                                memcpy(clone_d, srcdata, 8);
-                                                                                }
-                                                                                else
-                                                                                {
-                                                                                int j;
-
-                                                                                for(j=0;j<8;j++)
-                                                                                        {
-                                                                                        clone_d[j] = srcdata[7-j];
-                                                                                        }
-                                                                                }
+                                                                int j;
 
-                                                                        fstVcdID(vcdid_buf, idx+1);
-                                                                        wx_len = snprintf(wx_buf, 64, "r%.16g %s\n", d, vcdid_buf);
-                                                                        fstWritex(xc, wx_buf, wx_len);
+                                                                for(j=0;j<8;j++)
+                                                                        {
+                                                                        clone_d[j] = srcdata[7-j];
                                                                         }
                                                                 }
+
+                                                        wx_len = snprintf(wx_buf, 32, "r%.16g", d);
+                                                        fstWritex(xc, wx_buf, wx_len);
                                                         }
                                                 }
                                         }
 
-                                sig_offs += xc->signal_lens[idx];
-                                }
-
-                        free(mu);
-                        fstReaderFseeko(xc, xc->f, -((fst_off_t)frame_clen), SEEK_CUR);
-                        }
-                }
-
-        fstReaderFseeko(xc, xc->f, (fst_off_t)frame_clen, SEEK_CUR); /* skip past compressed data */
-
-        vc_maxhandle = fstReaderVarint64(xc->f);
-        vc_start = ftello(xc->f);       /* points to '!' character */
-        packtype = fgetc(xc->f);
-
-#ifdef FST_DEBUG
-        fprintf(stderr, FST_APIMESS "frame_uclen: %d, frame_clen: %d, frame_maxhandle: %d\n",
-                (int)frame_uclen, (int)frame_clen, (int)frame_maxhandle);
-        fprintf(stderr, FST_APIMESS "vc_maxhandle: %d, packtype: %c\n", (int)vc_maxhandle, packtype);
-#endif
-
-        indx_pntr = blkpos + seclen - 24 -tsec_clen -8;
-        fstReaderFseeko(xc, xc->f, indx_pntr, SEEK_SET);
-        chain_clen = fstReaderUint64(xc->f);
-        indx_pos = indx_pntr - chain_clen;
-#ifdef FST_DEBUG
-        fprintf(stderr, FST_APIMESS "indx_pos: %d (%d bytes)\n", (int)indx_pos, (int)chain_clen);
-#endif
-        chain_cmem = (unsigned char *)malloc(chain_clen);
-        if(!chain_cmem) goto block_err;
-        fstReaderFseeko(xc, xc->f, indx_pos, SEEK_SET);
-        fstFread(chain_cmem, chain_clen, 1, xc->f);
-
-        if(vc_maxhandle > vc_maxhandle_largest)
-                {
-                free(chain_table);
-                free(chain_table_lengths);
-
-                vc_maxhandle_largest = vc_maxhandle;
-
-		if(!(vc_maxhandle+1))
-			{
-			chk_report_abort("TALOS-2023-1798");
-			}
-
-		if(sizeof(size_t) < sizeof(uint64_t))
-			{
-			/* TALOS-2023-1798 for 32b overflow */
-			uint64_t chk_64 = (vc_maxhandle+1) * sizeof(fst_off_t);
-			size_t   chk_32 = ((size_t)(vc_maxhandle+1)) * sizeof(fst_off_t);
-			if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1798");
-			}
-		else
-			{
-			uint64_t chk_64 = (vc_maxhandle+1) * sizeof(fst_off_t);
-				if((chk_64/sizeof(fst_off_t)) != (vc_maxhandle+1))
-				{
-				chk_report_abort("TALOS-2023-1798");
-				}
-			}
-                chain_table = (fst_off_t *)calloc((vc_maxhandle+1), sizeof(fst_off_t));
-
-		if(sizeof(size_t) < sizeof(uint64_t))
-			{
-			/* TALOS-2023-1798 for 32b overflow */
-			uint64_t chk_64 = (vc_maxhandle+1) * sizeof(uint32_t);
-			size_t   chk_32 = ((size_t)(vc_maxhandle+1)) * sizeof(uint32_t);
-			if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1798");
-			}
-		else
-			{
-			uint64_t chk_64 = (vc_maxhandle+1) * sizeof(uint32_t);
-				if((chk_64/sizeof(uint32_t)) != (vc_maxhandle+1))
-				{
-				chk_report_abort("TALOS-2023-1798");
-				}
-			}
-                chain_table_lengths = (uint32_t *)calloc((vc_maxhandle+1), sizeof(uint32_t));
-                }
-
-        if(!chain_table || !chain_table_lengths) goto block_err;
-
-        pnt = chain_cmem;
-        idx = 0;
-        pval = 0;
-
-        if(sectype == FST_BL_VCDATA_DYN_ALIAS2)
-                {
-                uint32_t prev_alias = 0;
-
-                do      {
-                        int skiplen;
-
-                        if(*pnt & 0x01)
-                                {
-                                int64_t shval = fstGetSVarint64(pnt, &skiplen) >> 1;
-                                if(shval > 0)
-                                        {
-                                        pval = chain_table[idx] = pval + shval;
-                                        if(idx) { chain_table_lengths[pidx] = pval - chain_table[pidx]; }
-                                        pidx = idx++;
-                                        }
-                                else if(shval < 0)
-                                        {
-                                        chain_table[idx] = 0;                                   /* need to explicitly zero as calloc above might not run */
-                                        chain_table_lengths[idx] = prev_alias = shval;          /* because during this loop iter would give stale data! */
-                                        idx++;
-                                        }
-                                else
+                                if(fv)
                                         {
-                                        chain_table[idx] = 0;                                   /* need to explicitly zero as calloc above might not run */
-                                        chain_table_lengths[idx] = prev_alias;                  /* because during this loop iter would give stale data! */
-                                        idx++;
+                                        char vcd_id[16];
+                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
+                                        vcd_id[0] = ' ';
+                                        vcd_id[vcdid_len+1] = '\n';
+                                        fstWritex(xc, vcd_id, vcdid_len+2);
                                         }
-                                }
-                                else
-                                {
-                                uint64_t val = fstGetVarint32(pnt, &skiplen);
-
-                                fstHandle loopcnt = val >> 1;
-				if((idx+loopcnt-1) > vc_maxhandle) /* TALOS-2023-1789 */
-					{
-					chk_report_abort("TALOS-2023-1789");
-					}
 
-                                for(i=0;i<loopcnt;i++)
-                                        {
-                                        chain_table[idx++] = 0;
-                                        }
-                                }
+                                skiplen += len;
+                                headptr[idx] += skiplen;
+                                length_remaining[idx] -= skiplen;
 
-                        pnt += skiplen;
-                        } while (pnt != (chain_cmem + chain_clen));
-                }
-                else
-                {
-                do      {
-                        int skiplen;
-                        uint64_t val = fstGetVarint32(pnt, &skiplen);
+                                tc_head[i] = scatterptr[idx];
+                                scatterptr[idx] = 0;
 
-                        if(!val)
-                                {
-                                pnt += skiplen;
-                                val = fstGetVarint32(pnt, &skiplen);
-                                chain_table[idx] = 0;                   /* need to explicitly zero as calloc above might not run */
-                                chain_table_lengths[idx] = -val;        /* because during this loop iter would give stale data! */
-                                idx++;
-                                }
-                        else
-                        if(val&1)
-                                {
-                                pval = chain_table[idx] = pval + (val >> 1);
-                                if(idx) { chain_table_lengths[pidx] = pval - chain_table[pidx]; }
-                                pidx = idx++;
-                                }
-                        else
-                                {
-                                fstHandle loopcnt = val >> 1;
+                                if(length_remaining[idx])
+                                        {
+                                        vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[idx]);
+                                        tdelta = vli >> 1;
 
-				if((idx+loopcnt-1) > vc_maxhandle) /* TALOS-2023-1789 */
-					{
-					chk_report_abort("TALOS-2023-1789");
-					}
+					if((tdelta+i) >= tc_head_items)
+						{
+						chk_report_abort("TALOS-2023-1791");
+						}
 
-                                for(i=0;i<loopcnt;i++)
-                                        {
-                                        chain_table[idx++] = 0;
+                                        scatterptr[idx] = tc_head[i+tdelta];
+                                        tc_head[i+tdelta] = idx+1;
                                         }
                                 }
-
-                        pnt += skiplen;
-                        } while (pnt != (chain_cmem + chain_clen));
+                        }
                 }
 
-        chain_table[idx] = indx_pos - vc_start;
-        chain_table_lengths[pidx] = chain_table[idx] - chain_table[pidx];
-
-        for(i=0;i<idx;i++)
+block_err:
+#ifdef FST_READER_PARALLEL
+        if(bd)
                 {
-                int32_t v32 = chain_table_lengths[i];
-                if((v32 < 0) && (!chain_table[i]))
-                        {
-                        v32 = -v32;
-                        v32--;
-                        if(((uint32_t)v32) < i) /* sanity check */
-                                {
-                                chain_table[i] = chain_table[v32];
-                                chain_table_lengths[i] = chain_table_lengths[v32];
-                                }
-                        }
+                fstReaderDecodePoolRelease(pool, bd); /* the slot owns these */
+                time_table = NULL;
+                tc_head = NULL;
+                mem_for_traversal = NULL;
+                scatterptr = headptr = length_remaining = NULL;
                 }
-
-#ifdef FST_DEBUG
-        fprintf(stderr, FST_APIMESS "decompressed chain idx len: %" PRIu32 "\n", idx);
 #endif
+        free(tc_head);
+        free(chain_cmem_alloc);
+        free(mem_for_traversal); mem_for_traversal = NULL;
 
-        mc_mem_len = 16384;
-        mc_mem = (unsigned char *)malloc(mc_mem_len); /* buffer for compressed reads */
-
-        /* check compressed VC data */
-        if(idx > xc->maxhandle) idx = xc->maxhandle;
-        for(i=0;i<idx;i++)
-                {
-                if(chain_table[i])
-                        {
-                        int process_idx = i/8;
-                        int process_bit = i&7;
-
-                        if(xc->process_mask[process_idx]&(1<<process_bit))
-                                {
-                                int rc = Z_OK;
-                                uint32_t val;
-                                uint32_t skiplen;
-                                uint32_t tdelta;
-
-                                fstReaderFseeko(xc, xc->f, vc_start + chain_table[i], SEEK_SET);
-                                val = fstReaderVarint32WithSkip(xc->f, &skiplen);
-                                if(val)
-                                        {
-                                        unsigned char *mu = mem_for_traversal + traversal_mem_offs; /* uncomp: dst */
-                                        unsigned char *mc;                                          /* comp:   src */
-                                        unsigned long destlen = val;
-                                        unsigned long sourcelen = chain_table_lengths[i];
-
-					if(traversal_mem_offs >= mem_required_for_traversal)
-						{
-						chk_report_abort("TALOS-2023-1785");
-						}
+        secnum++;
+        if(secnum == xc->vc_section_count) break; /* in case file is growing, keep with original block count */
+        }
 
-                                        if(mc_mem_len < chain_table_lengths[i])
-                                                {
-                                                free(mc_mem);
-                                                mc_mem = (unsigned char *)malloc(mc_mem_len = chain_table_lengths[i]);
-                                                }
-                                        mc = mc_mem;
+#ifdef FST_READER_PARALLEL
+if(pool) fstReaderDecodePoolDestroy(pool);
+#endif
 
-                                        fstFread(mc, chain_table_lengths[i], 1, xc->f);
+if(mem_for_traversal) free(mem_for_traversal); /* scan-build */
+free(length_remaining);
+free(headptr);
+free(scatterptr);
 
-                                        switch(packtype)
-                                                {
-                                                case '4': rc = (destlen == (unsigned long)LZ4_decompress_safe_partial((char *)mc, (char *)mu, sourcelen, destlen, destlen)) ? Z_OK : Z_DATA_ERROR;
-                                                          break;
-                                                case 'F': fastlz_decompress(mc, sourcelen, mu, destlen); /* rc appears unreliable */
-                                                          break;
-                                                default:  rc = uncompress(mu, &destlen, mc, sourcelen);
-                                                          break;
-                                                }
+if(chain_table) free(chain_table);
+if(chain_table_lengths) free(chain_table_lengths);
 
-                                        /* data to process is for(j=0;j<destlen;j++) in mu[j] */
-                                        headptr[i] = traversal_mem_offs;
-                                        length_remaining[i] = val;
-                                        traversal_mem_offs += val;
-                                        }
-                                        else
-                                        {
-                                        int destlen = chain_table_lengths[i] - skiplen;
-                                        unsigned char *mu = mem_for_traversal + traversal_mem_offs;
+free(time_table);
 
-					if(traversal_mem_offs >= mem_required_for_traversal)
-						{
-						chk_report_abort("TALOS-2023-1785");
-						}
+#ifndef FST_WRITEX_DISABLE
+if(fv)
+        {
+        fstWritex(xc, NULL, 0);
+        }
+#endif
 
-                                        fstFread(mu, destlen, 1, xc->f);
-                                        /* data to process is for(j=0;j<destlen;j++) in mu[j] */
-                                        headptr[i] = traversal_mem_offs;
-                                        length_remaining[i] = destlen;
-                                        traversal_mem_offs += destlen;
-                                        }
+return(1);
+}
 
-                                if(rc != Z_OK)
-                                        {
-                                        fprintf(stderr, FST_APIMESS "fstReaderIterBlocks2(), fac: %d clen: %d (rc=%d), exiting.\n", (int)i, (int)val, rc);
-                                        exit(255);
-                                        }
 
-                                if(xc->signal_lens[i] == 1)
-                                        {
-                                        uint32_t vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[i]);
-                                        uint32_t shcnt = 2 << (vli & 1);
-                                        tdelta = vli >> shcnt;
-                                        }
-                                        else
-                                        {
-                                        uint32_t vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[i]);
-                                        tdelta = vli >> 1;
-                                        }
+/*
+ * columnar read: instead of one callback per value change with the value
+ * rendered as a string, each masked signal gets one callback per block with
+ * the block's time indices and its values packed straight from the chain.
+ */
+struct fstColumnScratch
+{
+uint32_t *time_idx;                     /* time_idx_alloc entries */
+uint32_t *value_offs;                   /* time_idx_alloc entries */
+uint32_t time_idx_alloc;
+unsigned char *values;
+uint64_t values_alloc;
+};
 
-				if(tdelta >= tc_head_items)
-					{
-					chk_report_abort("TALOS-2023-1791");
-					}
 
-                                scatterptr[i] = tc_head[tdelta];
-                                tc_head[tdelta] = i+1;
-                                }
-                        }
-                }
+static void fstColumnGrow(struct fstColumnScratch *cs, uint32_t count, uint64_t value_bytes)
+{
+if(count + 2 > cs->time_idx_alloc)
+        {
+        cs->time_idx_alloc = (count + 2) * 2;
+        cs->time_idx = (uint32_t *)realloc(cs->time_idx, cs->time_idx_alloc * sizeof(uint32_t));
+        cs->value_offs = (uint32_t *)realloc(cs->value_offs, cs->time_idx_alloc * sizeof(uint32_t));
+        }
 
-        free(mc_mem); /* there is no usage below for this, no real need to clear out mc_mem or mc_mem_len */
+if(value_bytes > cs->values_alloc)
+        {
+        cs->values_alloc = value_bytes * 2;
+        cs->values = (unsigned char *)realloc(cs->values, cs->values_alloc);
+        }
+}
 
-        for(i=0;i<tsec_nitems;i++)
-                {
-                uint32_t tdelta;
-                int skiplen, skiplen2;
-                uint32_t vli;
 
-                if(fv)
-                        {
-                        char wx_buf[32];
-                        int wx_len;
+static unsigned char fstColumnStateCode(unsigned char ch)
+{
+switch(ch)
+        {
+        case '0':               return(0);
+        case '1':               return(1);
+        case 'x': case 'X':     return(2);
+        case 'z': case 'Z':     return(3);
+        case 'h': case 'H':     return(4);
+        case 'u': case 'U':     return(5);
+        case 'w': case 'W':     return(6);
+        case 'l': case 'L':     return(7);
+        case '-':               return(8);
+        default:                return(9);
+        }
+}
 
-                        if(time_table[i] != previous_time)
-                                {
-                                if(xc->limit_range_valid)
-                                        {
-                                        if(time_table[i] > xc->limit_range_end)
-                                                {
-                                                break;
-                                                }
-                                        }
 
-				if(dumpvars_state == 1) { wx_len = snprintf(wx_buf, 32, "$end\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 2; }
-                                wx_len = snprintf(wx_buf, 32, "#%" PRIu64 "\n", time_table[i]);
-                                fstWritex(xc, wx_buf, wx_len);
-				if(!dumpvars_state) { wx_len = snprintf(wx_buf, 32, "$dumpvars\n"); fstWritex(xc, wx_buf, wx_len); dumpvars_state = 1; }
+/*
+ * packs len bits into dst (stride bytes, zeroed by the caller) at bpb bits
+ * per bit.  src is either bit-packed (binary) or one character per bit.
+ * returns 0 when a character needs more than 2 bits.
+ */
+static int fstColumnPackBits(unsigned char *dst, uint32_t stride, int bpb, const unsigned char *src, uint32_t len, int binary)
+{
+uint32_t j;
 
-                                if((xc->num_blackouts)&&(cur_blackout != xc->num_blackouts))
-                                        {
-                                        if(time_table[i] == xc->blackout_times[cur_blackout])
-                                                {
-                                                wx_len = snprintf(wx_buf, 32, "$dump%s $end\n", (xc->blackout_activity[cur_blackout++]) ? "on" : "off");
-                                                fstWritex(xc, wx_buf, wx_len);
-                                                }
-                                        }
-                                previous_time = time_table[i];
-                                }
-                        }
+if(binary)
+        {
+        if(bpb == 2)
+                {
+                for(j=0;j<(len+7)/8;j++)
+                        {
+                        uint32_t w = src[j];
 
-                while(tc_head[i])
+                        w = (w | (w << 4)) & 0x0F0F; /* bit k moves to bit 2k */
+                        w = (w | (w << 2)) & 0x3333;
+                        w = (w | (w << 1)) & 0x5555;
+                        dst[2*j] = w >> 8;
+                        if(2*j+1 < stride) dst[2*j+1] = w & 0xff;
+                        }
+                }
+                else
+                {
+                for(j=0;j<len;j++)
                         {
-                        idx = tc_head[i] - 1;
-                        vli = fstGetVarint32(mem_for_traversal + headptr[idx], &skiplen);
+                        dst[j>>1] |= ((src[j>>3] >> (7 - (j&7))) & 1) << ((j&1) ? 0 : 4);
+                        }
+                }
+        }
+        else
+        {
+        for(j=0;j<len;j++)
+                {
+                unsigned char code = fstColumnStateCode(src[j]);
 
-                        if(xc->signal_lens[idx] <= 1)
-                                {
-                                if(xc->signal_lens[idx] == 1)
-                                        {
-                                        unsigned char val;
-                                        if(!(vli & 1))
-                                                {
-                                                /* tdelta = vli >> 2; */ /* scan-build */
-                                                val = ((vli >> 1) & 1) | '0';
-                                                }
-                                                else
-                                                {
-                                                /* tdelta = vli >> 4; */ /* scan-build */
-                                                val = FST_RCV_STR[((vli >> 1) & 7)];
-                                                }
+                if(bpb == 2)
+                        {
+                        if(code > 3) return(0);
+                        dst[j>>2] |= code << (6 - ((j&3)<<1));
+                        }
+                        else
+                        {
+                        dst[j>>1] |= code << ((j&1) ? 0 : 4);
+                        }
+                }
+        }
 
-                                        if(value_change_callback)
-                                                {
-                                                xc->temp_signal_value_buf[0] = val;
-                                                xc->temp_signal_value_buf[1] = 0;
-                                                value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
-                                                }
-                                                else
-                                                {
-                                                if(fv)
-                                                        {
-                                                        char vcd_id[16];
-                                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
+return(1);
+}
 
-                                                        vcd_id[0] = val;
-                                                        vcd_id[vcdid_len+1] = '\n';
-                                                        fstWritex(xc, vcd_id, vcdid_len+2);
-                                                        }
-                                                }
-                                        headptr[idx] += skiplen;
-                                        length_remaining[idx] -= skiplen;
 
-                                        tc_head[i] = scatterptr[idx];
-                                        scatterptr[idx] = 0;
+static void fstColumnPackDouble(struct fstReaderContext *xc, unsigned char *dst, const unsigned char *srcdata)
+{
+if(xc->double_endian_match)
+        {
+        memcpy(dst, srcdata, 8);
+        }
+        else
+        {
+        int j;
 
-                                        if(length_remaining[idx])
-                                                {
-                                                int shamt;
-                                                vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[idx]);
-                                                shamt = 2 << (vli & 1);
-                                                tdelta = vli >> shamt;
+        for(j=0;j<8;j++)
+                {
+                dst[j] = srcdata[7-j];
+                }
+        }
+}
 
-						if((tdelta+i) >= tc_head_items)
-							{
-							chk_report_abort("TALOS-2023-1791");
-							}
 
-                                                scatterptr[idx] = tc_head[i+tdelta];
-                                                tc_head[i+tdelta] = idx+1;
-                                                }
-                                        }
-                                        else
-                                        {
-                                        unsigned char *vdata;
-                                        uint32_t len;
+/*
+ * fills col with the changes of facidx idx in one block: the frame value
+ * (if any) at time index 0, then the chain, whose entries are laid out as
+ * fstReaderIterBlocks2() consumes them.  returns 0 when bpb is too small.
+ */
+static int fstReaderDecodeColumn(struct fstReaderContext *xc, fstHandle idx, const unsigned char *frame_val,
+        const unsigned char *chain, uint32_t chain_len, uint64_t tsec_nitems, int bpb,
+        struct fstColumnScratch *cs, struct fstColumn *col)
+{
+uint32_t len = xc->signal_lens[idx];
+uint32_t stride;
+uint32_t count = 0;
+uint64_t used = 0;
+uint64_t tidx = 0;
+uint32_t pos = 0;
 
-                                        vli = fstGetVarint32(mem_for_traversal + headptr[idx], &skiplen);
-                                        len = fstGetVarint32(mem_for_traversal + headptr[idx] + skiplen, &skiplen2);
-                                        /* tdelta = vli >> 1; */ /* scan-build */
-                                        skiplen += skiplen2;
-                                        vdata = mem_for_traversal + headptr[idx] + skiplen;
+if(len == 0)
+        {
+        col->encoding = FST_CE_BYTES;
+        stride = 0;
+        }
+else if((len == 1) || (xc->signal_typs[idx] != FST_VT_VCD_REAL))
+        {
+        col->encoding = (bpb == 2) ? FST_CE_BITS2 : FST_CE_BITS4;
+        stride = ((uint64_t)len * bpb + 7) / 8;
+        }
+else
+        {
+        col->encoding = FST_CE_DOUBLE;
+        stride = 8;
+        }
 
-                                        if(!(vli & 1))
-                                                {
-                                                if(value_change_callback_varlen)
-                                                        {
-                                                        value_change_callback_varlen(user_callback_data_pointer, time_table[i], idx+1, vdata, len);
-                                                        }
-                                                        else
-                                                        {
-                                                        if(fv)
-                                                                {
-                                                                char vcd_id[16];
-                                                                int vcdid_len;
+if(frame_val)
+        {
+        fstColumnGrow(cs, count, used + stride);
+        memset(cs->values + used, 0, stride);
+        if(col->encoding == FST_CE_DOUBLE)
+                {
+                fstColumnPackDouble(xc, cs->values + used, frame_val);
+                }
+        else if(!fstColumnPackBits(cs->values + used, stride, bpb, frame_val, len, 0))
+                {
+                return(0);
+                }
+        cs->time_idx[count++] = 0;
+        used += stride;
+        }
 
-                                                                vcd_id[0] = 's';
-                                                                fstWritex(xc, vcd_id, 1);
+while(pos < chain_len)
+        {
+        int skiplen;
+        uint32_t vli = fstGetVarint32((unsigned char *)chain + pos, &skiplen);
+        const unsigned char *vdata;
+        uint32_t vlen;
+        int emit = 1;
 
-                                                                vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
-                                                                {
-								if(sizeof(size_t) < sizeof(uint64_t))
-                							{
-                							/* TALOS-2023-1790 for 32b overflow */
-                							uint64_t chk_64 = len*4 + 1;
-                							size_t   chk_32 = len*4 + 1;
-                							if(chk_64 != chk_32) chk_report_abort("TALOS-2023-1790");
-                							}
+        pos += skiplen;
+        if(len == 1)
+                {
+                unsigned char ch;
 
-                                                                unsigned char *vesc = (unsigned char *)malloc(len*4 + 1);
-                                                                int vlen = fstUtilityBinToEsc(vesc, vdata, len);
-                                                                fstWritex(xc, vesc, vlen);
-                                                                free(vesc);
-                                                                }
+                if(!(vli & 1))
+                        {
+                        tidx += vli >> 2;
+                        ch = ((vli >> 1) & 1) | '0';
+                        }
+                        else
+                        {
+                        tidx += vli >> 4;
+                        ch = FST_RCV_STR[((vli >> 1) & 7)];
+                        }
 
-                                                                vcd_id[0] = ' ';
-                                                                vcd_id[vcdid_len + 1] = '\n';
-                                                                fstWritex(xc, vcd_id, vcdid_len+2);
-                                                                }
-                                                        }
-                                                }
+                if(tidx >= tsec_nitems)
+                        {
+                        chk_report_abort("TALOS-2023-1791");
+                        }
 
-                                        skiplen += len;
-                                        headptr[idx] += skiplen;
-                                        length_remaining[idx] -= skiplen;
+                fstColumnGrow(cs, count, used + stride);
+                cs->values[used] = 0;
+                if(!fstColumnPackBits(cs->values + used, stride, bpb, &ch, 1, 0)) return(0);
+                cs->time_idx[count++] = tidx + 1;
+                used += stride;
+                continue;
+                }
 
-                                        tc_head[i] = scatterptr[idx];
-                                        scatterptr[idx] = 0;
+        tidx += vli >> 1;
+        if(tidx >= tsec_nitems)
+                {
+                chk_report_abort("TALOS-2023-1791");
+                }
 
-                                        if(length_remaining[idx])
-                                                {
-                                                vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[idx]);
-                                                tdelta = vli >> 1;
+        if(len == 0)
+                {
+                vlen = fstGetVarint32((unsigned char *)chain + pos, &skiplen);
+                pos += skiplen;
+                emit = !(vli & 1);
+                }
+        else if(col->encoding != FST_CE_DOUBLE)
+                {
+                vlen = (vli & 1) ? len : (len + 7) / 8;
+                }
+        else
+                {
+                vlen = (vli & 1) ? 8 : 1;
+                }
 
-						if((tdelta+i) >= tc_head_items)
-							{
-							chk_report_abort("TALOS-2023-1791");
-							}
+        if(vlen > chain_len - pos)
+                {
+                chk_report_abort("TALOS-2023-1793");
+                }
+        vdata = chain + pos;
+        pos += vlen;
+        if(!emit) continue;
 
-                                                scatterptr[idx] = tc_head[i+tdelta];
-                                                tc_head[i+tdelta] = idx+1;
-                                                }
+        if(col->encoding == FST_CE_BYTES)
+                {
+                fstColumnGrow(cs, count, used + vlen);
+                memcpy(cs->values + used, vdata, vlen);
+                cs->value_offs[count] = used;
+                used += vlen;
+                }
+                else
+                {
+                fstColumnGrow(cs, count, used + stride);
+                memset(cs->values + used, 0, stride);
+                if(col->encoding == FST_CE_DOUBLE)
+                        {
+                        if(!(vli & 1))  /* very rare case, but possible */
+                                {
+                                unsigned char buf[8];
+                                int j;
+
+                                for(j=0;j<8;j++)
+                                        {
+                                        buf[j] = ((vdata[0] >> (7 - j)) & 1) | '0';
                                         }
+                                fstColumnPackDouble(xc, cs->values + used, buf);
                                 }
                                 else
                                 {
-                                uint32_t len = xc->signal_lens[idx];
-                                unsigned char *vdata;
+                                fstColumnPackDouble(xc, cs->values + used, vdata);
+                                }
+                        }
+                else if(!fstColumnPackBits(cs->values + used, stride, bpb, vdata, len, !(vli & 1)))
+                        {
+                        return(0);
+                        }
+                used += stride;
+                }
+        cs->time_idx[count++] = tidx + 1;
+        }
 
-                                vli = fstGetVarint32(mem_for_traversal + headptr[idx], &skiplen);
-                                /* tdelta = vli >> 1; */ /* scan-build */
-                                vdata = mem_for_traversal + headptr[idx] + skiplen;
+if(col->encoding == FST_CE_BYTES) cs->value_offs[count] = used;
 
-                                if(xc->signal_typs[idx] != FST_VT_VCD_REAL)
-                                        {
-					if(len > xc->longest_signal_value_len)
-						{
-						chk_report_abort("TALOS-2023-1797");
-						}
+col->handle = idx + 1;
+col->len = len;
+col->count = count;
+col->time_idx = cs->time_idx;
+col->values = cs->values;
+col->value_stride = stride;
+col->value_offs = (col->encoding == FST_CE_BYTES) ? cs->value_offs : NULL;
+return(1);
+}
 
-                                        if(!(vli & 1))
-                                                {
-                                                int byte = 0;
-                                                int bit;
-                                                unsigned int j;
 
-                                                for(j=0;j<len;j++)
-                                                        {
-                                                        unsigned char ch;
-                                                        byte = j/8;
-                                                        bit = 7 - (j & 7);
-                                                        ch = ((vdata[byte] >> bit) & 1) | '0';
-                                                        xc->temp_signal_value_buf[j] = ch;
-                                                        }
-                                                xc->temp_signal_value_buf[j] = 0;
+/* inflates the frame (initial values) of a loaded block, NULL on a malformed block */
+static unsigned char *fstReaderColumnFrame(struct fstBlockDecode *bd, uint64_t *frame_uclen, uint64_t *frame_maxhandle)
+{
+const unsigned char *pnt = bd->blk + 32;
+uint64_t frame_clen;
+unsigned char *mu;
+int skiplen;
 
-                                                if(value_change_callback)
-                                                        {
-                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
-                                                        }
-                                                        else
-                                                        {
-                                                        if(fv)  {
-                                                                unsigned char ch_bp = (xc->signal_typs[idx] != FST_VT_VCD_PORT) ? 'b' : 'p';
+*frame_uclen = fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;
+frame_clen = fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;
+*frame_maxhandle = fstGetVarint64((unsigned char *)pnt, &skiplen); pnt += skiplen;
+if((frame_clen > bd->ent->seclen) || (pnt + frame_clen > bd->blk + bd->ent->seclen)) return(NULL);
 
-                                                                fstWritex(xc, &ch_bp, 1);
-                                                                fstWritex(xc, xc->temp_signal_value_buf, len);
-                                                                }
-                                                        }
+mu = (unsigned char *)malloc(*frame_uclen ? *frame_uclen : 1);
+if(!mu) return(NULL);
 
-                                                len = byte+1;
-                                                }
-                                                else
-                                                {
-                                                if(value_change_callback)
-                                                        {
-                                                        memcpy(xc->temp_signal_value_buf, vdata, len);
-                                                        xc->temp_signal_value_buf[len] = 0;
-                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
-                                                        }
-                                                        else
-                                                        {
-                                                        if(fv)
-                                                                {
-                                                                unsigned char ch_bp =  (xc->signal_typs[idx] != FST_VT_VCD_PORT) ? 'b' : 'p';
-								uint64_t mem_required_for_traversal_chk = vdata - mem_for_traversal + len;
+if(*frame_uclen == frame_clen)
+        {
+        memcpy(mu, pnt, frame_clen);
+        }
+        else
+        {
+        unsigned long destlen = *frame_uclen;
+        unsigned long sourcelen = frame_clen;
+        int rc = uncompress(mu, &destlen, pnt, sourcelen);
 
-                                                                fstWritex(xc, &ch_bp, 1);
-								if(mem_required_for_traversal_chk > mem_required_for_traversal)
-									{
-									chk_report_abort("TALOS-2023-1793");
-									}
-                                                                fstWritex(xc, vdata, len);
-                                                                }
-                                                        }
-                                                }
-                                        }
-                                        else
-                                        {
-                                        double d;
-                                        unsigned char *clone_d /*= (unsigned char *)&d */; /* scan-build */
-                                        unsigned char buf[8];
-                                        unsigned char *srcdata;
+        if(rc != Z_OK)
+                {
+                fprintf(stderr, FST_APIMESS "fstReaderIterBlocksColumns(), frame uncompress rc: %d, exiting.\n", rc);
+                exit(255);
+                }
+        }
 
-                                        if(!(vli & 1))  /* very rare case, but possible */
-                                                {
-                                                int bit;
-                                                int j;
+return(mu);
+}
 
-                                                for(j=0;j<8;j++)
-                                                        {
-                                                        unsigned char ch;
-                                                        bit = 7 - (j & 7);
-                                                        ch = ((vdata[0] >> bit) & 1) | '0';
-                                                        buf[j] = ch;
-                                                        }
 
-                                                len = 1;
-                                                srcdata = buf;
-                                                }
-                                                else
-                                                {
-                                                srcdata = vdata;
-                                                }
+/*
+ * calls column_callback once per masked signal with changes in each value
+ * change block, in block order and by ascending handle within a block.
+ * values are delivered as in fstReaderIterBlocks2(), initial values
+ * included, and col only stays valid during the callback.  as there, a
+ * time range limit selects whole blocks.
+ */
+int fstReaderIterBlocksColumns(void *ctx,
+        void (*column_callback)(void *user_callback_data_pointer, const struct fstColumn *col),
+        void *user_callback_data_pointer)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstBlockDecode bd_serial;
+struct fstBlockDecode *bd;
+struct fstColumnScratch cs;
+struct fstColumn col;
+uint64_t *times = NULL;
+uint64_t times_alloc = 0;
+uint64_t blk_num = 0;
+unsigned int secnum = 0;
+int blocks_skipped = 0;
+#ifdef FST_READER_PARALLEL
+struct fstBlockDecodePool *pool = NULL;
+#endif
 
-                                        if(value_change_callback)
-                                                {
-                                                if(xc->native_doubles_for_cb)
-                                                        {
-                                                        if(xc->double_endian_match)
-                                                                {
-                                                                clone_d = srcdata;
-                                                                }
-                                                                else
-                                                                {
-                                                                int j;
+if((!xc) || (!column_callback)) return(0);
 
-                                                                clone_d = (unsigned char *)&d;
-                                                                for(j=0;j<8;j++)
-                                                                        {
-                                                                        clone_d[j] = srcdata[7-j];
-                                                                        }
-                                                                }
-                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, clone_d);
-                                                        }
-                                                        else
-                                                        {
-                                                        clone_d = (unsigned char *)&d;
-                                                        if(xc->double_endian_match)
-                                                                {
-                                                                memcpy(clone_d, srcdata, 8);
-                                                                }
-                                                                else
-                                                                {
-                                                                int j;
+memset(&bd_serial, 0, sizeof(bd_serial));
+memset(&cs, 0, sizeof(cs));
+memset(&col, 0, sizeof(col));
 
-                                                                for(j=0;j<8;j++)
-                                                                        {
-                                                                        clone_d[j] = srcdata[7-j];
-                                                                        }
-                                                                }
-                                                        snprintf((char *)xc->temp_signal_value_buf, xc->longest_signal_value_len + 1, "%.16g", d);
-                                                        value_change_callback(user_callback_data_pointer, time_table[i], idx+1, xc->temp_signal_value_buf);
-                                                        }
-                                                }
-                                                else
-                                                {
-                                                if(fv)
-                                                        {
-                                                        char wx_buf[32];
-                                                        int wx_len;
+if(xc->limit_range_valid)
+        {
+        blk_num = fstReaderFindBlock(xc, xc->limit_range_start);
+        blocks_skipped = blk_num;
+        }
 
-                                                        clone_d = (unsigned char *)&d;
-                                                        if(xc->double_endian_match)
-                                                                {
-                                                                memcpy(clone_d, srcdata, 8);
-                                                                }
-                                                                else
-                                                                {
-                                                                int j;
+#ifdef FST_READER_PARALLEL
+if(xc->iterblocks_threads > 1)
+        {
+        pool = fstReaderDecodePoolCreate(xc, blk_num, xc->iterblocks_threads);
+        }
+
+if(!pool)
+#endif
+        {
+        bd_serial.scatterptr = (uint32_t *)calloc(xc->maxhandle ? xc->maxhandle : 1, sizeof(uint32_t));
+        bd_serial.headptr = (uint32_t *)calloc(xc->maxhandle ? xc->maxhandle : 1, sizeof(uint32_t));
+        bd_serial.length_remaining = (uint32_t *)calloc(xc->maxhandle ? xc->maxhandle : 1, sizeof(uint32_t));
+        }
+
+while(blk_num < xc->blk_index_count)
+        {
+        struct fstBlockIndexEntry *ent = xc->blk_index + blk_num++;
+        unsigned char *frame = NULL;
+        uint64_t frame_uclen = 0, frame_maxhandle = 0;
+        uint64_t sig_offs = 0;
+        fstHandle i;
+
+        if(xc->limit_range_valid)
+                {
+                if(ent->end_tim < xc->limit_range_start)
+                        {
+                        blocks_skipped++;
+                        continue;
+                        }
+
+                if(ent->beg_tim > xc->limit_range_end)
+                        {
+                        break;
+                        }
+                }
+
+#ifdef FST_READER_PARALLEL
+        if(pool)
+                {
+                bd = fstReaderDecodePoolNext(pool, ent);
+                if(!bd) break;
+                }
+                else
+#endif
+                {
+                bd = &bd_serial;
+                bd->ent = ent;
+                if(!fstReaderLoadBlock(xc, bd))
+                        {
+                        fstReaderDecodeReset(bd);
+                        break;
+                        }
+                fstReaderBlockCacheFetch(xc, bd);
+                if(!fstReaderDecodeBlock(xc, bd))
+                        {
+                        fstReaderDecodeReset(bd);
+                        break;
+                        }
+                fstReaderBlockCacheKeep(xc, bd);
+                }
+
+        if(bd->tsec_nitems + 1 > times_alloc)
+                {
+                times_alloc = (bd->tsec_nitems + 1) * 2;
+                times = (uint64_t *)realloc(times, times_alloc * sizeof(uint64_t));
+                }
+        times[0] = ent->beg_tim;
+        memcpy(times + 1, bd->time_table, bd->tsec_nitems * sizeof(uint64_t));
+        col.times = times;
+        col.times_count = bd->tsec_nitems + 1;
 
-                                                                for(j=0;j<8;j++)
-                                                                        {
-                                                                        clone_d[j] = srcdata[7-j];
-                                                                        }
-                                                                }
+        if((secnum == 0) && ((!bd->tsec_nitems) || (ent->beg_tim != bd->time_table[0]) || (blocks_skipped)))
+                {
+                frame = fstReaderColumnFrame(bd, &frame_uclen, &frame_maxhandle);
+                if(frame_maxhandle > xc->maxhandle) frame_maxhandle = xc->maxhandle;
+                }
 
-                                                        wx_len = snprintf(wx_buf, 32, "r%.16g", d);
-                                                        fstWritex(xc, wx_buf, wx_len);
-                                                        }
-                                                }
-                                        }
+        for(i=0;i<xc->maxhandle;i++)
+                {
+                const unsigned char *frame_val = NULL;
+                const unsigned char *chain = NULL;
 
-                                if(fv)
+                if(frame && (i < frame_maxhandle))
+                        {
+                        if(xc->signal_lens[i] && (xc->process_mask[i/8]&(1<<(i&7))))
+                                {
+                                if(sig_offs + xc->signal_lens[i] > frame_uclen)
                                         {
-                                        char vcd_id[16];
-                                        int vcdid_len = fstVcdIDForFwrite(vcd_id+1, idx+1);
-                                        vcd_id[0] = ' ';
-                                        vcd_id[vcdid_len+1] = '\n';
-                                        fstWritex(xc, vcd_id, vcdid_len+2);
+                                        chk_report_abort("TALOS-2023-1793");
                                         }
+                                frame_val = frame + sig_offs;
+                                }
+                        sig_offs += xc->signal_lens[i];
+                        }
+                else if(!xc->process_mask[i/8])
+                        {
+                        i |= 7; /* skip the rest of an empty mask byte */
+                        continue;
+                        }
 
-                                skiplen += len;
-                                headptr[idx] += skiplen;
-                                length_remaining[idx] -= skiplen;
+                if(!(xc->process_mask[i/8]&(1<<(i&7)))) continue;
 
-                                tc_head[i] = scatterptr[idx];
-                                scatterptr[idx] = 0;
+                if(bd->length_remaining[i])
+                        {
+                        chain = bd->mem_for_traversal + bd->headptr[i];
+                        }
 
-                                if(length_remaining[idx])
-                                        {
-                                        vli = fstGetVarint32NoSkip(mem_for_traversal + headptr[idx]);
-                                        tdelta = vli >> 1;
+                if((!frame_val) && (!chain)) continue;
 
-					if((tdelta+i) >= tc_head_items)
-						{
-						chk_report_abort("TALOS-2023-1791");
-						}
+                if(!fstReaderDecodeColumn(xc, i, frame_val, chain, chain ? bd->length_remaining[i] : 0, bd->tsec_nitems, 2, &cs, &col))
+                        {
+                        fstReaderDecodeColumn(xc, i, frame_val, chain, chain ? bd->length_remaining[i] : 0, bd->tsec_nitems, 4, &cs, &col);
+                        }
 
-                                        scatterptr[idx] = tc_head[i+tdelta];
-                                        tc_head[i+tdelta] = idx+1;
-                                        }
-                                }
+                if(col.count)
+                        {
+                        column_callback(user_callback_data_pointer, &col);
                         }
                 }
 
-block_err:
-        free(tc_head);
-        free(chain_cmem);
-        free(mem_for_traversal); mem_for_traversal = NULL;
+        free(frame);
+
+#ifdef FST_READER_PARALLEL
+        if(pool)
+                {
+                fstReaderDecodePoolRelease(pool, bd);
+                }
+                else
+#endif
+                {
+                fstReaderDecodeReset(bd);
+                }
 
         secnum++;
         if(secnum == xc->vc_section_count) break; /* in case file is growing, keep with original block count */
-        blkpos += seclen;
         }
 
-if(mem_for_traversal) free(mem_for_traversal); /* scan-build */
-free(length_remaining);
-free(headptr);
-free(scatterptr);
-
-if(chain_table) free(chain_table);
-if(chain_table_lengths) free(chain_table_lengths);
-
-free(time_table);
-
-#ifndef FST_WRITEX_DISABLE
-if(fv)
-        {
-        fstWritex(xc, NULL, 0);
-        }
+#ifdef FST_READER_PARALLEL
+if(pool) fstReaderDecodePoolDestroy(pool);
 #endif
 
+free(bd_serial.scatterptr);
+free(bd_serial.headptr);
+free(bd_serial.length_remaining);
+free(bd_serial.chain_table);
+free(bd_serial.chain_table_lengths);
+fstReaderFreeZstdDCtx(&bd_serial.zstd_dctx);
+free(cs.time_idx);
+free(cs.value_offs);
+free(cs.values);
+free(times);
+
 return(1);
 }
 
 
 /* rvat functions */
 
-static char *fstExtractRvatDataFromFrame(struct fstReaderContext *xc, fstHandle facidx, char *buf)
+static char *fstExtractRvatDataFromFrame(struct fstReaderContext *xc, struct fstRvatBlock *rb, fstHandle facidx, char *buf)
 {
-if(facidx >= xc->rvat_frame_maxhandle)
+if(facidx >= rb->frame_maxhandle)
         {
         return(NULL);
         }
 
 if(xc->signal_lens[facidx] == 1)
         {
-        buf[0] = (char)xc->rvat_frame_data[xc->rvat_sig_offs[facidx]];
+        buf[0] = (char)rb->frame_data[xc->rvat_sig_offs[facidx]];
         buf[1] = 0;
         }
         else
         {
         if(xc->signal_typs[facidx] != FST_VT_VCD_REAL)
                 {
-                memcpy(buf, xc->rvat_frame_data + xc->rvat_sig_offs[facidx], xc->signal_lens[facidx]);
+                memcpy(buf, rb->frame_data + xc->rvat_sig_offs[facidx], xc->signal_lens[facidx]);
                 buf[xc->signal_lens[facidx]] = 0;
                 }
                 else
                 {
                 double d;
                 unsigned char *clone_d = (unsigned char *)&d;
-                unsigned char *srcdata = xc->rvat_frame_data + xc->rvat_sig_offs[facidx];
+                unsigned char *srcdata = rb->frame_data + xc->rvat_sig_offs[facidx];
 
                 if(xc->double_endian_match)
                         {
@@ -6390,193 +11821,118 @@ return(buf);
 }
 
 
-char *fstReaderGetValueFromHandleAtTime(void *ctx, uint64_t tim, fstHandle facidx, char *buf)
+/*
+ * the decoded block blk_num for value at time lookups.  a miss loads it
+ * into the least recently used of the FST_RVAT_CACHE_BLOCKS slots, taking
+ * its time table and chain index from the block cache when they are there.
+ */
+static struct fstRvatBlock *fstReaderRvatLoadBlock(struct fstReaderContext *xc, uint64_t blk_num)
 {
-struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
-fst_off_t blkpos = 0, prev_blkpos;
-uint64_t beg_tim, end_tim, beg_tim2, end_tim2;
-int sectype;
-#ifdef FST_DEBUG
-unsigned int secnum = 0;
-#endif
+struct fstRvatBlock *rb = NULL;
+struct fstBlockIndexEntry *ent = xc->blk_index + blk_num;
+fst_off_t blkpos;
 uint64_t seclen;
-uint64_t tsec_uclen = 0, tsec_clen = 0;
-uint64_t tsec_nitems;
+uint64_t tsec_clen;
 uint64_t frame_uclen, frame_clen;
-#ifdef FST_DEBUG
-uint64_t mem_required_for_traversal;
-#endif
 fst_off_t indx_pntr, indx_pos;
 long chain_clen;
-unsigned char *chain_cmem;
-unsigned char *pnt;
-fstHandle idx, pidx=0, i;
-uint64_t pval;
-
-if((!xc) || (!facidx) || (facidx > xc->maxhandle) || (!buf) || (!xc->signal_lens[facidx-1]))
-        {
-        return(NULL);
-        }
-
-if(!xc->rvat_sig_offs)
-        {
-        uint32_t cur_offs = 0;
-
-        xc->rvat_sig_offs = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
-        for(i=0;i<xc->maxhandle;i++)
-                {
-                xc->rvat_sig_offs[i] = cur_offs;
-                cur_offs += xc->signal_lens[i];
-                }
-        }
+int times_cached, chains_cached;
+fstHandle idx = 0;
+int slot;
 
-if(xc->rvat_data_valid)
+if(!xc->rvat_blocks)
         {
-        if((xc->rvat_beg_tim <= tim) && (tim <= xc->rvat_end_tim))
-                {
-                goto process_value;
-                }
-
-        fstReaderDeallocateRvatData(xc);
+        xc->rvat_blocks = (struct fstRvatBlock *)calloc(FST_RVAT_CACHE_BLOCKS, sizeof(struct fstRvatBlock));
+        if(!xc->rvat_blocks) return(NULL);
         }
 
-xc->rvat_chain_pos_valid = 0;
-
-for(;;)
+for(slot=0;slot<FST_RVAT_CACHE_BLOCKS;slot++)
         {
-        fstReaderFseeko(xc, xc->f, (prev_blkpos = blkpos), SEEK_SET);
-
-        sectype = fgetc(xc->f);
-        seclen = fstReaderUint64(xc->f);
-
-        if((sectype == EOF) || (sectype == FST_BL_SKIP) || (!seclen))
-                {
-                return(NULL); /* if this loop exits on break, it's successful */
-                }
-
-        blkpos++;
-        if((sectype != FST_BL_VCDATA) && (sectype != FST_BL_VCDATA_DYN_ALIAS) && (sectype != FST_BL_VCDATA_DYN_ALIAS2))
-                {
-                blkpos += seclen;
-                continue;
-                }
-
-        beg_tim = fstReaderUint64(xc->f);
-        end_tim = fstReaderUint64(xc->f);
+        struct fstRvatBlock *cand = xc->rvat_blocks + slot;
 
-        if((beg_tim <= tim) && (tim <= end_tim))
+        if((cand->last_used) && (cand->blk_num == blk_num))
                 {
-                if((tim == end_tim) && (tim != xc->end_time))
-                        {
-                        fst_off_t cached_pos = ftello(xc->f);
-                        fstReaderFseeko(xc, xc->f, blkpos, SEEK_SET);
-
-                        sectype = fgetc(xc->f);
-                        seclen = fstReaderUint64(xc->f);
-
-                        beg_tim2 = fstReaderUint64(xc->f);
-                        end_tim2 = fstReaderUint64(xc->f);
-
-                        if(((sectype != FST_BL_VCDATA)&&(sectype != FST_BL_VCDATA_DYN_ALIAS)&&(sectype != FST_BL_VCDATA_DYN_ALIAS2)) || (!seclen) || (beg_tim2 != tim))
-                                {
-                                blkpos = prev_blkpos;
-                                break;
-                                }
-                        beg_tim = beg_tim2;
-                        end_tim = end_tim2;
-                        fstReaderFseeko(xc, xc->f, cached_pos, SEEK_SET);
-                        }
-                break;
+                cand->last_used = ++xc->rvat_clock;
+                return(cand);
                 }
 
-        blkpos += seclen;
-#ifdef FST_DEBUG
-        secnum++;
-#endif
+        if((!rb) || (cand->last_used < rb->last_used)) rb = cand;
         }
 
-xc->rvat_beg_tim = beg_tim;
-xc->rvat_end_tim = end_tim;
+fstReaderFreeRvatBlock(rb);
 
-#ifdef FST_DEBUG
-mem_required_for_traversal =
-#endif
-        fstReaderUint64(xc->f);
+blkpos = ent->pos + 1;
+seclen = ent->seclen;
+tsec_clen = ent->tsec_clen;
+rb->beg_tim = ent->beg_tim;
+rb->end_tim = ent->end_tim;
 
 #ifdef FST_DEBUG
 fprintf(stderr, FST_APIMESS "rvat sec: %u seclen: %d begtim: %d endtim: %d\n",
-        secnum, (int)seclen, (int)beg_tim, (int)end_tim);
-fprintf(stderr, FST_APIMESS "mem_required_for_traversal: %d\n", (int)mem_required_for_traversal);
+        (unsigned int)blk_num, (int)seclen, (int)rb->beg_tim, (int)rb->end_tim);
+fprintf(stderr, FST_APIMESS "mem_required_for_traversal: %d\n", (int)ent->mem_required);
 #endif
 
 /* process time block */
 {
-unsigned char *ucdata;
-unsigned char *cdata;
-unsigned long destlen /* = tsec_uclen */; /* scan-build */
-unsigned long sourcelen /* = tsec_clen */; /* scan-build */
-int rc;
-unsigned char *tpnt;
-uint64_t tpval;
-unsigned int ti;
+uint32_t *tc_head = NULL;
+uint32_t tc_head_items = 0;
+
+times_cached = fstReaderBlockCacheTimes(xc, blk_num, &rb->time_table, &tc_head, &tc_head_items);
+if(!times_cached)
+        {
+        unsigned char *ucdata;
+        unsigned char *cdata;
+        uint64_t tsec_uclen = ent->tsec_uclen;
+        unsigned long destlen = tsec_uclen;
+        unsigned long sourcelen = tsec_clen;
+        int rc;
 
-fstReaderFseeko(xc, xc->f, blkpos + seclen - 24, SEEK_SET);
-tsec_uclen = fstReaderUint64(xc->f);
-tsec_clen = fstReaderUint64(xc->f);
-tsec_nitems = fstReaderUint64(xc->f);
 #ifdef FST_DEBUG
-fprintf(stderr, FST_APIMESS "time section unc: %d, com: %d (%d items)\n",
-        (int)tsec_uclen, (int)tsec_clen, (int)tsec_nitems);
+        fprintf(stderr, FST_APIMESS "time section unc: %d, com: %d (%d items)\n",
+                (int)tsec_uclen, (int)tsec_clen, (int)ent->tsec_nitems);
 #endif
-ucdata = (unsigned char *)malloc(tsec_uclen);
-destlen = tsec_uclen;
-sourcelen = tsec_clen;
+        ucdata = (unsigned char *)malloc(tsec_uclen);
+        if(!ucdata) return(NULL); /* malloc fail as tsec_uclen out of range from corrupted file */
 
-fstReaderFseeko(xc, xc->f, -24 - ((fst_off_t)tsec_clen), SEEK_CUR);
-if(tsec_uclen != tsec_clen)
-        {
-        cdata = (unsigned char *)malloc(tsec_clen);
-        fstFread(cdata, tsec_clen, 1, xc->f);
+        fstReaderIoSeek(xc, blkpos + seclen - 24 - ((fst_off_t)tsec_clen), SEEK_SET);
+        if(tsec_uclen != tsec_clen)
+                {
+                cdata = (unsigned char *)malloc(tsec_clen);
+                fstReaderIoRead(xc, cdata, tsec_clen);
 
-        rc = uncompress(ucdata, &destlen, cdata, sourcelen);
+                rc = fstReaderUncompress(ucdata, &destlen, cdata, sourcelen);
 
-        if(rc != Z_OK)
+                if(rc != Z_OK)
+                        {
+                        fprintf(stderr, FST_APIMESS "fstReaderGetValueFromHandleAtTime(), tsec uncompress rc = %d, exiting.\n", rc);
+                        exit(255);
+                        }
+
+                free(cdata);
+                }
+                else
                 {
-                fprintf(stderr, FST_APIMESS "fstReaderGetValueFromHandleAtTime(), tsec uncompress rc = %d, exiting.\n", rc);
-                exit(255);
+                fstReaderIoRead(xc, ucdata, tsec_uclen);
                 }
 
-        free(cdata);
-        }
-        else
-        {
-        fstFread(ucdata, tsec_uclen, 1, xc->f);
-        }
-
-xc->rvat_time_table = (uint64_t *)calloc(tsec_nitems, sizeof(uint64_t));
-tpnt = ucdata;
-tpval = 0;
-for(ti=0;ti<tsec_nitems;ti++)
-        {
-        int skiplen;
-        uint64_t val = fstGetVarint64(tpnt, &skiplen);
-        tpval = xc->rvat_time_table[ti] = tpval + val;
-        tpnt += skiplen;
+        fstReaderBuildTimeTable(ucdata, ent->tsec_uclen, ent->tsec_nitems, &rb->time_table, &tc_head, &tc_head_items);
+        free(ucdata);
         }
 
-free(ucdata);
+free(tc_head); /* chain heads are only needed to re-interleave a whole block */
 }
 
-fstReaderFseeko(xc, xc->f, blkpos+32, SEEK_SET);
+fstReaderIoSeek(xc, blkpos+32, SEEK_SET);
 
-frame_uclen = fstReaderVarint64(xc->f);
-frame_clen = fstReaderVarint64(xc->f);
-xc->rvat_frame_maxhandle = fstReaderVarint64(xc->f);
-xc->rvat_frame_data = (unsigned char *)malloc(frame_uclen);
+frame_uclen = fstReaderIoVarint64(xc);
+frame_clen = fstReaderIoVarint64(xc);
+rb->frame_maxhandle = fstReaderIoVarint64(xc);
+rb->frame_data = (unsigned char *)malloc(frame_uclen);
 
 if(frame_uclen == frame_clen)
         {
-        fstFread(xc->rvat_frame_data, frame_uclen, 1, xc->f);
+        fstReaderIoRead(xc, rb->frame_data, frame_uclen);
         }
         else
         {
@@ -6586,8 +11942,8 @@ if(frame_uclen == frame_clen)
         unsigned long destlen = frame_uclen;
         unsigned long sourcelen = frame_clen;
 
-        fstFread(mc, sourcelen, 1, xc->f);
-        rc = uncompress(xc->rvat_frame_data, &destlen, mc, sourcelen);
+        fstReaderIoRead(xc, mc, sourcelen);
+        rc = uncompress(rb->frame_data, &destlen, mc, sourcelen);
         if(rc != Z_OK)
                 {
                 fprintf(stderr, FST_APIMESS "fstReaderGetValueFromHandleAtTime(), frame decompress rc: %d, exiting.\n", rc);
@@ -6596,242 +11952,88 @@ if(frame_uclen == frame_clen)
         free(mc);
         }
 
-xc->rvat_vc_maxhandle = fstReaderVarint64(xc->f);
-xc->rvat_vc_start = ftello(xc->f);      /* points to '!' character */
-xc->rvat_packtype = fgetc(xc->f);
+rb->vc_maxhandle = fstReaderIoVarint64(xc);
+rb->vc_start = fstReaderIoTell(xc);      /* points to '!' character */
+rb->packtype = fstReaderIoGetc(xc);
 
 #ifdef FST_DEBUG
 fprintf(stderr, FST_APIMESS "frame_uclen: %d, frame_clen: %d, frame_maxhandle: %d\n",
-        (int)frame_uclen, (int)frame_clen, (int)xc->rvat_frame_maxhandle);
-fprintf(stderr, FST_APIMESS "vc_maxhandle: %d\n", (int)xc->rvat_vc_maxhandle);
+        (int)frame_uclen, (int)frame_clen, (int)rb->frame_maxhandle);
+fprintf(stderr, FST_APIMESS "vc_maxhandle: %d\n", (int)rb->vc_maxhandle);
 #endif
 
 indx_pntr = blkpos + seclen - 24 -tsec_clen -8;
-fstReaderFseeko(xc, xc->f, indx_pntr, SEEK_SET);
-chain_clen = fstReaderUint64(xc->f);
+chain_clen = ent->chain_clen;
 indx_pos = indx_pntr - chain_clen;
 #ifdef FST_DEBUG
 fprintf(stderr, FST_APIMESS "indx_pos: %d (%d bytes)\n", (int)indx_pos, (int)chain_clen);
-#endif
-chain_cmem = (unsigned char *)malloc(chain_clen);
-fstReaderFseeko(xc, xc->f, indx_pos, SEEK_SET);
-fstFread(chain_cmem, chain_clen, 1, xc->f);
-
-xc->rvat_chain_table = (fst_off_t *)calloc((xc->rvat_vc_maxhandle+1), sizeof(fst_off_t));
-xc->rvat_chain_table_lengths = (uint32_t *)calloc((xc->rvat_vc_maxhandle+1), sizeof(uint32_t));
-
-pnt = chain_cmem;
-idx = 0;
-pval = 0;
-
-if(sectype == FST_BL_VCDATA_DYN_ALIAS2)
-        {
-        uint32_t prev_alias = 0;
-
-        do      {
-                int skiplen;
-
-                if(*pnt & 0x01)
-                        {
-                        int64_t shval = fstGetSVarint64(pnt, &skiplen) >> 1;
-                        if(shval > 0)
-                                {
-                                pval = xc->rvat_chain_table[idx] = pval + shval;
-                                if(idx) { xc->rvat_chain_table_lengths[pidx] = pval - xc->rvat_chain_table[pidx]; }
-                                pidx = idx++;
-                                }
-                        else if(shval < 0)
-                                {
-                                xc->rvat_chain_table[idx] = 0;                                   /* need to explicitly zero as calloc above might not run */
-                                xc->rvat_chain_table_lengths[idx] = prev_alias = shval;          /* because during this loop iter would give stale data! */
-                                idx++;
-                                }
-                        else
-                                {
-                                xc->rvat_chain_table[idx] = 0;                                   /* need to explicitly zero as calloc above might not run */
-                                xc->rvat_chain_table_lengths[idx] = prev_alias;                  /* because during this loop iter would give stale data! */
-                                idx++;
-                                }
-                        }
-                        else
-                        {
-                        uint64_t val = fstGetVarint32(pnt, &skiplen);
-
-                        fstHandle loopcnt = val >> 1;
-                        for(i=0;i<loopcnt;i++)
-                                {
-                                xc->rvat_chain_table[idx++] = 0;
-                                }
-                        }
-
-                pnt += skiplen;
-                } while (pnt != (chain_cmem + chain_clen));
-        }
-        else
-	{
-	do
-	        {
-	        int skiplen;
-	        uint64_t val = fstGetVarint32(pnt, &skiplen);
-
-	        if(!val)
-	                {
-	                pnt += skiplen;
-	                val = fstGetVarint32(pnt, &skiplen);
-	                xc->rvat_chain_table[idx] = 0;
-	                xc->rvat_chain_table_lengths[idx] = -val;
-	                idx++;
-	                }
-	        else
-	        if(val&1)
-	                {
-	                pval = xc->rvat_chain_table[idx] = pval + (val >> 1);
-	                if(idx) { xc->rvat_chain_table_lengths[pidx] = pval - xc->rvat_chain_table[pidx]; }
-	                pidx = idx++;
-	                }
-	                else
-	                {
-	                fstHandle loopcnt = val >> 1;
-	                for(i=0;i<loopcnt;i++)
-	                        {
-	                        xc->rvat_chain_table[idx++] = 0;
-	                        }
-	                }
-
-	        pnt += skiplen;
-	        } while (pnt != (chain_cmem + chain_clen));
-	}
-
-free(chain_cmem);
-xc->rvat_chain_table[idx] = indx_pos - xc->rvat_vc_start;
-xc->rvat_chain_table_lengths[pidx] = xc->rvat_chain_table[idx] - xc->rvat_chain_table[pidx];
-
-for(i=0;i<idx;i++)
-        {
-        int32_t v32 = xc->rvat_chain_table_lengths[i];
-        if((v32 < 0) && (!xc->rvat_chain_table[i]))
-                {
-                v32 = -v32;
-                v32--;
-                if(((uint32_t)v32) < i) /* sanity check */
-                        {
-                        xc->rvat_chain_table[i] = xc->rvat_chain_table[v32];
-                        xc->rvat_chain_table_lengths[i] = xc->rvat_chain_table_lengths[v32];
-                        }
-                }
-        }
-
-#ifdef FST_DEBUG
-fprintf(stderr, FST_APIMESS "decompressed chain idx len: %" PRIu32 "\n", idx);
-#endif
-
-xc->rvat_data_valid = 1;
-
-/* all data at this point is loaded or resident in fst cache, process and return appropriate value */
-process_value:
-if(facidx > xc->rvat_vc_maxhandle)
-        {
-        return(NULL);
-        }
-
-facidx--; /* scale down for array which starts at zero */
-
-
-if(((tim == xc->rvat_beg_tim)&&(!xc->rvat_chain_table[facidx])) || (!xc->rvat_chain_table[facidx]))
-        {
-        return(fstExtractRvatDataFromFrame(xc, facidx, buf));
-        }
-
-if(facidx != xc->rvat_chain_facidx)
-        {
-        if(xc->rvat_chain_mem)
-                {
-                free(xc->rvat_chain_mem);
-                xc->rvat_chain_mem = NULL;
-
-                xc->rvat_chain_pos_valid = 0;
-                }
-        }
-
-if(!xc->rvat_chain_mem)
-        {
-        uint32_t skiplen;
-        fstReaderFseeko(xc, xc->f, xc->rvat_vc_start + xc->rvat_chain_table[facidx], SEEK_SET);
-        xc->rvat_chain_len = fstReaderVarint32WithSkip(xc->f, &skiplen);
-        if(xc->rvat_chain_len)
-                {
-                unsigned char *mu = (unsigned char *)malloc(xc->rvat_chain_len);
-                unsigned char *mc = (unsigned char *)malloc(xc->rvat_chain_table_lengths[facidx]);
-                unsigned long destlen = xc->rvat_chain_len;
-                unsigned long sourcelen = xc->rvat_chain_table_lengths[facidx];
-                int rc = Z_OK;
-
-                fstFread(mc, xc->rvat_chain_table_lengths[facidx], 1, xc->f);
-
-                switch(xc->rvat_packtype)
-			{
-                        case '4': rc = (destlen == (unsigned long)LZ4_decompress_safe_partial((char *)mc, (char *)mu, sourcelen, destlen, destlen)) ? Z_OK : Z_DATA_ERROR;
-                        	break;
-                        case 'F': fastlz_decompress(mc, sourcelen, mu, destlen); /* rc appears unreliable */
-                        	break;
-                        default:  rc = uncompress(mu, &destlen, mc, sourcelen);
-                        	break;
-                        }
+#endif
 
-                free(mc);
+{
+uint64_t vc_maxhandle_largest = 0;
 
-                if(rc != Z_OK)
-                        {
-                        fprintf(stderr, FST_APIMESS "fstReaderGetValueFromHandleAtTime(), rvat decompress clen: %d (rc=%d), exiting.\n", (int)xc->rvat_chain_len, rc);
-                        exit(255);
-                        }
+chains_cached = fstReaderBlockCacheChains(xc, blk_num, &vc_maxhandle_largest, &rb->chain_table, &rb->chain_table_lengths, &idx);
+if(!chains_cached)
+        {
+        unsigned char *chain_cmem = (unsigned char *)malloc(chain_clen);
 
-                /* data to process is for(j=0;j<destlen;j++) in mu[j] */
-                xc->rvat_chain_mem = mu;
-                }
-                else
+        if((!chain_cmem) || (!fstReaderGrowChainTable(rb->vc_maxhandle, &vc_maxhandle_largest, &rb->chain_table, &rb->chain_table_lengths)))
                 {
-                int destlen = xc->rvat_chain_table_lengths[facidx] - skiplen;
-                unsigned char *mu = (unsigned char *)malloc(xc->rvat_chain_len = destlen);
-                fstFread(mu, destlen, 1, xc->f);
-                /* data to process is for(j=0;j<destlen;j++) in mu[j] */
-                xc->rvat_chain_mem = mu;
+                free(chain_cmem);
+                fstReaderFreeRvatBlock(rb);
+                return(NULL);
                 }
 
-        xc->rvat_chain_facidx = facidx;
+        fstReaderIoSeek(xc, indx_pos, SEEK_SET);
+        fstReaderIoRead(xc, chain_cmem, chain_clen);
+        idx = fstReaderParseChainTable(ent->sectype, chain_cmem, chain_clen, rb->vc_maxhandle,
+                rb->chain_table, rb->chain_table_lengths, indx_pos - rb->vc_start);
+        free(chain_cmem);
         }
+}
 
-/* process value chain here */
+#ifdef FST_DEBUG
+fprintf(stderr, FST_APIMESS "decompressed chain idx len: %" PRIu32 "\n", idx);
+#endif
+
+if(xc->blk_cache_budget)
+        {
+        fstReaderBlockCacheStore(xc, blk_num, times_cached ? NULL : rb->time_table, ent->tsec_nitems,
+                chains_cached ? NULL : rb->chain_table, rb->chain_table_lengths, idx, rb->vc_maxhandle);
+        }
+
+rb->blk_num = blk_num;
+rb->last_used = ++xc->rvat_clock;
+return(rb);
+}
 
+
+/*
+ * looks up the value of facidx at tim in its inflated value chain, scanning
+ * from the change at *pos_idx / *pos_tidx (0 / 0 for the chain start).
+ * returns 1 with buf filled and *pos_idx / *pos_tidx moved to the change in
+ * effect at tim, or 0 when the chain has none by then and the frame holds
+ * the value.
+ */
+static int fstReaderRvatScanChain(struct fstReaderContext *xc, struct fstRvatBlock *rb, fstHandle facidx, uint64_t tim,
+        unsigned char *chain_mem, uint32_t chain_len, uint32_t *pos_idx, uint32_t *pos_tidx, char *buf)
 {
-uint32_t tidx = 0, ptidx = 0;
+uint32_t i = *pos_idx, tidx = *pos_tidx, ptidx = 0;
 uint32_t tdelta;
 int skiplen;
-unsigned int iprev = xc->rvat_chain_len;
+unsigned int iprev = chain_len;
 uint32_t pvli = 0;
 int pskip = 0;
 
-if((xc->rvat_chain_pos_valid)&&(tim >= xc->rvat_chain_pos_time))
-        {
-        i = xc->rvat_chain_pos_idx;
-        tidx = xc->rvat_chain_pos_tidx;
-        }
-        else
-        {
-        i = 0;
-        tidx = 0;
-        xc->rvat_chain_pos_time = xc->rvat_beg_tim;
-        }
-
 if(xc->signal_lens[facidx] == 1)
         {
-        while(i<xc->rvat_chain_len)
+        while(i<chain_len)
                 {
-                uint32_t vli = fstGetVarint32(xc->rvat_chain_mem + i, &skiplen);
+                uint32_t vli = fstGetVarint32(chain_mem + i, &skiplen);
                 uint32_t shcnt = 2 << (vli & 1);
                 tdelta = vli >> shcnt;
 
-                if(xc->rvat_time_table[tidx + tdelta] <= tim)
+                if(rb->time_table[tidx + tdelta] <= tim)
                         {
                         iprev = i;
                         pvli = vli;
@@ -6846,12 +12048,10 @@ if(xc->signal_lens[facidx] == 1)
                         break;
                         }
                 }
-        if(iprev != xc->rvat_chain_len)
+        if(iprev != chain_len)
                 {
-                xc->rvat_chain_pos_tidx = ptidx;
-                xc->rvat_chain_pos_idx = iprev;
-                xc->rvat_chain_pos_time = tim;
-                xc->rvat_chain_pos_valid = 1;
+                *pos_tidx = ptidx;
+                *pos_idx = iprev;
 
                 if(!(pvli & 1))
                         {
@@ -6862,21 +12062,21 @@ if(xc->signal_lens[facidx] == 1)
                         buf[0] = FST_RCV_STR[((pvli >> 1) & 7)];
                         }
                 buf[1] = 0;
-                return(buf);
+                return(1);
                 }
                 else
                 {
-                return(fstExtractRvatDataFromFrame(xc, facidx, buf));
+                return(0);
                 }
         }
         else
         {
-        while(i<xc->rvat_chain_len)
+        while(i<chain_len)
                 {
-                uint32_t vli = fstGetVarint32(xc->rvat_chain_mem + i, &skiplen);
+                uint32_t vli = fstGetVarint32(chain_mem + i, &skiplen);
                 tdelta = vli >> 1;
 
-                if(xc->rvat_time_table[tidx + tdelta] <= tim)
+                if(rb->time_table[tidx + tdelta] <= tim)
                         {
                         iprev = i;
                         pvli = vli;
@@ -6901,14 +12101,12 @@ if(xc->signal_lens[facidx] == 1)
                         }
                 }
 
-        if(iprev != xc->rvat_chain_len)
+        if(iprev != chain_len)
                 {
-                unsigned char *vdata = xc->rvat_chain_mem + iprev + pskip;
+                unsigned char *vdata = chain_mem + iprev + pskip;
 
-                xc->rvat_chain_pos_tidx = ptidx;
-                xc->rvat_chain_pos_idx = iprev;
-                xc->rvat_chain_pos_time = tim;
-                xc->rvat_chain_pos_valid = 1;
+                *pos_tidx = ptidx;
+                *pos_idx = iprev;
 
                 if(xc->signal_typs[facidx] != FST_VT_VCD_REAL)
                         {
@@ -6928,13 +12126,13 @@ if(xc->signal_lens[facidx] == 1)
                                         }
                                 buf[j] = 0;
 
-                                return(buf);
+                                return(1);
                                 }
                                 else
                                 {
                                 memcpy(buf, vdata, xc->signal_lens[facidx]);
                                 buf[xc->signal_lens[facidx]] = 0;
-                                return(buf);
+                                return(1);
                                 }
                         }
                         else
@@ -6979,20 +12177,455 @@ if(xc->signal_lens[facidx] == 1)
                                 }
 
                         snprintf(buf, 32, "r%.16g", d); /* this will write 19 bytes */
-                        return(buf);
+                        return(1);
+                        }
+                }
+                else
+                {
+                return(0);
+                }
+        }
+}
+
+
+/* the decoded block holding the values at tim, or NULL if tim is outside the trace */
+static struct fstRvatBlock *fstReaderRvatBlockAt(struct fstReaderContext *xc, uint64_t tim)
+{
+struct fstBlockIndexEntry *ent;
+uint64_t blk_num;
+
+if(!xc->rvat_sig_offs)
+        {
+        uint32_t cur_offs = 0;
+        fstHandle i;
+
+        xc->rvat_sig_offs = (uint32_t *)calloc(xc->maxhandle, sizeof(uint32_t));
+        for(i=0;i<xc->maxhandle;i++)
+                {
+                xc->rvat_sig_offs[i] = cur_offs;
+                cur_offs += xc->signal_lens[i];
+                }
+        }
+
+blk_num = fstReaderFindBlock(xc, tim);
+if((blk_num == xc->blk_index_count) || (xc->blk_index[blk_num].beg_tim > tim))
+        {
+        return(NULL);
+        }
+
+/* a value change at a flush boundary can land in the following block too, its final value is there */
+ent = xc->blk_index + blk_num;
+if((tim == ent->end_tim) && (tim != xc->end_time) && ((blk_num+1) < xc->blk_index_count) && (ent[1].beg_tim == tim))
+        {
+        blk_num++;
+        }
+
+return(fstReaderRvatLoadBlock(xc, blk_num));
+}
+
+
+char *fstReaderGetValueFromHandleAtTime(void *ctx, uint64_t tim, fstHandle facidx, char *buf)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstRvatBlock *rb;
+
+if((!xc) || (!facidx) || (facidx > xc->maxhandle) || (!buf) || (!xc->signal_lens[facidx-1]))
+        {
+        return(NULL);
+        }
+
+rb = fstReaderRvatBlockAt(xc, tim);
+if(!rb)
+        {
+        return(NULL);
+        }
+
+/* all data at this point is loaded or resident in fst cache, process and return appropriate value */
+if(facidx > rb->vc_maxhandle)
+        {
+        return(NULL);
+        }
+
+facidx--; /* scale down for array which starts at zero */
+
+
+if(((tim == rb->beg_tim)&&(!rb->chain_table[facidx])) || (!rb->chain_table[facidx]))
+        {
+        return(fstExtractRvatDataFromFrame(xc, rb, facidx, buf));
+        }
+
+if(facidx != rb->chain_facidx)
+        {
+        if(rb->chain_mem)
+                {
+                free(rb->chain_mem);
+                rb->chain_mem = NULL;
+
+                rb->chain_pos_valid = 0;
+                }
+        }
+
+if(!rb->chain_mem)
+        {
+        uint32_t skiplen;
+        fstReaderIoSeek(xc, rb->vc_start + rb->chain_table[facidx], SEEK_SET);
+        rb->chain_len = fstReaderIoVarint32WithSkip(xc, &skiplen);
+        if(rb->chain_len)
+                {
+                unsigned char *mu = (unsigned char *)malloc(rb->chain_len);
+                unsigned char *mc_alloc = NULL;
+                unsigned char *mc = fstReaderIoPeek(xc, rb->chain_table_lengths[facidx]);
+                unsigned long destlen = rb->chain_len;
+                unsigned long sourcelen = rb->chain_table_lengths[facidx];
+                int rc = Z_OK;
+
+                if(!mc)
+                        {
+                        mc = mc_alloc = (unsigned char *)malloc(rb->chain_table_lengths[facidx]);
+                        fstReaderIoRead(xc, mc, rb->chain_table_lengths[facidx]);
+                        }
+
+                rc = fstReaderUnpackChain(xc, &xc->zstd_dctx, rb->packtype, mc, sourcelen, mu, destlen);
+
+                free(mc_alloc);
+
+                if(rc != Z_OK)
+                        {
+                        fprintf(stderr, FST_APIMESS "fstReaderGetValueFromHandleAtTime(), rvat decompress clen: %d (rc=%d), exiting.\n", (int)rb->chain_len, rc);
+                        exit(255);
                         }
+
+                /* data to process is for(j=0;j<destlen;j++) in mu[j] */
+                rb->chain_mem = mu;
                 }
                 else
                 {
-                return(fstExtractRvatDataFromFrame(xc, facidx, buf));
+                int destlen = rb->chain_table_lengths[facidx] - skiplen;
+                unsigned char *mu = (unsigned char *)malloc(rb->chain_len = destlen);
+                fstReaderIoRead(xc, mu, destlen);
+                /* data to process is for(j=0;j<destlen;j++) in mu[j] */
+                rb->chain_mem = mu;
                 }
+
+        rb->chain_facidx = facidx;
+        }
+
+/* process value chain here */
+{
+uint32_t pos_idx = 0, pos_tidx = 0;
+
+if((rb->chain_pos_valid)&&(tim >= rb->chain_pos_time))
+        {
+        pos_idx = rb->chain_pos_idx;
+        pos_tidx = rb->chain_pos_tidx;
         }
+
+if(fstReaderRvatScanChain(xc, rb, facidx, tim, rb->chain_mem, rb->chain_len, &pos_idx, &pos_tidx, buf))
+        {
+        rb->chain_pos_idx = pos_idx;
+        rb->chain_pos_tidx = pos_tidx;
+        rb->chain_pos_time = tim;
+        rb->chain_pos_valid = 1;
+        return(buf);
+        }
+
+return(fstExtractRvatDataFromFrame(xc, rb, facidx, buf));
 }
 
 /* return(NULL); */
 }
 
 
+/*
+ * batch value at time: the block is located once and the chains of all
+ * requested handles are read in one pass, then inflated and scanned on
+ * worker threads when parallel decode is enabled and there is enough to do.
+ * one job per distinct chain, as aliases share theirs.
+ */
+#ifndef FST_RVAT_PARALLEL_MIN_BYTES
+#define FST_RVAT_PARALLEL_MIN_BYTES (64 * 1024)
+#endif
+
+struct fstRvatChainJob
+{
+fst_off_t chain_pos;                    /* chain_table entry, jobs are sorted by it */
+uint32_t handle_idx;                    /* first request using the chain */
+fstHandle facidx;
+unsigned char *mc;                      /* compressed chain, mapped or in mc_alloc */
+unsigned char *mc_alloc;
+uint32_t clen;
+unsigned char *mu;                      /* uncompressed chain, mapped or in mu_alloc when not packed */
+unsigned char *mu_alloc;
+uint32_t ulen;
+size_t val_offs;                        /* where the value goes in the value arena */
+unsigned int compressed : 1;
+unsigned int found : 1;                 /* the chain held the value, else it is in the frame */
+int rc;
+};
+
+struct fstRvatChainWork
+{
+struct fstReaderContext *xc;
+struct fstRvatBlock *rb;
+uint64_t tim;
+struct fstRvatChainJob *jobs;
+uint32_t first, last;                   /* jobs[first..last-1], a contiguous run per thread */
+char *vals;
+void *zstd_dctx;                        /* per thread, freed as the run ends */
+};
+
+
+/* inflate and scan a run of jobs, dropping each chain once scanned so they are not all resident */
+static void *fstReaderRvatChainWorker(void *arg)
+{
+struct fstRvatChainWork *w = (struct fstRvatChainWork *)arg;
+uint32_t j;
+
+for(j=w->first;j<w->last;j++)
+        {
+        struct fstRvatChainJob *job = w->jobs + j;
+        uint32_t pos_idx = 0, pos_tidx = 0;
+
+        if(job->compressed)
+                {
+                job->mu = job->mu_alloc = (unsigned char *)malloc(job->ulen);
+                job->rc = job->mu ? fstReaderUnpackChain(w->xc, &w->zstd_dctx, w->rb->packtype, job->mc, job->clen, job->mu, job->ulen) : Z_MEM_ERROR;
+                free(job->mc_alloc);
+                job->mc_alloc = NULL;
+                if(job->rc != Z_OK) continue;
+                }
+
+        job->found = fstReaderRvatScanChain(w->xc, w->rb, job->facidx, w->tim, job->mu, job->ulen, &pos_idx, &pos_tidx, w->vals + job->val_offs);
+        free(job->mu_alloc);
+        job->mu_alloc = NULL;
+        }
+
+fstReaderFreeZstdDCtx(&w->zstd_dctx);
+return(NULL);
+}
+
+
+static int fstRvatChainJobCompare(const void *a, const void *b)
+{
+const struct fstRvatChainJob *ja = (const struct fstRvatChainJob *)a;
+const struct fstRvatChainJob *jb = (const struct fstRvatChainJob *)b;
+
+if(ja->chain_pos != jb->chain_pos) return((ja->chain_pos < jb->chain_pos) ? -1 : 1);
+return((ja->handle_idx < jb->handle_idx) ? -1 : (ja->handle_idx > jb->handle_idx));
+}
+
+
+/*
+ * the values of handles[0..num_handles-1] at time tim, as
+ * fstReaderGetValueFromHandleAtTime() returns them, packed into buf as
+ * NUL terminated strings.  values[n] points at the value of handles[n], or
+ * is NULL where there is none or it did not fit.  returns the bytes needed
+ * to hold every value, so a caller can retry with a larger buffer, or 0
+ * with every value NULL when the time is out of range or memory runs out.
+ */
+size_t fstReaderGetValuesAtTime(void *ctx, uint64_t tim, const fstHandle *handles, uint32_t num_handles,
+        char *buf, size_t buf_len, const char **values)
+{
+struct fstReaderContext *xc = (struct fstReaderContext *)ctx;
+struct fstRvatBlock *rb;
+struct fstRvatChainJob *jobs;
+struct fstRvatChainWork work;
+uint32_t *job_of;                       /* per request, 1 + its job, 0 when read from the frame */
+uint32_t num_jobs = 0, n, j;
+uint64_t total_len = 0;
+size_t vals_len = 0, used = 0;
+char *vals;
+int alloc_failed = 0;
+
+if((!xc) || (!handles) || (!values)) return(0);
+
+for(n=0;n<num_handles;n++) values[n] = NULL;
+
+rb = fstReaderRvatBlockAt(xc, tim);
+if(!rb) return(0);
+
+jobs = (struct fstRvatChainJob *)calloc(num_handles ? num_handles : 1, sizeof(struct fstRvatChainJob));
+job_of = (uint32_t *)calloc(num_handles ? num_handles : 1, sizeof(uint32_t));
+if((!jobs) || (!job_of))
+        {
+        free(jobs);
+        free(job_of);
+        return(0);
+        }
+
+for(n=0;n<num_handles;n++)
+        {
+        fstHandle facidx = handles[n];
+
+        if((!facidx) || (facidx > xc->maxhandle) || (!xc->signal_lens[facidx-1]) || (facidx > rb->vc_maxhandle)) continue;
+        if(!rb->chain_table[facidx-1]) continue;
+
+        jobs[num_jobs].chain_pos = rb->chain_table[facidx-1];
+        jobs[num_jobs].handle_idx = n;
+        jobs[num_jobs].facidx = facidx - 1;
+        num_jobs++;
+        }
+
+/* one job per distinct chain, read on this thread in file order */
+qsort(jobs, num_jobs, sizeof(struct fstRvatChainJob), fstRvatChainJobCompare);
+for(j=0,n=0;j<num_jobs;j++)
+        {
+        struct fstRvatChainJob *job;
+        uint32_t skiplen;
+
+        if(n && (jobs[n-1].chain_pos == jobs[j].chain_pos))
+                {
+                job_of[jobs[j].handle_idx] = n;
+                continue;
+                }
+
+        job = jobs + n;
+        if(j != n) *job = jobs[j];
+        job_of[job->handle_idx] = ++n;
+
+        job->val_offs = vals_len;
+        vals_len += (xc->signal_lens[job->facidx] < 32) ? 33 : (xc->signal_lens[job->facidx] + 1); /* reals print up to 32 */
+
+        fstReaderIoSeek(xc, rb->vc_start + job->chain_pos, SEEK_SET);
+        job->ulen = fstReaderIoVarint32WithSkip(xc, &skiplen);
+        if(job->ulen)
+                {
+                job->compressed = 1;
+                job->clen = rb->chain_table_lengths[job->facidx];
+                job->mc = fstReaderIoPeek(xc, job->clen);
+                if(!job->mc)
+                        {
+                        job->mc = job->mc_alloc = (unsigned char *)malloc(job->clen);
+                        if(job->mc) fstReaderIoRead(xc, job->mc, job->clen); else alloc_failed = 1;
+                        }
+                }
+                else
+                {
+                job->ulen = rb->chain_table_lengths[job->facidx] - skiplen;
+                job->mu = fstReaderIoPeek(xc, job->ulen);
+                if(!job->mu)
+                        {
+                        job->mu = job->mu_alloc = (unsigned char *)malloc(job->ulen);
+                        if(job->mu) fstReaderIoRead(xc, job->mu, job->ulen); else alloc_failed = 1;
+                        }
+                }
+        total_len += job->ulen;
+        }
+num_jobs = n;
+
+vals = (char *)malloc(vals_len ? vals_len : 1);
+if((!vals) || (alloc_failed))
+        {
+        for(j=0;j<num_jobs;j++)
+                {
+                free(jobs[j].mc_alloc);
+                free(jobs[j].mu_alloc);
+                }
+        free(vals);
+        free(jobs);
+        free(job_of);
+        return(0);
+        }
+
+work.xc = xc;
+work.rb = rb;
+work.tim = tim;
+work.jobs = jobs;
+work.first = 0;
+work.last = num_jobs;
+work.vals = vals;
+work.zstd_dctx = NULL;
+
+#ifdef FST_READER_PARALLEL
+if((xc->iterblocks_threads > 1) && (num_jobs > 1) && (total_len >= FST_RVAT_PARALLEL_MIN_BYTES))
+        {
+        int num_threads = (xc->iterblocks_threads < (int)num_jobs) ? xc->iterblocks_threads : (int)num_jobs;
+        pthread_t *threads;
+        struct fstRvatChainWork *thr_work;
+        int started = 0, t;
+
+        if(num_threads > FST_DECODE_POOL_MAX_THREADS) num_threads = FST_DECODE_POOL_MAX_THREADS;
+        threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+        thr_work = (struct fstRvatChainWork *)calloc(num_threads, sizeof(struct fstRvatChainWork));
+
+        for(t=0;(threads) && (thr_work) && (t<num_threads);t++)
+                {
+                thr_work[t] = work;
+                thr_work[t].first = (uint32_t)(((uint64_t)num_jobs * t) / num_threads);
+                thr_work[t].last = (uint32_t)(((uint64_t)num_jobs * (t + 1)) / num_threads);
+                }
+
+        for(t=0;(threads) && (thr_work) && (t<num_threads);t++)
+                {
+                if(pthread_create(threads + t, NULL, fstReaderRvatChainWorker, thr_work + t)) break;
+                started++;
+                }
+
+        for(t=0;t<started;t++)
+                {
+                pthread_join(threads[t], NULL);
+                }
+
+        /* the share of any thread that could not be started is done here */
+        for(t=started;(started) && (t<num_threads);t++)
+                {
+                fstReaderRvatChainWorker(thr_work + t);
+                }
+
+        if(started) work.last = 0;
+        free(thr_work);
+        free(threads);
+        }
+#endif
+
+fstReaderRvatChainWorker(&work);
+
+for(j=0;j<num_jobs;j++)
+        {
+        if(jobs[j].rc != Z_OK)
+                {
+                fprintf(stderr, FST_APIMESS "fstReaderGetValuesAtTime(), rvat decompress clen: %d (rc=%d), exiting.\n", (int)jobs[j].ulen, jobs[j].rc);
+                exit(255);
+                }
+        }
+
+for(n=0;n<num_handles;n++)
+        {
+        fstHandle facidx = handles[n];
+        const char *val = NULL;
+
+        if((!facidx) || (facidx > xc->maxhandle) || (!xc->signal_lens[facidx-1]) || (facidx > rb->vc_maxhandle)) continue;
+
+        if((job_of[n]) && (jobs[job_of[n]-1].found))
+                {
+                val = vals + jobs[job_of[n]-1].val_offs;
+                }
+                else
+                {
+                val = fstExtractRvatDataFromFrame(xc, rb, facidx-1, (char *)xc->temp_signal_value_buf);
+                }
+
+        if(val)
+                {
+                size_t len = strlen(val) + 1;
+
+                if((buf) && (used + len <= buf_len))
+                        {
+                        memcpy(buf + used, val, len);
+                        values[n] = buf + used;
+                        }
+                used += len;
+                }
+        }
+
+free(vals);
+free(jobs);
+free(job_of);
+
+return(used);
+}
+
+
 
 /**********************************************************************/
 #ifndef _WAVE_HAVE_JUDY
@@ -7207,6 +12840,34 @@ if(base && *base)
 /***                  ***/
 /************************/
 
+/*
+ * fstGetVarintRun() for callers outside the library (benchmarks, tests):
+ * decodes up to max_out varints from mem[0..len), returning the bytes used
+ */
+size_t fstUtilityDecodeVarints(const unsigned char *mem, size_t len, uint64_t *out, size_t max_out, size_t *nout)
+{
+size_t dummy;
+
+if(!nout) nout = &dummy;
+*nout = 0;
+if((!mem) || (!out)) return(0);
+
+return(fstGetVarintRun(mem, len, out, NULL, max_out, nout));
+}
+
+
+/*
+ * picks the bulk varint decoder for every reader in the process, falling
+ * back to the widest the CPU has.  meant to be set before reading starts.
+ */
+int fstUtilitySetVarintDecoder(int decoder)
+{
+fst_varint_decoder = fstVarintDecoderResolve(decoder);
+
+return(fst_varint_decoder);
+}
+
+
 int fstUtilityBinToEscConvertedLen(const unsigned char *s, int len)
 {
 const unsigned char *src = s;
@@ -50,7 +50,37 @@ typedef uint32_t fstEnumHandle;
 enum fstWriterPackType {
     FST_WR_PT_ZLIB             = 0,
     FST_WR_PT_FASTLZ           = 1,
-    FST_WR_PT_LZ4              = 2
+    FST_WR_PT_LZ4              = 2,
+    FST_WR_PT_ZSTD             = 3,  /* needs HAVE_LIBZSTD, zlib otherwise */
+    FST_WR_PT_ZSTD_DICT        = 4   /* as FST_WR_PT_ZSTD, chains after the first block use a trained dictionary */
+};
+
+enum fstWriterBufferLayout {
+    FST_WR_BL_CHAINED          = 0,  /* changes linked backwards through the change buffer */
+    FST_WR_BL_SEGMENTED        = 1   /* changes appended to per signal segments of the change buffer */
+};
+
+enum fstReaderOpenFlags {
+    FST_RD_OPEN_DEFAULT        = 0,
+    FST_RD_OPEN_NO_MMAP        = (1<<0),  /* always read through stdio */
+    FST_RD_OPEN_BLOCK_INDEX    = (1<<1),  /* load/save the <file>.fstidx block index sidecar (and <file>.fstgzidx) */
+    FST_RD_OPEN_GZIP_UNPACK    = (1<<2)   /* unpack wrapped (gzip) traces to a temp file instead of reading in place */
+};
+
+enum fstColumnEncoding {
+    FST_CE_BITS2               = 0,  /* 2 bits per bit, MSB first, codes index FST_COLUMN_STATES (0/1/x/z only) */
+    FST_CE_BITS4               = 1,  /* 4 bits per bit, MSB first, codes index FST_COLUMN_STATES */
+    FST_CE_DOUBLE              = 2,  /* one native double per change */
+    FST_CE_BYTES               = 3   /* variable length records, see value_offs */
+};
+
+#define FST_COLUMN_STATES "01xzhuwl-?"
+
+enum fstVarintDecoder {
+    FST_VARINT_AUTO            = 0,  /* widest the CPU supports */
+    FST_VARINT_SCALAR          = 1,
+    FST_VARINT_SSE2            = 2,
+    FST_VARINT_AVX2            = 3
 };
 
 enum fstFileType {
@@ -73,6 +103,8 @@ enum fstBlockType {
     FST_BL_HIER_LZ4            = 6,
     FST_BL_HIER_LZ4DUO         = 7,
     FST_BL_VCDATA_DYN_ALIAS2   = 8,
+    FST_BL_HIER_ZSTD           = 9,
+    FST_BL_ZSTD_DICT           = 10,    /* dictionary for zstd value change chains */
 
     FST_BL_ZWRAPPER            = 254,   /* indicates that whole trace is gz wrapped */
     FST_BL_SKIP                = 255    /* used while block is being written */
@@ -344,6 +376,71 @@ char **val_arr;
 };
 
 
+/* one signal's value changes within one value change block, see fstReaderIterBlocksColumns() */
+struct fstColumn
+{
+fstHandle handle;
+uint32_t len;                   /* signal length in bits, 0 for variable length records */
+unsigned char encoding;         /* FST_CE_BITS2 ... FST_CE_BYTES */
+uint32_t count;                 /* number of changes */
+const uint64_t *times;          /* block time table: times[0] is the block start time */
+uint32_t times_count;
+const uint32_t *time_idx;       /* count ascending indices into times */
+const unsigned char *values;    /* count values of value_stride bytes each */
+uint32_t value_stride;          /* 0 for FST_CE_BYTES */
+const uint32_t *value_offs;     /* FST_CE_BYTES only: count+1 offsets into values */
+};
+
+
+/* the whole hierarchy as parallel arrays, see fstReaderGetFlatHier() */
+#define FST_FLAT_HIER_NO_SCOPE          (0xffffffffU)
+
+struct fstFlatHier
+{
+uint32_t num_scopes;
+uint32_t num_vars;
+uint64_t names_len;
+char *names;                    /* NUL terminated names back to back, indexed by the *_name_offs arrays */
+
+/* scopes in file order, a parent always before its children */
+uint32_t *scope_parent;         /* index of the enclosing scope or FST_FLAT_HIER_NO_SCOPE */
+uint64_t *scope_name_offs;
+uint32_t *scope_name_len;
+unsigned char *scope_typ;       /* FST_ST_MIN ... FST_ST_MAX */
+
+/* vars in file order */
+uint32_t *var_scope;            /* index of the enclosing scope or FST_FLAT_HIER_NO_SCOPE */
+uint64_t *var_name_offs;
+uint32_t *var_name_len;
+unsigned char *var_typ;         /* FST_VT_MIN ... FST_VT_MAX */
+unsigned char *var_direction;   /* FST_VD_MIN ... FST_VD_MAX */
+uint32_t *var_length;           /* as fstHier u.var.length */
+fstHandle *var_handle;
+unsigned char *var_is_alias;
+};
+
+/* every scope with where its records sit, for materializing one scope's vars at a time */
+struct fstHierScopeIndex
+{
+uint32_t num_scopes;
+uint32_t num_vars;              /* in the whole hierarchy */
+uint32_t root_num_vars;         /* outside any scope */
+uint64_t names_len;
+char *names;                    /* scope names as in fstFlatHier */
+
+/* scopes in file order, a parent always before its children */
+uint32_t *scope_parent;         /* index of the enclosing scope or FST_FLAT_HIER_NO_SCOPE */
+uint64_t *scope_name_offs;
+uint32_t *scope_name_len;
+unsigned char *scope_typ;
+uint32_t *scope_num_vars;       /* vars directly in the scope */
+uint64_t *scope_body_ofs;       /* hierarchy offset of the first record inside the scope, ascending */
+uint64_t *scope_end_ofs;        /* offset of its upscope */
+fstHandle *scope_handle_base;   /* handles assigned before the scope */
+fstHandle *scope_num_handles;   /* handles assigned inside the scope and below it */
+};
+
+
 /*
  * writer functions
  */
@@ -365,6 +462,10 @@ void            fstWriterEmitValueChange32(void *ctx, fstHandle handle,
                         uint32_t bits, uint32_t val);
 void            fstWriterEmitValueChange64(void *ctx, fstHandle handle,
                         uint32_t bits, uint64_t val);
+void            fstWriterEmitValueChangeBatch(void *ctx, uint32_t count, const fstHandle *handles,
+                        const void *const *vals);
+void            fstWriterEmitValueChangeBatchPacked(void *ctx, uint32_t count, const fstHandle *handles,
+                        const uint64_t *vals);
 void            fstWriterEmitValueChangeVec32(void *ctx, fstHandle handle,
                         uint32_t bits, const uint32_t *val);
 void            fstWriterEmitValueChangeVec64(void *ctx, fstHandle handle,
@@ -372,17 +473,23 @@ void            fstWriterEmitValueChangeVec64(void *ctx, fstHandle handle,
 void            fstWriterEmitVariableLengthValueChange(void *ctx, fstHandle handle, const void *val, uint32_t len);
 void            fstWriterEmitTimeChange(void *ctx, uint64_t tim);
 void            fstWriterFlushContext(void *ctx);
+enum fstWriterBufferLayout fstWriterGetBufferLayout(void *ctx);
 int             fstWriterGetDumpSizeLimitReached(void *ctx);
+int             fstWriterGetFlushThreads(void *ctx);
 int             fstWriterGetFseekFailed(void *ctx);
+int             fstWriterGetParallelDepth(void *ctx);
 void            fstWriterSetAttrBegin(void *ctx, enum fstAttrType attrtype, int subtype,
                         const char *attrname, uint64_t arg);
 void            fstWriterSetAttrEnd(void *ctx);
+void            fstWriterSetBufferLayout(void *ctx, enum fstWriterBufferLayout layout);
 void            fstWriterSetComment(void *ctx, const char *comm);
 void            fstWriterSetDate(void *ctx, const char *dat);
 void            fstWriterSetDumpSizeLimit(void *ctx, uint64_t numbytes);
 void            fstWriterSetEnvVar(void *ctx, const char *envvar);
 void            fstWriterSetFileType(void *ctx, enum fstFileType filetype);
+void            fstWriterSetFlushThreads(void *ctx, int num_threads);
 void            fstWriterSetPackType(void *ctx, enum fstWriterPackType typ);
+void            fstWriterSetParallelDepth(void *ctx, int depth);
 void            fstWriterSetParallelMode(void *ctx, int enable);
 void            fstWriterSetRepackOnClose(void *ctx, int enable);       /* type = 0 (none), 1 (libz) */
 void            fstWriterSetScope(void *ctx, enum fstScopeType scopetype,
@@ -400,10 +507,16 @@ void            fstWriterSetVersion(void *ctx, const char *vers);
 /*
  * reader functions
  */
+void *          fstReaderClone(void *ctx);
 void            fstReaderClose(void *ctx);
 void            fstReaderClrFacProcessMask(void *ctx, fstHandle facidx);
 void            fstReaderClrFacProcessMaskAll(void *ctx);
+void            fstReaderFreeFlatHier(struct fstFlatHier *fh);
+void            fstReaderFreeHierScopeIndex(struct fstHierScopeIndex *si);
+void            fstReaderFreeTimeTable(void *ctx);
 uint64_t        fstReaderGetAliasCount(void *ctx);
+uint64_t        fstReaderGetBlockCacheSize(void *ctx);
+uint64_t        fstReaderGetBlockCacheUsage(void *ctx);
 const char *    fstReaderGetCurrentFlatScope(void *ctx);
 void *          fstReaderGetCurrentScopeUserInfo(void *ctx);
 int             fstReaderGetCurrentScopeLen(void *ctx);
@@ -414,16 +527,23 @@ unsigned char   fstReaderGetDumpActivityChangeValue(void *ctx, uint32_t idx);
 uint64_t        fstReaderGetEndTime(void *ctx);
 int             fstReaderGetFacProcessMask(void *ctx, fstHandle facidx);
 int             fstReaderGetFileType(void *ctx);
+struct fstFlatHier *fstReaderGetFlatHier(void *ctx);
+struct fstFlatHier *fstReaderGetFlatHierScope(void *ctx, const struct fstHierScopeIndex *si, uint32_t scope);
 int             fstReaderGetFseekFailed(void *ctx);
+struct fstHierScopeIndex *fstReaderGetHierScopeIndex(void *ctx);
 fstHandle       fstReaderGetMaxHandle(void *ctx);
 uint64_t        fstReaderGetMemoryUsedByWriter(void *ctx);
+int             fstReaderGetMmapIo(void *ctx);
 uint32_t        fstReaderGetNumberDumpActivityChanges(void *ctx);
 uint64_t        fstReaderGetScopeCount(void *ctx);
 uint64_t        fstReaderGetStartTime(void *ctx);
+const uint64_t *fstReaderGetTimeTable(void *ctx, uint64_t *num_times);
 signed char     fstReaderGetTimescale(void *ctx);
 int64_t         fstReaderGetTimezero(void *ctx);
 uint64_t        fstReaderGetValueChangeSectionCount(void *ctx);
 char *          fstReaderGetValueFromHandleAtTime(void *ctx, uint64_t tim, fstHandle facidx, char *buf);
+size_t          fstReaderGetValuesAtTime(void *ctx, uint64_t tim, const fstHandle *handles, uint32_t num_handles,
+                        char *buf, size_t buf_len, const char **values);
 uint64_t        fstReaderGetVarCount(void *ctx);
 const char *    fstReaderGetVersionString(void *ctx);
 struct fstHier *fstReaderIterateHier(void *ctx);
@@ -435,16 +555,24 @@ int             fstReaderIterBlocks2(void *ctx,
                         void (*value_change_callback)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value),
                         void (*value_change_callback_varlen)(void *user_callback_data_pointer, uint64_t time, fstHandle facidx, const unsigned char *value, uint32_t len),
                         void *user_callback_data_pointer, FILE *vcdhandle);
+int             fstReaderIterBlocksColumns(void *ctx,
+                        void (*column_callback)(void *user_callback_data_pointer, const struct fstColumn *col),
+                        void *user_callback_data_pointer);
+int             fstReaderIterBlocksGetParallelMode(void *ctx);
 void            fstReaderIterBlocksSetNativeDoublesOnCallback(void *ctx, int enable);
+void            fstReaderIterBlocksSetParallelMode(void *ctx, int num_threads);
 void *          fstReaderOpen(const char *nam);
+void *          fstReaderOpen2(const char *nam, unsigned int flags);
 void *          fstReaderOpenForUtilitiesOnly(void);
 const char *    fstReaderPopScope(void *ctx);
 int             fstReaderProcessHier(void *ctx, FILE *vcdhandle);
 const char *    fstReaderPushScope(void *ctx, const char *nam, void *user_info);
 void            fstReaderResetScope(void *ctx);
+void            fstReaderSetBlockCacheSize(void *ctx, uint64_t max_bytes);
 void            fstReaderSetFacProcessMask(void *ctx, fstHandle facidx);
 void            fstReaderSetFacProcessMaskAll(void *ctx);
 void            fstReaderSetLimitTimeRange(void *ctx, uint64_t start_time, uint64_t end_time);
+void            fstReaderSetMmapIo(void *ctx, int enable);
 void            fstReaderSetUnlimitedTimeRange(void *ctx);
 void            fstReaderSetVcdExtensions(void *ctx, int enable);
 
@@ -452,6 +580,8 @@ void            fstReaderSetVcdExtensions(void *ctx, int enable);
 /*
  * utility functions
  */
+size_t          fstUtilityDecodeVarints(const unsigned char *mem, size_t len, uint64_t *out, size_t max_out, size_t *nout);
+int             fstUtilitySetVarintDecoder(int decoder); /* process wide, returns the decoder now in use */
 int             fstUtilityBinToEscConvertedLen(const unsigned char *s, int len); /* used for mallocs for fstUtilityBinToEsc() */
 int             fstUtilityBinToEsc(unsigned char *d, const unsigned char *s, int len);
 int             fstUtilityEscToBin(unsigned char *d, unsigned char *s, int len);
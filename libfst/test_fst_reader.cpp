@@ -5,7 +5,13 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 extern "C" {
 #include "fstapi.h"
@@ -215,6 +221,1852 @@ bool test_fst_reader(const char* filename) {
     return passed;
 }
 
+// Writes a small multi-block trace (bit, vector, real, string and an alias)
+// so that block-level reader paths are exercised, not just a single block.
+bool write_synthetic_trace(const char* filename, int num_vectors, int num_steps, int flush_every, bool repack = false,
+                           enum fstWriterPackType pack = FST_WR_PT_ZLIB, int flush_threads = 0, int parallel_depth = 0,
+                           uint64_t dump_size_limit = 0, enum fstWriterBufferLayout layout = FST_WR_BL_CHAINED) {
+    void* wctx = fstWriterCreate(filename, 1);
+    if (!wctx) {
+        fprintf(stderr, "ERROR: Failed to create FST file: %s\n", filename);
+        return false;
+    }
+
+    fstWriterSetBufferLayout(wctx, layout);
+    fstWriterSetRepackOnClose(wctx, repack ? 1 : 0);
+    fstWriterSetPackType(wctx, pack);
+    fstWriterSetFlushThreads(wctx, flush_threads);
+    if (parallel_depth) {
+        fstWriterSetParallelDepth(wctx, parallel_depth);
+        fstWriterSetParallelMode(wctx, 1);
+    }
+    fstWriterSetDumpSizeLimit(wctx, dump_size_limit);
+    fstWriterSetDate(wctx, "synthetic"); // not the wall clock, so traces written twice compare equal
+
+    fstWriterSetTimescale(wctx, -9);
+    fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+    fstHandle clk = fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 1, "clk", 0);
+    fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 1, "clk_alias", clk);
+    fstHandle real = fstWriterCreateVar(wctx, FST_VT_VCD_REAL, FST_VD_IMPLICIT, 64, "level", 0);
+    fstHandle str = fstWriterCreateVar(wctx, FST_VT_GEN_STRING, FST_VD_IMPLICIT, 0, "state", 0);
+    std::vector<fstHandle> vectors;
+    for (int i = 0; i < num_vectors; i++) {
+        std::string name = "bus" + std::to_string(i);
+        vectors.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 8, name.c_str(), 0));
+    }
+    fstWriterSetUpscope(wctx);
+
+    char bits[9] = {0};
+    for (int t = 0; t < num_steps; t++) {
+        fstWriterEmitTimeChange(wctx, (uint64_t)t * 10);
+        fstWriterEmitValueChange(wctx, clk, (t & 1) ? "1" : "0");
+        if ((t % 3) == 0) {
+            double d = t * 0.5;
+            fstWriterEmitValueChange(wctx, real, &d);
+        }
+        if ((t % 7) == 0) {
+            std::string s = "s" + std::to_string(t);
+            fstWriterEmitVariableLengthValueChange(wctx, str, s.c_str(), (uint32_t)s.size());
+        }
+        for (int i = 0; i < num_vectors; i++) {
+            if (((t + i) % (i + 2)) == 0) {
+                for (int b = 0; b < 8; b++) {
+                    int v = ((t * (i + 1)) >> b) & 3;
+                    bits[b] = (v == 3) ? (((t % 50) == 0) ? 'u' : 'x') : (char)('0' + (v & 1));
+                }
+                fstWriterEmitValueChange(wctx, vectors[i], bits);
+            }
+        }
+        if (flush_every && t && ((t % flush_every) == 0)) {
+            fstWriterFlushContext(wctx);
+        }
+    }
+    fstWriterEmitTimeChange(wctx, (uint64_t)num_steps * 10);
+    fstWriterClose(wctx);
+    return true;
+}
+
+// Flushing every other step keeps each value change chain under the writer's
+// compression threshold, so the blocks reach the gzip wrapper uncompressed
+// and a short run spans several access points at arbitrary bit offsets.
+bool write_wide_trace(const char* filename, int num_vectors, int num_steps, bool repack) {
+    void* wctx = fstWriterCreate(filename, 1);
+    if (!wctx) {
+        fprintf(stderr, "ERROR: Failed to create FST file: %s\n", filename);
+        return false;
+    }
+
+    fstWriterSetRepackOnClose(wctx, repack ? 1 : 0);
+    fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+    std::vector<fstHandle> vectors;
+    for (int i = 0; i < num_vectors; i++) {
+        std::string name = "wide" + std::to_string(i);
+        vectors.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 64, name.c_str(), 0));
+    }
+    fstWriterSetUpscope(wctx);
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    char bits[65] = {0};
+    for (int t = 0; t < num_steps; t++) {
+        fstWriterEmitTimeChange(wctx, (uint64_t)t * 10);
+        for (int i = 0; i < num_vectors; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            for (int b = 0; b < 64; b++) bits[b] = (char)('0' + (((seed >> 60) >> (b & 3)) & 1));
+            fstWriterEmitValueChange(wctx, vectors[i], bits);
+        }
+        if (t & 1) {
+            fstWriterFlushContext(wctx);
+        }
+    }
+    fstWriterEmitTimeChange(wctx, (uint64_t)num_steps * 10);
+    fstWriterClose(wctx);
+    return true;
+}
+
+struct DigestContext {
+    std::string digest;
+    uint64_t count = 0;
+};
+
+static void digest_callback(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value) {
+    DigestContext* ctx = static_cast<DigestContext*>(user_data);
+    ctx->digest += std::to_string(time) + ":" + std::to_string(facidx) + "=" + (const char*)value + "\n";
+    ctx->count++;
+}
+
+static void digest_callback_varlen(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value, uint32_t len) {
+    DigestContext* ctx = static_cast<DigestContext*>(user_data);
+    ctx->digest += std::to_string(time) + ":" + std::to_string(facidx) + "=" + std::string((const char*)value, len) + "\n";
+    ctx->count++;
+}
+
+// Full value change dump plus a grid of value-at-time lookups, used to compare read paths.
+std::string digest_trace(void* ctx, uint64_t* count) {
+    DigestContext dctx;
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocks2(ctx, digest_callback, digest_callback_varlen, &dctx, nullptr);
+
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    uint64_t step = end_time / 37 + 1;
+    for (uint64_t t = 0; t <= end_time; t += step) {
+        for (fstHandle h = 1; h <= fstReaderGetMaxHandle(ctx); h++) {
+            char buf[256];
+            char* val = fstReaderGetValueFromHandleAtTime(ctx, t, h, buf);
+            dctx.digest += "@" + std::to_string(t) + ":" + std::to_string(h) + "=" + (val ? val : "(null)") + "\n";
+        }
+    }
+
+    if (count) *count = dctx.count;
+    return dctx.digest;
+}
+
+bool test_mmap_matches_stdio(const char* filename, std::string* digest = nullptr, const std::string* reference = nullptr) {
+    printf("\nTesting mmap and stdio read paths with file: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    printf("  Mapped on open: %d\n", fstReaderGetMmapIo(ctx));
+    uint64_t mapped_count = 0, stdio_count = 0;
+    std::string mapped = digest_trace(ctx, &mapped_count);
+    fstReaderSetMmapIo(ctx, 0);
+    bool unmapped = !fstReaderGetMmapIo(ctx);
+    std::string stdio = digest_trace(ctx, &stdio_count);
+    if (digest) *digest = mapped;
+    fstReaderClose(ctx);
+
+    bool passed = true;
+    if (reference && mapped != *reference) {
+        fprintf(stderr, "  FAIL: reads differ from the reference trace\n");
+        passed = false;
+    }
+    if (!unmapped) {
+        fprintf(stderr, "  FAIL: mapping still active after fstReaderSetMmapIo(ctx, 0)\n");
+        passed = false;
+    }
+    if (mapped_count == 0 || mapped != stdio) {
+        fprintf(stderr, "  FAIL: mmap and stdio reads differ (%llu vs %llu changes)\n",
+                (unsigned long long)mapped_count, (unsigned long long)stdio_count);
+        passed = false;
+    } else {
+        printf("  PASS: mmap and stdio reads match (%llu changes)\n", (unsigned long long)mapped_count);
+    }
+    return passed;
+}
+
+static bool read_whole_file(const std::string& filename, std::string* out) {
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    char buf[4096];
+    size_t n;
+    out->clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->append(buf, n);
+    fclose(f);
+    return true;
+}
+
+static bool write_whole_file(const std::string& filename, const std::string& data) {
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return (fclose(f) == 0) && ok;
+}
+
+static unsigned long long file_id(const std::string& filename) {
+    struct stat sb;
+    return stat(filename.c_str(), &sb) ? 0 : (unsigned long long)sb.st_ino;
+}
+
+static bool check_indexed_open(const char* filename, unsigned int flags, const std::string& reference, const char* what) {
+    void* ctx = fstReaderOpen2(filename, flags);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: %s: failed to open %s\n", what, filename);
+        return false;
+    }
+    uint64_t count = 0;
+    std::string digest = digest_trace(ctx, &count);
+    fstReaderClose(ctx);
+    if (digest != reference) {
+        fprintf(stderr, "  FAIL: %s: reads differ from a plain open (%llu changes)\n", what, (unsigned long long)count);
+        return false;
+    }
+    printf("  PASS: %s\n", what);
+    return true;
+}
+
+bool test_block_index(const char* filename, const std::string& reference) {
+    printf("\nTesting block index sidecar with file: %s\n", filename);
+
+    std::string sidecar = std::string(filename) + ".fstidx";
+    remove(sidecar.c_str());
+
+    bool passed = check_indexed_open(filename, FST_RD_OPEN_NO_MMAP, reference, "stdio open without sidecar");
+    std::string data;
+    if (read_whole_file(sidecar, &data)) {
+        fprintf(stderr, "  FAIL: sidecar written without FST_RD_OPEN_BLOCK_INDEX\n");
+        passed = false;
+    }
+
+    passed = check_indexed_open(filename, FST_RD_OPEN_BLOCK_INDEX, reference, "first indexed open writes sidecar") && passed;
+    if (!read_whole_file(sidecar, &data) || data.size() < 84) {
+        fprintf(stderr, "  FAIL: sidecar %s missing after indexed open\n", sidecar.c_str());
+        return false;
+    }
+
+    unsigned long long id = file_id(sidecar);
+    passed = check_indexed_open(filename, FST_RD_OPEN_BLOCK_INDEX, reference, "second indexed open loads sidecar") && passed;
+#ifndef _WIN32
+    if (file_id(sidecar) != id) {
+        fprintf(stderr, "  FAIL: valid sidecar was rewritten instead of loaded\n");
+        passed = false;
+    }
+#endif
+
+    // a damaged sidecar must be ignored and replaced, never trusted
+    std::string damaged = data;
+    damaged[100] ^= 0x5a;
+    passed = write_whole_file(sidecar, damaged) &&
+             check_indexed_open(filename, FST_RD_OPEN_BLOCK_INDEX, reference, "damaged sidecar falls back to scan") && passed;
+    std::string rewritten;
+    if (!read_whole_file(sidecar, &rewritten) || rewritten != data) {
+        fprintf(stderr, "  FAIL: damaged sidecar was not rewritten\n");
+        passed = false;
+    }
+
+    passed = write_whole_file(sidecar, data.substr(0, data.size() / 2)) &&
+             check_indexed_open(filename, FST_RD_OPEN_BLOCK_INDEX, reference, "truncated sidecar falls back to scan") && passed;
+
+    remove(sidecar.c_str());
+    return passed;
+}
+
+// Value-at-time lookups on a fresh context must not depend on which block an
+// earlier lookup left cached, in particular at the flush boundaries where one
+// block ends and the next begins at the same time.
+bool test_rvat_cold_lookups(const char* filename, uint64_t boundary_period) {
+    printf("\nTesting cold value-at-time lookups at block boundaries: %s\n", filename);
+
+    void* warm = fstReaderOpen(filename);
+    if (!warm) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    bool passed = true;
+    int lookups = 0;
+    uint64_t end_time = fstReaderGetEndTime(warm);
+    fstHandle maxhandle = fstReaderGetMaxHandle(warm);
+    for (uint64_t t = boundary_period; t <= end_time && passed; t += boundary_period) {
+        void* cold = fstReaderOpen(filename);
+        for (fstHandle h = 1; h <= maxhandle; h++) {
+            char wbuf[256], cbuf[256];
+            fstReaderGetValueFromHandleAtTime(warm, t - 1, h, wbuf);
+            char* wval = fstReaderGetValueFromHandleAtTime(warm, t, h, wbuf);
+            char* cval = fstReaderGetValueFromHandleAtTime(cold, t, h, cbuf);
+            // reals decoded from a value chain carry a leading 'r', from a frame they do not
+            if (wval && wval[0] == 'r') wval++;
+            if (cval && cval[0] == 'r') cval++;
+            if ((!wval != !cval) || (wval && strcmp(wval, cval))) {
+                fprintf(stderr, "  FAIL: handle %u at time %llu: warm=%s cold=%s\n", h, (unsigned long long)t,
+                        wval ? wval : "(null)", cval ? cval : "(null)");
+                passed = false;
+                break;
+            }
+            lookups++;
+        }
+        fstReaderClose(cold);
+    }
+    fstReaderClose(warm);
+
+    if (passed) printf("  PASS: %d cold lookups match\n", lookups);
+    return passed;
+}
+
+// Lookups jumping between regions, more than the reader keeps blocks for, must
+// match a reader that has never decoded a block.
+bool test_rvat_random_access(const char* filename) {
+    printf("\nTesting value-at-time lookups jumping between blocks: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    std::vector<uint64_t> times;
+    for (int i = 0; i < 12; i++) {
+        times.push_back(end_time / 50 + i);            // two cursors far apart
+        times.push_back(end_time - end_time / 50 - i);
+    }
+    for (uint64_t i = 0; i < 24; i++) {
+        times.push_back((i * 7919) % (end_time + 1));  // scattered over every block
+    }
+    times.push_back(end_time + 1);
+
+    bool passed = true;
+    int lookups = 0;
+    for (size_t n = 0; n < times.size() && passed; n++) {
+        void* cold = fstReaderOpen(filename);
+        for (fstHandle h = 1; h <= maxhandle; h++) {
+            char buf[256], cbuf[256];
+            char* val = fstReaderGetValueFromHandleAtTime(ctx, times[n], h, buf);
+            char* cval = fstReaderGetValueFromHandleAtTime(cold, times[n], h, cbuf);
+            if ((!val != !cval) || (val && strcmp(val, cval))) {
+                fprintf(stderr, "  FAIL: handle %u at time %llu: got %s expected %s\n", h, (unsigned long long)times[n],
+                        val ? val : "(null)", cval ? cval : "(null)");
+                passed = false;
+                break;
+            }
+            lookups++;
+        }
+        fstReaderClose(cold);
+    }
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: %d lookups match a fresh reader\n", lookups);
+    return passed;
+}
+
+// A batch lookup must give each handle what a single lookup gives it,
+// including aliases, invalid handles and a buffer that is too small.
+bool test_batch_values_at_time(const char* filename, int threads = 0) {
+    printf("\nTesting batch value-at-time lookups (threads=%d): %s\n", threads, filename);
+
+    void* ctx = fstReaderOpen(filename);
+    void* single = fstReaderOpen(filename);
+    if (!ctx || !single) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        if (ctx) fstReaderClose(ctx);
+        if (single) fstReaderClose(single);
+        return false;
+    }
+    fstReaderIterBlocksSetParallelMode(ctx, threads);
+
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    std::vector<fstHandle> handles;
+    for (fstHandle h = maxhandle; h >= 1; h--) {
+        handles.push_back(h);
+    }
+    handles.push_back(1);                   // repeated handle
+    handles.push_back(0);                   // invalid handles
+    handles.push_back(maxhandle + 1);
+
+    std::vector<uint64_t> times;
+    for (uint64_t i = 0; i < 16; i++) {
+        times.push_back((i * 7919) % (end_time + 1));
+    }
+    times.push_back(end_time);
+    times.push_back(end_time + 1);
+
+    bool passed = true;
+    int lookups = 0;
+    std::vector<const char*> values(handles.size());
+    for (size_t n = 0; n < times.size() && passed; n++) {
+        std::vector<char> buf(16);
+        size_t need = fstReaderGetValuesAtTime(ctx, times[n], handles.data(), (uint32_t)handles.size(),
+                                               buf.data(), buf.size(), values.data());
+        if (need > buf.size()) {
+            buf.resize(need);
+            size_t again = fstReaderGetValuesAtTime(ctx, times[n], handles.data(), (uint32_t)handles.size(),
+                                                    buf.data(), buf.size(), values.data());
+            if (again != need) {
+                fprintf(stderr, "  FAIL: time %llu needed %zu bytes then %zu\n", (unsigned long long)times[n], need, again);
+                passed = false;
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < handles.size(); i++) {
+            char sbuf[256];
+            char* sval = (handles[i] && handles[i] <= maxhandle) ?
+                fstReaderGetValueFromHandleAtTime(single, times[n], handles[i], sbuf) : NULL;
+            if ((!values[i] != !sval) || (sval && strcmp(values[i], sval))) {
+                fprintf(stderr, "  FAIL: handle %u at time %llu: got %s expected %s\n", handles[i], (unsigned long long)times[n],
+                        values[i] ? values[i] : "(null)", sval ? sval : "(null)");
+                passed = false;
+                break;
+            }
+            lookups++;
+        }
+    }
+    fstReaderClose(single);
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: %d batched values match single lookups\n", lookups);
+    return passed;
+}
+
+struct HistoryContext {
+    std::map<fstHandle, std::vector<std::pair<uint64_t, std::string> > > history;
+    uint64_t count = 0;
+};
+
+static void history_callback_varlen(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value, uint32_t len) {
+    HistoryContext* ctx = static_cast<HistoryContext*>(user_data);
+    ctx->history[facidx].push_back(std::make_pair(time, std::string((const char*)value, len)));
+    ctx->count++;
+}
+
+static void history_callback(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value) {
+    history_callback_varlen(user_data, time, facidx, value, (uint32_t)strlen((const char*)value));
+}
+
+static const std::string* history_value_at(const HistoryContext& ctx, fstHandle facidx, uint64_t time) {
+    std::map<fstHandle, std::vector<std::pair<uint64_t, std::string> > >::const_iterator it = ctx.history.find(facidx);
+    const std::string* val = nullptr;
+    if (it != ctx.history.end()) {
+        for (size_t i = 0; i < it->second.size() && it->second[i].first <= time; i++) val = &it->second[i].second;
+    }
+    return val;
+}
+
+// Iteration limited to a time window must reproduce every signal's value
+// inside the window and must not decode blocks that lie before it.
+bool test_limit_time_range(const char* filename, int threads = 0) {
+    printf("\nTesting time range limited iteration (%d threads) with file: %s\n", threads, filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocksSetParallelMode(ctx, threads);
+
+    HistoryContext full;
+    fstReaderIterBlocks2(ctx, history_callback, history_callback_varlen, &full, nullptr);
+
+    bool passed = true;
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    fstHandle maxhandle = fstReaderGetMaxHandle(ctx);
+    const uint64_t windows[][2] = {
+        {0, end_time / 10}, {end_time / 3, end_time / 2}, {end_time - 5, end_time}, {end_time / 2 + 1, end_time / 2 + 1}
+    };
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        uint64_t lo = windows[w][0], hi = windows[w][1];
+        HistoryContext limited;
+        fstReaderSetLimitTimeRange(ctx, lo, hi);
+        fstReaderIterBlocks2(ctx, history_callback, history_callback_varlen, &limited, nullptr);
+        fstReaderSetUnlimitedTimeRange(ctx);
+
+        // callbacks are limited per block, so only the skipped leading blocks are checked here
+        if (lo > end_time / 4 && limited.count * 2 > full.count) {
+            fprintf(stderr, "  FAIL: [%llu, %llu] delivered %llu of %llu changes\n", (unsigned long long)lo,
+                    (unsigned long long)hi, (unsigned long long)limited.count, (unsigned long long)full.count);
+            passed = false;
+            continue;
+        }
+        for (uint64_t t = lo; t <= hi; t += (hi - lo) / 16 + 1) {
+            for (fstHandle h = 1; h <= maxhandle; h++) {
+                const std::string* expected = history_value_at(full, h, t);
+                const std::string* got = history_value_at(limited, h, t);
+                if ((!expected != !got) || (expected && *expected != *got)) {
+                    fprintf(stderr, "  FAIL: [%llu, %llu] handle %u at time %llu: expected %s got %s\n", (unsigned long long)lo,
+                            (unsigned long long)hi, h, (unsigned long long)t, expected ? expected->c_str() : "(none)",
+                            got ? got->c_str() : "(none)");
+                    passed = false;
+                    t = hi;
+                    break;
+                }
+            }
+        }
+    }
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: windowed iteration matches full iteration\n");
+    return passed;
+}
+
+// Parallel block decode must deliver exactly the serial callback sequence.
+bool test_parallel_iteration(const char* filename, const std::string& reference) {
+    printf("\nTesting parallel block decode with file: %s\n", filename);
+
+    bool passed = true;
+    const int thread_counts[] = {2, 3, 8};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        for (int use_mmap = 1; use_mmap >= 0; use_mmap--) {
+            void* ctx = fstReaderOpen(filename);
+            if (!ctx) {
+                fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+                return false;
+            }
+            fstReaderSetMmapIo(ctx, use_mmap);
+            fstReaderIterBlocksSetParallelMode(ctx, thread_counts[t]);
+            int effective = fstReaderIterBlocksGetParallelMode(ctx);
+
+            uint64_t count = 0;
+            std::string digest = digest_trace(ctx, &count);
+            std::string again = digest_trace(ctx, nullptr);
+            fstReaderClose(ctx);
+
+            if (digest != reference || again != reference) {
+                fprintf(stderr, "  FAIL: %d threads (%s): reads differ from serial decode (%llu changes)\n",
+                        thread_counts[t], use_mmap ? "mmap" : "stdio", (unsigned long long)count);
+                passed = false;
+            } else {
+                printf("  PASS: %d threads requested, %d used (%s)\n", thread_counts[t], effective,
+                       use_mmap ? "mmap" : "stdio");
+            }
+        }
+    }
+    return passed;
+}
+
+struct ColumnContext {
+    std::map<fstHandle, std::string> changes;
+    int encodings_seen = 0;
+};
+
+static void per_handle_callback(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value) {
+    ColumnContext* ctx = static_cast<ColumnContext*>(user_data);
+    ctx->changes[facidx] += std::to_string(time) + "=" + (const char*)value + "\n";
+}
+
+static void per_handle_callback_varlen(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value, uint32_t len) {
+    ColumnContext* ctx = static_cast<ColumnContext*>(user_data);
+    ctx->changes[facidx] += std::to_string(time) + "=" + std::string((const char*)value, len) + "\n";
+}
+
+static void column_callback(void* user_data, const struct fstColumn* col) {
+    ColumnContext* ctx = static_cast<ColumnContext*>(user_data);
+    std::string& out = ctx->changes[col->handle];
+    ctx->encodings_seen |= 1 << col->encoding;
+
+    for (uint32_t c = 0; c < col->count; c++) {
+        out += std::to_string(col->times[col->time_idx[c]]) + "=";
+        if (col->encoding == FST_CE_BYTES) {
+            out += std::string((const char*)col->values + col->value_offs[c], col->value_offs[c + 1] - col->value_offs[c]);
+        } else if (col->encoding == FST_CE_DOUBLE) {
+            double d;
+            char buf[32];
+            memcpy(&d, col->values + (size_t)c * col->value_stride, sizeof(d));
+            snprintf(buf, sizeof(buf), "%.16g", d);
+            out += buf;
+        } else {
+            int bpb = (col->encoding == FST_CE_BITS2) ? 2 : 4;
+            const unsigned char* v = col->values + (size_t)c * col->value_stride;
+            for (uint32_t j = 0; j < col->len; j++) {
+                uint32_t bit = j * bpb;
+                out += FST_COLUMN_STATES[(v[bit / 8] >> (8 - bpb - bit % 8)) & ((1 << bpb) - 1)];
+            }
+        }
+        out += "\n";
+    }
+}
+
+// Columnar iteration must deliver, per signal, the same changes as fstReaderIterBlocks2.
+bool test_column_iteration(const char* filename) {
+    printf("\nTesting columnar iteration with file: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    bool passed = true;
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    const int threads[] = {0, 0, 3};
+    for (int pass = 0; pass < 3; pass++) {
+        fstReaderSetFacProcessMaskAll(ctx);
+        if (pass == 1) {
+            fstReaderClrFacProcessMask(ctx, 2);
+            fstReaderSetLimitTimeRange(ctx, end_time / 3, end_time / 2);
+        }
+        fstReaderIterBlocksSetParallelMode(ctx, threads[pass]);
+
+        ColumnContext reference, columns;
+        fstReaderIterBlocks2(ctx, per_handle_callback, per_handle_callback_varlen, &reference, nullptr);
+        fstReaderIterBlocksColumns(ctx, column_callback, &columns);
+        fstReaderSetUnlimitedTimeRange(ctx);
+
+        if (reference.changes.empty() || columns.changes != reference.changes) {
+            fprintf(stderr, "  FAIL: pass %d: columns differ from per-change callbacks (%zu vs %zu signals)\n", pass,
+                    columns.changes.size(), reference.changes.size());
+            passed = false;
+        } else if (pass == 0 && columns.encodings_seen != 0xf) {
+            fprintf(stderr, "  FAIL: expected all column encodings, saw mask 0x%x\n", columns.encodings_seen);
+            passed = false;
+        }
+    }
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: columns match per-change callbacks\n");
+    return passed;
+}
+
+// Clones share metadata with their source but must be usable from other threads,
+// with the source closed, and in any close order.
+bool test_clone_readers(const char* filename, const char* wrapped_filename, const std::string& reference) {
+    printf("\nTesting cloned readers with file: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    const int num_clones = 4;
+    std::vector<void*> clones;
+    for (int i = 0; i < num_clones; i++) {
+        void* clone = fstReaderClone(i ? clones[i - 1] : ctx);
+        if (!clone) {
+            fprintf(stderr, "  FAIL: fstReaderClone() returned NULL\n");
+            for (void* c : clones) fstReaderClose(c);
+            fstReaderClose(ctx);
+            return false;
+        }
+        if (i & 1) fstReaderSetMmapIo(clone, 0);
+        clones.push_back(clone);
+    }
+    fstReaderClose(ctx);
+
+    bool passed = true;
+    uint64_t vars = 0;
+    fstReaderIterateHierRewind(clones[0]);
+    while (struct fstHier* h = fstReaderIterateHier(clones[0])) {
+        if (h->htyp == FST_HT_VAR) vars++;
+    }
+    if (vars != fstReaderGetVarCount(clones[0])) {
+        fprintf(stderr, "  FAIL: clone hierarchy has %llu vars, expected %llu\n", (unsigned long long)vars,
+                (unsigned long long)fstReaderGetVarCount(clones[0]));
+        passed = false;
+    }
+
+    std::vector<std::string> digests(num_clones);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_clones; i++) {
+        threads.emplace_back([&clones, &digests, i]() { digests[i] = digest_trace(clones[i], nullptr); });
+    }
+    for (std::thread& t : threads) t.join();
+
+    for (int i = 0; i < num_clones; i++) {
+        if (digests[i] != reference) {
+            fprintf(stderr, "  FAIL: clone %d (%s) reads differ from the source reader\n", i, (i & 1) ? "stdio" : "mmap");
+            passed = false;
+        }
+    }
+    for (int i = num_clones - 1; i >= 0; i -= 2) fstReaderClose(clones[i]);
+    for (int i = 0; i < num_clones; i += 2) fstReaderClose(clones[i]);
+
+    void* wrapped = fstReaderOpen2(wrapped_filename, FST_RD_OPEN_GZIP_UNPACK);
+    if (wrapped) {
+        void* clone = fstReaderClone(wrapped);
+        if (clone) {
+            fprintf(stderr, "  FAIL: fstReaderClone() accepted a wrapped trace unpacked to a temp file\n");
+            fstReaderClose(clone);
+            passed = false;
+        }
+        fstReaderClose(wrapped);
+    }
+
+    if (passed) printf("  PASS: %d clones read concurrently match the source reader\n", num_clones);
+    return passed;
+}
+
+// A wrapped trace read in place through the gzip index must read like the
+// plain one, from clones, backwards across access points, with the index
+// loaded from its sidecar, and with a damaged sidecar.
+bool test_gzip_index(const char* filename, const char* wrapped_filename) {
+    printf("\nTesting in-place gzip reads with file: %s\n", wrapped_filename);
+
+    void* plain = fstReaderOpen(filename);
+    if (!plain) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+    std::string reference = digest_trace(plain, nullptr);
+
+    std::string sidecar = std::string(wrapped_filename) + ".fstgzidx";
+    remove(sidecar.c_str());
+    remove((std::string(wrapped_filename) + ".fstidx").c_str());
+
+    bool passed = check_indexed_open(wrapped_filename, FST_RD_OPEN_DEFAULT, reference, "in-place open matches the plain trace");
+    passed = check_indexed_open(wrapped_filename, FST_RD_OPEN_GZIP_UNPACK, reference, "unpacked open matches the plain trace") && passed;
+
+    void* ctx = fstReaderOpen(wrapped_filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", wrapped_filename);
+        fstReaderClose(plain);
+        return false;
+    }
+
+    // walk backwards so every lookup has to restart at an earlier access point
+    uint64_t end_time = fstReaderGetEndTime(ctx);
+    int lookups = 0;
+    for (uint64_t t = end_time + 1; t-- > 0 && passed; t -= (t > end_time / 97) ? end_time / 97 : t) {
+        for (fstHandle h = 1; h <= fstReaderGetMaxHandle(ctx); h++) {
+            char buf[256], pbuf[256];
+            char* val = fstReaderGetValueFromHandleAtTime(ctx, t, h, buf);
+            char* pval = fstReaderGetValueFromHandleAtTime(plain, t, h, pbuf);
+            if ((!val != !pval) || (val && strcmp(val, pval))) {
+                fprintf(stderr, "  FAIL: handle %u at time %llu: got %s expected %s\n", h, (unsigned long long)t,
+                        val ? val : "(null)", pval ? pval : "(null)");
+                passed = false;
+                break;
+            }
+            lookups++;
+        }
+    }
+    if (passed) printf("  PASS: %d backward lookups match the plain trace\n", lookups);
+    fstReaderClose(plain);
+
+    const int num_clones = 4;
+    std::vector<void*> clones;
+    for (int i = 0; i < num_clones; i++) {
+        void* clone = fstReaderClone(ctx);
+        if (!clone) {
+            fprintf(stderr, "  FAIL: fstReaderClone() refused a wrapped trace read in place\n");
+            passed = false;
+            break;
+        }
+        clones.push_back(clone);
+    }
+    fstReaderClose(ctx);
+
+    std::vector<std::string> digests(clones.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clones.size(); i++) {
+        threads.emplace_back([&clones, &digests, i]() { digests[i] = digest_trace(clones[i], nullptr); });
+    }
+    for (std::thread& t : threads) t.join();
+    for (size_t i = 0; i < clones.size(); i++) {
+        if (digests[i] != reference) {
+            fprintf(stderr, "  FAIL: clone %d reads differ from the plain trace\n", (int)i);
+            passed = false;
+        }
+        fstReaderClose(clones[i]);
+    }
+    if (passed && clones.size() == num_clones) printf("  PASS: %d clones inflate concurrently\n", num_clones);
+
+    std::string data;
+    if (read_whole_file(sidecar, &data)) {
+        fprintf(stderr, "  FAIL: gzip index sidecar written without FST_RD_OPEN_BLOCK_INDEX\n");
+        passed = false;
+    }
+    passed = check_indexed_open(wrapped_filename, FST_RD_OPEN_BLOCK_INDEX, reference, "first indexed open writes gzip index") && passed;
+    if (!read_whole_file(sidecar, &data) || data.size() < 56) {
+        fprintf(stderr, "  FAIL: gzip index sidecar %s missing after indexed open\n", sidecar.c_str());
+        return false;
+    }
+
+    unsigned long long id = file_id(sidecar);
+    passed = check_indexed_open(wrapped_filename, FST_RD_OPEN_BLOCK_INDEX, reference, "second indexed open loads gzip index") && passed;
+#ifndef _WIN32
+    if (file_id(sidecar) != id) {
+        fprintf(stderr, "  FAIL: valid gzip index was rewritten instead of loaded\n");
+        passed = false;
+    }
+#endif
+
+    std::string damaged = data;
+    damaged[data.size() / 2] ^= 0x5a;
+    passed = write_whole_file(sidecar, damaged) &&
+             check_indexed_open(wrapped_filename, FST_RD_OPEN_BLOCK_INDEX, reference, "damaged gzip index is rebuilt") && passed;
+    std::string rewritten;
+    if (!read_whole_file(sidecar, &rewritten) || rewritten != data) {
+        fprintf(stderr, "  FAIL: damaged gzip index was not rewritten\n");
+        passed = false;
+    }
+
+    remove(sidecar.c_str());
+    remove((std::string(wrapped_filename) + ".fstidx").c_str());
+    return passed;
+}
+
+static void time_callback(void* user_data, uint64_t time, fstHandle, const unsigned char*) {
+    static_cast<std::vector<uint64_t>*>(user_data)->push_back(time);
+}
+
+static void time_callback_varlen(void* user_data, uint64_t time, fstHandle, const unsigned char*, uint32_t) {
+    static_cast<std::vector<uint64_t>*>(user_data)->push_back(time);
+}
+
+// The global time table must be sorted, duplicate free and hold every time a change is reported at.
+bool test_time_table(const char* filename) {
+    printf("\nTesting global time table with file: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    uint64_t num_times = 0, num_again = 0;
+    const uint64_t* times = fstReaderGetTimeTable(ctx, &num_times);
+    const uint64_t* again = fstReaderGetTimeTable(ctx, &num_again);
+
+    std::vector<uint64_t> change_times;
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocks2(ctx, time_callback, time_callback_varlen, &change_times, nullptr);
+
+    bool passed = true;
+    if (!times || !num_times || again != times || num_again != num_times) {
+        fprintf(stderr, "  FAIL: time table missing or not cached (%llu times)\n", (unsigned long long)num_times);
+        passed = false;
+    } else if (times[0] != fstReaderGetStartTime(ctx) || times[num_times - 1] != fstReaderGetEndTime(ctx)) {
+        fprintf(stderr, "  FAIL: time table spans %llu..%llu, trace spans %llu..%llu\n", (unsigned long long)times[0],
+                (unsigned long long)times[num_times - 1], (unsigned long long)fstReaderGetStartTime(ctx),
+                (unsigned long long)fstReaderGetEndTime(ctx));
+        passed = false;
+    } else {
+        std::vector<uint64_t> copy(times, times + num_times);
+        fstReaderFreeTimeTable(ctx);
+        times = fstReaderGetTimeTable(ctx, &num_again);
+        if (!times || std::vector<uint64_t>(times, times + num_again) != copy) {
+            fprintf(stderr, "  FAIL: time table rebuilt after fstReaderFreeTimeTable() differs\n");
+            passed = false;
+            times = copy.data();
+        }
+        for (uint64_t i = 1; i < num_times && passed; i++) {
+            if (times[i] <= times[i - 1]) {
+                fprintf(stderr, "  FAIL: time table not strictly increasing at %llu\n", (unsigned long long)i);
+                passed = false;
+            }
+        }
+        for (uint64_t t : change_times) {
+            if (!std::binary_search(times, times + num_times, t)) {
+                fprintf(stderr, "  FAIL: change time %llu missing from the time table\n", (unsigned long long)t);
+                passed = false;
+                break;
+            }
+        }
+    }
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: %llu distinct times cover %zu changes\n", (unsigned long long)num_times, change_times.size());
+    return passed;
+}
+
+// Time tables and chain indexes cached across passes must not change what is read,
+// whatever the budget, and the cache must stay within it.
+bool test_block_cache(const char* filename, const std::string& reference) {
+    printf("\nTesting block metadata cache with file: %s\n", filename);
+
+    ColumnContext uncached;
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocksColumns(ctx, column_callback, &uncached);
+    fstReaderClose(ctx);
+
+    bool passed = true;
+    const uint64_t budgets[] = {64 << 20, 8192, 16};
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+        for (int threads = 0; threads <= 3; threads += 3) {
+            ctx = fstReaderOpen(filename);
+            fstReaderSetBlockCacheSize(ctx, budgets[b]);
+            fstReaderIterBlocksSetParallelMode(ctx, threads);
+
+            // a narrow first pass fills the cache, later full passes must not depend on its mask
+            fstReaderClrFacProcessMaskAll(ctx);
+            fstReaderSetFacProcessMask(ctx, 1);
+            ColumnContext narrow;
+            fstReaderIterBlocksColumns(ctx, column_callback, &narrow);
+            uint64_t used = fstReaderGetBlockCacheUsage(ctx);
+
+            std::string digest = digest_trace(ctx, nullptr);
+            std::string again = digest_trace(ctx, nullptr);
+            ColumnContext columns;
+            fstReaderSetFacProcessMaskAll(ctx);
+            fstReaderIterBlocksColumns(ctx, column_callback, &columns);
+
+            if (digest != reference || again != reference || columns.changes != uncached.changes) {
+                fprintf(stderr, "  FAIL: budget %llu, %d threads: reads differ from the uncached reader\n",
+                        (unsigned long long)budgets[b], threads);
+                passed = false;
+            } else if (fstReaderGetBlockCacheUsage(ctx) > budgets[b] || (b == 0 && !used)) {
+                fprintf(stderr, "  FAIL: budget %llu, %d threads: cache holds %llu bytes\n", (unsigned long long)budgets[b],
+                        threads, (unsigned long long)fstReaderGetBlockCacheUsage(ctx));
+                passed = false;
+            }
+
+            fstReaderSetBlockCacheSize(ctx, 1024);
+            if (fstReaderGetBlockCacheUsage(ctx) > 1024) {
+                fprintf(stderr, "  FAIL: shrinking the budget did not evict\n");
+                passed = false;
+            }
+            fstReaderSetBlockCacheSize(ctx, 0);
+            if (fstReaderGetBlockCacheUsage(ctx) || digest_trace(ctx, nullptr) != reference) {
+                fprintf(stderr, "  FAIL: disabling the cache left it in use or changed reads\n");
+                passed = false;
+            }
+            fstReaderClose(ctx);
+        }
+    }
+
+    if (passed) printf("  PASS: cached passes match uncached reads within budget\n");
+    return passed;
+}
+
+// Same hierarchy, written with the gzip (default) or LZ4 hierarchy section encoding.
+static bool write_hier_trace(const char* filename, bool lz4) {
+    void* wctx = fstWriterCreate(filename, 1);
+    if (!wctx) {
+        fprintf(stderr, "ERROR: Failed to create FST file: %s\n", filename);
+        return false;
+    }
+    if (lz4) fstWriterSetPackType(wctx, FST_WR_PT_LZ4);
+
+    std::string long_name(700, 'n');  // longer than the reader's scope/var name buffer
+    fstHandle first = 0;
+    for (int i = 0; i < 40; i++) {
+        std::string scope = "unit" + std::to_string(i);
+        fstWriterSetScope(wctx, (i & 1) ? FST_ST_VHDL_ARCHITECTURE : FST_ST_VCD_MODULE, scope.c_str(), (i & 1) ? "comp" : NULL);
+        fstWriterSetComment(wctx, scope.c_str());
+        fstWriterSetSourceStem(wctx, "rtl/unit.sv", 10 + i, 0);
+        fstHandle h = fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_INPUT, 8, "data", 0);
+        fstWriterCreateVar(wctx, FST_VT_VCD_REAL, FST_VD_IMPLICIT, 64, "level", 0);
+        fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_OUTPUT, 8, (i == 7) ? long_name.c_str() : "data_alias", first ? first : h);
+        if (!first) first = h;
+        if (i % 5 == 0) {
+            fstWriterSetScope(wctx, FST_ST_VCD_BEGIN, "blk", NULL);
+            fstWriterCreateVar(wctx, FST_VT_SV_LOGIC, FST_VD_IMPLICIT, 1, "q", 0);
+            fstWriterSetUpscope(wctx);
+            fstWriterCreateVar(wctx, FST_VT_VCD_REG, FST_VD_IMPLICIT, 4, "after_blk", 0);
+        }
+        fstWriterSetUpscope(wctx);
+    }
+    fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 1, "unscoped", 0);
+    fstWriterEmitTimeChange(wctx, 0);
+    fstWriterEmitValueChange(wctx, first, "01010101");
+    fstWriterEmitTimeChange(wctx, 10);
+    fstWriterEmitValueChange(wctx, first, "10101010");
+    fstWriterClose(wctx);
+    return true;
+}
+
+static std::string walk_hierarchy(void* ctx) {
+    std::string out;
+    char line[1024];
+    while (struct fstHier* h = fstReaderIterateHier(ctx)) {
+        switch (h->htyp) {
+        case FST_HT_SCOPE:
+            snprintf(line, sizeof(line), "S %d %s(%u) %s(%u)\n", h->u.scope.typ, h->u.scope.name, h->u.scope.name_length,
+                     h->u.scope.component, h->u.scope.component_length);
+            break;
+        case FST_HT_UPSCOPE:
+            snprintf(line, sizeof(line), "U\n");
+            break;
+        case FST_HT_VAR:
+            snprintf(line, sizeof(line), "V %d %d %s(%u) %u %u %d\n", h->u.var.typ, h->u.var.direction, h->u.var.name,
+                     h->u.var.name_length, h->u.var.length, h->u.var.handle, h->u.var.is_alias);
+            break;
+        case FST_HT_ATTRBEGIN:
+            snprintf(line, sizeof(line), "A %d %d %.64s %llu %llu\n", h->u.attr.typ, h->u.attr.subtype, h->u.attr.name,
+                     (unsigned long long)h->u.attr.arg, (unsigned long long)h->u.attr.arg_from_name);
+            break;
+        default:
+            snprintf(line, sizeof(line), "E\n");
+            break;
+        }
+        out += line;
+    }
+    return out;
+}
+
+// The hierarchy is decoded into memory: both section encodings, rewinds and
+// clones (sharing the buffer or not) must walk the same entries.
+bool test_hierarchy_in_memory(const char* gzip_filename, const char* lz4_filename) {
+    printf("\nTesting in-memory hierarchy with files: %s, %s\n", gzip_filename, lz4_filename);
+
+    if (!write_hier_trace(gzip_filename, false) || !write_hier_trace(lz4_filename, true)) return false;
+
+    void* gz = fstReaderOpen(gzip_filename);
+    void* lz = fstReaderOpen(lz4_filename);
+    if (!gz || !lz) {
+        fprintf(stderr, "  FAIL: Failed to open hierarchy traces\n");
+        if (gz) fstReaderClose(gz);
+        if (lz) fstReaderClose(lz);
+        return false;
+    }
+
+    void* early_clone = fstReaderClone(gz);  // before the source decoded its hierarchy
+    std::string reference = walk_hierarchy(gz);
+    void* late_clone = fstReaderClone(gz);   // after: the clone copies the decoded hierarchy
+
+    bool passed = true;
+    uint64_t vars = 0, scopes = 0;
+    for (size_t pos = 0; pos < reference.size(); pos = reference.find('\n', pos) + 1) {
+        vars += (reference[pos] == 'V');
+        scopes += (reference[pos] == 'S');
+    }
+    if (vars != fstReaderGetVarCount(gz) || scopes != fstReaderGetScopeCount(gz)) {
+        fprintf(stderr, "  FAIL: walked %llu vars / %llu scopes, header says %llu / %llu\n", (unsigned long long)vars,
+                (unsigned long long)scopes, (unsigned long long)fstReaderGetVarCount(gz),
+                (unsigned long long)fstReaderGetScopeCount(gz));
+        passed = false;
+    }
+    if (reference.find("(512)") == std::string::npos) {
+        fprintf(stderr, "  FAIL: long variable name was not truncated to the name buffer\n");
+        passed = false;
+    }
+
+    fstReaderIterateHierRewind(gz);
+    std::string lz_walk = walk_hierarchy(lz);
+    void* shared_clone = fstReaderClone(lz);  // first clone of a decoded source shares its buffer
+    const char* what[] = {"rewound walk", "LZ4 hierarchy", "clone made before decode", "clone made after decode",
+                          "clone sharing the hierarchy"};
+    std::string walks[] = {walk_hierarchy(gz), lz_walk, early_clone ? walk_hierarchy(early_clone) : "",
+                           late_clone ? walk_hierarchy(late_clone) : "", shared_clone ? walk_hierarchy(shared_clone) : ""};
+    for (int i = 0; i < 5; i++) {
+        if (walks[i] != reference) {
+            fprintf(stderr, "  FAIL: %s differs from the first walk\n", what[i]);
+            passed = false;
+        }
+    }
+    if (fstReaderIterateHier(gz)) {
+        fprintf(stderr, "  FAIL: hierarchy walk did not stop at the end\n");
+        passed = false;
+    }
+
+    if (early_clone) fstReaderClose(early_clone);
+    fstReaderClose(gz);
+    if (late_clone) {
+        fstReaderIterateHierRewind(late_clone);
+        if (walk_hierarchy(late_clone) != reference) {
+            fprintf(stderr, "  FAIL: clone walk changed after its source was closed\n");
+            passed = false;
+        }
+        fstReaderClose(late_clone);
+    }
+    fstReaderClose(lz);
+    if (shared_clone) {
+        fstReaderIterateHierRewind(shared_clone);
+        if (walk_hierarchy(shared_clone) != reference) {
+            fprintf(stderr, "  FAIL: shared clone walk changed after its source was closed\n");
+            passed = false;
+        }
+        fstReaderClose(shared_clone);
+    }
+
+    if (passed) printf("  PASS: %llu vars in %llu scopes walk identically\n", (unsigned long long)vars, (unsigned long long)scopes);
+    return passed;
+}
+
+// The flat export must list what fstReaderIterateHier() walks, with names
+// untruncated, and leave a walk in progress where it was.
+bool test_flat_hierarchy(const char* filename) {
+    printf("\nTesting flat hierarchy export with file: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    bool passed = true;
+    struct fstHier* first = fstReaderIterateHier(ctx);
+    int first_htyp = first ? first->htyp : -1;
+    struct fstFlatHier* fh = fstReaderGetFlatHier(ctx);
+    if (!fh) {
+        fprintf(stderr, "  FAIL: fstReaderGetFlatHier() returned NULL\n");
+        fstReaderClose(ctx);
+        return false;
+    }
+
+    // resume the walk started above, then compare a full walk entry by entry
+    size_t resumed = 0;
+    while (fstReaderIterateHier(ctx)) resumed++;
+    fstReaderIterateHierRewind(ctx);
+
+    std::vector<uint32_t> stack;
+    uint32_t si = 0, vi = 0;
+    size_t walked = 0;
+    while (struct fstHier* h = fstReaderIterateHier(ctx)) {
+        walked++;
+        if (h->htyp == FST_HT_SCOPE) {
+            uint32_t parent = stack.empty() ? FST_FLAT_HIER_NO_SCOPE : stack.back();
+            const char* name = fh->names + fh->scope_name_offs[si];
+            if (si >= fh->num_scopes || fh->scope_parent[si] != parent || fh->scope_typ[si] != h->u.scope.typ ||
+                strcmp(name, h->u.scope.name) || fh->scope_name_len[si] != h->u.scope.name_length) {
+                fprintf(stderr, "  FAIL: scope %u (%s) differs from the iterated hierarchy\n", si, h->u.scope.name);
+                passed = false;
+                break;
+            }
+            stack.push_back(si++);
+        } else if (h->htyp == FST_HT_UPSCOPE) {
+            if (!stack.empty()) stack.pop_back();
+        } else if (h->htyp == FST_HT_VAR) {
+            uint32_t scope = stack.empty() ? FST_FLAT_HIER_NO_SCOPE : stack.back();
+            const char* name = fh->names + fh->var_name_offs[vi];
+            if (vi >= fh->num_vars || fh->var_scope[vi] != scope || fh->var_typ[vi] != h->u.var.typ ||
+                fh->var_direction[vi] != h->u.var.direction || fh->var_length[vi] != h->u.var.length ||
+                fh->var_handle[vi] != h->u.var.handle || fh->var_is_alias[vi] != h->u.var.is_alias ||
+                strncmp(name, h->u.var.name, h->u.var.name_length) || strlen(name) != fh->var_name_len[vi] ||
+                fh->var_name_len[vi] < h->u.var.name_length) {
+                fprintf(stderr, "  FAIL: var %u (%s) differs from the iterated hierarchy\n", vi, h->u.var.name);
+                passed = false;
+                break;
+            }
+            vi++;
+        }
+    }
+    if (passed && (si != fh->num_scopes || vi != fh->num_vars || vi != fstReaderGetVarCount(ctx))) {
+        fprintf(stderr, "  FAIL: export has %u scopes / %u vars, walk found %u / %u\n", fh->num_scopes, fh->num_vars, si, vi);
+        passed = false;
+    }
+    if (passed && (first_htyp < 0 || resumed + 1 != walked)) {
+        fprintf(stderr, "  FAIL: export moved the hierarchy walk (%zu entries after the first, %zu total)\n", resumed, walked);
+        passed = false;
+    }
+    fstReaderFreeFlatHier(fh);
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: %u scopes and %u vars match the iterated hierarchy\n", si, vi);
+    return passed;
+}
+
+bool test_hier_scope_index(const char* filename) {
+    printf("\nTesting per scope hierarchy decoding with file: %s\n", filename);
+
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+        return false;
+    }
+
+    struct fstFlatHier* fh = fstReaderGetFlatHier(ctx);
+    struct fstHierScopeIndex* si = fstReaderGetHierScopeIndex(ctx);
+    if (!fh || !si) {
+        fprintf(stderr, "  FAIL: could not build the flat hierarchy or the scope index\n");
+        if (fh) fstReaderFreeFlatHier(fh);
+        if (si) fstReaderFreeHierScopeIndex(si);
+        fstReaderClose(ctx);
+        return false;
+    }
+
+    bool passed = (si->num_scopes == fh->num_scopes && si->num_vars == fh->num_vars);
+    for (uint32_t s = 0; passed && s < si->num_scopes; s++) {
+        if (si->scope_parent[s] != fh->scope_parent[s] || si->scope_typ[s] != fh->scope_typ[s] ||
+            strcmp(si->names + si->scope_name_offs[s], fh->names + fh->scope_name_offs[s])) {
+            fprintf(stderr, "  FAIL: indexed scope %u differs from the flat hierarchy\n", s);
+            passed = false;
+        }
+    }
+
+    // every scope, then the vars outside any scope, decoded on their own in reverse order
+    uint32_t decoded = 0;
+    for (int64_t s = (int64_t)si->num_scopes; passed && s >= 0; s--) {
+        uint32_t scope = (s == (int64_t)si->num_scopes) ? FST_FLAT_HIER_NO_SCOPE : (uint32_t)s;
+        struct fstFlatHier* part = fstReaderGetFlatHierScope(ctx, si, scope);
+        uint32_t expected = (scope == FST_FLAT_HIER_NO_SCOPE) ? si->root_num_vars : si->scope_num_vars[scope];
+        if (!part || part->num_scopes != 0 || part->num_vars != expected) {
+            fprintf(stderr, "  FAIL: scope %u decoded to %u vars, expected %u\n", scope, part ? part->num_vars : 0, expected);
+            passed = false;
+        }
+        uint32_t j = 0;
+        for (uint32_t v = 0; passed && v < fh->num_vars; v++) {
+            if (fh->var_scope[v] != scope) continue;
+            if (j >= part->num_vars || part->var_scope[j] != scope || part->var_typ[j] != fh->var_typ[v] ||
+                part->var_direction[j] != fh->var_direction[v] || part->var_length[j] != fh->var_length[v] ||
+                part->var_handle[j] != fh->var_handle[v] || part->var_is_alias[j] != fh->var_is_alias[v] ||
+                strcmp(part->names + part->var_name_offs[j], fh->names + fh->var_name_offs[v])) {
+                fprintf(stderr, "  FAIL: var %u of scope %u differs from the flat hierarchy\n", j, scope);
+                passed = false;
+            }
+            j++;
+        }
+        decoded += j;
+        if (part) fstReaderFreeFlatHier(part);
+    }
+    if (passed && decoded != fh->num_vars) {
+        fprintf(stderr, "  FAIL: scopes decoded to %u vars in total, expected %u\n", decoded, fh->num_vars);
+        passed = false;
+    }
+    if (passed && fstReaderGetFlatHierScope(ctx, si, si->num_scopes)) {
+        fprintf(stderr, "  FAIL: an out of range scope decoded\n");
+        passed = false;
+    }
+
+    fstReaderFreeHierScopeIndex(si);
+    fstReaderFreeFlatHier(fh);
+    fstReaderClose(ctx);
+
+    if (passed) printf("  PASS: %u vars decoded scope by scope match the flat hierarchy\n", decoded);
+    return passed;
+}
+
+// Walks the top-level sections of an unwrapped trace looking for one of the given type.
+static bool has_section(const char* filename, int sectype) {
+    std::string data;
+    if (!read_whole_file(filename, &data)) return false;
+    for (size_t pos = 0; pos + 9 <= data.size();) {
+        uint64_t seclen = 0;
+        for (int i = 1; i <= 8; i++) seclen = (seclen << 8) | (unsigned char)data[pos + i];
+        if ((unsigned char)data[pos] == sectype) return true;
+        if (!seclen) break;
+        pos += 1 + seclen;
+    }
+    return false;
+}
+
+// Traces written with FST_WR_PT_ZSTD (zstd chains, time tables and hierarchy)
+// and FST_WR_PT_ZSTD_DICT (chains against a trained dictionary) must read like
+// the zlib one, from clones and with the block index sidecar.  Built without
+// HAVE_LIBZSTD the writer falls back to zlib and the reads must still match.
+bool test_zstd_pack(const char* zlib_filename, const char* zstd_filename, const char* dict_filename) {
+    printf("\nTesting zstd pack types with files: %s, %s\n", zstd_filename, dict_filename);
+
+    // blocks of 1500 steps over 400 vectors give the dictionary trainer enough chains
+    if (!write_synthetic_trace(zlib_filename, 400, 4000, 1500) ||
+        !write_synthetic_trace(zstd_filename, 400, 4000, 1500, false, FST_WR_PT_ZSTD) ||
+        !write_synthetic_trace(dict_filename, 400, 4000, 1500, false, FST_WR_PT_ZSTD_DICT)) {
+        return false;
+    }
+
+    void* zlib = fstReaderOpen(zlib_filename);
+    if (!zlib) {
+        fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", zlib_filename);
+        return false;
+    }
+    std::string reference = digest_trace(zlib, nullptr);
+    fstReaderClose(zlib);
+    zlib = fstReaderOpen(zlib_filename);
+    std::string reference_hier = walk_hierarchy(zlib);
+    fstReaderClose(zlib);
+
+    bool passed = true;
+#ifdef HAVE_LIBZSTD
+    bool built_in = true;
+#else
+    bool built_in = false;
+#endif
+    if (has_section(zstd_filename, FST_BL_HIER_ZSTD) != built_in || has_section(dict_filename, FST_BL_ZSTD_DICT) != built_in) {
+        fprintf(stderr, "  FAIL: zstd sections %s, expected them %s\n", built_in ? "missing" : "present", built_in ? "present" : "absent");
+        passed = false;
+    }
+
+    const char* files[] = { zstd_filename, dict_filename };
+    for (const char* filename : files) {
+        std::string sidecar = std::string(filename) + ".fstidx";
+        remove(sidecar.c_str());
+
+        passed = test_mmap_matches_stdio(filename, nullptr, &reference) && passed;
+        passed = check_indexed_open(filename, FST_RD_OPEN_BLOCK_INDEX, reference, "first indexed open writes sidecar") && passed;
+        passed = check_indexed_open(filename, FST_RD_OPEN_BLOCK_INDEX, reference, "second indexed open loads sidecar") && passed;
+        remove(sidecar.c_str());
+
+        void* ctx = fstReaderOpen(filename);
+        if (!ctx) {
+            fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+            return false;
+        }
+        if (walk_hierarchy(ctx) != reference_hier) {
+            fprintf(stderr, "  FAIL: %s: hierarchy differs from the zlib trace\n", filename);
+            passed = false;
+        }
+        void* clone = fstReaderClone(ctx);
+        fstReaderClose(ctx);
+        if (!clone || digest_trace(clone, nullptr) != reference) {
+            fprintf(stderr, "  FAIL: %s: clone reads differ from the zlib trace\n", filename);
+            passed = false;
+        }
+        if (clone) fstReaderClose(clone);
+    }
+
+    if (passed) printf("  PASS: zstd traces read like the zlib trace (zstd %s)\n", built_in ? "built in" : "not built in, zlib written");
+    return passed;
+}
+
+// The SSE2 and AVX2 bulk varint decoders must agree with the scalar one on
+// every varint width, on runs that straddle vectors and on truncated input,
+// and the time tables and chain indexes they decode must read the same trace.
+bool test_varint_decoders(const char* filename, const std::string& reference) {
+    printf("\nTesting bulk varint decoders with file: %s\n", filename);
+
+    std::vector<uint64_t> values;
+    for (int i = 0; i < 300; i++) values.push_back(i % 100);                   // single byte runs
+    for (int i = 0; i < 300; i++) values.push_back(100 + i * 37);              // mostly two bytes
+    for (int i = 0; i < 64; i++) values.push_back((uint64_t)1 << i);            // every width up to ten bytes
+    for (int i = 0; i < 500; i++) values.push_back((i % 5) ? (uint64_t)(i & 0x7f) : ((uint64_t)0x9e3779b97f4a7c15ULL >> (i % 64)));
+    values.push_back(UINT64_MAX);
+
+    std::vector<unsigned char> encoded;
+    for (uint64_t v : values) {
+        while (v >> 7) {
+            encoded.push_back((unsigned char)(v | 0x80));
+            v >>= 7;
+        }
+        encoded.push_back((unsigned char)v);
+    }
+
+    bool passed = true;
+    const int decoders[] = { FST_VARINT_SCALAR, FST_VARINT_SSE2, FST_VARINT_AVX2 };
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    for (int d = 0; d < 3; d++) {
+        int used = fstUtilitySetVarintDecoder(decoders[d]);
+        if (used != decoders[d]) {
+            printf("  SKIP: %s decoder not available on this CPU (%d used)\n", names[d], used);
+            continue;
+        }
+
+        std::vector<uint64_t> out(values.size() + 8, 0);
+        size_t nout = 0;
+        size_t used_bytes = fstUtilityDecodeVarints(encoded.data(), encoded.size(), out.data(), out.size(), &nout);
+        bool ok = (nout == values.size()) && (used_bytes == encoded.size()) &&
+                  std::equal(values.begin(), values.end(), out.begin());
+
+        // stopping at max_out must leave the position on the next varint
+        std::fill(out.begin(), out.end(), 0);
+        size_t half = 0;
+        size_t half_bytes = fstUtilityDecodeVarints(encoded.data(), encoded.size(), out.data(), 777, &half);
+        size_t rest = 0;
+        fstUtilityDecodeVarints(encoded.data() + half_bytes, encoded.size() - half_bytes, out.data() + half, out.size() - half, &rest);
+        ok = ok && (half == 777) && (half + rest == values.size()) && std::equal(values.begin(), values.end(), out.begin());
+
+        // a varint cut short by len ends the run
+        unsigned char cut[3] = { 0x81, 0x82, 0x83 };
+        ok = ok && (fstUtilityDecodeVarints(cut, sizeof(cut), out.data(), 4, &nout) == sizeof(cut)) && (nout == 1);
+
+        if (!ok) {
+            fprintf(stderr, "  FAIL: %s decoder: varints differ from the encoded values\n", names[d]);
+            passed = false;
+            continue;
+        }
+
+        void* ctx = fstReaderOpen(filename);
+        if (!ctx) {
+            fprintf(stderr, "  FAIL: Failed to open FST file: %s\n", filename);
+            fstUtilitySetVarintDecoder(FST_VARINT_AUTO);
+            return false;
+        }
+        std::string digest = digest_trace(ctx, nullptr);
+        fstReaderClose(ctx);
+        if (digest != reference) {
+            fprintf(stderr, "  FAIL: %s decoder: trace reads differ\n", names[d]);
+            passed = false;
+        } else {
+            printf("  PASS: %s decoder\n", names[d]);
+        }
+    }
+
+    fstUtilitySetVarintDecoder(FST_VARINT_AUTO);
+    return passed;
+}
+
+// Chains compressed on a pool of flush threads are written out in handle
+// order, so the file must be byte for byte the one a serial flush writes.
+bool test_parallel_flush(const char* serial_filename, const char* threaded_filename) {
+    printf("\nTesting parallel chain compression with files: %s, %s\n", serial_filename, threaded_filename);
+
+    struct PackType {
+        enum fstWriterPackType pack;
+        const char* label;
+    };
+    const PackType packs[] = {
+        { FST_WR_PT_ZLIB, "zlib" },
+        { FST_WR_PT_FASTLZ, "fastlz" },
+        { FST_WR_PT_LZ4, "lz4" },
+        { FST_WR_PT_ZSTD, "zstd" },
+        { FST_WR_PT_ZSTD_DICT, "zstd+dict" },
+    };
+
+    void* probe = fstWriterCreate(threaded_filename, 1);
+    if (!probe) {
+        fprintf(stderr, "  FAIL: Failed to create FST file: %s\n", threaded_filename);
+        return false;
+    }
+    fstWriterSetFlushThreads(probe, 3);
+    int effective = fstWriterGetFlushThreads(probe);
+    fstWriterClose(probe);
+
+    bool passed = true;
+    for (const PackType& p : packs) {
+        std::string serial, threaded;
+        if (!write_synthetic_trace(serial_filename, 400, 4000, 1500, false, p.pack) ||
+            !write_synthetic_trace(threaded_filename, 400, 4000, 1500, false, p.pack, 3) ||
+            !read_whole_file(serial_filename, &serial) || !read_whole_file(threaded_filename, &threaded)) {
+            fprintf(stderr, "  FAIL: %s: could not write the traces\n", p.label);
+            passed = false;
+            continue;
+        }
+
+        if (serial != threaded) {
+            fprintf(stderr, "  FAIL: %s: %d flush threads wrote a different file (%zu vs %zu bytes)\n", p.label, effective,
+                    threaded.size(), serial.size());
+            passed = false;
+        } else {
+            printf("  PASS: %s: %d flush threads wrote the serial file (%zu bytes)\n", p.label, effective, serial.size());
+        }
+    }
+
+    return passed;
+}
+
+// Value changes and block count of a trace, for traces that only differ in
+// their header.
+static std::string digest_changes(const char* filename, uint64_t* blocks) {
+    void* ctx = fstReaderOpen(filename);
+    if (!ctx) return std::string();
+
+    DigestContext dctx;
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocks2(ctx, digest_callback, digest_callback_varlen, &dctx, nullptr);
+    *blocks = fstReaderGetValueChangeSectionCount(ctx);
+    fstReaderClose(ctx);
+    return dctx.digest;
+}
+
+// Parallel mode flushes several blocks at once but commits them in order, so
+// it must write the serial file too.  When the dump size limit cuts the trace
+// off while later blocks are in flight those are dropped; only the header end
+// time then differs, as the simulation ran on until the limit was noticed.
+bool test_flush_pipeline(const char* serial_filename, const char* pipelined_filename) {
+    printf("\nTesting the parallel mode flush pipeline with files: %s, %s\n", serial_filename, pipelined_filename);
+
+    struct Case {
+        enum fstWriterPackType pack;
+        int flush_threads;
+        uint64_t dump_size_limit;
+        const char* label;
+    };
+    const Case cases[] = {
+        { FST_WR_PT_ZLIB, 0, 0, "zlib" },
+        { FST_WR_PT_LZ4, 0, 0, "lz4" },
+        { FST_WR_PT_ZSTD_DICT, 0, 0, "zstd+dict" },
+        { FST_WR_PT_ZLIB, 3, 0, "zlib, 3 flush threads" },
+        { FST_WR_PT_ZLIB, 0, 40000, "zlib, 40000 byte size limit" },
+    };
+
+    void* probe = fstWriterCreate(pipelined_filename, 1);
+    if (!probe) {
+        fprintf(stderr, "  FAIL: Failed to create FST file: %s\n", pipelined_filename);
+        return false;
+    }
+    fstWriterSetParallelDepth(probe, 3);
+    int depth = fstWriterGetParallelDepth(probe);
+    fstWriterClose(probe);
+    if (!depth) {
+        printf("  SKIP: parallel mode not built in\n");
+        return true;
+    }
+
+    bool passed = true;
+    for (const Case& c : cases) {
+        std::string serial, pipelined;
+        if (!write_synthetic_trace(serial_filename, 400, 4000, 250, false, c.pack, c.flush_threads, 0, c.dump_size_limit) ||
+            !write_synthetic_trace(pipelined_filename, 400, 4000, 250, false, c.pack, c.flush_threads, depth,
+                                   c.dump_size_limit) ||
+            !read_whole_file(serial_filename, &serial) || !read_whole_file(pipelined_filename, &pipelined)) {
+            fprintf(stderr, "  FAIL: %s: could not write the traces\n", c.label);
+            passed = false;
+            continue;
+        }
+
+        uint64_t serial_blocks = 0, pipelined_blocks = 0;
+        std::string serial_changes = digest_changes(serial_filename, &serial_blocks);
+        std::string pipelined_changes = digest_changes(pipelined_filename, &pipelined_blocks);
+        bool same = c.dump_size_limit ? (serial_changes == pipelined_changes && serial_blocks == pipelined_blocks &&
+                                         serial.size() == pipelined.size())
+                                      : (serial == pipelined);
+        if (!same || serial_changes.empty()) {
+            fprintf(stderr, "  FAIL: %s: %d blocks in flight wrote a different file (%zu vs %zu bytes, %llu vs %llu blocks)\n",
+                    c.label, depth, pipelined.size(), serial.size(), (unsigned long long)pipelined_blocks,
+                    (unsigned long long)serial_blocks);
+            passed = false;
+        } else {
+            printf("  PASS: %s: %d blocks in flight wrote the serial %s (%llu blocks, %zu bytes)\n", c.label, depth,
+                   c.dump_size_limit ? "blocks" : "file", (unsigned long long)serial_blocks, serial.size());
+        }
+    }
+
+    return passed;
+}
+
+// Writes a trace of bit vectors from 1 to 130 bits wide plus a real, either
+// with one fstWriterEmitValueChange() per change or batched per time step,
+// packed or not.  Values emitted before the first time change go through the
+// batch fallback path.
+static bool write_batch_trace(const char* filename, int mode,
+                              enum fstWriterBufferLayout layout = FST_WR_BL_CHAINED) {
+    void* wctx = fstWriterCreate(filename, 1);
+    if (!wctx) {
+        fprintf(stderr, "ERROR: Failed to create FST file: %s\n", filename);
+        return false;
+    }
+    fstWriterSetBufferLayout(wctx, layout);
+    fstWriterSetDate(wctx, "synthetic");
+
+    const uint32_t widths[] = { 1, 7, 8, 32, 63, 64, 65, 100, 128, 130 };
+    const int num_widths = sizeof(widths) / sizeof(widths[0]);
+    fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+    std::vector<fstHandle> handles;
+    std::vector<uint32_t> handle_widths;
+    for (int i = 0; i < 300; i++) {
+        uint32_t width = widths[i % num_widths];
+        std::string name = "v" + std::to_string(i);
+        handles.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, width, name.c_str(), 0));
+        handle_widths.push_back(width);
+    }
+    fstHandle real = fstWriterCreateVar(wctx, FST_VT_VCD_REAL, FST_VD_IMPLICIT, 64, "level", 0);
+    fstWriterSetUpscope(wctx);
+
+    uint64_t seed = 0x243f6a8885a308d3ULL;
+    for (int t = -1; t < 600; t++) {
+        if (t >= 0) fstWriterEmitTimeChange(wctx, (uint64_t)t * 5);
+
+        std::vector<fstHandle> batch;
+        std::vector<std::string> chars;
+        std::vector<uint64_t> words;
+        for (size_t i = 0; i < handles.size(); i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            if (t >= 0 && (seed & 3)) continue;
+
+            uint32_t width = handle_widths[i];
+            std::string bits(width, '0');
+            for (uint32_t w = 0; w < (width + 63) / 64; w++) {
+                uint64_t word = seed * (w + 1) + t;
+                if (width - w * 64 < 64) word &= (1ULL << (width - w * 64)) - 1;
+                words.push_back(word);
+                for (uint32_t b = 0; b < 64 && w * 64 + b < width; b++) {
+                    bits[width - 1 - (w * 64 + b)] = (char)('0' + ((word >> b) & 1));
+                }
+            }
+            batch.push_back(handles[i]);
+            chars.push_back(bits);
+        }
+
+        if (mode == 0) {
+            for (size_t i = 0; i < batch.size(); i++) fstWriterEmitValueChange(wctx, batch[i], chars[i].c_str());
+        } else if (mode == 1) {
+            std::vector<const void*> vals;
+            for (const std::string& c : chars) vals.push_back(c.c_str());
+            fstWriterEmitValueChangeBatch(wctx, (uint32_t)batch.size(), batch.data(), vals.data());
+        } else {
+            fstWriterEmitValueChangeBatchPacked(wctx, (uint32_t)batch.size(), batch.data(), words.data());
+        }
+
+        double d = t * 0.25;
+        const void* real_val = &d;
+        if (mode == 0) {
+            fstWriterEmitValueChange(wctx, real, &d);
+        } else {
+            fstWriterEmitValueChangeBatch(wctx, 1, &real, &real_val);
+        }
+        if (t && (t % 200) == 0) fstWriterFlushContext(wctx);
+    }
+    fstWriterEmitTimeChange(wctx, 3000);
+    fstWriterClose(wctx);
+    return true;
+}
+
+// Batched emits append the same change records as single ones, so all three
+// ways of emitting must write the same file.
+bool test_emit_batch(const char* single_filename, const char* batch_filename) {
+    printf("\nTesting batched value change emits with files: %s, %s\n", single_filename, batch_filename);
+
+    std::string single;
+    if (!write_batch_trace(single_filename, 0) || !read_whole_file(single_filename, &single)) {
+        fprintf(stderr, "  FAIL: could not write %s\n", single_filename);
+        return false;
+    }
+
+    bool passed = true;
+    const char* labels[] = { nullptr, "batch", "packed batch" };
+    for (int mode = 1; mode <= 2; mode++) {
+        std::string batched;
+        if (!write_batch_trace(batch_filename, mode) || !read_whole_file(batch_filename, &batched)) {
+            fprintf(stderr, "  FAIL: %s: could not write %s\n", labels[mode], batch_filename);
+            passed = false;
+        } else if (batched != single) {
+            fprintf(stderr, "  FAIL: %s emits wrote a different file (%zu vs %zu bytes)\n", labels[mode], batched.size(),
+                    single.size());
+            passed = false;
+        } else {
+            printf("  PASS: %s emits wrote the single emit file (%zu bytes)\n", labels[mode], single.size());
+        }
+    }
+
+    return passed;
+}
+
+// Writes bit vectors from 2 to 130 bits wide with two-state, four-state and
+// nine-state values.  Mode 0 emits characters only; mode 1 emits the
+// two-state values as integers through the 32 and 64 bit calls instead, and
+// mode 2 emits characters with the flushes handed to flush threads and the
+// parallel mode pipeline.  The changes emitted after the initial values are
+// recorded in expected.
+static bool write_packed_trace(const char* filename, int mode, std::map<std::pair<uint64_t, fstHandle>, std::string>* expected,
+                               enum fstWriterBufferLayout layout = FST_WR_BL_CHAINED) {
+    void* wctx = fstWriterCreate(filename, 1);
+    if (!wctx) {
+        fprintf(stderr, "ERROR: Failed to create FST file: %s\n", filename);
+        return false;
+    }
+    fstWriterSetBufferLayout(wctx, layout);
+    fstWriterSetDate(wctx, "synthetic");
+    if (mode == 2) {
+        fstWriterSetFlushThreads(wctx, 2);
+        fstWriterSetParallelMode(wctx, 1);
+    }
+
+    const uint32_t widths[] = { 2, 3, 8, 9, 31, 32, 33, 63, 64, 65, 100, 128, 130 };
+    const int num_widths = sizeof(widths) / sizeof(widths[0]);
+    fstWriterSetScope(wctx, FST_ST_VCD_MODULE, "top", NULL);
+    std::vector<fstHandle> handles;
+    std::vector<uint32_t> handle_widths;
+    for (int i = 0; i < 260; i++) {
+        uint32_t width = widths[i % num_widths];
+        std::string name = "v" + std::to_string(i);
+        handles.push_back(fstWriterCreateVar(wctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, width, name.c_str(), 0));
+        handle_widths.push_back(width);
+    }
+    fstWriterSetUpscope(wctx);
+
+    uint64_t seed = 0x13198a2e03707344ULL;
+    for (int t = -1; t < 500; t++) {
+        if (t >= 0) fstWriterEmitTimeChange(wctx, (uint64_t)t * 3);
+
+        for (size_t i = 0; i < handles.size(); i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            if (t >= 0 && (seed & 3)) continue;
+
+            uint32_t width = handle_widths[i];
+            std::vector<uint64_t> words((width + 63) / 64);
+            std::string bits(width, '0');
+            for (uint32_t w = 0; w < words.size(); w++) {
+                words[w] = seed * (w + 3) + t;
+                if (width - w * 64 < 64) words[w] &= (1ULL << (width - w * 64)) - 1;
+                for (uint32_t b = 0; b < 64 && w * 64 + b < width; b++) {
+                    bits[width - 1 - (w * 64 + b)] = (char)('0' + ((words[w] >> b) & 1));
+                }
+            }
+
+            int kind = (seed >> 8) % 8; // mostly two-state, then x/z, then other characters
+            if (kind == 5 || kind == 6) {
+                for (uint32_t b = (seed >> 16) % width; b < width; b += 1 + (uint32_t)((seed >> 24) % 5)) {
+                    bits[b] = (b & 1) ? 'z' : 'x';
+                }
+            } else if (kind == 7) {
+                bits[(seed >> 16) % width] = "XZuwlh-"[(seed >> 32) % 7];
+            }
+
+            if (mode == 1 && kind < 5) {
+                uint32_t words32[6];
+                for (uint32_t w = 0; w < words.size() * 2; w++) words32[w] = (uint32_t)(words[w / 2] >> ((w & 1) * 32));
+                if (width <= 32 && (i & 1)) {
+                    fstWriterEmitValueChange32(wctx, handles[i], width, (uint32_t)words[0]);
+                } else if (width <= 64 && (i & 1)) {
+                    fstWriterEmitValueChange64(wctx, handles[i], width, words[0]);
+                } else if (i & 2) {
+                    fstWriterEmitValueChangeVec32(wctx, handles[i], width, words32);
+                } else {
+                    fstWriterEmitValueChangeVec64(wctx, handles[i], width, words.data());
+                }
+            } else {
+                fstWriterEmitValueChange(wctx, handles[i], bits.c_str());
+            }
+            if (expected && t >= 0) (*expected)[std::make_pair((uint64_t)t * 3, handles[i])] = bits;
+        }
+        if (t && (t % 150) == 0) fstWriterFlushContext(wctx);
+    }
+    fstWriterEmitTimeChange(wctx, 1500);
+    fstWriterClose(wctx);
+    return true;
+}
+
+static void packed_callback(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value) {
+    auto* changes = static_cast<std::map<std::pair<uint64_t, fstHandle>, std::string>*>(user_data);
+    (*changes)[std::make_pair(time, facidx)] = reinterpret_cast<const char*>(value);
+}
+
+static void packed_callback_varlen(void* user_data, uint64_t time, fstHandle facidx, const unsigned char* value, uint32_t len) {
+    auto* changes = static_cast<std::map<std::pair<uint64_t, fstHandle>, std::string>*>(user_data);
+    (*changes)[std::make_pair(time, facidx)] = std::string(reinterpret_cast<const char*>(value), len);
+}
+
+// The writer buffers two-state values packed and four-state values as value
+// and xz planes, but has to write the same file whatever form they came in,
+// and the reader has to get back the characters emitted.
+bool test_packed_values(const char* chars_filename, const char* packed_filename) {
+    printf("\nTesting packed value buffering with files: %s, %s\n", chars_filename, packed_filename);
+
+    std::map<std::pair<uint64_t, fstHandle>, std::string> expected;
+    std::string chars;
+    if (!write_packed_trace(chars_filename, 0, &expected) || !read_whole_file(chars_filename, &chars)) {
+        fprintf(stderr, "  FAIL: could not write %s\n", chars_filename);
+        return false;
+    }
+
+    bool passed = true;
+    std::map<std::pair<uint64_t, fstHandle>, std::string> changes;
+    void* ctx = fstReaderOpen(chars_filename);
+    if (!ctx) {
+        fprintf(stderr, "  FAIL: could not open %s\n", chars_filename);
+        return false;
+    }
+    fstReaderSetFacProcessMaskAll(ctx);
+    fstReaderIterBlocks2(ctx, packed_callback, packed_callback_varlen, &changes, nullptr);
+    fstReaderClose(ctx);
+    if (changes != expected) {
+        size_t mismatched = 0;
+        for (const auto& e : expected) {
+            auto it = changes.find(e.first);
+            if (it == changes.end() || it->second != e.second) mismatched++;
+        }
+        fprintf(stderr, "  FAIL: read back %zu changes, %zu of the %zu emitted differ\n", changes.size(), mismatched,
+                expected.size());
+        passed = false;
+    } else {
+        printf("  PASS: read back the %zu changes emitted\n", expected.size());
+    }
+
+    const char* labels[] = { nullptr, "integer emits", "flush threads and pipeline" };
+    for (int mode = 1; mode <= 2; mode++) {
+        std::string other;
+        if (!write_packed_trace(packed_filename, mode, nullptr) || !read_whole_file(packed_filename, &other)) {
+            fprintf(stderr, "  FAIL: %s: could not write %s\n", labels[mode], packed_filename);
+            passed = false;
+        } else if (other != chars) {
+            fprintf(stderr, "  FAIL: %s wrote a different file (%zu vs %zu bytes)\n", labels[mode], other.size(),
+                    chars.size());
+            passed = false;
+        } else {
+            printf("  PASS: %s wrote the character emit file (%zu bytes)\n", labels[mode], chars.size());
+        }
+    }
+
+    return passed;
+}
+
+// The segmented buffer layout only changes how the writer holds the changes
+// until a flush, so every trace has to come out byte for byte as the chained
+// layout writes it: long chains over several segments, flush threads, the
+// parallel mode pipeline, and batched, packed and integer emits.
+bool test_buffer_layout(const char* chained_filename, const char* segmented_filename) {
+    printf("\nTesting the segmented change buffer layout with files: %s, %s\n", chained_filename, segmented_filename);
+
+    bool passed = true;
+    void* probe = fstWriterCreate(segmented_filename, 1);
+    if (!probe) {
+        fprintf(stderr, "  FAIL: Failed to create FST file: %s\n", segmented_filename);
+        return false;
+    }
+    fstWriterSetBufferLayout(probe, FST_WR_BL_SEGMENTED);
+    fstHandle bit = fstWriterCreateVar(probe, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 1, "bit", 0);
+    fstWriterEmitTimeChange(probe, 0);
+    fstWriterEmitValueChange(probe, bit, "1");
+    fstWriterSetBufferLayout(probe, FST_WR_BL_CHAINED); // too late, ignored
+    if (fstWriterGetBufferLayout(probe) != FST_WR_BL_SEGMENTED) {
+        fprintf(stderr, "  FAIL: the layout changed after the first time change\n");
+        passed = false;
+    }
+    fstWriterClose(probe);
+
+    struct Case {
+        int trace; // 0 synthetic, 1 batch, 2 packed
+        int mode;
+        int num_steps, flush_every, flush_threads, parallel_depth;
+        const char* label;
+    };
+    const Case cases[] = {
+        { 0, 0, 4000, 250, 0, 0, "synthetic" },
+        { 0, 0, 20000, 0, 0, 0, "synthetic, one block" },
+        { 0, 0, 4000, 250, 3, 0, "synthetic, 3 flush threads" },
+        { 0, 0, 4000, 250, 3, 2, "synthetic, 3 flush threads and pipeline" },
+        { 1, 0, 0, 0, 0, 0, "single emits" },
+        { 1, 1, 0, 0, 0, 0, "batch emits" },
+        { 1, 2, 0, 0, 0, 0, "packed batch emits" },
+        { 2, 0, 0, 0, 0, 0, "character emits" },
+        { 2, 1, 0, 0, 0, 0, "integer emits" },
+        { 2, 2, 0, 0, 0, 0, "character emits, flush threads and pipeline" },
+    };
+
+    for (const Case& c : cases) {
+        std::string chained, segmented;
+        bool written = true;
+        for (int l = 0; l < 2 && written; l++) {
+            enum fstWriterBufferLayout layout = l ? FST_WR_BL_SEGMENTED : FST_WR_BL_CHAINED;
+            const char* filename = l ? segmented_filename : chained_filename;
+            if (c.trace == 0) {
+                written = write_synthetic_trace(filename, 16, c.num_steps, c.flush_every, false, FST_WR_PT_ZLIB,
+                                                c.flush_threads, c.parallel_depth, 0, layout);
+            } else if (c.trace == 1) {
+                written = write_batch_trace(filename, c.mode, layout);
+            } else {
+                written = write_packed_trace(filename, c.mode, nullptr, layout);
+            }
+            written = written && read_whole_file(filename, l ? &segmented : &chained);
+        }
+
+        if (!written) {
+            fprintf(stderr, "  FAIL: %s: could not write the traces\n", c.label);
+            passed = false;
+        } else if (segmented != chained) {
+            fprintf(stderr, "  FAIL: %s: the segmented layout wrote a different file (%zu vs %zu bytes)\n", c.label,
+                    segmented.size(), chained.size());
+            passed = false;
+        } else {
+            printf("  PASS: %s: the segmented layout wrote the chained file (%zu bytes)\n", c.label, chained.size());
+        }
+    }
+
+    return passed;
+}
+
+// Traces the tests generate go here, never into the source tree
+#ifndef FST_TEST_OUTPUT_DIR
+#define FST_TEST_OUTPUT_DIR "test_output"
+#endif
+
+static std::string output_path(const char* name) {
+    return std::string(FST_TEST_OUTPUT_DIR "/") + name;
+}
+
 int main(int argc, char* argv[]) {
     const char* test_file = "test/vcd_extensions.fst";
     
@@ -228,6 +2080,71 @@ int main(int argc, char* argv[]) {
     printf("Some features like hierarchy iteration might not work correctly.\n\n");
     
     bool result = test_fst_reader(test_file);
+
+#ifdef _WIN32
+    _mkdir(FST_TEST_OUTPUT_DIR);
+#else
+    mkdir(FST_TEST_OUTPUT_DIR, 0755);
+#endif
+    const std::string synthetic_path = output_path("synthetic_blocks.fst");
+    const std::string wrapped_path = output_path("synthetic_blocks_wrapped.fst");
+    const char* synthetic_file = synthetic_path.c_str();
+    const char* wrapped_file = wrapped_path.c_str();
+    if (write_synthetic_trace(synthetic_file, 16, 2000, 150) &&
+        write_synthetic_trace(wrapped_file, 16, 2000, 150, true)) {
+        std::string plain;
+        result = test_mmap_matches_stdio(test_file) && result;
+        result = test_mmap_matches_stdio(synthetic_file, &plain) && result;
+        result = test_mmap_matches_stdio(wrapped_file, nullptr, &plain) && result;
+        result = test_block_index(synthetic_file, plain) && result;
+        result = test_rvat_cold_lookups(synthetic_file, 150 * 10) && result;
+        result = test_rvat_random_access(synthetic_file) && result;
+        result = test_rvat_random_access(wrapped_file) && result;
+        result = test_batch_values_at_time(synthetic_file) && result;
+        result = test_batch_values_at_time(wrapped_file, 4) && result;
+        result = test_batch_values_at_time(test_file) && result;
+        result = test_limit_time_range(synthetic_file) && result;
+        result = test_parallel_iteration(synthetic_file, plain) && result;
+        result = test_parallel_iteration(wrapped_file, plain) && result;
+        result = test_limit_time_range(synthetic_file, 4) && result;
+        result = test_clone_readers(synthetic_file, wrapped_file, plain) && result;
+        result = test_column_iteration(synthetic_file) && result;
+        result = test_column_iteration(wrapped_file) && result;
+        result = test_time_table(synthetic_file) && result;
+        result = test_time_table(wrapped_file) && result;
+        result = test_time_table(test_file) && result;
+        result = test_block_cache(synthetic_file, plain) && result;
+        result = test_block_cache(wrapped_file, plain) && result;
+        const std::string hier_gzip_path = output_path("hier_gzip.fst");
+        const std::string hier_lz4_path = output_path("hier_lz4.fst");
+        const char* hier_gzip_file = hier_gzip_path.c_str();
+        const char* hier_lz4_file = hier_lz4_path.c_str();
+        result = test_hierarchy_in_memory(hier_gzip_file, hier_lz4_file) && result;
+        result = test_flat_hierarchy(hier_gzip_file) && result;
+        result = test_flat_hierarchy(hier_lz4_file) && result;
+        result = test_flat_hierarchy(test_file) && result;
+        result = test_hier_scope_index(hier_gzip_file) && result;
+        result = test_hier_scope_index(hier_lz4_file) && result;
+        result = test_hier_scope_index(test_file) && result;
+        result = test_gzip_index(synthetic_file, wrapped_file) && result;
+        const std::string wide_path = output_path("wide.fst");
+        const std::string wide_wrapped_path = output_path("wide_wrapped.fst");
+        if (write_wide_trace(wide_path.c_str(), 500, 1000, false) &&
+            write_wide_trace(wide_wrapped_path.c_str(), 500, 1000, true)) {
+            result = test_gzip_index(wide_path.c_str(), wide_wrapped_path.c_str()) && result;
+        } else {
+            result = false;
+        }
+        result = test_zstd_pack(output_path("pack_zlib.fst").c_str(), output_path("pack_zstd.fst").c_str(), output_path("pack_zstd_dict.fst").c_str()) && result;
+        result = test_varint_decoders(synthetic_file, plain) && result;
+        result = test_parallel_flush(output_path("flush_serial.fst").c_str(), output_path("flush_threads.fst").c_str()) && result;
+        result = test_flush_pipeline(output_path("flush_serial.fst").c_str(), output_path("flush_pipeline.fst").c_str()) && result;
+        result = test_emit_batch(output_path("emit_single.fst").c_str(), output_path("emit_batch.fst").c_str()) && result;
+        result = test_packed_values(output_path("packed_chars.fst").c_str(), output_path("packed_ints.fst").c_str()) && result;
+        result = test_buffer_layout(output_path("layout_chained.fst").c_str(), output_path("layout_segmented.fst").c_str()) && result;
+    } else {
+        result = false;
+    }
     
     return result ? 0 : 1;
 }
\ No newline at end of file
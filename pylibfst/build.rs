@@ -73,13 +73,24 @@ fn main() {
             .define("STDC_HEADERS", "1")
             .define("_LARGEFILE_SOURCE", "1")
             .define("_FILE_OFFSET_BITS", "64")
+            // Parallel block decode in fstReaderIterBlocks2 (pthreads come with std)
+            .define("HAVE_LIBPTHREAD", "1")
+            .define("FST_READER_PARALLEL", "1")
             .flag_if_supported("-Wno-unused-parameter")
             .flag_if_supported("-Wno-unused-variable")
             .flag_if_supported("-Wno-unused-function")
             .flag_if_supported("-Wno-sign-compare")
             .flag_if_supported("-Wno-implicit-function-declaration");
+
+        // zstd pack type, only when libzstd is installed (probing also emits its link flags)
+        if let Ok(zstd) = pkg_config::probe_library("libzstd") {
+            build.define("HAVE_LIBZSTD", "1");
+            for path in &zstd.include_paths {
+                build.include(path);
+            }
+        }
     }
-    
+
     build.compile("fst");
     
     // Link against zlib for compression support
@@ -18,6 +18,7 @@ try:
         ScopeIter,
         SignalChangeIter,
         QueryResult,
+        CacheStats,
     )
 except ImportError:
     # Fallback for development
@@ -36,6 +37,7 @@ except ImportError:
     ScopeIter = _mod.ScopeIter
     SignalChangeIter = _mod.SignalChangeIter
     QueryResult = _mod.QueryResult
+    CacheStats = _mod.CacheStats
 
 __all__ = [
     "Waveform",
@@ -51,6 +53,7 @@ __all__ = [
     "ScopeIter",
     "SignalChangeIter",
     "QueryResult",
+    "CacheStats",
 ]
 
 __version__ = "0.1.0"
@@ -71,4 +74,5 @@ if False:  # TYPE_CHECKING
         ScopeIter as ScopeIter,
         SignalChangeIter as SignalChangeIter,
         QueryResult as QueryResult,
+        CacheStats as CacheStats,
     )
\ No newline at end of file
@@ -1,5 +1,6 @@
 """Type stubs for pylibfst - FST waveform reader with pywellen-compatible API"""
 
+import array
 from typing import Optional, Tuple, Union, List, Literal, Iterator
 
 class VarIndex:
@@ -15,6 +16,16 @@ class Hierarchy:
     def version(self) -> str: ...
     def timescale(self) -> Optional[Timescale]: ...
     def file_format(self) -> Literal["FST", "VCD", "GHW", "Unknown"]: ...
+    def var_by_path(self, abs_hierarchy_path: str) -> Optional[Var]: ...
+    def is_complete(self) -> bool:
+        """True once every scope's vars are decoded, always when not opened lazily"""
+        ...
+    def complete(self) -> None:
+        """Decode every scope's vars now, waiting for any already being decoded"""
+        ...
+    def complete_in_background(self) -> None:
+        """Decode every scope's vars on a native thread, returning at once"""
+        ...
 
 class Scope:
     """Represents a scope (module, task, function, etc.) in the hierarchy"""
@@ -63,7 +74,7 @@ class VarIter:
     def __next__(self) -> Var: ...
 
 class TimeTable:
-    """Time table for compressed time representation"""
+    """Every distinct time in the file, ascending; signals store indices into it"""
     def __getitem__(self, idx: int) -> int: ...
     def __len__(self) -> int: ...
 
@@ -71,6 +82,7 @@ class Waveform:
     """Main waveform reader for FST files"""
     hierarchy: Hierarchy
     time_range: Optional[Tuple[int, int]]  # (start_time, end_time) - FST time boundaries
+    time_table: Optional[TimeTable]  # All distinct times, None until the body is loaded
 
     def __init__(
         self,
@@ -78,6 +90,8 @@ class Waveform:
         multi_threaded: bool = True,
         remove_scopes_with_empty_name: bool = False,
         load_body: bool = True,
+        signal_cache_bytes: Optional[int] = None,
+        lazy_hierarchy: bool = False,
     ) -> None: 
         """
         Create a new Waveform reader for an FST file.
@@ -87,10 +101,18 @@ class Waveform:
             multi_threaded: Whether to use multi-threading for signal loading
             remove_scopes_with_empty_name: Whether to filter out unnamed scopes
             load_body: Whether to immediately load the waveform body (time range and signals)
+            signal_cache_bytes: Byte budget for cached signals, None for no limit
+            lazy_hierarchy: Read only the scopes up front and decode each scope's vars
+                the first time they are asked for
         
         Note:
-            libfst doesn't support efficient full time table access. This implementation
-            provides time_range (start, end) and a compatibility time_table with just those values.
+            The time section of every value change block is read to build time_table
+            on the first signal load or time_table access, not when the body is loaded;
+            signals store u32 indices into it rather than full times, so a file with
+            more than 2**32 - 1 distinct times raises RuntimeError there.
+            
+            With lazy_hierarchy, all_vars() lists vars scope by scope instead of in file
+            order.
         """
         ...
     
@@ -150,6 +172,24 @@ class Waveform:
         """
         ...
     
+    def values_at_time(self, vars: List[Var], time: int) -> List[Union[int, str, float, None]]: 
+        """
+        Get the values of many variables at one time without loading their signals.
+        
+        The block holding the time is decoded once for all of them, which suits a
+        cursor readout over many signals better than loading each one.
+        
+        Args:
+            vars: Variables to read
+            time: Simulation time to query
+            
+        Returns:
+            Values in the same order as vars, as Signal.value_at_time returns them,
+            except that before a signal's first change this gives its initial value
+            from the file (often 'x') rather than None
+        """
+        ...
+    
     def unload_signals(self, signals: List[Signal]) -> None: 
         """
         Unload signals from cache to free memory.
@@ -158,6 +198,32 @@ class Waveform:
             signals: List of signals to unload
         """
         ...
+    
+    def clear_signal_cache(self) -> None: 
+        """
+        Drop every signal from the signal cache, including ones still referenced
+        from Python. They are not counted as evictions.
+        """
+        ...
+    
+    def is_signal_cached(self, var: Var) -> bool: 
+        """Whether the signal of var is in the signal cache; counts no hit or miss"""
+        ...
+    
+    def set_signal_cache_budget(self, budget_bytes: Optional[int] = None) -> None: 
+        """
+        Change the signal cache byte budget, evicting least recently used signals
+        at once if the cache is over it. Signals still referenced from Python are
+        never evicted.
+        
+        Args:
+            budget_bytes: Byte budget for cached signals, None for no limit
+        """
+        ...
+    
+    def signal_cache_stats(self) -> CacheStats: 
+        """Hit, miss and eviction counters plus current size of the signal cache"""
+        ...
 
 class Signal:
     """Represents signal data with all value transitions"""
@@ -186,6 +252,22 @@ class Signal:
         """
         ...
     
+    def sample_at_times(self, times: List[int], signed: bool = False) -> array.array: 
+        """
+        Sample the signal at many times in one sweep over its changes.
+        
+        Ascending times are cheapest; out of order ones are still answered.
+        
+        Args:
+            times: Simulation times to sample at
+            signed: Read bit vectors as two's complement rather than unsigned
+            
+        Returns:
+            array('d') with one value per time: bit vectors as numbers, reals as
+            they are, NaN before the first change or where the value holds x/z
+        """
+        ...
+    
     def all_changes(self) -> SignalChangeIter: 
         """
         Get iterator over all signal transitions.
@@ -218,6 +300,15 @@ class Signal:
             QueryResult with value, actual time, and next transition info
         """
         ...
+    
+    def memory_usage(self) -> int: 
+        """
+        Approximate memory held by this signal's transitions.
+        
+        Returns:
+            Size in bytes
+        """
+        ...
 
 class SignalChangeIter:
     """Iterator over signal changes (time, value) pairs"""
@@ -232,6 +323,16 @@ class QueryResult:
     next_idx: Optional[int]
     next_time: Optional[int]
 
+class CacheStats:
+    """Signal cache counters"""
+    hits: int
+    misses: int
+    evictions: int
+    evicted_bytes: int
+    bytes: int  # Bytes held by cached signals
+    entries: int
+    budget: Optional[int]  # None when the cache is unbounded
+
 class TimescaleUnit:
     """Represents timescale units (ps, ns, us, ms, s, etc.)"""
     def __str__(self) -> Literal["zs", "as", "fs", "ps", "ns", "us", "ms", "s", "unknown"]: ...
@@ -0,0 +1,141 @@
+use std::collections::{BTreeMap, HashMap};
+use std::sync::Arc;
+
+use crate::hierarchy::SignalRef;
+use crate::signal::Signal;
+
+/// Counters describing how the signal cache is doing
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CacheStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub evictions: u64,
+    pub evicted_bytes: u64,
+    pub bytes: usize,            // Bytes held by cached signals right now
+    pub entries: usize,
+    pub budget: Option<usize>,   // None when the cache is unbounded
+}
+
+struct CacheEntry {
+    signal: Arc<Signal>,
+    bytes: usize,
+    last_used: u64,
+}
+
+/// Loaded signals kept up to a byte budget, least recently used first out.
+/// A signal still referenced outside the cache is never evicted, since
+/// dropping the cache's reference would not free its memory.
+pub struct SignalCache {
+    entries: HashMap<SignalRef, CacheEntry>,
+    lru: BTreeMap<u64, SignalRef>,  // last_used -> signal, oldest first
+    clock: u64,
+    bytes: usize,
+    budget: Option<usize>,
+    stats: CacheStats,
+}
+
+impl SignalCache {
+    pub fn new(budget: Option<usize>) -> Self {
+        SignalCache {
+            entries: HashMap::new(),
+            lru: BTreeMap::new(),
+            clock: 0,
+            bytes: 0,
+            budget,
+            stats: CacheStats::default(),
+        }
+    }
+    
+    /// Look up a signal, counting the hit or miss and marking it recently used
+    pub fn get(&mut self, signal_ref: &SignalRef) -> Option<Arc<Signal>> {
+        match self.entries.get_mut(signal_ref) {
+            Some(entry) => {
+                self.lru.remove(&entry.last_used);
+                self.clock += 1;
+                entry.last_used = self.clock;
+                self.lru.insert(self.clock, *signal_ref);
+                self.stats.hits += 1;
+                Some(entry.signal.clone())
+            }
+            None => {
+                self.stats.misses += 1;
+                None
+            }
+        }
+    }
+    
+    /// Whether a signal is held, without counting a hit or miss or marking it used
+    pub fn contains(&self, signal_ref: &SignalRef) -> bool {
+        self.entries.contains_key(signal_ref)
+    }
+    
+    /// Add a signal, then evict older ones if that went over budget
+    pub fn insert(&mut self, signal_ref: SignalRef, signal: Arc<Signal>) {
+        self.remove(&signal_ref);
+        
+        let bytes = signal.memory_usage();
+        self.clock += 1;
+        self.entries.insert(signal_ref, CacheEntry { signal, bytes, last_used: self.clock });
+        self.lru.insert(self.clock, signal_ref);
+        self.bytes += bytes;
+        
+        self.evict();
+    }
+    
+    pub fn remove(&mut self, signal_ref: &SignalRef) {
+        if let Some(entry) = self.entries.remove(signal_ref) {
+            self.lru.remove(&entry.last_used);
+            self.bytes -= entry.bytes;
+        }
+    }
+    
+    pub fn clear(&mut self) {
+        self.entries.clear();
+        self.lru.clear();
+        self.bytes = 0;
+    }
+    
+    /// Change the byte budget, evicting right away if the cache is now over it
+    pub fn set_budget(&mut self, budget: Option<usize>) {
+        self.budget = budget;
+        self.evict();
+    }
+    
+    pub fn stats(&self) -> CacheStats {
+        CacheStats {
+            bytes: self.bytes,
+            entries: self.entries.len(),
+            budget: self.budget,
+            ..self.stats
+        }
+    }
+    
+    fn evict(&mut self) {
+        let budget = match self.budget {
+            Some(budget) if self.bytes > budget => budget,
+            _ => return,
+        };
+        
+        let mut victims = Vec::new();
+        let mut remaining = self.bytes;
+        for (_, signal_ref) in self.lru.iter() {
+            if remaining <= budget {
+                break;
+            }
+            let entry = &self.entries[signal_ref];
+            if Arc::strong_count(&entry.signal) == 1 {
+                remaining -= entry.bytes;
+                victims.push(*signal_ref);
+            }
+        }
+        
+        for signal_ref in victims {
+            if let Some(entry) = self.entries.remove(&signal_ref) {
+                self.lru.remove(&entry.last_used);
+                self.bytes -= entry.bytes;
+                self.stats.evictions += 1;
+                self.stats.evicted_bytes += entry.bytes as u64;
+            }
+        }
+    }
+}
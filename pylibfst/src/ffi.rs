@@ -44,6 +44,9 @@ pub struct FstHierVar {
     pub is_alias: u32,                // Using u32 for bitfield
 }
 
+// fstReaderOpen2() flags
+pub const FST_RD_OPEN_BLOCK_INDEX: c_uint = 1 << 1;
+
 // Hierarchy types
 pub const FST_HT_SCOPE: u8 = 0;
 pub const FST_HT_UPSCOPE: u8 = 1;
@@ -100,6 +103,75 @@ pub const FST_VD_INPUT: u8 = 1;
 pub const FST_VD_OUTPUT: u8 = 2;
 pub const FST_VD_INOUT: u8 = 3;
 
+// Column encodings (fstColumnEncoding)
+pub const FST_CE_BITS2: u8 = 0;
+pub const FST_CE_BITS4: u8 = 1;
+pub const FST_CE_DOUBLE: u8 = 2;
+pub const FST_CE_BYTES: u8 = 3;
+
+// Per-bit state characters indexed by FST_CE_BITS2/FST_CE_BITS4 codes
+pub const FST_COLUMN_STATES: &[u8; 10] = b"01xzhuwl-?";
+
+// One signal's changes within one value change block (struct fstColumn)
+#[repr(C)]
+pub struct FstColumn {
+    pub handle: FstHandle,
+    pub len: u32,
+    pub encoding: u8,
+    pub count: u32,
+    pub times: *const u64,
+    pub times_count: u32,
+    pub time_idx: *const u32,
+    pub values: *const u8,
+    pub value_stride: u32,
+    pub value_offs: *const u32,
+}
+
+// The whole hierarchy as parallel arrays (struct fstFlatHier)
+pub const FST_FLAT_HIER_NO_SCOPE: u32 = u32::MAX;
+
+#[repr(C)]
+pub struct FstFlatHier {
+    pub num_scopes: u32,
+    pub num_vars: u32,
+    pub names_len: u64,
+    pub names: *const c_char,         // NUL terminated names back to back
+    pub scope_parent: *const u32,     // FST_FLAT_HIER_NO_SCOPE at top level
+    pub scope_name_offs: *const u64,
+    pub scope_name_len: *const u32,
+    pub scope_typ: *const u8,
+    pub var_scope: *const u32,        // FST_FLAT_HIER_NO_SCOPE at top level
+    pub var_name_offs: *const u64,
+    pub var_name_len: *const u32,
+    pub var_typ: *const u8,
+    pub var_direction: *const u8,
+    pub var_length: *const u32,
+    pub var_handle: *const FstHandle,
+    pub var_is_alias: *const u8,
+}
+
+// Every scope with the byte range of its records (struct fstHierScopeIndex)
+#[repr(C)]
+pub struct FstHierScopeIndex {
+    pub num_scopes: u32,
+    pub num_vars: u32,
+    pub root_num_vars: u32,           // Vars outside any scope
+    pub names_len: u64,
+    pub names: *const c_char,
+    pub scope_parent: *const u32,
+    pub scope_name_offs: *const u64,
+    pub scope_name_len: *const u32,
+    pub scope_typ: *const u8,
+    pub scope_num_vars: *const u32,   // Vars directly in each scope
+    pub scope_body_ofs: *const u64,
+    pub scope_end_ofs: *const u64,
+    pub scope_handle_base: *const FstHandle,
+    pub scope_num_handles: *const FstHandle,
+}
+
+// Callback type for fstReaderIterBlocksColumns
+pub type FstColumnCb = unsafe extern "C" fn(user_data: *mut c_void, col: *const FstColumn);
+
 // Callback type for value changes (matches fstReaderIterBlocks callback)
 pub type FstValueChangeCb = unsafe extern "C" fn(
     user_data: *mut c_void,
@@ -112,12 +184,23 @@ pub type FstValueChangeCb = unsafe extern "C" fn(
 extern "C" {
     // Reader functions
     pub fn fstReaderOpen(filename: *const c_char) -> FstReaderContext;
+    pub fn fstReaderOpen2(filename: *const c_char, flags: c_uint) -> FstReaderContext;
     pub fn fstReaderOpenForUtilitiesOnly() -> FstReaderContext;
+    pub fn fstReaderClone(ctx: FstReaderContext) -> FstReaderContext;
     pub fn fstReaderClose(ctx: FstReaderContext);
     
     // Hierarchy iteration
     pub fn fstReaderIterateHier(ctx: FstReaderContext) -> *mut FstHier;
     pub fn fstReaderIterateHierRewind(ctx: FstReaderContext) -> c_int;
+    pub fn fstReaderGetFlatHier(ctx: FstReaderContext) -> *mut FstFlatHier;
+    pub fn fstReaderFreeFlatHier(fh: *mut FstFlatHier);
+    pub fn fstReaderGetHierScopeIndex(ctx: FstReaderContext) -> *mut FstHierScopeIndex;
+    pub fn fstReaderFreeHierScopeIndex(si: *mut FstHierScopeIndex);
+    pub fn fstReaderGetFlatHierScope(
+        ctx: FstReaderContext,
+        si: *const FstHierScopeIndex,
+        scope: u32,
+    ) -> *mut FstFlatHier;
     
     // Signal selection
     pub fn fstReaderSetFacProcessMask(ctx: FstReaderContext, facidx: FstHandle);
@@ -132,11 +215,29 @@ extern "C" {
         user_data: *mut c_void,
         vcd_handle: *mut c_void,
     ) -> c_int;
+    pub fn fstReaderIterBlocksColumns(
+        ctx: FstReaderContext,
+        callback: Option<FstColumnCb>,
+        user_data: *mut c_void,
+    ) -> c_int;
+    pub fn fstReaderIterBlocksSetParallelMode(ctx: FstReaderContext, num_threads: c_int);
+    pub fn fstReaderSetBlockCacheSize(ctx: FstReaderContext, max_bytes: u64);
+    pub fn fstReaderGetValuesAtTime(
+        ctx: FstReaderContext,
+        tim: u64,
+        handles: *const FstHandle,
+        num_handles: u32,
+        buf: *mut c_char,
+        buf_len: usize,
+        values: *mut *const c_char,
+    ) -> usize;
     
     // Metadata
     pub fn fstReaderGetTimescale(ctx: FstReaderContext) -> i8;
     pub fn fstReaderGetStartTime(ctx: FstReaderContext) -> u64;
     pub fn fstReaderGetEndTime(ctx: FstReaderContext) -> u64;
+    pub fn fstReaderGetTimeTable(ctx: FstReaderContext, num_times: *mut u64) -> *const u64;
+    pub fn fstReaderFreeTimeTable(ctx: FstReaderContext);
     pub fn fstReaderGetVarCount(ctx: FstReaderContext) -> u32;
     pub fn fstReaderGetMaxHandle(ctx: FstReaderContext) -> FstHandle;
     pub fn fstReaderGetAliasCount(ctx: FstReaderContext) -> u32;
@@ -145,6 +246,11 @@ extern "C" {
     pub fn fstReaderGetFileType(ctx: FstReaderContext) -> u8;
 }
 
+/// Budget for the time tables and chain indexes libfst keeps per reader, so
+/// loading more signals from blocks already visited skips re-parsing them.
+/// Clones inherit it and each keeps its own.
+pub const BLOCK_CACHE_BYTES: u64 = 16 << 20;
+
 // Safe Rust wrapper
 pub struct FstReader {
     ctx: FstReaderContext,
@@ -181,15 +287,43 @@ impl FstReader {
         
         let c_path = CString::new(path_str).map_err(|e| format!("Invalid path: {}", e))?;
         
-        let ctx = unsafe { fstReaderOpen(c_path.as_ptr()) };
+        // Reuse (or leave behind) the .fstidx block index and, for wrapped
+        // traces, the .fstgzidx access points, so reopening skips the scan
+        let ctx = unsafe { fstReaderOpen2(c_path.as_ptr(), FST_RD_OPEN_BLOCK_INDEX) };
         
         if ctx.is_null() {
             Err(format!("Failed to open FST file: {}", path_str))
         } else {
+            // Blocks are inflated serially until a caller asks for decode threads
+            unsafe { fstReaderSetBlockCacheSize(ctx, BLOCK_CACHE_BYTES) };
             Ok(FstReader { ctx })
         }
     }
     
+    /// Open a second reader on the same file that can be used from another
+    /// thread concurrently with this one. Header, signal table and block index
+    /// are shared; the process mask starts empty. Returns None when a wrapped
+    /// (gzip) trace had to be unpacked to a temp file.
+    pub fn try_clone(&self) -> Option<FstReader> {
+        let ctx = unsafe { fstReaderClone(self.ctx) };
+        if ctx.is_null() {
+            None
+        } else {
+            Some(FstReader { ctx })
+        }
+    }
+    
+    /// Threads libfst inflates value change blocks on ahead of the callbacks,
+    /// which stay on the calling thread; 0 or 1 decodes serially
+    pub fn set_decode_threads(&self, threads: usize) {
+        unsafe { fstReaderIterBlocksSetParallelMode(self.ctx, threads.min(c_int::MAX as usize) as c_int) };
+    }
+    
+    /// Byte budget of libfst's block metadata cache, evicting at once if over it
+    pub fn set_block_cache_size(&self, max_bytes: u64) {
+        unsafe { fstReaderSetBlockCacheSize(self.ctx, max_bytes) };
+    }
+    
     /// Get reader context for FFI calls
     pub fn context(&self) -> FstReaderContext {
         self.ctx
@@ -210,6 +344,27 @@ impl FstReader {
         unsafe { fstReaderGetEndTime(self.ctx) }
     }
     
+    /// Every distinct time in the file, ascending. libfst's own table is
+    /// released once copied so the trace is not held in memory twice. Fails
+    /// when there are more times than the u32 indices signals hold can address.
+    pub fn time_table(&self) -> Result<Vec<u64>, String> {
+        let mut num_times: u64 = 0;
+        unsafe {
+            let times = fstReaderGetTimeTable(self.ctx, &mut num_times);
+            if times.is_null() {
+                return Ok(Vec::new());
+            }
+            // Signals index the table with u32
+            if num_times > u32::MAX as u64 {
+                fstReaderFreeTimeTable(self.ctx);
+                return Err(format!("Too many distinct times: {}, at most {} are supported", num_times, u32::MAX));
+            }
+            let copy = std::slice::from_raw_parts(times, num_times as usize).to_vec();
+            fstReaderFreeTimeTable(self.ctx);
+            Ok(copy)
+        }
+    }
+    
     /// Get variable count
     pub fn var_count(&self) -> u32 {
         unsafe { fstReaderGetVarCount(self.ctx) }
@@ -266,6 +421,37 @@ impl FstReader {
         result != 0
     }
     
+    /// The whole hierarchy in one call, None when the file has none
+    pub fn flat_hier(&self) -> Option<FlatHier> {
+        let ptr = unsafe { fstReaderGetFlatHier(self.ctx) };
+        if ptr.is_null() {
+            None
+        } else {
+            Some(FlatHier { ptr })
+        }
+    }
+    
+    /// Scopes only, with where each one's vars are, for decoding them one scope at a time
+    pub fn hier_scope_index(&self) -> Option<HierScopeIndex> {
+        let ptr = unsafe { fstReaderGetHierScopeIndex(self.ctx) };
+        if ptr.is_null() {
+            None
+        } else {
+            Some(HierScopeIndex { ptr })
+        }
+    }
+    
+    /// The vars directly in one scope of `index`, or outside any scope for
+    /// FST_FLAT_HIER_NO_SCOPE. The index must come from this reader or a clone.
+    pub fn flat_hier_scope(&self, index: &HierScopeIndex, scope: u32) -> Option<FlatHier> {
+        let ptr = unsafe { fstReaderGetFlatHierScope(self.ctx, index.ptr, scope) };
+        if ptr.is_null() {
+            None
+        } else {
+            Some(FlatHier { ptr })
+        }
+    }
+    
     /// Set facility process mask
     pub fn set_fac_process_mask(&self, handle: FstHandle) {
         unsafe { fstReaderSetFacProcessMask(self.ctx, handle) }
@@ -284,6 +470,47 @@ impl FstReader {
     ) -> bool {
         unsafe { fstReaderIterBlocks(self.ctx, callback, user_data, ptr::null_mut()) != 0 }
     }
+    
+    /// Values of many handles at one time in a single lookup, None where the
+    /// handle has no value then (or is a variable-length signal)
+    pub fn values_at_time(&self, time: u64, handles: &[FstHandle]) -> Vec<Option<String>> {
+        let mut values: Vec<*const c_char> = vec![ptr::null(); handles.len()];
+        let mut buf: Vec<u8> = vec![0; handles.len() * 16 + 256];
+        loop {
+            let needed = unsafe {
+                fstReaderGetValuesAtTime(
+                    self.ctx,
+                    time,
+                    handles.as_ptr(),
+                    handles.len() as u32,
+                    buf.as_mut_ptr() as *mut c_char,
+                    buf.len(),
+                    values.as_mut_ptr(),
+                )
+            };
+            if needed <= buf.len() {
+                break;
+            }
+            buf.resize(needed, 0);
+        }
+        
+        values.iter()
+            .map(|&value| if value.is_null() {
+                None
+            } else {
+                Some(unsafe { CStr::from_ptr(value) }.to_string_lossy().into_owned())
+            })
+            .collect()
+    }
+    
+    /// Iterate through value changes one (block, signal) column at a time
+    pub fn iterate_columns(
+        &self,
+        callback: Option<FstColumnCb>,
+        user_data: *mut c_void,
+    ) -> bool {
+        unsafe { fstReaderIterBlocksColumns(self.ctx, callback, user_data) != 0 }
+    }
 }
 
 impl Drop for FstReader {
@@ -294,6 +521,154 @@ impl Drop for FstReader {
     }
 }
 
+/// Owned fstReaderGetFlatHier() result, its arrays borrowed as slices
+pub struct FlatHier {
+    ptr: *mut FstFlatHier,
+}
+
+impl FlatHier {
+    fn raw(&self) -> &FstFlatHier {
+        unsafe { &*self.ptr }
+    }
+    
+    fn slice<T>(&self, ptr: *const T, len: usize) -> &[T] {
+        if len == 0 {
+            &[]
+        } else {
+            unsafe { std::slice::from_raw_parts(ptr, len) }
+        }
+    }
+    
+    pub fn num_scopes(&self) -> usize {
+        self.raw().num_scopes as usize
+    }
+    
+    pub fn num_vars(&self) -> usize {
+        self.raw().num_vars as usize
+    }
+    
+    /// Name bytes without the NUL terminator
+    pub fn name(&self, offset: u64, len: u32) -> &[u8] {
+        let raw = self.raw();
+        let names = self.slice(raw.names as *const u8, raw.names_len as usize);
+        &names[offset as usize..offset as usize + len as usize]
+    }
+    
+    pub fn scope_parent(&self) -> &[u32] {
+        self.slice(self.raw().scope_parent, self.num_scopes())
+    }
+    
+    pub fn scope_name_offs(&self) -> &[u64] {
+        self.slice(self.raw().scope_name_offs, self.num_scopes())
+    }
+    
+    pub fn scope_name_len(&self) -> &[u32] {
+        self.slice(self.raw().scope_name_len, self.num_scopes())
+    }
+    
+    pub fn scope_typ(&self) -> &[u8] {
+        self.slice(self.raw().scope_typ, self.num_scopes())
+    }
+    
+    pub fn var_scope(&self) -> &[u32] {
+        self.slice(self.raw().var_scope, self.num_vars())
+    }
+    
+    pub fn var_name_offs(&self) -> &[u64] {
+        self.slice(self.raw().var_name_offs, self.num_vars())
+    }
+    
+    pub fn var_name_len(&self) -> &[u32] {
+        self.slice(self.raw().var_name_len, self.num_vars())
+    }
+    
+    pub fn var_typ(&self) -> &[u8] {
+        self.slice(self.raw().var_typ, self.num_vars())
+    }
+    
+    pub fn var_direction(&self) -> &[u8] {
+        self.slice(self.raw().var_direction, self.num_vars())
+    }
+    
+    pub fn var_length(&self) -> &[u32] {
+        self.slice(self.raw().var_length, self.num_vars())
+    }
+    
+    pub fn var_handle(&self) -> &[FstHandle] {
+        self.slice(self.raw().var_handle, self.num_vars())
+    }
+}
+
+impl Drop for FlatHier {
+    fn drop(&mut self) {
+        unsafe { fstReaderFreeFlatHier(self.ptr) }
+    }
+}
+
+/// Owned fstReaderGetHierScopeIndex() result
+pub struct HierScopeIndex {
+    ptr: *mut FstHierScopeIndex,
+}
+
+// Never written after creation, so it can be read from any thread
+unsafe impl Send for HierScopeIndex {}
+unsafe impl Sync for HierScopeIndex {}
+
+impl HierScopeIndex {
+    fn raw(&self) -> &FstHierScopeIndex {
+        unsafe { &*self.ptr }
+    }
+    
+    fn slice<T>(&self, ptr: *const T, len: usize) -> &[T] {
+        if len == 0 {
+            &[]
+        } else {
+            unsafe { std::slice::from_raw_parts(ptr, len) }
+        }
+    }
+    
+    pub fn num_scopes(&self) -> usize {
+        self.raw().num_scopes as usize
+    }
+    
+    pub fn root_num_vars(&self) -> usize {
+        self.raw().root_num_vars as usize
+    }
+    
+    /// Name bytes without the NUL terminator
+    pub fn name(&self, offset: u64, len: u32) -> &[u8] {
+        let raw = self.raw();
+        let names = self.slice(raw.names as *const u8, raw.names_len as usize);
+        &names[offset as usize..offset as usize + len as usize]
+    }
+    
+    pub fn scope_parent(&self) -> &[u32] {
+        self.slice(self.raw().scope_parent, self.num_scopes())
+    }
+    
+    pub fn scope_name_offs(&self) -> &[u64] {
+        self.slice(self.raw().scope_name_offs, self.num_scopes())
+    }
+    
+    pub fn scope_name_len(&self) -> &[u32] {
+        self.slice(self.raw().scope_name_len, self.num_scopes())
+    }
+    
+    pub fn scope_typ(&self) -> &[u8] {
+        self.slice(self.raw().scope_typ, self.num_scopes())
+    }
+    
+    pub fn scope_num_vars(&self) -> &[u32] {
+        self.slice(self.raw().scope_num_vars, self.num_scopes())
+    }
+}
+
+impl Drop for HierScopeIndex {
+    fn drop(&mut self) {
+        unsafe { fstReaderFreeHierScopeIndex(self.ptr) }
+    }
+}
+
 // Helper to convert C string to Rust string
 pub unsafe fn c_str_to_string(ptr: *const c_char, len: u32) -> String {
     if ptr.is_null() {
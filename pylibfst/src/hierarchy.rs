@@ -1,9 +1,8 @@
-use std::collections::HashMap;
-use std::sync::Arc;
+use std::sync::{Arc, Mutex, OnceLock};
+use std::thread;
 
 use crate::ffi::{
-    self, FstHandle, FstReader, FST_HT_SCOPE, FST_HT_UPSCOPE, FST_HT_VAR,
-    FST_HT_ATTRBEGIN, FST_HT_ATTREND, FST_HT_TREEBEGIN, FST_HT_TREEEND,
+    FlatHier, FstHandle, FstReader, HierScopeIndex, FST_FLAT_HIER_NO_SCOPE,
     FST_ST_VCD_BEGIN, FST_ST_VCD_FORK, FST_ST_VCD_FUNCTION, FST_ST_VCD_GENERATE,
     FST_ST_VCD_MODULE, FST_ST_VCD_TASK, FST_VD_IMPLICIT, FST_VD_INOUT, FST_VD_INPUT,
     FST_VD_OUTPUT, FST_VT_VCD_EVENT, FST_VT_VCD_INTEGER, FST_VT_VCD_PARAMETER,
@@ -192,32 +191,28 @@ impl VarDirection {
     }
 }
 
+/// A name in one of the hierarchy's string arenas, see `Hierarchy::name`
+#[derive(Debug, Clone, Copy)]
+pub struct NameRef {
+    offset: usize,
+    len: u32,
+    arena: u32,  // 0 for the main arena, slot + 1 for a lazily decoded scope's
+}
+
 /// Scope structure
 #[derive(Debug, Clone)]
 pub struct Scope {
-    pub name: String,
+    pub name: NameRef,
     pub scope_type: ScopeType,
     pub parent: Option<ScopeRef>,
-    pub children: Vec<ScopeRef>,
-    pub vars: Vec<VarRef>,
-}
-
-impl Scope {
-    fn new(name: String, scope_type: ScopeType, parent: Option<ScopeRef>) -> Self {
-        Scope {
-            name,
-            scope_type,
-            parent,
-            children: Vec::new(),
-            vars: Vec::new(),
-        }
-    }
+    children: (u32, u32),  // Range into Hierarchy::scope_children
+    vars: (u32, u32),      // Range into Hierarchy::scope_vars, or of VarRefs when lazy
 }
 
 /// Variable structure
 #[derive(Debug, Clone)]
 pub struct Var {
-    pub name: String,
+    pub name: NameRef,     // Without the bit range, which is kept in `index`
     pub var_type: VarType,
     pub direction: VarDirection,
     pub length: Option<u32>,
@@ -228,30 +223,6 @@ pub struct Var {
 }
 
 impl Var {
-    fn new(
-        name: String,
-        var_type: VarType,
-        direction: VarDirection,
-        length: Option<u32>,
-        signal_ref: SignalRef,
-        fst_handle: FstHandle,
-        scope: Option<ScopeRef>,
-    ) -> Self {
-        // Parse bit range from name if present
-        let (clean_name, index) = parse_bit_range(&name);
-        
-        Var {
-            name: clean_name,
-            var_type,
-            direction,
-            length,
-            signal_ref,
-            index,
-            scope,
-            fst_handle,
-        }
-    }
-    
     pub fn is_real(&self) -> bool {
         self.var_type.is_real()
     }
@@ -274,11 +245,11 @@ impl Var {
 }
 
 /// Parse bit range from signal name
-fn parse_bit_range(name: &str) -> (String, Option<VarIndex>) {
+fn parse_bit_range(name: &str) -> (&str, Option<VarIndex>) {
     if let Some(idx) = name.rfind('[') {
         if let Some(end_idx) = name.rfind(']') {
             if end_idx > idx {
-                let base = name[..idx].to_string();
+                let base = &name[..idx];
                 let range = &name[idx + 1..end_idx];
                 
                 // Parse range like "7:0" or "15:8"
@@ -299,9 +270,20 @@ fn parse_bit_range(name: &str) -> (String, Option<VarIndex>) {
         }
     }
     
-    (name.to_string(), None)
+    (name, None)
 }
 
+/// FNV-1a, continued from `hash`, for full path lookups without storing the paths
+fn fnv1a(mut hash: u64, bytes: &[u8]) -> u64 {
+    for &b in bytes {
+        hash ^= b as u64;
+        hash = hash.wrapping_mul(0x100000001b3);
+    }
+    hash
+}
+
+const FNV_OFFSET: u64 = 0xcbf29ce484222325;
+
 /// Timescale unit
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum TimescaleUnit {
@@ -366,12 +348,30 @@ impl Timescale {
     }
 }
 
+/// Vars of one scope, decoded the first time anything asks for them
+struct ScopeVars {
+    vars: Vec<Var>,
+    names: String,
+}
+
+/// What a lazily opened hierarchy needs to decode vars later
+struct LazyVars {
+    reader: Mutex<FstReader>,            // Own clone, so decoding never waits on signal loading
+    index: HierScopeIndex,
+    slots: Vec<OnceLock<ScopeVars>>,     // One per scope, then one for vars outside any scope
+    var_base: Vec<usize>,                // First VarRef of each slot, then the total
+    scope_hashes: Vec<(u64, ScopeRef)>,  // Full path hash per scope, sorted by hash
+}
+
 /// Main hierarchy structure
 pub struct Hierarchy {
     pub scopes: Vec<Scope>,
-    pub vars: Vec<Var>,
-    pub path_to_var: HashMap<String, VarRef>,
-    pub signal_ref_map: HashMap<FstHandle, SignalRef>,
+    vars: Vec<Var>,                 // Empty when lazy, see `lazy`
+    names: String,                  // Every scope and var name back to back
+    scope_children: Vec<ScopeRef>,  // Children of each scope, grouped by scope
+    scope_vars: Vec<VarRef>,        // Vars of each scope, grouped by scope
+    path_hashes: Vec<(u64, VarRef)>,  // Full path hash per var, sorted by hash
+    lazy: Option<LazyVars>,         // Set when vars are decoded one scope at a time
     pub timescale: Option<Timescale>,
     pub date: String,
     pub version: String,
@@ -379,174 +379,277 @@ pub struct Hierarchy {
 }
 
 impl Hierarchy {
-    /// Build hierarchy from FST reader
-    pub fn from_fst(reader: &FstReader) -> Result<Self, String> {
-        let mut hierarchy = Hierarchy {
+    fn empty(reader: &FstReader) -> Self {
+        let ts_exp = reader.timescale();
+        Hierarchy {
             scopes: Vec::new(),
             vars: Vec::new(),
-            path_to_var: HashMap::new(),
-            signal_ref_map: HashMap::new(),
-            timescale: None,
+            names: String::new(),
+            scope_children: Vec::new(),
+            scope_vars: Vec::new(),
+            path_hashes: Vec::new(),
+            lazy: None,
+            timescale: if ts_exp != 0 { Some(Timescale::from_fst_exponent(ts_exp)) } else { None },
             date: reader.date(),
             version: reader.version(),
             file_format: "FST".to_string(),
+        }
+    }
+    
+    /// Build hierarchy from FST reader
+    pub fn from_fst(reader: &FstReader) -> Result<Self, String> {
+        let mut hierarchy = Hierarchy::empty(reader);
+        
+        // The whole hierarchy arrives as flat arrays in one call
+        let flat = match reader.flat_hier() {
+            Some(flat) => flat,
+            None => return Ok(hierarchy),
         };
         
-        // Set timescale
-        let ts_exp = reader.timescale();
-        if ts_exp != 0 {
-            hierarchy.timescale = Some(Timescale::from_fst_exponent(ts_exp));
+        let num_scopes = flat.num_scopes();
+        let num_vars = flat.num_vars();
+        let scope_hashes = hierarchy.add_scopes(flat.scope_parent(), flat.scope_typ(), |i| {
+            flat.name(flat.scope_name_offs()[i], flat.scope_name_len()[i])
+        });
+        hierarchy.vars.reserve_exact(num_vars);
+        hierarchy.path_hashes.reserve_exact(num_vars);
+        
+        // Signal refs are numbered in order of first appearance of each handle
+        let mut handle_signals: Vec<u32> = Vec::new();
+        let mut signal_counter = 0u32;
+        let mut var_counts = vec![0u32; num_scopes];
+        
+        for i in 0..num_vars {
+            let scope = to_scope_ref(flat.var_scope()[i]);
+            let raw_name = String::from_utf8_lossy(flat.name(flat.var_name_offs()[i], flat.var_name_len()[i]));
+            let (clean_name, index) = parse_bit_range(raw_name.trim());
+            let name = hierarchy.push_name(clean_name);
+            
+            let hash = match scope {
+                Some(s) => fnv1a(fnv1a(scope_hashes[s.0], b"."), clean_name.as_bytes()),
+                None => fnv1a(FNV_OFFSET, clean_name.as_bytes()),
+            };
+            hierarchy.path_hashes.push((hash, VarRef(i)));
+            if let Some(s) = scope {
+                var_counts[s.0] += 1;
+            }
+            
+            let handle = flat.var_handle()[i];
+            if handle as usize >= handle_signals.len() {
+                handle_signals.resize(handle as usize + 1, u32::MAX);
+            }
+            if handle_signals[handle as usize] == u32::MAX {
+                handle_signals[handle as usize] = signal_counter;
+                signal_counter += 1;
+            }
+            
+            let signal_ref = SignalRef(handle_signals[handle as usize] as usize);
+            hierarchy.vars.push(var_from_flat(&flat, i, name, index, scope, signal_ref));
         }
         
-        // Build hierarchy by iterating FST structure
-        let mut scope_stack: Vec<ScopeRef> = Vec::new();
-        let mut current_path = Vec::new();
-        let mut signal_counter = 0usize;
+        // Group vars per scope, keeping file order within each
+        let mut var_pos = 0u32;
+        for (i, scope) in hierarchy.scopes.iter_mut().enumerate() {
+            scope.vars = (var_pos, var_pos);
+            var_pos += var_counts[i];
+        }
+        hierarchy.scope_vars = vec![VarRef(0); var_pos as usize];
+        for i in 0..num_vars {
+            if let Some(s) = hierarchy.vars[i].scope {
+                let end = &mut hierarchy.scopes[s.0].vars.1;
+                hierarchy.scope_vars[*end as usize] = VarRef(i);
+                *end += 1;
+            }
+        }
+        
+        // Stable, so duplicate paths keep file order and the last one wins on lookup
+        hierarchy.path_hashes.sort_by_key(|&(hash, _)| hash);
+        
+        Ok(hierarchy)
+    }
+    
+    /// Build only the scopes, leaving each scope's vars to be decoded the
+    /// first time they are asked for. Var refs then count scope by scope
+    /// rather than in file order, and signal refs are handle - 1, which is
+    /// what `from_fst` numbers them for any file whose aliases point back.
+    pub fn from_fst_lazy(reader: &FstReader) -> Result<Self, String> {
+        // Traces unpacked to a temp file cannot be cloned, so they are read whole
+        let decoder = match reader.try_clone() {
+            Some(decoder) => decoder,
+            None => return Hierarchy::from_fst(reader),
+        };
+        let index = match decoder.hier_scope_index() {
+            Some(index) => index,
+            None => return Hierarchy::from_fst(reader),
+        };
         
-        // Call rewind - just like the C test code does
-        let rewind_result = reader.rewind_hier();
+        let mut hierarchy = Hierarchy::empty(reader);
+        let scope_hashes = hierarchy.add_scopes(index.scope_parent(), index.scope_typ(), |i| {
+            index.name(index.scope_name_offs()[i], index.scope_name_len()[i])
+        });
         
-        // If rewind failed, we can still try to iterate
-        // The first call to iterate_hier might create the temp file
-        if !rewind_result {
-            // Rewind might fail on first call, but that's ok
+        let num_scopes = index.num_scopes();
+        let mut var_base = Vec::with_capacity(num_scopes + 2);
+        let mut total = 0usize;
+        for (i, scope) in hierarchy.scopes.iter_mut().enumerate() {
+            let count = index.scope_num_vars()[i] as usize;
+            var_base.push(total);
+            scope.vars = (total as u32, (total + count) as u32);
+            total += count;
         }
+        var_base.push(total);
+        var_base.push(total + index.root_num_vars());
         
-        // Now iterate through the hierarchy
-        let mut iter_count = 0;
-        let mut scope_count = 0;
-        let mut var_count = 0;
-        let max_iterations = 5000000;  // Safety limit
+        let mut scope_hashes: Vec<(u64, ScopeRef)> = scope_hashes.into_iter()
+            .enumerate()
+            .map(|(i, hash)| (hash, ScopeRef(i)))
+            .collect();
+        scope_hashes.sort_by_key(|&(hash, _)| hash);
         
-        loop {
-            if iter_count >= max_iterations {
-                eprintln!("DEBUG: Hit max iterations limit in Hierarchy::from_fst");
-                break;
-            }
+        hierarchy.lazy = Some(LazyVars {
+            reader: Mutex::new(decoder),
+            index,
+            slots: (0..num_scopes + 1).map(|_| OnceLock::new()).collect(),
+            var_base,
+            scope_hashes,
+        });
+        
+        Ok(hierarchy)
+    }
+    
+    /// Add scopes from parallel arrays, returning each one's full path hash
+    fn add_scopes<'a>(&mut self, parents: &[u32], typs: &[u8], name_of: impl Fn(usize) -> &'a [u8]) -> Vec<u64> {
+        let num_scopes = parents.len();
+        self.scopes.reserve_exact(num_scopes);
+        let mut scope_hashes: Vec<u64> = Vec::with_capacity(num_scopes);
+        let mut child_counts = vec![0u32; num_scopes];
+        
+        for i in 0..num_scopes {
+            let parent = to_scope_ref(parents[i]);
+            let raw_name = String::from_utf8_lossy(name_of(i));
+            let name = self.push_name(raw_name.trim());
+            let name_str = self.name(name);
             
-            let hier_ptr = reader.iterate_hier()?;
-            if hier_ptr.is_null() {
-                break;
+            // Full path hash: parent path, '.', own name
+            let hash = match parent {
+                Some(p) => fnv1a(fnv1a(scope_hashes[p.0], b"."), name_str.as_bytes()),
+                None => fnv1a(FNV_OFFSET, name_str.as_bytes()),
+            };
+            scope_hashes.push(hash);
+            if let Some(p) = parent {
+                child_counts[p.0] += 1;
             }
-            iter_count += 1;
-            
-            
-            let hier = unsafe { &*hier_ptr };
             
+            self.scopes.push(Scope {
+                name,
+                scope_type: ScopeType::from_fst(typs[i]),
+                parent,
+                children: (0, 0),
+                vars: (0, 0),
+            });
+        }
+        
+        // Group children per scope, keeping file order within each
+        let mut child_pos = 0u32;
+        for (i, scope) in self.scopes.iter_mut().enumerate() {
+            scope.children = (child_pos, child_pos);
+            child_pos += child_counts[i];
+        }
+        self.scope_children = vec![ScopeRef(0); child_pos as usize];
+        for i in 0..num_scopes {
+            if let Some(p) = self.scopes[i].parent {
+                let end = &mut self.scopes[p.0].children.1;
+                self.scope_children[*end as usize] = ScopeRef(i);
+                *end += 1;
+            }
+        }
+        
+        scope_hashes
+    }
+    
+    fn push_name(&mut self, name: &str) -> NameRef {
+        let offset = self.names.len();
+        self.names.push_str(name);
+        NameRef { offset, len: name.len() as u32, arena: 0 }
+    }
+    
+    pub fn name(&self, name: NameRef) -> &str {
+        let names = match (name.arena, &self.lazy) {
+            (0, _) => &self.names,
+            (arena, Some(lazy)) => match lazy.slots[arena as usize - 1].get() {
+                Some(decoded) => &decoded.names,
+                None => return "",
+            },
+            (_, None) => return "",
+        };
+        &names[name.offset..name.offset + name.len as usize]
+    }
+    
+    /// Decode one lazy slot, or wait for whoever is decoding it already
+    fn slot_vars<'a>(&self, lazy: &'a LazyVars, slot: usize) -> &'a ScopeVars {
+        lazy.slots[slot].get_or_init(|| {
+            let num_scopes = lazy.slots.len() - 1;
+            let (fst_scope, scope) = if slot < num_scopes {
+                (slot as u32, Some(ScopeRef(slot)))
+            } else {
+                (FST_FLAT_HIER_NO_SCOPE, None)
+            };
             
-            match hier.htyp {
-                FST_HT_SCOPE => {
-                    scope_count += 1;
-                    // Enter new scope - access union safely
-                    let scope_data = unsafe { hier.u.scope };
-                    
-                    // Check for null pointers before dereferencing
-                    if scope_data.name.is_null() {
-                        // Skip null scope names
-                        continue;
-                    }
-                    
-                    let name = unsafe { ffi::c_str_to_string(scope_data.name, scope_data.name_length) };
-                    let scope_type = ScopeType::from_fst(scope_data.typ);
-                    
-                    let parent = scope_stack.last().copied();
-                    let scope_ref = ScopeRef(hierarchy.scopes.len());
-                    
-                    hierarchy.scopes.push(Scope::new(name.clone(), scope_type, parent));
-                    
-                    // Update parent's children
-                    if let Some(parent_ref) = parent {
-                        hierarchy.scopes[parent_ref.0].children.push(scope_ref);
-                    }
-                    
-                    scope_stack.push(scope_ref);
-                    current_path.push(name);
-                }
-                
-                FST_HT_UPSCOPE => {
-                    // Exit current scope
-                    scope_stack.pop();
-                    current_path.pop();
-                }
-                
-                FST_HT_VAR => {
-                    var_count += 1;
-                    // Add variable
-                    let var_data = unsafe { hier.u.var };
-                    let name = unsafe { ffi::c_str_to_string(var_data.name, var_data.name_length) };
-                    let var_type = VarType::from_fst(var_data.typ);
-                    let direction = VarDirection::from_fst(var_data.direction);
-                    let length = if var_data.length > 0 {
-                        Some(var_data.length)
-                    } else {
-                        None
-                    };
-                    
-                    // Check if this is an alias
-                    let signal_ref = if let Some(&existing_ref) = hierarchy.signal_ref_map.get(&var_data.handle) {
-                        existing_ref
-                    } else {
-                        let new_ref = SignalRef(signal_counter);
-                        hierarchy.signal_ref_map.insert(var_data.handle, new_ref);
-                        signal_counter += 1;
-                        new_ref
-                    };
-                    
-                    let scope = scope_stack.last().copied();
-                    let var_ref = VarRef(hierarchy.vars.len());
-                    
-                    // Create the variable (which will parse and clean the name)
-                    let var = Var::new(
-                        name.clone(),
-                        var_type,
-                        direction,
-                        length,
-                        signal_ref,
-                        var_data.handle,
-                        scope,
-                    );
+            let flat = lazy.reader.lock().unwrap().flat_hier_scope(&lazy.index, fst_scope);
+            let mut decoded = ScopeVars { vars: Vec::new(), names: String::new() };
+            if let Some(flat) = flat {
+                decoded.vars.reserve_exact(flat.num_vars());
+                for i in 0..flat.num_vars() {
+                    let raw_name = String::from_utf8_lossy(flat.name(flat.var_name_offs()[i], flat.var_name_len()[i]));
+                    let (clean_name, index) = parse_bit_range(raw_name.trim());
+                    let name = NameRef { offset: decoded.names.len(), len: clean_name.len() as u32, arena: slot as u32 + 1 };
+                    decoded.names.push_str(clean_name);
                     
-                    // Build full path for lookup using the cleaned name
-                    let mut full_path = current_path.clone();
-                    full_path.push(var.name.clone());
-                    let path_str = full_path.join(".");
-                    
-                    hierarchy.vars.push(var);
-                    hierarchy.path_to_var.insert(path_str, var_ref);
-                    
-                    // Update scope's vars
-                    if let Some(scope_ref) = scope {
-                        hierarchy.scopes[scope_ref.0].vars.push(var_ref);
-                    }
-                }
-                
-                FST_HT_ATTRBEGIN => {
-                    // Skip attributes for now
-                }
-                
-                FST_HT_ATTREND => {
-                    // Skip attributes for now
-                }
-                
-                FST_HT_TREEBEGIN => {
-                    // Skip tree markers for now
-                }
-                
-                FST_HT_TREEEND => {
-                    // Skip tree markers for now
-                }
-                
-                _ => {
-                    // Unknown hierarchy type - skip
+                    let signal_ref = SignalRef(flat.var_handle()[i].saturating_sub(1) as usize);
+                    decoded.vars.push(var_from_flat(&flat, i, name, index, scope, signal_ref));
                 }
             }
+            decoded
+        })
+    }
+    
+    /// Lazy slot holding a var ref, given the slot's var ref range is not empty
+    fn slot_of(lazy: &LazyVars, var_ref: usize) -> usize {
+        lazy.var_base.partition_point(|&base| base <= var_ref) - 1
+    }
+    
+    /// True once every var has been decoded, always for an eagerly built hierarchy
+    pub fn is_complete(&self) -> bool {
+        match self.lazy {
+            Some(ref lazy) => lazy.slots.iter().all(|slot| slot.get().is_some()),
+            None => true,
         }
-        
-        Ok(hierarchy)
     }
     
-    pub fn all_vars(&self) -> impl Iterator<Item = &Var> {
-        self.vars.iter()
+    /// Decode every scope not decoded yet
+    pub fn complete(&self) {
+        if let Some(ref lazy) = self.lazy {
+            for slot in 0..lazy.slots.len() {
+                self.slot_vars(lazy, slot);
+            }
+        }
+    }
+    
+    /// Decode every scope on a thread of its own, so that lookups over the
+    /// whole design find their vars ready. Scopes asked for meanwhile are
+    /// decoded by the caller; one already being decoded is waited for.
+    pub fn complete_in_background(self: &Arc<Self>) {
+        if !self.is_complete() {
+            let hierarchy = self.clone();
+            thread::spawn(move || hierarchy.complete());
+        }
+    }
+    
+    pub fn all_vars(&self) -> Box<dyn Iterator<Item = &Var> + '_> {
+        match self.lazy {
+            Some(ref lazy) => Box::new((0..lazy.slots.len()).flat_map(move |slot| self.slot_vars(lazy, slot).vars.iter())),
+            None => Box::new(self.vars.iter()),
+        }
     }
     
     pub fn top_scopes(&self) -> impl Iterator<Item = &Scope> {
@@ -554,38 +657,123 @@ impl Hierarchy {
     }
     
     pub fn get_var(&self, var_ref: VarRef) -> Option<&Var> {
-        self.vars.get(var_ref.0)
+        match self.lazy {
+            Some(ref lazy) => {
+                if var_ref.0 >= *lazy.var_base.last()? {
+                    return None;
+                }
+                let slot = Hierarchy::slot_of(lazy, var_ref.0);
+                self.slot_vars(lazy, slot).vars.get(var_ref.0 - lazy.var_base[slot])
+            }
+            None => self.vars.get(var_ref.0),
+        }
     }
     
     pub fn get_scope(&self, scope_ref: ScopeRef) -> Option<&Scope> {
         self.scopes.get(scope_ref.0)
     }
     
-    pub fn var_by_path(&self, path: &str) -> Option<&Var> {
-        self.path_to_var.get(path).and_then(|&var_ref| self.get_var(var_ref))
+    pub fn scope_children(&self, scope: &Scope) -> &[ScopeRef] {
+        &self.scope_children[scope.children.0 as usize..scope.children.1 as usize]
     }
     
-    pub fn var_full_name(&self, var: &Var) -> String {
-        let mut path = Vec::new();
-        
-        // Build path from variable's scope
-        if let Some(scope_ref) = var.scope {
-            let mut current_scope = Some(scope_ref);
-            while let Some(sr) = current_scope {
-                if let Some(scope) = self.get_scope(sr) {
-                    path.push(scope.name.clone());
-                    current_scope = scope.parent;
-                } else {
-                    break;
+    /// Vars directly in a scope, decoding them first when lazy
+    pub fn scope_vars(&self, scope: &Scope) -> Vec<&Var> {
+        match self.lazy {
+            Some(ref lazy) => {
+                if scope.vars.0 == scope.vars.1 {
+                    return Vec::new();
                 }
+                let slot = Hierarchy::slot_of(lazy, scope.vars.0 as usize);
+                self.slot_vars(lazy, slot).vars.iter().collect()
             }
-            path.reverse();
+            None => self.scope_vars[scope.vars.0 as usize..scope.vars.1 as usize]
+                .iter()
+                .filter_map(|&var_ref| self.get_var(var_ref))
+                .collect(),
         }
+    }
+    
+    pub fn var_by_path(&self, path: &str) -> Option<&Var> {
+        let lazy = match self.lazy {
+            Some(ref lazy) => lazy,
+            None => {
+                let hash = fnv1a(FNV_OFFSET, path.as_bytes());
+                let start = self.path_hashes.partition_point(|&(h, _)| h < hash);
+                return self.path_hashes[start..]
+                    .iter()
+                    .take_while(|&&(h, _)| h == hash)
+                    .filter_map(|&(_, var_ref)| self.get_var(var_ref))
+                    .filter(|var| self.var_full_name(var) == path)
+                    .last();
+            }
+        };
         
-        // Add variable name (without bit range - it's stored separately in index)
-        path.push(var.name.clone());
-        
-        // Don't add bit range to match pywellen behavior
+        // Only the scopes named by a prefix of the path need decoding,
+        // trying the longest scope path first
+        let root = lazy.slots.len() - 1;
+        let find = |slot: usize, name: &str| {
+            self.slot_vars(lazy, slot).vars.iter().filter(|var| self.name(var.name) == name).last()
+        };
+        for (dot, _) in path.rmatch_indices('.') {
+            let (scope_path, name) = (&path[..dot], &path[dot + 1..]);
+            let hash = fnv1a(FNV_OFFSET, scope_path.as_bytes());
+            let start = lazy.scope_hashes.partition_point(|&(h, _)| h < hash);
+            let found = lazy.scope_hashes[start..]
+                .iter()
+                .take_while(|&&(h, _)| h == hash)
+                .filter(|&&(_, scope_ref)| self.scope_full_name(&self.scopes[scope_ref.0]) == scope_path)
+                .filter_map(|&(_, scope_ref)| find(scope_ref.0, name))
+                .last();
+            if found.is_some() {
+                return found;
+            }
+        }
+        find(root, path)
+    }
+    
+    pub fn scope_full_name(&self, scope: &Scope) -> String {
+        let mut path = vec![self.name(scope.name)];
+        let mut current = scope.parent;
+        while let Some(sr) = current {
+            match self.get_scope(sr) {
+                Some(parent) => {
+                    path.push(self.name(parent.name));
+                    current = parent.parent;
+                }
+                None => break,
+            }
+        }
+        path.reverse();
         path.join(".")
     }
-}
\ No newline at end of file
+    
+    pub fn var_full_name(&self, var: &Var) -> String {
+        // Variable name without bit range - it's stored separately in index,
+        // which matches pywellen behavior
+        match var.scope.and_then(|sr| self.get_scope(sr)) {
+            Some(scope) => format!("{}.{}", self.scope_full_name(scope), self.name(var.name)),
+            None => self.name(var.name).to_string(),
+        }
+    }
+}
+
+fn to_scope_ref(idx: u32) -> Option<ScopeRef> {
+    if idx == FST_FLAT_HIER_NO_SCOPE { None } else { Some(ScopeRef(idx as usize)) }
+}
+
+/// Var `i` of a flat export, its name already in an arena
+fn var_from_flat(flat: &FlatHier, i: usize, name: NameRef, index: Option<VarIndex>,
+                 scope: Option<ScopeRef>, signal_ref: SignalRef) -> Var {
+    let length = flat.var_length()[i];
+    Var {
+        name,
+        var_type: VarType::from_fst(flat.var_typ()[i]),
+        direction: VarDirection::from_fst(flat.var_direction()[i]),
+        length: if length > 0 { Some(length) } else { None },
+        signal_ref,
+        index,
+        scope,
+        fst_handle: flat.var_handle()[i],
+    }
+}
@@ -1,10 +1,11 @@
+mod cache;
 mod ffi;
 mod hierarchy;
 mod signal;
 mod waveform;
 
 use pyo3::prelude::*;
-use pyo3::types::PyString;
+use pyo3::types::{PyBytes, PyString};
 use pyo3::Bound;
 use std::sync::Arc;
 
@@ -131,6 +132,25 @@ impl PyHierarchy {
     fn file_format(&self) -> &str {
         &self.inner.file_format
     }
+    
+    fn var_by_path(&self, abs_hierarchy_path: &str) -> Option<PyVar> {
+        self.inner.var_by_path(abs_hierarchy_path).map(|v| PyVar {
+            inner: v.clone(),
+            hierarchy: self.inner.clone(),
+        })
+    }
+    
+    fn is_complete(&self) -> bool {
+        self.inner.is_complete()
+    }
+    
+    fn complete(&self, py: Python) {
+        py.allow_threads(|| self.inner.complete())
+    }
+    
+    fn complete_in_background(&self) {
+        self.inner.complete_in_background();
+    }
 }
 
 /// Python wrapper for Scope
@@ -144,21 +164,11 @@ struct PyScope {
 #[pymethods]
 impl PyScope {
     fn name(&self, _hier: &PyHierarchy) -> &str {
-        &self.inner.name
+        self.hierarchy.name(self.inner.name)
     }
     
     fn full_name(&self, _hier: &PyHierarchy) -> String {
-        // Build full path from parent scopes
-        let mut path = Vec::new();
-        let mut current = Some(&self.inner);
-        
-        while let Some(scope) = current {
-            path.push(scope.name.clone());
-            current = scope.parent.and_then(|p| self.hierarchy.get_scope(p));
-        }
-        
-        path.reverse();
-        path.join(".")
+        self.hierarchy.scope_full_name(&self.inner)
     }
     
     fn scope_type(&self) -> &str {
@@ -180,9 +190,9 @@ impl PyScope {
     }
     
     fn vars(&self, _hier: &PyHierarchy) -> PyVarIter {
-        let vars: Vec<PyVar> = self.inner.vars
-            .iter()
-            .filter_map(|&var_ref| self.hierarchy.get_var(var_ref))
+        let vars: Vec<PyVar> = self.hierarchy
+            .scope_vars(&self.inner)
+            .into_iter()
             .map(|v| PyVar {
                 inner: v.clone(),
                 hierarchy: self.hierarchy.clone(),
@@ -192,7 +202,8 @@ impl PyScope {
     }
     
     fn scopes(&self, _hier: &PyHierarchy) -> PyScopeIter {
-        let scopes: Vec<PyScope> = self.inner.children
+        let scopes: Vec<PyScope> = self.hierarchy
+            .scope_children(&self.inner)
             .iter()
             .filter_map(|&scope_ref| self.hierarchy.get_scope(scope_ref))
             .map(|s| PyScope {
@@ -215,7 +226,7 @@ struct PyVar {
 #[pymethods]
 impl PyVar {
     fn name(&self, _hier: &PyHierarchy) -> &str {
-        &self.inner.name
+        self.hierarchy.name(self.inner.name)
     }
     
     fn full_name(&self, _hier: &PyHierarchy) -> String {
@@ -363,11 +374,29 @@ impl PyScopeIter {
     }
 }
 
+/// Python form of a signal value, as Signal.value_at_time returns it
+fn value_to_py(py: Python, value: Option<SignalValue>) -> PyObject {
+    match value {
+        Some(SignalValue::Binary(bits)) => {
+            let value = SignalValue::Binary(bits);
+            match value.to_int() {
+                Some(val) => val.into_py(py),
+                None => value.to_string_repr().into_py(py),  // Too large for u64
+            }
+        }
+        Some(SignalValue::FourValue(s)) => s.into_py(py),
+        Some(SignalValue::Real(r)) => r.into_py(py),
+        Some(SignalValue::String(s)) => s.into_py(py),
+        None => py.None(),
+    }
+}
+
 /// Python wrapper for Signal
 #[pyclass(name = "Signal")]
 #[derive(Clone)]
 struct PySignal {
     inner: Arc<signal::Signal>,
+    signal_ref: SignalRef,  // Cache key, for unload_signals
 }
 
 #[pymethods]
@@ -410,6 +439,18 @@ impl PySignal {
         })
     }
     
+    #[pyo3(signature = (times, signed = false))]
+    fn sample_at_times(&self, times: Vec<u64>, signed: bool, py: Python) -> PyResult<PyObject> {
+        // One sweep over the changes, handed back as array('d') so no
+        // Python object is made per sample
+        let samples = py.allow_threads(|| self.inner.sample_at_times(&times, signed));
+        let bytes: Vec<u8> = samples.iter().flat_map(|value| value.to_ne_bytes()).collect();
+        let array = py.import_bound("array")?
+            .getattr("array")?
+            .call1(("d", PyBytes::new_bound(py, &bytes)))?;
+        Ok(array.unbind())
+    }
+    
     fn all_changes(&self) -> PySignalChangeIter {
         let changes: Vec<(u64, PyObject)> = Python::with_gil(|py| {
             self.inner.all_changes()
@@ -483,6 +524,10 @@ impl PySignal {
             next_time: result.next_time,
         }
     }
+    
+    fn memory_usage(&self) -> usize {
+        self.inner.memory_usage()
+    }
 }
 
 /// Python iterator for signal changes
@@ -527,17 +572,38 @@ struct PyQueryResult {
     next_time: Option<u64>,
 }
 
+/// Python wrapper for CacheStats
+#[pyclass(name = "CacheStats")]
+struct PyCacheStats {
+    #[pyo3(get)]
+    hits: u64,
+    #[pyo3(get)]
+    misses: u64,
+    #[pyo3(get)]
+    evictions: u64,
+    #[pyo3(get)]
+    evicted_bytes: u64,
+    #[pyo3(get)]
+    bytes: usize,
+    #[pyo3(get)]
+    entries: usize,
+    #[pyo3(get)]
+    budget: Option<usize>,
+}
+
 /// Python wrapper for TimeTable
 #[pyclass(name = "TimeTable")]
 #[derive(Clone)]
 struct PyTimeTable {
-    inner: signal::TimeTable,
+    inner: Arc<signal::TimeTable>,
 }
 
 #[pymethods]
 impl PyTimeTable {
-    fn __getitem__(&self, idx: usize) -> PyResult<u64> {
-        self.inner.get(idx)
+    fn __getitem__(&self, idx: isize) -> PyResult<u64> {
+        let idx = if idx < 0 { idx + self.inner.len() as isize } else { idx };
+        usize::try_from(idx).ok()
+            .and_then(|i| self.inner.get(i))
             .ok_or_else(|| PyErr::new::<pyo3::exceptions::PyIndexError, _>("Index out of range"))
     }
     
@@ -555,18 +621,22 @@ struct PyWaveform {
 #[pymethods]
 impl PyWaveform {
     #[new]
-    #[pyo3(signature = (path, multi_threaded = true, remove_scopes_with_empty_name = false, load_body = true))]
+    #[pyo3(signature = (path, multi_threaded = true, remove_scopes_with_empty_name = false, load_body = true, signal_cache_bytes = None, lazy_hierarchy = false))]
     fn new(
         path: &str,
         multi_threaded: bool,
         remove_scopes_with_empty_name: bool,
         load_body: bool,
+        signal_cache_bytes: Option<usize>,
+        lazy_hierarchy: bool,
     ) -> PyResult<Self> {
         let waveform = waveform::Waveform::new(
             path,
             multi_threaded,
             remove_scopes_with_empty_name,
             load_body,
+            signal_cache_bytes,
+            lazy_hierarchy,
         ).map_err(|e| PyErr::new::<pyo3::exceptions::PyIOError, _>(e))?;
         
         Ok(PyWaveform { inner: waveform })
@@ -584,6 +654,13 @@ impl PyWaveform {
         self.inner.time_range
     }
     
+    #[getter]
+    fn time_table(&self) -> PyResult<Option<PyTimeTable>> {
+        self.inner.time_table()
+            .map(|table| table.map(|inner| PyTimeTable { inner }))
+            .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))
+    }
+    
     fn load_body(&mut self) -> PyResult<()> {
         self.inner.load_body()
             .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))
@@ -597,7 +674,7 @@ impl PyWaveform {
         // Release GIL for I/O operation
         py.allow_threads(|| {
             self.inner.get_signal(&var.inner)
-                .map(|signal| PySignal { inner: signal })
+                .map(|signal| PySignal { inner: signal, signal_ref: var.inner.signal_ref })
                 .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))
         })
     }
@@ -605,7 +682,7 @@ impl PyWaveform {
     fn get_signal_from_path(&mut self, abs_hierarchy_path: &str, py: Python) -> PyResult<PySignal> {
         py.allow_threads(|| {
             self.inner.get_signal_from_path(abs_hierarchy_path)
-                .map(|signal| PySignal { inner: signal })
+                .map(|(signal_ref, signal)| PySignal { inner: signal, signal_ref })
                 .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))
         })
     }
@@ -617,7 +694,8 @@ impl PyWaveform {
             self.inner.load_signals(&rust_vars)
                 .map(|signals| {
                     signals.into_iter()
-                        .map(|s| PySignal { inner: s })
+                        .zip(&rust_vars)
+                        .map(|(s, var)| PySignal { inner: s, signal_ref: var.signal_ref })
                         .collect()
                 })
                 .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))
@@ -631,19 +709,54 @@ impl PyWaveform {
             self.inner.load_signals_multithreaded(&rust_vars)
                 .map(|signals| {
                     signals.into_iter()
-                        .map(|s| PySignal { inner: s })
+                        .zip(&rust_vars)
+                        .map(|(s, var)| PySignal { inner: s, signal_ref: var.signal_ref })
                         .collect()
                 })
                 .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))
         })
     }
     
+    fn values_at_time(&mut self, vars: Vec<PyVar>, time: u64, py: Python) -> PyResult<Vec<PyObject>> {
+        let rust_vars: Vec<_> = vars.iter().map(|v| v.inner.clone()).collect();
+        
+        let values = py.allow_threads(|| self.inner.values_at_time(&rust_vars, time))
+            .map_err(|e| PyErr::new::<pyo3::exceptions::PyRuntimeError, _>(e))?;
+        Ok(values.into_iter().map(|value| value_to_py(py, value)).collect())
+    }
+    
     fn unload_signals(&self, signals: Vec<PySignal>) {
         let refs: Vec<_> = signals.iter()
-            .map(|_| SignalRef(0)) // Would need proper tracking of signal refs
+            .map(|signal| signal.signal_ref)
             .collect();
         self.inner.unload_signals(&refs);
     }
+    
+    fn clear_signal_cache(&self) {
+        self.inner.clear_signal_cache();
+    }
+    
+    fn is_signal_cached(&self, var: &PyVar) -> bool {
+        self.inner.is_signal_cached(&var.inner)
+    }
+    
+    #[pyo3(signature = (budget_bytes = None))]
+    fn set_signal_cache_budget(&mut self, budget_bytes: Option<usize>) {
+        self.inner.set_cache_budget(budget_bytes);
+    }
+    
+    fn signal_cache_stats(&self) -> PyCacheStats {
+        let stats = self.inner.cache_stats();
+        PyCacheStats {
+            hits: stats.hits,
+            misses: stats.misses,
+            evictions: stats.evictions,
+            evicted_bytes: stats.evicted_bytes,
+            bytes: stats.bytes,
+            entries: stats.entries,
+            budget: stats.budget,
+        }
+    }
 }
 
 /// Python module definition
@@ -662,6 +775,7 @@ fn pylibfst(m: &Bound<'_, PyModule>) -> PyResult<()> {
     m.add_class::<PyScopeIter>()?;
     m.add_class::<PySignalChangeIter>()?;
     m.add_class::<PyQueryResult>()?;
+    m.add_class::<PyCacheStats>()?;
     
     // Alias classes to match pywellen naming
     m.add("Waveform", m.getattr("Waveform")?)?;
@@ -677,6 +791,7 @@ fn pylibfst(m: &Bound<'_, PyModule>) -> PyResult<()> {
     m.add("ScopeIter", m.getattr("ScopeIter")?)?;
     m.add("SignalChangeIter", m.getattr("SignalChangeIter")?)?;
     m.add("QueryResult", m.getattr("QueryResult")?)?;
+    m.add("CacheStats", m.getattr("CacheStats")?)?;
     
     Ok(())
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
-use std::collections::BTreeMap;
-use std::sync::{Arc, Mutex};
+use std::sync::{Arc, Mutex, OnceLock};
 
-use crate::ffi::{FstHandle, FstReader, FstValueChangeCb};
+use rayon::prelude::*;
+
+use crate::cache::{CacheStats, SignalCache};
+use crate::ffi::{FstColumn, FstHandle, FstReader, BLOCK_CACHE_BYTES, FST_CE_BITS2, FST_CE_BYTES, FST_CE_DOUBLE, FST_COLUMN_STATES};
 use crate::hierarchy::SignalRef;
 
 /// Signal value enumeration
@@ -56,6 +58,25 @@ impl SignalValue {
         }
     }
     
+    /// Numeric reading for sampling: bit vectors as unsigned, or two's
+    /// complement when `signed`, reals as they are, text that spells a
+    /// number as that number, NaN for anything holding x/z or other states
+    pub fn to_numeric(&self, signed: bool) -> f64 {
+        match self {
+            SignalValue::Binary(bits) => bits_to_numeric(bits, signed),
+            SignalValue::Real(r) => *r,
+            SignalValue::FourValue(_) => f64::NAN,
+            SignalValue::String(s) => {
+                let s = s.trim();
+                if s.contains(|c| c == '.' || c == 'e' || c == 'E') {
+                    s.parse::<f64>().unwrap_or(f64::NAN)
+                } else {
+                    s.parse::<i128>().map(|v| v as f64).unwrap_or(f64::NAN)
+                }
+            }
+        }
+    }
+    
     /// Convert to string representation
     pub fn to_string_repr(&self) -> String {
         match self {
@@ -69,79 +90,406 @@ impl SignalValue {
     }
 }
 
-/// Signal change (time, value) pair
+/// Packed per-bit state codes: index into FST_COLUMN_STATES ("01xzhuwl-?")
+fn state_code(c: u8) -> Option<u8> {
+    match c {
+        b'0' => Some(0),
+        b'1' => Some(1),
+        b'x' | b'X' => Some(2),
+        b'z' | b'Z' => Some(3),
+        b'h' | b'H' => Some(4),
+        b'u' | b'U' => Some(5),
+        b'w' | b'W' => Some(6),
+        b'l' | b'L' => Some(7),
+        b'-' => Some(8),
+        b'?' => Some(9),
+        _ => None,
+    }
+}
+
+/// Bits per bit needed to hold the given codes: 1 for 0/1, 2 for 0/1/x/z, 4 otherwise
+fn bits_per_bit_for(codes: &[u8]) -> usize {
+    match codes.iter().copied().max().unwrap_or(0) {
+        0..=1 => 1,
+        2..=3 => 2,
+        _ => 4,
+    }
+}
+
+/// Pack per-bit codes MSB first at `bpb` bits each into a zeroed buffer
+fn pack_codes(dst: &mut [u8], codes: &[u8], bpb: usize) {
+    for (j, &code) in codes.iter().enumerate() {
+        let bit = j * bpb;
+        dst[bit / 8] |= code << (8 - bpb - bit % 8);
+    }
+}
+
+/// Inverse of `pack_codes`
+fn unpack_codes(src: &[u8], width: usize, bpb: usize, out: &mut Vec<u8>) {
+    let mask = ((1u16 << bpb) - 1) as u8;
+    out.clear();
+    out.extend((0..width).map(|j| {
+        let bit = j * bpb;
+        (src[bit / 8] >> (8 - bpb - bit % 8)) & mask
+    }));
+}
+
+/// Numeric value of 0/1 codes MSB first, NaN if any code is another state.
+/// Up to 64 bits are summed exactly and rounded once.
+fn bits_to_numeric(codes: &[u8], signed: bool) -> f64 {
+    let mut exact = 0u64;
+    let mut wide = 0f64;
+    for &code in codes {
+        if code > 1 {
+            return f64::NAN;
+        }
+        exact = exact.wrapping_shl(1) | code as u64;
+        wide = wide * 2.0 + code as f64;
+    }
+    let value = if codes.len() <= 64 { exact as f64 } else { wide };
+    if signed && codes.first() == Some(&1) {
+        value - 2f64.powi(codes.len() as i32)
+    } else {
+        value
+    }
+}
+
+/// Value storage of a signal, one contiguous buffer per kind of signal
 #[derive(Debug, Clone)]
-pub struct SignalChange {
-    pub time: u64,
-    pub value: SignalValue,
+enum SignalStorage {
+    /// No changes recorded yet
+    Empty,
+    /// Fixed width bit vectors, `bits_per_bit` (1, 2 or 4) bits per bit and
+    /// `stride` bytes per change. Widened in place the first time x/z (or
+    /// another 9-state value) shows up, so 2-state signals stay at 1 bit.
+    Bits { width: usize, bits_per_bit: usize, stride: usize, data: Vec<u8> },
+    /// Real numbers
+    Real(Vec<f64>),
+    /// Variable length values, change `i` is `data[offs[i]..offs[i + 1]]`
+    Text { is_string: bool, offs: Vec<u32>, data: Vec<u8> },
+    /// Changes that do not share one kind or width, kept unpacked
+    Values(Vec<SignalValue>),
 }
 
 /// Signal structure containing all transitions
 #[derive(Debug, Clone)]
 pub struct Signal {
-    pub changes: Vec<SignalChange>,
+    time_table: Arc<TimeTable>,
+    times: Vec<u32>,  // Indices into `time_table`, one per change
+    storage: SignalStorage,
 }
 
 impl Signal {
-    pub fn new() -> Self {
+    pub fn new(time_table: Arc<TimeTable>) -> Self {
         Signal {
-            changes: Vec::new(),
+            time_table,
+            times: Vec::new(),
+            storage: SignalStorage::Empty,
         }
     }
     
     /// Create a new signal with pre-allocated capacity
-    pub fn with_capacity(capacity: usize) -> Self {
+    pub fn with_capacity(time_table: Arc<TimeTable>, capacity: usize) -> Self {
         Signal {
-            changes: Vec::with_capacity(capacity),
+            time_table,
+            times: Vec::with_capacity(capacity),
+            storage: SignalStorage::Empty,
+        }
+    }
+    
+    /// Number of transitions
+    pub fn len(&self) -> usize {
+        self.times.len()
+    }
+    
+    pub fn is_empty(&self) -> bool {
+        self.times.is_empty()
+    }
+    
+    /// Approximate heap and inline size of this signal in bytes
+    pub fn memory_usage(&self) -> usize {
+        let storage = match &self.storage {
+            SignalStorage::Empty => 0,
+            SignalStorage::Bits { data, .. } => data.capacity(),
+            SignalStorage::Real(values) => values.capacity() * std::mem::size_of::<f64>(),
+            SignalStorage::Text { offs, data, .. } => offs.capacity() * std::mem::size_of::<u32>() + data.capacity(),
+            SignalStorage::Values(values) => values.capacity() * std::mem::size_of::<SignalValue>()
+                + values.iter().map(|v| match v {
+                    SignalValue::Binary(bits) => bits.capacity(),
+                    SignalValue::FourValue(s) | SignalValue::String(s) => s.capacity(),
+                    SignalValue::Real(_) => 0,
+                }).sum::<usize>(),
+        };
+        std::mem::size_of::<Signal>() + self.times.capacity() * std::mem::size_of::<u32>() + storage
+    }
+    
+    /// Release spare capacity left over from loading
+    pub fn shrink_to_fit(&mut self) {
+        self.times.shrink_to_fit();
+        match &mut self.storage {
+            SignalStorage::Empty => {}
+            SignalStorage::Bits { data, .. } => data.shrink_to_fit(),
+            SignalStorage::Real(values) => values.shrink_to_fit(),
+            SignalStorage::Text { offs, data, .. } => {
+                offs.shrink_to_fit();
+                data.shrink_to_fit();
+            }
+            SignalStorage::Values(values) => values.shrink_to_fit(),
+        }
+    }
+    
+    /// Add a change given as per-bit codes (indices into FST_COLUMN_STATES)
+    pub fn add_bits(&mut self, time_idx: u32, codes: &[u8]) {
+        let needed = bits_per_bit_for(codes);
+        
+        if let SignalStorage::Empty = self.storage {
+            self.storage = SignalStorage::Bits {
+                width: codes.len(),
+                bits_per_bit: needed,
+                stride: (codes.len() * needed + 7) / 8,
+                data: Vec::with_capacity(self.times.capacity() * ((codes.len() * needed + 7) / 8)),
+            };
+        }
+        
+        match self.storage {
+            SignalStorage::Bits { width, bits_per_bit, .. } if width == codes.len() => {
+                if needed > bits_per_bit {
+                    self.widen_bits(needed);
+                }
+                if let SignalStorage::Bits { bits_per_bit, stride, ref mut data, .. } = self.storage {
+                    let start = data.len();
+                    data.resize(start + stride, 0);
+                    pack_codes(&mut data[start..], codes, bits_per_bit);
+                }
+                self.times.push(time_idx);
+            }
+            _ => {
+                let value = if needed == 1 {
+                    SignalValue::Binary(codes.to_vec())
+                } else {
+                    SignalValue::FourValue(codes.iter().map(|&c| FST_COLUMN_STATES[c as usize] as char).collect())
+                };
+                self.add_unpacked(time_idx, value);
+            }
+        }
+    }
+    
+    /// Add a real valued change
+    pub fn add_real(&mut self, time_idx: u32, value: f64) {
+        if let SignalStorage::Empty = self.storage {
+            self.storage = SignalStorage::Real(Vec::with_capacity(self.times.capacity()));
+        }
+        
+        match self.storage {
+            SignalStorage::Real(ref mut values) => {
+                values.push(value);
+                self.times.push(time_idx);
+            }
+            _ => self.add_unpacked(time_idx, SignalValue::Real(value)),
+        }
+    }
+    
+    /// Add a variable length change
+    pub fn add_text(&mut self, time_idx: u32, bytes: &[u8], is_string: bool) {
+        if let SignalStorage::Empty = self.storage {
+            self.storage = SignalStorage::Text { is_string, offs: vec![0], data: Vec::new() };
+        }
+        
+        match self.storage {
+            SignalStorage::Text { is_string: text_is_string, ref mut offs, ref mut data } if text_is_string == is_string => {
+                data.extend_from_slice(bytes);
+                offs.push(data.len() as u32);
+                self.times.push(time_idx);
+            }
+            _ => {
+                let value_str = String::from_utf8_lossy(bytes);
+                self.add_unpacked(time_idx, SignalValue::from_fst_string(&value_str, false, is_string));
+            }
         }
     }
     
     /// Add a change to the signal
-    pub fn add_change(&mut self, time: u64, value: SignalValue) {
-        self.changes.push(SignalChange { time, value });
+    pub fn add_change(&mut self, time_idx: u32, value: SignalValue) {
+        match value {
+            SignalValue::Binary(bits) if bits.iter().all(|&b| b <= 1) => self.add_bits(time_idx, &bits),
+            SignalValue::FourValue(s) => {
+                match s.bytes().map(state_code).collect::<Option<Vec<u8>>>() {
+                    Some(codes) => self.add_bits(time_idx, &codes),
+                    None => self.add_unpacked(time_idx, SignalValue::FourValue(s)),
+                }
+            }
+            SignalValue::Real(r) => self.add_real(time_idx, r),
+            SignalValue::String(s) => self.add_text(time_idx, s.as_bytes(), true),
+            value => self.add_unpacked(time_idx, value),
+        }
+    }
+    
+    /// Re-pack all bit vector changes at a wider per-bit code
+    fn widen_bits(&mut self, new_bpb: usize) {
+        if let SignalStorage::Bits { width, bits_per_bit, stride, data } = &mut self.storage {
+            let new_stride = (*width * new_bpb + 7) / 8;
+            let count = data.len() / (*stride).max(1);
+            let mut widened = vec![0u8; count * new_stride];
+            let mut codes = Vec::with_capacity(*width);
+            for i in 0..count {
+                unpack_codes(&data[i * *stride..(i + 1) * *stride], *width, *bits_per_bit, &mut codes);
+                pack_codes(&mut widened[i * new_stride..(i + 1) * new_stride], &codes, new_bpb);
+            }
+            *data = widened;
+            *bits_per_bit = new_bpb;
+            *stride = new_stride;
+        }
+    }
+    
+    /// Fall back to unpacked values once a change does not fit the packed layout
+    fn add_unpacked(&mut self, time_idx: u32, value: SignalValue) {
+        if !matches!(self.storage, SignalStorage::Values(_)) {
+            let values: Vec<SignalValue> = (0..self.times.len()).filter_map(|i| self.value_at_idx(i)).collect();
+            self.storage = SignalStorage::Values(values);
+        }
+        if let SignalStorage::Values(ref mut values) = self.storage {
+            values.push(value);
+        }
+        self.times.push(time_idx);
     }
     
     /// Get value at specific time using binary search
-    pub fn value_at_time(&self, time: u64) -> Option<&SignalValue> {
-        if self.changes.is_empty() {
+    pub fn value_at_time(&self, time: u64) -> Option<SignalValue> {
+        // Last change at or before the given time, None before the first change
+        match self.changes_at_or_before(time) {
+            0 => None,
+            n => self.value_at_idx(n - 1),
+        }
+    }
+    
+    /// Number of changes at or before `time`, found by index in the time table
+    fn changes_at_or_before(&self, time: u64) -> usize {
+        match u32::try_from(self.time_table.count_at_or_before(time)) {
+            Ok(limit) => self.times.partition_point(|&ti| ti < limit),
+            Err(_) => self.times.len(),
+        }
+    }
+    
+    /// Get value at specific index
+    pub fn value_at_idx(&self, idx: usize) -> Option<SignalValue> {
+        if idx >= self.times.len() {
             return None;
         }
         
-        // Binary search for the last change at or before the given time
-        let idx = match self.changes.binary_search_by_key(&time, |c| c.time) {
-            Ok(idx) => idx,
-            Err(idx) => {
-                if idx == 0 {
-                    return None; // Time is before first change
+        match &self.storage {
+            SignalStorage::Empty => None,
+            SignalStorage::Bits { width, bits_per_bit, stride, data } => {
+                let mut codes = Vec::with_capacity(*width);
+                unpack_codes(&data[idx * stride..(idx + 1) * stride], *width, *bits_per_bit, &mut codes);
+                if *bits_per_bit == 1 || codes.iter().all(|&c| c <= 1) {
+                    Some(SignalValue::Binary(codes))
+                } else {
+                    Some(SignalValue::FourValue(codes.iter().map(|&c| FST_COLUMN_STATES[c as usize] as char).collect()))
                 }
-                idx - 1
             }
-        };
+            SignalStorage::Real(values) => Some(SignalValue::Real(values[idx])),
+            SignalStorage::Text { is_string, offs, data } => {
+                let value_str = String::from_utf8_lossy(&data[offs[idx] as usize..offs[idx + 1] as usize]);
+                Some(SignalValue::from_fst_string(&value_str, false, *is_string))
+            }
+            SignalStorage::Values(values) => values.get(idx).cloned(),
+        }
+    }
+    
+    /// Numeric value of change `idx`, see `SignalValue::to_numeric`; read
+    /// straight from packed storage without building a SignalValue
+    fn numeric_at_idx(&self, idx: usize, signed: bool, codes: &mut Vec<u8>) -> f64 {
+        match &self.storage {
+            SignalStorage::Bits { width, bits_per_bit, stride, data } => {
+                unpack_codes(&data[idx * stride..(idx + 1) * stride], *width, *bits_per_bit, codes);
+                bits_to_numeric(codes, signed)
+            }
+            SignalStorage::Real(values) => values[idx],
+            _ => self.value_at_idx(idx).map_or(f64::NAN, |value| value.to_numeric(signed)),
+        }
+    }
+    
+    /// Numeric values at each of `times`, NaN before the first change. Times
+    /// are swept in one pass when ascending: the change cursor gallops
+    /// forward from the previous sample, so the cost stays close to
+    /// linear in changes plus samples; a step backwards searches afresh.
+    pub fn sample_at_times(&self, times: &[u64], signed: bool) -> Vec<f64> {
+        let table = self.time_table.times();
+        let change_time = |i: usize| table[self.times[i] as usize];
+        let mut samples = Vec::with_capacity(times.len());
+        let mut codes = Vec::new();
+        let mut pos = 0;            // Changes at or before the previous sample
+        let mut prev_time = 0;
+        let mut last: Option<(usize, f64)> = None;
+        
+        for &time in times {
+            if time < prev_time {
+                pos = self.changes_at_or_before(time);
+            } else {
+                let mut step = 1;
+                while pos + step <= self.times.len() && change_time(pos + step - 1) <= time {
+                    pos += step;
+                    step *= 2;
+                }
+                let end = (pos + step).min(self.times.len());
+                pos += self.times[pos..end].partition_point(|&ti| table[ti as usize] <= time);
+            }
+            prev_time = time;
+            
+            let value = match (pos, last) {
+                (0, _) => f64::NAN,
+                (n, Some((idx, value))) if idx == n - 1 => value,
+                (n, _) => self.numeric_at_idx(n - 1, signed, &mut codes),
+            };
+            if pos > 0 {
+                last = Some((pos - 1, value));
+            }
+            samples.push(value);
+        }
         
-        Some(&self.changes[idx].value)
+        samples
     }
     
-    /// Get value at specific index
-    pub fn value_at_idx(&self, idx: usize) -> Option<&SignalValue> {
-        self.changes.get(idx).map(|c| &c.value)
+    /// Time of the change at a specific index
+    pub fn time_at_idx(&self, idx: usize) -> Option<u64> {
+        self.times.get(idx).and_then(|&ti| self.time_table.get(ti as usize))
+    }
+    
+    /// Time table indices of all changes, comparable across signals of one file
+    pub fn time_indices(&self) -> &[u32] {
+        &self.times
+    }
+    
+    /// The file's time table the change indices point into
+    pub fn time_table(&self) -> &Arc<TimeTable> {
+        &self.time_table
     }
     
     /// Iterator over all signal transitions
-    pub fn all_changes(&self) -> impl Iterator<Item = (u64, &SignalValue)> {
-        self.changes.iter().map(|c| (c.time, &c.value))
+    pub fn all_changes(&self) -> impl Iterator<Item = (u64, SignalValue)> + '_ {
+        self.all_changes_from_idx(0)
     }
     
     /// Iterator over changes after a specific time
-    pub fn all_changes_after(&self, start_time: u64) -> impl Iterator<Item = (u64, &SignalValue)> {
-        let start_idx = self.changes.binary_search_by_key(&start_time, |c| c.time)
-            .unwrap_or_else(|idx| idx);
+    pub fn all_changes_after(&self, start_time: u64) -> impl Iterator<Item = (u64, SignalValue)> + '_ {
+        let start_idx = match start_time {
+            0 => 0,
+            t => self.changes_at_or_before(t - 1),
+        };
         
-        self.changes[start_idx..].iter().map(|c| (c.time, &c.value))
+        self.all_changes_from_idx(start_idx)
+    }
+    
+    fn all_changes_from_idx(&self, start_idx: usize) -> impl Iterator<Item = (u64, SignalValue)> + '_ {
+        (start_idx..self.times.len()).filter_map(move |i| {
+            let time = self.time_table.get(self.times[i] as usize)?;
+            self.value_at_idx(i).map(|v| (time, v))
+        })
     }
     
     /// Query signal at specific time
     pub fn query_signal(&self, query_time: u64) -> QueryResult {
-        if self.changes.is_empty() {
+        if self.times.is_empty() {
             return QueryResult {
                 value: None,
                 actual_time: None,
@@ -150,47 +498,28 @@ impl Signal {
             };
         }
         
-        let idx = match self.changes.binary_search_by_key(&query_time, |c| c.time) {
-            Ok(idx) => {
-                // Exact match
-                let next_idx = if idx + 1 < self.changes.len() {
-                    Some(idx + 1)
-                } else {
-                    None
-                };
-                let next_time = next_idx.map(|i| self.changes[i].time);
-                
-                return QueryResult {
-                    value: Some(self.changes[idx].value.clone()),
-                    actual_time: Some(self.changes[idx].time),
-                    next_idx,
-                    next_time,
-                };
-            }
-            Err(idx) => idx,
+        // Changes before `idx` are at or before the query time
+        let idx = self.changes_at_or_before(query_time);
+        let next_idx = if idx < self.times.len() {
+            Some(idx)
+        } else {
+            None
         };
+        let next_time = next_idx.and_then(|i| self.time_at_idx(i));
         
         if idx == 0 {
             // Query time is before first change
             QueryResult {
                 value: None,
                 actual_time: None,
-                next_idx: Some(0),
-                next_time: Some(self.changes[0].time),
+                next_idx,
+                next_time,
             }
         } else {
-            // Return the last change before query time
-            let prev_idx = idx - 1;
-            let next_idx = if idx < self.changes.len() {
-                Some(idx)
-            } else {
-                None
-            };
-            let next_time = next_idx.map(|i| self.changes[i].time);
-            
+            // Return the last change at or before query time
             QueryResult {
-                value: Some(self.changes[prev_idx].value.clone()),
-                actual_time: Some(self.changes[prev_idx].time),
+                value: self.value_at_idx(idx - 1),
+                actual_time: self.time_at_idx(idx - 1),
                 next_idx,
                 next_time,
             }
@@ -207,7 +536,8 @@ pub struct QueryResult {
     pub next_time: Option<u64>,
 }
 
-/// Time table for compressed time representation
+/// Every distinct time of a file in ascending order, shared by its signals
+/// which store u32 indices into it instead of full times
 #[derive(Debug, Clone)]
 pub struct TimeTable {
     times: Vec<u64>,
@@ -233,6 +563,33 @@ impl TimeTable {
     pub fn is_empty(&self) -> bool {
         self.times.is_empty()
     }
+    
+    pub fn times(&self) -> &[u64] {
+        &self.times
+    }
+    
+    /// Number of entries at or before `time`
+    pub fn count_at_or_before(&self, time: u64) -> usize {
+        self.times.partition_point(|&t| t <= time)
+    }
+    
+    /// Index of `time`, searched forward from index `from`; the galloping
+    /// step keeps a walk over ascending times close to linear
+    pub fn seek(&self, from: usize, time: u64) -> Option<usize> {
+        let times = &self.times[from.min(self.times.len())..];
+        let mut hi = 1;
+        while hi < times.len() && times[hi - 1] < time {
+            hi *= 2;
+        }
+        let lo = hi / 2;
+        let hi = hi.min(times.len());
+        let idx = lo + times[lo..hi].partition_point(|&t| t < time);
+        if idx < times.len() && times[idx] == time {
+            Some(from + idx)
+        } else {
+            None
+        }
+    }
 }
 
 // C callback context for signal loading
@@ -242,82 +599,80 @@ struct SignalLoadContext {
     is_string: bool,
 }
 
-// C callback function for FST value changes
-unsafe extern "C" fn signal_callback(
-    user_data: *mut std::os::raw::c_void,
-    time: u64,
-    _handle: FstHandle,
-    value: *const u8,  // const unsigned char *
-) {
-    let ctx = &*(user_data as *const SignalLoadContext);
-    
-    // Direct access to signal without mutex lock
-    let signal = &mut *ctx.signal;
-    
-    if value.is_null() {
-        signal.add_change(time, SignalValue::String(String::new()));
-        return;
-    }
-    
-    // Find the null terminator more efficiently
-    let mut len = 0;
-    while *value.add(len) != 0 {
-        len += 1;
-    }
-    
-    // Get the bytes directly
-    let bytes = std::slice::from_raw_parts(value, len);
+/// Append one block's worth of changes for a signal, moving the packed
+/// column values into the signal's own packed storage and block times to
+/// indices in the file's time table
+unsafe fn append_column(signal: &mut Signal, col: &FstColumn, is_real: bool, is_string: bool) {
+    let count = col.count as usize;
+    let times = std::slice::from_raw_parts(col.times, col.times_count as usize);
+    let time_idx = std::slice::from_raw_parts(col.time_idx, count);
+    
+    // Column times ascend, so each lookup resumes where the previous one ended
+    let table = signal.time_table.clone();
+    let mut cursor = 0;
+    let mut global_idx = |ti: u32| {
+        let found = table.seek(cursor, times[ti as usize])?;
+        cursor = found;
+        u32::try_from(found).ok()
+    };
     
-    // Fast path for real signals - parse directly from bytes
-    if ctx.is_real {
-        // Parse float directly from bytes without String allocation
-        // Use std::str::from_utf8 which doesn't allocate
-        if let Ok(s) = std::str::from_utf8(bytes) {
-            if let Ok(val) = s.parse::<f64>() {
-                signal.add_change(time, SignalValue::Real(val));
-                return;
+    match col.encoding {
+        FST_CE_DOUBLE => {
+            for (c, &ti) in time_idx.iter().enumerate() {
+                let val = std::ptr::read_unaligned(col.values.add(c * 8) as *const f64);
+                if let Some(gi) = global_idx(ti) {
+                    signal.add_real(gi, val);
+                }
             }
         }
-        // Fall through to string path if parsing fails
-    }
-    
-    // Fast path for binary signals (most common case)
-    if !ctx.is_real && !ctx.is_string {
-        // Quick check: if first byte is 0 or 1, likely binary
-        // Only do full check if it looks binary
-        if len > 0 && (bytes[0] == b'0' || bytes[0] == b'1') {
-            let mut is_binary = true;
-            let mut binary = Vec::with_capacity(len);
-            
-            for &b in bytes {
-                if b == b'0' {
-                    binary.push(0);
-                } else if b == b'1' {
-                    binary.push(1);
-                } else {
-                    is_binary = false;
-                    break;
+        FST_CE_BYTES => {
+            let offs = std::slice::from_raw_parts(col.value_offs, count + 1);
+            for (c, &ti) in time_idx.iter().enumerate() {
+                let bytes = std::slice::from_raw_parts(
+                    col.values.add(offs[c] as usize),
+                    (offs[c + 1] - offs[c]) as usize,
+                );
+                if let Some(gi) = global_idx(ti) {
+                    signal.add_text(gi, bytes, is_string);
                 }
             }
+        }
+        _ => {
+            let len = col.len as usize;
+            let bpb = if col.encoding == FST_CE_BITS2 { 2 } else { 4 };
+            let stride = col.value_stride as usize;
+            let values = std::slice::from_raw_parts(col.values, count * stride);
+            let mut codes = Vec::with_capacity(len);
             
-            if is_binary {
-                signal.add_change(time, SignalValue::Binary(binary));
-                return;
+            for (c, &ti) in time_idx.iter().enumerate() {
+                let gi = match global_idx(ti) {
+                    Some(gi) => gi,
+                    None => continue,
+                };
+                unpack_codes(&values[c * stride..(c + 1) * stride], len, bpb, &mut codes);
+                if is_string || is_real {
+                    let chars: Vec<u8> = codes.iter().map(|&c| FST_COLUMN_STATES[c as usize]).collect();
+                    signal.add_text(gi, &chars, is_string);
+                } else {
+                    signal.add_bits(gi, &codes);
+                }
             }
         }
     }
+}
+
+// C callback function for FST value change columns
+unsafe extern "C" fn signal_callback(user_data: *mut std::os::raw::c_void, col: *const FstColumn) {
+    let ctx = &*(user_data as *const SignalLoadContext);
     
-    // Only allocate string for non-binary/non-real cases
-    let value_str = String::from_utf8_lossy(bytes);
-    let signal_value = SignalValue::from_fst_string(&value_str, ctx.is_real, ctx.is_string);
-    
-    // Add change directly without locking
-    signal.add_change(time, signal_value);
+    // Direct access to signal without mutex lock
+    append_column(&mut *ctx.signal, &*col, ctx.is_real, ctx.is_string);
 }
 
 /// Load signal from FST file
 pub fn load_signal_from_fst(
     reader: &FstReader,
+    time_table: &Arc<TimeTable>,
     handle: FstHandle,
     is_real: bool,
     is_string: bool,
@@ -325,7 +680,7 @@ pub fn load_signal_from_fst(
     // Create signal with pre-allocated capacity for better performance
     // Use larger capacity for real signals which often have many transitions
     let capacity = if is_real { 10240 } else { 1024 };
-    let mut signal = Signal::with_capacity(capacity);
+    let mut signal = Signal::with_capacity(time_table.clone(), capacity);
     
     // Create context with raw pointer to the signal
     let ctx = SignalLoadContext {
@@ -340,10 +695,11 @@ pub fn load_signal_from_fst(
     
     // Load signal data
     let ctx_ptr = &ctx as *const _ as *mut std::os::raw::c_void;
-    if !reader.iterate_blocks(Some(signal_callback), ctx_ptr) {
+    if !reader.iterate_columns(Some(signal_callback), ctx_ptr) {
         return Err("Failed to iterate blocks".to_string());
     }
     
+    signal.shrink_to_fit();
     Ok(signal)
 }
 
@@ -353,81 +709,26 @@ struct BatchLoadContext {
     signal_types: std::collections::HashMap<FstHandle, (bool, bool)>, // (is_real, is_string)
 }
 
-// Batch callback function for multiple signals
-unsafe extern "C" fn batch_signal_callback(
-    user_data: *mut std::os::raw::c_void,
-    time: u64,
-    handle: FstHandle,
-    value: *const u8,
-) {
+// Batch callback function for multiple signals, one call per signal and block
+unsafe extern "C" fn batch_signal_callback(user_data: *mut std::os::raw::c_void, col: *const FstColumn) {
     let ctx = &*(user_data as *const BatchLoadContext);
+    let col = &*col;
     
     // Find the signal for this handle
-    if let Some(&signal_ptr) = ctx.signals.get(&handle) {
-        let signal = &mut *signal_ptr;
-        
+    if let Some(&signal_ptr) = ctx.signals.get(&col.handle) {
         // Get signal type info
-        let (is_real, is_string) = ctx.signal_types.get(&handle)
+        let (is_real, is_string) = ctx.signal_types.get(&col.handle)
             .copied()
             .unwrap_or((false, false));
         
-        if value.is_null() {
-            signal.add_change(time, SignalValue::String(String::new()));
-            return;
-        }
-        
-        // Find the null terminator
-        let mut len = 0;
-        while *value.add(len) != 0 {
-            len += 1;
-        }
-        
-        let bytes = std::slice::from_raw_parts(value, len);
-        
-        // Fast path for real signals
-        if is_real {
-            if let Ok(s) = std::str::from_utf8(bytes) {
-                if let Ok(val) = s.parse::<f64>() {
-                    signal.add_change(time, SignalValue::Real(val));
-                    return;
-                }
-            }
-        }
-        
-        // Fast path for binary signals
-        if !is_real && !is_string {
-            if len > 0 && (bytes[0] == b'0' || bytes[0] == b'1') {
-                let mut is_binary = true;
-                let mut binary = Vec::with_capacity(len);
-                
-                for &b in bytes {
-                    if b == b'0' {
-                        binary.push(0);
-                    } else if b == b'1' {
-                        binary.push(1);
-                    } else {
-                        is_binary = false;
-                        break;
-                    }
-                }
-                
-                if is_binary {
-                    signal.add_change(time, SignalValue::Binary(binary));
-                    return;
-                }
-            }
-        }
-        
-        // Default: parse as string
-        let value_str = String::from_utf8_lossy(bytes);
-        let signal_value = SignalValue::from_fst_string(&value_str, is_real, is_string);
-        signal.add_change(time, signal_value);
+        append_column(&mut *signal_ptr, col, is_real, is_string);
     }
 }
 
 /// Load multiple signals from FST file in a single scan
 pub fn load_signals_batch_from_fst(
     reader: &FstReader,
+    time_table: &Arc<TimeTable>,
     requests: &[(SignalRef, FstHandle, bool, bool)],
 ) -> Vec<(SignalRef, Signal)> {
     use std::collections::HashMap;
@@ -444,7 +745,7 @@ pub fn load_signals_batch_from_fst(
     for &(ref_id, handle, is_real, is_string) in requests {
         // Pre-allocate capacity based on signal type
         let capacity = if is_real { 10240 } else { 1024 };
-        signals.insert(handle, Box::new(Signal::with_capacity(capacity)));
+        signals.insert(handle, Box::new(Signal::with_capacity(time_table.clone(), capacity)));
         signal_refs.insert(handle, ref_id);
         signal_types.insert(handle, (is_real, is_string));
         
@@ -465,12 +766,13 @@ pub fn load_signals_batch_from_fst(
     
     // Load all signals in a single iteration
     let ctx_ptr = &ctx as *const _ as *mut std::os::raw::c_void;
-    reader.iterate_blocks(Some(batch_signal_callback), ctx_ptr);
+    reader.iterate_columns(Some(batch_signal_callback), ctx_ptr);
     
     // Convert to result vector
     let mut results = Vec::new();
-    for (handle, signal) in signals {
+    for (handle, mut signal) in signals {
         if let Some(&ref_id) = signal_refs.get(&handle) {
+            signal.shrink_to_fit();
             results.push((ref_id, *signal));
         }
     }
@@ -478,19 +780,71 @@ pub fn load_signals_batch_from_fst(
     results
 }
 
+/// Decode threads for a load that scans the file once on one reader; one
+/// consumer rarely keeps more than a handful of them busy
+const SCAN_DECODE_THREADS_MAX: usize = 8;
+
+/// Cloned FST readers handed out to loads, one per concurrent load
+struct ReaderPool {
+    template: Option<FstReader>,  // Clone source, never iterated itself
+    idle: Mutex<Vec<FstReader>>,
+}
+
 /// Signal source for loading and caching signals
 pub struct SignalSource {
     reader: Arc<FstReader>,
-    signal_cache: Arc<Mutex<BTreeMap<SignalRef, Arc<Signal>>>>,
-    reader_lock: Arc<Mutex<()>>,  // Mutex to serialize FST reader access
+    time_table: OnceLock<Arc<TimeTable>>,  // Built by the first load, see time_table()
+    signal_cache: Arc<Mutex<SignalCache>>,
+    readers: ReaderPool,
+    reader_lock: Arc<Mutex<()>>,  // Serializes access to `reader` when it cannot be cloned
+    scan_threads: usize,          // Decode threads for single-scan loads
 }
 
 impl SignalSource {
-    pub fn new(reader: Arc<FstReader>) -> Self {
+    /// `cache_budget` caps the bytes held by cached signals, None for no limit
+    pub fn new(reader: Arc<FstReader>, cache_budget: Option<usize>) -> Self {
+        let template = reader.try_clone();
         SignalSource {
             reader,
-            signal_cache: Arc::new(Mutex::new(BTreeMap::new())),
+            time_table: OnceLock::new(),
+            signal_cache: Arc::new(Mutex::new(SignalCache::new(cache_budget))),
+            readers: ReaderPool {
+                template,
+                idle: Mutex::new(Vec::new()),
+            },
             reader_lock: Arc::new(Mutex::new(())),
+            scan_threads: std::thread::available_parallelism()
+                .map(|n| n.get())
+                .unwrap_or(1)
+                .min(SCAN_DECODE_THREADS_MAX),
+        }
+    }
+    
+    /// Run `f` on a reader no other thread is using: an idle clone, a new
+    /// clone, or the shared reader under `reader_lock` if cloning failed.
+    /// The reader inflates blocks on `decode_threads` threads meanwhile, and
+    /// `shares` readers running at once split the block cache budget.
+    fn with_reader<R>(&self, decode_threads: usize, shares: usize, f: impl FnOnce(&FstReader) -> R) -> R {
+        let cache_bytes = BLOCK_CACHE_BYTES / shares.max(1) as u64;
+        let pooled = {
+            let mut idle = self.readers.idle.lock().unwrap();
+            idle.pop().or_else(|| self.readers.template.as_ref().and_then(|t| t.try_clone()))
+        };
+        
+        match pooled {
+            Some(reader) => {
+                reader.set_decode_threads(decode_threads);
+                reader.set_block_cache_size(cache_bytes);
+                let result = f(&reader);
+                self.readers.idle.lock().unwrap().push(reader);
+                result
+            }
+            None => {
+                let _lock = self.reader_lock.lock().unwrap();
+                self.reader.set_decode_threads(decode_threads);
+                self.reader.set_block_cache_size(cache_bytes);
+                f(&self.reader)
+            }
         }
     }
     
@@ -504,18 +858,15 @@ impl SignalSource {
     ) -> Result<Arc<Signal>, String> {
         // Check cache first
         {
-            let cache = self.signal_cache.lock().unwrap();
+            let mut cache = self.signal_cache.lock().unwrap();
             if let Some(signal) = cache.get(&signal_ref) {
-                return Ok(signal.clone());
+                return Ok(signal);
             }
         }
         
-        // Load signal from FST with mutex protection
-        // The FST C library is not thread-safe for concurrent block iteration
-        let signal = {
-            let _lock = self.reader_lock.lock().unwrap();
-            load_signal_from_fst(&self.reader, handle, is_real, is_string)?
-        };
+        // Load signal from FST on a reader private to this call
+        let time_table = self.time_table()?;
+        let signal = self.with_reader(self.scan_threads, 1, |reader| load_signal_from_fst(reader, time_table, handle, is_real, is_string))?;
         let signal_arc = Arc::new(signal);
         
         // Store in cache
@@ -532,25 +883,26 @@ impl SignalSource {
         &self,
         requests: Vec<(SignalRef, FstHandle, bool, bool)>,
         multi_threaded: bool,
-    ) -> Vec<(SignalRef, Arc<Signal>)> {
-        // Single-threaded batch loading with one file scan, MT not supported
-        self.load_signals_batch(requests)
+    ) -> Result<Vec<(SignalRef, Arc<Signal>)>, String> {
+        self.load_signals_batch(requests, multi_threaded)
     }
     
-    /// Load multiple signals in a single file scan (optimized version)
+    /// Load multiple signals in a single file scan, or with `multi_threaded`
+    /// one scan per worker thread, each over its share of the handles
     fn load_signals_batch(
         &self,
         requests: Vec<(SignalRef, FstHandle, bool, bool)>,
-    ) -> Vec<(SignalRef, Arc<Signal>)> {
+        multi_threaded: bool,
+    ) -> Result<Vec<(SignalRef, Arc<Signal>)>, String> {
         // Check cache first and filter out already loaded signals
         let mut to_load = Vec::new();
         let mut results = Vec::new();
         
         {
-            let cache = self.signal_cache.lock().unwrap();
+            let mut cache = self.signal_cache.lock().unwrap();
             for &(ref_id, handle, is_real, is_string) in &requests {
                 if let Some(signal) = cache.get(&ref_id) {
-                    results.push((ref_id, signal.clone()));
+                    results.push((ref_id, signal));
                 } else {
                     to_load.push((ref_id, handle, is_real, is_string));
                 }
@@ -559,13 +911,31 @@ impl SignalSource {
         
         // If all signals are cached, return early
         if to_load.is_empty() {
-            return results;
+            return Ok(results);
         }
         
-        // Load all uncached signals in a single scan
-        let loaded_signals = {
-            let _lock = self.reader_lock.lock().unwrap();
-            load_signals_batch_from_fst(&self.reader, &to_load)
+        let time_table = self.time_table()?;
+        
+        // Load all uncached signals in a single scan, or split them across
+        // threads when every thread can have a reader of its own. Rayon then
+        // provides the parallelism, so those readers decode serially rather
+        // than each starting decode threads of its own.
+        let threads = if multi_threaded && self.readers.template.is_some() {
+            rayon::current_num_threads().min(to_load.len())
+        } else {
+            1
+        };
+        let loaded_signals = if threads > 1 {
+            // Round robin so each share gets a similar mix of busy and quiet signals
+            let mut shares = vec![Vec::new(); threads];
+            for (i, request) in to_load.into_iter().enumerate() {
+                shares[i % threads].push(request);
+            }
+            shares.into_par_iter()
+                .flat_map_iter(|share| self.with_reader(1, threads, |reader| load_signals_batch_from_fst(reader, time_table, &share)))
+                .collect()
+        } else {
+            self.with_reader(self.scan_threads, 1, |reader| load_signals_batch_from_fst(reader, time_table, &to_load))
         };
         
         // Store in cache and add to results
@@ -578,7 +948,46 @@ impl SignalSource {
             }
         }
         
-        results
+        Ok(results)
+    }
+    
+    /// Values of many signals at one time, read straight from the block
+    /// holding it rather than by loading each signal. Variable-length
+    /// (string) signals are not covered by the lookup and are loaded instead.
+    pub fn values_at_time(
+        &self,
+        requests: &[(SignalRef, FstHandle, bool, bool)],
+        time: u64,
+    ) -> Result<Vec<Option<SignalValue>>, String> {
+        // Past the end everything holds its final value
+        let time = time.min(self.reader.end_time());
+        let handles: Vec<FstHandle> = requests.iter().map(|&(_, handle, _, _)| handle).collect();
+        let raw = self.with_reader(self.scan_threads, 1, |reader| reader.values_at_time(time, &handles));
+        
+        requests.iter().zip(raw)
+            .map(|(&(signal_ref, handle, is_real, is_string), value)| {
+                if is_string {
+                    return Ok(self.load_signal(signal_ref, handle, is_real, is_string)?.value_at_time(time));
+                }
+                // Reals come back as "r<value>" when they changed inside the block
+                Ok(value.map(|s| {
+                    let s = if is_real { s.strip_prefix('r').unwrap_or(&s) } else { &s };
+                    SignalValue::from_fst_string(s, is_real, is_string)
+                }))
+            })
+            .collect()
+    }
+    
+    /// Every distinct time in the file, shared by all loaded signals. Built
+    /// on first use rather than at open, as it inflates the time section of
+    /// every block; must not be called from inside `with_reader`. Fails
+    /// when the file has more distinct times than u32 indices can address.
+    pub fn time_table(&self) -> Result<&Arc<TimeTable>, String> {
+        if let Some(table) = self.time_table.get() {
+            return Ok(table);
+        }
+        let times = self.with_reader(1, 1, |reader| reader.time_table())?;
+        Ok(self.time_table.get_or_init(|| Arc::new(TimeTable::from_times(times))))
     }
     
     /// Clear signal cache
@@ -594,4 +1003,18 @@ impl SignalSource {
             cache.remove(signal_ref);
         }
     }
+    
+    /// Whether a signal is in the cache, without touching its counters
+    pub fn is_cached(&self, signal_ref: &SignalRef) -> bool {
+        self.signal_cache.lock().unwrap().contains(signal_ref)
+    }
+    
+    /// Change the signal cache byte budget, None for no limit
+    pub fn set_cache_budget(&self, budget: Option<usize>) {
+        self.signal_cache.lock().unwrap().set_budget(budget);
+    }
+    
+    pub fn cache_stats(&self) -> CacheStats {
+        self.signal_cache.lock().unwrap().stats()
+    }
 }
\ No newline at end of file
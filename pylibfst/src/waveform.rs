@@ -1,8 +1,9 @@
 use std::sync::Arc;
 
+use crate::cache::CacheStats;
 use crate::ffi::FstReader;
-use crate::hierarchy::{Hierarchy, Var};
-use crate::signal::{Signal, SignalSource, TimeTable};
+use crate::hierarchy::{Hierarchy, SignalRef, Var};
+use crate::signal::{Signal, SignalSource, SignalValue, TimeTable};
 
 /// Main waveform structure
 pub struct Waveform {
@@ -11,6 +12,7 @@ pub struct Waveform {
     pub time_range: Option<(u64, u64)>,  // (start_time, end_time)
     reader: Option<Arc<FstReader>>,
     multi_threaded: bool,
+    cache_budget: Option<usize>,  // Signal cache byte budget, None for no limit
 }
 
 impl Waveform {
@@ -20,13 +22,19 @@ impl Waveform {
         multi_threaded: bool,
         _remove_scopes_with_empty_name: bool,
         load_body: bool,
+        cache_budget: Option<usize>,
+        lazy_hierarchy: bool,
     ) -> Result<Self, String> {
         // Open FST file
         let reader = FstReader::open(path)?;
         let reader_arc = Arc::new(reader);
         
-        // Parse hierarchy
-        let hierarchy = Hierarchy::from_fst(&reader_arc)?;
+        // Parse hierarchy, or only its scopes when lazy
+        let hierarchy = if lazy_hierarchy {
+            Hierarchy::from_fst_lazy(&reader_arc)?
+        } else {
+            Hierarchy::from_fst(&reader_arc)?
+        };
         let hierarchy_arc = Arc::new(hierarchy);
         
         let mut waveform = Waveform {
@@ -35,6 +43,7 @@ impl Waveform {
             time_range: None,
             reader: Some(reader_arc.clone()),
             multi_threaded,
+            cache_budget,
         };
         
         // Load body if requested
@@ -60,12 +69,20 @@ impl Waveform {
         self.time_range = Some((start_time, end_time));
         
         // Create signal source
-        let signal_source = SignalSource::new(reader.clone());
+        let signal_source = SignalSource::new(reader.clone(), self.cache_budget);
         self.wave_source = Some(Arc::new(signal_source));
         
         Ok(())
     }
     
+    /// Every distinct time in the file, once the body is loaded; the
+    /// first call builds it unless a signal load already has
+    pub fn time_table(&self) -> Result<Option<Arc<TimeTable>>, String> {
+        self.wave_source.as_ref()
+            .map(|source| source.time_table().cloned())
+            .transpose()
+    }
+    
     /// Check if body is loaded
     pub fn body_loaded(&self) -> bool {
         self.wave_source.is_some()
@@ -90,14 +107,14 @@ impl Waveform {
         )
     }
     
-    /// Get signal from absolute hierarchy path
-    pub fn get_signal_from_path(&mut self, abs_hierarchy_path: &str) -> Result<Arc<Signal>, String> {
+    /// Get signal from absolute hierarchy path, with the ref it is cached under
+    pub fn get_signal_from_path(&mut self, abs_hierarchy_path: &str) -> Result<(SignalRef, Arc<Signal>), String> {
         // Clone the variable to avoid borrow issues
         let var = self.hierarchy.var_by_path(abs_hierarchy_path)
             .ok_or_else(|| format!("Variable not found: {}", abs_hierarchy_path))?
             .clone();
         
-        self.get_signal(&var)
+        self.get_signal(&var).map(|signal| (var.signal_ref, signal))
     }
     
     /// Load multiple signals
@@ -116,7 +133,7 @@ impl Waveform {
             .collect();
         
         // Load signals
-        let loaded = wave_source.load_signals(requests, false);
+        let loaded = wave_source.load_signals(requests, false)?;
         
         // Extract signals in order
         let mut result = Vec::new();
@@ -124,7 +141,7 @@ impl Waveform {
             if let Some((_, signal)) = loaded.iter().find(|(ref_id, _)| *ref_id == var.signal_ref) {
                 result.push(signal.clone());
             } else {
-                return Err(format!("Failed to load signal for {}", var.name));
+                return Err(format!("Failed to load signal for {}", self.hierarchy.name(var.name)));
             }
         }
         
@@ -147,7 +164,7 @@ impl Waveform {
             .collect();
         
         // Load signals with multi-threading
-        let loaded = wave_source.load_signals(requests, true);
+        let loaded = wave_source.load_signals(requests, self.multi_threaded)?;
         
         // Extract signals in order
         let mut result = Vec::new();
@@ -155,17 +172,62 @@ impl Waveform {
             if let Some((_, signal)) = loaded.iter().find(|(ref_id, _)| *ref_id == var.signal_ref) {
                 result.push(signal.clone());
             } else {
-                return Err(format!("Failed to load signal for {}", var.name));
+                return Err(format!("Failed to load signal for {}", self.hierarchy.name(var.name)));
             }
         }
         
         Ok(result)
     }
     
+    /// Values of many variables at one time, without loading their signals
+    pub fn values_at_time(&mut self, vars: &[Var], time: u64) -> Result<Vec<Option<SignalValue>>, String> {
+        // Ensure body is loaded
+        if !self.body_loaded() {
+            self.load_body()?;
+        }
+        
+        let wave_source = self.wave_source.as_ref()
+            .ok_or_else(|| "Wave source not available".to_string())?;
+        
+        let requests: Vec<_> = vars.iter()
+            .map(|var| (var.signal_ref, var.fst_handle, var.is_real(), var.is_string()))
+            .collect();
+        
+        wave_source.values_at_time(&requests, time)
+    }
+    
+    /// Whether the signal of `var` is loaded and still in the signal cache
+    pub fn is_signal_cached(&self, var: &Var) -> bool {
+        self.wave_source.as_ref().map_or(false, |source| source.is_cached(&var.signal_ref))
+    }
+    
+    /// Change the signal cache byte budget, evicting at once if over it
+    pub fn set_cache_budget(&mut self, budget: Option<usize>) {
+        self.cache_budget = budget;
+        if let Some(ref wave_source) = self.wave_source {
+            wave_source.set_cache_budget(budget);
+        }
+    }
+    
+    /// Signal cache counters, all zero before the body is loaded
+    pub fn cache_stats(&self) -> CacheStats {
+        match self.wave_source {
+            Some(ref wave_source) => wave_source.cache_stats(),
+            None => CacheStats { budget: self.cache_budget, ..CacheStats::default() },
+        }
+    }
+    
     /// Unload signals from cache
-    pub fn unload_signals(&self, signal_refs: &[crate::hierarchy::SignalRef]) {
+    pub fn unload_signals(&self, signal_refs: &[SignalRef]) {
         if let Some(ref wave_source) = self.wave_source {
             wave_source.unload_signals(signal_refs);
         }
     }
+    
+    /// Drop every cached signal; not counted as evictions
+    pub fn clear_signal_cache(&self) {
+        if let Some(ref wave_source) = self.wave_source {
+            wave_source.clear_cache();
+        }
+    }
 }
\ No newline at end of file
@@ -93,6 +93,22 @@ def test_hierarchy_navigation():
     assert scope.scope_type() is not None
 
 
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_path_lookup_round_trip():
+    """Every variable's full name finds that variable's signal again"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    wave = pylibfst.Waveform(fst_file)
+    hier = wave.hierarchy
+    _, end = wave.time_range
+    
+    for var in hier.all_vars():
+        by_path = wave.get_signal_from_path(var.full_name(hier))
+        assert by_path.value_at_time(end) == wave.get_signal(var).value_at_time(end)
+
+
 @pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
 def test_signal_loading():
     """Test signal loading"""
@@ -1331,6 +1347,233 @@ def test_performance_comparison():
     print(f"{'='*80}\n")
 
 
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_time_table():
+    """Signal change times all come from the waveform's global time table"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    wave = pylibfst.Waveform(fst_file)
+    time_table = wave.time_table
+    assert time_table is not None
+    times = [time_table[i] for i in range(len(time_table))]
+    assert times == sorted(set(times))
+    assert time_table[-1] == times[-1]
+    
+    table = set(times)
+    for var in list(wave.hierarchy.all_vars())[:20]:
+        signal = wave.get_signal(var)
+        for time, _ in signal.all_changes():
+            assert time in table
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_multithreaded_load():
+    """Multithreaded batch loads return the same signals as a single scan"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    vars_serial = list(pylibfst.Waveform(fst_file).hierarchy.all_vars())
+    serial = pylibfst.Waveform(fst_file).load_signals(vars_serial)
+    
+    wave = pylibfst.Waveform(fst_file)
+    vars_mt = list(wave.hierarchy.all_vars())
+    threaded = wave.load_signals_multithreaded(vars_mt)
+    
+    assert len(threaded) == len(serial) == len(vars_mt)
+    for a, b in zip(serial, threaded):
+        assert list(a.all_changes()) == list(b.all_changes())
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_values_at_time():
+    """Batch value lookups agree with loaded signals once each has changed"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    wave = pylibfst.Waveform(fst_file)
+    vars_list = list(wave.hierarchy.all_vars())
+    start, end = wave.time_range
+    times = [start, (start + end) // 3, (start + end) // 2, end, end + 10]
+    
+    for t in times:
+        values = wave.values_at_time(vars_list, t)
+        assert len(values) == len(vars_list)
+        for var, value in zip(vars_list, values):
+            expected = wave.get_signal(var).value_at_time(t)
+            if expected is None:
+                continue  # Before the first change the batch gives the initial value
+            if isinstance(expected, float):
+                assert value == pytest.approx(expected)
+            else:
+                assert value == expected
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_sample_at_times():
+    """Bulk sampling gives the numbers value_at_time gives one time at a time"""
+    import math
+    
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    wave = pylibfst.Waveform(fst_file)
+    start, end = wave.time_range
+    times = list(range(start, end + 2, max(1, (end - start) // 500)))
+    
+    for var in list(wave.hierarchy.all_vars())[:50]:
+        signal = wave.get_signal(var)
+        samples = signal.sample_at_times(times)
+        assert len(samples) == len(times)
+        shuffled = signal.sample_at_times(times[::-1])
+        for t, sample, backwards in zip(times, samples, reversed(shuffled)):
+            value = signal.value_at_time(t)
+            if isinstance(value, (int, float)):
+                assert sample == float(value)
+            else:
+                assert math.isnan(sample)
+            assert sample == backwards or (math.isnan(sample) and math.isnan(backwards))
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_signal_cache_budget():
+    """Signal cache stays within its byte budget, except for signals still in use"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    wave = pylibfst.Waveform(fst_file)
+    vars_list = list(wave.hierarchy.all_vars())[:50]
+    budget = max(wave.get_signal(var).memory_usage() for var in vars_list[:10])
+    wave.set_signal_cache_budget(budget)
+    
+    stats = wave.signal_cache_stats()
+    assert stats.budget == budget
+    assert stats.bytes <= budget
+    assert stats.evictions > 0
+    
+    # A signal held from Python is pinned even when over budget
+    held = [wave.get_signal(var) for var in vars_list]
+    stats = wave.signal_cache_stats()
+    for var in vars_list:
+        wave.get_signal(var)
+    assert wave.signal_cache_stats().hits == stats.hits + len(vars_list)
+    
+    del held
+    wave.set_signal_cache_budget(budget)
+    stats = wave.signal_cache_stats()
+    assert stats.bytes <= budget
+    assert stats.misses > 0
+    assert stats.evicted_bytes > 0
+    
+    wave.set_signal_cache_budget(None)
+    assert wave.signal_cache_stats().budget is None
+    
+    # Unloading removes exactly the signals passed in; aliases share a signal
+    distinct = list({var.signal_ref(): var for var in vars_list}.values())[:4]
+    assert len(distinct) == 4
+    signals = wave.load_signals(distinct[:3])
+    wave.get_signal(distinct[3])
+    wave.unload_signals(signals[1:])
+    assert wave.is_signal_cached(distinct[0])
+    assert not wave.is_signal_cached(distinct[1])
+    assert not wave.is_signal_cached(distinct[2])
+    assert wave.is_signal_cached(distinct[3])
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_signal_memory_footprint():
+    """Packed signal storage versus one enum value per change"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    wave = pylibfst.Waveform(fst_file)
+    hier = wave.hierarchy
+    
+    packed_bytes = 0
+    naive_bytes = 0
+    num_changes = 0
+    for var in hier.all_vars():
+        signal = wave.get_signal(var)
+        n = sum(1 for _ in signal.all_changes())
+        num_changes += n
+        packed_bytes += signal.memory_usage()
+        # time + enum tag/payload per change, plus a heap string for vectors
+        width = var.bitwidth() or 1
+        naive_bytes += n * (40 + (width if width > 1 and not var.is_real() else 0))
+    
+    print(f"\n  Signal memory for {num_changes} changes:")
+    print(f"  packed: {packed_bytes / 1024:10.1f} KiB")
+    print(f"  naive:  {naive_bytes / 1024:10.1f} KiB  ({naive_bytes / max(packed_bytes, 1):.2f}x)")
+    assert packed_bytes <= naive_bytes
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_lazy_hierarchy():
+    """Lazily opened hierarchy exposes the same scopes and vars as an eager one"""
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    eager = pylibfst.Waveform(fst_file).hierarchy
+    lazy = pylibfst.Waveform(fst_file, lazy_hierarchy=True).hierarchy
+    assert eager.is_complete()
+    assert not lazy.is_complete()
+    
+    # Path lookups decode only the scope they land in
+    eager_names = [var.full_name(eager) for var in eager.all_vars()]
+    for name in eager_names[::max(1, len(eager_names) // 50)]:
+        var = lazy.var_by_path(name)
+        assert var is not None
+        assert var.full_name(lazy) == name
+        assert var.signal_ref() == eager.var_by_path(name).signal_ref()
+    assert lazy.var_by_path("no.such.signal") is None
+    
+    def scope_vars(hier):
+        result = {}
+        def walk(scope):
+            result[scope.full_name(hier)] = [
+                (var.name(hier), var.bitwidth(), var.signal_ref()) for var in scope.vars(hier)
+            ]
+            for child in scope.scopes(hier):
+                walk(child)
+        for scope in hier.top_scopes():
+            walk(scope)
+        return result
+    
+    assert scope_vars(lazy) == scope_vars(eager)
+    
+    lazy.complete()
+    assert lazy.is_complete()
+    assert sorted(var.full_name(lazy) for var in lazy.all_vars()) == sorted(eager_names)
+
+@pytest.mark.skipif(pylibfst is None, reason="pylibfst not built")
+def test_wrapped_trace_index(tmp_path):
+    """A gzip wrapped trace leaves index sidecars behind and reads the same when reopened"""
+    import gzip
+    import struct
+    
+    fst_file = get_test_fst_file()
+    if not fst_file:
+        pytest.skip("No test FST file found")
+    
+    # Wrap it as fstWriterSetRepackOnClose() does: section type, section length, uncompressed length, gzip stream
+    data = Path(fst_file).read_bytes()
+    packed = gzip.compress(data, compresslevel=4)
+    wrapped = tmp_path / "wrapped.fst"
+    wrapped.write_bytes(bytes([254]) + struct.pack(">QQ", 16 + len(packed), len(data)) + packed)
+    
+    plain = pylibfst.Waveform(fst_file)
+    plain_vars = list(plain.hierarchy.all_vars())[:20]
+    expected = [list(signal.all_changes()) for signal in plain.load_signals(plain_vars)]
+    
+    for _ in range(2):
+        wave = pylibfst.Waveform(str(wrapped))
+        assert wave.time_range == plain.time_range
+        wave_vars = list(wave.hierarchy.all_vars())[:20]
+        assert [list(signal.all_changes()) for signal in wave.load_signals(wave_vars)] == expected
+        assert (tmp_path / "wrapped.fst.fstgzidx").exists()
+        assert (tmp_path / "wrapped.fst.fstidx").exists()
+
 if __name__ == "__main__":
     # Run basic tests
     print("Testing pylibfst API compatibility...")
@@ -191,4 +191,83 @@ def test_fst_backend_data_consistency():
     
     # Clean up
     db_pywellen.close()
-    db_pylibfst.close()
\ No newline at end of file
+    db_pylibfst.close()
+
+
+def test_signal_cache_stats():
+    """Test that WaveformDB reports pylibfst signal cache counters."""
+    fst_file = get_test_input_path(TestFiles.DES_FST)
+    
+    if not fst_file.exists():
+        pytest.skip(f"Test FST file not found: {fst_file}")
+    
+    # pywellen keeps no cache of its own
+    db_pywellen = WaveformDB(backend_preference="pywellen")
+    db_pywellen.open(str(fst_file))
+    assert db_pywellen.get_signal_cache_stats() is None
+    db_pywellen.close()
+    
+    db_pylibfst = WaveformDB(backend_preference="pylibfst")
+    db_pylibfst.open(str(fst_file))
+    handles = db_pylibfst.get_all_handles()[:5]
+    for handle in handles:
+        db_pylibfst.get_signal(handle)
+    
+    stats = db_pylibfst.get_signal_cache_stats()
+    assert stats is not None
+    assert stats['misses'] >= len(handles)
+    assert stats['entries'] == len(handles)
+    assert stats['bytes'] > 0
+    db_pylibfst.close()
+
+
+def test_signal_cache_budget_evicts():
+    """Test that WaveformDB keeps pylibfst signals within its cache budget."""
+    fst_file = get_test_input_path(TestFiles.DES_FST)
+    
+    if not fst_file.exists():
+        pytest.skip(f"Test FST file not found: {fst_file}")
+    
+    # Size the budget from an unbounded pass, so a few signals overflow it
+    db = WaveformDB(backend_preference="pylibfst", signal_cache_bytes=None)
+    db.open(str(fst_file))
+    handles = db.get_all_handles()[:20]
+    db.preload_signals(handles)
+    stats = db.get_signal_cache_stats()
+    assert stats is not None
+    assert stats['budget'] is None
+    assert stats['evictions'] == 0
+    sizes = [db.get_signal(handle).memory_usage() for handle in handles]  # type: ignore[union-attr]
+    budget = max(max(sizes), sum(sizes) // 4)
+    db.close()
+    
+    db = WaveformDB(backend_preference="pylibfst", signal_cache_bytes=budget)
+    db.open(str(fst_file))
+    db.preload_signals(handles)
+    for handle in handles:
+        assert db.get_signal(handle) is not None
+    
+    # WaveformDB holds no references of its own, so nothing is pinned
+    stats = db.get_signal_cache_stats()
+    assert stats is not None
+    assert stats['budget'] == budget
+    assert stats['evictions'] > 0
+    assert stats['bytes'] <= budget
+    assert not db.are_signals_cached(handles)
+    assert db.is_signal_cached(handles[-1])
+    
+    # Lifting the budget keeps what is cached and stops evicting
+    db.set_signal_cache_budget(None)
+    evictions = db.get_signal_cache_stats()['evictions']
+    db.preload_signals(handles)
+    assert db.are_signals_cached(handles)
+    assert db.get_signal_cache_stats()['evictions'] == evictions
+    
+    # Clearing empties the cache without counting evictions
+    db.clear_signal_cache()
+    stats = db.get_signal_cache_stats()
+    assert stats['entries'] == 0
+    assert stats['bytes'] == 0
+    assert stats['evictions'] == evictions
+    assert not db.is_signal_cached(handles[0])
+    db.close()
@@ -3,10 +3,10 @@
 from __future__ import annotations
 
 import math
-from typing import List, Dict, Optional, Tuple, Any
+from typing import List, Dict, Optional, Tuple, Any, Iterator, Sequence
 from dataclasses import dataclass
 
-from .data_model import SignalNode, Time
+from .data_model import SignalNode, Time, DataFormat
 from .signal_sampling import parse_signal_value
 
 
@@ -68,12 +68,73 @@ def compute_signal_statistics(
         bit_width = 1
     
     # Sample signal at each valid time and collect statistics
+    samples = _sample_values_native(waveform_db, signal_node, valid_times, bit_width)
+    if samples is None:
+        samples = _sample_values(waveform_db, signal_node, valid_times, bit_width)
+    
     min_val = float('inf')
     max_val = float('-inf')
     sum_val = 0.0
     valid_count = 0
     
-    for time in valid_times:
+    for value_float in samples:
+        # Skip NaN values (undefined/high-impedance)
+        if value_float is not None and not math.isnan(value_float):
+            min_val = min(min_val, value_float)
+            max_val = max(max_val, value_float)
+            sum_val += value_float
+            valid_count += 1
+    
+    # Calculate average
+    if valid_count > 0:
+        avg_val = sum_val / valid_count
+    else:
+        # No valid samples found
+        min_val = max_val = sum_val = avg_val = 0.0
+    
+    return SignalStatistics(
+        signal_name=signal_node.name,
+        min_value=min_val,
+        max_value=max_val,
+        sum_value=sum_val,
+        average_value=avg_val,
+        sample_count=valid_count
+    )
+
+
+def _sample_values_native(
+    waveform_db: Any,
+    signal_node: SignalNode,
+    times: List[Time],
+    bit_width: int
+) -> Optional[Sequence[float]]:
+    """
+    Sample a signal at all times in one native sweep, when the backend can.
+    
+    Only formats that read a bit vector as a plain or two's complement integer
+    qualify; float32 reinterpretation stays on the per-sample path.
+    
+    Returns:
+        One float per time (NaN where undefined), or None if not available
+    """
+    data_format = signal_node.format.data_format
+    if data_format == DataFormat.FLOAT and bit_width == 32:
+        return None
+    
+    sample_numeric = getattr(waveform_db, 'sample_numeric', None)
+    if sample_numeric is None:
+        return None
+    return sample_numeric(signal_node.handle, times, data_format == DataFormat.SIGNED)
+
+
+def _sample_values(
+    waveform_db: Any,
+    signal_node: SignalNode,
+    times: List[Time],
+    bit_width: int
+) -> Iterator[Optional[float]]:
+    """Sample a signal one time at a time, parsed with the signal's format."""
+    for time in times:
         # Get signal value at this time
         value = waveform_db.sample(signal_node.handle, time)
         
@@ -97,29 +158,7 @@ def compute_signal_statistics(
             signal_node.format.data_format,
             bit_width
         )
-        
-        # Skip NaN values (undefined/high-impedance)
-        if value_float is not None and not math.isnan(value_float):
-            min_val = min(min_val, value_float)
-            max_val = max(max_val, value_float)
-            sum_val += value_float
-            valid_count += 1
-    
-    # Calculate average
-    if valid_count > 0:
-        avg_val = sum_val / valid_count
-    else:
-        # No valid samples found
-        min_val = max_val = sum_val = avg_val = 0.0
-    
-    return SignalStatistics(
-        signal_name=signal_node.name,
-        min_value=min_val,
-        max_value=max_val,
-        sum_value=sum_val,
-        average_value=avg_val,
-        sample_count=valid_count
-    )
+        yield value_float
 
 
 def generate_sampling_times_period(
@@ -2,7 +2,7 @@
 
 from abc import ABC, abstractmethod
 from enum import Enum
-from typing import Optional, List, Literal, TYPE_CHECKING
+from typing import Optional, List, Literal, Dict, TYPE_CHECKING
 from pathlib import Path
 
 from ..backend_types import (
@@ -42,7 +42,9 @@ class WaveformBackend(ABC):
         self,
         multi_threaded: bool = True,
         remove_scopes_with_empty_name: bool = False,
-        load_body: bool = True
+        load_body: bool = True,
+        lazy_hierarchy: bool = False,
+        signal_cache_bytes: Optional[int] = None
     ) -> WWaveform:
         """Load the waveform file.
         
@@ -50,6 +52,10 @@ class WaveformBackend(ABC):
             multi_threaded: Whether to use multi-threading for signal loading
             remove_scopes_with_empty_name: Whether to filter out unnamed scopes
             load_body: Whether to immediately load the waveform body
+            lazy_hierarchy: Read only the scopes up front and each scope's
+                variables when first asked for, if the backend supports it
+            signal_cache_bytes: Byte budget of the backend's own signal cache,
+                None for no limit; ignored by backends without one
             
         Returns:
             Loaded waveform object conforming to WWaveform protocol
@@ -111,6 +117,65 @@ class WaveformBackend(ABC):
         """
         ...
     
+    def get_signal_cache_stats(self) -> Optional[Dict[str, Optional[int]]]:
+        """Get counters of the backend's own signal cache.
+        
+        Returns:
+            Dict with hits, misses, evictions, evicted_bytes, bytes, entries and
+            budget, or None if the backend does not keep such a cache
+        """
+        return None
+    
+    def is_signal_cached(self, var: WVar) -> Optional[bool]:
+        """Check whether the backend's own signal cache holds a variable's signal.
+        
+        Args:
+            var: Variable whose signal to look for
+            
+        Returns:
+            True or False, or None if the backend does not keep such a cache
+        """
+        return None
+    
+    def set_signal_cache_budget(self, budget_bytes: Optional[int]) -> None:
+        """Change the byte budget of the backend's own signal cache.
+        
+        Args:
+            budget_bytes: New budget, None for no limit
+        """
+        pass
+    
+    def clear_signal_cache(self) -> None:
+        """Drop every signal from the backend's own signal cache, if it keeps one."""
+        pass
+    
+    def is_hierarchy_lazy(self) -> bool:
+        """Check whether some scopes' variables have not been read yet.
+        
+        Returns:
+            True while the hierarchy is only partly materialized
+        """
+        return False
+    
+    def complete_hierarchy(self, background: bool = False) -> None:
+        """Read the variables of every scope not read yet.
+        
+        Args:
+            background: Start the work on a native thread and return at once
+        """
+        pass
+    
+    def find_var_by_path(self, path: str) -> Optional[WVar]:
+        """Look up a variable by full hierarchical name without a full walk.
+        
+        Args:
+            path: Full name, e.g. "TOP.cpu.clk"
+            
+        Returns:
+            The variable, or None if not found or not supported by the backend
+        """
+        return None
+    
     @property
     def backend_type(self) -> BackendType:
         """Get the type of this backend.
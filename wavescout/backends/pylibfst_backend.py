@@ -1,6 +1,6 @@
 """Pylibfst backend implementation with adapters for protocol types."""
 
-from typing import Optional, List, Tuple, cast, TYPE_CHECKING, Any
+from typing import Optional, List, Tuple, Dict, cast, TYPE_CHECKING, Any
 from pathlib import Path
 
 if TYPE_CHECKING:
@@ -109,6 +109,22 @@ class WaveformAdapter:
     def unload_signals(self, signals: List[WSignal]) -> None:
         """Unload signals to free memory."""
         self._waveform.unload_signals(signals)
+    
+    def signal_cache_stats(self) -> Any:
+        """Get the pylibfst signal cache counters."""
+        return self._waveform.signal_cache_stats()
+    
+    def is_signal_cached(self, var: WVar) -> bool:
+        """Check whether the pylibfst signal cache holds a variable's signal."""
+        return bool(self._waveform.is_signal_cached(var))
+    
+    def set_signal_cache_budget(self, budget_bytes: Optional[int]) -> None:
+        """Change the pylibfst signal cache byte budget."""
+        self._waveform.set_signal_cache_budget(budget_bytes)
+    
+    def clear_signal_cache(self) -> None:
+        """Drop every signal from the pylibfst signal cache."""
+        self._waveform.clear_signal_cache()
 
 
 class PylibfstBackend(WaveformBackend):
@@ -132,7 +148,9 @@ class PylibfstBackend(WaveformBackend):
         self,
         multi_threaded: bool = True,
         remove_scopes_with_empty_name: bool = False,
-        load_body: bool = True
+        load_body: bool = True,
+        lazy_hierarchy: bool = False,
+        signal_cache_bytes: Optional[int] = None
     ) -> WWaveform:
         """Load the waveform file using pylibfst.
         
@@ -140,6 +158,10 @@ class PylibfstBackend(WaveformBackend):
             multi_threaded: Whether to use multi-threading for signal loading
             remove_scopes_with_empty_name: Whether to filter out unnamed scopes
             load_body: Whether to immediately load the waveform body
+            lazy_hierarchy: Index the scopes only and decode each scope's
+                variables on first use
+            signal_cache_bytes: Byte budget of the pylibfst signal cache,
+                None for no limit
             
         Returns:
             Loaded waveform object wrapped in adapter
@@ -149,7 +171,9 @@ class PylibfstBackend(WaveformBackend):
             self.file_path,
             multi_threaded=multi_threaded,
             remove_scopes_with_empty_name=remove_scopes_with_empty_name,
-            load_body=load_body
+            load_body=load_body,
+            signal_cache_bytes=signal_cache_bytes,
+            lazy_hierarchy=lazy_hierarchy
         )
         
         # Wrap in adapter to handle time_range vs time_table difference
@@ -211,6 +235,91 @@ class PylibfstBackend(WaveformBackend):
             return []
         return self._adapted_waveform.load_signals(vars, multithreaded)
     
+    def get_signal_cache_stats(self) -> Optional[Dict[str, Optional[int]]]:
+        """Get counters of the pylibfst signal cache.
+        
+        Returns:
+            Dict of cache counters, or None if no waveform is loaded
+        """
+        if self._adapted_waveform is None:
+            return None
+        stats = self._adapted_waveform.signal_cache_stats()
+        return {
+            'hits': stats.hits,
+            'misses': stats.misses,
+            'evictions': stats.evictions,
+            'evicted_bytes': stats.evicted_bytes,
+            'bytes': stats.bytes,
+            'entries': stats.entries,
+            'budget': stats.budget,
+        }
+    
+    def is_signal_cached(self, var: WVar) -> Optional[bool]:
+        """Check whether the pylibfst signal cache holds a variable's signal.
+        
+        Args:
+            var: Variable whose signal to look for
+            
+        Returns:
+            Whether it is cached, or None if no waveform is loaded
+        """
+        if self._adapted_waveform is None:
+            return None
+        return self._adapted_waveform.is_signal_cached(var)
+    
+    def set_signal_cache_budget(self, budget_bytes: Optional[int]) -> None:
+        """Change the pylibfst signal cache byte budget, evicting at once if over it.
+        
+        Args:
+            budget_bytes: New budget, None for no limit
+        """
+        if self._adapted_waveform is not None:
+            self._adapted_waveform.set_signal_cache_budget(budget_bytes)
+    
+    def clear_signal_cache(self) -> None:
+        """Drop every signal from the pylibfst signal cache, not counting them as evictions."""
+        if self._adapted_waveform is not None:
+            self._adapted_waveform.clear_signal_cache()
+    
+    def is_hierarchy_lazy(self) -> bool:
+        """Check whether some scopes' variables are still undecoded.
+        
+        Returns:
+            True until every scope of a lazily opened hierarchy is decoded
+        """
+        if self._adapted_waveform is None:
+            return False
+        hierarchy: Any = self._adapted_waveform.hierarchy  # pylibfst.Hierarchy
+        return not hierarchy.is_complete()
+    
+    def complete_hierarchy(self, background: bool = False) -> None:
+        """Decode the variables of every scope not decoded yet.
+        
+        Args:
+            background: Decode on a native thread and return at once
+        """
+        if self._adapted_waveform is None:
+            return
+        hierarchy: Any = self._adapted_waveform.hierarchy
+        if background:
+            hierarchy.complete_in_background()
+        else:
+            hierarchy.complete()
+    
+    def find_var_by_path(self, path: str) -> Optional[WVar]:
+        """Look up a variable by full name, decoding only its scope.
+        
+        Args:
+            path: Full name, e.g. "TOP.cpu.clk"
+            
+        Returns:
+            The variable, or None if not found or no waveform is loaded
+        """
+        if self._adapted_waveform is None:
+            return None
+        hierarchy: Any = self._adapted_waveform.hierarchy
+        return cast(Optional[WVar], hierarchy.var_by_path(path))
+    
     def supports_file_format(self, file_path: str) -> bool:
         """Check if pylibfst supports the given file format.
         
@@ -40,7 +40,9 @@ class PywellenBackend(WaveformBackend):
         self,
         multi_threaded: bool = True,
         remove_scopes_with_empty_name: bool = False,
-        load_body: bool = True
+        load_body: bool = True,
+        lazy_hierarchy: bool = False,
+        signal_cache_bytes: Optional[int] = None
     ) -> WWaveform:
         """Load the waveform file using pywellen.
         
@@ -48,6 +50,8 @@ class PywellenBackend(WaveformBackend):
             multi_threaded: Whether to use multi-threading for signal loading
             remove_scopes_with_empty_name: Whether to filter out unnamed scopes
             load_body: Whether to immediately load the waveform body
+            lazy_hierarchy: Ignored, pywellen always reads the whole hierarchy
+            signal_cache_bytes: Ignored, pywellen keeps no signal cache
             
         Returns:
             Loaded waveform object (pywellen.Waveform implements WWaveform protocol)
@@ -40,6 +40,7 @@ class RenderingConfig:
     
     # Cache settings
     TRANSITION_CACHE_MAX_ENTRIES: int = 1000
+    SIGNAL_CACHE_MAX_BYTES: int = 1024 * 1024 * 1024  # Loaded signals kept by backends with a cache of their own
     
     # Cursor settings
     CURSOR_WIDTH: int = 2
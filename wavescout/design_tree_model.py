@@ -87,6 +87,7 @@ class DesignTreeNode:
         self.var_handle: Optional[SignalHandle] = None  # Wellen Var handle for database lookups
         self.var: Optional[WVar] = None  # Backend-agnostic Var object reference
         self.scope: Optional[WScope] = None  # Backend scope object for scope nodes
+        self.vars_pending = False  # Scope whose signals are added on first expand
 
     def add_child(self, child: 'DesignTreeNode') -> None:
         """Add a child node to this node and set this node as its parent."""
@@ -156,9 +157,16 @@ class DesignTreeModel(QAbstractItemModel):
 
         hierarchy = self.waveform_db.hierarchy
 
+        # With a lazy hierarchy, build the scopes only and leave each scope's
+        # signals to fetchMore, so opening does not decode every var
+        self._var_to_handle: Optional[Dict[int, SignalHandle]] = {}
+        if self.waveform_db.is_hierarchy_lazy():
+            self._var_to_handle = None
+            self._build_scope_recursive(hierarchy.top_scopes(), self.root_node, hierarchy)
+            return
+
         # OPTIMIZATION: Build a reverse mapping from variables to handles once
         # This allows O(1) handle lookups instead of O(n) searches
-        self._var_to_handle: Optional[Dict[int, SignalHandle]] = {}
         for handle, vars_list in self.waveform_db.iter_handles_and_vars():
             # Map each variable in the list to the same handle
             for var in vars_list:
@@ -190,43 +198,59 @@ class DesignTreeModel(QAbstractItemModel):
             scope_node.scope = scope  # Store the scope reference for icon selection
             parent_node.add_child(scope_node)
 
-            # Add variables in this scope
-            for i, var in enumerate(scope.vars(hierarchy)):
-                var_name = var.name(hierarchy).split('.')[-1]  # Just the signal name
-                var_type = str(var.var_type())
-
-                # Format bit range based on bitwidth
-                bit_range = ""
-                try:
-                    bitwidth = var.bitwidth()
-                    if bitwidth is not None and bitwidth > 1:
-                        # Multi-bit signal - show as [MSB:0]
-                        bit_range = f"[{bitwidth - 1}:0]"
-                    elif bitwidth == 1:
-                        # Single bit - could show as [0] or leave empty
-                        pass  # Leave empty for single bits
-                except:
-                    # If bitwidth() fails, leave empty
-                    pass
-
-                # Create variable node
-                var_node = DesignTreeNode(var_name, is_scope=False,
-                                          var_type=var_type, bit_range=bit_range)
-
-                # Store the variable reference for later use
-                var_node.var = var
-
-                # OPTIMIZATION: Use the pre-built mapping to find handle in O(1)
-                if self._var_to_handle:
-                    var_node.var_handle = self._var_to_handle.get(id(var))
-
-                scope_node.add_child(var_node)
+            # Add variables in this scope, or defer them for a lazy hierarchy
+            if self._var_to_handle is None:
+                scope_node.vars_pending = True
+            else:
+                for var in scope.vars(hierarchy):
+                    var_node = self._create_var_node(var, hierarchy)
+
+                    # OPTIMIZATION: Use the pre-built mapping to find handle in O(1)
+                    if self._var_to_handle:
+                        var_node.var_handle = self._var_to_handle.get(id(var))
+
+                    scope_node.add_child(var_node)
 
             # Recursively add child scopes
             child_scopes = scope.scopes(hierarchy)
             if child_scopes:
                 self._build_scope_recursive(child_scopes, scope_node, hierarchy)
 
+    def _create_var_node(self, var: WVar, hierarchy: WHierarchy) -> DesignTreeNode:
+        """Create the leaf node for one signal, without its handle.
+        
+        Args:
+            var: Variable to show
+            hierarchy: Hierarchy object for name lookups
+            
+        Returns:
+            Signal node holding the var reference
+        """
+        var_name = var.name(hierarchy).split('.')[-1]  # Just the signal name
+        var_type = str(var.var_type())
+
+        # Format bit range based on bitwidth
+        bit_range = ""
+        try:
+            bitwidth = var.bitwidth()
+            if bitwidth is not None and bitwidth > 1:
+                # Multi-bit signal - show as [MSB:0]
+                bit_range = f"[{bitwidth - 1}:0]"
+            elif bitwidth == 1:
+                # Single bit - could show as [0] or leave empty
+                pass  # Leave empty for single bits
+        except:
+            # If bitwidth() fails, leave empty
+            pass
+
+        # Create variable node
+        var_node = DesignTreeNode(var_name, is_scope=False,
+                                  var_type=var_type, bit_range=bit_range)
+
+        # Store the variable reference for later use
+        var_node.var = var
+        return var_node
+
     # QAbstractItemModel interface methods
     def index(self, row: int, column: int, parent: QModelIndex | QPersistentModelIndex = QModelIndex()) -> QModelIndex:
         """Create a QModelIndex for the item at (row, column) under the given parent.
@@ -314,6 +338,68 @@ class DesignTreeModel(QAbstractItemModel):
             return 0
         return len(parent_node.children)
 
+    def hasChildren(self, parent: QModelIndex | QPersistentModelIndex = QModelIndex()) -> bool:
+        """Check whether the given item can be expanded.
+        
+        A scope whose signals have not been fetched yet counts as having
+        children, so the view shows its expand arrow and calls fetchMore.
+        
+        Args:
+            parent: Parent item's index (invalid index means root level)
+            
+        Returns:
+            True if the item has or may have child rows
+        """
+        if parent.column() > 0:
+            return False
+
+        parent_node = parent.internalPointer() if parent.isValid() else self.root_node
+        if parent_node is None:
+            return False
+        return parent_node.vars_pending or len(parent_node.children) > 0
+
+    def canFetchMore(self, parent: QModelIndex | QPersistentModelIndex) -> bool:
+        """Check whether a scope still has signals to add from a lazy hierarchy.
+        
+        Args:
+            parent: Scope item's index
+            
+        Returns:
+            True if fetchMore would add the scope's signals
+        """
+        if not parent.isValid():
+            return False
+        node = parent.internalPointer()
+        return isinstance(node, DesignTreeNode) and node.vars_pending
+
+    def fetchMore(self, parent: QModelIndex | QPersistentModelIndex) -> None:
+        """Add a scope's signals ahead of its child scopes, reading only that scope.
+        
+        Args:
+            parent: Scope item's index
+        """
+        if not self.canFetchMore(parent) or not self.waveform_db or not self.waveform_db.hierarchy:
+            return
+
+        scope_node = parent.internalPointer()
+        scope_node.vars_pending = False
+        if scope_node.scope is None:
+            return
+
+        hierarchy = self.waveform_db.hierarchy
+        var_nodes = []
+        for var in scope_node.scope.vars(hierarchy):
+            var_node = self._create_var_node(var, hierarchy)
+            var_node.parent = scope_node
+            var_node.var_handle = self.waveform_db.get_handle_for_var(var)
+            var_nodes.append(var_node)
+        if not var_nodes:
+            return
+
+        self.beginInsertRows(parent, 0, len(var_nodes) - 1)
+        scope_node.children[:0] = var_nodes
+        self.endInsertRows()
+
     def columnCount(self, parent: QModelIndex | QPersistentModelIndex = QModelIndex()) -> int:
         """Get the number of columns in the model.
         
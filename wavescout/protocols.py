@@ -131,6 +131,15 @@ class WaveformDBProtocol(Protocol):
         """
         return None
     
+    def is_hierarchy_lazy(self) -> bool:
+        """Check whether scope vars are still read on demand.
+        
+        Returns:
+            True if handles are assigned as vars are first looked up, so
+            views should read a scope's vars only when it is expanded
+        """
+        return False
+    
     def get_next_available_handle(self) -> Optional[SignalHandle]:
         """Get next available handle for new signals.
         
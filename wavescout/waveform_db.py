@@ -1,9 +1,10 @@
 """WaveformDB implementation with backend-agnostic design."""
 
-from typing import List, Tuple, Optional, Dict, Literal
+from typing import List, Tuple, Optional, Dict, Literal, Sequence
 from pathlib import Path
 import threading
 
+from . import config
 from .data_model import Time, SignalHandle, Timescale, TimeUnit
 from .backend_types import (
     WWaveform, WVar, WHierarchy, WSignal, WTimeTable, WScope
@@ -14,12 +15,14 @@ from .backends import BackendFactory, BackendType, WaveformBackend
 class WaveformDB:
     """Waveform database with backend-agnostic design for reading VCD/FST files."""
     
-    def __init__(self, backend_preference: Optional[Literal["pywellen", "pylibfst"]] = None) -> None:
+    def __init__(self, backend_preference: Optional[Literal["pywellen", "pylibfst"]] = None,
+                 lazy_hierarchy: bool = False,
+                 signal_cache_bytes: Optional[int] = config.RENDERING.SIGNAL_CACHE_MAX_BYTES) -> None:
         self.waveform: Optional[WWaveform] = None
         self.hierarchy: Optional[WHierarchy] = None
         self.uri: Optional[str] = None
         self._var_map: Dict[SignalHandle, List[WVar]] = {}  # Map handles to list of variables (for aliases)
-        self._signal_cache: Dict[SignalHandle, WSignal] = {}  # Cache loaded signals
+        self._signal_cache: Dict[SignalHandle, WSignal] = {}  # Loaded signals, for backends without a cache of their own
         self._timescale: Optional[Timescale] = None  # Store parsed timescale
         self._var_name_to_handle: Dict[str, SignalHandle] = {}  # Map var full name to handle
         self._signal_ref_to_handle: Dict[int, SignalHandle] = {}  # Map SignalRef to our handle (for O(1) alias detection)
@@ -27,6 +30,10 @@ class WaveformDB:
         self._backend: Optional[WaveformBackend] = None  # Current backend instance
         self._backend_preference = backend_preference or "pywellen"  # Default to pywellen
         self._current_backend_type: Optional[Literal["pywellen", "pylibfst"]] = None
+        self._lazy_hierarchy = lazy_hierarchy  # Ask the backend to defer reading scope vars
+        self._vars_pending = False  # True while handles are only assigned to vars seen so far
+        self._signal_cache_bytes = signal_cache_bytes  # Budget of a backend's own signal cache, None for no limit
+        self._native_signal_cache = False  # True when the backend caches signals itself, within the budget
 
     @property
     def file_path(self) -> Optional[str]:
@@ -77,8 +84,11 @@ class WaveformDB:
             backend_type=backend_type
         )
         # Load waveform
-        self.waveform = self._backend.load_waveform()
+        self.waveform = self._backend.load_waveform(lazy_hierarchy=self._lazy_hierarchy,
+                                                    signal_cache_bytes=self._signal_cache_bytes)
         self.hierarchy = self._backend.get_hierarchy()
+        # Holding signals here as well would pin them and defeat the backend's budget
+        self._native_signal_cache = self._backend.get_signal_cache_stats() is not None
         load_end = time.time()
         
         print(f"  - Waveform loaded in {load_end - load_start:.2f} seconds")
@@ -86,6 +96,15 @@ class WaveformDB:
         # Extract and store timescale
         self._extract_timescale()
         
+        # A lazy hierarchy hands out handles as vars are first asked for, so
+        # skip the full walk and let the backend finish decoding meanwhile
+        self._vars_pending = self._backend.is_hierarchy_lazy()
+        if self._vars_pending:
+            self._backend.complete_hierarchy(background=True)
+            print("  - Variable mapping deferred (lazy hierarchy)")
+            print(f"  - Total load time: {time.time() - start_time:.2f} seconds")
+            return
+        
         # Build variable mapping with lazy loading and alias detection
         mapping_start = time.time()
         handle = 0
@@ -146,10 +165,54 @@ class WaveformDB:
         print(f"  - Number of unique signals: {len(self._var_map)}")
         print(f"  - Number of variables: {self.num_vars()}")
             
+    def is_hierarchy_lazy(self) -> bool:
+        """Check whether handles are still being assigned on demand.
+        
+        Returns:
+            True if the waveform was opened with a lazy hierarchy and no call
+            has needed the full variable mapping yet
+        """
+        return self._vars_pending
+    
+    def _register_var(self, var: WVar) -> Optional[SignalHandle]:
+        """Give a var seen for the first time a handle, in lazy mode.
+        
+        The handle is the var's signal_ref, so aliases share it and the
+        result does not depend on the order vars are first seen in.
+        """
+        if self.hierarchy is None:
+            return None
+        var_full_name = var.full_name(self.hierarchy)
+        handle = self._var_name_to_handle.get(var_full_name)
+        if handle is not None:
+            return handle
+        
+        handle = var.signal_ref()
+        if handle in self._var_map:
+            self._var_map[handle].append(var)
+        else:
+            self._var_map[handle] = [var]
+            self._signal_ref_to_handle[handle] = handle
+            self._handle_to_signal_ref[handle] = handle
+        self._var_name_to_handle[var_full_name] = handle
+        return handle
+    
+    def _ensure_all_vars(self) -> None:
+        """Finish the hierarchy and register every var, leaving lazy mode."""
+        if not self._vars_pending:
+            return
+        if self._backend is not None:
+            self._backend.complete_hierarchy()
+        if self.hierarchy is not None:
+            for var in self.hierarchy.all_vars():
+                self._register_var(var)
+        self._vars_pending = False
+    
     def top_signals(self) -> List[SignalHandle]:
         """Get handles for top-level signals."""
         if not self.waveform or not self.hierarchy:
             return []
+        self._ensure_all_vars()
             
         handles = []
         hierarchy = self.hierarchy  # Local variable for type checker
@@ -218,6 +281,25 @@ class WaveformDB:
         
         return (value_str, query_result.next_time)
         
+    def sample_numeric(self, handle: SignalHandle, times: List[Time], signed: bool = False) -> Optional[Sequence[float]]:
+        """Sample a signal at many times as numbers, in one sweep over its changes.
+        
+        Args:
+            handle: Signal to sample
+            times: Times to sample at, cheapest when ascending
+            signed: Read bit vectors as two's complement rather than unsigned
+        
+        Returns:
+            One float per time, NaN before the first change or where the value
+            holds x/z, or None if the backend's signals cannot sample in bulk
+        """
+        signal = self.get_signal(handle)
+        sample_at_times = getattr(signal, 'sample_at_times', None)
+        if sample_at_times is None:
+            return None
+        
+        return sample_at_times([max(0, t) for t in times], signed)
+        
     def close(self) -> None:
         """Close the waveform file."""
         self.waveform = None
@@ -230,6 +312,8 @@ class WaveformDB:
         self._handle_to_signal_ref.clear()
         self._backend = None
         self._current_backend_type = None
+        self._vars_pending = False
+        self._native_signal_cache = False
         
     def _extract_timescale(self) -> None:
         """Extract timescale from the hierarchy."""
@@ -276,6 +360,7 @@ class WaveformDB:
         
     def num_vars(self) -> int:
         """Get total number of unique variables (counting all aliases)."""
+        self._ensure_all_vars()
         total = 0
         for vars_list in self._var_map.values():
             total += len(vars_list)
@@ -309,6 +394,10 @@ class WaveformDB:
         if not vars_list:
             return None
         
+        # The backend's own cache answers repeat requests until it evicts the signal
+        if self._native_signal_cache and self._backend is not None:
+            return self._backend.get_signal(vars_list[0])
+        
         # Load signal lazily if not cached
         if handle not in self._signal_cache:
             if self._backend is not None:
@@ -348,7 +437,7 @@ class WaveformDB:
         Returns:
             True if all signals are cached, False otherwise
         """
-        return all(handle in self._signal_cache for handle in handles)
+        return all(self.is_signal_cached(handle) for handle in handles)
     
     def preload_signals(self, handles: List[SignalHandle], multithreaded: bool = False) -> None:
         """Preload multiple signals using efficient batch loading.
@@ -380,7 +469,7 @@ class WaveformDB:
         # Filter out already cached signals and invalid handles
         handles_to_load = [
             h for h in unique_handles 
-            if h not in self._signal_cache and h in self._var_map
+            if h in self._var_map and not self.is_signal_cached(h)
         ]
         
         if not handles_to_load:
@@ -416,7 +505,8 @@ class WaveformDB:
             for var, signal in zip(vars_to_load, loaded_signals):
                 handle_or_none = handle_to_var_map.get(id(var))
                 if handle_or_none is not None and signal is not None:
-                    self._signal_cache[handle_or_none] = signal
+                    if not self._native_signal_cache:
+                        self._signal_cache[handle_or_none] = signal
                     cached_count += 1
             cache_time = time.perf_counter() - cache_start
             
@@ -440,6 +530,7 @@ class WaveformDB:
     
     def get_all_handles(self) -> List[SignalHandle]:
         """Get all handle IDs in the database."""
+        self._ensure_all_vars()
         return list(self._var_map.keys())
     
     def get_handle_for_var(self, var: WVar) -> Optional[SignalHandle]:
@@ -454,6 +545,8 @@ class WaveformDB:
         # Get the full name of the var and look it up
         if self.hierarchy is None:
             return None
+        if self._vars_pending:
+            return self._register_var(var)
         var_full_name = var.full_name(self.hierarchy)
         return self._var_name_to_handle.get(var_full_name)
     
@@ -466,7 +559,13 @@ class WaveformDB:
         Returns:
             Handle ID if found, None otherwise
         """
-        return self._var_name_to_handle.get(name)
+        handle = self._var_name_to_handle.get(name)
+        if handle is None and self._vars_pending and self._backend is not None:
+            # Decode just the scope the name points into
+            var = self._backend.find_var_by_path(name)
+            if var is not None:
+                handle = self._register_var(var)
+        return handle
     
     def get_var_to_handle_mapping(self) -> Dict[WVar, int]:
         """Get complete variable-to-handle mapping.
@@ -474,6 +573,7 @@ class WaveformDB:
         Returns:
             Dictionary mapping backend-agnostic variable objects to handle IDs
         """
+        self._ensure_all_vars()
         var_to_handle = {}
         for handle, vars_list in self._var_map.items():
             for var in vars_list:
@@ -482,11 +582,31 @@ class WaveformDB:
     
     def get_next_available_handle(self) -> int:
         """Get the next available handle ID."""
-        return len(self._var_map) if self._var_map else 0
+        self._ensure_all_vars()
+        return max(self._var_map) + 1 if self._var_map else 0
     
     def clear_signal_cache(self) -> None:
-        """Clear the signal cache. Primarily for testing."""
+        """Clear the signal cache. Primarily for testing.
+        
+        A backend's own cache drops every signal too, including ones still
+        referenced elsewhere, and does not count them as evictions.
+        """
         self._signal_cache.clear()
+        if self._backend is not None:
+            self._backend.clear_signal_cache()
+    
+    def set_signal_cache_budget(self, budget_bytes: Optional[int]) -> None:
+        """Change the byte budget of the backend's own signal cache.
+        
+        Applies to the open waveform, evicting at once if over the new budget,
+        and to waveforms opened later. Backends without such a cache ignore it.
+        
+        Args:
+            budget_bytes: New budget, None for no limit
+        """
+        self._signal_cache_bytes = budget_bytes
+        if self._backend is not None:
+            self._backend.set_signal_cache_budget(budget_bytes)
     
     def is_signal_cached(self, handle: SignalHandle) -> bool:
         """Check if signal is cached for the given handle.
@@ -499,6 +619,9 @@ class WaveformDB:
         Returns:
             True if signal is cached, False otherwise
         """
+        if self._native_signal_cache and self._backend is not None:
+            vars_list = self._var_map.get(handle)
+            return bool(vars_list) and bool(self._backend.is_signal_cached(vars_list[0]))
         return handle in self._signal_cache
     
     def iter_handles_and_vars(self) -> List[Tuple[int, List[WVar]]]:
@@ -507,6 +630,7 @@ class WaveformDB:
         Returns:
             List of tuples (handle, vars_list)
         """
+        self._ensure_all_vars()
         return list(self._var_map.items())
     
     def find_handle_by_path(self, path: str) -> Optional[SignalHandle]:
@@ -548,6 +672,17 @@ class WaveformDB:
                 return int(width)
         return 32  # Default bit width
     
+    def get_signal_cache_stats(self) -> Optional[Dict[str, Optional[int]]]:
+        """Get the backend's signal cache counters, to show cache pressure.
+        
+        Returns:
+            Dict with hits, misses, evictions, evicted_bytes, bytes, entries and
+            budget, or None if the backend keeps no signal cache of its own
+        """
+        if self._backend is None:
+            return None
+        return self._backend.get_signal_cache_stats()
+    
     def get_backend_type(self) -> Optional[BackendType]:
         """Get the current backend type.
         